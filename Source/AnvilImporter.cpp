@@ -0,0 +1,1111 @@
+#include "AnvilImporter.h"
+#include "Inflate.h"
+#include "TaskScheduler.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace donut;
+
+static const int k_ChunkSize = 16;
+static const int k_RegionChunks = 32;
+static const uint64_t k_SectorBytes = 4096;
+static const int k_MinSectionY = -4;		//Worlds since 1.18 start at y = -64
+static const int k_NumSections = 24;		//Up to y = 319
+static const uint k_SectionBlocks = 4096;
+//Data version of 1.13 (first version with block state palettes) and of 20w17a, from where on entries do not span two longs
+static const int k_PaletteDataVersion = 1451;
+static const int k_NonSpanningDataVersion = 2529;
+//Chunks per task when decoding and meshing
+static const uint64_t k_ChunkGrainSize = 4;
+
+enum NbtTag : uint8_t {
+	TAG_End, TAG_Byte, TAG_Short, TAG_Int, TAG_Long, TAG_Float, TAG_Double, TAG_ByteArray, TAG_String, TAG_List, TAG_Compound, TAG_IntArray, TAG_LongArray
+};
+
+namespace {
+	//Streaming reader for big endian NBT. Payloads that are not read by the callbacks are skipped without allocations
+	class NbtReader {
+	public:
+		NbtReader(const uint8_t* data, size_t size) : m_Data(data), m_Size(size) {}
+
+		bool IsValid() const { return m_Valid; }
+
+		int8_t ReadByte() { return int8_t(ReadBigEndian(1)); }
+		int32_t ReadInt() { return int32_t(ReadBigEndian(4)); }
+		std::string_view ReadString() {
+			uint16_t length = uint16_t(ReadBigEndian(2));
+			if (!Require(length))
+				return {};
+			std::string_view str(reinterpret_cast<const char*>(m_Data + m_Pos), length);
+			m_Pos += length;
+			return str;
+		}
+		//Returns the big endian longs of a long array
+		const uint8_t* ReadLongArray(uint32_t& count) {
+			int32_t length = ReadInt();
+			count = 0;
+			if (length < 0 || !Require(size_t(length) * 8)) {
+				m_Valid = false;
+				return nullptr;
+			}
+			const uint8_t* longs = m_Data + m_Pos;
+			m_Pos += size_t(length) * 8;
+			count = uint32_t(length);
+			return longs;
+		}
+
+		//func(type, name) reads the payload of an entry or returns false to skip it
+		template<typename Func> void ReadRoot(Func func) {
+			if (ReadByte() != TAG_Compound) {
+				m_Valid = false;
+				return;
+			}
+			ReadString();
+			ReadCompound(func);
+		}
+		template<typename Func> void ReadCompound(Func func) {
+			while (m_Valid) {
+				uint8_t type = uint8_t(ReadByte());
+				if (type == TAG_End || !m_Valid)
+					return;
+				std::string_view name = ReadString();
+				if (!func(type, name))
+					Skip(type);
+			}
+		}
+		//func(elementType) reads one element or returns false to skip it
+		template<typename Func> void ReadList(Func func) {
+			uint8_t type = uint8_t(ReadByte());
+			int32_t count = ReadInt();
+			for (int32_t i = 0; i < count && m_Valid; i++) {
+				if (!func(type))
+					Skip(type);
+			}
+		}
+
+		void Skip(uint8_t type, int depth = 0) {
+			if (depth > k_MaxDepth) {
+				m_Valid = false;
+				return;
+			}
+			switch (type) {
+			case TAG_Byte: Advance(1); break;
+			case TAG_Short: Advance(2); break;
+			case TAG_Int: case TAG_Float: Advance(4); break;
+			case TAG_Long: case TAG_Double: Advance(8); break;
+			case TAG_ByteArray: AdvanceArray(1); break;
+			case TAG_IntArray: AdvanceArray(4); break;
+			case TAG_LongArray: AdvanceArray(8); break;
+			case TAG_String: ReadString(); break;
+			case TAG_List: {
+				uint8_t elementType = uint8_t(ReadByte());
+				int32_t count = ReadInt();
+				for (int32_t i = 0; i < count && m_Valid; i++)
+					Skip(elementType, depth + 1);
+				break;
+			}
+			case TAG_Compound:
+				while (m_Valid) {
+					uint8_t entryType = uint8_t(ReadByte());
+					if (entryType == TAG_End)
+						break;
+					ReadString();
+					Skip(entryType, depth + 1);
+				}
+				break;
+			default:
+				m_Valid = false;
+				break;
+			}
+		}
+
+	private:
+		static const int k_MaxDepth = 512;
+
+		bool Require(size_t bytes) {
+			if (m_Pos + bytes > m_Size)
+				m_Valid = false;
+			return m_Valid;
+		}
+		uint64_t ReadBigEndian(unsigned bytes) {
+			if (!Require(bytes))
+				return 0;
+			uint64_t value = 0;
+			for (unsigned i = 0; i < bytes; i++)
+				value = (value << 8) | m_Data[m_Pos++];
+			return value;
+		}
+		void Advance(size_t bytes) {
+			if (Require(bytes))
+				m_Pos += bytes;
+		}
+		void AdvanceArray(size_t elementBytes) {
+			int32_t length = ReadInt();
+			if (length < 0)
+				m_Valid = false;
+			else
+				Advance(size_t(length) * elementBytes);
+		}
+
+		const uint8_t* m_Data;
+		size_t m_Size;
+		size_t m_Pos = 0;
+		bool m_Valid = true;
+	};
+
+	//Blocks of a chunk column. Sections start with local palette indices and are remapped to global block states
+	struct ChunkColumn {
+		int2 position;
+		bool valid = false;
+		uint16_t uniform[k_NumSections] = {};				//Block state of sections without per block data
+		std::vector<uint16_t> blocks[k_NumSections];		//Block state per block in y, z, x order, empty for uniform sections
+		std::vector<std::string> palettes[k_NumSections];	//Block state keys, only needed until the sections are remapped
+
+		uint16_t Get(int x, int y, int z) const {
+			int section = (y >> 4) - k_MinSectionY;
+			if (section < 0 || section >= k_NumSections)
+				return 0;
+			const std::vector<uint16_t>& sectionBlocks = blocks[section];
+			return sectionBlocks.empty() ? uniform[section] : sectionBlocks[((y & 15) << 8) | (z << 4) | x];
+		}
+	};
+
+	//Location of a stored chunk inside the data read from its region file
+	struct ChunkSource {
+		int2 position;
+		uint region = 0;
+		uint64_t offset = 0;
+		uint64_t size = 0;
+	};
+
+	enum class BlockShape : uint8_t { Air, Box, Cross, Skip };
+
+	struct BlockModel {
+		BlockShape shape = BlockShape::Air;
+		float minY = 0.f;				//Box height inside the block
+		float maxY = 1.f;
+		int materials[6] = {};			//Face materials in AABBMaterials order (-x, -y, -z, +x, +y, +z), crosses use the first
+		bool opaque = false;			//Full block that hides the faces of its neighbours
+		bool cullsSame = false;			//Faces towards the same block state are hidden (water, glass)
+		bool approximated = false;		//Model replaced by a full block
+	};
+
+	//Creates one .mtl style material per texture, in the same form as the ones from a Mineways export
+	class MaterialTable {
+	public:
+		MaterialTable(const std::filesystem::path& sceneFolder, const std::string& textureFolder) : m_TextureFolder(textureFolder) {
+			std::error_code ec;
+			if (textureFolder.empty())
+				return;
+			for (const auto& file : std::filesystem::directory_iterator(sceneFolder / textureFolder, ec)) {
+				if (file.path().extension() == ".png")
+					m_Textures.insert(file.path().stem().string());
+			}
+		}
+
+		bool HasTexture(const std::string& name) const { return m_Textures.count(name) != 0; }
+
+		//Returns the first existing texture, or the first candidate if none exists
+		std::string FindTexture(std::initializer_list<std::string> candidates) const {
+			for (const std::string& candidate : candidates) {
+				if (HasTexture(candidate))
+					return candidate;
+			}
+			return *candidates.begin();
+		}
+
+		int GetMaterial(const std::string& texture, bool alphaTested, bool emissive) {
+			std::string key = texture + (alphaTested ? "|a" : "") + (emissive ? "|e" : "");
+			auto it = m_MaterialIDs.find(key);
+			if (it != m_MaterialIDs.end())
+				return it->second;
+
+			tinyobj::material_t material = {};
+			material.name = texture;
+			material.dissolve = 1.f;
+			auto texturePath = [&](const std::string& name) { return m_TextureFolder + "/" + name + ".png"; };
+			if (HasTexture(texture)) {
+				for (int i = 0; i < 3; i++)
+					material.diffuse[i] = 1.f;
+				material.diffuse_texname = texturePath(texture);
+				if (alphaTested)
+					material.alpha_texname = material.diffuse_texname;
+				//PBR maps of the Mineways tile export
+				if (HasTexture(texture + "_n"))
+					material.normal_texname = texturePath(texture + "_n");
+				if (HasTexture(texture + "_r"))
+					material.roughness_texname = texturePath(texture + "_r");
+				if (HasTexture(texture + "_m"))
+					material.metallic_texname = texturePath(texture + "_m");
+			}
+			else {
+				for (int i = 0; i < 3; i++)
+					material.diffuse[i] = 0.5f;
+				m_NumMissingTextures++;
+			}
+			if (emissive) {
+				for (int i = 0; i < 3; i++)
+					material.emission[i] = 1.f;
+				if (HasTexture(texture + "_e"))
+					material.emissive_texname = texturePath(texture + "_e");
+				else if (HasTexture(texture))
+					material.emissive_texname = material.diffuse_texname;
+			}
+
+			int id = int(m_Materials.size());
+			m_Materials.push_back(material);
+			m_MaterialIDs[key] = id;
+			return id;
+		}
+
+		std::vector<tinyobj::material_t>& GetMaterials() { return m_Materials; }
+		uint GetNumMissingTextures() const { return m_NumMissingTextures; }
+
+	private:
+		std::string m_TextureFolder;
+		std::unordered_set<std::string> m_Textures;
+		std::vector<tinyobj::material_t> m_Materials;
+		std::unordered_map<std::string, int> m_MaterialIDs;
+		uint m_NumMissingTextures = 0;
+	};
+}
+
+//Properties that change the imported model or texture. All others are dropped to keep the number of block states small
+static const char* k_UsedProperties[] = { "age", "axis", "half", "layers", "lit", "moisture", "snowy", "type" };
+
+static const char* k_AirBlocks[] = { "air", "cave_air", "void_air", "structure_void", "barrier", "light" };
+static const char* k_CrossBlocks[] = { "grass", "short_grass", "fern", "dead_bush", "dandelion", "poppy", "blue_orchid", "allium", "azure_bluet",
+	"red_tulip", "orange_tulip", "white_tulip", "pink_tulip", "oxeye_daisy", "cornflower", "lily_of_the_valley", "wither_rose", "torchflower",
+	"brown_mushroom", "red_mushroom", "crimson_fungus", "warped_fungus", "crimson_roots", "warped_roots", "nether_sprouts", "cobweb",
+	"sugar_cane", "seagrass", "kelp", "kelp_plant", "hanging_roots" };
+static const char* k_DoublePlants[] = { "tall_grass", "large_fern", "sunflower", "lilac", "rose_bush", "peony", "tall_seagrass" };
+static const char* k_EmissiveBlocks[] = { "glowstone", "sea_lantern", "shroomlight", "jack_o_lantern", "lava", "magma_block", "torch", "wall_torch",
+	"soul_torch", "soul_wall_torch", "lantern", "soul_lantern", "end_rod", "beacon", "crying_obsidian", "ochre_froglight", "verdant_froglight",
+	"pearlescent_froglight" };
+//Name parts of thin attachments that are not imported
+static const char* k_SkippedParts[] = { "rail", "button", "sign", "banner", "lever", "tripwire", "redstone_wire", "ladder", "pressure_plate",
+	"pane", "iron_bars", "vine", "item_frame", "_head", "skull", "lichen", "lily_pad", "sculk_vein", "string" };
+static const char* k_SkippedBlocks[] = { "fire", "soul_fire", "water_cauldron", "moving_piston", "nether_portal", "end_portal", "end_gateway" };
+//Name parts of block models that are approximated by a full block
+static const char* k_ApproximatedParts[] = { "stairs", "fence", "wall", "door", "bed", "chest", "flower_pot", "potted_", "cake", "anvil",
+	"cauldron", "hopper", "bell", "campfire", "candle", "lectern", "grindstone", "stonecutter", "enchanting_table", "brewing_stand", "chain",
+	"end_rod", "lightning_rod", "dripstone", "amethyst_cluster", "_bud", "cactus", "chorus", "bamboo", "azalea", "dripleaf", "conduit",
+	"piston", "composter", "daylight_detector", "repeater", "comparator", "sea_pickle", "turtle_egg", "frogspawn", "sniffer_egg",
+	"decorated_pot", "mangrove_roots", "snow_layer", "pitcher", "pink_petals", "coral" };
+
+template<size_t N> static bool IsOneOf(const std::string& name, const char* (&list)[N]) {
+	for (const char* entry : list) {
+		if (name == entry)
+			return true;
+	}
+	return false;
+}
+
+template<size_t N> static bool ContainsAny(const std::string& name, const char* (&list)[N]) {
+	for (const char* entry : list) {
+		if (name.find(entry) != std::string::npos)
+			return true;
+	}
+	return false;
+}
+
+static bool EndsWith(const std::string& str, const std::string& suffix) {
+	return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+//Value of a property in a block state key ("name;property=value;..."), empty if it is not set
+static std::string GetProperty(const std::string& key, const std::string& property) {
+	std::string pattern = ";" + property + "=";
+	size_t pos = key.find(pattern);
+	if (pos == std::string::npos)
+		return "";
+	pos += pattern.size();
+	return key.substr(pos, key.find(';', pos) - pos);
+}
+
+static std::string ReadBlockState(NbtReader& reader) {
+	std::string name;
+	std::vector<std::string> properties;
+	reader.ReadCompound([&](uint8_t type, std::string_view entry) {
+		if (entry == "Name" && type == TAG_String) {
+			name = std::string(reader.ReadString());
+			return true;
+		}
+		if (entry == "Properties" && type == TAG_Compound) {
+			reader.ReadCompound([&](uint8_t propertyType, std::string_view property) {
+				bool used = std::any_of(std::begin(k_UsedProperties), std::end(k_UsedProperties), [&](const char* p) { return property == p; });
+				if (propertyType != TAG_String || !used)
+					return false;
+				properties.push_back(";" + std::string(property) + "=" + std::string(reader.ReadString()));
+				return true;
+			});
+			return true;
+		}
+		return false;
+	});
+
+	const std::string prefix = "minecraft:";
+	if (name.compare(0, prefix.size(), prefix) == 0)
+		name = name.substr(prefix.size());
+	std::sort(properties.begin(), properties.end());
+	for (const std::string& property : properties)
+		name += property;
+	return name;
+}
+
+//Unpacks the palette indices of a section. Before 20w17a the entries span two longs, the bit width follows from the array length
+static bool UnpackSection(const uint8_t* longs, uint32_t numLongs, size_t paletteSize, bool spanning, std::vector<uint16_t>& indices) {
+	auto getLong = [&](uint32_t i) {
+		uint64_t value = 0;
+		for (uint32_t b = 0; b < 8; b++)
+			value = (value << 8) | longs[i * 8 + b];
+		return value;
+	};
+
+	indices.resize(k_SectionBlocks);
+	if (spanning) {
+		uint bits = numLongs * 64 / k_SectionBlocks;
+		if (bits < 4 || bits > 16 || bits * k_SectionBlocks != numLongs * 64)
+			return false;
+		for (uint i = 0; i < k_SectionBlocks; i++) {
+			uint64_t bitIndex = uint64_t(i) * bits;
+			uint32_t word = uint32_t(bitIndex / 64);
+			uint shift = uint(bitIndex % 64);
+			uint64_t value = getLong(word) >> shift;
+			if (shift + bits > 64)
+				value |= getLong(word + 1) << (64 - shift);
+			indices[i] = uint16_t(value & ((uint64_t(1) << bits) - 1));
+		}
+	}
+	else {
+		auto numLongsForBits = [](uint b) { uint perLong = 64 / b; return (k_SectionBlocks + perLong - 1) / perLong; };
+		uint bits = 4;
+		while ((size_t(1) << bits) < paletteSize)
+			bits++;
+		//Some versions use wider entries than needed
+		while (bits <= 16 && numLongsForBits(bits) != numLongs)
+			bits++;
+		if (bits > 16)
+			return false;
+		const uint perLong = 64 / bits;
+		const uint64_t mask = (uint64_t(1) << bits) - 1;
+		for (uint32_t word = 0; word < numLongs; word++) {
+			uint64_t value = getLong(word);
+			for (uint j = 0; j < perLong && word * perLong + j < k_SectionBlocks; j++)
+				indices[word * perLong + j] = uint16_t((value >> (j * bits)) & mask);
+		}
+	}
+
+	for (uint16_t& index : indices) {
+		if (index >= paletteSize)
+			index = 0;
+	}
+	return true;
+}
+
+//Parses the chunk NBT into the sections with local palettes
+static bool DecodeChunk(const uint8_t* nbt, size_t size, ChunkColumn& column) {
+	struct RawSection {
+		int y = 0;
+		std::vector<std::string> palette;
+		const uint8_t* longs = nullptr;
+		uint32_t numLongs = 0;
+	};
+	std::vector<RawSection> sections;
+	int dataVersion = 0;
+	std::string status;
+
+	NbtReader reader(nbt, size);
+	auto readPalette = [&](RawSection& section) {
+		reader.ReadList([&](uint8_t type) {
+			if (type != TAG_Compound)
+				return false;
+			section.palette.push_back(ReadBlockState(reader));
+			return true;
+		});
+	};
+	auto readSections = [&]() {
+		reader.ReadList([&](uint8_t type) {
+			if (type != TAG_Compound)
+				return false;
+			RawSection section;
+			reader.ReadCompound([&](uint8_t entryType, std::string_view name) {
+				if (name == "Y" && entryType == TAG_Byte) {
+					section.y = reader.ReadByte();
+					return true;
+				}
+				//Since 1.18
+				if (name == "block_states" && entryType == TAG_Compound) {
+					reader.ReadCompound([&](uint8_t stateType, std::string_view stateName) {
+						if (stateName == "palette" && stateType == TAG_List) {
+							readPalette(section);
+							return true;
+						}
+						if (stateName == "data" && stateType == TAG_LongArray) {
+							section.longs = reader.ReadLongArray(section.numLongs);
+							return true;
+						}
+						return false;
+					});
+					return true;
+				}
+				//1.13 - 1.17
+				if (name == "Palette" && entryType == TAG_List) {
+					readPalette(section);
+					return true;
+				}
+				if (name == "BlockStates" && entryType == TAG_LongArray) {
+					section.longs = reader.ReadLongArray(section.numLongs);
+					return true;
+				}
+				return false;
+			});
+			sections.push_back(std::move(section));
+			return true;
+		});
+	};
+	auto readChunkEntry = [&](uint8_t type, std::string_view name) {
+		if (name == "DataVersion" && type == TAG_Int) {
+			dataVersion = reader.ReadInt();
+			return true;
+		}
+		if (name == "Status" && type == TAG_String) {
+			status = std::string(reader.ReadString());
+			return true;
+		}
+		if ((name == "sections" || name == "Sections") && type == TAG_List) {
+			readSections();
+			return true;
+		}
+		return false;
+	};
+	reader.ReadRoot([&](uint8_t type, std::string_view name) {
+		//Before 1.18 the chunk data is inside a "Level" compound
+		if (name == "Level" && type == TAG_Compound) {
+			reader.ReadCompound(readChunkEntry);
+			return true;
+		}
+		return readChunkEntry(type, name);
+	});
+
+	//Only fully generated chunks, the ones at the border of the explored area miss features like trees
+	bool generated = status.empty() || EndsWith(status, "full") || status == "postprocessed" || status == "fullchunk";
+	if (!reader.IsValid() || dataVersion < k_PaletteDataVersion || !generated)
+		return false;
+
+	const bool spanning = dataVersion < k_NonSpanningDataVersion;
+	for (RawSection& section : sections) {
+		int index = section.y - k_MinSectionY;
+		if (index < 0 || index >= k_NumSections || section.palette.empty())
+			continue;
+		if (section.palette.size() == 1) {
+			if (IsOneOf(section.palette[0], k_AirBlocks))
+				continue;
+		}
+		else if (!section.longs || !UnpackSection(section.longs, section.numLongs, section.palette.size(), spanning, column.blocks[index])) {
+			column.blocks[index].clear();
+			continue;
+		}
+		column.palettes[index] = std::move(section.palette);
+	}
+	return true;
+}
+
+//Texture of a block, or of the block a slab, stair or wall is made of
+static std::string FindBaseTexture(const MaterialTable& table, const std::string& base) {
+	for (const std::string& candidate : { base, base + "s", base + "_planks", base + "_block" }) {
+		if (table.HasTexture(candidate) || table.HasTexture(candidate + "_side") || table.HasTexture(candidate + "_top"))
+			return candidate;
+	}
+	return base;
+}
+
+static BlockModel CreateBlockModel(const std::string& key, MaterialTable& table) {
+	BlockModel model;
+	const std::string name = key.substr(0, key.find(';'));
+	if (IsOneOf(name, k_AirBlocks))
+		return model;
+
+	const bool emissive = IsOneOf(name, k_EmissiveBlocks) || (GetProperty(key, "lit") == "true" && name.find("redstone") != std::string::npos);
+	auto setAllFaces = [&](int material) {
+		for (int& faceMaterial : model.materials)
+			faceMaterial = material;
+	};
+
+	//Crossed quads
+	std::string crossTexture;
+	if (IsOneOf(name, k_CrossBlocks) || EndsWith(name, "_sapling")) {
+		crossTexture = name == "grass" || name == "short_grass" ? table.FindTexture({ "short_grass", "grass" }) : name;
+	}
+	else if (IsOneOf(name, k_DoublePlants)) {
+		crossTexture = name + (GetProperty(key, "half") == "upper" ? "_top" : "_bottom");
+	}
+	else if (name == "wheat" || name == "carrots" || name == "potatoes" || name == "beetroots" || name == "sweet_berry_bush") {
+		//Crops with 8 ages only have 4 textures, except wheat
+		static const int k_FourStages[8] = { 0, 0, 1, 1, 2, 2, 2, 3 };
+		int age = std::clamp(atoi(GetProperty(key, "age").c_str()), 0, 7);
+		int stage = name == "wheat" || name == "beetroots" || name == "sweet_berry_bush" ? age : k_FourStages[age];
+		crossTexture = name + "_stage" + std::to_string(stage);
+	}
+	else if (name.find("torch") != std::string::npos) {
+		std::string torch = name;
+		size_t wall = torch.find("wall_");
+		if (wall != std::string::npos)
+			torch.erase(wall, 5);
+		crossTexture = torch == "redstone_torch" && GetProperty(key, "lit") == "false" ? "redstone_torch_off" : torch;
+	}
+	else if (name == "lantern" || name == "soul_lantern") {
+		crossTexture = name;
+	}
+	if (!crossTexture.empty()) {
+		model.shape = BlockShape::Cross;
+		setAllFaces(table.GetMaterial(crossTexture, true, emissive));
+		return model;
+	}
+
+	if (IsOneOf(name, k_SkippedBlocks) || ContainsAny(name, k_SkippedParts)) {
+		model.shape = BlockShape::Skip;
+		return model;
+	}
+
+	//Boxes
+	model.shape = BlockShape::Box;
+	const bool alphaTested = name.find("leaves") != std::string::npos || name.find("glass") != std::string::npos || name.find("ice") != std::string::npos ||
+		name == "slime_block" || name == "honey_block" || name == "spawner";
+	model.cullsSame = name == "water" || name == "lava" || name.find("glass") != std::string::npos || name.find("ice") != std::string::npos;
+
+	std::string base = name;
+	if (name == "water" || name == "lava") {
+		setAllFaces(table.GetMaterial(table.FindTexture({ name + "_still", name }), false, emissive));
+		return model;
+	}
+	if (EndsWith(name, "_carpet")) {
+		model.maxY = 1.f / 16.f;
+		base = name == "moss_carpet" ? "moss_block" : name.substr(0, name.size() - 7) + "_wool";
+	}
+	else if (name == "snow") {
+		model.maxY = float(std::clamp(atoi(GetProperty(key, "layers").c_str()), 1, 8)) / 8.f;
+		base = "snow";
+	}
+	else if (EndsWith(name, "_slab")) {
+		std::string type = GetProperty(key, "type");
+		if (type == "bottom")
+			model.maxY = 0.5f;
+		else if (type == "top")
+			model.minY = 0.5f;
+		base = FindBaseTexture(table, name == "smooth_stone_slab" ? "smooth_stone" : name.substr(0, name.size() - 5));
+	}
+	else if (name == "farmland" || name == "dirt_path") {
+		model.maxY = 15.f / 16.f;
+	}
+	else if (ContainsAny(name, k_ApproximatedParts)) {
+		model.approximated = true;
+		for (const char* suffix : { "_stairs", "_fence_gate", "_fence", "_wall" }) {
+			if (EndsWith(name, suffix)) {
+				base = FindBaseTexture(table, name.substr(0, name.size() - strlen(suffix)));
+				break;
+			}
+		}
+		if (EndsWith(name, "_door"))
+			base = name + (GetProperty(key, "half") == "upper" ? "_top" : "_bottom");
+	}
+	else if (EndsWith(name, "_wood") || EndsWith(name, "_hyphae")) {
+		//Bark on all sides
+		std::string log = name.substr(0, name.rfind('_')) + (EndsWith(name, "_wood") ? "_log" : "_stem");
+		setAllFaces(table.GetMaterial(table.FindTexture({ log, name }), alphaTested, emissive));
+		model.opaque = !alphaTested;
+		return model;
+	}
+	else if (name == "redstone_lamp" && GetProperty(key, "lit") == "true") {
+		base = "redstone_lamp_on";
+	}
+
+	std::string side = table.FindTexture({ base + "_side", base });
+	std::string top = table.FindTexture({ base + "_top", base });
+	std::string bottom = table.FindTexture({ base + "_bottom", top });
+	if (name == "grass_block" || name == "podzol" || name == "mycelium" || name == "farmland" || name == "dirt_path") {
+		bottom = "dirt";
+		if (name == "farmland") {
+			top = GetProperty(key, "moisture") == "7" ? "farmland_moist" : "farmland";
+			side = "dirt";
+		}
+		if (GetProperty(key, "snowy") == "true")
+			side = table.FindTexture({ "grass_block_snow", side });
+	}
+
+	int sideMaterial = table.GetMaterial(side, alphaTested, emissive);
+	int topMaterial = table.GetMaterial(top, alphaTested, emissive);
+	int bottomMaterial = table.GetMaterial(bottom, alphaTested, emissive);
+	setAllFaces(sideMaterial);
+	//Logs and pillars show their top texture on the faces along their axis
+	std::string axis = GetProperty(key, "axis");
+	int axisIndex = axis == "x" ? 0 : axis == "z" ? 2 : 1;
+	model.materials[axisIndex] = axisIndex == 1 ? bottomMaterial : topMaterial;
+	model.materials[axisIndex + 3] = topMaterial;
+
+	model.opaque = !alphaTested && !model.approximated && !model.cullsSame && model.minY == 0.f && model.maxY == 1.f;
+	return model;
+}
+
+bool AnvilImporter::IsWorldFolder(const std::filesystem::path& folder)
+{
+	std::error_code ec;
+	return std::filesystem::is_directory(folder / "region", ec) && !FindRegionFiles(folder).empty();
+}
+
+std::vector<AnvilImporter::RegionFile> AnvilImporter::FindRegionFiles(const std::filesystem::path& worldFolder)
+{
+	std::vector<RegionFile> regionFiles;
+	std::error_code ec;
+	for (const auto& file : std::filesystem::directory_iterator(worldFolder / "region", ec)) {
+		RegionFile regionFile;
+		char extension[4] = {};
+		std::string fileName = file.path().filename().string();
+		if (file.is_regular_file(ec) && sscanf(fileName.c_str(), "r.%d.%d.%3s", &regionFile.position.x, &regionFile.position.y, extension) == 3 &&
+			std::string(extension) == "mca" && file.file_size(ec) >= 2 * k_SectorBytes) {
+			regionFile.path = file.path();
+			regionFiles.push_back(regionFile);
+		}
+	}
+	std::sort(regionFiles.begin(), regionFiles.end(), [](const RegionFile& a, const RegionFile& b) {
+		return a.position.y != b.position.y ? a.position.y < b.position.y : a.position.x < b.position.x;
+	});
+	return regionFiles;
+}
+
+std::vector<int2> AnvilImporter::GetChunkPositions(const RegionFile& regionFile)
+{
+	std::vector<int2> positions;
+	std::ifstream stream(regionFile.path, std::ios::binary);
+	uint8_t header[k_SectorBytes];
+	if (!stream.read(reinterpret_cast<char*>(header), sizeof(header)))
+		return positions;
+
+	for (int i = 0; i < k_RegionChunks * k_RegionChunks; i++) {
+		uint32_t location = (uint32_t(header[i * 4]) << 24) | (header[i * 4 + 1] << 16) | (header[i * 4 + 2] << 8) | header[i * 4 + 3];
+		if (location != 0)
+			positions.push_back(regionFile.position * k_RegionChunks + int2(i % k_RegionChunks, i / k_RegionChunks));
+	}
+	return positions;
+}
+
+bool AnvilImporter::ReadSpawn(const std::filesystem::path& worldFolder, int2& spawn)
+{
+	std::ifstream stream(worldFolder / "level.dat", std::ios::binary);
+	std::vector<uint8_t> compressed((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+	std::vector<uint8_t> nbt;
+	if (compressed.empty() || !Inflate::Gzip(compressed.data(), compressed.size(), nbt))
+		return false;
+
+	bool foundX = false;
+	bool foundZ = false;
+	NbtReader reader(nbt.data(), nbt.size());
+	reader.ReadRoot([&](uint8_t type, std::string_view name) {
+		if (name != "Data" || type != TAG_Compound)
+			return false;
+		reader.ReadCompound([&](uint8_t entryType, std::string_view entry) {
+			if (entryType != TAG_Int || (entry != "SpawnX" && entry != "SpawnZ"))
+				return false;
+			(entry == "SpawnX" ? spawn.x : spawn.y) = reader.ReadInt();
+			(entry == "SpawnX" ? foundX : foundZ) = true;
+			return true;
+		});
+		return true;
+	});
+	return reader.IsValid() && foundX && foundZ;
+}
+
+std::string AnvilImporter::FindTextureFolder(const std::filesystem::path& sceneFolder, const std::string& worldName)
+{
+	std::error_code ec;
+	if (std::filesystem::is_directory(sceneFolder / worldName / "textures", ec))
+		return worldName + "/textures";
+	if (std::filesystem::is_directory(sceneFolder / "textures", ec))
+		return "textures";
+	return "";
+}
+
+bool AnvilImporter::Import(const std::filesystem::path& sceneFolder, const std::string& worldName, const Settings& settings, Result& result)
+{
+	m_Stats = Stats();
+	result = Result();
+	const std::filesystem::path worldFolder = sceneFolder / worldName;
+	auto timeSince = [](std::chrono::high_resolution_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	};
+
+	int3 minBlock = settings.minBlock;
+	int3 maxBlock = settings.maxBlock;
+	if (settings.useSpawn) {
+		int2 spawn = int2(0);
+		if (!ReadSpawn(worldFolder, spawn))
+			log::warning("AnvilImporter: no spawn in %s/level.dat, importing around 0, 0", worldName.c_str());
+		minBlock = int3(spawn.x - settings.spawnRadius, settings.minBlock.y, spawn.y - settings.spawnRadius);
+		maxBlock = int3(spawn.x + settings.spawnRadius - 1, settings.maxBlock.y, spawn.y + settings.spawnRadius - 1);
+	}
+	const int2 minChunk = int2(minBlock.x >> 4, minBlock.z >> 4);
+	const int2 maxChunk = int2(maxBlock.x >> 4, maxBlock.z >> 4);
+	const int3 origin = int3((minBlock.x + maxBlock.x + 1) / 2, 0, (minBlock.z + maxBlock.z + 1) / 2);
+
+	//Chunks from firstChunk to lastChunk that overlap the region, grown by a block so that the hidden block test sees the neighbours of the border blocks
+	auto overlapsRegion = [&](int2 firstChunk, int2 lastChunk) {
+		float3 boxMin = float3(int3(firstChunk.x * k_ChunkSize, minBlock.y, firstChunk.y * k_ChunkSize) - origin) - float3(1.f);
+		float3 boxMax = float3(int3((lastChunk.x + 1) * k_ChunkSize, maxBlock.y + 1, (lastChunk.y + 1) * k_ChunkSize) - origin) + float3(1.f);
+		return settings.region.Overlaps(boxMin, boxMax);
+	};
+
+	//Read the sectors of all chunks in the volume and the region, one read per region file
+	auto readStart = std::chrono::high_resolution_clock::now();
+	std::vector<RegionFile> regionFiles;
+	for (const RegionFile& regionFile : FindRegionFiles(worldFolder)) {
+		int2 regionMin = regionFile.position * k_RegionChunks;
+		int2 regionMax = regionMin + int2(k_RegionChunks - 1);
+		if (regionMax.x >= minChunk.x && regionMin.x <= maxChunk.x && regionMax.y >= minChunk.y && regionMin.y <= maxChunk.y)
+			regionFiles.push_back(regionFile);
+	}
+	std::vector<std::vector<uint8_t>> regionData(regionFiles.size());
+	std::vector<std::vector<ChunkSource>> regionChunks(regionFiles.size());
+	//Stored chunks of the volume per region file, for the bounds
+	std::vector<int2> regionFirstChunk(regionFiles.size(), int2(INT_MAX));
+	std::vector<int2> regionLastChunk(regionFiles.size(), int2(INT_MIN));
+	std::atomic<uint64_t> bytesRead = 0;
+	std::atomic<uint> numChunksOutsideRegion = 0;
+	TaskScheduler::Get().ParallelFor(0, regionFiles.size(), 1, [&](uint64_t begin, uint64_t end) {
+		for (uint64_t r = begin; r < end; r++) {
+			std::ifstream stream(regionFiles[r].path, std::ios::binary);
+			uint8_t header[k_SectorBytes];
+			if (!stream.read(reinterpret_cast<char*>(header), sizeof(header)))
+				continue;
+			bytesRead += k_SectorBytes;
+
+			uint64_t firstSector = ~0ull;
+			uint64_t endSector = 0;
+			for (int i = 0; i < k_RegionChunks * k_RegionChunks; i++) {
+				uint32_t location = (uint32_t(header[i * 4]) << 24) | (header[i * 4 + 1] << 16) | (header[i * 4 + 2] << 8) | header[i * 4 + 3];
+				int2 position = regionFiles[r].position * k_RegionChunks + int2(i % k_RegionChunks, i / k_RegionChunks);
+				uint64_t sector = location >> 8;
+				uint64_t numSectors = location & 0xFF;
+				if (numSectors == 0 || sector < 2 || position.x < minChunk.x || position.x > maxChunk.x || position.y < minChunk.y || position.y > maxChunk.y)
+					continue;
+				regionFirstChunk[r] = min(regionFirstChunk[r], position);
+				regionLastChunk[r] = max(regionLastChunk[r], position);
+				if (!overlapsRegion(position, position)) {
+					numChunksOutsideRegion++;
+					continue;
+				}
+				regionChunks[r].push_back({ position, uint(r), sector * k_SectorBytes, numSectors * k_SectorBytes });
+				firstSector = std::min(firstSector, sector);
+				endSector = std::max(endSector, sector + numSectors);
+			}
+			if (regionChunks[r].empty())
+				continue;
+
+			//The last chunk of the file does not need to fill its sectors
+			std::vector<uint8_t>& data = regionData[r];
+			data.resize((endSector - firstSector) * k_SectorBytes);
+			stream.seekg(std::streamoff(firstSector * k_SectorBytes));
+			stream.read(reinterpret_cast<char*>(data.data()), std::streamsize(data.size()));
+			data.resize(size_t(stream.gcount()));
+			bytesRead += data.size();
+			for (ChunkSource& chunk : regionChunks[r])
+				chunk.offset -= firstSector * k_SectorBytes;
+		}
+	});
+
+	std::vector<ChunkSource> chunkSources;
+	for (const std::vector<ChunkSource>& chunks : regionChunks)
+		chunkSources.insert(chunkSources.end(), chunks.begin(), chunks.end());
+	std::sort(chunkSources.begin(), chunkSources.end(), [](const ChunkSource& a, const ChunkSource& b) {
+		return a.position.y != b.position.y ? a.position.y < b.position.y : a.position.x < b.position.x;
+	});
+	m_Stats.numRegions = uint(regionFiles.size());
+	m_Stats.numChunksOutsideRegion = numChunksOutsideRegion;
+	m_Stats.readTimeMs = timeSince(readStart);
+
+	//Same as the bounds of the scene index, the height is the one of the volume
+	int2 firstChunk = int2(INT_MAX);
+	int2 lastChunk = int2(INT_MIN);
+	for (size_t r = 0; r < regionFiles.size(); r++) {
+		firstChunk = min(firstChunk, regionFirstChunk[r]);
+		lastChunk = max(lastChunk, regionLastChunk[r]);
+	}
+	if (firstChunk.x <= lastChunk.x) {
+		result.chunkBoundsMin = float3(int3(firstChunk.x * k_ChunkSize, minBlock.y, firstChunk.y * k_ChunkSize) - origin);
+		result.chunkBoundsMax = float3(int3((lastChunk.x + 1) * k_ChunkSize, maxBlock.y + 1, (lastChunk.y + 1) * k_ChunkSize) - origin);
+	}
+
+	//Decompress and parse the chunks
+	auto decodeStart = std::chrono::high_resolution_clock::now();
+	std::vector<ChunkColumn> columns(chunkSources.size());
+	std::atomic<uint64_t> bytesInflated = 0;
+	TaskScheduler::Get().ParallelFor(0, chunkSources.size(), k_ChunkGrainSize, [&](uint64_t begin, uint64_t end) {
+		std::vector<uint8_t> nbt;
+		std::vector<uint8_t> external;
+		for (uint64_t c = begin; c < end; c++) {
+			const ChunkSource& source = chunkSources[c];
+			const std::vector<uint8_t>& data = regionData[source.region];
+			ChunkColumn& column = columns[c];
+			column.position = source.position;
+			if (source.offset + 5 > data.size())
+				continue;
+
+			const uint8_t* chunk = data.data() + source.offset;
+			uint64_t length = (uint64_t(chunk[0]) << 24) | (chunk[1] << 16) | (chunk[2] << 8) | chunk[3];
+			uint8_t compression = chunk[4];
+			const uint8_t* payload = chunk + 5;
+			uint64_t payloadSize = length > 0 ? length - 1 : 0;
+			if (compression & 0x80) {
+				//Chunks larger than 1 MB are stored in a separate file next to the region
+				compression &= 0x7F;
+				std::filesystem::path externalFile = regionFiles[source.region].path.parent_path() /
+					("c." + std::to_string(source.position.x) + "." + std::to_string(source.position.y) + ".mcc");
+				std::ifstream stream(externalFile, std::ios::binary);
+				external.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+				bytesRead += external.size();
+				payload = external.data();
+				payloadSize = external.size();
+			}
+			else if (source.offset + 4 + length > data.size()) {
+				continue;
+			}
+
+			nbt.clear();
+			bool inflated = false;
+			if (compression == 1)
+				inflated = Inflate::Gzip(payload, payloadSize, nbt);
+			else if (compression == 2)
+				inflated = Inflate::Zlib(payload, payloadSize, nbt);
+			else if (compression == 3) {
+				nbt.assign(payload, payload + payloadSize);
+				inflated = true;
+			}
+			if (!inflated)
+				continue;
+			bytesInflated += nbt.size();
+			column.valid = DecodeChunk(nbt.data(), nbt.size(), column);
+		}
+	});
+	regionData.clear();
+	m_Stats.bytesRead = bytesRead;
+	m_Stats.bytesInflated = bytesInflated;
+
+	//Global block states, shared by all chunks. Air is always 0
+	std::unordered_map<std::string, uint16_t> stateIDs;
+	std::vector<std::string> states;
+	auto getStateID = [&](const std::string& key) -> uint16_t {
+		std::string state = IsOneOf(key, k_AirBlocks) ? "air" : key;
+		auto it = stateIDs.find(state);
+		if (it != stateIDs.end())
+			return it->second;
+		if (states.size() > 0xFFFF)
+			return 0;
+		uint16_t id = uint16_t(states.size());
+		stateIDs[state] = id;
+		states.push_back(state);
+		return id;
+	};
+	getStateID("air");
+
+	std::vector<std::vector<uint16_t>> remaps;
+	std::vector<std::pair<size_t, int>> remappedSections;
+	for (size_t c = 0; c < columns.size(); c++) {
+		ChunkColumn& column = columns[c];
+		if (!column.valid) {
+			m_Stats.numSkippedChunks++;
+			continue;
+		}
+		m_Stats.numChunks++;
+		for (int s = 0; s < k_NumSections; s++) {
+			std::vector<std::string>& palette = column.palettes[s];
+			if (palette.empty())
+				continue;
+			m_Stats.numSections++;
+			if (column.blocks[s].empty()) {
+				column.uniform[s] = getStateID(palette[0]);
+			}
+			else {
+				std::vector<uint16_t> remap(palette.size());
+				for (size_t i = 0; i < palette.size(); i++)
+					remap[i] = getStateID(palette[i]);
+				remaps.push_back(std::move(remap));
+				remappedSections.push_back({ c, s });
+			}
+			palette = std::vector<std::string>();
+		}
+	}
+	m_Stats.numBlockStates = uint(states.size());
+
+	TaskScheduler::Get().ParallelFor(0, remappedSections.size(), 16, [&](uint64_t begin, uint64_t end) {
+		for (uint64_t i = begin; i < end; i++) {
+			std::vector<uint16_t>& blocks = columns[remappedSections[i].first].blocks[remappedSections[i].second];
+			for (uint16_t& block : blocks)
+				block = remaps[i][block];
+		}
+	});
+	m_Stats.decodeTimeMs = timeSince(decodeStart);
+
+	//Block models and materials
+	auto meshStart = std::chrono::high_resolution_clock::now();
+	const std::string textureFolder = FindTextureFolder(sceneFolder, worldName);
+	if (textureFolder.empty())
+		log::warning("AnvilImporter: no textures folder found for %s, blocks will be untextured", worldName.c_str());
+	MaterialTable materialTable(sceneFolder, textureFolder);
+	std::vector<BlockModel> models(states.size());
+	for (size_t i = 0; i < states.size(); i++)
+		models[i] = CreateBlockModel(states[i], materialTable);
+	m_Stats.numMissingTextures = materialTable.GetNumMissingTextures();
+
+	//Mesh every chunk with access to its four neighbours for the hidden block test
+	std::unordered_map<uint64_t, const ChunkColumn*> columnMap;
+	auto columnKey = [](int2 position) { return (uint64_t(uint32_t(position.x)) << 32) | uint32_t(position.y); };
+	for (const ChunkColumn& column : columns) {
+		if (column.valid)
+			columnMap[columnKey(column.position)] = &column;
+	}
+
+	struct ChunkMesh {
+		std::vector<AABB> aabbs;
+		std::vector<AABBMaterials> aabbMaterials;
+		std::vector<VertexData> vertices;
+		std::vector<uint> indices;
+		std::vector<int> triangleMaterialIDs;
+		uint numBlocks = 0;
+		uint numHiddenBlocks = 0;
+		uint numApproximatedBlocks = 0;
+		uint numSkippedBlocks = 0;
+	};
+	std::vector<ChunkMesh> meshes(columns.size());
+	TaskScheduler::Get().ParallelFor(0, columns.size(), k_ChunkGrainSize, [&](uint64_t begin, uint64_t end) {
+		for (uint64_t c = begin; c < end; c++) {
+			const ChunkColumn& column = columns[c];
+			if (!column.valid)
+				continue;
+			ChunkMesh& mesh = meshes[c];
+			const int3 chunkOrigin = int3(column.position.x * k_ChunkSize, 0, column.position.y * k_ChunkSize);
+
+			const ChunkColumn* neighbours[4] = {};
+			const int2 offsets[4] = { int2(-1, 0), int2(1, 0), int2(0, -1), int2(0, 1) };
+			for (int n = 0; n < 4; n++) {
+				auto it = columnMap.find(columnKey(column.position + offsets[n]));
+				neighbours[n] = it != columnMap.end() ? it->second : nullptr;
+			}
+			//Blocks outside the volume are air, so that the border of the volume is closed
+			auto getBlock = [&](int3 block) -> uint16_t {
+				if (block.x < minBlock.x || block.x > maxBlock.x || block.y < minBlock.y || block.y > maxBlock.y || block.z < minBlock.z || block.z > maxBlock.z)
+					return 0;
+				int3 local = block - chunkOrigin;
+				const ChunkColumn* source = &column;
+				if (local.x < 0) { source = neighbours[0]; local.x += k_ChunkSize; }
+				else if (local.x >= k_ChunkSize) { source = neighbours[1]; local.x -= k_ChunkSize; }
+				else if (local.z < 0) { source = neighbours[2]; local.z += k_ChunkSize; }
+				else if (local.z >= k_ChunkSize) { source = neighbours[3]; local.z -= k_ChunkSize; }
+				return source ? source->Get(local.x, local.y, local.z) : 0;
+			};
+			const int3 directions[6] = { int3(-1, 0, 0), int3(0, -1, 0), int3(0, 0, -1), int3(1, 0, 0), int3(0, 1, 0), int3(0, 0, 1) };
+
+			for (int s = 0; s < k_NumSections; s++) {
+				if (column.blocks[s].empty() && column.uniform[s] == 0)
+					continue;
+				for (uint i = 0; i < k_SectionBlocks; i++) {
+					int3 local = int3(int(i & 15), (s + k_MinSectionY) * k_ChunkSize + int(i >> 8), int((i >> 4) & 15));
+					int3 block = chunkOrigin + local;
+					if (block.x < minBlock.x || block.x > maxBlock.x || block.y < minBlock.y || block.y > maxBlock.y || block.z < minBlock.z || block.z > maxBlock.z)
+						continue;
+					float3 position = float3(block - origin);
+					if (!settings.region.Overlaps(position, position + float3(1.f)))
+						continue;
+					uint16_t state = column.blocks[s].empty() ? column.uniform[s] : column.blocks[s][i];
+					const BlockModel& model = models[state];
+					if (model.shape == BlockShape::Air)
+						continue;
+					mesh.numBlocks++;
+					if (model.shape == BlockShape::Skip) {
+						mesh.numSkippedBlocks++;
+						continue;
+					}
+
+					if (settings.cullHiddenBlocks && model.shape == BlockShape::Box) {
+						bool hidden = true;
+						for (int d = 0; d < 6 && hidden; d++) {
+							uint16_t neighbour = getBlock(block + directions[d]);
+							hidden = models[neighbour].opaque || (model.cullsSame && neighbour == state);
+						}
+						if (hidden) {
+							mesh.numHiddenBlocks++;
+							continue;
+						}
+					}
+
+					if (model.shape == BlockShape::Box) {
+						AABB aabb;
+						aabb.min = position + float3(0.f, model.minY, 0.f);
+						aabb.max = position + float3(1.f, model.maxY, 1.f);
+						AABBMaterials materials{};
+						materials.negXMatID = model.materials[0];
+						materials.negYMatID = model.materials[1];
+						materials.negZMatID = model.materials[2];
+						materials.posXMatID = model.materials[3];
+						materials.posYMatID = model.materials[4];
+						materials.posZMatID = model.materials[5];
+						mesh.aabbs.push_back(aabb);
+						mesh.aabbMaterials.push_back(materials);
+						mesh.numApproximatedBlocks += model.approximated ? 1 : 0;
+						continue;
+					}
+
+					//Two diagonal quads, textures upright
+					const float3 corners[2][2] = { { float3(0.f, 0.f, 0.f), float3(1.f, 0.f, 1.f) }, { float3(1.f, 0.f, 0.f), float3(0.f, 0.f, 1.f) } };
+					for (int q = 0; q < 2; q++) {
+						float3 from = corners[q][0];
+						float3 to = corners[q][1];
+						float3 normal = normalize(cross(to - from, float3(0.f, 1.f, 0.f)));
+						uint baseVertex = uint(mesh.vertices.size());
+						const float3 quad[4] = { from, to, to + float3(0.f, 1.f, 0.f), from + float3(0.f, 1.f, 0.f) };
+						const float2 uvs[4] = { float2(0.f, 1.f), float2(1.f, 1.f), float2(1.f, 0.f), float2(0.f, 0.f) };
+						for (int v = 0; v < 4; v++) {
+							VertexData vertex{};
+							vertex.position = position + quad[v];
+							vertex.normal = normal;
+							vertex.uvX = uvs[v].x;
+							vertex.uvY = uvs[v].y;
+							mesh.vertices.push_back(vertex);
+						}
+						for (uint index : { 0u, 1u, 2u, 0u, 2u, 3u })
+							mesh.indices.push_back(baseVertex + index);
+						mesh.triangleMaterialIDs.push_back(model.materials[0]);
+						mesh.triangleMaterialIDs.push_back(model.materials[0]);
+					}
+				}
+			}
+		}
+	});
+
+	for (ChunkMesh& mesh : meshes) {
+		uint baseVertex = uint(result.vertices.size());
+		result.aabbs.insert(result.aabbs.end(), mesh.aabbs.begin(), mesh.aabbs.end());
+		result.aabbMaterials.insert(result.aabbMaterials.end(), mesh.aabbMaterials.begin(), mesh.aabbMaterials.end());
+		result.vertices.insert(result.vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+		for (uint index : mesh.indices)
+			result.indices.push_back(baseVertex + index);
+		result.triangleMaterialIDs.insert(result.triangleMaterialIDs.end(), mesh.triangleMaterialIDs.begin(), mesh.triangleMaterialIDs.end());
+		m_Stats.numBlocks += mesh.numBlocks;
+		m_Stats.numHiddenBlocks += mesh.numHiddenBlocks;
+		m_Stats.numApproximatedBlocks += mesh.numApproximatedBlocks;
+		m_Stats.numSkippedBlocks += mesh.numSkippedBlocks;
+		mesh = ChunkMesh();
+	}
+	result.materials = std::move(materialTable.GetMaterials());
+	m_Stats.meshTimeMs = timeSince(meshStart);
+
+	return !result.aabbs.empty() || !result.indices.empty();
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <tiny_obj_loader.h>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace donut::math;
+#include "sharedShaderData.h" //Needs namespace donut::math;
+#include "SceneRegion.h"
+
+/* Imports the blocks of a Minecraft Java Edition world (1.13 and newer) directly from its region files (region/r.X.Z.mca),
+   without a Mineways export. Produces the same AABBs, triangles and .mtl style materials as the .obj path, so the rest
+   of MinecraftSceneLoader is shared. Textures are taken from a Mineways tile export ("textures" folder with one PNG per
+   Minecraft texture name), either inside the world folder or next to it.
+   Full blocks, slabs, carpets and snow layers become AABBs, plants and torches crossed quads. Other block models
+   (stairs, fences, doors, ...) are approximated by full blocks, small attachments (rails, signs, buttons, ...) are skipped.
+*/
+class AnvilImporter {
+public:
+	struct Settings {
+		//Imported block volume (inclusive). If useSpawn is set, the volume is centered around the world spawn instead
+		int3 minBlock = int3(-256, -64, -256);
+		int3 maxBlock = int3(255, 319, 255);
+		bool useSpawn = true;
+		int spawnRadius = 256;
+		bool cullHiddenBlocks = true;	//Skips blocks that are enclosed on all six sides by opaque blocks
+		//Part of the volume to import, relative to its center like the positions of the result. Region files and chunks that do not
+		//overlap it are not read, blocks whose cell does not overlap it are skipped
+		SceneRegion region;
+	};
+
+	struct Result {
+		std::vector<AABB> aabbs;
+		std::vector<AABBMaterials> aabbMaterials;
+		std::vector<VertexData> vertices;
+		std::vector<uint> indices;
+		std::vector<int> triangleMaterialIDs;
+		std::vector<tinyobj::material_t> materials;	//Texture names are relative to the scene folder
+		//Bounds of all stored chunks of the volume from the region headers, also of the chunks outside the region. Empty if there are none
+		float3 chunkBoundsMin = float3(0.f);
+		float3 chunkBoundsMax = float3(0.f);
+	};
+
+	struct Stats {
+		uint numRegions = 0;
+		uint numChunks = 0;				//Decoded, fully generated chunks
+		uint numSkippedChunks = 0;		//Chunks that are not fully generated or could not be decoded
+		uint numChunksOutsideRegion = 0;	//Stored chunks of the volume that were not read
+		uint numSections = 0;			//Non-empty 16x16x16 sections
+		uint numBlockStates = 0;		//Distinct block states (name and the properties the importer uses)
+		uint64_t bytesRead = 0;			//Region file bytes read from disk
+		uint64_t bytesInflated = 0;		//Decompressed NBT bytes
+		uint numBlocks = 0;				//Non-air blocks in the volume and the region
+		uint numHiddenBlocks = 0;		//Blocks skipped by cullHiddenBlocks
+		uint numApproximatedBlocks = 0;	//Blocks with a model that was replaced by a full block
+		uint numSkippedBlocks = 0;		//Blocks without a supported model
+		uint numMissingTextures = 0;
+		double readTimeMs = 0.0;
+		double decodeTimeMs = 0.0;
+		double meshTimeMs = 0.0;
+	};
+
+	struct RegionFile {
+		std::filesystem::path path;
+		int2 position;		//Region coordinates, a region has 32x32 chunks
+	};
+
+	//True if the folder contains a region folder with .mca files
+	static bool IsWorldFolder(const std::filesystem::path& folder);
+	static std::vector<RegionFile> FindRegionFiles(const std::filesystem::path& worldFolder);
+	//Reads the region header and returns the positions of the stored chunks
+	static std::vector<int2> GetChunkPositions(const RegionFile& regionFile);
+	//Reads the world spawn from level.dat
+	static bool ReadSpawn(const std::filesystem::path& worldFolder, int2& spawn);
+	//Folder with the block textures relative to the scene folder, or an empty string if there is none
+	static std::string FindTextureFolder(const std::filesystem::path& sceneFolder, const std::string& worldName);
+
+	//Imports the world sceneFolder/worldName. Chunks are decoded and meshed in parallel.
+	//Positions are relative to the center of the imported volume in x and z
+	bool Import(const std::filesystem::path& sceneFolder, const std::string& worldName, const Settings& settings, Result& result);
+
+	const Stats& GetStats() const { return m_Stats; }
+
+private:
+	Stats m_Stats;
+};
@@ -0,0 +1,163 @@
+#include "BatchJobs.h"
+#include "CameraPath.h"
+#include <donut/app/ApplicationBase.h>
+#include <donut/core/log.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+using namespace donut;
+
+static const char* k_JobFileHeader = "# Mineways Renderer batch jobs v1";
+
+static bool ReadFloat3(const std::string& str, float3& value) { return sscanf(str.c_str(), "%f,%f,%f", &value.x, &value.y, &value.z) == 3; }
+
+void BatchJobFile::Clear()
+{
+	m_Jobs.clear();
+	m_OutputFolder.clear();
+	m_SceneFolder.clear();
+}
+
+bool BatchJobFile::Load(const std::filesystem::path& file)
+{
+	Clear();
+
+	std::ifstream stream(file);
+	if (!stream) {
+		log::warning("BatchJobFile: could not read %s", file.string().c_str());
+		return false;
+	}
+
+	std::string line;
+	if (!std::getline(stream, line) || line.rfind(k_JobFileHeader, 0) != 0) {
+		log::warning("BatchJobFile: %s is not a batch job file", file.string().c_str());
+		return false;
+	}
+
+	const std::filesystem::path fileFolder = std::filesystem::absolute(file).parent_path();
+	UIData jobSettings;
+	int lineNumber = 1;
+	auto fail = [&](const char* reason) {
+		log::warning("BatchJobFile: %s in line %d of %s", reason, lineNumber, file.string().c_str());
+		Clear();
+		return false;
+	};
+
+	while (std::getline(stream, line)) {
+		lineNumber++;
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::istringstream lineStream(line);
+		std::string command, token;
+		lineStream >> command;
+		if (line.rfind("output=", 0) == 0) {
+			m_OutputFolder = fileFolder / line.substr(7);
+		}
+		else if (line.rfind("scenes=", 0) == 0) {
+			m_SceneFolder = fileFolder / line.substr(7);
+		}
+		else if (command == "job") {
+			BatchJob job;
+			if (!(lineStream >> job.name))
+				return fail("missing job name");
+			jobSettings = UIData();
+			while (lineStream >> token) {
+				if (token.rfind("scene=", 0) == 0)
+					job.scene = token.substr(6);
+				else if (token.rfind("width=", 0) == 0)
+					job.resolution.x = uint(std::max(std::atoi(token.c_str() + 6), 0));
+				else if (token.rfind("height=", 0) == 0)
+					job.resolution.y = uint(std::max(std::atoi(token.c_str() + 7), 0));
+				else if (!CameraPath::ReadRenderSetting(token, jobSettings))
+					log::warning("BatchJobFile: ignoring %s in line %d", token.c_str(), lineNumber);
+			}
+			if (job.scene.empty() || job.resolution.x == 0 || job.resolution.y == 0)
+				return fail("job without scene or resolution");
+			m_Jobs.push_back(job);
+		}
+		else if (command == "still" || command == "orbit") {
+			if (m_Jobs.empty())
+				return fail("frame before the first job");
+			BatchFrame frame;
+			frame.ui = jobSettings;
+			int numFrames = 1;
+			if (command == "still") {
+				std::string position, direction, up;
+				if (!(lineStream >> position >> direction >> up) || !ReadFloat3(position, frame.position) ||
+					!ReadFloat3(direction, frame.direction) || !ReadFloat3(up, frame.up))
+					return fail("invalid camera");
+			}
+			else {
+				frame.orbit = true;
+				if (!(lineStream >> numFrames) || numFrames <= 0)
+					return fail("invalid orbit frame count");
+			}
+			while (lineStream >> token) {
+				if (frame.orbit && token.rfind("distance=", 0) == 0)
+					frame.orbitDistance = float(std::atof(token.c_str() + 9));
+				else if (frame.orbit && token.rfind("height=", 0) == 0)
+					frame.orbitHeight = float(std::atof(token.c_str() + 7));
+				else if (!CameraPath::ReadRenderSetting(token, frame.ui))
+					log::warning("BatchJobFile: ignoring %s in line %d", token.c_str(), lineNumber);
+			}
+			//Orbit frames are evenly spaced over a full turn
+			for (int i = 0; i < numFrames; i++) {
+				frame.orbitAngle = 2.f * PI_f * float(i) / float(numFrames);
+				m_Jobs.back().frames.push_back(frame);
+			}
+		}
+		else {
+			return fail("unknown command");
+		}
+	}
+
+	if (m_OutputFolder.empty())
+		m_OutputFolder = fileFolder;
+	return GetNumFrames() > 0;
+}
+
+std::filesystem::path BatchJobFile::GetSceneFolder() const
+{
+	if (!m_SceneFolder.empty())
+		return m_SceneFolder;
+	return app::GetDirectoryWithExecutable().parent_path() / "MinecraftModels";
+}
+
+size_t BatchJobFile::GetNumFrames() const
+{
+	size_t numFrames = 0;
+	for (const BatchJob& job : m_Jobs)
+		numFrames += job.frames.size();
+	return numFrames;
+}
+
+std::filesystem::path BatchJobFile::GetImageFile(const BatchJob& job, uint frame) const
+{
+	char frameNumber[16];
+	snprintf(frameNumber, sizeof(frameNumber), "%04u", frame);
+	return m_OutputFolder / (job.name + "_" + frameNumber + ".png");
+}
+
+void BatchJobFile::GetFrameCamera(const BatchFrame& frame, float3 boundsMin, float3 boundsMax, float3& position, float3& direction, float3& up)
+{
+	if (!frame.orbit) {
+		position = frame.position;
+		direction = frame.direction;
+		up = frame.up;
+		return;
+	}
+
+	float3 center = (boundsMin + boundsMax) * 0.5f;
+	float3 extent = max(boundsMax - boundsMin, float3(1.f));
+	float distance = frame.orbitDistance > 0.f ? frame.orbitDistance : std::sqrt(extent.x * extent.x + extent.z * extent.z);
+	position = center + float3(std::cos(frame.orbitAngle) * distance, frame.orbitHeight * extent.y, std::sin(frame.orbitAngle) * distance);
+	direction = normalize(center - position);
+	up = float3(0.f, 1.f, 0.f);
+}
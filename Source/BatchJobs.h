@@ -0,0 +1,65 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "UIData.h"
+
+using namespace donut::math;
+
+//Camera and render settings of one frame of a batch job
+struct BatchFrame {
+	float3 position = float3(0.f);
+	float3 direction = float3(0.f, 0.f, -1.f);
+	float3 up = float3(0.f, 1.f, 0.f);
+	//Orbit frames look at the center of the scene bounds, the position is computed once the scene is loaded
+	bool orbit = false;
+	float orbitAngle = 0.f;			//Radians around the y axis
+	float orbitDistance = 0.f;		//Horizontal distance to the center, 0 = the diagonal of the bounds
+	float orbitHeight = 0.5f;		//Height above the center relative to the height of the bounds
+	UIData ui;
+};
+
+//Frames of one scene that are rendered at the same resolution
+struct BatchJob {
+	std::string name;			//Prefix of the image files
+	std::string scene;			//Scene name as in the scene list (.obj file or world folder)
+	uint2 resolution = uint2(1280, 720);
+	std::vector<BatchFrame> frames;
+};
+
+/* Job file of the batch mode: a text file with the scenes, camera poses and render settings to render.
+
+	# Mineways Renderer batch jobs v1
+	output=<folder for the images>
+	scenes=<scene folder, the MinecraftModels folder of the build by default>
+	job <name> scene=<scene> width=<pixels> height=<pixels> [key=value ...]
+	still <position> <direction> <up> [key=value ...]
+	orbit <frames> [distance=<units>] [height=<relative>] [key=value ...]
+
+   key=value tokens are the render settings of the camera path files. Settings of a job line apply to all of its frames,
+   settings of a frame line only to that frame. Relative folders are relative to the job file
+*/
+class BatchJobFile {
+public:
+	void Clear();
+
+	//Returns false if the file does not exist or is invalid
+	bool Load(const std::filesystem::path& file);
+
+	const std::vector<BatchJob>& GetJobs() const { return m_Jobs; }
+	const std::filesystem::path& GetOutputFolder() const { return m_OutputFolder; }
+	//The MinecraftModels folder of the build if the file does not set the scene folder
+	std::filesystem::path GetSceneFolder() const;
+	size_t GetNumFrames() const;
+	//Image of a frame in the output folder, <job>_<frame>.png
+	std::filesystem::path GetImageFile(const BatchJob& job, uint frame) const;
+
+	//Camera of the frame; orbit frames are placed around the given scene bounds
+	static void GetFrameCamera(const BatchFrame& frame, float3 boundsMin, float3 boundsMax, float3& position, float3& direction, float3& up);
+
+private:
+	std::vector<BatchJob> m_Jobs;
+	std::filesystem::path m_OutputFolder;
+	std::filesystem::path m_SceneFolder;
+};
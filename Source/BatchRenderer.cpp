@@ -0,0 +1,416 @@
+#include "BatchRenderer.h"
+#include "BatchJobs.h"
+#include "BenchmarkReport.h"
+#include "CpuRenderer.h"
+#include "MinecraftSceneLoader.h"
+#include "PngWriter.h"
+#include "PotentiallyVisibleSet.h"
+#include "ProcessUtils.h"
+#include "Renderer.h"
+#include "TaskScheduler.h"
+#include <donut/app/Camera.h>
+#include <donut/app/DeviceManager.h>
+#include <donut/core/log.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+using namespace donut;
+
+namespace {
+	//Consecutive frames of one job, stored in the queue as item_<job>_<first frame>_<frame count><state extension>
+	struct QueueItem {
+		uint job = 0;
+		uint firstFrame = 0;
+		uint numFrames = 0;
+	};
+
+	//Timings a worker reports for one item
+	struct ItemResult {
+		double loadMs = 0.0;						//Scene load and CPU renderer build, 0 if the scene was loaded for an earlier item
+		std::vector<std::pair<uint, double>> frameMs;	//Rendered frames with their render and write time, failed frames are missing
+	};
+}
+
+//Pending items, claimed items (renamed to .w<worker index>) and finished items. Results are written to .part first
+static const char* k_TodoExtension = ".todo";
+static const char* k_DoneExtension = ".done";
+static const char* k_PartExtension = ".part";
+
+static std::string GetItemName(const QueueItem& item)
+{
+	return "item_" + std::to_string(item.job) + "_" + std::to_string(item.firstFrame) + "_" + std::to_string(item.numFrames);
+}
+
+//Items of the queue folder with the given extension
+static std::vector<QueueItem> ListItems(const std::filesystem::path& queueFolder, const std::string& extension)
+{
+	std::vector<QueueItem> items;
+	std::error_code error;
+	for (const auto& file : std::filesystem::directory_iterator(queueFolder, error)) {
+		if (file.path().extension().string() != extension)
+			continue;
+		QueueItem item;
+		if (sscanf(file.path().stem().string().c_str(), "item_%u_%u_%u", &item.job, &item.firstFrame, &item.numFrames) == 3)
+			items.push_back(item);
+	}
+	std::sort(items.begin(), items.end(), [](const QueueItem& a, const QueueItem& b) {
+		return a.job != b.job ? a.job < b.job : a.firstFrame < b.firstFrame;
+	});
+	return items;
+}
+
+static bool WriteResult(const std::filesystem::path& queueFolder, const QueueItem& item, uint workerIndex, const ItemResult& result)
+{
+	std::filesystem::path partFile = queueFolder / (GetItemName(item) + k_PartExtension);
+	{
+		std::ofstream stream(partFile);
+		if (!stream)
+			return false;
+		stream << "worker=" << workerIndex << "\n";
+		stream << "load=" << result.loadMs << "\n";
+		for (const auto& [frame, ms] : result.frameMs)
+			stream << "frame " << frame << " " << ms << "\n";
+		if (!stream)
+			return false;
+	}
+	//The coordinator only reads complete results
+	std::error_code error;
+	std::filesystem::rename(partFile, queueFolder / (GetItemName(item) + k_DoneExtension), error);
+	return !error;
+}
+
+static bool ReadResult(const std::filesystem::path& file, ItemResult& result)
+{
+	std::ifstream stream(file);
+	if (!stream)
+		return false;
+	std::string line;
+	while (std::getline(stream, line)) {
+		uint frame = 0;
+		double value = 0.0;
+		if (sscanf(line.c_str(), "load=%lf", &value) == 1)
+			result.loadMs = value;
+		else if (sscanf(line.c_str(), "frame %u %lf", &frame, &value) == 2)
+			result.frameMs.push_back({ frame, value });
+	}
+	return true;
+}
+
+//Restricts the load of the scene to the cells visible from the cameras of all jobs of the scene, as the worker may render any of them.
+//Orbit cameras are placed around the bounds of the set, which are those of the scene
+static void SetLoadVisibility(MinecraftSceneLoader& scene, const BatchJobFile& jobs, const std::filesystem::path& sceneFolder, const std::string& sceneName,
+	uint margin)
+{
+	auto pvs = std::make_shared<PotentiallyVisibleSet>();
+	if (!pvs->Read(PotentiallyVisibleSet::GetFile(sceneFolder, sceneName), sceneFolder / sceneName)) {
+		log::info("BatchRenderer: no valid potentially visible set for %s, loading all of it", sceneName.c_str());
+		return;
+	}
+	std::vector<float3> positions;
+	for (const BatchJob& job : jobs.GetJobs()) {
+		if (job.scene != sceneName)
+			continue;
+		for (const BatchFrame& frame : job.frames) {
+			float3 position, direction, up;
+			BatchJobFile::GetFrameCamera(frame, pvs->GetBoundsMin(), pvs->GetBoundsMax(), position, direction, up);
+			positions.push_back(position);
+		}
+	}
+	std::vector<uint8_t> visibleCells = pvs->GetVisibleCells(positions, margin);
+	log::info("BatchRenderer: %zu cameras of %s, %.1f%% of the primitives are culled", positions.size(), sceneName.c_str(),
+		100.0 * pvs->GetCulledFraction(visibleCells));
+	scene.SetLoadVisibility(std::move(pvs), std::move(visibleCells));
+}
+
+//Command line option of the graphics API, passed on to the workers
+static const char* GetGraphicsAPIArgument(nvrhi::GraphicsAPI api)
+{
+	switch (api) {
+	case nvrhi::GraphicsAPI::D3D11: return "-dx11";
+	case nvrhi::GraphicsAPI::VULKAN: return "-vk";
+	default: return "-dx12";
+	}
+}
+
+//Device without a window or swap chain. nullptr if the API is not available or the device cannot trace rays
+static app::DeviceManager* CreateHeadlessDevice(nvrhi::GraphicsAPI api)
+{
+	app::DeviceManager* deviceManager = app::DeviceManager::Create(api);
+	if (!deviceManager)
+		return nullptr;
+	app::DeviceCreationParameters deviceParams;
+	deviceParams.enableRayTracingExtensions = true;
+	if (!deviceManager->CreateHeadlessDevice(deviceParams) || !deviceManager->GetDevice()->queryFeatureSupport(nvrhi::Feature::RayTracingPipeline)) {
+		deviceManager->Shutdown();
+		delete deviceManager;
+		return nullptr;
+	}
+	return deviceManager;
+}
+
+int BatchRenderer::RunWorker(const std::filesystem::path& jobFile, const std::filesystem::path& queueFolder, uint workerIndex, uint numThreads,
+	const BatchSettings& settings)
+{
+	//The calling thread helps the scheduler workers while waiting
+	if (numThreads > 0)
+		TaskScheduler::SetSharedNumWorkers(std::max(numThreads, 2u) - 1);
+
+	BatchJobFile jobs;
+	if (!jobs.Load(jobFile))
+		return 1;
+	const std::filesystem::path sceneFolder = jobs.GetSceneFolder();
+
+	//The GPU renders with the shader of the window, the CpuRenderer is the fallback if there is no ray tracing device
+	app::DeviceManager* deviceManager = settings.cpuRendering ? nullptr : CreateHeadlessDevice(settings.graphicsAPI);
+	UIData gpuUI;
+	std::unique_ptr<Renderer> gpuRenderer;
+	if (deviceManager) {
+		gpuRenderer = std::make_unique<Renderer>(deviceManager, &gpuUI);
+		if (!gpuRenderer->Init(sceneFolder))
+			gpuRenderer.reset();
+	}
+	log::info("BatchRenderer: worker %u renders on the %s", workerIndex, gpuRenderer ? "GPU" : "CPU");
+	if (gpuRenderer && settings.pvsCulling)
+		log::info("BatchRenderer: the potentially visible set only restricts the scene loads of the CPU renderer, worker %u loads whole scenes", workerIndex);
+
+	std::unique_ptr<MinecraftSceneLoader> scene;
+	CpuRenderer renderer;
+	std::string loadedScene;
+	bool sceneLoaded = false;
+	std::vector<uint8_t> image;
+	uint numItems = 0;
+	int exitCode = 0;
+
+	while (true) {
+		std::vector<QueueItem> items = ListItems(queueFolder, k_TodoExtension);
+		if (items.empty())
+			break;
+
+		//Items of the loaded scene first, then in job order
+		std::stable_partition(items.begin(), items.end(), [&](const QueueItem& item) {
+			return item.job < jobs.GetJobs().size() && jobs.GetJobs()[item.job].scene == loadedScene;
+		});
+		const QueueItem* claimed = nullptr;
+		const std::string workerExtension = ".w" + std::to_string(workerIndex);
+		for (const QueueItem& item : items) {
+			//Fails if another worker renamed the item first
+			std::error_code error;
+			std::filesystem::rename(queueFolder / (GetItemName(item) + k_TodoExtension), queueFolder / (GetItemName(item) + workerExtension), error);
+			if (!error) {
+				claimed = &item;
+				break;
+			}
+		}
+		if (!claimed) {
+			//Either other workers took all listed items, or renaming does not work in the queue folder
+			if (ListItems(queueFolder, k_TodoExtension).size() == items.size()) {
+				log::warning("BatchRenderer: worker %u cannot claim items in %s", workerIndex, queueFolder.string().c_str());
+				exitCode = 1;
+				break;
+			}
+			continue;
+		}
+		const QueueItem item = *claimed;
+		numItems++;
+
+		ItemResult result;
+		const std::string workerFile = GetItemName(item) + workerExtension;
+		if (item.job >= jobs.GetJobs().size()) {
+			log::warning("BatchRenderer: worker %u claimed item %s of an unknown job", workerIndex, GetItemName(item).c_str());
+			std::error_code error;
+			std::filesystem::remove(queueFolder / workerFile, error);
+			continue;
+		}
+		const BatchJob& job = jobs.GetJobs()[item.job];
+
+		if (job.scene != loadedScene) {
+			auto loadStart = std::chrono::high_resolution_clock::now();
+			loadedScene = job.scene;
+			if (gpuRenderer) {
+				sceneLoaded = gpuRenderer->LoadSceneOffscreen(job.scene);
+			}
+			else {
+				renderer.Clear();
+				scene = std::make_unique<MinecraftSceneLoader>(nullptr);
+				if (settings.pvsCulling)
+					SetLoadVisibility(*scene, jobs, sceneFolder, job.scene, settings.pvsMargin);
+				sceneLoaded = scene->LoadSceneWithoutDevice(sceneFolder, job.scene);
+				if (sceneLoaded)
+					renderer.Build(*scene, sceneFolder);
+			}
+			if (!sceneLoaded)
+				log::warning("BatchRenderer: worker %u could not load %s", workerIndex, job.scene.c_str());
+			result.loadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - loadStart).count();
+		}
+
+		for (uint frameIndex = item.firstFrame; sceneLoaded && frameIndex < item.firstFrame + item.numFrames && frameIndex < job.frames.size(); frameIndex++) {
+			auto frameStart = std::chrono::high_resolution_clock::now();
+			const BatchFrame& frame = job.frames[frameIndex];
+			const MinecraftSceneLoader::SceneStats& stats = gpuRenderer ? gpuRenderer->GetActiveScene()->GetSceneStats() : scene->GetSceneStats();
+			float3 position, direction, up;
+			BatchJobFile::GetFrameCamera(frame, stats.boundsMin, stats.boundsMax, position, direction, up);
+
+			if (gpuRenderer) {
+				if (!gpuRenderer->RenderOffscreen(position, direction, up, frame.ui, job.resolution, image)) {
+					log::warning("BatchRenderer: could not render frame %u of %s on the GPU", frameIndex, job.name.c_str());
+					continue;
+				}
+			}
+			else {
+				app::FirstPersonCamera camera;
+				camera.LookAt(position, position + direction, up);
+				renderer.Render(CpuRenderer::MakeCamera(camera.GetWorldToViewMatrix(), frame.ui, job.resolution), job.resolution, frame.ui, image);
+			}
+			if (!PngWriter::Write(jobs.GetImageFile(job, frameIndex), job.resolution.x, job.resolution.y, image.data())) {
+				log::warning("BatchRenderer: could not write frame %u of %s", frameIndex, job.name.c_str());
+				continue;
+			}
+			result.frameMs.push_back({ frameIndex, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frameStart).count() });
+		}
+
+		if (!WriteResult(queueFolder, item, workerIndex, result))
+			log::warning("BatchRenderer: worker %u could not write the result of %s", workerIndex, GetItemName(item).c_str());
+		std::error_code error;
+		std::filesystem::remove(queueFolder / workerFile, error);
+	}
+
+	log::info("BatchRenderer: worker %u finished %u items", workerIndex, numItems);
+	if (deviceManager) {
+		gpuRenderer.reset();
+		deviceManager->Shutdown();
+		delete deviceManager;
+	}
+	return exitCode;
+}
+
+int BatchRenderer::Run(const std::filesystem::path& jobFile, const BatchSettings& settings)
+{
+	BatchJobFile jobs;
+	if (!jobs.Load(jobFile)) {
+		log::warning("BatchRenderer: no frames to render in %s", jobFile.string().c_str());
+		return 1;
+	}
+	const std::filesystem::path absoluteJobFile = std::filesystem::absolute(jobFile);
+	const std::filesystem::path outputFolder = jobs.GetOutputFolder();
+	const std::filesystem::path queueFolder = outputFolder / "BatchQueue";
+	const uint numWorkers = std::max(settings.numWorkers, 1u);
+	const uint framesPerItem = std::max(settings.framesPerItem, 1u);
+
+	//Start with an empty queue, items of an aborted run would be rendered twice
+	std::error_code error;
+	std::filesystem::create_directories(outputFolder, error);
+	std::filesystem::remove_all(queueFolder, error);
+	std::filesystem::create_directories(queueFolder, error);
+	if (error) {
+		log::warning("BatchRenderer: could not create the queue folder %s", queueFolder.string().c_str());
+		return 1;
+	}
+	for (uint jobIndex = 0; jobIndex < jobs.GetJobs().size(); jobIndex++) {
+		uint numFrames = uint(jobs.GetJobs()[jobIndex].frames.size());
+		for (uint first = 0; first < numFrames; first += framesPerItem) {
+			QueueItem item = { jobIndex, first, std::min(framesPerItem, numFrames - first) };
+			std::ofstream(queueFolder / (GetItemName(item) + k_TodoExtension));
+		}
+	}
+
+	const uint hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	const uint threadsPerWorker = std::max(hardwareThreads / numWorkers, 1u);
+	log::info("BatchRenderer: %zu frames of %zu jobs, %u workers with %u threads each", jobs.GetNumFrames(), jobs.GetJobs().size(), numWorkers, threadsPerWorker);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<ChildProcess> workers(numWorkers);
+	const std::filesystem::path executable = GetExecutablePath();
+	uint numStarted = 0;
+	for (uint i = 0; i < numWorkers; i++) {
+		std::vector<std::string> arguments = { "-batchworker", absoluteJobFile.string(), std::filesystem::absolute(queueFolder).string(), std::to_string(i),
+			"-threads", std::to_string(threadsPerWorker) };
+		if (settings.pvsCulling) {
+			arguments.push_back("-pvs");
+			arguments.push_back(std::to_string(settings.pvsMargin));
+		}
+		arguments.push_back(settings.cpuRendering ? "-cpu" : GetGraphicsAPIArgument(settings.graphicsAPI));
+		if (!executable.empty() && workers[i].Start(executable, arguments))
+			numStarted++;
+		else
+			log::warning("BatchRenderer: could not start worker %u", i);
+	}
+	//Without worker processes the coordinator renders the queue itself
+	if (numStarted == 0)
+		RunWorker(absoluteJobFile, queueFolder, 0, 0, settings);
+	for (ChildProcess& worker : workers) {
+		if (worker.IsStarted() && worker.Wait() != 0)
+			log::warning("BatchRenderer: a worker exited with an error");
+	}
+	double wallSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	//Per job totals of the results
+	struct JobTotals {
+		uint sceneLoads = 0;
+		double loadMs = 0.0;
+		std::vector<double> frameMs;
+	};
+	std::vector<JobTotals> totals(jobs.GetJobs().size());
+	for (const QueueItem& item : ListItems(queueFolder, k_DoneExtension)) {
+		ItemResult result;
+		if (item.job >= totals.size() || !ReadResult(queueFolder / (GetItemName(item) + k_DoneExtension), result))
+			continue;
+		JobTotals& job = totals[item.job];
+		if (result.loadMs > 0.0) {
+			job.sceneLoads++;
+			job.loadMs += result.loadMs;
+		}
+		for (const auto& [frame, ms] : result.frameMs)
+			job.frameMs.push_back(ms);
+	}
+
+	size_t numRendered = 0;
+	for (const JobTotals& job : totals)
+		numRendered += job.frameMs.size();
+	size_t numFailed = jobs.GetNumFrames() - numRendered;
+	double framesPerHour = wallSeconds > 0.0 ? double(numRendered) / wallSeconds * 3600.0 : 0.0;
+
+	std::filesystem::path reportFile = settings.reportFile.empty() ? outputFolder / "BatchReport.json" : settings.reportFile;
+	std::ofstream stream(reportFile);
+	if (!stream) {
+		log::warning("BatchRenderer: could not write %s", reportFile.string().c_str());
+	}
+	else {
+		stream << "{\n  \"version\": \"" << RENDERER_VERSION << "\",\n  \"workers\": " << numWorkers << ",\n  \"threadsPerWorker\": " << threadsPerWorker
+			<< ",\n  \"framesPerItem\": " << framesPerItem << ",\n  \"frames\": " << numRendered << ",\n  \"failedFrames\": " << numFailed
+			<< ",\n  \"wallSeconds\": " << wallSeconds << ",\n  \"framesPerHour\": " << framesPerHour << ",\n  \"jobs\": [";
+		for (size_t i = 0; i < totals.size(); i++) {
+			const BatchJob& job = jobs.GetJobs()[i];
+			const JobTotals& jobTotals = totals[i];
+			double renderMs = 0.0;
+			for (double ms : jobTotals.frameMs)
+				renderMs += ms;
+			//Throughput of a single worker on this job, including its scene loads
+			double workerMs = jobTotals.loadMs + renderMs;
+			double framesPerWorkerHour = workerMs > 0.0 ? double(jobTotals.frameMs.size()) / workerMs * 3600000.0 : 0.0;
+			BenchmarkReport::Summary frameSummary = BenchmarkReport::Summarize(jobTotals.frameMs);
+
+			stream << (i == 0 ? "\n" : ",\n");
+			stream << "    { \"name\": \"" << BenchmarkReport::EscapeJson(job.name) << "\", \"scene\": \"" << BenchmarkReport::EscapeJson(job.scene)
+				<< "\", \"resolution\": \"" << job.resolution.x << "," << job.resolution.y << "\", \"frames\": " << jobTotals.frameMs.size()
+				<< ", \"failedFrames\": " << job.frames.size() - jobTotals.frameMs.size() << ", \"sceneLoads\": " << jobTotals.sceneLoads
+				<< ", \"loadMs\": " << jobTotals.loadMs << ", \"renderMs\": " << renderMs << ", \"framesPerWorkerHour\": " << framesPerWorkerHour
+				<< ", \"frameMs\": { \"mean\": " << frameSummary.mean << ", \"min\": " << frameSummary.min << ", \"p50\": " << frameSummary.p50
+				<< ", \"p95\": " << frameSummary.p95 << ", \"max\": " << frameSummary.max << " } }";
+			log::info("BatchRenderer: %s (%s) %zu frames, %u scene loads %.0f ms, frames p50 %.1f ms max %.1f ms", job.name.c_str(), job.scene.c_str(),
+				jobTotals.frameMs.size(), jobTotals.sceneLoads, jobTotals.loadMs, frameSummary.p50, frameSummary.max);
+		}
+		stream << "\n  ]\n}\n";
+	}
+	log::info("BatchRenderer: %zu frames in %.1f s (%.0f frames per hour), %zu failed, report %s", numRendered, wallSeconds, framesPerHour, numFailed,
+		reportFile.string().c_str());
+
+	//Failed items stay in the queue folder for inspection
+	if (numFailed == 0)
+		std::filesystem::remove_all(queueFolder, error);
+	return numFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <nvrhi/nvrhi.h>
+#include <filesystem>
+
+using namespace donut::math;
+
+//Options of a batch run
+struct BatchSettings {
+	uint numWorkers = 1;					//Worker processes, the cores are split between them
+	uint framesPerItem = 4;					//Frames per queue item; smaller items balance better, larger ones touch the queue less often
+	std::filesystem::path reportFile;		//JSON report, BatchReport.json in the output folder if empty
+	bool pvsCulling = false;				//Workers only load the cells of the scene potentially visible from the cameras (see PotentiallyVisibleSet)
+	uint pvsMargin = 1;						//Cells kept around the visible ones, for shadows and reflections of nearby geometry
+	bool cpuRendering = false;				//Render with the CpuRenderer even if a ray tracing device exists
+	nvrhi::GraphicsAPI graphicsAPI = nvrhi::GraphicsAPI::D3D12;	//API of the workers' headless devices
+};
+
+/* Headless offline rendering of a batch job file (see BatchJobFile) on one machine.
+   The coordinator splits the jobs into items of a few consecutive frames and writes them as files into a queue folder.
+   It then starts worker processes of the same executable, which claim items by renaming them (atomic on all file systems the output
+   folder can be on) and prefer items of the scene they have loaded, so every worker loads a scene once and renders many frames from it.
+   Results come back as files with the load and frame timings, from which the coordinator writes the throughput report.
+   Workers that can create a headless ray tracing device render with the Renderer into an offscreen target, the others with the CpuRenderer,
+   so no graphics device is needed. Frames are written as PNGs named <job>_<frame>.png
+*/
+namespace BatchRenderer {
+	//Coordinator: fills the queue, runs the workers and writes the report. Returns the exit code of the process
+	int Run(const std::filesystem::path& jobFile, const BatchSettings& settings);
+
+	//Worker process: renders queue items until the queue is empty. numThreads = 0 uses all hardware threads.
+	//With pvsCulling the CpuRenderer loads a scene that has a .pvs file without the cells that no camera of its jobs can see
+	int RunWorker(const std::filesystem::path& jobFile, const std::filesystem::path& queueFolder, uint workerIndex, uint numThreads,
+		const BatchSettings& settings);
+}
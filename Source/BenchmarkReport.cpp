@@ -0,0 +1,113 @@
+#include "BenchmarkReport.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+using namespace donut;
+
+std::string BenchmarkReport::EscapeJson(const std::string& str)
+{
+	std::string escaped;
+	escaped.reserve(str.size());
+	for (char c : str) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+			escaped += c;
+		}
+		else if (static_cast<unsigned char>(c) < 0x20) {
+			char buffer[8];
+			snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+			escaped += buffer;
+		}
+		else {
+			escaped += c;
+		}
+	}
+	return escaped;
+}
+
+static void WriteSummary(std::ostream& stream, const char* name, const BenchmarkReport::Summary& summary, bool last) {
+	stream << "    \"" << name << "\": { \"mean\": " << summary.mean << ", \"min\": " << summary.min << ", \"max\": " << summary.max
+		<< ", \"p50\": " << summary.p50 << ", \"p95\": " << summary.p95 << ", \"p99\": " << summary.p99 << " }" << (last ? "\n" : ",\n");
+}
+
+void BenchmarkReport::Clear()
+{
+	m_Info.clear();
+	m_Frames.clear();
+}
+
+void BenchmarkReport::SetInfo(const std::string& key, const std::string& value)
+{
+	for (auto& info : m_Info) {
+		if (info.first == key) {
+			info.second = value;
+			return;
+		}
+	}
+	m_Info.emplace_back(key, value);
+}
+
+BenchmarkReport::Summary BenchmarkReport::Summarize(std::vector<double> values)
+{
+	Summary summary;
+	if (values.empty())
+		return summary;
+
+	std::sort(values.begin(), values.end());
+	auto percentile = [&values](double p) {
+		size_t rank = size_t(std::ceil(p / 100.0 * double(values.size())));
+		return values[std::min(std::max(rank, size_t(1)), values.size()) - 1];
+	};
+
+	double sum = 0.0;
+	for (double value : values)
+		sum += value;
+	summary.mean = sum / double(values.size());
+	summary.min = values.front();
+	summary.max = values.back();
+	summary.p50 = percentile(50.0);
+	summary.p95 = percentile(95.0);
+	summary.p99 = percentile(99.0);
+	return summary;
+}
+
+bool BenchmarkReport::WriteJson(const std::filesystem::path& file) const
+{
+	std::ofstream stream(file);
+	if (!stream) {
+		log::warning("BenchmarkReport: could not write %s", file.string().c_str());
+		return false;
+	}
+
+	std::vector<double> frameMs, cpuMs, gpuMs;
+	for (const FrameTiming& timing : m_Frames) {
+		frameMs.push_back(timing.frameMs);
+		cpuMs.push_back(timing.cpuMs);
+		gpuMs.push_back(timing.gpuMs);
+	}
+
+	stream.precision(6);
+	stream << std::fixed;
+	stream << "{\n";
+	stream << "  \"info\": {\n";
+	for (size_t i = 0; i < m_Info.size(); i++)
+		stream << "    \"" << EscapeJson(m_Info[i].first) << "\": \"" << EscapeJson(m_Info[i].second) << "\"" << (i + 1 < m_Info.size() ? ",\n" : "\n");
+	stream << "  },\n";
+	stream << "  \"numFrames\": " << m_Frames.size() << ",\n";
+	stream << "  \"summary\": {\n";
+	WriteSummary(stream, "frameMs", Summarize(frameMs), false);
+	WriteSummary(stream, "cpuMs", Summarize(cpuMs), false);
+	WriteSummary(stream, "gpuMs", Summarize(gpuMs), true);
+	stream << "  },\n";
+	stream << "  \"frames\": [\n";
+	for (size_t i = 0; i < m_Frames.size(); i++) {
+		stream << "    { \"frame\": " << i << ", \"frameMs\": " << m_Frames[i].frameMs << ", \"cpuMs\": " << m_Frames[i].cpuMs
+			<< ", \"gpuMs\": " << m_Frames[i].gpuMs << " }" << (i + 1 < m_Frames.size() ? ",\n" : "\n");
+	}
+	stream << "  ]\n";
+	stream << "}\n";
+	return true;
+}
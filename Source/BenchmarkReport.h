@@ -0,0 +1,48 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+//Timings of one benchmark frame in milliseconds
+struct FrameTiming {
+	double frameMs = 0.0;	//Wall clock time until the next frame started
+	double cpuMs = 0.0;		//CPU time spent recording and submitting the frame
+	double gpuMs = 0.0;		//GPU time of the ray dispatch, measured with a timer query
+};
+
+/* Collects per frame timings of a benchmark run and writes them together with
+   percentile summaries as JSON, so runs of different builds can be compared
+*/
+class BenchmarkReport {
+public:
+	struct Summary {
+		double mean = 0.0;
+		double min = 0.0;
+		double max = 0.0;
+		double p50 = 0.0;
+		double p95 = 0.0;
+		double p99 = 0.0;
+	};
+
+	void Clear();
+
+	//Adds a string that is written to the "info" object of the report (e.g. scene, GPU, resolution)
+	void SetInfo(const std::string& key, const std::string& value);
+
+	void AddFrame(const FrameTiming& timing) { m_Frames.push_back(timing); }
+	FrameTiming& GetFrame(size_t index) { return m_Frames[index]; }
+	size_t GetNumFrames() const { return m_Frames.size(); }
+
+	//Nearest rank percentiles, mean, min and max of the values
+	static Summary Summarize(std::vector<double> values);
+
+	bool WriteJson(const std::filesystem::path& file) const;
+
+	//Escapes quotes, backslashes and control characters for a JSON string
+	static std::string EscapeJson(const std::string& str);
+
+private:
+	std::vector<std::pair<std::string, std::string>> m_Info;
+	std::vector<FrameTiming> m_Frames;
+};
@@ -0,0 +1,239 @@
+#include "BlockEditor.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace donut;
+
+static const uint k_MinGrowth = 1024;		//Slots appended at least when the free list is empty
+
+static int& GetFaceMaterialRef(AABBMaterials& materials, BlockEditor::Face face) {
+	switch (face) {
+	case BlockEditor::NegX: return materials.negXMatID;
+	case BlockEditor::PosX: return materials.posXMatID;
+	case BlockEditor::NegZ: return materials.negZMatID;
+	case BlockEditor::PosZ: return materials.posZMatID;
+	case BlockEditor::NegY: return materials.negYMatID;
+	default: return materials.posYMatID;
+	}
+}
+
+static bool SameMaterials(const AABBMaterials& a, const AABBMaterials& b) {
+	return a.negXMatID == b.negXMatID && a.posXMatID == b.posXMatID && a.negZMatID == b.negZMatID && a.posZMatID == b.posZMatID
+		&& a.negYMatID == b.negYMatID && a.posYMatID == b.posYMatID;
+}
+
+BlockEditor::BlockEditor(std::vector<AABB>& aabbs, std::vector<AABBMaterials>& materials, uint reserveSlots) : m_AABBs(aabbs), m_Materials(materials)
+{
+	auto indexStart = std::chrono::high_resolution_clock::now();
+	m_Materials.resize(m_AABBs.size(), GetUniformMaterials(-1));
+	//Descending, so that the lowest free slot ends up at the back
+	for (uint slot = uint(m_AABBs.size()); slot-- > 0;) {
+		if (IsFreeSlot(m_AABBs[slot]))
+			m_FreeSlots.push_back(slot);
+		else
+			m_ChunkSlots[GetChunkKey(GetCell(m_AABBs[slot]))].push_back(slot);
+	}
+	m_Stats.numFreeSlots = uint(m_FreeSlots.size());
+	m_Stats.numUsedSlots = uint(m_AABBs.size()) - m_Stats.numFreeSlots;
+	if (reserveSlots > 0)
+		Grow(reserveSlots, m_AABBs.empty() ? int3(0) : GetCell(m_AABBs.back()));
+
+	double indexMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - indexStart).count();
+	log::info("BlockEditor: indexed %u boxes in %zu chunks, %u free slots, %.1f ms", m_Stats.numUsedSlots, m_ChunkSlots.size(), m_Stats.numFreeSlots, indexMs);
+}
+
+bool BlockEditor::SetBlock(int3 cell, const AABBMaterials& materials)
+{
+	AABB box;
+	box.min = float3(cell);
+	box.max = float3(cell) + float3(1.f);
+
+	//The first box of the cell becomes the block, the others are removed
+	std::vector<uint> cellSlots;
+	GetSlots(cell, cellSlots);
+	if (cellSlots.size() == 1 && all(m_AABBs[cellSlots[0]].min == box.min) && all(m_AABBs[cellSlots[0]].max == box.max)
+		&& SameMaterials(m_Materials[cellSlots[0]], materials))
+		return false;
+
+	uint slot = cellSlots.empty() ? AllocateSlot(cell) : cellSlots[0];
+	for (size_t i = 1; i < cellSlots.size(); i++)
+		FreeSlot(cellSlots[i]);
+	m_AABBs[slot] = box;
+	m_Materials[slot] = materials;
+	m_DirtySlots.push_back(slot);
+	m_Stats.numEdits++;
+	return true;
+}
+
+bool BlockEditor::RemoveBlock(int3 cell)
+{
+	std::vector<uint> cellSlots;
+	GetSlots(cell, cellSlots);
+	if (cellSlots.empty())
+		return false;
+	for (uint slot : cellSlots)
+		FreeSlot(slot);
+	m_Stats.numEdits++;
+	return true;
+}
+
+bool BlockEditor::SetFaceMaterial(int3 cell, Face face, int materialID)
+{
+	std::vector<uint> cellSlots;
+	GetSlots(cell, cellSlots);
+	bool changed = false;
+	for (uint slot : cellSlots) {
+		int& faceMaterial = GetFaceMaterialRef(m_Materials[slot], face);
+		if (faceMaterial == materialID)
+			continue;
+		faceMaterial = materialID;
+		m_DirtySlots.push_back(slot);
+		changed = true;
+	}
+	if (changed)
+		m_Stats.numEdits++;
+	return changed;
+}
+
+bool BlockEditor::IsOccupied(int3 cell) const
+{
+	const std::vector<uint>* chunk = FindChunk(cell);
+	if (!chunk)
+		return false;
+	for (uint slot : *chunk) {
+		if (all(GetCell(m_AABBs[slot]) == cell))
+			return true;
+	}
+	return false;
+}
+
+void BlockEditor::GetSlots(int3 cell, std::vector<uint>& slots) const
+{
+	slots.clear();
+	const std::vector<uint>* chunk = FindChunk(cell);
+	if (!chunk)
+		return;
+	for (uint slot : *chunk) {
+		if (all(GetCell(m_AABBs[slot]) == cell))
+			slots.push_back(slot);
+	}
+}
+
+std::vector<BlockEditor::SlotRange> BlockEditor::TakeDirtyRanges(uint maxGap)
+{
+	std::sort(m_DirtySlots.begin(), m_DirtySlots.end());
+	m_DirtySlots.erase(std::unique(m_DirtySlots.begin(), m_DirtySlots.end()), m_DirtySlots.end());
+
+	std::vector<SlotRange> ranges;
+	for (uint slot : m_DirtySlots) {
+		if (!ranges.empty() && slot - (ranges.back().first + ranges.back().count) <= maxGap)
+			ranges.back().count = slot - ranges.back().first + 1;
+		else
+			ranges.push_back({ slot, 1 });
+	}
+	m_DirtySlots.clear();
+	return ranges;
+}
+
+bool BlockEditor::TakeGrown()
+{
+	bool grown = m_Grown;
+	m_Grown = false;
+	return grown;
+}
+
+int3 BlockEditor::GetCell(const AABB& aabb)
+{
+	return int3(int(std::floor(aabb.min.x)), int(std::floor(aabb.min.y)), int(std::floor(aabb.min.z)));
+}
+
+AABBMaterials BlockEditor::GetUniformMaterials(int materialID)
+{
+	AABBMaterials materials = {};
+	for (int face = 0; face < NumFaces; face++)
+		GetFaceMaterialRef(materials, Face(face)) = materialID;
+	return materials;
+}
+
+int BlockEditor::GetFaceMaterial(const AABBMaterials& materials, Face face)
+{
+	AABBMaterials copy = materials;
+	return GetFaceMaterialRef(copy, face);
+}
+
+uint64_t BlockEditor::GetChunkKey(int3 cell)
+{
+	//21 bits per axis, arithmetic shifts keep negative cells apart
+	const uint64_t mask = (uint64_t(1) << 21) - 1;
+	return (uint64_t(cell.x >> k_ChunkShift) & mask) | ((uint64_t(cell.y >> k_ChunkShift) & mask) << 21) | ((uint64_t(cell.z >> k_ChunkShift) & mask) << 42);
+}
+
+uint BlockEditor::AllocateSlot(int3 cell)
+{
+	if (m_FreeSlots.empty())
+		Grow(std::max(uint(m_AABBs.size() / 16), k_MinGrowth), cell);
+	uint slot = m_FreeSlots.back();
+	m_FreeSlots.pop_back();
+	m_ChunkSlots[GetChunkKey(cell)].push_back(slot);
+	m_Stats.numUsedSlots++;
+	m_Stats.numFreeSlots--;
+	return slot;
+}
+
+void BlockEditor::FreeSlot(uint slot)
+{
+	AABB& aabb = m_AABBs[slot];
+	int3 cell = GetCell(aabb);
+	std::vector<uint>* chunk = FindChunk(cell);
+	if (chunk) {
+		auto it = std::find(chunk->begin(), chunk->end(), slot);
+		if (it != chunk->end()) {
+			*it = chunk->back();
+			chunk->pop_back();
+		}
+		if (chunk->empty())
+			m_ChunkSlots.erase(GetChunkKey(cell));
+	}
+
+	//Collapsed in place, so that a refit does not stretch the BVH
+	aabb.max = aabb.min;
+	m_Materials[slot] = GetUniformMaterials(-1);
+	m_FreeSlots.push_back(slot);
+	m_DirtySlots.push_back(slot);
+	m_Stats.numUsedSlots--;
+	m_Stats.numFreeSlots++;
+}
+
+void BlockEditor::Grow(uint numSlots, int3 cell)
+{
+	uint first = uint(m_AABBs.size());
+	AABB freeBox;
+	freeBox.min = float3(cell);
+	freeBox.max = float3(cell);
+	m_AABBs.resize(first + numSlots, freeBox);
+	m_Materials.resize(first + numSlots, GetUniformMaterials(-1));
+
+	//In front of the existing free slots, which are lower
+	std::vector<uint> newSlots(numSlots);
+	for (uint i = 0; i < numSlots; i++)
+		newSlots[i] = first + numSlots - 1 - i;
+	m_FreeSlots.insert(m_FreeSlots.begin(), newSlots.begin(), newSlots.end());
+
+	m_Grown = true;
+	m_Stats.numGrowths++;
+	m_Stats.numFreeSlots += numSlots;
+}
+
+std::vector<uint>* BlockEditor::FindChunk(int3 cell)
+{
+	auto it = m_ChunkSlots.find(GetChunkKey(cell));
+	return it != m_ChunkSlots.end() ? &it->second : nullptr;
+}
+
+const std::vector<uint>* BlockEditor::FindChunk(int3 cell) const
+{
+	auto it = m_ChunkSlots.find(GetChunkKey(cell));
+	return it != m_ChunkSlots.end() ? &it->second : nullptr;
+}
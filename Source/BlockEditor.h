@@ -0,0 +1,86 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <unordered_map>
+#include <vector>
+
+using namespace donut::math;
+#include "sharedShaderData.h" //Needs namespace donut::math;
+
+/* Runtime edits of the blocks of a scene in integer block coordinates, applied to the AABB and AABB material arrays of MinecraftSceneLoader.
+   A cell holds the boxes whose min corner lies in it (full blocks, slabs, stair parts, ...), the same assignment as SceneRegion.
+   The arrays are used as slots: removed boxes become degenerate boxes (min == max, never hit by RayBoxIntersection) with no materials
+   and are reused through a free list, so an edit only touches its own slots and the arrays only grow when no slot is free.
+   The changed slots are collected for partial uploads (TakeDirtyRanges)
+*/
+class BlockEditor {
+public:
+	//Order of the material IDs in AABBMaterials
+	enum Face {
+		NegX,
+		PosX,
+		NegZ,
+		PosZ,
+		NegY,
+		PosY,
+		NumFaces
+	};
+
+	//Consecutive slots [first, first + count)
+	struct SlotRange {
+		uint first = 0;
+		uint count = 0;
+	};
+
+	struct Stats {
+		uint64_t numEdits = 0;		//Calls that changed a cell
+		uint numUsedSlots = 0;
+		uint numFreeSlots = 0;
+		uint numGrowths = 0;		//Times the arrays had to grow
+	};
+
+	//Indexes the boxes of the arrays by cell, degenerate boxes become free slots. The arrays are referenced and have to outlive the editor.
+	//reserveSlots free slots are appended at once, so that the first edits do not grow the arrays
+	BlockEditor(std::vector<AABB>& aabbs, std::vector<AABBMaterials>& materials, uint reserveSlots);
+
+	//Replaces the boxes of the cell with a full block. Returns false if the cell already is this block
+	bool SetBlock(int3 cell, const AABBMaterials& materials);
+	//Removes all boxes of the cell. Returns false if the cell is empty
+	bool RemoveBlock(int3 cell);
+	//Sets the material of one face of all boxes of the cell. Returns false if the cell is empty or nothing changed
+	bool SetFaceMaterial(int3 cell, Face face, int materialID);
+
+	bool IsOccupied(int3 cell) const;
+	//Slots of the boxes of the cell
+	void GetSlots(int3 cell, std::vector<uint>& slots) const;
+
+	//Slots changed since the last call, sorted and merged into ranges. Ranges closer than maxGap slots are joined to save uploads
+	std::vector<SlotRange> TakeDirtyRanges(uint maxGap = 16);
+	bool HasDirtySlots() const { return !m_DirtySlots.empty(); }
+	//True if the arrays grew since the last call, buffers sized by the arrays have to be recreated
+	bool TakeGrown();
+
+	const Stats& GetStats() const { return m_Stats; }
+
+	static bool IsFreeSlot(const AABB& aabb) { return all(aabb.min == aabb.max); }
+	static int3 GetCell(const AABB& aabb);
+	static AABBMaterials GetUniformMaterials(int materialID);
+	static int GetFaceMaterial(const AABBMaterials& materials, Face face);
+
+private:
+	static const int k_ChunkShift = 4;		//Cells are indexed in chunks of 16^3
+
+	static uint64_t GetChunkKey(int3 cell);
+	uint AllocateSlot(int3 cell);
+	void FreeSlot(uint slot);
+	void Grow(uint numSlots, int3 cell);
+	std::vector<uint>* FindChunk(int3 cell);
+	const std::vector<uint>* FindChunk(int3 cell) const;
+
+	std::vector<AABB>& m_AABBs;
+	std::vector<AABBMaterials>& m_Materials;
+	std::unordered_map<uint64_t, std::vector<uint>> m_ChunkSlots;	//Used slots by chunk
+	std::vector<uint> m_FreeSlots;		//Lowest slot at the back
+	std::vector<uint> m_DirtySlots;
+	bool m_Grown = false;
+	Stats m_Stats;
+};
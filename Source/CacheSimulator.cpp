@@ -0,0 +1,49 @@
+#include "CacheSimulator.h"
+#include <algorithm>
+
+CacheSimulator::CacheSimulator(size_t cacheBytes, unsigned lineBytes, unsigned ways)
+	: m_LineBytes(std::max(lineBytes, 1u)), m_Ways(std::max(ways, 1u))
+{
+	m_NumSets = std::max<size_t>(cacheBytes / (size_t(m_LineBytes) * m_Ways), 1);
+	Reset();
+}
+
+void CacheSimulator::Reset()
+{
+	m_Tags.assign(m_NumSets * m_Ways, 0);
+	m_LastUse.assign(m_NumSets * m_Ways, 0);
+	m_Time = 0;
+	m_Accesses = 0;
+	m_Misses = 0;
+}
+
+void CacheSimulator::Access(uint64_t address, unsigned bytes)
+{
+	const uint64_t firstLine = address / m_LineBytes;
+	const uint64_t lastLine = (address + std::max(bytes, 1u) - 1) / m_LineBytes;
+	for (uint64_t line = firstLine; line <= lastLine; line++) {
+		m_Accesses++;
+		m_Time++;
+		const size_t set = size_t(line % m_NumSets);
+		uint64_t* tags = &m_Tags[set * m_Ways];
+		uint64_t* lastUse = &m_LastUse[set * m_Ways];
+
+		//Hit, or replace the least recently used way
+		unsigned victim = 0;
+		bool hit = false;
+		for (unsigned way = 0; way < m_Ways; way++) {
+			if (tags[way] == line + 1) {
+				victim = way;
+				hit = true;
+				break;
+			}
+			if (lastUse[way] < lastUse[victim])
+				victim = way;
+		}
+		if (!hit) {
+			m_Misses++;
+			tags[victim] = line + 1;
+		}
+		lastUse[victim] = m_Time;
+	}
+}
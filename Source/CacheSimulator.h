@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Set associative LRU cache model. Used to compare the memory locality of buffer layouts without GPU counters
+*/
+class CacheSimulator {
+public:
+	//Defaults roughly match the L1 cache of a GPU shader multiprocessor
+	explicit CacheSimulator(size_t cacheBytes = 64 * 1024, unsigned lineBytes = 128, unsigned ways = 8);
+
+	//Touches every cache line of [address, address + bytes)
+	void Access(uint64_t address, unsigned bytes);
+	void Reset();
+
+	uint64_t GetAccesses() const { return m_Accesses; }
+	uint64_t GetMisses() const { return m_Misses; }
+	double GetMissRate() const { return m_Accesses > 0 ? double(m_Misses) / double(m_Accesses) : 0.0; }
+
+private:
+	unsigned m_LineBytes;
+	unsigned m_Ways;
+	size_t m_NumSets;
+	std::vector<uint64_t> m_Tags;		//Line address + 1 per way, 0 for empty ways
+	std::vector<uint64_t> m_LastUse;
+	uint64_t m_Time = 0;
+	uint64_t m_Accesses = 0;			//Cache line accesses
+	uint64_t m_Misses = 0;
+};
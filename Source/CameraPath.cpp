@@ -0,0 +1,124 @@
+#include "CameraPath.h"
+#include <donut/core/log.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+using namespace donut;
+
+static const char* k_PathFileHeader = "# Mineways Renderer camera path v1";
+
+static void WriteValue(std::ostream& stream, float value) { stream << value; }
+static void WriteValue(std::ostream& stream, int value) { stream << value; }
+static void WriteValue(std::ostream& stream, const float3& value) { stream << value.x << "," << value.y << "," << value.z; }
+
+static bool ReadValue(const std::string& str, float& value) { return sscanf(str.c_str(), "%f", &value) == 1; }
+static bool ReadValue(const std::string& str, int& value) { return sscanf(str.c_str(), "%d", &value) == 1; }
+static bool ReadValue(const std::string& str, float3& value) { return sscanf(str.c_str(), "%f,%f,%f", &value.x, &value.y, &value.z) == 3; }
+
+void CameraPath::Clear()
+{
+	m_SceneName.clear();
+	m_Timestep = 1.f / 60.f;
+	m_Frames.clear();
+}
+
+void CameraPath::ApplyRenderSettings(const UIData& source, UIData& target)
+{
+	VisitRenderSettings([](const char*, auto& targetField, const auto& sourceField) {
+		targetField = sourceField;
+	}, target, source);
+}
+
+bool CameraPath::ReadRenderSetting(const std::string& token, UIData& ui)
+{
+	size_t split = token.find('=');
+	if (split == std::string::npos)
+		return false;
+	std::string key = token.substr(0, split);
+	std::string value = token.substr(split + 1);
+	bool read = false;
+	VisitRenderSettings([&](const char* name, auto& field) {
+		if (key == name)
+			read = ReadValue(value, field);
+	}, ui);
+	return read;
+}
+
+bool CameraPath::Load(const std::filesystem::path& file)
+{
+	Clear();
+
+	std::ifstream stream(file);
+	if (!stream)
+		return false;
+
+	std::string line;
+	if (!std::getline(stream, line) || line.rfind(k_PathFileHeader, 0) != 0) {
+		log::warning("CameraPath: %s is not a camera path file", file.string().c_str());
+		return false;
+	}
+
+	while (std::getline(stream, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		if (line.rfind("scene=", 0) == 0) {
+			m_SceneName = line.substr(6);
+		}
+		else if (line.rfind("timestep=", 0) == 0) {
+			if (!ReadValue(line.substr(9), m_Timestep) || m_Timestep <= 0.f)
+				m_Timestep = 1.f / 60.f;
+		}
+		else if (line.rfind("frame ", 0) == 0) {
+			//frame <position> <direction> <up> key=value ...
+			std::istringstream lineStream(line.substr(6));
+			std::string position, direction, up;
+			CameraPathFrame frame;
+			if (!(lineStream >> position >> direction >> up) || !ReadValue(position, frame.position) ||
+				!ReadValue(direction, frame.direction) || !ReadValue(up, frame.up)) {
+				log::warning("CameraPath: invalid frame %zu in %s", m_Frames.size(), file.string().c_str());
+				Clear();
+				return false;
+			}
+
+			//Fields missing in the file keep their default value
+			std::string token;
+			while (lineStream >> token)
+				ReadRenderSetting(token, frame.ui);
+			m_Frames.push_back(frame);
+		}
+	}
+
+	return !m_Frames.empty();
+}
+
+bool CameraPath::Save(const std::filesystem::path& file) const
+{
+	std::ofstream stream(file);
+	if (!stream) {
+		log::warning("CameraPath: could not write %s", file.string().c_str());
+		return false;
+	}
+
+	//Enough digits for an exact float round trip
+	stream.precision(9);
+
+	stream << k_PathFileHeader << "\n";
+	stream << "scene=" << m_SceneName << "\n";
+	stream << "timestep=" << m_Timestep << "\n";
+	for (const CameraPathFrame& frame : m_Frames) {
+		stream << "frame ";
+		WriteValue(stream, frame.position);
+		stream << " ";
+		WriteValue(stream, frame.direction);
+		stream << " ";
+		WriteValue(stream, frame.up);
+		VisitRenderSettings([&](const char* name, const auto& field) {
+			stream << " " << name << "=";
+			WriteValue(stream, field);
+		}, frame.ui);
+		stream << "\n";
+	}
+	return true;
+}
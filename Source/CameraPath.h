@@ -0,0 +1,48 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "UIData.h"
+
+//Camera transform and render settings of one frame
+struct CameraPathFrame {
+	float3 position = float3(0.f);
+	float3 direction = float3(0.f, 0.f, -1.f);
+	float3 up = float3(0.f, 1.f, 0.f);
+	UIData ui;
+};
+
+/* Recorded camera flythrough (per frame camera transform and UIData) for reproducible benchmarks.
+   Stored as a text file with one line per frame. The scene is stored by name, as the scene index in UIData depends on the available scenes
+*/
+class CameraPath {
+public:
+	void Clear();
+
+	void AddFrame(const CameraPathFrame& frame) { m_Frames.push_back(frame); }
+
+	//Reads the path file. Returns false if it does not exist or is invalid
+	bool Load(const std::filesystem::path& file);
+	bool Save(const std::filesystem::path& file) const;
+
+	void SetSceneName(const std::string& sceneName) { m_SceneName = sceneName; }
+	const std::string& GetSceneName() const { return m_SceneName; }
+
+	//Average frame time of the recording in seconds. The replay renders one recorded frame per frame and reports the frames that were slower
+	void SetTimestep(float timestep) { m_Timestep = timestep; }
+	float GetTimestep() const { return m_Timestep; }
+
+	//Copies the recorded render settings, the scene selection and scene cache budgets of the target are kept
+	static void ApplyRenderSettings(const UIData& source, UIData& target);
+	//Reads a key=value token of a render setting as written by Save. Returns false for unknown keys or invalid values
+	static bool ReadRenderSetting(const std::string& token, UIData& ui);
+
+	const std::vector<CameraPathFrame>& GetFrames() const { return m_Frames; }
+	size_t GetNumFrames() const { return m_Frames.size(); }
+
+private:
+	std::string m_SceneName;
+	float m_Timestep = 1.f / 60.f;
+	std::vector<CameraPathFrame> m_Frames;
+};
@@ -0,0 +1,203 @@
+#include "CpuBvh.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <utility>
+
+static float SurfaceArea(float3 boundsMin, float3 boundsMax) {
+	float3 extent = max(boundsMax - boundsMin, float3(0.f));
+	return 2.f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+void CpuBvh::Clear()
+{
+	m_Nodes.clear();
+	m_Primitives.clear();
+	m_BuildTimeMs = 0.0;
+}
+
+void CpuBvh::Build(const std::vector<AABB>& aabbs, const std::vector<VertexData>& vertices, const std::vector<uint>& indices)
+{
+	auto buildStart = std::chrono::high_resolution_clock::now();
+	Clear();
+
+	const uint numAABBs = uint(aabbs.size());
+	const uint numTriangles = uint(indices.size() / 3);
+	const uint numPrimitives = numAABBs + numTriangles;
+	if (numPrimitives == 0)
+		return;
+
+	//Primitive bounds and centroids
+	m_Primitives.resize(numPrimitives);
+	m_PrimitiveMin.resize(numPrimitives);
+	m_PrimitiveMax.resize(numPrimitives);
+	m_Centroids.resize(numPrimitives);
+	for (uint i = 0; i < numAABBs; i++) {
+		m_Primitives[i] = i;
+		m_PrimitiveMin[i] = aabbs[i].min;
+		m_PrimitiveMax[i] = aabbs[i].max;
+	}
+	for (uint i = 0; i < numTriangles; i++) {
+		const float3& v0 = vertices[indices[i * 3]].position;
+		const float3& v1 = vertices[indices[i * 3 + 1]].position;
+		const float3& v2 = vertices[indices[i * 3 + 2]].position;
+		m_Primitives[numAABBs + i] = i | k_TriangleFlag;
+		m_PrimitiveMin[numAABBs + i] = min(v0, min(v1, v2));
+		m_PrimitiveMax[numAABBs + i] = max(v0, max(v1, v2));
+	}
+	for (uint i = 0; i < numPrimitives; i++)
+		m_Centroids[i] = (m_PrimitiveMin[i] + m_PrimitiveMax[i]) * 0.5f;
+
+	//The temporary arrays are indexed by the position in m_Primitives and are partitioned together with it
+	m_Nodes.reserve(size_t(numPrimitives) * 2);
+	CpuBvhNode root = {};
+	root.leftOrFirst = 0;
+	root.count = numPrimitives;
+	m_Nodes.push_back(root);
+	UpdateNodeBounds(0);
+
+	//Pairs of node index and depth
+	std::vector<std::pair<uint, uint>> stack = { { 0, 0 } };
+	while (!stack.empty()) {
+		uint nodeIndex = stack.back().first;
+		uint depth = stack.back().second;
+		stack.pop_back();
+		CpuBvhNode node = m_Nodes[nodeIndex];
+		if (node.count <= 1 || depth >= k_MaxDepth)
+			continue;
+
+		int axis = 0;
+		float splitPosition = 0.f;
+		float splitCost = 0.f;
+		if (!FindBestSplit(node, axis, splitPosition, splitCost))
+			continue;
+		//Keep small leafs if splitting does not pay off
+		float leafCost = SurfaceArea(node.boundsMin, node.boundsMax) * float(node.count);
+		if (splitCost >= leafCost && node.count <= k_MaxLeafPrimitives)
+			continue;
+
+		//Partition the primitive range
+		uint i = node.leftOrFirst;
+		uint j = node.leftOrFirst + node.count - 1;
+		while (i <= j && j != ~0u) {
+			if (m_Centroids[i][axis] < splitPosition) {
+				i++;
+			}
+			else {
+				std::swap(m_Primitives[i], m_Primitives[j]);
+				std::swap(m_PrimitiveMin[i], m_PrimitiveMin[j]);
+				std::swap(m_PrimitiveMax[i], m_PrimitiveMax[j]);
+				std::swap(m_Centroids[i], m_Centroids[j]);
+				j--;
+			}
+		}
+		uint leftCount = i - node.leftOrFirst;
+		if (leftCount == 0 || leftCount == node.count)
+			continue;
+
+		uint leftIndex = uint(m_Nodes.size());
+		CpuBvhNode left = {};
+		left.leftOrFirst = node.leftOrFirst;
+		left.count = leftCount;
+		CpuBvhNode right = {};
+		right.leftOrFirst = i;
+		right.count = node.count - leftCount;
+		m_Nodes.push_back(left);
+		m_Nodes.push_back(right);
+		UpdateNodeBounds(leftIndex);
+		UpdateNodeBounds(leftIndex + 1);
+
+		m_Nodes[nodeIndex].leftOrFirst = leftIndex;
+		m_Nodes[nodeIndex].count = 0;
+		stack.push_back({ leftIndex, depth + 1 });
+		stack.push_back({ leftIndex + 1, depth + 1 });
+	}
+
+	m_PrimitiveMin.clear();
+	m_PrimitiveMax.clear();
+	m_Centroids.clear();
+	m_PrimitiveMin.shrink_to_fit();
+	m_PrimitiveMax.shrink_to_fit();
+	m_Centroids.shrink_to_fit();
+	m_Nodes.shrink_to_fit();
+
+	m_BuildTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildStart).count();
+}
+
+void CpuBvh::UpdateNodeBounds(uint nodeIndex)
+{
+	CpuBvhNode& node = m_Nodes[nodeIndex];
+	node.boundsMin = float3(std::numeric_limits<float>::max());
+	node.boundsMax = float3(-std::numeric_limits<float>::max());
+	for (uint i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++) {
+		node.boundsMin = min(node.boundsMin, m_PrimitiveMin[i]);
+		node.boundsMax = max(node.boundsMax, m_PrimitiveMax[i]);
+	}
+}
+
+bool CpuBvh::FindBestSplit(const CpuBvhNode& node, int& axis, float& splitPosition, float& cost) const
+{
+	//Bins are placed over the centroid bounds
+	float3 centroidMin = float3(std::numeric_limits<float>::max());
+	float3 centroidMax = float3(-std::numeric_limits<float>::max());
+	for (uint i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++) {
+		centroidMin = min(centroidMin, m_Centroids[i]);
+		centroidMax = max(centroidMax, m_Centroids[i]);
+	}
+
+	struct Bin {
+		float3 boundsMin = float3(std::numeric_limits<float>::max());
+		float3 boundsMax = float3(-std::numeric_limits<float>::max());
+		uint count = 0;
+	};
+
+	cost = std::numeric_limits<float>::max();
+	bool found = false;
+	for (int a = 0; a < 3; a++) {
+		float extent = centroidMax[a] - centroidMin[a];
+		if (extent <= 0.f)
+			continue;
+
+		Bin bins[k_NumBins];
+		float scale = float(k_NumBins) / extent;
+		for (uint i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++) {
+			uint binIndex = std::min(k_NumBins - 1, uint((m_Centroids[i][a] - centroidMin[a]) * scale));
+			bins[binIndex].count++;
+			bins[binIndex].boundsMin = min(bins[binIndex].boundsMin, m_PrimitiveMin[i]);
+			bins[binIndex].boundsMax = max(bins[binIndex].boundsMax, m_PrimitiveMax[i]);
+		}
+
+		//Sweep from both sides to get the area and count left and right of every plane
+		float leftArea[k_NumBins - 1], rightArea[k_NumBins - 1];
+		uint leftCount[k_NumBins - 1], rightCount[k_NumBins - 1];
+		Bin leftBox, rightBox;
+		uint leftSum = 0, rightSum = 0;
+		for (uint i = 0; i < k_NumBins - 1; i++) {
+			leftSum += bins[i].count;
+			leftCount[i] = leftSum;
+			leftBox.boundsMin = min(leftBox.boundsMin, bins[i].boundsMin);
+			leftBox.boundsMax = max(leftBox.boundsMax, bins[i].boundsMax);
+			leftArea[i] = leftSum > 0 ? SurfaceArea(leftBox.boundsMin, leftBox.boundsMax) : 0.f;
+
+			uint r = k_NumBins - 1 - i;
+			rightSum += bins[r].count;
+			rightCount[r - 1] = rightSum;
+			rightBox.boundsMin = min(rightBox.boundsMin, bins[r].boundsMin);
+			rightBox.boundsMax = max(rightBox.boundsMax, bins[r].boundsMax);
+			rightArea[r - 1] = rightSum > 0 ? SurfaceArea(rightBox.boundsMin, rightBox.boundsMax) : 0.f;
+		}
+
+		for (uint i = 0; i < k_NumBins - 1; i++) {
+			if (leftCount[i] == 0 || rightCount[i] == 0)
+				continue;
+			float planeCost = leftArea[i] * float(leftCount[i]) + rightArea[i] * float(rightCount[i]);
+			if (planeCost < cost) {
+				cost = planeCost;
+				axis = a;
+				splitPosition = centroidMin[a] + float(i + 1) / scale;
+				found = true;
+			}
+		}
+	}
+	return found;
+}
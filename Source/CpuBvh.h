@@ -0,0 +1,47 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <vector>
+
+using namespace donut::math;
+#include "sharedShaderData.h" //Needs namespace donut::math;
+
+//Node of the CPU BVH. Children of an inner node are stored next to each other (leftOrFirst, leftOrFirst + 1)
+struct CpuBvhNode {
+	float3 boundsMin;
+	uint leftOrFirst;	//Index of the left child for inner nodes, index of the first primitive reference for leafs
+	float3 boundsMax;
+	uint count;			//Number of primitives of a leaf, 0 for inner nodes
+};
+
+/* Binned SAH BVH over all blocks (AABBs) and triangles of a scene, used for ray tracing on the CPU.
+   Primitive references are AABB indices, or triangle indices with k_TriangleFlag set
+*/
+class CpuBvh {
+public:
+	static const uint k_TriangleFlag = 0x80000000u;
+	static const uint k_MaxLeafPrimitives = 8;		//Leafs with more primitives are always split
+	static const uint k_NumBins = 12;
+	static const uint k_MaxDepth = 60;				//Deeper nodes become leafs, keeps the traversal stacks bounded
+
+	void Build(const std::vector<AABB>& aabbs, const std::vector<VertexData>& vertices, const std::vector<uint>& indices);
+
+	void Clear();
+
+	const std::vector<CpuBvhNode>& GetNodes() const { return m_Nodes; }
+	const std::vector<uint>& GetPrimitives() const { return m_Primitives; }
+	bool IsEmpty() const { return m_Nodes.empty(); }
+	double GetBuildTimeMs() const { return m_BuildTimeMs; }
+
+private:
+	//Computes the bounds of the primitives of a node
+	void UpdateNodeBounds(uint nodeIndex);
+	//Finds the best binned SAH split of the node. Returns false if the centroids can not be separated
+	bool FindBestSplit(const CpuBvhNode& node, int& axis, float& splitPosition, float& cost) const;
+
+	std::vector<CpuBvhNode> m_Nodes;		//Root is node 0
+	std::vector<uint> m_Primitives;			//Primitive references, leafs reference a continuous range
+	std::vector<float3> m_PrimitiveMin;		//Temporary primitive bounds used while building
+	std::vector<float3> m_PrimitiveMax;
+	std::vector<float3> m_Centroids;
+	double m_BuildTimeMs = 0.0;
+};
@@ -0,0 +1,708 @@
+#include "CpuRayTracer.h"
+#include "CacheSimulator.h"
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+
+//Packets whose ray directions spread more than this (cosine to the mean direction) are traced as single rays
+static const float k_MinPacketDirectionCos = 0.9f;
+
+//Ray data of a packet in the layout used by the traversal
+struct CpuRayTracer::Packet {
+	uint numRays = 0;
+	CpuRay rays[k_PacketSize];
+	float3 invDirection[k_PacketSize];
+	bool active[k_PacketSize];
+
+	//Frustum planes through the common origin, normals point inside
+	bool hasFrustum = false;
+	float3 frustumOrigin;
+	float3 frustumNormals[4];
+};
+
+static float MaxElement(float3 v) {
+	return max(max(v.x, v.y), v.z);
+}
+
+static float Sign(float v) {
+	return v > 0.f ? 1.f : (v < 0.f ? -1.f : 0.f);
+}
+
+//Same as RayBoxIntersection in RaytraceWorld_rt.hlsl (Majercik et al. 2018, canStartInBox = true, oriented = false)
+static bool RayBoxIntersection(const AABB& aabb, float3 rayOrigin, float3 rayDirection, float& distance, float3& normal) {
+	const float3 invRayDir = float3(1.f) / rayDirection;
+	const float3 boxCenter = (aabb.min + aabb.max) * 0.5f;
+	const float3 boxRadius = boxCenter - aabb.min;
+	const float3 invBoxRadius = float3(1.f) / boxRadius;
+
+	rayOrigin -= boxCenter;
+	float winding = MaxElement(abs(rayOrigin) * invBoxRadius) < 1.f ? -1.f : 1.f;
+	float3 sgn = float3(-Sign(rayDirection.x), -Sign(rayDirection.y), -Sign(rayDirection.z));
+	//Distance to plane
+	float3 d = (boxRadius * winding * sgn - rayOrigin) * invRayDir;
+
+	auto test = [&](int u, int v, int w) {
+		return d[u] >= 0.f && std::abs(rayOrigin[v] + rayDirection[v] * d[u]) < boxRadius[v] && std::abs(rayOrigin[w] + rayDirection[w] * d[u]) < boxRadius[w];
+	};
+	bool testX = test(0, 1, 2);
+	bool testY = test(1, 2, 0);
+	bool testZ = test(2, 0, 1);
+	sgn = testX ? float3(sgn.x, 0.f, 0.f) : (testY ? float3(0.f, sgn.y, 0.f) : float3(0.f, 0.f, testZ ? sgn.z : 0.f));
+
+	distance = (sgn.x != 0.f) ? d.x : ((sgn.y != 0.f) ? d.y : d.z);
+	normal = sgn;
+	return (sgn.x != 0.f) || (sgn.y != 0.f) || (sgn.z != 0.f);
+}
+
+//Same as GetAABBAttributes in RaytraceWorld_rt.hlsl. Hit side order: 0:-x, 1:+x, 2:-z, 3:+z, 4:-y, 5:+y
+static void GetAABBAttributes(const AABB& aabb, float3 hitPos, float3 normal, float2& uv, int& hitSide) {
+	bool negative = normal.x < 0.f || normal.y < 0.f || normal.z < 0.f;
+	if (normal.x != 0.f) {
+		uv = float2((hitPos.z - aabb.min.z) / (aabb.max.z - aabb.min.z), (hitPos.y - aabb.min.y) / (aabb.max.y - aabb.min.y));
+		uv = negative ? float2(1.f - uv.x, 1.f - uv.y) : float2(uv.x, 1.f - uv.y);
+		hitSide = negative ? 0 : 1;
+	}
+	else if (normal.z != 0.f) {
+		uv = float2((hitPos.x - aabb.min.x) / (aabb.max.x - aabb.min.x), (hitPos.y - aabb.min.y) / (aabb.max.y - aabb.min.y));
+		uv = negative ? float2(1.f - uv.x, 1.f - uv.y) : float2(uv.x, 1.f - uv.y);
+		hitSide = negative ? 2 : 3;
+	}
+	else {
+		uv = float2(1.f - (hitPos.x - aabb.min.x) / (aabb.max.x - aabb.min.x), 1.f - (hitPos.z - aabb.min.z) / (aabb.max.z - aabb.min.z));
+		hitSide = negative ? 4 : 5;
+	}
+}
+
+static int GetAABBMaterialID(const AABBMaterials& materials, int hitSide) {
+	switch (hitSide) {
+	case 0: return materials.negXMatID;
+	case 1: return materials.posXMatID;
+	case 2: return materials.negZMatID;
+	case 3: return materials.posZMatID;
+	case 4: return materials.negYMatID;
+	default: return materials.posYMatID;
+	}
+}
+
+static float3 GetAABBNormalFromHitSide(int hitSide) {
+	const float3 normals[6] = { float3(-1.f, 0.f, 0.f), float3(1.f, 0.f, 0.f), float3(0.f, 0.f, -1.f),
+		float3(0.f, 0.f, 1.f), float3(0.f, -1.f, 0.f), float3(0.f, 1.f, 0.f) };
+	return normals[hitSide];
+}
+
+//Moeller-Trumbore. Barycentrics are the weights of the second and third vertex, as in DXR
+static bool RayTriangleIntersection(float3 rayOrigin, float3 rayDirection, float3 v0, float3 v1, float3 v2, float& distance, float2& barycentrics) {
+	float3 edge1 = v1 - v0;
+	float3 edge2 = v2 - v0;
+	float3 p = cross(rayDirection, edge2);
+	float det = dot(edge1, p);
+	if (std::abs(det) < 1e-12f)
+		return false;
+	float invDet = 1.f / det;
+	float3 s = rayOrigin - v0;
+	float u = dot(s, p) * invDet;
+	if (u < 0.f || u > 1.f)
+		return false;
+	float3 q = cross(s, edge1);
+	float v = dot(rayDirection, q) * invDet;
+	if (v < 0.f || u + v > 1.f)
+		return false;
+	distance = dot(edge2, q) * invDet;
+	barycentrics = float2(u, v);
+	return true;
+}
+
+//Slab test against the node bounds within [tMin, tMax]
+static bool RayNodeIntersection(const CpuBvhNode& node, float3 origin, float3 invDirection, float tMin, float tMax) {
+	float3 t0 = (node.boundsMin - origin) * invDirection;
+	float3 t1 = (node.boundsMax - origin) * invDirection;
+	float3 tNear = min(t0, t1);
+	float3 tFar = max(t0, t1);
+	float entry = max(max(tNear.x, tNear.y), max(tNear.z, tMin));
+	float exit = min(min(tFar.x, tFar.y), min(tFar.z, tMax));
+	return entry <= exit;
+}
+
+static float3 SafeInverse(float3 direction) {
+	auto inverse = [](float v) { return std::abs(v) > 1e-20f ? 1.f / v : std::copysign(1e30f, v); };
+	return float3(inverse(direction.x), inverse(direction.y), inverse(direction.z));
+}
+
+CpuRay CpuCamera::GetPrimaryRay(uint2 pixelPosition) const
+{
+	float2 uv = float2((float(pixelPosition.x) + 0.5f) * viewportSizeInv.x, (float(pixelPosition.y) + 0.5f) * viewportSizeInv.y);
+	float4 clipPos = float4(uv.x * 2.f - 1.f, 1.f - uv.y * 2.f, 0.5f, 1.f);
+	float4 worldPos = clipPos * matClipToWorld;
+
+	CpuRay ray;
+	ray.origin = origin;
+	ray.direction = normalize(float3(worldPos.x, worldPos.y, worldPos.z) / worldPos.w - origin);
+	ray.tMin = tMin;
+	ray.tMax = tMax;
+	return ray;
+}
+
+void CpuRayTracer::Stats::Add(const Stats& other)
+{
+	nodesVisited += other.nodesVisited;
+	nodesFrustumCulled += other.nodesFrustumCulled;
+	primitiveTests += other.primitiveTests;
+	packetRays += other.packetRays;
+	singleRays += other.singleRays;
+	fallbackRays += other.fallbackRays;
+}
+
+void CpuRayTracer::Build(const std::vector<AABB>& aabbs, const std::vector<AABBMaterials>& aabbMaterials, const std::vector<VertexData>& vertices,
+	const std::vector<uint>& indices, const std::vector<int>& triPerFaceMatID)
+{
+	m_AABBs = &aabbs;
+	m_AABBMaterials = &aabbMaterials;
+	m_Vertices = &vertices;
+	m_Indices = &indices;
+	m_TriPerFaceMatID = &triPerFaceMatID;
+	m_Bvh.Build(aabbs, vertices, indices);
+}
+
+void CpuRayTracer::SetAlphaTest(std::vector<bool> alphaTestedMaterials, AlphaTestFunction alphaTest)
+{
+	m_AlphaTestedMaterials = std::move(alphaTestedMaterials);
+	m_AlphaTest = std::move(alphaTest);
+}
+
+bool CpuRayTracer::IsOpaque(int materialID, float2 uv) const
+{
+	if (!m_AlphaTest || materialID < 0 || size_t(materialID) >= m_AlphaTestedMaterials.size() || !m_AlphaTestedMaterials[materialID])
+		return true;
+	return m_AlphaTest(materialID, uv);
+}
+
+bool CpuRayTracer::IntersectPrimitive(uint primitive, const CpuRay& ray, CpuHit& hit) const
+{
+	const float tMax = hit.hitType != k_CpuHitTypeMiss ? hit.t : ray.tMax;
+
+	if (primitive & CpuBvh::k_TriangleFlag) {
+		uint triangle = primitive & ~CpuBvh::k_TriangleFlag;
+		const VertexData& v0 = (*m_Vertices)[(*m_Indices)[triangle * 3]];
+		const VertexData& v1 = (*m_Vertices)[(*m_Indices)[triangle * 3 + 1]];
+		const VertexData& v2 = (*m_Vertices)[(*m_Indices)[triangle * 3 + 2]];
+		float distance;
+		float2 barycentrics;
+		if (!RayTriangleIntersection(ray.origin, ray.direction, v0.position, v1.position, v2.position, distance, barycentrics))
+			return false;
+		if (distance < ray.tMin || distance > tMax)
+			return false;
+
+		float3 weights = float3(1.f - barycentrics.x - barycentrics.y, barycentrics.x, barycentrics.y);
+		float2 uv = float2(v0.uvX * weights.x + v1.uvX * weights.y + v2.uvX * weights.z, v0.uvY * weights.x + v1.uvY * weights.y + v2.uvY * weights.z);
+		int matID = (*m_TriPerFaceMatID)[triangle];
+		if (!IsOpaque(matID, uv))
+			return false;
+
+		hit.hitType = k_CpuHitTypeTriangle;
+		hit.matID = matID;
+		hit.t = distance;
+		hit.primitiveIndex = triangle;
+		hit.face = -1;
+		hit.normal = normalize(v0.normal * weights.x + v1.normal * weights.y + v2.normal * weights.z);
+		hit.uv = uv;
+		return true;
+	}
+
+	const AABB& aabb = (*m_AABBs)[primitive];
+	float distance = -1.f;
+	float3 normal;
+	if (!RayBoxIntersection(aabb, ray.origin, ray.direction, distance, normal))
+		return false;
+
+	float3 hitPos = ray.origin + ray.direction * distance;
+	float2 uv;
+	int hitSide;
+	GetAABBAttributes(aabb, hitPos, normal, uv, hitSide);
+	int matID = GetAABBMaterialID((*m_AABBMaterials)[primitive], hitSide);
+	bool accepted = distance >= ray.tMin && distance <= tMax && IsOpaque(matID, uv);
+
+	//If the first hit was rejected, calculate the second hit by moving the ray inside of the box (as the intersection shader does)
+	if (!accepted) {
+		float oldDistance = distance;
+		hitPos += ray.direction * 1e-2f;
+		if (!RayBoxIntersection(aabb, hitPos, ray.direction, distance, normal))
+			return false;
+		hitPos = hitPos + ray.direction * distance;
+		GetAABBAttributes(aabb, hitPos, normal, uv, hitSide);
+		distance += oldDistance;
+		matID = GetAABBMaterialID((*m_AABBMaterials)[primitive], hitSide);
+		if (distance < ray.tMin || distance > tMax || !IsOpaque(matID, uv))
+			return false;
+	}
+
+	hit.hitType = k_CpuHitTypeAABB;
+	hit.matID = matID;
+	hit.t = distance;
+	hit.primitiveIndex = primitive;
+	hit.face = hitSide;
+	hit.normal = GetAABBNormalFromHitSide(hitSide);
+	hit.uv = uv;
+	return true;
+}
+
+bool CpuRayTracer::OccludesPrimitive(uint primitive, const CpuRay& ray) const
+{
+	CpuHit hit;
+	return IntersectPrimitive(primitive, ray, hit);
+}
+
+bool CpuRayTracer::TraceRay(const CpuRay& ray, CpuHit& hit, Stats* stats) const
+{
+	hit = CpuHit();
+	if (m_Bvh.IsEmpty())
+		return false;
+
+	const std::vector<CpuBvhNode>& nodes = m_Bvh.GetNodes();
+	const std::vector<uint>& primitives = m_Bvh.GetPrimitives();
+	const float3 invDirection = SafeInverse(ray.direction);
+	Stats localStats;
+	localStats.singleRays++;
+
+	uint stack[64];
+	uint stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		const CpuBvhNode& node = nodes[stack[--stackSize]];
+		localStats.nodesVisited++;
+		float tMax = hit.hitType != k_CpuHitTypeMiss ? hit.t : ray.tMax;
+		if (!RayNodeIntersection(node, ray.origin, invDirection, ray.tMin, tMax))
+			continue;
+
+		if (node.count > 0) {
+			for (uint i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++) {
+				localStats.primitiveTests++;
+				IntersectPrimitive(primitives[i], ray, hit);
+			}
+			continue;
+		}
+
+		//Visit the nearer child first
+		const CpuBvhNode& left = nodes[node.leftOrFirst];
+		const CpuBvhNode& right = nodes[node.leftOrFirst + 1];
+		bool leftFirst = dot((right.boundsMin + right.boundsMax) - (left.boundsMin + left.boundsMax), ray.direction) >= 0.f;
+		stack[stackSize++] = leftFirst ? node.leftOrFirst + 1 : node.leftOrFirst;
+		stack[stackSize++] = leftFirst ? node.leftOrFirst : node.leftOrFirst + 1;
+	}
+
+	if (stats)
+		stats->Add(localStats);
+	return hit.hitType != k_CpuHitTypeMiss;
+}
+
+bool CpuRayTracer::TraceShadowRay(const CpuRay& ray, Stats* stats) const
+{
+	if (m_Bvh.IsEmpty())
+		return false;
+
+	const std::vector<CpuBvhNode>& nodes = m_Bvh.GetNodes();
+	const std::vector<uint>& primitives = m_Bvh.GetPrimitives();
+	const float3 invDirection = SafeInverse(ray.direction);
+	Stats localStats;
+	localStats.singleRays++;
+
+	bool occluded = false;
+	uint stack[64];
+	uint stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0 && !occluded) {
+		const CpuBvhNode& node = nodes[stack[--stackSize]];
+		localStats.nodesVisited++;
+		if (!RayNodeIntersection(node, ray.origin, invDirection, ray.tMin, ray.tMax))
+			continue;
+
+		if (node.count > 0) {
+			for (uint i = node.leftOrFirst; i < node.leftOrFirst + node.count && !occluded; i++) {
+				localStats.primitiveTests++;
+				occluded = OccludesPrimitive(primitives[i], ray);
+			}
+			continue;
+		}
+		stack[stackSize++] = node.leftOrFirst + 1;
+		stack[stackSize++] = node.leftOrFirst;
+	}
+
+	if (stats)
+		stats->Add(localStats);
+	return occluded;
+}
+
+void CpuRayTracer::TracePacket(const CpuRay* rays, CpuHit* hits, uint numRays, Stats* stats) const
+{
+	Packet packet;
+	packet.numRays = std::min(numRays, k_PacketSize);
+	for (uint i = 0; i < packet.numRays; i++) {
+		packet.rays[i] = rays[i];
+		packet.active[i] = true;
+		hits[i] = CpuHit();
+	}
+
+	Stats localStats;
+	TracePacketInternal(packet, hits, nullptr, true, localStats);
+	if (stats)
+		stats->Add(localStats);
+}
+
+void CpuRayTracer::TraceShadowPacket(const CpuRay* rays, const bool* active, bool* occluded, uint numRays, Stats* stats) const
+{
+	Packet packet;
+	packet.numRays = std::min(numRays, k_PacketSize);
+	for (uint i = 0; i < packet.numRays; i++) {
+		packet.rays[i] = rays[i];
+		packet.active[i] = active[i];
+		occluded[i] = false;
+	}
+
+	Stats localStats;
+	TracePacketInternal(packet, nullptr, occluded, false, localStats);
+	if (stats)
+		stats->Add(localStats);
+}
+
+void CpuRayTracer::TracePacketInternal(Packet& packet, CpuHit* hits, bool* occluded, bool closestHit, Stats& stats) const
+{
+	if (m_Bvh.IsEmpty())
+		return;
+
+	//Coherence check: enough active rays with similar directions
+	uint numActive = 0;
+	float3 meanDirection = float3(0.f);
+	for (uint i = 0; i < packet.numRays; i++) {
+		if (!packet.active[i])
+			continue;
+		numActive++;
+		meanDirection += packet.rays[i].direction;
+	}
+	if (numActive == 0)
+		return;
+
+	bool coherent = numActive >= k_MinCoherentRays && length(meanDirection) > 0.f;
+	if (coherent) {
+		meanDirection = normalize(meanDirection);
+		for (uint i = 0; i < packet.numRays && coherent; i++)
+			coherent = !packet.active[i] || dot(normalize(packet.rays[i].direction), meanDirection) >= k_MinPacketDirectionCos;
+	}
+
+	auto traceSingle = [&](uint i) {
+		if (closestHit)
+			TraceRay(packet.rays[i], hits[i], &stats);
+		else
+			occluded[i] = TraceShadowRay(packet.rays[i], &stats);
+	};
+
+	if (!coherent) {
+		for (uint i = 0; i < packet.numRays; i++) {
+			if (packet.active[i]) {
+				traceSingle(i);
+				stats.fallbackRays++;
+			}
+		}
+		return;
+	}
+	stats.packetRays += numActive;
+
+	for (uint i = 0; i < packet.numRays; i++)
+		packet.invDirection[i] = SafeInverse(packet.rays[i].direction);
+
+	//Frustum of a full 8x8 packet with a common origin, spanned by the corner rays
+	packet.hasFrustum = packet.numRays == k_PacketSize;
+	for (uint i = 0; i < packet.numRays && packet.hasFrustum; i++)
+		packet.hasFrustum = packet.active[i] && all(packet.rays[i].origin == packet.rays[0].origin);
+	if (packet.hasFrustum) {
+		packet.frustumOrigin = packet.rays[0].origin;
+		const uint corners[4] = { 0, k_PacketWidth - 1, k_PacketSize - 1, k_PacketSize - k_PacketWidth };
+		for (uint p = 0; p < 4; p++) {
+			float3 normal = cross(packet.rays[corners[p]].direction, packet.rays[corners[(p + 1) % 4]].direction);
+			if (dot(normal, meanDirection) < 0.f)
+				normal = -normal;
+			packet.frustumNormals[p] = normal;
+		}
+		//The planes are only valid if all rays are inside (e.g. not for a degenerated tile)
+		for (uint i = 0; i < packet.numRays && packet.hasFrustum; i++) {
+			for (uint p = 0; p < 4; p++) {
+				if (dot(packet.frustumNormals[p], packet.rays[i].direction) < -1e-6f) {
+					packet.hasFrustum = false;
+					break;
+				}
+			}
+		}
+	}
+
+	const std::vector<CpuBvhNode>& nodes = m_Bvh.GetNodes();
+	const std::vector<uint>& primitives = m_Bvh.GetPrimitives();
+	auto rayTMax = [&](uint i) {
+		return closestHit && hits[i].hitType != k_CpuHitTypeMiss ? hits[i].t : packet.rays[i].tMax;
+	};
+
+	//Every stack entry stores the first ray that might hit the node; rays before it missed a parent
+	struct StackEntry {
+		uint node;
+		uint firstRay;
+	};
+	StackEntry stack[64];
+	uint stackSize = 0;
+	stack[stackSize++] = { 0, 0 };
+	while (stackSize > 0) {
+		StackEntry entry = stack[--stackSize];
+		const CpuBvhNode& node = nodes[entry.node];
+		stats.nodesVisited++;
+
+		//Cull the whole node if it is outside of any frustum plane
+		if (packet.hasFrustum) {
+			bool outside = false;
+			for (uint p = 0; p < 4 && !outside; p++) {
+				const float3& normal = packet.frustumNormals[p];
+				float3 farthest = float3(normal.x >= 0.f ? node.boundsMax.x : node.boundsMin.x, normal.y >= 0.f ? node.boundsMax.y : node.boundsMin.y,
+					normal.z >= 0.f ? node.boundsMax.z : node.boundsMin.z);
+				outside = dot(normal, farthest - packet.frustumOrigin) < 0.f;
+			}
+			if (outside) {
+				stats.nodesFrustumCulled++;
+				continue;
+			}
+		}
+
+		//First active ray that hits the node
+		uint firstRay = entry.firstRay;
+		while (firstRay < packet.numRays && (!packet.active[firstRay] ||
+			!RayNodeIntersection(node, packet.rays[firstRay].origin, packet.invDirection[firstRay], packet.rays[firstRay].tMin, rayTMax(firstRay))))
+			firstRay++;
+		if (firstRay == packet.numRays)
+			continue;
+
+		if (node.count > 0) {
+			for (uint r = firstRay; r < packet.numRays; r++) {
+				if (!packet.active[r])
+					continue;
+				for (uint i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++) {
+					stats.primitiveTests++;
+					if (closestHit) {
+						IntersectPrimitive(primitives[i], packet.rays[r], hits[r]);
+					}
+					else if (OccludesPrimitive(primitives[i], packet.rays[r])) {
+						occluded[r] = true;
+						packet.active[r] = false;
+						numActive--;
+						break;
+					}
+				}
+			}
+
+			//Terminated shadow rays leave too few rays for packet traversal, finish the rest alone
+			if (!closestHit && numActive < k_MinCoherentRays) {
+				for (uint r = 0; r < packet.numRays; r++) {
+					if (packet.active[r]) {
+						occluded[r] = TraceShadowRay(packet.rays[r], &stats);
+						stats.fallbackRays++;
+					}
+				}
+				return;
+			}
+			continue;
+		}
+
+		//Visit the nearer child first, judged by the first active ray
+		const CpuBvhNode& left = nodes[node.leftOrFirst];
+		const CpuBvhNode& right = nodes[node.leftOrFirst + 1];
+		bool leftFirst = dot((right.boundsMin + right.boundsMax) - (left.boundsMin + left.boundsMax), packet.rays[firstRay].direction) >= 0.f;
+		stack[stackSize++] = { leftFirst ? node.leftOrFirst + 1 : node.leftOrFirst, firstRay };
+		stack[stackSize++] = { leftFirst ? node.leftOrFirst : node.leftOrFirst + 1, firstRay };
+	}
+}
+
+void CpuRayTracer::TracePrimaryTile(const CpuCamera& camera, uint2 resolution, uint2 tileOrigin, CpuHit* hits, Stats* stats) const
+{
+	CpuRay rays[k_PacketSize];
+	uint numRays = 0;
+	bool fullTile = tileOrigin.x + k_PacketWidth <= resolution.x && tileOrigin.y + k_PacketWidth <= resolution.y;
+	for (uint y = 0; y < k_PacketWidth; y++) {
+		for (uint x = 0; x < k_PacketWidth; x++) {
+			uint2 pixel = uint2(tileOrigin.x + x, tileOrigin.y + y);
+			if (pixel.x < resolution.x && pixel.y < resolution.y)
+				rays[numRays++] = camera.GetPrimaryRay(pixel);
+		}
+	}
+
+	//Partial tiles at the border have no regular 8x8 layout and are traced without frustum
+	if (fullTile) {
+		TracePacket(rays, hits, numRays, stats);
+		return;
+	}
+
+	CpuHit tileHits[k_PacketSize];
+	TracePacket(rays, tileHits, numRays, stats);
+	uint ray = 0;
+	for (uint y = 0; y < k_PacketWidth; y++) {
+		for (uint x = 0; x < k_PacketWidth; x++) {
+			bool inside = tileOrigin.x + x < resolution.x && tileOrigin.y + y < resolution.y;
+			hits[y * k_PacketWidth + x] = inside ? tileHits[ray++] : CpuHit();
+		}
+	}
+}
+
+CpuRayTracer::BenchmarkResult CpuRayTracer::RunBenchmark(const CpuCamera& camera, uint2 resolution, float3 toLight, float shadowRayOffset) const
+{
+	using Clock = std::chrono::high_resolution_clock;
+	auto seconds = [](Clock::time_point start) { return std::chrono::duration<double>(Clock::now() - start).count(); };
+	auto mrays = [](uint64_t rays, double time) { return time > 0.0 ? double(rays) / time * 1e-6 : 0.0; };
+
+	BenchmarkResult result;
+	result.resolution = resolution;
+	result.bvhBuildMs = m_Bvh.GetBuildTimeMs();
+	if (m_Bvh.IsEmpty() || resolution.x == 0 || resolution.y == 0)
+		return result;
+
+	//Hits are stored per tile in row major 8x8 order
+	const uint2 numTiles = uint2((resolution.x + k_PacketWidth - 1) / k_PacketWidth, (resolution.y + k_PacketWidth - 1) / k_PacketWidth);
+	const size_t numTileRays = size_t(numTiles.x) * numTiles.y * k_PacketSize;
+	auto isInside = [&](uint tileX, uint tileY, uint ray) {
+		return tileX * k_PacketWidth + ray % k_PacketWidth < resolution.x && tileY * k_PacketWidth + ray / k_PacketWidth < resolution.y;
+	};
+
+	//Tiles are distributed over all threads of the scheduler, one task per tile
+	TaskScheduler& scheduler = TaskScheduler::Get();
+	result.numThreads = scheduler.GetNumThreads();
+	std::mutex statsMutex;
+	auto forEachTile = [&](const std::function<void(uint, uint, size_t, Stats&)>& func) {
+		scheduler.ParallelForTiles(numTiles, uint2(1, 1), [&](uint2 tileMin, uint2 tileMax) {
+			Stats tileStats;
+			for (uint tileY = tileMin.y; tileY < tileMax.y; tileY++) {
+				for (uint tileX = tileMin.x; tileX < tileMax.x; tileX++)
+					func(tileX, tileY, size_t(tileY) * numTiles.x + tileX, tileStats);
+			}
+			std::lock_guard<std::mutex> lock(statsMutex);
+			result.packetStats.Add(tileStats);
+		});
+	};
+
+	//Primary rays as packets
+	std::vector<CpuHit> packetHits(numTileRays);
+	Clock::time_point start = Clock::now();
+	forEachTile([&](uint tileX, uint tileY, size_t tile, Stats& stats) {
+		TracePrimaryTile(camera, resolution, uint2(tileX * k_PacketWidth, tileY * k_PacketWidth), &packetHits[tile * k_PacketSize], &stats);
+	});
+	double primaryPacketTime = seconds(start);
+
+	//Primary rays one by one. The stats only count packet tracing
+	std::vector<CpuHit> singleHits(numTileRays);
+	start = Clock::now();
+	forEachTile([&](uint tileX, uint tileY, size_t tile, Stats&) {
+		for (uint ray = 0; ray < k_PacketSize; ray++) {
+			if (isInside(tileX, tileY, ray))
+				TraceRay(camera.GetPrimaryRay(uint2(tileX * k_PacketWidth + ray % k_PacketWidth, tileY * k_PacketWidth + ray / k_PacketWidth)), singleHits[tile * k_PacketSize + ray]);
+		}
+	});
+	double primarySingleTime = seconds(start);
+
+	//Shadow rays towards the light from every primary hit
+	std::vector<CpuRay> shadowRays(numTileRays);
+	std::vector<char> shadowActive(numTileRays, 0);
+	for (uint tileY = 0; tileY < numTiles.y; tileY++) {
+		for (uint tileX = 0; tileX < numTiles.x; tileX++) {
+			for (uint ray = 0; ray < k_PacketSize; ray++) {
+				size_t index = (size_t(tileY) * numTiles.x + tileX) * k_PacketSize + ray;
+				if (!isInside(tileX, tileY, ray))
+					continue;
+				result.primaryRays++;
+				const CpuHit& hit = packetHits[index];
+				if (hit.hitType != singleHits[index].hitType || hit.primitiveIndex != singleHits[index].primitiveIndex)
+					result.mismatches++;
+				if (hit.hitType == k_CpuHitTypeMiss)
+					continue;
+				result.primaryHits++;
+
+				CpuRay primaryRay = camera.GetPrimaryRay(uint2(tileX * k_PacketWidth + ray % k_PacketWidth, tileY * k_PacketWidth + ray / k_PacketWidth));
+				CpuRay& shadowRay = shadowRays[index];
+				shadowRay.origin = primaryRay.origin + primaryRay.direction * hit.t + hit.normal * shadowRayOffset;
+				shadowRay.direction = toLight;
+				shadowRay.tMin = shadowRayOffset;
+				shadowRay.tMax = camera.tMax;
+				shadowActive[index] = 1;
+			}
+		}
+	}
+	result.shadowRays = result.primaryHits;
+
+	//Shadow rays as packets
+	std::vector<char> packetOccluded(numTileRays, 0);
+	start = Clock::now();
+	forEachTile([&](uint, uint, size_t tile, Stats& stats) {
+		bool active[k_PacketSize];
+		bool occluded[k_PacketSize];
+		for (uint ray = 0; ray < k_PacketSize; ray++)
+			active[ray] = shadowActive[tile * k_PacketSize + ray] != 0;
+		TraceShadowPacket(&shadowRays[tile * k_PacketSize], active, occluded, k_PacketSize, &stats);
+		for (uint ray = 0; ray < k_PacketSize; ray++)
+			packetOccluded[tile * k_PacketSize + ray] = occluded[ray] ? 1 : 0;
+	});
+	double shadowPacketTime = seconds(start);
+
+	//Shadow rays one by one
+	std::vector<char> singleOccluded(numTileRays, 0);
+	start = Clock::now();
+	forEachTile([&](uint, uint, size_t tile, Stats&) {
+		for (size_t index = tile * k_PacketSize; index < (tile + 1) * k_PacketSize; index++) {
+			if (shadowActive[index])
+				singleOccluded[index] = TraceShadowRay(shadowRays[index]) ? 1 : 0;
+		}
+	});
+	double shadowSingleTime = seconds(start);
+
+	for (size_t index = 0; index < numTileRays; index++) {
+		if (packetOccluded[index])
+			result.shadowOccluded++;
+		if (packetOccluded[index] != singleOccluded[index])
+			result.mismatches++;
+	}
+
+	//Memory locality of the hit shaders for the hits in tile order
+	result.hitCacheMissRate = SimulateHitCacheMissRate(packetHits, false);
+	if (m_AABBOrder || m_TriangleOrder)
+		result.originalHitCacheMissRate = SimulateHitCacheMissRate(packetHits, true);
+
+	result.primaryPacketMrays = mrays(result.primaryRays, primaryPacketTime);
+	result.primarySingleMrays = mrays(result.primaryRays, primarySingleTime);
+	result.shadowPacketMrays = mrays(result.shadowRays, shadowPacketTime);
+	result.shadowSingleMrays = mrays(result.shadowRays, shadowSingleTime);
+	return result;
+}
+
+void CpuRayTracer::SetOriginalOrder(const std::vector<uint>* aabbOrder, const std::vector<uint>* triangleOrder, const std::vector<uint>* vertexOrder)
+{
+	m_AABBOrder = aabbOrder && !aabbOrder->empty() ? aabbOrder : nullptr;
+	m_TriangleOrder = triangleOrder && !triangleOrder->empty() ? triangleOrder : nullptr;
+	m_VertexOrder = vertexOrder && !vertexOrder->empty() ? vertexOrder : nullptr;
+}
+
+double CpuRayTracer::SimulateHitCacheMissRate(const std::vector<CpuHit>& hits, bool useOriginalOrder) const
+{
+	//Every buffer gets its own address range
+	enum Buffer : uint64_t { AABBData, AABBMaterialIDs, Indices, Vertices, TriangleMaterialIDs };
+	auto address = [](Buffer buffer, uint64_t index, uint64_t stride) { return (uint64_t(buffer) << 40) + index * stride; };
+	auto remap = [&](const std::vector<uint>* order, uint index) { return useOriginalOrder && order ? (*order)[index] : index; };
+
+	CacheSimulator cache;
+	for (const CpuHit& hit : hits) {
+		if (hit.hitType == k_CpuHitTypeAABB) {
+			uint aabb = remap(m_AABBOrder, hit.primitiveIndex);
+			cache.Access(address(AABBData, aabb, sizeof(AABB)), sizeof(AABB));
+			cache.Access(address(AABBMaterialIDs, aabb, sizeof(AABBMaterials)), sizeof(AABBMaterials));
+		}
+		else if (hit.hitType == k_CpuHitTypeTriangle) {
+			uint triangle = remap(m_TriangleOrder, hit.primitiveIndex);
+			cache.Access(address(TriangleMaterialIDs, triangle, sizeof(int)), sizeof(int));
+			cache.Access(address(Indices, triangle, 3 * sizeof(uint)), 3 * sizeof(uint));
+			for (uint i = 0; i < 3; i++) {
+				uint vertex = remap(m_VertexOrder, (*m_Indices)[size_t(hit.primitiveIndex) * 3 + i]);
+				cache.Access(address(Vertices, vertex, sizeof(VertexData)), sizeof(VertexData));
+			}
+		}
+	}
+	return cache.GetMissRate();
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <functional>
+#include <vector>
+#include "CpuBvh.h"
+
+//Ray with the same conventions as the DXR RayDesc
+struct CpuRay {
+	float3 origin;
+	float tMin = 0.f;
+	float3 direction;
+	float tMax = 0.f;
+};
+
+//Hit types, same values as in RaytraceWorld_rt.hlsl
+static const int k_CpuHitTypeMiss = 0;
+static const int k_CpuHitTypeTriangle = 1;
+static const int k_CpuHitTypeAABB = 2;
+
+//Closest hit of a ray, mirrors the HitInfo payload of the shader
+struct CpuHit {
+	int hitType = k_CpuHitTypeMiss;
+	int matID = -1;
+	float t = -1.f;
+	uint primitiveIndex = 0;
+	int face = -1;			//Hit side of blocks (0:-x, 1:+x, 2:-z, 3:+z, 4:-y, 5:+y), -1 for triangles
+	float3 normal = float3(0.f, 1.f, 0.f);
+	float2 uv = float2(0.f);
+};
+
+//Camera for primary rays, generates the same rays as SetupPrimaryRay in the shader
+struct CpuCamera {
+	float3 origin;
+	float4x4 matClipToWorld;
+	float2 viewportSizeInv;
+	float tMin = 0.1f;
+	float tMax = 1000.f;
+
+	CpuRay GetPrimaryRay(uint2 pixelPosition) const;
+};
+
+/* Ray tracer on the CPU over a CpuBvh of the scene geometry, for previews, reference images and headless runs.
+   Besides single rays it traces packets of up to 8x8 rays. Packets with a common origin (primary rays of a tile) cull whole nodes
+   against the packet frustum; packets that are not coherent (spread directions, few active rays) fall back to single rays.
+   The scene arrays are referenced, not copied, and need to stay valid while tracing. All trace functions are const and can be called from several threads
+*/
+class CpuRayTracer {
+public:
+	static const uint k_PacketWidth = 8;
+	static const uint k_PacketSize = k_PacketWidth * k_PacketWidth;
+	static const uint k_MinCoherentRays = 16;		//Packets with fewer active rays are traced as single rays
+
+	//Returns true if the surface of the alpha tested material is opaque at the texture coordinate
+	using AlphaTestFunction = std::function<bool(int materialID, float2 uv)>;
+
+	//Traversal counters, summed over the traced rays
+	struct Stats {
+		uint64_t nodesVisited = 0;
+		uint64_t nodesFrustumCulled = 0;	//Nodes skipped by the packet frustum without testing single rays
+		uint64_t primitiveTests = 0;
+		uint64_t packetRays = 0;			//Rays traced as part of a packet
+		uint64_t singleRays = 0;			//Rays traced alone, including packet fallbacks
+		uint64_t fallbackRays = 0;			//Packet rays that fell back to single ray traversal
+
+		void Add(const Stats& other);
+	};
+
+	struct BenchmarkResult {
+		uint2 resolution = uint2(0, 0);
+		uint numThreads = 1;				//Threads of the task scheduler that traced the tiles
+		double bvhBuildMs = 0.0;
+		uint64_t primaryRays = 0;
+		uint64_t primaryHits = 0;
+		uint64_t shadowRays = 0;
+		uint64_t shadowOccluded = 0;
+		double primaryPacketMrays = 0.0;	//Million rays per second
+		double primarySingleMrays = 0.0;
+		double shadowPacketMrays = 0.0;
+		double shadowSingleMrays = 0.0;
+		uint64_t mismatches = 0;			//Rays where packet and single ray tracing disagree
+		double hitCacheMissRate = 0.0;		//Simulated cache miss rate of the hit shader buffer reads, in tile order
+		double originalHitCacheMissRate = 0.0;	//Same for the original primitive order, if set with SetOriginalOrder
+		Stats packetStats;
+	};
+
+	//Builds the BVH over the scene geometry
+	void Build(const std::vector<AABB>& aabbs, const std::vector<AABBMaterials>& aabbMaterials, const std::vector<VertexData>& vertices,
+		const std::vector<uint>& indices, const std::vector<int>& triPerFaceMatID);
+
+	//alphaTestedMaterials flags the materials that call the alpha test function, all other materials are opaque.
+	//Without a function all surfaces are opaque
+	void SetAlphaTest(std::vector<bool> alphaTestedMaterials, AlphaTestFunction alphaTest);
+
+	//Original order of spatially sorted scene arrays (see MinecraftSceneLoader::GetAABBOrder), used to compare the memory locality.
+	//The arrays are referenced like the scene arrays
+	void SetOriginalOrder(const std::vector<uint>* aabbOrder, const std::vector<uint>* triangleOrder, const std::vector<uint>* vertexOrder);
+
+	//Closest hit. Returns false on a miss
+	bool TraceRay(const CpuRay& ray, CpuHit& hit, Stats* stats = nullptr) const;
+	//Any opaque hit. Returns true if the ray is occluded
+	bool TraceShadowRay(const CpuRay& ray, Stats* stats = nullptr) const;
+
+	//Closest hits of up to k_PacketSize rays. A full packet is expected in row major 8x8 order for the frustum
+	void TracePacket(const CpuRay* rays, CpuHit* hits, uint numRays, Stats* stats = nullptr) const;
+	//Occlusion of up to k_PacketSize rays. Inactive rays (active[i] = false) are skipped and not occluded
+	void TraceShadowPacket(const CpuRay* rays, const bool* active, bool* occluded, uint numRays, Stats* stats = nullptr) const;
+
+	//Traces the primary rays of the 8x8 tile starting at tileOrigin. Pixels outside of the resolution are misses
+	void TracePrimaryTile(const CpuCamera& camera, uint2 resolution, uint2 tileOrigin, CpuHit* hits, Stats* stats = nullptr) const;
+
+	//Traces primary and shadow rays (towards toLight) for every pixel with packets and with single rays and measures the ray throughput.
+	//Tiles are traced in parallel with the TaskScheduler
+	BenchmarkResult RunBenchmark(const CpuCamera& camera, uint2 resolution, float3 toLight, float shadowRayOffset) const;
+
+	//Simulates the buffer reads of the hit shaders for the hits in the given order with a CacheSimulator: AABB data and materials for blocks,
+	//indices, vertices and material ID for triangles. With useOriginalOrder the primitives and vertices are read at their original position
+	double SimulateHitCacheMissRate(const std::vector<CpuHit>& hits, bool useOriginalOrder) const;
+
+	const CpuBvh& GetBvh() const { return m_Bvh; }
+
+private:
+	struct Packet;
+
+	//Intersects a primitive and updates the hit if it is closer. Returns true if the hit was updated
+	bool IntersectPrimitive(uint primitive, const CpuRay& ray, CpuHit& hit) const;
+	//Returns true if the primitive occludes the ray
+	bool OccludesPrimitive(uint primitive, const CpuRay& ray) const;
+	bool IsOpaque(int materialID, float2 uv) const;
+
+	//Packet traversal, closestHit = false stops rays at their first opaque hit
+	void TracePacketInternal(Packet& packet, CpuHit* hits, bool* occluded, bool closestHit, Stats& stats) const;
+
+	CpuBvh m_Bvh;
+	const std::vector<AABB>* m_AABBs = nullptr;
+	const std::vector<AABBMaterials>* m_AABBMaterials = nullptr;
+	const std::vector<VertexData>* m_Vertices = nullptr;
+	const std::vector<uint>* m_Indices = nullptr;
+	const std::vector<int>* m_TriPerFaceMatID = nullptr;
+	const std::vector<uint>* m_AABBOrder = nullptr;
+	const std::vector<uint>* m_TriangleOrder = nullptr;
+	const std::vector<uint>* m_VertexOrder = nullptr;
+
+	std::vector<bool> m_AlphaTestedMaterials;
+	AlphaTestFunction m_AlphaTest;
+};
@@ -0,0 +1,264 @@
+#include "CpuRenderer.h"
+#include "MinecraftSceneLoader.h"
+#include "PngReader.h"
+#include "TaskScheduler.h"
+#include <donut/engine/View.h>
+#include <donut/core/log.h>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <unordered_map>
+
+using namespace donut;
+
+//Same constants as RaytraceWorld_rt.hlsl
+static const float k_DielectricSpecular = 0.04f;
+static const float3 k_EnvironmentColor = float3(0.68f, 0.85f, 0.9f);
+
+static float LinearToSrgb(float c) {
+	c = clamp(c, 0.f, 1.f);
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+}
+
+void CpuRenderer::Build(const MinecraftSceneLoader& scene, const std::filesystem::path& sceneFolder)
+{
+	Clear();
+	m_RayQuery.Build(scene, sceneFolder);
+
+	for (int i = 0; i < 256; i++) {
+		float c = float(i) / 255.f;
+		m_SrgbToLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	//Materials and their textures, every texture is decoded once. Diffuse textures are sRGB, emissive textures are loaded as linear by the Renderer
+	const std::vector<Material>& materials = scene.GetMaterials();
+	const std::vector<MinecraftSceneLoader::MaterialTextureNames>& textureNames = scene.GetMaterialTextureNames();
+	std::unordered_map<std::string, int> textureIndices;
+	std::vector<std::string> textureFiles;
+	auto addTexture = [&](const std::string& name, bool sRGB) {
+		if (name.empty())
+			return -1;
+		auto [it, inserted] = textureIndices.emplace(name + (sRGB ? "|srgb" : ""), int(textureFiles.size()));
+		if (inserted) {
+			textureFiles.push_back(name);
+			m_Textures.emplace_back();
+			m_Textures.back().sRGB = sRGB;
+		}
+		return it->second;
+	};
+	m_Materials.resize(materials.size());
+	for (size_t i = 0; i < materials.size(); i++) {
+		MaterialData& material = m_Materials[i];
+		material.diffuseColor = materials[i].baseOrDiffuseColor;
+		material.emissiveColor = materials[i].emissiveColor;
+		material.doubleSided = materials[i].doubleSided;
+		if (i < textureNames.size()) {
+			material.diffuseTexture = addTexture(textureNames[i].diffuse, true);
+			material.emissiveTexture = addTexture(textureNames[i].emissive, false);
+		}
+	}
+
+	std::atomic<uint> numFailed = 0;
+	TaskScheduler::Get().ParallelFor(0, textureFiles.size(), 1, [&](uint64_t begin, uint64_t end) {
+		for (uint64_t i = begin; i < end; i++) {
+			PngReader::Image image;
+			if (!PngReader::Read(sceneFolder / textureFiles[i], image)) {
+				numFailed++;
+				continue;
+			}
+			m_Textures[i].width = image.width;
+			m_Textures[i].height = image.height;
+			m_Textures[i].rgba = std::move(image.rgba);
+		}
+	});
+	//Materials whose texture could not be read keep their color, which is the average texture color for scenes loaded without a device
+	if (numFailed > 0)
+		log::warning("CpuRenderer: %u textures could not be read", numFailed.load());
+}
+
+void CpuRenderer::Clear()
+{
+	m_RayQuery.Clear();
+	m_Textures.clear();
+	m_Materials.clear();
+}
+
+CpuCamera CpuRenderer::MakeCamera(const affine3& worldToView, const UIData& settings, uint2 resolution)
+{
+	nvrhi::Viewport viewport(float(resolution.x), float(resolution.y));
+	engine::PlanarView view;
+	view.SetViewport(viewport);
+	view.SetMatrices(worldToView, perspProjD3DStyleReverse(settings.cameraFov, viewport.width() / viewport.height(), settings.cameraFar));
+	view.UpdateCache();
+
+	CpuCamera camera;
+	camera.origin = view.GetViewOrigin();
+	camera.matClipToWorld = view.GetInverseViewProjectionMatrix();
+	camera.viewportSizeInv = float2(1.f / float(resolution.x), 1.f / float(resolution.y));
+	camera.tMin = settings.cameraNear;
+	camera.tMax = settings.cameraFar;
+	return camera;
+}
+
+float3 CpuRenderer::SampleTexture(int textureIndex, float2 uv) const
+{
+	const Texture& texture = m_Textures[textureIndex];
+	//Point sampling with clamping, as the material sampler of the shader
+	int x = clamp(int(std::floor(uv.x * float(texture.width))), 0, int(texture.width) - 1);
+	int y = clamp(int(std::floor(uv.y * float(texture.height))), 0, int(texture.height) - 1);
+	const uint8_t* texel = &texture.rgba[(size_t(y) * texture.width + x) * 4];
+	if (texture.sRGB)
+		return float3(m_SrgbToLinear[texel[0]], m_SrgbToLinear[texel[1]], m_SrgbToLinear[texel[2]]);
+	return float3(texel[0], texel[1], texel[2]) / 255.f;
+}
+
+float3 CpuRenderer::Shade(const CpuRay& ray, const CpuHit& hit, const UIData& settings, float3 lightDirection, float3& light) const
+{
+	light = float3(0.f);
+	if (hit.hitType == k_CpuHitTypeMiss)
+		return k_EnvironmentColor;
+
+	const MaterialData& material = m_Materials[hit.matID];
+	float3 normal = hit.normal;
+	if (material.doubleSided && dot(normal, -ray.direction) < 0.f)
+		normal = -normal;
+
+	float3 diffuseColor = material.diffuseColor;
+	if (material.diffuseTexture >= 0 && !m_Textures[material.diffuseTexture].rgba.empty())
+		diffuseColor = SampleTexture(material.diffuseTexture, hit.uv);
+	float3 emissiveColor = material.emissiveColor;
+	if (material.emissiveTexture >= 0 && !m_Textures[material.emissiveTexture].rgba.empty())
+		emissiveColor = SampleTexture(material.emissiveTexture, hit.uv);
+	diffuseColor *= 1.f - k_DielectricSpecular;
+
+	float3 ambient = settings.ambient * diffuseColor;
+	float3 emission = settings.emissiveStrength * emissiveColor;
+
+	//Schlick Fresnel of the reflection direction, whose half vector is the normal
+	float3 reflectDirection = normalize(ray.direction - 2.f * dot(ray.direction, normal) * normal);
+	float3 halfVector = normalize(-ray.direction + reflectDirection);
+	float fresnel = k_DielectricSpecular + (1.f - k_DielectricSpecular) * std::pow(1.f - saturate(dot(-ray.direction, halfVector)), 5.f);
+	float3 reflectionAmbient = fresnel * k_DielectricSpecular * k_EnvironmentColor * settings.ambientSpecularStrength;
+
+	light = max(0.f, -dot(normal, lightDirection)) / PI_f * diffuseColor * settings.lightIntensity;
+
+	return emission + ambient + reflectionAmbient;
+}
+
+void CpuRenderer::TraceTile(const CpuCamera& camera, uint2 resolution, uint2 tileOrigin, const UIData& settings, float3 lightDirection, CpuHit* hits,
+	CpuRay* shadowRays, bool* active) const
+{
+	const uint tileSize = CpuRayTracer::k_PacketWidth;
+	m_RayQuery.GetTracer().TracePrimaryTile(camera, resolution, tileOrigin, hits);
+
+	//Shadow rays from the hit positions, offset along the face normal like RayShadowTest
+	for (uint i = 0; i < CpuRayTracer::k_PacketSize; i++) {
+		active[i] = hits[i].hitType != k_CpuHitTypeMiss;
+		if (!active[i])
+			continue;
+		uint2 pixel = tileOrigin + uint2(i % tileSize, i / tileSize);
+		CpuRay ray = camera.GetPrimaryRay(pixel);
+		float3 normal = hits[i].normal;
+		if (m_Materials[hits[i].matID].doubleSided && dot(normal, -ray.direction) < 0.f)
+			normal = -normal;
+		shadowRays[i].origin = ray.origin + ray.direction * hits[i].t + normal * settings.shadowRayBias;
+		shadowRays[i].direction = -lightDirection;
+		shadowRays[i].tMin = settings.shadowRayBias;
+		shadowRays[i].tMax = settings.cameraFar;
+	}
+}
+
+void CpuRenderer::EncodeColor(float3 color, uint8_t* texel)
+{
+	texel[0] = uint8_t(LinearToSrgb(color.x) * 255.f + 0.5f);
+	texel[1] = uint8_t(LinearToSrgb(color.y) * 255.f + 0.5f);
+	texel[2] = uint8_t(LinearToSrgb(color.z) * 255.f + 0.5f);
+	texel[3] = 255;
+}
+
+void CpuRenderer::Render(const CpuCamera& camera, uint2 resolution, const UIData& settings, std::vector<uint8_t>& rgba) const
+{
+	rgba.resize(size_t(resolution.x) * resolution.y * 4);
+	const float3 lightDirection = normalize(settings.lightDirection);
+	const CpuRayTracer& tracer = m_RayQuery.GetTracer();
+	const uint tileSize = CpuRayTracer::k_PacketWidth;
+	const uint2 numTiles = (resolution + uint2(tileSize - 1)) / tileSize;
+
+	TaskScheduler::Get().ParallelFor(0, uint64_t(numTiles.x) * numTiles.y, 16, [&](uint64_t begin, uint64_t end) {
+		CpuHit hits[CpuRayTracer::k_PacketSize];
+		CpuRay shadowRays[CpuRayTracer::k_PacketSize];
+		bool active[CpuRayTracer::k_PacketSize];
+		bool occluded[CpuRayTracer::k_PacketSize];
+		for (uint64_t tile = begin; tile < end; tile++) {
+			uint2 tileOrigin = uint2(uint(tile % numTiles.x), uint(tile / numTiles.x)) * tileSize;
+			TraceTile(camera, resolution, tileOrigin, settings, lightDirection, hits, shadowRays, active);
+			tracer.TraceShadowPacket(shadowRays, active, occluded, CpuRayTracer::k_PacketSize);
+
+			for (uint i = 0; i < CpuRayTracer::k_PacketSize; i++) {
+				uint2 pixel = tileOrigin + uint2(i % tileSize, i / tileSize);
+				if (pixel.x >= resolution.x || pixel.y >= resolution.y)
+					continue;
+				float3 light;
+				float3 color = Shade(camera.GetPrimaryRay(pixel), hits[i], settings, lightDirection, light);
+				if (active[i] && !occluded[i])
+					color += light;
+				EncodeColor(color, &rgba[(size_t(pixel.y) * resolution.x + pixel.x) * 4]);
+			}
+		}
+	});
+}
+
+void CpuRenderer::RenderLayers(const CpuCamera& camera, uint2 resolution, const UIData& settings, std::vector<LayerTexel>& layers) const
+{
+	layers.resize(size_t(resolution.x) * resolution.y);
+	const float3 lightDirection = normalize(settings.lightDirection);
+	const uint tileSize = CpuRayTracer::k_PacketWidth;
+	const uint2 numTiles = (resolution + uint2(tileSize - 1)) / tileSize;
+
+	TaskScheduler::Get().ParallelFor(0, uint64_t(numTiles.x) * numTiles.y, 16, [&](uint64_t begin, uint64_t end) {
+		CpuHit hits[CpuRayTracer::k_PacketSize];
+		CpuRay shadowRays[CpuRayTracer::k_PacketSize];
+		bool active[CpuRayTracer::k_PacketSize];
+		for (uint64_t tile = begin; tile < end; tile++) {
+			uint2 tileOrigin = uint2(uint(tile % numTiles.x), uint(tile / numTiles.x)) * tileSize;
+			TraceTile(camera, resolution, tileOrigin, settings, lightDirection, hits, shadowRays, active);
+
+			for (uint i = 0; i < CpuRayTracer::k_PacketSize; i++) {
+				uint2 pixel = tileOrigin + uint2(i % tileSize, i / tileSize);
+				if (pixel.x >= resolution.x || pixel.y >= resolution.y)
+					continue;
+				LayerTexel& texel = layers[size_t(pixel.y) * resolution.x + pixel.x];
+				texel.color = Shade(camera.GetPrimaryRay(pixel), hits[i], settings, lightDirection, texel.light);
+				texel.hitT = active[i] ? hits[i].t : std::numeric_limits<float>::infinity();
+				texel.shadowOrigin = active[i] ? shadowRays[i].origin : float3(0.f);
+			}
+		}
+	});
+}
+
+void CpuRenderer::TraceShadows(const float3* origins, const uint8_t* active, size_t numRays, const UIData& settings, uint8_t* occluded) const
+{
+	const float3 lightDirection = normalize(settings.lightDirection);
+	const CpuRayTracer& tracer = m_RayQuery.GetTracer();
+	const size_t numPackets = (numRays + CpuRayTracer::k_PacketSize - 1) / CpuRayTracer::k_PacketSize;
+
+	TaskScheduler::Get().ParallelFor(0, numPackets, 16, [&](uint64_t begin, uint64_t end) {
+		CpuRay rays[CpuRayTracer::k_PacketSize];
+		bool packetActive[CpuRayTracer::k_PacketSize];
+		bool packetOccluded[CpuRayTracer::k_PacketSize];
+		for (uint64_t packet = begin; packet < end; packet++) {
+			const size_t first = size_t(packet) * CpuRayTracer::k_PacketSize;
+			const uint count = uint(std::min<size_t>(CpuRayTracer::k_PacketSize, numRays - first));
+			for (uint i = 0; i < count; i++) {
+				packetActive[i] = active[first + i] != 0;
+				rays[i].origin = origins[first + i];
+				rays[i].direction = -lightDirection;
+				rays[i].tMin = settings.shadowRayBias;
+				rays[i].tMax = settings.cameraFar;
+			}
+			tracer.TraceShadowPacket(rays, packetActive, packetOccluded, count);
+			for (uint i = 0; i < count; i++)
+				occluded[first + i] = packetActive[i] && packetOccluded[i] ? 1 : 0;
+		}
+	});
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <filesystem>
+#include <vector>
+#include "SceneRayQuery.h"
+#include "UIData.h"
+
+using namespace donut::math;
+
+class MinecraftSceneLoader;
+
+/* Renders images of a loaded scene on the CPU, for headless batch runs without a ray tracing device.
+   Shades like RaytraceWorld_rt.hlsl with the dielectric material model: ambient, environment reflection, emission and the directional light
+   with shadow rays. Normal and metal rough textures, the GGX highlight and the emissive block lights are left out.
+   Diffuse and emissive textures are decoded from the PNGs and point sampled like the material sampler. The output is sRGB encoded, as on screen
+*/
+class CpuRenderer {
+public:
+	//Per pixel result of RenderLayers: the shading without the shadow ray, so that the images of renderers of different parts of a scene
+	//can be composited by depth and shadowed by all of them (see ShardedRenderer)
+	struct LayerTexel {
+		float hitT = 0.f;					//Distance of the closest hit, infinity for misses
+		float3 color = float3(0.f);			//Linear color without the directional light, the environment for misses
+		float3 light = float3(0.f);			//Directional light, added where the shadow ray is not occluded
+		float3 shadowOrigin = float3(0.f);	//Origin of the shadow ray, offset along the face normal
+	};
+
+	//Builds the ray query and decodes the textures. The scene needs to stay loaded while rendering
+	void Build(const MinecraftSceneLoader& scene, const std::filesystem::path& sceneFolder);
+	void Clear();
+	bool IsBuilt() const { return m_RayQuery.IsBuilt(); }
+
+	//Renders the view to RGBA8, rows from top to bottom. Tiles are rendered in parallel with the TaskScheduler
+	void Render(const CpuCamera& camera, uint2 resolution, const UIData& settings, std::vector<uint8_t>& rgba) const;
+
+	//Primary rays only, rows from top to bottom. Render is Encode(color + light) where the shadow ray of a texel is not occluded
+	void RenderLayers(const CpuCamera& camera, uint2 resolution, const UIData& settings, std::vector<LayerTexel>& layers) const;
+	//Shadow rays towards the light as in Render, occluded[i] is 1 if active[i] is set and the ray from origins[i] hits an opaque surface
+	void TraceShadows(const float3* origins, const uint8_t* active, size_t numRays, const UIData& settings, uint8_t* occluded) const;
+	//sRGB encoded RGBA8 of a linear color, as written by Render
+	static void EncodeColor(float3 color, uint8_t* texel);
+
+	//Camera with the projection of the Renderer (reverse depth, cameraFov and cameraFar of the settings)
+	static CpuCamera MakeCamera(const affine3& worldToView, const UIData& settings, uint2 resolution);
+
+	const SceneRayQuery& GetRayQuery() const { return m_RayQuery; }
+
+private:
+	struct Texture {
+		uint width = 0;
+		uint height = 0;
+		std::vector<uint8_t> rgba;
+		bool sRGB = false;
+	};
+	struct MaterialData {
+		float3 diffuseColor = float3(1.f);
+		float3 emissiveColor = float3(0.f);
+		int diffuseTexture = -1;	//Index into m_Textures
+		int emissiveTexture = -1;
+		bool doubleSided = false;
+	};
+
+	float3 SampleTexture(int textureIndex, float2 uv) const;
+	//Color without the directional light, which is returned in light
+	float3 Shade(const CpuRay& ray, const CpuHit& hit, const UIData& settings, float3 lightDirection, float3& light) const;
+	//Primary hits of a tile and their shadow rays, active is false for misses
+	void TraceTile(const CpuCamera& camera, uint2 resolution, uint2 tileOrigin, const UIData& settings, float3 lightDirection, CpuHit* hits,
+		CpuRay* shadowRays, bool* active) const;
+
+	SceneRayQuery m_RayQuery;
+	std::vector<Texture> m_Textures;
+	std::vector<MaterialData> m_Materials;
+	float m_SrgbToLinear[256] = {};
+};
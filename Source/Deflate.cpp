@@ -0,0 +1,381 @@
+#include "Deflate.h"
+#include <algorithm>
+
+static const uint16_t k_LengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t k_LengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t k_DistanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+	4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t k_DistanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static const size_t k_WindowSize = 32768;
+static const size_t k_MinMatch = 3;
+static const size_t k_MaxMatch = 258;
+static const uint32_t k_HashBits = 15;
+//Candidates compared per position, more find longer matches but take longer
+static const unsigned k_MaxChain = 32;
+
+namespace {
+	//LSB first bit stream
+	class BitWriter {
+	public:
+		BitWriter(std::vector<uint8_t>& output) : m_Output(output) {}
+
+		void Put(uint32_t value, unsigned n) {
+			m_Bits |= uint64_t(value) << m_Count;
+			m_Count += n;
+			while (m_Count >= 8) {
+				m_Output.push_back(uint8_t(m_Bits));
+				m_Bits >>= 8;
+				m_Count -= 8;
+			}
+		}
+		void Flush() {
+			if (m_Count > 0)
+				m_Output.push_back(uint8_t(m_Bits));
+			m_Bits = 0;
+			m_Count = 0;
+		}
+
+	private:
+		std::vector<uint8_t>& m_Output;
+		uint64_t m_Bits = 0;
+		unsigned m_Count = 0;
+	};
+}
+
+//Order of the code length code lengths in a dynamic block header
+static const uint8_t k_CodeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+static const unsigned k_NumLiteralCodes = 286;
+static const unsigned k_NumDistanceCodes = 30;
+static const unsigned k_MaxCodeLength = 15;
+static const unsigned k_MaxCodeLengthCodeLength = 7;
+//Matches and literals per block, each block gets its own Huffman codes
+static const size_t k_BlockTokens = size_t(1) << 16;
+
+namespace {
+	//Literal (distance 0) or match of the LZ77 pass
+	struct Token {
+		uint16_t value;		//Literal byte or match length
+		uint16_t distance;
+	};
+
+	//Huffman code lengths and the codes bit reversed for the LSB first stream
+	struct HuffmanTable {
+		uint8_t lengths[288] = {};
+		uint16_t codes[288] = {};
+		unsigned numSymbols = 0;
+	};
+}
+
+static unsigned GetLengthCode(size_t length) {
+	return unsigned(std::upper_bound(k_LengthBase, k_LengthBase + 29, uint16_t(length)) - k_LengthBase) - 1;
+}
+
+static unsigned GetDistanceCode(size_t distance) {
+	return unsigned(std::upper_bound(k_DistanceBase, k_DistanceBase + 30, uint16_t(distance)) - k_DistanceBase) - 1;
+}
+
+//Canonical codes from the code lengths (RFC 1951, 3.2.2)
+static void AssignCodes(HuffmanTable& table) {
+	uint16_t count[k_MaxCodeLength + 1] = {};
+	for (unsigned s = 0; s < table.numSymbols; s++)
+		count[table.lengths[s]]++;
+	count[0] = 0;
+	uint16_t nextCode[k_MaxCodeLength + 1] = {};
+	for (unsigned length = 1; length <= k_MaxCodeLength; length++)
+		nextCode[length] = uint16_t((nextCode[length - 1] + count[length - 1]) << 1);
+	for (unsigned s = 0; s < table.numSymbols; s++) {
+		unsigned length = table.lengths[s];
+		if (length == 0)
+			continue;
+		uint32_t code = nextCode[length]++;
+		uint32_t reversed = 0;
+		for (unsigned i = 0; i < length; i++)
+			reversed |= ((code >> i) & 1) << (length - 1 - i);
+		table.codes[s] = uint16_t(reversed);
+	}
+}
+
+//Huffman code lengths of at most maxLength bits for the frequencies. Frequencies are flattened until the lengths fit.
+//Codes are always complete, a single used symbol gets a second one, which some decoders require
+static void BuildLengths(const uint32_t* frequencies, unsigned numSymbols, unsigned maxLength, HuffmanTable& table) {
+	table.numSymbols = numSymbols;
+	std::fill(table.lengths, table.lengths + numSymbols, uint8_t(0));
+	std::vector<uint32_t> weights(frequencies, frequencies + numSymbols);
+	std::vector<unsigned> used;
+	for (unsigned s = 0; s < numSymbols; s++) {
+		if (weights[s] > 0)
+			used.push_back(s);
+	}
+	if (used.size() < 2) {
+		unsigned first = used.empty() ? 0 : used[0];
+		table.lengths[first] = 1;
+		table.lengths[first == 0 ? 1 : 0] = 1;
+		AssignCodes(table);
+		return;
+	}
+
+	struct Node {
+		uint64_t weight;
+		int left, right;	//Children, -1 for leaves
+	};
+	std::vector<Node> nodes;
+	std::vector<unsigned> depths;
+	while (true) {
+		//Two queue construction: leaves sorted by weight, inner nodes are created in increasing weight order
+		std::sort(used.begin(), used.end(), [&](unsigned a, unsigned b) { return weights[a] < weights[b] || (weights[a] == weights[b] && a < b); });
+		nodes.clear();
+		for (unsigned s : used)
+			nodes.push_back({ weights[s], -1, -1 });
+		size_t nextLeaf = 0, nextInner = used.size();
+		auto takeSmallest = [&]() {
+			if (nextLeaf < used.size() && (nextInner >= nodes.size() || nodes[nextLeaf].weight <= nodes[nextInner].weight))
+				return int(nextLeaf++);
+			return int(nextInner++);
+		};
+		for (size_t i = 1; i < used.size(); i++) {
+			int a = takeSmallest();
+			int b = takeSmallest();
+			nodes.push_back({ nodes[a].weight + nodes[b].weight, a, b });
+		}
+
+		//Depths from the root down, children always have lower indices than their parent
+		depths.assign(nodes.size(), 0);
+		unsigned maxDepth = 0;
+		for (size_t i = nodes.size(); i-- > 0;) {
+			if (nodes[i].left < 0) {
+				maxDepth = std::max(maxDepth, depths[i]);
+				continue;
+			}
+			depths[nodes[i].left] = depths[i] + 1;
+			depths[nodes[i].right] = depths[i] + 1;
+		}
+		if (maxDepth <= maxLength)
+			break;
+		for (unsigned s : used)
+			weights[s] = (weights[s] >> 1) | 1;
+	}
+	for (size_t i = 0; i < used.size(); i++)
+		table.lengths[used[i]] = uint8_t(depths[i]);
+	AssignCodes(table);
+}
+
+static void BuildFixedTables(HuffmanTable& literals, HuffmanTable& distances) {
+	literals.numSymbols = 288;
+	std::fill(literals.lengths, literals.lengths + 144, uint8_t(8));
+	std::fill(literals.lengths + 144, literals.lengths + 256, uint8_t(9));
+	std::fill(literals.lengths + 256, literals.lengths + 280, uint8_t(7));
+	std::fill(literals.lengths + 280, literals.lengths + 288, uint8_t(8));
+	AssignCodes(literals);
+	distances.numSymbols = k_NumDistanceCodes;
+	std::fill(distances.lengths, distances.lengths + k_NumDistanceCodes, uint8_t(5));
+	AssignCodes(distances);
+}
+
+//Run length coded code lengths of a dynamic block header, symbols 16 to 18 are followed by their repeat count
+static void EncodeCodeLengths(const uint8_t* lengths, unsigned count, std::vector<std::pair<uint8_t, uint8_t>>& symbols) {
+	for (unsigned i = 0; i < count;) {
+		unsigned run = 1;
+		while (i + run < count && lengths[i + run] == lengths[i])
+			run++;
+		if (lengths[i] == 0 && run >= 3) {
+			run = std::min(run, 138u);
+			symbols.push_back(run <= 10 ? std::make_pair(uint8_t(17), uint8_t(run - 3)) : std::make_pair(uint8_t(18), uint8_t(run - 11)));
+		}
+		else if (lengths[i] != 0 && run >= 4) {
+			run = std::min(run, 7u);
+			symbols.push_back({ lengths[i], 0 });
+			symbols.push_back({ uint8_t(16), uint8_t(run - 4) });
+		}
+		else {
+			run = 1;
+			symbols.push_back({ lengths[i], 0 });
+		}
+		i += run;
+	}
+}
+
+static void PutTokens(BitWriter& writer, const Token* tokens, size_t numTokens, const HuffmanTable& literals, const HuffmanTable& distances) {
+	for (size_t t = 0; t < numTokens; t++) {
+		const Token& token = tokens[t];
+		if (token.distance == 0) {
+			writer.Put(literals.codes[token.value], literals.lengths[token.value]);
+			continue;
+		}
+		unsigned lengthCode = GetLengthCode(token.value);
+		writer.Put(literals.codes[257 + lengthCode], literals.lengths[257 + lengthCode]);
+		writer.Put(uint32_t(token.value - k_LengthBase[lengthCode]), k_LengthExtra[lengthCode]);
+		unsigned distanceCode = GetDistanceCode(token.distance);
+		writer.Put(distances.codes[distanceCode], distances.lengths[distanceCode]);
+		writer.Put(uint32_t(token.distance - k_DistanceBase[distanceCode]), k_DistanceExtra[distanceCode]);
+	}
+	writer.Put(literals.codes[256], literals.lengths[256]);	//End of block
+}
+
+//Writes the tokens as one block with dynamic Huffman codes, or with the fixed codes if that is smaller
+static void PutBlock(BitWriter& writer, const Token* tokens, size_t numTokens, bool final) {
+	uint32_t literalFrequencies[k_NumLiteralCodes] = {};
+	uint32_t distanceFrequencies[k_NumDistanceCodes] = {};
+	for (size_t t = 0; t < numTokens; t++) {
+		if (tokens[t].distance == 0) {
+			literalFrequencies[tokens[t].value]++;
+		}
+		else {
+			literalFrequencies[257 + GetLengthCode(tokens[t].value)]++;
+			distanceFrequencies[GetDistanceCode(tokens[t].distance)]++;
+		}
+	}
+	literalFrequencies[256] = 1;
+
+	HuffmanTable literals, distances;
+	BuildLengths(literalFrequencies, k_NumLiteralCodes, k_MaxCodeLength, literals);
+	BuildLengths(distanceFrequencies, k_NumDistanceCodes, k_MaxCodeLength, distances);
+	unsigned numLiterals = k_NumLiteralCodes;
+	while (numLiterals > 257 && literals.lengths[numLiterals - 1] == 0)
+		numLiterals--;
+	unsigned numDistances = k_NumDistanceCodes;
+	while (numDistances > 1 && distances.lengths[numDistances - 1] == 0)
+		numDistances--;
+
+	//Literal and distance code lengths are run length coded as one sequence
+	uint8_t allLengths[k_NumLiteralCodes + k_NumDistanceCodes];
+	std::copy(literals.lengths, literals.lengths + numLiterals, allLengths);
+	std::copy(distances.lengths, distances.lengths + numDistances, allLengths + numLiterals);
+	std::vector<std::pair<uint8_t, uint8_t>> lengthSymbols;
+	EncodeCodeLengths(allLengths, numLiterals + numDistances, lengthSymbols);
+	uint32_t lengthFrequencies[19] = {};
+	for (const auto& symbol : lengthSymbols)
+		lengthFrequencies[symbol.first]++;
+	HuffmanTable lengthTable;
+	BuildLengths(lengthFrequencies, 19, k_MaxCodeLengthCodeLength, lengthTable);
+	unsigned numLengthCodes = 19;
+	while (numLengthCodes > 4 && lengthTable.lengths[k_CodeLengthOrder[numLengthCodes - 1]] == 0)
+		numLengthCodes--;
+
+	//The extra bits of lengths and distances are the same for both codes
+	HuffmanTable fixedLiterals, fixedDistances;
+	BuildFixedTables(fixedLiterals, fixedDistances);
+	uint64_t dynamicBits = 14 + 3 * numLengthCodes, fixedBits = 0;
+	for (const auto& symbol : lengthSymbols)
+		dynamicBits += lengthTable.lengths[symbol.first] + (symbol.first == 16 ? 2 : symbol.first == 17 ? 3 : symbol.first == 18 ? 7 : 0);
+	for (unsigned s = 0; s < k_NumLiteralCodes; s++) {
+		dynamicBits += uint64_t(literalFrequencies[s]) * literals.lengths[s];
+		fixedBits += uint64_t(literalFrequencies[s]) * fixedLiterals.lengths[s];
+	}
+	for (unsigned s = 0; s < k_NumDistanceCodes; s++) {
+		dynamicBits += uint64_t(distanceFrequencies[s]) * distances.lengths[s];
+		fixedBits += uint64_t(distanceFrequencies[s]) * fixedDistances.lengths[s];
+	}
+
+	writer.Put(final ? 1 : 0, 1);
+	if (fixedBits <= dynamicBits) {
+		writer.Put(1, 2);
+		PutTokens(writer, tokens, numTokens, fixedLiterals, fixedDistances);
+		return;
+	}
+	writer.Put(2, 2);
+	writer.Put(numLiterals - 257, 5);
+	writer.Put(numDistances - 1, 5);
+	writer.Put(numLengthCodes - 4, 4);
+	for (unsigned i = 0; i < numLengthCodes; i++)
+		writer.Put(lengthTable.lengths[k_CodeLengthOrder[i]], 3);
+	for (const auto& symbol : lengthSymbols) {
+		writer.Put(lengthTable.codes[symbol.first], lengthTable.lengths[symbol.first]);
+		if (symbol.first >= 16)
+			writer.Put(symbol.second, symbol.first == 16 ? 2 : symbol.first == 17 ? 3 : 7);
+	}
+	PutTokens(writer, tokens, numTokens, literals, distances);
+}
+
+void Deflate::Raw(const uint8_t* data, size_t size, std::vector<uint8_t>& output)
+{
+	BitWriter writer(output);
+	std::vector<Token> tokens;
+	tokens.reserve(std::min(size, k_BlockTokens));
+
+	//Most recent position per hash of the next 3 bytes, and the previous position with the same hash per window slot
+	std::vector<int32_t> head(size_t(1) << k_HashBits, -1);
+	std::vector<int32_t> previous(k_WindowSize, -1);
+	auto hash = [&](size_t i) { return ((uint32_t(data[i]) << 10) ^ (uint32_t(data[i + 1]) << 5) ^ data[i + 2]) & ((1u << k_HashBits) - 1); };
+	auto insert = [&](size_t i) {
+		if (i + k_MinMatch > size)
+			return;
+		uint32_t h = hash(i);
+		previous[i % k_WindowSize] = head[h];
+		head[h] = int32_t(i);
+	};
+
+	size_t i = 0;
+	while (i < size) {
+		size_t bestLength = 0;
+		size_t bestDistance = 0;
+		if (i + k_MinMatch <= size) {
+			const size_t maxLength = std::min(k_MaxMatch, size - i);
+			int32_t candidate = head[hash(i)];
+			//The chain can contain positions of overwritten window slots, all matches are verified
+			for (unsigned chain = 0; candidate >= 0 && chain < k_MaxChain; chain++) {
+				size_t distance = i - size_t(candidate);
+				if (distance == 0 || distance > k_WindowSize)
+					break;
+				if (data[candidate + bestLength] == data[i + bestLength]) {
+					size_t length = 0;
+					while (length < maxLength && data[candidate + length] == data[i + length])
+						length++;
+					if (length > bestLength) {
+						bestLength = length;
+						bestDistance = distance;
+						if (length == maxLength)
+							break;
+					}
+				}
+				candidate = previous[size_t(candidate) % k_WindowSize];
+			}
+		}
+
+		if (bestLength >= k_MinMatch) {
+			tokens.push_back({ uint16_t(bestLength), uint16_t(bestDistance) });
+			for (size_t k = 0; k < bestLength; k++)
+				insert(i + k);
+			i += bestLength;
+		}
+		else {
+			tokens.push_back({ data[i], 0 });
+			insert(i);
+			i++;
+		}
+		if (tokens.size() == k_BlockTokens && i < size) {
+			PutBlock(writer, tokens.data(), tokens.size(), false);
+			tokens.clear();
+		}
+	}
+	PutBlock(writer, tokens.data(), tokens.size(), true);
+	writer.Flush();
+}
+
+void Deflate::Zlib(const uint8_t* data, size_t size, std::vector<uint8_t>& output)
+{
+	//Deflate with a 32K window, no dictionary
+	output.push_back(0x78);
+	output.push_back(0x01);
+	Raw(data, size, output);
+	uint32_t adler = Adler32(data, size);
+	for (int shift = 24; shift >= 0; shift -= 8)
+		output.push_back(uint8_t(adler >> shift));
+}
+
+uint32_t Deflate::Adler32(const uint8_t* data, size_t size, uint32_t adler)
+{
+	uint32_t a = adler & 0xFFFF;
+	uint32_t b = adler >> 16;
+	for (size_t i = 0; i < size;) {
+		//Largest run without overflowing b
+		size_t end = std::min(size, i + 5552);
+		for (; i < end; i++) {
+			a += data[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	return (b << 16) | a;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* DEFLATE compression (RFC 1951) with the zlib (RFC 1950) wrapper, the counterpart of Inflate.
+   Uses LZ77 matches with a hash chain and Huffman codes built per block of 64K symbols (the fixed codes if they are smaller),
+   which is fast and good enough for images and scene data
+*/
+namespace Deflate {
+	//Compresses data to a raw DEFLATE stream and appends it to output
+	void Raw(const uint8_t* data, size_t size, std::vector<uint8_t>& output);
+
+	//Compresses data to a zlib stream with its Adler-32 and appends it to output
+	void Zlib(const uint8_t* data, size_t size, std::vector<uint8_t>& output);
+
+	uint32_t Adler32(const uint8_t* data, size_t size, uint32_t adler = 1);
+}
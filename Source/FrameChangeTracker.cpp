@@ -0,0 +1,33 @@
+#include "FrameChangeTracker.h"
+#include <cstring>
+
+static bool SameValue(float a, float b) { return a == b; }
+static bool SameValue(int a, int b) { return a == b; }
+static bool SameValue(const float3& a, const float3& b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+
+bool FrameChangeTracker::Update(const Inputs& inputs)
+{
+	if (m_Valid && Equal(inputs, m_Last)) {
+		m_Stats.reusedFrames++;
+		return false;
+	}
+	m_Last = inputs;
+	m_Valid = true;
+	m_Stats.tracedFrames++;
+	return true;
+}
+
+bool FrameChangeTracker::Equal(const Inputs& a, const Inputs& b)
+{
+	if (a.scene != b.scene || a.sceneVersion != b.sceneVersion || a.resolution.x != b.resolution.x || a.resolution.y != b.resolution.y)
+		return false;
+	//The matrix is a plain array of floats
+	if (std::memcmp(&a.viewProjection, &b.viewProjection, sizeof(float4x4)) != 0)
+		return false;
+
+	bool same = true;
+	VisitRenderSettings([&](const char*, const auto& fieldA, const auto& fieldB) {
+		same = same && SameValue(fieldA, fieldB);
+	}, a.settings, b.settings);
+	return same;
+}
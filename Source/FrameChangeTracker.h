@@ -0,0 +1,41 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include "UIData.h"
+
+using namespace donut::math;
+
+/* Decides whether a frame has to be traced or the image of the last traced frame can be shown again.
+   A frame is traced if one of its inputs differs from the last traced frame: the camera matrices, the render settings of UIData
+   (see VisitRenderSettings), the scene and the version of its materials, or the resolution. Values are compared exactly, any camera
+   movement traces a new frame
+*/
+class FrameChangeTracker {
+public:
+	struct Inputs {
+		float4x4 viewProjection = float4x4::identity();
+		UIData settings;
+		const void* scene = nullptr;	//Identity of the active scene
+		uint64_t sceneVersion = 0;		//Changes when the scene content changes, e.g. materials switching to their lazy textures
+		uint2 resolution = uint2(0, 0);
+	};
+
+	struct Stats {
+		uint64_t tracedFrames = 0;
+		uint64_t reusedFrames = 0;
+	};
+
+	//Returns true if the frame has to be traced and remembers its inputs, false if the last traced image is still valid
+	bool Update(const Inputs& inputs);
+	//The next frame is traced regardless of its inputs, e.g. after the render target was recreated
+	void Invalidate() { m_Valid = false; }
+
+	const Stats& GetStats() const { return m_Stats; }
+	void ResetStats() { m_Stats = Stats(); }
+
+	static bool Equal(const Inputs& a, const Inputs& b);
+
+private:
+	Inputs m_Last;
+	bool m_Valid = false;
+	Stats m_Stats;
+};
@@ -0,0 +1,339 @@
+#include "Inflate.h"
+#include <algorithm>
+#include <cstring>
+
+//Codes up to this length are decoded with a single table lookup, longer ones bit by bit
+static const unsigned k_FastBits = 10;
+static const unsigned k_MaxCodeLength = 15;
+
+static const uint16_t k_LengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t k_LengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t k_DistanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+	4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t k_DistanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+//Order of the code length code lengths in a dynamic block header
+static const uint8_t k_CodeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+namespace {
+	//LSB first bit stream. Reads past the end return zeros and are detected with IsOverrun
+	class BitReader {
+	public:
+		BitReader(const uint8_t* data, size_t size) : m_Data(data), m_Size(size) {}
+
+		void Refill() {
+			while (m_Count <= 56) {
+				uint64_t byte = m_Pos < m_Size ? m_Data[m_Pos] : 0;
+				m_Bits |= byte << m_Count;
+				m_Count += 8;
+				m_Pos++;
+			}
+		}
+		uint32_t Peek(unsigned n) { return uint32_t(m_Bits & ((uint64_t(1) << n) - 1)); }
+		void Consume(unsigned n) { m_Bits >>= n; m_Count -= n; }
+		uint32_t Get(unsigned n) {
+			if (n == 0)
+				return 0;
+			if (m_Count < n)
+				Refill();
+			uint32_t value = Peek(n);
+			Consume(n);
+			return value;
+		}
+		void AlignToByte() { Consume(m_Count & 7); }
+
+		//Bytes consumed so far, excluding the buffered bits
+		size_t GetBytePosition() const { return m_Pos - m_Count / 8; }
+		bool IsOverrun() const { return GetBytePosition() > m_Size; }
+
+		//Copies n bytes of a stored block. Needs to be byte aligned
+		bool CopyBytes(size_t n, std::vector<uint8_t>& output) {
+			size_t position = GetBytePosition();
+			if (position + n > m_Size)
+				return false;
+			output.insert(output.end(), m_Data + position, m_Data + position + n);
+			m_Pos = position + n;
+			m_Bits = 0;
+			m_Count = 0;
+			return true;
+		}
+
+	private:
+		const uint8_t* m_Data;
+		size_t m_Size;
+		size_t m_Pos = 0;
+		uint64_t m_Bits = 0;
+		unsigned m_Count = 0;
+	};
+
+	//Canonical Huffman code
+	class HuffmanCode {
+	public:
+		//Returns false if the code is over-subscribed. Incomplete codes are allowed (e.g. a single distance code)
+		bool Build(const uint8_t* lengths, unsigned numSymbols) {
+			memset(m_Count, 0, sizeof(m_Count));
+			memset(m_Fast, 0, sizeof(m_Fast));
+			for (unsigned s = 0; s < numSymbols; s++)
+				m_Count[lengths[s]]++;
+			m_Count[0] = 0;
+
+			int left = 1;
+			for (unsigned length = 1; length <= k_MaxCodeLength; length++) {
+				left = (left << 1) - m_Count[length];
+				if (left < 0)
+					return false;
+			}
+
+			uint16_t offset[k_MaxCodeLength + 1];
+			uint32_t nextCode[k_MaxCodeLength + 1];
+			offset[1] = 0;
+			nextCode[1] = 0;
+			for (unsigned length = 1; length < k_MaxCodeLength; length++) {
+				offset[length + 1] = offset[length] + m_Count[length];
+				nextCode[length + 1] = (nextCode[length] + m_Count[length]) << 1;
+			}
+
+			for (unsigned s = 0; s < numSymbols; s++) {
+				unsigned length = lengths[s];
+				if (length == 0)
+					continue;
+				m_Symbol[offset[length]++] = uint16_t(s);
+
+				//Codes are stored MSB first in the LSB first stream, the table is indexed with the reversed code
+				uint32_t code = nextCode[length]++;
+				if (length <= k_FastBits) {
+					uint32_t reversed = 0;
+					for (unsigned i = 0; i < length; i++)
+						reversed |= ((code >> i) & 1) << (length - 1 - i);
+					for (uint32_t fill = reversed; fill < (1u << k_FastBits); fill += 1u << length)
+						m_Fast[fill] = uint16_t((s << 4) | length);
+				}
+			}
+			return true;
+		}
+
+		//Returns the next symbol or -1 for an invalid code
+		int Decode(BitReader& reader) const {
+			reader.Refill();
+			uint16_t entry = m_Fast[reader.Peek(k_FastBits)];
+			if (entry != 0) {
+				reader.Consume(entry & 15);
+				return entry >> 4;
+			}
+
+			int code = 0;
+			int first = 0;
+			int index = 0;
+			for (unsigned length = 1; length <= k_MaxCodeLength; length++) {
+				code |= int(reader.Get(1));
+				int count = m_Count[length];
+				if (code - count < first)
+					return m_Symbol[index + (code - first)];
+				index += count;
+				first = (first + count) << 1;
+				code <<= 1;
+			}
+			return -1;
+		}
+
+	private:
+		uint16_t m_Fast[1 << k_FastBits];	//Symbol << 4 | length, 0 if the code is longer than k_FastBits
+		uint16_t m_Count[k_MaxCodeLength + 1];
+		uint16_t m_Symbol[288];
+	};
+}
+
+static bool InflateBlock(BitReader& reader, const HuffmanCode& lengthCode, const HuffmanCode& distanceCode, std::vector<uint8_t>& output, size_t outputStart) {
+	while (true) {
+		int symbol = lengthCode.Decode(reader);
+		if (symbol < 0 || reader.IsOverrun())
+			return false;
+		if (symbol < 256) {
+			output.push_back(uint8_t(symbol));
+			continue;
+		}
+		if (symbol == 256)
+			return true;
+
+		symbol -= 257;
+		if (symbol >= 29)
+			return false;
+		size_t length = k_LengthBase[symbol] + reader.Get(k_LengthExtra[symbol]);
+		int distanceSymbol = distanceCode.Decode(reader);
+		if (distanceSymbol < 0 || distanceSymbol >= 30)
+			return false;
+		size_t distance = k_DistanceBase[distanceSymbol] + reader.Get(k_DistanceExtra[distanceSymbol]);
+		if (distance > output.size() - outputStart)
+			return false;
+
+		//Byte by byte, the source may overlap the copied bytes
+		size_t from = output.size() - distance;
+		output.resize(output.size() + length);
+		uint8_t* out = output.data() + output.size() - length;
+		const uint8_t* in = output.data() + from;
+		for (size_t i = 0; i < length; i++)
+			out[i] = in[i];
+	}
+}
+
+bool Inflate::Raw(const uint8_t* data, size_t size, std::vector<uint8_t>& output, size_t* consumed)
+{
+	BitReader reader(data, size);
+	const size_t outputStart = output.size();
+	HuffmanCode lengthCode;
+	HuffmanCode distanceCode;
+
+	bool lastBlock = false;
+	while (!lastBlock) {
+		lastBlock = reader.Get(1) != 0;
+		uint32_t type = reader.Get(2);
+		if (type == 0) {
+			//Stored
+			reader.AlignToByte();
+			uint32_t length = reader.Get(16);
+			uint32_t lengthComplement = reader.Get(16);
+			if ((length ^ 0xFFFF) != lengthComplement || !reader.CopyBytes(length, output))
+				return false;
+		}
+		else if (type == 1) {
+			//Fixed codes
+			uint8_t lengths[288 + 30];
+			memset(lengths, 8, 144);
+			memset(lengths + 144, 9, 112);
+			memset(lengths + 256, 7, 24);
+			memset(lengths + 280, 8, 8);
+			memset(lengths + 288, 5, 30);
+			lengthCode.Build(lengths, 288);
+			distanceCode.Build(lengths + 288, 30);
+			if (!InflateBlock(reader, lengthCode, distanceCode, output, outputStart))
+				return false;
+		}
+		else if (type == 2) {
+			//Dynamic codes
+			uint32_t numLengthCodes = reader.Get(5) + 257;
+			uint32_t numDistanceCodes = reader.Get(5) + 1;
+			uint32_t numCodeLengthCodes = reader.Get(4) + 4;
+			if (numLengthCodes > 286 || numDistanceCodes > 30)
+				return false;
+
+			uint8_t codeLengthLengths[19] = {};
+			for (uint32_t i = 0; i < numCodeLengthCodes; i++)
+				codeLengthLengths[k_CodeLengthOrder[i]] = uint8_t(reader.Get(3));
+			HuffmanCode codeLengthCode;
+			if (!codeLengthCode.Build(codeLengthLengths, 19))
+				return false;
+
+			uint8_t lengths[286 + 30] = {};
+			uint32_t numLengths = numLengthCodes + numDistanceCodes;
+			for (uint32_t i = 0; i < numLengths;) {
+				int symbol = codeLengthCode.Decode(reader);
+				if (symbol < 0)
+					return false;
+				if (symbol < 16) {
+					lengths[i++] = uint8_t(symbol);
+					continue;
+				}
+				uint8_t repeatLength = 0;
+				uint32_t repeat = 0;
+				if (symbol == 16) {
+					if (i == 0)
+						return false;
+					repeatLength = lengths[i - 1];
+					repeat = 3 + reader.Get(2);
+				}
+				else if (symbol == 17) {
+					repeat = 3 + reader.Get(3);
+				}
+				else {
+					repeat = 11 + reader.Get(7);
+				}
+				if (i + repeat > numLengths)
+					return false;
+				while (repeat-- > 0)
+					lengths[i++] = repeatLength;
+			}
+
+			//A block without an end of block code can not be decoded
+			if (lengths[256] == 0)
+				return false;
+			if (!lengthCode.Build(lengths, numLengthCodes) || !distanceCode.Build(lengths + numLengthCodes, numDistanceCodes))
+				return false;
+			if (!InflateBlock(reader, lengthCode, distanceCode, output, outputStart))
+				return false;
+		}
+		else {
+			return false;
+		}
+		if (reader.IsOverrun())
+			return false;
+	}
+
+	if (consumed) {
+		reader.AlignToByte();
+		*consumed = reader.GetBytePosition();
+	}
+	return true;
+}
+
+bool Inflate::Zlib(const uint8_t* data, size_t size, std::vector<uint8_t>& output)
+{
+	//CMF (deflate, window <= 32K) and FLG, without preset dictionary
+	if (size < 6 || (data[0] & 0x0F) != 8 || (data[0] >> 4) > 7 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20) != 0)
+		return false;
+
+	const size_t outputStart = output.size();
+	size_t consumed = 0;
+	if (!Inflate::Raw(data + 2, size - 2, output, &consumed) || 2 + consumed + 4 > size)
+		return false;
+
+	uint32_t a = 1;
+	uint32_t b = 0;
+	for (size_t i = outputStart; i < output.size();) {
+		//Largest run without overflowing b
+		size_t end = std::min(output.size(), i + 5552);
+		for (; i < end; i++) {
+			a += output[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	const uint8_t* trailer = data + 2 + consumed;
+	uint32_t adler = (uint32_t(trailer[0]) << 24) | (uint32_t(trailer[1]) << 16) | (uint32_t(trailer[2]) << 8) | trailer[3];
+	return adler == ((b << 16) | a);
+}
+
+bool Inflate::Gzip(const uint8_t* data, size_t size, std::vector<uint8_t>& output)
+{
+	if (size < 18 || data[0] != 0x1F || data[1] != 0x8B || data[2] != 8)
+		return false;
+
+	//Skip the optional header fields
+	const uint8_t flags = data[3];
+	size_t pos = 10;
+	if (flags & 0x04) {
+		if (pos + 2 > size)
+			return false;
+		pos += 2 + (data[pos] | (data[pos + 1] << 8));
+	}
+	for (uint8_t stringFlag : { uint8_t(0x08), uint8_t(0x10) }) {
+		if (!(flags & stringFlag))
+			continue;
+		while (pos < size && data[pos] != 0)
+			pos++;
+		pos++;
+	}
+	if (flags & 0x02)
+		pos += 2;
+	if (pos >= size)
+		return false;
+
+	const size_t outputStart = output.size();
+	size_t consumed = 0;
+	if (!Inflate::Raw(data + pos, size - pos, output, &consumed) || pos + consumed + 8 > size)
+		return false;
+
+	//The CRC-32 is not checked, the size modulo 2^32 catches truncated streams
+	const uint8_t* trailer = data + pos + consumed + 4;
+	uint32_t isize = uint32_t(trailer[0]) | (uint32_t(trailer[1]) << 8) | (uint32_t(trailer[2]) << 16) | (uint32_t(trailer[3]) << 24);
+	return isize == uint32_t(output.size() - outputStart);
+}
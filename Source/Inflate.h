@@ -0,0 +1,19 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* DEFLATE decompression (RFC 1951) with the zlib (RFC 1950) and gzip (RFC 1952) wrappers.
+   Used for Minecraft region files and level.dat without an external zlib dependency
+*/
+namespace Inflate {
+	//Decompresses a raw DEFLATE stream and appends it to output. Returns false if the stream is corrupt or truncated.
+	//If consumed is set, it receives the number of input bytes used by the stream
+	bool Raw(const uint8_t* data, size_t size, std::vector<uint8_t>& output, size_t* consumed = nullptr);
+
+	//Decompresses a zlib stream and checks its Adler-32
+	bool Zlib(const uint8_t* data, size_t size, std::vector<uint8_t>& output);
+
+	//Decompresses the first member of a gzip file and checks its size
+	bool Gzip(const uint8_t* data, size_t size, std::vector<uint8_t>& output);
+}
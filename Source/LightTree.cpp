@@ -0,0 +1,364 @@
+#include "LightTree.h"
+#include "TaskScheduler.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <unordered_map>
+
+using namespace donut;
+using namespace donut::engine;
+
+//Subtrees with more lights than this are built as separate tasks
+static const uint k_ParallelBuildThreshold = 4096;
+//Blocks per task when extracting the emissive faces
+static const uint k_ExtractGrainSize = 16384;
+//Depth limit of the traversal, kLightTreeMaxDepth in the shader
+static const uint k_MaxTraversalDepth = 64;
+
+static float Luminance(float3 color) {
+	return dot(color, float3(0.2126f, 0.7152f, 0.0722f));
+}
+
+//Returns the emitted "strength" of a material or 0 if it is not emissive
+static float GetMaterialEmission(const Material& material) {
+	float emission = Luminance(material.emissiveColor);
+	//Emissive textures override the emissive color in the shader. Assume full strength if no color is set
+	if (material.emissiveTexture && emission <= 0.f)
+		emission = 1.f;
+	return emission;
+}
+
+static void GetLightBounds(const EmissiveLight& light, float3& boundsMin, float3& boundsMax) {
+	float3 p0 = light.origin;
+	float3 p1 = light.origin + light.edge1;
+	float3 p2 = light.origin + light.edge2;
+	boundsMin = min(p0, min(p1, p2));
+	boundsMax = max(p0, max(p1, p2));
+	if ((light.flags & EMISSIVE_LIGHT_FLAG_TRIANGLE) == 0) {
+		float3 p3 = light.origin + light.edge1 + light.edge2;
+		boundsMin = min(boundsMin, p3);
+		boundsMax = max(boundsMax, p3);
+	}
+}
+
+static float GetLightArea(const EmissiveLight& light) {
+	float area = length(cross(light.edge1, light.edge2));
+	return (light.flags & EMISSIVE_LIGHT_FLAG_TRIANGLE) ? area * 0.5f : area;
+}
+
+//Same heuristic as LightTreeNodeImportance in the shader
+static float NodeImportance(const LightTreeNode& node, float3 position) {
+	float3 center = (node.boundsMin + node.boundsMax) * 0.5f;
+	float3 extent = node.boundsMax - node.boundsMin;
+	float3 toCenter = center - position;
+	float distanceSquared = max(dot(toCenter, toCenter), 0.25f * dot(extent, extent));
+	return node.power / max(distanceSquared, 1e-4f);
+}
+
+//Same hash as PcgHash in the shader
+static uint PcgHash(uint v) {
+	uint state = v * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+//Integer key for unit blocks, used to cull faces between two adjacent blocks
+struct BlockKeyHash {
+	size_t operator()(const int3& key) const {
+		return size_t(key.x) * 73856093u ^ size_t(key.y) * 19349663u ^ size_t(key.z) * 83492791u;
+	}
+};
+struct BlockKeyEqual {
+	bool operator()(const int3& a, const int3& b) const { return a.x == b.x && a.y == b.y && a.z == b.z; }
+};
+
+void LightTree::Build(const std::vector<AABB>& aabbs, const std::vector<AABBMaterials>& aabbMaterials, const std::vector<VertexData>& vertices,
+	const std::vector<uint>& indices, const std::vector<int>& triPerFaceMatID, const std::vector<Material>& materials)
+{
+	std::vector<float> materialEmission(materials.size(), 0.f);
+	bool anyEmissive = false;
+	for (size_t i = 0; i < materials.size(); i++) {
+		materialEmission[i] = GetMaterialEmission(materials[i]);
+		anyEmissive |= materialEmission[i] > 0.f;
+	}
+
+	std::vector<EmissiveLight> lights;
+	if (!anyEmissive) {
+		BuildFromLights(std::move(lights));
+		return;
+	}
+
+	auto getEmission = [&](int matID) { return (matID >= 0 && matID < int(materialEmission.size())) ? materialEmission[matID] : 0.f; };
+	auto isOccluder = [&](int matID) { return matID >= 0 && matID < int(materials.size()) && materials[matID].domain == MaterialDomain::Opaque; };
+
+	//Map of all unit blocks to their index, needed to skip emissive faces that are covered by a neighbor
+	std::unordered_map<int3, uint, BlockKeyHash, BlockKeyEqual> unitBlocks;
+	auto isUnitBlock = [](const AABB& aabb) {
+		float3 size = aabb.max - aabb.min;
+		return all(abs(size - float3(1.f)) < float3(1e-4f)) && all(abs(aabb.min - floor(aabb.min + float3(0.5f))) < float3(1e-4f));
+	};
+	auto blockKey = [](const AABB& aabb) { float3 p = floor(aabb.min + float3(0.5f)); return int3(int(p.x), int(p.y), int(p.z)); };
+	for (uint i = 0; i < aabbs.size(); i++) {
+		if (isUnitBlock(aabbs[i]))
+			unitBlocks.emplace(blockKey(aabbs[i]), i);
+	}
+
+	//Face order: -X, +X, -Y, +Y, -Z, +Z
+	const int3 faceOffsets[6] = { int3(-1, 0, 0), int3(1, 0, 0), int3(0, -1, 0), int3(0, 1, 0), int3(0, 0, -1), int3(0, 0, 1) };
+	std::atomic<uint> numCulledFaces = 0;
+
+	//Appends the visible emissive faces of block i
+	auto extractBlockFaces = [&](uint i, std::vector<EmissiveLight>& blockLights) {
+		const AABBMaterials& mats = aabbMaterials[i];
+		const int faceMatIDs[6] = { mats.negXMatID, mats.posXMatID, mats.negYMatID, mats.posYMatID, mats.negZMatID, mats.posZMatID };
+		const int oppositeFace[6] = { 1, 0, 3, 2, 5, 4 };
+		const AABB& aabb = aabbs[i];
+		float3 size = aabb.max - aabb.min;
+		bool unit = isUnitBlock(aabb);
+		int3 key = unit ? blockKey(aabb) : int3(0);
+
+		for (int face = 0; face < 6; face++) {
+			float emission = getEmission(faceMatIDs[face]);
+			if (emission <= 0.f)
+				continue;
+
+			//Skip faces that are hidden behind an opaque neighbor face
+			if (unit) {
+				auto neighbor = unitBlocks.find(key + faceOffsets[face]);
+				if (neighbor != unitBlocks.end()) {
+					const AABBMaterials& nMats = aabbMaterials[neighbor->second];
+					const int nFaceMatIDs[6] = { nMats.negXMatID, nMats.posXMatID, nMats.negYMatID, nMats.posYMatID, nMats.negZMatID, nMats.posZMatID };
+					if (isOccluder(nFaceMatIDs[oppositeFace[face]])) {
+						numCulledFaces++;
+						continue;
+					}
+				}
+			}
+
+			//Edges are ordered so that cross(edge1, edge2) points away from the block
+			EmissiveLight light{};
+			switch (face) {
+			case 0: light.origin = aabb.min; light.edge1 = float3(0, 0, size.z); light.edge2 = float3(0, size.y, 0); break;
+			case 1: light.origin = float3(aabb.max.x, aabb.min.y, aabb.min.z); light.edge1 = float3(0, size.y, 0); light.edge2 = float3(0, 0, size.z); break;
+			case 2: light.origin = aabb.min; light.edge1 = float3(size.x, 0, 0); light.edge2 = float3(0, 0, size.z); break;
+			case 3: light.origin = float3(aabb.min.x, aabb.max.y, aabb.min.z); light.edge1 = float3(0, 0, size.z); light.edge2 = float3(size.x, 0, 0); break;
+			case 4: light.origin = aabb.min; light.edge1 = float3(0, size.y, 0); light.edge2 = float3(size.x, 0, 0); break;
+			default: light.origin = float3(aabb.min.x, aabb.min.y, aabb.max.z); light.edge1 = float3(size.x, 0, 0); light.edge2 = float3(0, size.y, 0); break;
+			}
+			light.matID = faceMatIDs[face];
+			light.flags = 0;
+			light.power = emission * GetLightArea(light);
+			if (light.power > 0.f)
+				blockLights.push_back(light);
+		}
+	};
+
+	//Blocks are processed in parallel ranges. The lights of the ranges are appended in range order, which keeps the result deterministic
+	const uint numRanges = uint((aabbs.size() + k_ExtractGrainSize - 1) / k_ExtractGrainSize);
+	std::vector<std::vector<EmissiveLight>> rangeLights(numRanges);
+	TaskScheduler::Get().ParallelFor(0, numRanges, 1, [&](uint64_t rangeBegin, uint64_t rangeEnd) {
+		for (uint64_t range = rangeBegin; range < rangeEnd; range++) {
+			const uint blockEnd = uint(std::min<uint64_t>(aabbs.size(), (range + 1) * k_ExtractGrainSize));
+			for (uint i = uint(range * k_ExtractGrainSize); i < blockEnd; i++)
+				extractBlockFaces(i, rangeLights[range]);
+		}
+	});
+	for (const std::vector<EmissiveLight>& blockLights : rangeLights)
+		lights.insert(lights.end(), blockLights.begin(), blockLights.end());
+
+	//Emissive triangles (torches, lanterns, ...)
+	for (uint t = 0; t < triPerFaceMatID.size(); t++) {
+		int matID = triPerFaceMatID[t];
+		float emission = getEmission(matID);
+		if (emission <= 0.f)
+			continue;
+
+		float3 p0 = vertices[indices[t * 3 + 0]].position;
+		float3 p1 = vertices[indices[t * 3 + 1]].position;
+		float3 p2 = vertices[indices[t * 3 + 2]].position;
+		EmissiveLight light{};
+		light.origin = p0;
+		light.edge1 = p1 - p0;
+		light.edge2 = p2 - p0;
+		light.matID = matID;
+		light.flags = EMISSIVE_LIGHT_FLAG_TRIANGLE;
+		if (materials[matID].doubleSided)
+			light.flags |= EMISSIVE_LIGHT_FLAG_DOUBLE_SIDED;
+		light.power = emission * GetLightArea(light);
+		if (light.power > 0.f)
+			lights.push_back(light);
+	}
+
+	log::info("LightTree: %u emissive lights extracted (%u hidden faces skipped)", uint(lights.size()), numCulledFaces.load());
+
+	BuildFromLights(std::move(lights));
+}
+
+void LightTree::BuildFromLights(std::vector<EmissiveLight> lights, TaskScheduler* scheduler)
+{
+	m_Nodes.clear();
+	m_Lights = std::move(lights);
+	if (m_Lights.empty())
+		return;
+
+	m_Centroids.resize(m_Lights.size());
+	for (size_t i = 0; i < m_Lights.size(); i++) {
+		float3 bMin, bMax;
+		GetLightBounds(m_Lights[i], bMin, bMax);
+		m_Centroids[i] = (bMin + bMax) * 0.5f;
+	}
+
+	//The order array is partitioned while building. Leafs store their position in it
+	m_Order.resize(m_Lights.size());
+	for (uint i = 0; i < m_Order.size(); i++)
+		m_Order[i] = i;
+
+	//A binary tree with one light per leaf always has 2n - 1 nodes, which allows to place every subtree at a fixed
+	//offset and build them in parallel
+	m_Nodes.resize(2 * m_Lights.size() - 1);
+	m_Scheduler = scheduler;
+	BuildRecursive(0, 0, uint(m_Lights.size()), 1);
+	m_Scheduler = nullptr;
+
+	//Store the lights in leaf order, so that lights close in the tree are close in memory
+	std::vector<EmissiveLight> orderedLights(m_Lights.size());
+	for (size_t i = 0; i < m_Order.size(); i++)
+		orderedLights[i] = m_Lights[m_Order[i]];
+	m_Lights = std::move(orderedLights);
+
+	m_Order.clear();
+	m_Order.shrink_to_fit();
+	m_Centroids.clear();
+	m_Centroids.shrink_to_fit();
+}
+
+void LightTree::BuildRecursive(uint nodeIndex, uint begin, uint end, uint childBase)
+{
+	//Leaf
+	if (end - begin == 1) {
+		LightTreeNode& node = m_Nodes[nodeIndex];
+		const EmissiveLight& light = m_Lights[m_Order[begin]];
+		GetLightBounds(light, node.boundsMin, node.boundsMax);
+		node.power = light.power;
+		node.childOrLight = begin | LIGHT_TREE_LEAF_FLAG;
+		return;
+	}
+
+	//Split at the median of the longest centroid axis
+	float3 cMin = float3(std::numeric_limits<float>::max());
+	float3 cMax = float3(-std::numeric_limits<float>::max());
+	for (uint i = begin; i < end; i++) {
+		cMin = min(cMin, m_Centroids[m_Order[i]]);
+		cMax = max(cMax, m_Centroids[m_Order[i]]);
+	}
+	float3 extent = cMax - cMin;
+	int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+	uint mid = begin + (end - begin) / 2;
+	std::nth_element(m_Order.begin() + begin, m_Order.begin() + mid, m_Order.begin() + end,
+		[&](uint a, uint b) { return m_Centroids[a][axis] < m_Centroids[b][axis]; });
+
+	//Left subtree has (mid - begin) leafs and therefore 2 * (mid - begin) - 2 descendants
+	uint left = childBase;
+	uint right = childBase + 1;
+	uint leftChildBase = childBase + 2;
+	uint rightChildBase = leftChildBase + 2 * (mid - begin) - 2;
+
+	if (m_Scheduler && end - begin > k_ParallelBuildThreshold) {
+		TaskGroup group;
+		m_Scheduler->Run(group, [=]() { BuildRecursive(left, begin, mid, leftChildBase); });
+		BuildRecursive(right, mid, end, rightChildBase);
+		m_Scheduler->Wait(group);
+	}
+	else {
+		BuildRecursive(left, begin, mid, leftChildBase);
+		BuildRecursive(right, mid, end, rightChildBase);
+	}
+
+	LightTreeNode& parent = m_Nodes[nodeIndex];
+	parent.boundsMin = min(m_Nodes[left].boundsMin, m_Nodes[right].boundsMin);
+	parent.boundsMax = max(m_Nodes[left].boundsMax, m_Nodes[right].boundsMax);
+	parent.power = m_Nodes[left].power + m_Nodes[right].power;
+	parent.childOrLight = left;
+}
+
+void LightTree::Clear()
+{
+	m_Lights.clear();
+	m_Nodes.clear();
+}
+
+bool LightTree::SampleLight(float3 position, uint& rngState, uint& lightIndex, float& pdf) const
+{
+	pdf = 1.f;
+	lightIndex = 0;
+	uint nodeIndex = 0;
+	for (uint depth = 0; depth < k_MaxTraversalDepth && nodeIndex < m_Nodes.size(); depth++) {
+		uint childOrLight = m_Nodes[nodeIndex].childOrLight;
+		if (childOrLight & LIGHT_TREE_LEAF_FLAG) {
+			lightIndex = childOrLight & ~LIGHT_TREE_LEAF_FLAG;
+			return true;
+		}
+
+		float importanceLeft = NodeImportance(m_Nodes[childOrLight], position);
+		float importanceRight = NodeImportance(m_Nodes[childOrLight + 1], position);
+		float total = importanceLeft + importanceRight;
+		if (total <= 0.f)
+			return false;
+
+		float probLeft = importanceLeft / total;
+		if (NextRandom(rngState) < probLeft) {
+			nodeIndex = childOrLight;
+			pdf *= probLeft;
+		}
+		else {
+			nodeIndex = childOrLight + 1;
+			pdf *= 1.f - probLeft;
+		}
+	}
+	return false;
+}
+
+uint LightTree::InitRandomSeed(uint2 pixel, uint frameIndex)
+{
+	return PcgHash(pixel.x + PcgHash(pixel.y + PcgHash(frameIndex)));
+}
+
+float LightTree::NextRandom(uint& state)
+{
+	state = PcgHash(state);
+	return float(state >> 8) * (1.f / 16777216.f);
+}
+
+float LightTree::GetLightPdf(float3 position, uint lightIndex) const
+{
+	if (lightIndex >= m_Lights.size())
+		return 0.f;
+
+	//Every inner node splits its light range at the middle, as in BuildRecursive, which gives the path to the leaf of the light
+	float pdf = 1.f;
+	uint nodeIndex = 0;
+	uint begin = 0;
+	uint end = uint(m_Lights.size());
+	while ((m_Nodes[nodeIndex].childOrLight & LIGHT_TREE_LEAF_FLAG) == 0) {
+		uint left = m_Nodes[nodeIndex].childOrLight;
+		float importanceLeft = NodeImportance(m_Nodes[left], position);
+		float importanceRight = NodeImportance(m_Nodes[left + 1], position);
+		float total = importanceLeft + importanceRight;
+		if (total <= 0.f)
+			return 0.f;
+
+		uint mid = begin + (end - begin) / 2;
+		if (lightIndex < mid) {
+			nodeIndex = left;
+			pdf *= importanceLeft / total;
+			end = mid;
+		}
+		else {
+			nodeIndex = left + 1;
+			pdf *= 1.f - importanceLeft / total;
+			begin = mid;
+		}
+	}
+	return pdf;
+}
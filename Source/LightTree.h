@@ -0,0 +1,50 @@
+#pragma once
+#include <donut/engine/SceneTypes.h>
+#include <donut/core/math/math.h>
+#include <vector>
+#include "TaskScheduler.h"
+
+using namespace donut::math;
+#include "sharedShaderData.h" //Needs namespace donut::math;
+
+/* Light BVH (light tree) over all emissive block faces and triangles of a scene.
+   Every node stores the bounds and the summed power of its subtree, which allows stochastic
+   light selection with logarithmic cost per sample (see SampleLightTree in RaytraceWorld_rt.hlsl)
+*/
+class LightTree {
+public:
+	//Extracts all emissive surfaces of the scene and builds the tree over them
+	void Build(const std::vector<AABB>& aabbs, const std::vector<AABBMaterials>& aabbMaterials, const std::vector<VertexData>& vertices,
+		const std::vector<uint>& indices, const std::vector<int>& triPerFaceMatID, const std::vector<donut::engine::Material>& materials);
+
+	//Builds the tree over an already extracted light list. Large subtrees are built as tasks of the scheduler, a null scheduler
+	//builds on the calling thread. The tree does not depend on the scheduler
+	void BuildFromLights(std::vector<EmissiveLight> lights, TaskScheduler* scheduler = &TaskScheduler::Get());
+
+	void Clear();
+
+	//Selects a light proportional to the node importance at the given position. Draws one random number per level from rngState
+	//like SampleLightTree in the shader, so the same state selects the same light
+	bool SampleLight(float3 position, uint& rngState, uint& lightIndex, float& pdf) const;
+	//Probability of SampleLight to select the light (index into GetLights) at the given position
+	float GetLightPdf(float3 position, uint lightIndex) const;
+
+	const std::vector<EmissiveLight>& GetLights() const { return m_Lights; }
+	const std::vector<LightTreeNode>& GetNodes() const { return m_Nodes; }
+	uint GetNumLights() const { return uint(m_Lights.size()); }
+	float GetTotalPower() const { return m_Nodes.empty() ? 0.f : m_Nodes[0].power; }
+
+	//Random numbers of the shader (InitRandomSeed and NextRandom in RaytraceWorld_rt.hlsl)
+	static uint InitRandomSeed(uint2 pixel, uint frameIndex);
+	static float NextRandom(uint& state);
+
+private:
+	//Builds the subtree for the light range [begin,end) into node nodeIndex. The children of the node are placed at childBase
+	void BuildRecursive(uint nodeIndex, uint begin, uint end, uint childBase);
+
+	std::vector<EmissiveLight> m_Lights;
+	std::vector<LightTreeNode> m_Nodes;		//2 * numLights - 1 nodes, root is node 0
+	std::vector<float3> m_Centroids;		//Temporary light centroids used while building
+	std::vector<uint> m_Order;				//Temporary light order, partitioned while building
+	TaskScheduler* m_Scheduler = nullptr;	//Scheduler of the running build
+};
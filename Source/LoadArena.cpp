@@ -0,0 +1,67 @@
+#include "LoadArena.h"
+#include <chrono>
+
+LoadArena::LoadArena()
+	: m_Buffer(k_InitialChunkBytes, &m_Chunks)
+{
+}
+
+LoadArena::Stats LoadArena::Release()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto start = std::chrono::high_resolution_clock::now();
+	m_Buffer.release();
+	m_Chunks.allocatorMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	Stats stats;
+	stats.numAllocations = m_NumAllocations.exchange(0);
+	stats.allocatedBytes = m_AllocatedBytes.exchange(0);
+	stats.numChunks = m_Chunks.numChunks;
+	stats.chunkBytes = m_Chunks.chunkBytes;
+	stats.allocatorMs = m_Chunks.allocatorMs;
+	m_Chunks.numChunks = 0;
+	m_Chunks.chunkBytes = 0;
+	m_Chunks.allocatorMs = 0.0;
+	return stats;
+}
+
+LoadArena::Stats LoadArena::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	Stats stats;
+	stats.numAllocations = m_NumAllocations;
+	stats.allocatedBytes = m_AllocatedBytes;
+	stats.numChunks = m_Chunks.numChunks;
+	stats.chunkBytes = m_Chunks.chunkBytes;
+	stats.allocatorMs = m_Chunks.allocatorMs;
+	return stats;
+}
+
+void* LoadArena::do_allocate(size_t bytes, size_t alignment)
+{
+	m_NumAllocations.fetch_add(1, std::memory_order_relaxed);
+	m_AllocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Buffer.allocate(bytes, alignment);
+}
+
+void LoadArena::do_deallocate(void*, size_t, size_t)
+{
+	//Freed with the chunks in Release
+}
+
+void* LoadArena::ChunkResource::do_allocate(size_t bytes, size_t alignment)
+{
+	//Called by the monotonic buffer while the arena is locked
+	auto start = std::chrono::high_resolution_clock::now();
+	void* pointer = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	allocatorMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	numChunks++;
+	chunkBytes += bytes;
+	return pointer;
+}
+
+void LoadArena::ChunkResource::do_deallocate(void* pointer, size_t bytes, size_t alignment)
+{
+	std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+}
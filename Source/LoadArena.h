@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+
+/* Memory resource for the temporaries of a scene load, used through std::pmr containers.
+   Allocations are carved from a few large chunks and never freed one by one; Release frees all of them at once at the end of the load.
+   Allocation is thread-safe, so tasks of the TaskScheduler can use the arena of their load. Containers that outlive the load must not use it
+*/
+class LoadArena : public std::pmr::memory_resource {
+public:
+	struct Stats {
+		uint64_t numAllocations = 0;	//Allocations served by the arena
+		uint64_t allocatedBytes = 0;
+		uint64_t numChunks = 0;			//Allocations of the arena from the heap
+		uint64_t chunkBytes = 0;
+		double allocatorMs = 0.0;		//Time spent in the chunk allocations and in Release, single allocations are not timed
+	};
+
+	LoadArena();
+	LoadArena(const LoadArena&) = delete;
+	LoadArena& operator=(const LoadArena&) = delete;
+
+	//Frees all chunks, invalidating every allocation. Returns the statistics of the load and resets them
+	Stats Release();
+	Stats GetStats();
+
+protected:
+	void* do_allocate(size_t bytes, size_t alignment) override;
+	void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+private:
+	//Counts the chunk allocations of the monotonic buffer
+	class ChunkResource : public std::pmr::memory_resource {
+	public:
+		uint64_t numChunks = 0;
+		uint64_t chunkBytes = 0;
+		double allocatorMs = 0.0;
+	protected:
+		void* do_allocate(size_t bytes, size_t alignment) override;
+		void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+	};
+
+	//The first chunk, following chunks grow geometrically
+	static const size_t k_InitialChunkBytes = size_t(1) << 20;
+
+	//Only guards the monotonic buffer, the counters are updated outside of the lock
+	std::mutex m_Mutex;
+	ChunkResource m_Chunks;
+	std::pmr::monotonic_buffer_resource m_Buffer;
+	std::atomic<uint64_t> m_NumAllocations = 0;
+	std::atomic<uint64_t> m_AllocatedBytes = 0;
+};
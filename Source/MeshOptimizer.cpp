@@ -0,0 +1,162 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+
+//Scoring constants from "Linear-Speed Vertex Cache Optimisation" by Tom Forsyth (2006)
+static const float k_CacheDecayPower = 1.5f;
+static const float k_LastTriangleScore = 0.75f;
+static const float k_ValenceBoostScale = 2.0f;
+static const float k_ValenceBoostPower = 0.5f;
+
+static float GetVertexScore(int cachePosition, uint remainingTriangles) {
+	if (remainingTriangles == 0)
+		return -1.f;
+
+	float score = 0.f;
+	if (cachePosition >= 0) {
+		//The vertices of the last triangle get a fixed score, so that the next triangle does not reuse all of them
+		if (cachePosition < 3)
+			score = k_LastTriangleScore;
+		else
+			score = std::pow(1.f - float(cachePosition - 3) / float(MeshOptimizer::k_CacheSize - 3), k_CacheDecayPower);
+	}
+	//Vertices with few remaining triangles are preferred to finish them off
+	score += k_ValenceBoostScale * std::pow(float(remainingTriangles), -k_ValenceBoostPower);
+	return score;
+}
+
+std::vector<uint> MeshOptimizer::OptimizeVertexCache(const uint* indices, uint numTriangles, uint numVertices)
+{
+	std::vector<uint> order;
+	order.reserve(numTriangles);
+	if (numTriangles == 0)
+		return order;
+
+	//Triangles adjacent to each vertex. The first remainingTriangles[v] entries are the ones not emitted yet
+	std::vector<uint> adjacencyOffset(numVertices + 1, 0);
+	for (uint i = 0; i < numTriangles * 3; i++)
+		adjacencyOffset[indices[i] + 1]++;
+	for (uint v = 0; v < numVertices; v++)
+		adjacencyOffset[v + 1] += adjacencyOffset[v];
+	std::vector<uint> adjacency(numTriangles * 3);
+	std::vector<uint> remainingTriangles(numVertices, 0);
+	for (uint triangle = 0; triangle < numTriangles; triangle++) {
+		for (uint k = 0; k < 3; k++) {
+			uint vertex = indices[triangle * 3 + k];
+			adjacency[adjacencyOffset[vertex] + remainingTriangles[vertex]++] = triangle;
+		}
+	}
+
+	std::vector<int> cachePosition(numVertices, -1);
+	std::vector<float> vertexScore(numVertices);
+	for (uint v = 0; v < numVertices; v++)
+		vertexScore[v] = GetVertexScore(-1, remainingTriangles[v]);
+	std::vector<bool> emitted(numTriangles, false);
+
+	std::vector<uint> cache;
+	std::vector<uint> newCache;
+	cache.reserve(k_CacheSize + 3);
+	newCache.reserve(k_CacheSize + 3);
+	uint nextTriangle = 0;
+	int bestTriangle = -1;
+	while (order.size() < numTriangles) {
+		//Nothing in the cache, continue with the next triangle of the input order
+		if (bestTriangle < 0) {
+			while (emitted[nextTriangle])
+				nextTriangle++;
+			bestTriangle = int(nextTriangle);
+		}
+
+		const uint* triangleIndices = &indices[bestTriangle * 3];
+		emitted[bestTriangle] = true;
+		order.push_back(uint(bestTriangle));
+
+		//Remove the triangle from the remaining adjacency of its vertices
+		for (uint k = 0; k < 3; k++) {
+			uint vertex = triangleIndices[k];
+			uint* vertexTriangles = &adjacency[adjacencyOffset[vertex]];
+			uint last = --remainingTriangles[vertex];
+			for (uint i = 0; i <= last; i++) {
+				if (vertexTriangles[i] == uint(bestTriangle)) {
+					std::swap(vertexTriangles[i], vertexTriangles[last]);
+					break;
+				}
+			}
+		}
+
+		//Move the vertices of the triangle to the front of the LRU cache
+		newCache.assign(triangleIndices, triangleIndices + 3);
+		for (uint vertex : cache) {
+			if (vertex != triangleIndices[0] && vertex != triangleIndices[1] && vertex != triangleIndices[2])
+				newCache.push_back(vertex);
+		}
+		for (size_t i = 0; i < newCache.size(); i++) {
+			uint vertex = newCache[i];
+			cachePosition[vertex] = i < k_CacheSize ? int(i) : -1;
+			vertexScore[vertex] = GetVertexScore(cachePosition[vertex], remainingTriangles[vertex]);
+		}
+
+		//Score the triangles around the cache and pick the best one
+		bestTriangle = -1;
+		float bestScore = -1.f;
+		for (size_t i = 0; i < std::min(newCache.size(), size_t(k_CacheSize)); i++) {
+			uint vertex = newCache[i];
+			for (uint j = 0; j < remainingTriangles[vertex]; j++) {
+				uint triangle = adjacency[adjacencyOffset[vertex] + j];
+				float score = vertexScore[indices[triangle * 3]] + vertexScore[indices[triangle * 3 + 1]] + vertexScore[indices[triangle * 3 + 2]];
+				if (score > bestScore) {
+					bestScore = score;
+					bestTriangle = int(triangle);
+				}
+			}
+		}
+
+		if (newCache.size() > k_CacheSize)
+			newCache.resize(k_CacheSize);
+		cache.swap(newCache);
+	}
+	return order;
+}
+
+std::vector<uint> MeshOptimizer::OptimizeVertexFetch(uint* indices, size_t numIndices, uint numVertices)
+{
+	const uint unassigned = ~0u;
+	std::vector<uint> newIndex(numVertices, unassigned);
+	std::vector<uint> order;
+	for (size_t i = 0; i < numIndices; i++) {
+		uint& index = indices[i];
+		if (newIndex[index] == unassigned) {
+			newIndex[index] = uint(order.size());
+			order.push_back(index);
+		}
+		index = newIndex[index];
+	}
+	return order;
+}
+
+MeshOptimizer::VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const uint* indices, size_t numIndices, uint numVertices, uint cacheSize)
+{
+	VertexCacheStats stats;
+	if (numIndices < 3)
+		return stats;
+
+	//A vertex is in the FIFO if it was added less than cacheSize misses ago
+	std::vector<uint64_t> addedAt(numVertices, 0);
+	std::vector<bool> referenced(numVertices, false);
+	uint64_t misses = 0;
+	uint numReferenced = 0;
+	for (size_t i = 0; i < numIndices; i++) {
+		uint vertex = indices[i];
+		if (!referenced[vertex]) {
+			referenced[vertex] = true;
+			numReferenced++;
+		}
+		if (addedAt[vertex] == 0 || misses - addedAt[vertex] >= cacheSize) {
+			misses++;
+			addedAt[vertex] = misses;
+		}
+	}
+	stats.acmr = double(misses) / double(numIndices / 3);
+	stats.atvr = double(misses) / double(std::max(numReferenced, 1u));
+	return stats;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <vector>
+
+using namespace donut::math;
+
+/* Triangle order optimization for the post transform vertex cache and vertex fetch locality
+*/
+namespace MeshOptimizer {
+	static const uint k_CacheSize = 32;			//LRU cache size assumed by OptimizeVertexCache
+	static const uint k_AnalyzeCacheSize = 16;	//FIFO cache size used for the reported metrics
+
+	struct VertexCacheStats {
+		double acmr = 0.0;		//Average cache miss ratio, transformed vertices per triangle (0.5 - 3)
+		double atvr = 0.0;		//Average transformed vertex ratio, transformed vertices per referenced vertex (>= 1)
+	};
+
+	//Linear-speed vertex cache optimization (Forsyth 2006). Indices are local, all in [0, numVertices).
+	//Returns the new triangle order, order[i] is the old index of the i-th triangle
+	std::vector<uint> OptimizeVertexCache(const uint* indices, uint numTriangles, uint numVertices);
+
+	//Renumbers the vertices in order of their first use and rewrites the indices.
+	//Returns the vertex order, order[i] is the old index of the new vertex i. Unreferenced vertices are dropped
+	std::vector<uint> OptimizeVertexFetch(uint* indices, size_t numIndices, uint numVertices);
+
+	//Simulates a FIFO vertex cache
+	VertexCacheStats AnalyzeVertexCache(const uint* indices, size_t numIndices, uint numVertices, uint cacheSize = k_AnalyzeCacheSize);
+}
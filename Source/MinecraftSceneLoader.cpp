@@ -4,10 +4,24 @@
 #include <nvrhi/utils.h>
 #include <donut/core/log.h>
 #include <limits>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <chrono>
 #include <donut/shaders/material_cb.h>
+#include "TaskScheduler.h"
+#include "SpatialSort.h"
+#include "MeshOptimizer.h"
+#include "VoxelReconstruction.h"
+#include "AnvilImporter.h"
+#include "SceneArchive.h"
+#include "PngReader.h"
 
 using namespace donut;
 
+//Shapes per task when computing the block bounds
+static const uint64_t k_ShapeGrainSize = 4096;
+
 //Hash defines needed for optimized Vertices
 inline void hash_combine(size_t& seed, size_t hash) {
     hash += 0x9e3779b9 + (seed << 6) + (seed >> 2);
@@ -40,7 +54,356 @@ namespace std {
 }
 
 bool MinecraftSceneLoader::LoadScene(std::filesystem::path scenePath, std::string sceneName, nvrhi::IDevice* device, nvrhi::CommandListHandle commandList, 
-    std::shared_ptr<TextureCache>& pTextureCache, std::shared_ptr<DescriptorTableManager>& descriptorTable)
+    std::shared_ptr<TextureCache>& pTextureCache, std::shared_ptr<DescriptorTableManager>& descriptorTable, const TextureLoadSettings& textureSettings)
+{
+    std::vector<tinyobj::material_t> materials;
+    std::vector<uint> materialSourceIndices;
+
+    //The CPU stages run on the task scheduler. Everything that records into the command list runs on this thread, as soon as its inputs are ready
+    TaskGraph graph;
+    const TaskGraph::Affinity mainThread = TaskGraph::Affinity::MainThread;
+    PrepareTasks prepare = AddPrepareTasks(graph, scenePath, sceneName, materials, materialSourceIndices);
+
+    //Eager textures are decoded while the geometry is prepared and uploaded by the cache, the materials then take them from the cache
+    std::vector<TaskGraph::TaskID> materialDependencies = { prepare.materials };
+    if (!textureSettings.lazy && textureSettings.commonPasses) {
+        TaskGraph::TaskID decode = graph.Add("texture decode", [&]() { DecodeMaterialTextures(materials, materialSourceIndices, *pTextureCache); },
+            { prepare.materials });
+        materialDependencies.push_back(graph.Add("texture upload", [&]() { pTextureCache->ProcessRenderingThreadCommands(*textureSettings.commonPasses, 0.f); },
+            { decode }, mainThread));
+    }
+    TaskGraph::TaskID materialsTask = graph.Add("materials", [&]() {
+        AddMaterialsToScene(materials, materialSourceIndices, device, commandList, pTextureCache, descriptorTable, scenePath, textureSettings);
+    }, materialDependencies, mainThread);
+    graph.Add("material buffers", [&]() { CreateMaterialsBuffers(device, commandList); }, { materialsTask }, mainThread);
+
+    TaskGraph::TaskID geometryBuffers = graph.Add("geometry buffers", [&]() { CreateGeometryBuffers(device, commandList); }, { prepare.geometry }, mainThread);
+    graph.Add("occupancy buffers", [&]() { CreateOccupancyGridBuffers(device, commandList); }, { prepare.occupancy }, mainThread);
+
+    //The light tree needs the emissive colors of the materials and the final order of the primitives
+    TaskGraph::TaskID lightTree = graph.Add("light tree", [this]() { BuildLightTree(); }, { materialsTask, prepare.geometry });
+    graph.Add("light buffers", [&]() { CreateEmissiveLightBuffers(device, commandList); }, { lightTree }, mainThread);
+
+    graph.Add("acceleration structures", [&]() { CreateAccelerationStructure(device, commandList); }, { geometryBuffers }, mainThread);
+
+    graph.Run();
+    m_LoadReport = graph.GetReport();
+    TaskGraph::LogReport("LoadScene", m_LoadReport);
+    ReleaseLoadArena();
+    if (graph.IsCancelled())
+        return false;
+
+    m_sceneIsLoaded = true;
+    return true;
+}
+
+bool MinecraftSceneLoader::PrepareScene(const std::filesystem::path& scenePath, const std::string& sceneName, std::vector<tinyobj::material_t>& materials,
+    std::vector<uint>& materialSourceIndices)
+{
+    bool prepared = PrepareSceneData(scenePath, sceneName, materials, materialSourceIndices);
+    ReleaseLoadArena();
+    return prepared;
+}
+
+bool MinecraftSceneLoader::LoadSceneWithoutDevice(const std::filesystem::path& scenePath, const std::string& sceneName)
+{
+    std::vector<tinyobj::material_t> materials;
+    std::vector<uint> materialSourceIndices;
+    bool prepared = PrepareSceneData(scenePath, sceneName, materials, materialSourceIndices);
+    if (prepared) {
+        TextureLoadSettings textureSettings;
+        textureSettings.lazy = true;
+        AddLazyMaterialsToScene(materials, materialSourceIndices, nullptr, scenePath, textureSettings);
+    }
+    ReleaseLoadArena();
+    return prepared;
+}
+
+void MinecraftSceneLoader::ReleaseLoadArena()
+{
+    LoadArena::Stats stats = m_LoadArena.Release();
+    log::info("MinecraftSceneLoader: %llu temporary allocations (%.1f MB) in %llu chunks, %.1f ms in the allocator",
+        (unsigned long long)stats.numAllocations, double(stats.allocatedBytes) / (1024.0 * 1024.0), (unsigned long long)stats.numChunks, stats.allocatorMs);
+    if (m_ArenaCallback)
+        m_ArenaCallback(stats);
+}
+
+MinecraftSceneLoader::PrepareTasks MinecraftSceneLoader::AddPrepareTasks(TaskGraph& graph, const std::filesystem::path& scenePath,
+    const std::string& sceneName, std::vector<tinyobj::material_t>& materials, std::vector<uint>& materialSourceIndices)
+{
+    TaskGraph::TaskID read = graph.Add("read scene", [&]() {
+        //Minecraft world folders are imported from their region files, archives are decoded, everything else is a Mineways .obj
+        bool added;
+        if (AnvilImporter::IsWorldFolder(scenePath / sceneName))
+            added = AddAnvilWorldToScene(scenePath, sceneName, materials);
+        else if (SceneArchive::IsArchive(sceneName))
+            added = AddArchiveToScene(scenePath / sceneName, materials);
+        else
+            added = AddObjToScene(scenePath / sceneName, materials);
+        if (!added) {
+            graph.Cancel();
+            return;
+        }
+        //Before the materials are resolved, so that materials only used outside the region are dropped
+        ClipToLoadRegion();
+
+        if (materials.empty()) {
+            log::warning("No Materials found. Abort scene loading");
+            graph.Cancel();
+        }
+    });
+
+    PrepareTasks tasks;
+    //Only materials that are referenced by geometry and not a duplicate are added to the scene
+    tasks.materials = graph.Add("deduplicate materials", [&]() {
+        NotifyStage(LoadStage::Materials, false);
+        materialSourceIndices = DeduplicateMaterials(materials);
+        NotifyStage(LoadStage::Materials, true);
+    }, { read });
+
+    //Remaps the material IDs of the primitives as well, so it runs after the deduplication
+    TaskGraph::TaskID sort = graph.Add("spatial sort", [this]() {
+        NotifyStage(LoadStage::Buffers, false);
+        SortPrimitivesSpatially();
+    }, { tasks.materials });
+    //The mesh optimization only reorders the triangles, the occupancy grid only reads the blocks
+    tasks.geometry = graph.Add("mesh optimization", [this]() { OptimizeTriangleMesh(); }, { sort });
+    tasks.occupancy = graph.Add("occupancy grid", [this]() { m_OccupancyGrid.Build(m_AABBs); }, { sort });
+    graph.Add("buffers prepared", [this]() { NotifyStage(LoadStage::Buffers, true); }, { tasks.geometry, tasks.occupancy });
+    return tasks;
+}
+
+bool MinecraftSceneLoader::PrepareSceneData(const std::filesystem::path& scenePath, const std::string& sceneName, std::vector<tinyobj::material_t>& materials,
+    std::vector<uint>& materialSourceIndices)
+{
+    TaskGraph graph;
+    AddPrepareTasks(graph, scenePath, sceneName, materials, materialSourceIndices);
+    graph.Run();
+    m_LoadReport = graph.GetReport();
+    TaskGraph::LogReport("PrepareScene", m_LoadReport);
+    return !graph.IsCancelled();
+}
+
+const char* MinecraftSceneLoader::GetStageName(LoadStage stage)
+{
+    switch (stage) {
+    case LoadStage::Parse: return "parse";
+    case LoadStage::Geometry: return "geometry";
+    case LoadStage::Materials: return "materials";
+    case LoadStage::Buffers: return "buffers";
+    }
+    return "";
+}
+
+void MinecraftSceneLoader::UpdateTextureResidency(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList, std::shared_ptr<TextureCache>& pTextureCache,
+    std::shared_ptr<DescriptorTableManager>& descriptorTable, uint64_t budgetBytes)
+{
+    if (!m_TextureResidency)
+        return;
+
+    auto createMetalRough = [&](nvrhi::TextureHandle roughness, nvrhi::TextureHandle metallic, bool convertShininessToRoughness) {
+        if (!m_ComputeHandle)
+            InitMetalRoughTexGenCS(device);
+        return CreateMetalRoughTextures(device, commandList, descriptorTable, roughness, metallic, convertShininessToRoughness);
+    };
+    std::vector<uint> changedMaterials = m_TextureResidency->Update(device, m_Materials, pTextureCache, createMetalRough, budgetBytes);
+
+    //Only the constants of the changed materials are uploaded
+    if (!changedMaterials.empty())
+        m_MaterialVersion++;
+    for (uint materialID : changedMaterials) {
+        MaterialConstants constants;
+        m_Materials[materialID].FillConstantBuffer(constants);
+        commandList->writeBuffer(m_MaterialBuffer, &constants, sizeof(MaterialConstants), sizeof(MaterialConstants) * materialID);
+    }
+}
+
+void MinecraftSceneLoader::RecordTextureFeedback(nvrhi::ICommandList* commandList)
+{
+    if (m_TextureResidency)
+        m_TextureResidency->RecordFeedback(commandList, m_MaterialFeedbackBuffer);
+}
+
+bool MinecraftSceneLoader::SetBlock(int3 cell, int materialID)
+{
+    return SetBlock(cell, BlockEditor::GetUniformMaterials(materialID));
+}
+
+bool MinecraftSceneLoader::SetBlock(int3 cell, const AABBMaterials& materials)
+{
+    if (!m_sceneIsLoaded)
+        return false;
+    for (int face = 0; face < BlockEditor::NumFaces; face++) {
+        int materialID = BlockEditor::GetFaceMaterial(materials, BlockEditor::Face(face));
+        if (!IsValidMaterialID(materialID)) {
+            log::warning("SetBlock: invalid material ID %d", materialID);
+            return false;
+        }
+    }
+    if (!GetOrCreateBlockEditor().SetBlock(cell, materials))
+        return false;
+    MarkOccupiedCell(cell);
+    m_BlockRebuildPending = true;
+    return true;
+}
+
+bool MinecraftSceneLoader::RemoveBlock(int3 cell)
+{
+    if (!m_sceneIsLoaded || !GetOrCreateBlockEditor().RemoveBlock(cell))
+        return false;
+    //The occupancy grid keeps the cell until the batch rebuild, which only costs empty space skipping
+    m_BlockRebuildPending = true;
+    return true;
+}
+
+bool MinecraftSceneLoader::SetBlockFaceMaterial(int3 cell, BlockEditor::Face face, int materialID)
+{
+    if (!m_sceneIsLoaded)
+        return false;
+    if (!IsValidMaterialID(materialID)) {
+        log::warning("SetBlockFaceMaterial: invalid material ID %d", materialID);
+        return false;
+    }
+    if (!GetOrCreateBlockEditor().SetFaceMaterial(cell, face, materialID))
+        return false;
+    m_BlockRebuildPending = true;
+    return true;
+}
+
+bool MinecraftSceneLoader::IsBlockOccupied(int3 cell) const
+{
+    if (m_BlockEditor)
+        return m_BlockEditor->IsOccupied(cell);
+    //Before the first edit the grid holds exactly the cells covered by boxes, it only gets conservative when blocks are removed
+    return m_OccupancyGrid.IsOccupied(cell);
+}
+
+bool MinecraftSceneLoader::HasPendingBlockEdits() const
+{
+    return m_BlockEditor && (m_BlockEditor->HasDirtySlots() || m_BlockRebuildPending);
+}
+
+MinecraftSceneLoader::BlockEditUpdate MinecraftSceneLoader::ApplyBlockEdits(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList)
+{
+    BlockEditUpdate update;
+    if (!m_BlockEditor)
+        return update;
+    auto applyStart = std::chrono::high_resolution_clock::now();
+
+    bool grown = m_BlockEditor->TakeGrown();
+    std::vector<BlockEditor::SlotRange> ranges = m_BlockEditor->TakeDirtyRanges();
+    uint numChangedSlots = 0;
+    for (const BlockEditor::SlotRange& range : ranges)
+        numChangedSlots += range.count;
+    bool edited = grown || !ranges.empty();
+    m_BlockEditIdleFrames = edited ? 0 : m_BlockEditIdleFrames + 1;
+    update.batchRebuild = !edited && m_BlockRebuildPending && m_BlockEditIdleFrames >= k_IdleFramesBeforeRebuild;
+    if (!edited && !update.batchRebuild)
+        return update;
+    m_sceneStats.numAABBs = int(m_BlockEditor->GetStats().numUsedSlots);
+
+    //Slots, grown arrays are uploaded as a whole into new buffers
+    if (grown) {
+        for (uint i = uint(m_AABBOrder.size()); !m_AABBOrder.empty() && i < m_AABBs.size(); i++)
+            m_AABBOrder.push_back(i);
+        CreateBlockBuffers(device, commandList);
+        update.numSlots = uint(m_AABBs.size());
+        update.numUploads += 2;
+        update.uploadBytes += m_AABBs.size() * (sizeof(AABB) + sizeof(AABBMaterials));
+        update.buffersChanged = true;
+    }
+    else {
+        for (const BlockEditor::SlotRange& range : ranges) {
+            commandList->writeBuffer(m_AABBBuffer, &m_AABBs[range.first], sizeof(AABB) * range.count, sizeof(AABB) * range.first);
+            commandList->writeBuffer(m_AABBMaterialIDBuffer, &m_AABBMaterials[range.first], sizeof(AABBMaterials) * range.count,
+                sizeof(AABBMaterials) * range.first);
+            update.numSlots += range.count;
+            update.numUploads += 2;
+            update.uploadBytes += range.count * (sizeof(AABB) + sizeof(AABBMaterials));
+        }
+    }
+
+    //Occupancy grid, placed blocks were marked by MarkOccupiedCell. The batch rebuild also clears the removed ones
+    if (update.batchRebuild || m_OccupancyGridOutdated)
+        m_OccupancyGrid.Build(m_AABBs);
+    if (update.batchRebuild || m_OccupancyGridOutdated || m_OccupancyBuffersDirty) {
+        CreateOccupancyGridBuffers(device, commandList);
+        update.numUploads += 2;
+        update.uploadBytes += m_OccupancyGrid.GetByteSize();
+        update.buffersChanged = true;
+    }
+    else {
+        for (uint brick : m_DirtyOccupancyBricks) {
+            commandList->writeBuffer(m_OccupancyBrickBuffer, &m_OccupancyGrid.GetBricks()[brick], sizeof(uint64_t), sizeof(uint64_t) * brick);
+            update.numUploads++;
+            update.uploadBytes += sizeof(uint64_t);
+        }
+    }
+    m_DirtyOccupancyBricks.clear();
+    m_OccupancyBuffersDirty = false;
+    m_OccupancyGridOutdated = false;
+
+    //Block BLAS: refit for small edits, the refits degrade the BVH, so it is rebuilt after many refit slots and after the edits stopped.
+    //A grown array or the compacted BLAS of the load need a new one
+    bool canRefit = !grown && m_BlasAABBs && (m_BlasAABBsDesc.buildFlags & nvrhi::rt::AccelStructBuildFlags::AllowUpdate) != nvrhi::rt::AccelStructBuildFlags::None;
+    if (canRefit && !update.batchRebuild && m_RefitSlots + numChangedSlots <= k_MaxRefitSlots) {
+        commandList->buildBottomLevelAccelStruct(m_BlasAABBs, m_BlasAABBsDesc.bottomLevelGeometries.data(), m_BlasAABBsDesc.bottomLevelGeometries.size(),
+            m_BlasAABBsDesc.buildFlags | nvrhi::rt::AccelStructBuildFlags::PerformUpdate);
+        m_RefitSlots += numChangedSlots;
+        update.refit = true;
+    }
+    else if (edited || m_RefitSlots > 0) {
+        BuildBlockAccelStruct(device, commandList, true);
+        m_RefitSlots = 0;
+        update.rebuilt = true;
+    }
+
+    //The instances point to the block BLAS, which may have been recreated. A scene without blocks gets a new instance
+    nvrhi::rt::AccelStructHandle previousTLAS = m_TopLevelAS;
+    BuildTopLevelAccelStruct(device, commandList);
+    if (m_TopLevelAS != previousTLAS)
+        update.buffersChanged = true;
+
+    //Emissive blocks are added to and removed from the light tree by the batch rebuild
+    if (update.batchRebuild) {
+        BuildLightTree();
+        CreateEmissiveLightBuffers(device, commandList);
+        m_BlockRebuildPending = false;
+    }
+
+    m_GeometryVersion++;
+    update.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - applyStart).count();
+    if (update.batchRebuild)
+        log::info("Block edits: batch rebuild of %u slots in %.1f ms", uint(m_AABBs.size()), update.cpuMs);
+    return update;
+}
+
+BlockEditor& MinecraftSceneLoader::GetOrCreateBlockEditor()
+{
+    if (!m_BlockEditor)
+        m_BlockEditor = std::make_unique<BlockEditor>(m_AABBs, m_AABBMaterials, k_BlockEditReserveSlots);
+    return *m_BlockEditor;
+}
+
+void MinecraftSceneLoader::MarkOccupiedCell(int3 cell)
+{
+    uint brickIndex = 0;
+    switch (m_OccupancyGrid.MarkCell(cell, &brickIndex)) {
+    case OccupancyGrid::MarkResult::BrickChanged:
+        m_DirtyOccupancyBricks.push_back(brickIndex);
+        break;
+    case OccupancyGrid::MarkResult::BrickInserted:
+        m_OccupancyBuffersDirty = true;
+        break;
+    case OccupancyGrid::MarkResult::OutsideGrid:
+        m_OccupancyGridOutdated = true;
+        break;
+    default:
+        break;
+    }
+}
+
+bool MinecraftSceneLoader::AddObjToScene(const std::filesystem::path& objFile, std::vector<tinyobj::material_t>& materials)
 {
     //Init TinyObj and load scene
 	tinyobj::ObjReaderConfig reader_config;
@@ -48,7 +411,10 @@ bool MinecraftSceneLoader::LoadScene(std::filesystem::path scenePath, std::strin
 
 
 	tinyobj::ObjReader reader;
-	if (!reader.ParseFromFile((scenePath / sceneName).string(), reader_config)) {
+	NotifyStage(LoadStage::Parse, false);
+	bool parsed = reader.ParseFromFile(objFile.string(), reader_config);
+	NotifyStage(LoadStage::Parse, true);
+	if (!parsed) {
 		if (!reader.Error().empty()) {
 			std::string err = "TinyObjReader: " + reader.Error();
 			log::warning(err.c_str());
@@ -63,70 +429,408 @@ bool MinecraftSceneLoader::LoadScene(std::filesystem::path scenePath, std::strin
 
 	auto& attribs = reader.GetAttrib();
 	auto& shapes = reader.GetShapes();
-	auto& materials = reader.GetMaterials();
+	materials = reader.GetMaterials();
 
-    if (materials.empty()) {
-        log::warning("No Materials found. Abort scene loading");
+    NotifyStage(LoadStage::Geometry, false);
+    AddGeometryToScene(attribs, shapes);
+    NotifyStage(LoadStage::Geometry, true);
+    return true;
+}
+
+bool MinecraftSceneLoader::AddAnvilWorldToScene(const std::filesystem::path& scenePath, const std::string& worldName, std::vector<tinyobj::material_t>& materials)
+{
+    AnvilImporter importer;
+    AnvilImporter::Result result;
+    //Chunks outside the load region are not read at all, ClipToLoadRegion does the exact assignment of the blocks
+    AnvilImporter::Settings settings;
+    settings.region = m_LoadRegion;
+    //The import reads, decodes and meshes the chunks, which corresponds to parsing the .obj
+    NotifyStage(LoadStage::Parse, false);
+    bool imported = importer.Import(scenePath, worldName, settings, result);
+    NotifyStage(LoadStage::Parse, true);
+    const AnvilImporter::Stats& stats = importer.GetStats();
+    log::info("AnvilImporter: %u regions, %u chunks (%u skipped, %u outside the load region), %u sections, %u block states, %.2f MB read, %.2f MB inflated",
+        stats.numRegions, stats.numChunks, stats.numSkippedChunks, stats.numChunksOutsideRegion, stats.numSections, stats.numBlockStates,
+        double(stats.bytesRead) / (1 << 20), double(stats.bytesInflated) / (1 << 20));
+    log::info("AnvilImporter: %u blocks (%.3f bytes read per block), %u hidden, %u approximated, %u skipped, %u missing textures, "
+        "read %.1f ms, decode %.1f ms, mesh %.1f ms", stats.numBlocks, stats.numBlocks > 0 ? double(stats.bytesRead) / stats.numBlocks : 0.0,
+        stats.numHiddenBlocks, stats.numApproximatedBlocks, stats.numSkippedBlocks, stats.numMissingTextures, stats.readTimeMs, stats.decodeTimeMs, stats.meshTimeMs);
+    if (!imported) {
+        log::warning("AnvilImporter: no blocks found in %s", worldName.c_str());
         return false;
     }
 
-    AddGeometryToScene(attribs, shapes);
+    NotifyStage(LoadStage::Geometry, false);
+    m_AABBs = std::move(result.aabbs);
+    m_AABBMaterials = std::move(result.aabbMaterials);
+    m_Vertices = std::move(result.vertices);
+    m_Indices = std::move(result.indices);
+    m_TriPerFaceMatID = std::move(result.triangleMaterialIDs);
+    materials = std::move(result.materials);
+
+    m_sceneStats.numAABBs = int(m_AABBs.size());
+    m_sceneStats.numTriangles = int(m_TriPerFaceMatID.size());
+    m_sceneStats.numUniqueVertices = int(m_Vertices.size());
+    m_sceneStats.numIndices = int(m_Indices.size());
+    for (const AABB& aabb : m_AABBs) {
+        m_sceneStats.boundsMin = min(m_sceneStats.boundsMin, aabb.min);
+        m_sceneStats.boundsMax = max(m_sceneStats.boundsMax, aabb.max);
+    }
+    for (const VertexData& vertex : m_Vertices) {
+        m_sceneStats.boundsMin = min(m_sceneStats.boundsMin, vertex.position);
+        m_sceneStats.boundsMax = max(m_sceneStats.boundsMax, vertex.position);
+    }
+    //A region load only has the blocks of its region. The stored chunks give the same bounds for every region, so orbit cameras match between them
+    if (!m_LoadRegion.IsEverything()) {
+        m_sceneStats.boundsMin = result.chunkBoundsMin;
+        m_sceneStats.boundsMax = result.chunkBoundsMax;
+    }
+    NotifyStage(LoadStage::Geometry, true);
+    return true;
+}
 
-    AddMaterialsToScene(materials, device, commandList, pTextureCache, descriptorTable);
+bool MinecraftSceneLoader::AddArchiveToScene(const std::filesystem::path& archiveFile, std::vector<tinyobj::material_t>& materials)
+{
+    //Decoding the chunks replaces parsing the .obj
+    SceneArchive::Contents contents;
+    SceneArchive::Stats stats;
+    NotifyStage(LoadStage::Parse, false);
+    SceneArchive::ChunkFilter chunkFilter;
+    if (m_LoadVisibility) {
+        //A chunk is a cell of the set, its center decides
+        chunkFilter = [this](float3 chunkMin) {
+            int cell = m_LoadVisibility->GetCellIndex(chunkMin + float3(0.5f * float(SceneArchive::k_ChunkSize)));
+            return cell < 0 || m_LoadVisibleCells[cell] != 0;
+        };
+    }
+    bool read = SceneArchive::Read(archiveFile, contents, &stats, &m_LoadArena, m_LoadRegion, chunkFilter);
+    NotifyStage(LoadStage::Parse, true);
+    if (!read) {
+        log::warning("SceneArchive: could not read %s", archiveFile.string().c_str());
+        return false;
+    }
+    log::info("SceneArchive: %u of %u chunks, %.2f MB decoded from %.2f MB, read %.1f ms, decode %.1f ms (%.2f GB/s)", stats.numDecodedChunks, stats.info.numChunks,
+        double(stats.decodedBytes) / (1 << 20), double(stats.fileBytes) / (1 << 20), stats.readMs, stats.decodeMs,
+        stats.decodeMs > 0.0 ? double(stats.decodedBytes) / 1e9 / (stats.decodeMs / 1000.0) : 0.0);
+
+    //The arrays are moved, the archive decodes straight into them
+    NotifyStage(LoadStage::Geometry, false);
+    m_AABBs = std::move(contents.aabbs);
+    m_AABBMaterials = std::move(contents.aabbMaterials);
+    m_Vertices = std::move(contents.vertices);
+    m_Indices = std::move(contents.indices);
+    m_TriPerFaceMatID = std::move(contents.triangleMaterialIDs);
+    materials = std::move(contents.materials);
+
+    m_sceneStats.numAABBs = int(m_AABBs.size());
+    m_sceneStats.numTriangles = int(m_TriPerFaceMatID.size());
+    m_sceneStats.numUniqueVertices = int(m_Vertices.size());
+    m_sceneStats.numIndices = int(m_Indices.size());
+    if (!m_AABBs.empty() || !m_Vertices.empty()) {
+        m_sceneStats.boundsMin = stats.info.boundsMin;
+        m_sceneStats.boundsMax = stats.info.boundsMax;
+    }
+    NotifyStage(LoadStage::Geometry, true);
+    return true;
+}
 
-    CreateMaterialsBuffers(device, commandList);
-    
-    CreateGeometryBuffers(device, commandList);
-    
-    CreateAccelerationStructure(device, commandList);
+bool MinecraftSceneLoader::IsLoaded(float3 position) const
+{
+    if (!m_LoadRegion.Contains(position))
+        return false;
+    if (!m_LoadVisibility)
+        return true;
+    int cell = m_LoadVisibility->GetCellIndex(position);
+    return cell < 0 || m_LoadVisibleCells[cell] != 0;
+}
 
-	m_sceneIsLoaded = true;
-	return true;
+void MinecraftSceneLoader::ClipToLoadRegion()
+{
+    if (m_LoadRegion.IsEverything() && !m_LoadVisibility)
+        return;
+    const size_t numBlocks = m_AABBs.size();
+    const size_t numTriangles = m_TriPerFaceMatID.size();
+
+    size_t keptBlocks = 0;
+    for (size_t i = 0; i < numBlocks; i++) {
+        if (!IsLoaded(m_AABBs[i].min))
+            continue;
+        m_AABBs[keptBlocks] = m_AABBs[i];
+        m_AABBMaterials[keptBlocks] = m_AABBMaterials[i];
+        keptBlocks++;
+    }
+    m_AABBs.resize(keptBlocks);
+    m_AABBMaterials.resize(keptBlocks);
+
+    //Kept vertices are renumbered in their original order
+    const uint unassigned = ~0u;
+    std::pmr::vector<uint> newIndex(m_Vertices.size(), unassigned, &m_LoadArena);
+    size_t keptTriangles = 0;
+    for (size_t t = 0; t < numTriangles; t++) {
+        const uint* triangle = &m_Indices[t * 3];
+        float3 centroid = (m_Vertices[triangle[0]].position + m_Vertices[triangle[1]].position + m_Vertices[triangle[2]].position) / 3.f;
+        if (!IsLoaded(centroid))
+            continue;
+        for (int k = 0; k < 3; k++) {
+            newIndex[triangle[k]] = 0;
+            m_Indices[keptTriangles * 3 + k] = triangle[k];
+        }
+        m_TriPerFaceMatID[keptTriangles] = m_TriPerFaceMatID[t];
+        keptTriangles++;
+    }
+    m_Indices.resize(keptTriangles * 3);
+    m_TriPerFaceMatID.resize(keptTriangles);
+    uint keptVertices = 0;
+    for (size_t v = 0; v < m_Vertices.size(); v++) {
+        if (newIndex[v] == unassigned)
+            continue;
+        newIndex[v] = keptVertices;
+        m_Vertices[keptVertices++] = m_Vertices[v];
+    }
+    m_Vertices.resize(keptVertices);
+    for (uint& index : m_Indices)
+        index = newIndex[index];
+
+    //The memory of the other regions is what a region load saves
+    m_AABBs.shrink_to_fit();
+    m_AABBMaterials.shrink_to_fit();
+    m_Vertices.shrink_to_fit();
+    m_Indices.shrink_to_fit();
+    m_TriPerFaceMatID.shrink_to_fit();
+
+    m_sceneStats.numAABBs = int(m_AABBs.size());
+    m_sceneStats.numTriangles = int(m_TriPerFaceMatID.size());
+    m_sceneStats.numUniqueVertices = int(m_Vertices.size());
+    m_sceneStats.numIndices = int(m_Indices.size());
+    log::info("Load region and visibility kept %zu of %zu blocks and %zu of %zu triangles", keptBlocks, numBlocks, keptTriangles, numTriangles);
 }
 
-bool MinecraftSceneLoader::UnloadScene(std::shared_ptr<engine::TextureCache>& pTextureCache) {
+bool MinecraftSceneLoader::UnloadScene(std::shared_ptr<engine::TextureCache>& pTextureCache, bool resetTextureCache) {
     //Clear the scene
     m_sceneStats = { };
 
     //CPU Buffer
     m_Materials.clear();
+    m_AlphaTestTextures.clear();
+    m_MaterialTextureNames.clear();
     m_AABBs.clear();
     m_AABBMaterials.clear();
     m_Indices.clear();
     m_Vertices.clear();
     m_TriPerFaceMatID.clear();
+    m_TriangleRegions.clear();
+    m_RegionIndices.clear();
+    m_AABBOrder.clear();
+    m_TriangleOrder.clear();
+    m_VertexOrder.clear();
+    m_LightTree.Clear();
+    m_OccupancyGrid.Clear();
+
+    //Block edits
+    m_BlockEditor = nullptr;
+    m_RefitSlots = 0;
+    m_BlockEditIdleFrames = 0;
+    m_BlockRebuildPending = false;
+    m_DirtyOccupancyBricks.clear();
+    m_OccupancyBuffersDirty = false;
+    m_OccupancyGridOutdated = false;
+    m_CachedTextures.clear();
+    m_TextureFallbackColors.clear();
+
+    //Lazy textures, the compute shader is kept while the scene is loaded
+    if (m_TextureResidency) {
+        m_TextureResidency->Release(*pTextureCache);
+        m_TextureResidency = nullptr;
+        RemoveMetalRoughTexGenCS();
+    }
 
     //Acceleration Structures
     m_TopLevelAS = nullptr;
     m_BlasAABBs = nullptr;
     m_BlasTriangles = nullptr;
+    m_BlasAABBsDesc = nvrhi::rt::AccelStructDesc();
 
     //Buffer
     m_AABBBuffer = nullptr;
     m_VertexBuffer = nullptr;
     m_IndexBuffer = nullptr;
+    m_TriangleRegionBuffer = nullptr;
 
     m_MaterialBuffer = nullptr;
+    m_MaterialFeedbackBuffer = nullptr;
     m_TriangleMaterialIDBuffer = nullptr;
     m_AABBMaterialIDBuffer = nullptr;
 
+    m_LightTreeBuffer = nullptr;
+    m_EmissiveLightBuffer = nullptr;
+
+    m_OccupancyRegionBuffer = nullptr;
+    m_OccupancyBrickBuffer = nullptr;
+
     //Textures
-    pTextureCache->Reset();
+    if (resetTextureCache)
+        pTextureCache->Reset();
 
     m_sceneIsLoaded = false;
 
     return true;
 }
 
-void MinecraftSceneLoader::AddMaterialsToScene(const std::vector<tinyobj::material_t>& materials, nvrhi::IDevice* device, nvrhi::CommandListHandle commandList, 
-    std::shared_ptr<TextureCache>& pTextureCache, std::shared_ptr<DescriptorTableManager>& descriptorTable)
+std::vector<uint> MinecraftSceneLoader::DeduplicateMaterials(const std::vector<tinyobj::material_t>& materials)
 {
+    const std::filesystem::path modelFolderName = "/MinecraftModels/";
+    auto resolveTexPath = [&](const std::string& texName) -> std::string {
+        if (texName.empty())
+            return "";
+        return (modelFolderName / texName).lexically_normal().generic_string();
+    };
+
+    //Mark all materials that are referenced by at least one AABB face or triangle
+    std::pmr::vector<bool> referenced(materials.size(), false, &m_LoadArena);
+    auto markReferenced = [&](int matID) {
+        if (matID >= 0 && matID < int(materials.size()))
+            referenced[matID] = true;
+    };
+    for (const AABBMaterials& aabbMat : m_AABBMaterials) {
+        markReferenced(aabbMat.negXMatID);
+        markReferenced(aabbMat.posXMatID);
+        markReferenced(aabbMat.negYMatID);
+        markReferenced(aabbMat.posYMatID);
+        markReferenced(aabbMat.negZMatID);
+        markReferenced(aabbMat.posZMatID);
+    }
+    for (int matID : m_TriPerFaceMatID)
+        markReferenced(matID);
+
+    //Collapse materials with identical parameters and resolved texture paths. The name is ignored on purpose,
+    //as Mineways emits one material per block type even if they share the same textures
+    std::vector<uint> uniqueSourceIndices;
+    std::pmr::vector<int> remap(materials.size(), -1, &m_LoadArena);
+    std::pmr::unordered_map<std::pmr::string, int> keyToUniqueIndex(&m_LoadArena);
+    keyToUniqueIndex.reserve(materials.size());
+    for (uint i = 0; i < materials.size(); i++) {
+        if (!referenced[i])
+            continue;
+
+        auto& material = materials[i];
+        std::pmr::string key(&m_LoadArena);
+        char params[128];
+        snprintf(params, sizeof(params), "%a,%a,%a|%a,%a,%a|", material.diffuse[0], material.diffuse[1], material.diffuse[2],
+            material.emission[0], material.emission[1], material.emission[2]);
+        key += params;
+        key += resolveTexPath(material.diffuse_texname) + "|";
+        key += material.alpha_texname.empty() ? "0|" : "1|";
+        key += resolveTexPath(material.normal_texname) + "|";
+        key += resolveTexPath(material.emissive_texname) + "|";
+        key += resolveTexPath(material.specular_highlight_texname) + "|";
+        key += resolveTexPath(material.roughness_texname) + "|";
+        key += resolveTexPath(material.metallic_texname);
+
+        auto it = keyToUniqueIndex.find(key);
+        if (it == keyToUniqueIndex.end()) {
+            it = keyToUniqueIndex.emplace(key, int(uniqueSourceIndices.size())).first;
+            uniqueSourceIndices.push_back(i);
+        }
+        remap[i] = it->second;
+    }
+
+    //Remap the geometry to the deduplicated material IDs
+    auto remapID = [&](int& matID) {
+        if (matID >= 0 && matID < int(remap.size()))
+            matID = remap[matID];
+    };
+    for (AABBMaterials& aabbMat : m_AABBMaterials) {
+        remapID(aabbMat.negXMatID);
+        remapID(aabbMat.posXMatID);
+        remapID(aabbMat.negYMatID);
+        remapID(aabbMat.posYMatID);
+        remapID(aabbMat.negZMatID);
+        remapID(aabbMat.posZMatID);
+    }
+    for (int& matID : m_TriPerFaceMatID)
+        remapID(matID);
+
+    //Keep at least one material so that the material buffer is never empty
+    if (uniqueSourceIndices.empty() && !materials.empty())
+        uniqueSourceIndices.push_back(0);
+
+    uint numReferenced = uint(std::count(referenced.begin(), referenced.end(), true));
+    log::info("MinecraftSceneLoader: %u materials in .mtl, %u referenced, %u after deduplication",
+        uint(materials.size()), numReferenced, uint(uniqueSourceIndices.size()));
+
+    return uniqueSourceIndices;
+}
+
+MinecraftSceneLoader::MemoryFootprint MinecraftSceneLoader::GetMemoryFootprint() const
+{
+    MemoryFootprint footprint;
+    footprint.cpuBytes += m_AABBs.capacity() * sizeof(AABB);
+    footprint.cpuBytes += m_AABBMaterials.capacity() * sizeof(AABBMaterials);
+    footprint.cpuBytes += m_Indices.capacity() * sizeof(uint);
+    footprint.cpuBytes += m_Vertices.capacity() * sizeof(VertexData);
+    footprint.cpuBytes += m_TriPerFaceMatID.capacity() * sizeof(int);
+    footprint.cpuBytes += m_TriangleRegions.capacity() * sizeof(TriangleRegion) + m_RegionIndices.capacity() * sizeof(uint16_t);
+    footprint.cpuBytes += (m_AABBOrder.capacity() + m_TriangleOrder.capacity() + m_VertexOrder.capacity()) * sizeof(uint);
+    footprint.cpuBytes += m_Materials.capacity() * sizeof(Material);
+    footprint.cpuBytes += m_LightTree.GetNodes().capacity() * sizeof(LightTreeNode);
+    footprint.cpuBytes += m_LightTree.GetLights().capacity() * sizeof(EmissiveLight);
+    footprint.cpuBytes += m_OccupancyGrid.GetByteSize();
+
+    const nvrhi::BufferHandle buffers[] = { m_AABBBuffer, m_VertexBuffer, m_IndexBuffer, m_TriangleRegionBuffer, m_AABBMaterialIDBuffer, m_TriangleMaterialIDBuffer,
+        m_MaterialBuffer, m_LightTreeBuffer, m_EmissiveLightBuffer, m_OccupancyRegionBuffer, m_OccupancyBrickBuffer };
+    for (const nvrhi::BufferHandle& buffer : buffers) {
+        if (buffer)
+            footprint.gpuBytes += buffer->getDesc().byteSize;
+    }
+
+    //The acceleration structure size is not exposed, estimate it per primitive
+    const size_t bytesPerBlasPrimitive = 64;
+    footprint.gpuBytes += (m_AABBs.size() + m_TriPerFaceMatID.size()) * bytesPerBlasPrimitive;
+
+    //Generated metal rough textures are not part of the TextureCache and owned by the scene
+    for (const Material& material : m_Materials) {
+        if (material.metalRoughOrSpecularTexture && material.metalRoughOrSpecularTexture->texture)
+            footprint.gpuBytes += GetTextureByteSize(material.metalRoughOrSpecularTexture->texture);
+    }
+
+    return footprint;
+}
+
+size_t MinecraftSceneLoader::GetTextureByteSize(const nvrhi::ITexture* texture)
+{
+    if (!texture)
+        return 0;
+    const nvrhi::TextureDesc& desc = texture->getDesc();
+    const nvrhi::FormatInfo& formatInfo = nvrhi::getFormatInfo(desc.format);
+    size_t blockSize = std::max<size_t>(formatInfo.blockSize, 1);
+    size_t bytes = 0;
+    for (uint mip = 0; mip < desc.mipLevels; mip++) {
+        size_t width = std::max<size_t>(desc.width >> mip, 1);
+        size_t height = std::max<size_t>(desc.height >> mip, 1);
+        bytes += ((width + blockSize - 1) / blockSize) * ((height + blockSize - 1) / blockSize) * formatInfo.bytesPerBlock;
+    }
+    return bytes * desc.arraySize * desc.depth;
+}
+
+void MinecraftSceneLoader::AddMaterialsToScene(const std::vector<tinyobj::material_t>& materials, const std::vector<uint>& uniqueSourceIndices,
+    nvrhi::IDevice* device, nvrhi::CommandListHandle commandList, std::shared_ptr<TextureCache>& pTextureCache, std::shared_ptr<DescriptorTableManager>& descriptorTable,
+    const std::filesystem::path& scenePath, const TextureLoadSettings& textureSettings)
+{
+    if (textureSettings.lazy) {
+        AddLazyMaterialsToScene(materials, uniqueSourceIndices, device, scenePath, textureSettings);
+        return;
+    }
+
     //Handle Materials
     //Mineways stores roughness and metallic textures separately, therefore a compute shader that creates a metalRough Texture is needed.
     InitMetalRoughTexGenCS(device);
     const std::filesystem::path modelFolderName = "/MinecraftModels/";
-    for (uint i = 0; i < materials.size(); i++) {
-        auto& material = materials[i];
+
+    m_Materials.reserve(m_Materials.size() + uniqueSourceIndices.size());
+    m_AlphaTestTextures.reserve(m_AlphaTestTextures.size() + uniqueSourceIndices.size());
+    m_MaterialTextureNames.reserve(m_MaterialTextureNames.size() + uniqueSourceIndices.size());
+    for (uint i = 0; i < uniqueSourceIndices.size(); i++) {
+        auto& material = materials[uniqueSourceIndices[i]];
         Material sceneMat{};
         sceneMat.modelFileName = "MinecraftSceneLoader";
         sceneMat.name = material.name;
@@ -140,6 +844,7 @@ void MinecraftSceneLoader::AddMaterialsToScene(const std::vector<tinyobj::materi
         if (!material.diffuse_texname.empty()) {
             std::filesystem::path texPath = modelFolderName / material.diffuse_texname;
             sceneMat.baseOrDiffuseTexture = pTextureCache->LoadTextureFromFile(texPath, true, nullptr, commandList);
+            m_CachedTextures.push_back(sceneMat.baseOrDiffuseTexture);
 
             //Check if the material is alpha tested
             if (!material.alpha_texname.empty()) {
@@ -151,11 +856,13 @@ void MinecraftSceneLoader::AddMaterialsToScene(const std::vector<tinyobj::materi
         if (!material.normal_texname.empty()) {
             std::filesystem::path texPath = modelFolderName / material.normal_texname;
             sceneMat.normalTexture = pTextureCache->LoadTextureFromFile(texPath, false, nullptr, commandList);
+            m_CachedTextures.push_back(sceneMat.normalTexture);
         }
         //Emissive
         if (!material.emissive_texname.empty()) {
             std::filesystem::path texPath = modelFolderName / material.emissive_texname;
             sceneMat.emissiveTexture = pTextureCache->LoadTextureFromFile(texPath, false, nullptr, commandList);
+            m_CachedTextures.push_back(sceneMat.emissiveTexture);
         }
         //Roughness, metal
         if (!material.specular_highlight_texname.empty() || !material.roughness_texname.empty()) {
@@ -180,21 +887,115 @@ void MinecraftSceneLoader::AddMaterialsToScene(const std::vector<tinyobj::materi
                 pTextureCache->UnloadTexture(metallicTexture);
         }
         m_Materials.push_back(sceneMat);
+        m_AlphaTestTextures.push_back(sceneMat.domain == MaterialDomain::AlphaTested ? material.diffuse_texname : std::string());
+        m_MaterialTextureNames.push_back({ material.diffuse_texname, material.emissive_texname });
     }
+    m_sceneStats.numMaterials = int(m_Materials.size());
 
     //Remove Compute shader resources, as they are not needed anymore
     RemoveMetalRoughTexGenCS();
 }
 
+void MinecraftSceneLoader::AddLazyMaterialsToScene(const std::vector<tinyobj::material_t>& materials, const std::vector<uint>& uniqueSourceIndices,
+    nvrhi::IDevice* device, const std::filesystem::path& scenePath, const TextureLoadSettings& textureSettings)
+{
+    const std::filesystem::path modelFolderName = "/MinecraftModels/";
+
+    //Average colors of the diffuse and emissive textures. Colors the scene index does not know are computed from the PNGs
+    m_TextureFallbackColors.clear();
+    std::pmr::vector<std::string> missingTextures(&m_LoadArena);
+    for (uint sourceIndex : uniqueSourceIndices) {
+        for (const std::string* texture : { &materials[sourceIndex].diffuse_texname, &materials[sourceIndex].emissive_texname }) {
+            if (texture->empty() || m_TextureFallbackColors.count(*texture) > 0)
+                continue;
+            if (textureSettings.fallbackColors && textureSettings.fallbackColors->count(*texture) > 0)
+                m_TextureFallbackColors[*texture] = textureSettings.fallbackColors->at(*texture);
+            else if (std::find(missingTextures.begin(), missingTextures.end(), *texture) == missingTextures.end())
+                missingTextures.push_back(*texture);
+        }
+    }
+    std::pmr::vector<float4> missingColors(missingTextures.size(), &m_LoadArena);
+    std::pmr::vector<uint8_t> missingFound(missingTextures.size(), 0, &m_LoadArena);
+    TaskScheduler::Get().ParallelFor(0, missingTextures.size(), 1, [&](uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; i++) {
+            PngReader::Image image;
+            if (PngReader::Read(scenePath / missingTextures[i], image)) {
+                missingColors[i] = PngReader::ComputeAverageColor(image);
+                missingFound[i] = 1;
+            }
+        }
+    });
+    for (size_t i = 0; i < missingTextures.size(); i++) {
+        if (missingFound[i])
+            m_TextureFallbackColors[missingTextures[i]] = missingColors[i];
+    }
+    log::info("Lazy textures: %u fallback colors, %u computed", uint(m_TextureFallbackColors.size()), uint(missingTextures.size()));
+
+    //Same materials as AddMaterialsToScene, the textures are only recorded for the TextureResidency
+    std::vector<TextureResidency::MaterialTextures> materialTextures;
+    materialTextures.reserve(uniqueSourceIndices.size());
+    m_Materials.reserve(m_Materials.size() + uniqueSourceIndices.size());
+    m_AlphaTestTextures.reserve(m_AlphaTestTextures.size() + uniqueSourceIndices.size());
+    m_MaterialTextureNames.reserve(m_MaterialTextureNames.size() + uniqueSourceIndices.size());
+    for (uint i = 0; i < uniqueSourceIndices.size(); i++) {
+        auto& material = materials[uniqueSourceIndices[i]];
+        Material sceneMat{};
+        sceneMat.modelFileName = "MinecraftSceneLoader";
+        sceneMat.name = material.name;
+        sceneMat.materialID = i;
+        sceneMat.baseOrDiffuseColor = float3(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
+        sceneMat.emissiveColor = float3(material.emission[0], material.emission[1], material.emission[2]);
+        sceneMat.roughness = 1.f;
+        sceneMat.metalness = 0.f;
+        sceneMat.alphaCutoff = 0.1;  //Force opaque on transmissive materials
+
+        TextureResidency::MaterialTextures textures;
+        if (!material.diffuse_texname.empty()) {
+            textures.diffuse = modelFolderName / material.diffuse_texname;
+            auto fallback = m_TextureFallbackColors.find(material.diffuse_texname);
+            if (fallback != m_TextureFallbackColors.end())
+                sceneMat.baseOrDiffuseColor = float3(fallback->second.x, fallback->second.y, fallback->second.z);
+
+            //Check if the material is alpha tested. Without the texture the alpha test is skipped
+            if (!material.alpha_texname.empty()) {
+                sceneMat.domain = MaterialDomain::AlphaTested;
+                sceneMat.doubleSided = true;
+            }
+        }
+        if (!material.normal_texname.empty())
+            textures.normal = modelFolderName / material.normal_texname;
+        //Emissive textures replace the emissive color, the fallback is needed for the light tree to find the emitters
+        if (!material.emissive_texname.empty()) {
+            textures.emissive = modelFolderName / material.emissive_texname;
+            auto fallback = m_TextureFallbackColors.find(material.emissive_texname);
+            if (fallback != m_TextureFallbackColors.end())
+                sceneMat.emissiveColor = float3(fallback->second.x, fallback->second.y, fallback->second.z);
+            else if (all(sceneMat.emissiveColor == float3(0.f)))
+                sceneMat.emissiveColor = float3(1.f);
+        }
+        if (!material.specular_highlight_texname.empty() || !material.roughness_texname.empty()) {
+            textures.convertShininessToRoughness = material.roughness_texname.empty();
+            textures.roughness = modelFolderName / (textures.convertShininessToRoughness ? material.specular_highlight_texname : material.roughness_texname);
+            if (!material.metallic_texname.empty())
+                textures.metallic = modelFolderName / material.metallic_texname;
+        }
+        m_Materials.push_back(sceneMat);
+        m_AlphaTestTextures.push_back(sceneMat.domain == MaterialDomain::AlphaTested ? material.diffuse_texname : std::string());
+        m_MaterialTextureNames.push_back({ material.diffuse_texname, material.emissive_texname });
+        materialTextures.push_back(textures);
+    }
+    m_sceneStats.numMaterials = int(m_Materials.size());
+
+    if (device)
+        m_TextureResidency = std::make_unique<TextureResidency>(device, materialTextures);
+}
+
 void MinecraftSceneLoader::CreateMaterialsBuffers(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList)
 {
     //Fill the material buffer construct
-    std::vector<MaterialConstants> materialConstants;
-    for (uint i = 0; i < m_Materials.size(); i++) {
-        MaterialConstants constant;
-        m_Materials[i].FillConstantBuffer(constant);
-        materialConstants.push_back(constant);
-    }
+    std::pmr::vector<MaterialConstants> materialConstants(m_Materials.size(), &m_LoadArena);
+    for (uint i = 0; i < m_Materials.size(); i++)
+        m_Materials[i].FillConstantBuffer(materialConstants[i]);
 
     //Create GPU Buffers
     nvrhi::BufferDesc bufferDesc;
@@ -208,36 +1009,93 @@ void MinecraftSceneLoader::CreateMaterialsBuffers(nvrhi::IDevice* device, nvrhi:
     m_MaterialBuffer = device->createBuffer(bufferDesc);
     commandList->writeBuffer(m_MaterialBuffer, materialConstants.data(), sizeof(MaterialConstants) * materialConstants.size());
 
-    //Material ID Buffers for Triangles and AABBs
-    if (!m_TriPerFaceMatID.empty())
-    {
-        bufferDesc.byteSize = sizeof(uint) * m_TriPerFaceMatID.size();
-        bufferDesc.debugName = "TrianglePerFaceMatID";
-        bufferDesc.structStride = sizeof(uint);
-        m_TriangleMaterialIDBuffer = device->createBuffer(bufferDesc);
-        commandList->writeBuffer(m_TriangleMaterialIDBuffer, m_TriPerFaceMatID.data(), sizeof(uint) * m_TriPerFaceMatID.size());
-    }
-    if (!m_AABBMaterials.empty())
-    {
-        bufferDesc.byteSize = sizeof(AABBMaterials) * m_AABBMaterials.size();
-        bufferDesc.debugName = "AABBMatID";
-        bufferDesc.structStride = sizeof(AABBMaterials);
-        m_AABBMaterialIDBuffer = device->createBuffer(bufferDesc);
-        commandList->writeBuffer(m_AABBMaterialIDBuffer, m_AABBMaterials.data(), sizeof(AABBMaterials) * m_AABBMaterials.size());
+    //Material feedback buffer, always bound. The shader only writes it with lazy textures
+    nvrhi::BufferDesc feedbackDesc;
+    feedbackDesc.byteSize = sizeof(uint) * std::max<size_t>(m_Materials.size(), 1);
+    feedbackDesc.debugName = "MaterialFeedback";
+    feedbackDesc.structStride = sizeof(uint);
+    feedbackDesc.format = nvrhi::Format::R32_UINT;
+    feedbackDesc.canHaveUAVs = true;
+    feedbackDesc.canHaveTypedViews = true;
+    feedbackDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
+    feedbackDesc.keepInitialState = true;
+    m_MaterialFeedbackBuffer = device->createBuffer(feedbackDesc);
+    commandList->clearBufferUInt(m_MaterialFeedbackBuffer, 0);
+}
+
+void MinecraftSceneLoader::DecodeMaterialTextures(const std::vector<tinyobj::material_t>& materials, const std::vector<uint>& uniqueSourceIndices,
+    TextureCache& textureCache)
+{
+    //The textures of AddMaterialsToScene in the same order, the cache keeps the sRGB flag of the first load of a file
+    const std::filesystem::path modelFolderName = "/MinecraftModels/";
+    std::pmr::vector<std::pair<std::string, bool>> textures(&m_LoadArena);
+    std::unordered_set<std::string> added;
+    auto addTexture = [&](const std::string& name, bool sRGB) {
+        if (!name.empty() && added.insert(name).second)
+            textures.push_back({ name, sRGB });
+    };
+    for (uint sourceIndex : uniqueSourceIndices) {
+        const tinyobj::material_t& material = materials[sourceIndex];
+        addTexture(material.diffuse_texname, true);
+        addTexture(material.normal_texname, false);
+        addTexture(material.emissive_texname, false);
+        if (!material.specular_highlight_texname.empty() || !material.roughness_texname.empty()) {
+            addTexture(material.roughness_texname.empty() ? material.specular_highlight_texname : material.roughness_texname, false);
+            addTexture(material.metallic_texname, false);
+        }
     }
+
+    auto decodeStart = std::chrono::high_resolution_clock::now();
+    TaskScheduler::Get().ParallelFor(0, textures.size(), 1, [&](uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; i++)
+            textureCache.LoadTextureFromFileDeferred(modelFolderName / textures[i].first, textures[i].second);
+    });
+    double decodeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - decodeStart).count();
+    log::info("Texture decode: %u textures, %.1f ms", uint(textures.size()), decodeMs);
 }
 
 void MinecraftSceneLoader::AddGeometryToScene(const tinyobj::attrib_t& attribs, const std::vector<tinyobj::shape_t>& shapes)
 {
-    std::unordered_map<SceneVertex, uint32_t> uniqueVertices{};
+    //Counting pass, the output arrays are allocated once with their exact size
+    size_t numBlocks = 0;
+    size_t numTriangles = 0;
+    for (const tinyobj::shape_t& shape : shapes) {
+        if (shape.mesh.num_face_vertices.size() == 12) {
+            numBlocks++;
+            continue;
+        }
+        for (unsigned int fv : shape.mesh.num_face_vertices)
+            numTriangles += fv == 3 ? 1 : 0;
+    }
 
-    // Loop over shapes
-    for (size_t s = 0; s < shapes.size(); s++) {
-        size_t index_offset = 0;
-        //Check if Block (AABB) or more billboard/complex (stored as Triangle)
-        if (shapes[s].mesh.num_face_vertices.size() == 12) //Case AABB
-        {
-            AABB aabb;
+    //Standard exports only contain the visible faces of the blocks
+    std::pmr::vector<size_t> faceOffsets(&m_LoadArena);
+    std::pmr::vector<uint8_t> faceInBlock(&m_LoadArena);
+    numTriangles -= ReconstructBlocks(attribs, shapes, faceOffsets, faceInBlock);
+
+    m_AABBs.reserve(m_AABBs.size() + numBlocks);
+    m_AABBMaterials.reserve(m_AABBMaterials.size() + numBlocks);
+    m_Indices.reserve(m_Indices.size() + numTriangles * 3);
+    m_TriPerFaceMatID.reserve(m_TriPerFaceMatID.size() + numTriangles);
+
+    //The vertex map and the unique vertices live in the load arena. Mineways quads share most of their vertices,
+    //the map is sized for about two references per vertex
+    std::pmr::unordered_map<SceneVertex, uint32_t> uniqueVertices(&m_LoadArena);
+    uniqueVertices.reserve(numTriangles * 3 / 2);
+    std::pmr::vector<SceneVertex> newVertices(&m_LoadArena);
+    const uint32_t firstVertex = uint32_t(m_Vertices.size());
+
+    //Blocks are independent of each other, their bounds and face materials are computed in parallel.
+    //Triangles share the vertex map and are added in shape order afterwards
+    std::pmr::vector<AABB> shapeAABBs(shapes.size(), &m_LoadArena);
+    std::pmr::vector<AABBMaterials> shapeMaterials(shapes.size(), &m_LoadArena);
+    TaskScheduler::Get().ParallelFor(0, shapes.size(), k_ShapeGrainSize, [&](uint64_t shapeBegin, uint64_t shapeEnd) {
+        for (size_t s = shapeBegin; s < shapeEnd; s++) {
+            if (shapes[s].mesh.num_face_vertices.size() != 12)
+                continue;
+
+            size_t index_offset = 0;
+            AABB& aabb = shapeAABBs[s];
             aabb.min = float3(std::numeric_limits<float>::max());
             aabb.max = float3(std::numeric_limits<float>::max()) * -1.f;
             //Get box extends with min/max
@@ -262,7 +1120,7 @@ void MinecraftSceneLoader::AddGeometryToScene(const tinyobj::attrib_t& attribs,
 
             //Get per face material (sorted from negative x,y,z to positive x,y,z
             //TODO Calculated front orientation to correctly recreate uv's for blocks with special orientations
-            AABBMaterials aabbMaterials;
+            AABBMaterials& aabbMaterials = shapeMaterials[s];
             aabbMaterials.negXMatID = shapes[s].mesh.material_ids[0];
             aabbMaterials.negYMatID = shapes[s].mesh.material_ids[2];
             aabbMaterials.negZMatID = shapes[s].mesh.material_ids[4];
@@ -270,10 +1128,21 @@ void MinecraftSceneLoader::AddGeometryToScene(const tinyobj::attrib_t& attribs,
             aabbMaterials.posYMatID = shapes[s].mesh.material_ids[8];
             aabbMaterials.posZMatID = shapes[s].mesh.material_ids[10];
             aabbMaterials.padding = int2(0);
+        }
+    });
 
+    // Loop over shapes
+    for (size_t s = 0; s < shapes.size(); s++) {
+        size_t index_offset = 0;
+        //Check if Block (AABB) or more billboard/complex (stored as Triangle)
+        if (shapes[s].mesh.num_face_vertices.size() == 12) //Case AABB
+        {
+            const AABB& aabb = shapeAABBs[s];
             m_AABBs.push_back(aabb);
-            m_AABBMaterials.push_back(aabbMaterials);
+            m_AABBMaterials.push_back(shapeMaterials[s]);
             m_sceneStats.numAABBs++;
+            m_sceneStats.boundsMin = min(m_sceneStats.boundsMin, aabb.min);
+            m_sceneStats.boundsMax = max(m_sceneStats.boundsMax, aabb.max);
         }
         else //Case Triangle
         {
@@ -284,6 +1153,11 @@ void MinecraftSceneLoader::AddGeometryToScene(const tinyobj::attrib_t& attribs,
                     log::warning("MinecraftSceneLoader::Load() encountered a non-triangle");
                     continue;
                 }
+                //Face of a reconstructed block
+                if (faceInBlock[faceOffsets[s] + f]) {
+                    index_offset += fv;
+                    continue;
+                }
 
                 // Loop over vertices in the face.
                 for (size_t v = 0; v < fv; v++) {
@@ -308,13 +1182,15 @@ void MinecraftSceneLoader::AddGeometryToScene(const tinyobj::attrib_t& attribs,
                     }
 
                     //Check if vertex is duplicate
-                    if (uniqueVertices.count(vertex) == 0) {
-                        uniqueVertices[vertex] = static_cast<uint32_t>(m_Vertices.size()); //Add new index to map
-                        m_Vertices.push_back(vertex.toVertexData()); //Store vertex data
+                    auto [it, inserted] = uniqueVertices.emplace(vertex, firstVertex + uint32_t(newVertices.size()));
+                    if (inserted) {
+                        newVertices.push_back(vertex);
                         m_sceneStats.numUniqueVertices++;
+                        m_sceneStats.boundsMin = min(m_sceneStats.boundsMin, vertex.position);
+                        m_sceneStats.boundsMax = max(m_sceneStats.boundsMax, vertex.position);
                     }
 
-                    m_Indices.push_back(uniqueVertices[vertex]);
+                    m_Indices.push_back(it->second);
                     m_sceneStats.numIndices++;
                 }
                 index_offset += fv;
@@ -324,6 +1200,315 @@ void MinecraftSceneLoader::AddGeometryToScene(const tinyobj::attrib_t& attribs,
             }
         }
     }
+
+    //Store vertex data
+    m_Vertices.reserve(m_Vertices.size() + newVertices.size());
+    for (SceneVertex& vertex : newVertices)
+        m_Vertices.push_back(vertex.toVertexData());
+}
+
+size_t MinecraftSceneLoader::ReconstructBlocks(const tinyobj::attrib_t& attribs, const std::vector<tinyobj::shape_t>& shapes, std::pmr::vector<size_t>& faceOffsets,
+    std::pmr::vector<uint8_t>& faceInBlock)
+{
+    faceOffsets.assign(shapes.size() + 1, 0);
+    for (size_t s = 0; s < shapes.size(); s++)
+        faceOffsets[s + 1] = faceOffsets[s] + shapes[s].mesh.num_face_vertices.size();
+    faceInBlock.assign(faceOffsets.back(), 0);
+
+    auto getPosition = [&](const tinyobj::index_t& idx) {
+        return float3(attribs.vertices[3 * size_t(idx.vertex_index) + 0], attribs.vertices[3 * size_t(idx.vertex_index) + 1],
+            attribs.vertices[3 * size_t(idx.vertex_index) + 2]);
+    };
+
+    //Quads are two consecutive triangles with the same material that share an edge, independent of how tinyobj split them.
+    //All other triangles only contribute their centroid, which rejects blocks that contain them
+    std::pmr::vector<VoxelReconstruction::Quad> quads(&m_LoadArena);
+    std::pmr::vector<size_t> quadFaces(&m_LoadArena);
+    std::pmr::vector<float3> otherCentroids(&m_LoadArena);
+    //Blocks of the 12 triangle shapes. Quads on their faces (rails, lily pads, carpets) must not become a second box on top of them
+    std::pmr::vector<float3> blockMins(&m_LoadArena);
+    for (size_t s = 0; s < shapes.size(); s++) {
+        const tinyobj::mesh_t& mesh = shapes[s].mesh;
+        if (mesh.num_face_vertices.size() == 12) {
+            float3 blockMin = float3(std::numeric_limits<float>::max());
+            for (const tinyobj::index_t& idx : mesh.indices)
+                blockMin = min(blockMin, getPosition(idx));
+            blockMins.push_back(blockMin);
+            continue;
+        }
+        size_t index_offset = 0;
+        for (size_t f = 0; f < mesh.num_face_vertices.size(); f++) {
+            size_t fv = size_t(mesh.num_face_vertices[f]);
+            if (fv != 3) {
+                index_offset += fv;
+                continue;
+            }
+            const tinyobj::index_t* first = &mesh.indices[index_offset];
+            if (f + 1 < mesh.num_face_vertices.size() && mesh.num_face_vertices[f + 1] == 3 && mesh.material_ids[f] == mesh.material_ids[f + 1]) {
+                const tinyobj::index_t* second = &mesh.indices[index_offset + 3];
+                int shared = 0;
+                int otherVertex = -1;
+                for (int i = 0; i < 3; i++) {
+                    bool inFirst = second[i].vertex_index == first[0].vertex_index || second[i].vertex_index == first[1].vertex_index ||
+                        second[i].vertex_index == first[2].vertex_index;
+                    shared += inFirst ? 1 : 0;
+                    if (!inFirst)
+                        otherVertex = i;
+                }
+                if (shared == 2) {
+                    VoxelReconstruction::Quad quad;
+                    const tinyobj::index_t corners[4] = { first[0], first[1], first[2], second[otherVertex] };
+                    quad.hasUVs = true;
+                    for (int i = 0; i < 4; i++) {
+                        quad.positions[i] = getPosition(corners[i]);
+                        if (corners[i].texcoord_index >= 0)
+                            quad.uvs[i] = float2(attribs.texcoords[2 * size_t(corners[i].texcoord_index) + 0], attribs.texcoords[2 * size_t(corners[i].texcoord_index) + 1]);
+                        else
+                            quad.hasUVs = false;
+                    }
+                    //Normals of the export if there are any, the winding otherwise
+                    if (first[0].normal_index >= 0)
+                        quad.normal = float3(attribs.normals[3 * size_t(first[0].normal_index) + 0], attribs.normals[3 * size_t(first[0].normal_index) + 1],
+                            attribs.normals[3 * size_t(first[0].normal_index) + 2]);
+                    else
+                        quad.normal = cross(quad.positions[1] - quad.positions[0], quad.positions[2] - quad.positions[0]);
+                    quad.materialID = mesh.material_ids[f];
+                    quads.push_back(quad);
+                    quadFaces.push_back(faceOffsets[s] + f);
+                    index_offset += 6;
+                    f++;
+                    continue;
+                }
+            }
+            otherCentroids.push_back((getPosition(first[0]) + getPosition(first[1]) + getPosition(first[2])) / 3.f);
+            index_offset += fv;
+        }
+    }
+    if (quads.empty())
+        return 0;
+
+    VoxelReconstruction::Result result;
+    VoxelReconstruction::Reconstruct(quads.data(), quads.size(), otherCentroids.data(), otherCentroids.size(), blockMins.data(), blockMins.size(), result, &m_LoadArena);
+    for (size_t q = 0; q < quads.size(); q++) {
+        if (result.quadUsed[q]) {
+            faceInBlock[quadFaces[q]] = 1;
+            faceInBlock[quadFaces[q] + 1] = 1;
+        }
+    }
+    for (const AABB& aabb : result.aabbs) {
+        m_sceneStats.boundsMin = min(m_sceneStats.boundsMin, aabb.min);
+        m_sceneStats.boundsMax = max(m_sceneStats.boundsMax, aabb.max);
+    }
+    m_sceneStats.numAABBs += int(result.aabbs.size());
+    m_AABBs.insert(m_AABBs.end(), result.aabbs.begin(), result.aabbs.end());
+    m_AABBMaterials.insert(m_AABBMaterials.end(), result.materials.begin(), result.materials.end());
+
+    const VoxelReconstruction::Stats& stats = result.stats;
+    if (stats.numBlocks > 0 || stats.numRejectedBlocks > 0 || stats.numQuadsOnBlocks > 0)
+        log::info("VoxelReconstruction: %llu of %llu quads rebuilt into %llu blocks, %llu blocks rejected, %llu quads on existing blocks, grid offset %.3f %.3f %.3f",
+            (unsigned long long)stats.numUsedQuads, (unsigned long long)stats.numQuads, (unsigned long long)stats.numBlocks,
+            (unsigned long long)stats.numRejectedBlocks, (unsigned long long)stats.numQuadsOnBlocks, stats.gridOrigin.x, stats.gridOrigin.y, stats.gridOrigin.z);
+    return size_t(stats.numUsedQuads) * 2;
+}
+
+void MinecraftSceneLoader::SortPrimitivesSpatially()
+{
+    auto sortStart = std::chrono::high_resolution_clock::now();
+    auto sortByMorton = [](const std::vector<float3>& centers) {
+        float3 boundsMin = float3(std::numeric_limits<float>::max());
+        float3 boundsMax = float3(-std::numeric_limits<float>::max());
+        for (const float3& center : centers) {
+            boundsMin = min(boundsMin, center);
+            boundsMax = max(boundsMax, center);
+        }
+        return SpatialSort::RadixSortPermutation(SpatialSort::ComputeMortonKeys(centers, boundsMin, boundsMax));
+    };
+
+    //Blocks
+    m_AABBOrder.clear();
+    if (!m_AABBs.empty()) {
+        std::vector<float3> centers(m_AABBs.size());
+        for (size_t i = 0; i < m_AABBs.size(); i++)
+            centers[i] = (m_AABBs[i].min + m_AABBs[i].max) * 0.5f;
+        m_AABBOrder = sortByMorton(centers);
+        SpatialSort::ApplyPermutation(m_AABBs, m_AABBOrder);
+        SpatialSort::ApplyPermutation(m_AABBMaterials, m_AABBOrder);
+    }
+
+    //Triangles
+    m_TriangleOrder.clear();
+    m_VertexOrder.clear();
+    if (!m_TriPerFaceMatID.empty()) {
+        std::vector<float3> centers(m_TriPerFaceMatID.size());
+        for (size_t i = 0; i < centers.size(); i++)
+            centers[i] = (m_Vertices[m_Indices[i * 3]].position + m_Vertices[m_Indices[i * 3 + 1]].position + m_Vertices[m_Indices[i * 3 + 2]].position) / 3.f;
+        m_TriangleOrder = sortByMorton(centers);
+        SpatialSort::ApplyPermutation(m_Indices, m_TriangleOrder, 3);
+        SpatialSort::ApplyPermutation(m_TriPerFaceMatID, m_TriangleOrder);
+
+        //Vertices in order of their first use, unreferenced vertices are moved to the end
+        const uint unassigned = ~0u;
+        std::pmr::vector<uint> newIndex(m_Vertices.size(), unassigned, &m_LoadArena);
+        m_VertexOrder.reserve(m_Vertices.size());
+        for (uint& index : m_Indices) {
+            if (newIndex[index] == unassigned) {
+                newIndex[index] = uint(m_VertexOrder.size());
+                m_VertexOrder.push_back(index);
+            }
+            index = newIndex[index];
+        }
+        for (uint vertex = 0; vertex < uint(m_Vertices.size()); vertex++) {
+            if (newIndex[vertex] == unassigned)
+                m_VertexOrder.push_back(vertex);
+        }
+        SpatialSort::ApplyPermutation(m_Vertices, m_VertexOrder);
+    }
+
+    double sortTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - sortStart).count();
+    log::info("Spatially sorted %u blocks and %u triangles in %.1f ms", uint(m_AABBs.size()), uint(m_TriPerFaceMatID.size()), sortTimeMs);
+}
+
+void MinecraftSceneLoader::OptimizeTriangleMesh()
+{
+    m_TriangleRegions.clear();
+    m_RegionIndices.clear();
+    const uint numTriangles = uint(m_TriPerFaceMatID.size());
+    if (numTriangles == 0)
+        return;
+
+    auto optimizeStart = std::chrono::high_resolution_clock::now();
+    const uint numVerticesBefore = uint(m_Vertices.size());
+    const MeshOptimizer::VertexCacheStats statsBefore = MeshOptimizer::AnalyzeVertexCache(m_Indices.data(), m_Indices.size(), numVerticesBefore);
+    const size_t indexBytesBefore = m_Indices.size() * sizeof(uint);
+
+    //Consecutive triangles of the spatial order form a region until it would reference too many vertices
+    const uint unassigned = ~0u;
+    std::pmr::vector<uint> vertexRegion(numVerticesBefore, unassigned, &m_LoadArena);
+    uint regionVertices = 0;
+    for (uint triangle = 0; triangle < numTriangles; triangle++) {
+        uint newVertices = 0;
+        for (uint k = 0; k < 3; k++) {
+            uint vertex = m_Indices[triangle * 3 + k];
+            if (vertexRegion[vertex] != uint(m_TriangleRegions.size()) - 1 || m_TriangleRegions.empty())
+                newVertices++;
+        }
+        if (m_TriangleRegions.empty() || regionVertices + newVertices > TRIANGLE_REGION_MAX_VERTICES) {
+            m_TriangleRegions.push_back({ triangle, 0, 0, 0 });
+            regionVertices = 0;
+        }
+        TriangleRegion& region = m_TriangleRegions.back();
+        for (uint k = 0; k < 3; k++) {
+            uint vertex = m_Indices[triangle * 3 + k];
+            if (vertexRegion[vertex] != uint(m_TriangleRegions.size()) - 1) {
+                vertexRegion[vertex] = uint(m_TriangleRegions.size()) - 1;
+                regionVertices++;
+            }
+        }
+        region.numTriangles++;
+    }
+
+    //Optimize the regions independently. Vertices get region local indices in order of first use
+    struct RegionResult {
+        std::pmr::vector<uint> triangles;    //Old triangle indices in the new order
+        std::pmr::vector<uint> indices;      //Region local indices
+        std::pmr::vector<uint> vertices;     //Old vertex indices in the new order
+    };
+    std::pmr::vector<RegionResult> results(&m_LoadArena);
+    results.reserve(m_TriangleRegions.size());
+    for (size_t r = 0; r < m_TriangleRegions.size(); r++)
+        results.push_back({ std::pmr::vector<uint>(&m_LoadArena), std::pmr::vector<uint>(&m_LoadArena), std::pmr::vector<uint>(&m_LoadArena) });
+    //The scratch arrays of a task are freed when it ends, the arena would keep a vertex sized array per task until the end of the load
+    TaskScheduler::Get().ParallelFor(0, m_TriangleRegions.size(), 1, [&](uint64_t begin, uint64_t end) {
+        std::vector<uint> localIndex(numVerticesBefore, unassigned);
+        std::vector<uint> indices;
+        std::vector<uint> vertices;
+        for (uint64_t r = begin; r < end; r++) {
+            const TriangleRegion& region = m_TriangleRegions[r];
+            RegionResult& result = results[r];
+            indices.resize(size_t(region.numTriangles) * 3);
+            vertices.clear();
+            for (uint i = 0; i < region.numTriangles * 3; i++) {
+                uint vertex = m_Indices[size_t(region.firstTriangle) * 3 + i];
+                if (localIndex[vertex] == unassigned) {
+                    localIndex[vertex] = uint(vertices.size());
+                    vertices.push_back(vertex);
+                }
+                indices[i] = localIndex[vertex];
+            }
+            for (uint vertex : vertices)
+                localIndex[vertex] = unassigned;
+
+            std::vector<uint> triangleOrder = MeshOptimizer::OptimizeVertexCache(indices.data(), region.numTriangles, uint(vertices.size()));
+            result.triangles.resize(region.numTriangles);
+            result.indices.resize(indices.size());
+            for (uint i = 0; i < region.numTriangles; i++) {
+                result.triangles[i] = region.firstTriangle + triangleOrder[i];
+                for (uint k = 0; k < 3; k++)
+                    result.indices[i * 3 + k] = indices[triangleOrder[i] * 3 + k];
+            }
+            std::vector<uint> vertexOrder = MeshOptimizer::OptimizeVertexFetch(result.indices.data(), result.indices.size(), uint(vertices.size()));
+            result.vertices.resize(vertexOrder.size());
+            for (size_t i = 0; i < vertexOrder.size(); i++)
+                result.vertices[i] = vertices[vertexOrder[i]];
+        }
+    });
+
+    //Rebuild the scene arrays region by region, the original order is carried over from the spatial sort.
+    //All sizes are known from the region results
+    size_t numVertices = 0;
+    size_t numRegionIndices = 0;
+    for (const RegionResult& result : results) {
+        numVertices += result.vertices.size();
+        numRegionIndices += (result.indices.size() + 1) & ~size_t(1);
+    }
+    std::vector<uint> indices;
+    std::vector<VertexData> vertices;
+    std::vector<int> materialIDs;
+    std::vector<uint> triangleOrder;
+    std::vector<uint> vertexOrder;
+    indices.reserve(m_Indices.size());
+    vertices.reserve(numVertices);
+    materialIDs.reserve(numTriangles);
+    triangleOrder.reserve(numTriangles);
+    vertexOrder.reserve(numVertices);
+    m_RegionIndices.reserve(numRegionIndices + 2);
+    for (size_t r = 0; r < m_TriangleRegions.size(); r++) {
+        TriangleRegion& region = m_TriangleRegions[r];
+        const RegionResult& result = results[r];
+        region.firstTriangle = uint(materialIDs.size());
+        region.baseVertex = uint(vertices.size());
+        region.indexOffset = uint(m_RegionIndices.size() * sizeof(uint16_t));
+        for (uint triangle : result.triangles) {
+            materialIDs.push_back(m_TriPerFaceMatID[triangle]);
+            triangleOrder.push_back(m_TriangleOrder.empty() ? triangle : m_TriangleOrder[triangle]);
+        }
+        for (uint index : result.indices) {
+            indices.push_back(region.baseVertex + index);
+            m_RegionIndices.push_back(uint16_t(index));
+        }
+        //Keep the regions 4 byte aligned
+        if (m_RegionIndices.size() % 2 != 0)
+            m_RegionIndices.push_back(0);
+        for (uint vertex : result.vertices) {
+            vertices.push_back(m_Vertices[vertex]);
+            vertexOrder.push_back(m_VertexOrder.empty() ? vertex : m_VertexOrder[vertex]);
+        }
+    }
+    //The shader reads 8 bytes around each triangle, padding keeps the last read inside the buffer
+    m_RegionIndices.resize(m_RegionIndices.size() + 2, 0);
+
+    m_Indices.swap(indices);
+    m_Vertices.swap(vertices);
+    m_TriPerFaceMatID.swap(materialIDs);
+    m_TriangleOrder.swap(triangleOrder);
+    m_VertexOrder.swap(vertexOrder);
+
+    const MeshOptimizer::VertexCacheStats statsAfter = MeshOptimizer::AnalyzeVertexCache(m_Indices.data(), m_Indices.size(), uint(m_Vertices.size()));
+    const size_t indexBytesAfter = m_RegionIndices.size() * sizeof(uint16_t) + m_TriangleRegions.size() * sizeof(TriangleRegion);
+    double optimizeTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - optimizeStart).count();
+    log::info("Mesh optimization: %u triangle regions, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, index buffer %.1f KB -> %.1f KB, vertices %u -> %u, %.1f ms",
+        uint(m_TriangleRegions.size()), statsBefore.acmr, statsAfter.acmr, statsBefore.atvr, statsAfter.atvr, double(indexBytesBefore) / 1024.0,
+        double(indexBytesAfter) / 1024.0, numVerticesBefore, uint(m_Vertices.size()), optimizeTimeMs);
 }
 
 void MinecraftSceneLoader::CreateGeometryBuffers(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList)
@@ -331,12 +1516,13 @@ void MinecraftSceneLoader::CreateGeometryBuffers(nvrhi::IDevice* device, nvrhi::
     //Triangle (Vertex + Index Buffers)
     if (!m_Vertices.empty() && !m_Indices.empty())
     {
+        //16 bit indices of all triangle regions, read as raw buffer in the shader
         nvrhi::BufferDesc bufferDesc;
-        bufferDesc.byteSize = sizeof(uint) * m_Indices.size();
+        bufferDesc.byteSize = sizeof(uint16_t) * m_RegionIndices.size();
         bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
         bufferDesc.keepInitialState = true;
         bufferDesc.isAccelStructBuildInput = true;
-        bufferDesc.structStride = sizeof(uint);
+        bufferDesc.canHaveRawViews = true;
         bufferDesc.debugName = "MinecraftSceneLoader::Indices";
         m_IndexBuffer = device->createBuffer(bufferDesc);
         bufferDesc.canHaveRawViews = false;
@@ -345,23 +1531,118 @@ void MinecraftSceneLoader::CreateGeometryBuffers(nvrhi::IDevice* device, nvrhi::
         bufferDesc.debugName = "MinecraftSceneLoader::Vertices";
         m_VertexBuffer = device->createBuffer(bufferDesc);
 
-        commandList->writeBuffer(m_IndexBuffer, m_Indices.data(), sizeof(uint) * m_Indices.size());
+        commandList->writeBuffer(m_IndexBuffer, m_RegionIndices.data(), sizeof(uint16_t) * m_RegionIndices.size());
         commandList->writeBuffer(m_VertexBuffer, m_Vertices.data(), sizeof(VertexData) * m_Vertices.size());
     }
 
-    //AABB Buffer
-    if (!m_AABBs.empty())
+    //Triangle regions. Always created, the shader binds it even for scenes without triangles
     {
+        TriangleRegion dummyRegion = {};
         nvrhi::BufferDesc bufferDesc;
+        bufferDesc.byteSize = sizeof(TriangleRegion) * std::max<size_t>(m_TriangleRegions.size(), 1);
+        bufferDesc.structStride = sizeof(TriangleRegion);
         bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
         bufferDesc.keepInitialState = true;
-        bufferDesc.isAccelStructBuildInput = true;
-        bufferDesc.structStride = sizeof(float2);   //Necessary due to SPIR-V HLSL alignment bug (AABB(float6) does not work properly)
-        bufferDesc.byteSize = sizeof(AABB) * m_AABBs.size();
-        bufferDesc.debugName = "MinecraftSceneLoader::AABBs";
-        m_AABBBuffer = device->createBuffer(bufferDesc);
-        commandList->writeBuffer(m_AABBBuffer, m_AABBs.data(), sizeof(AABB) * m_AABBs.size());
+        bufferDesc.debugName = "MinecraftSceneLoader::TriangleRegions";
+        m_TriangleRegionBuffer = device->createBuffer(bufferDesc);
+        commandList->writeBuffer(m_TriangleRegionBuffer, m_TriangleRegions.empty() ? &dummyRegion : m_TriangleRegions.data(), bufferDesc.byteSize);
+    }
+
+    //Material ID Buffer for Triangles, in the order of the optimized triangles. The one of the AABBs is created with the AABBs (CreateBlockBuffers)
+    if (!m_TriPerFaceMatID.empty())
+    {
+        nvrhi::BufferDesc bufferDesc;
+        bufferDesc.byteSize = sizeof(uint) * m_TriPerFaceMatID.size();
+        bufferDesc.structStride = sizeof(uint);
+        bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+        bufferDesc.keepInitialState = true;
+        bufferDesc.debugName = "TrianglePerFaceMatID";
+        m_TriangleMaterialIDBuffer = device->createBuffer(bufferDesc);
+        commandList->writeBuffer(m_TriangleMaterialIDBuffer, m_TriPerFaceMatID.data(), sizeof(uint) * m_TriPerFaceMatID.size());
     }
+
+    CreateBlockBuffers(device, commandList);
+}
+
+void MinecraftSceneLoader::CreateBlockBuffers(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList)
+{
+    if (m_AABBs.empty())
+        return;
+
+    //AABB Buffer
+    nvrhi::BufferDesc bufferDesc;
+    bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+    bufferDesc.keepInitialState = true;
+    bufferDesc.isAccelStructBuildInput = true;
+    bufferDesc.structStride = sizeof(float2);   //Necessary due to SPIR-V HLSL alignment bug (AABB(float6) does not work properly)
+    bufferDesc.byteSize = sizeof(AABB) * m_AABBs.size();
+    bufferDesc.debugName = "MinecraftSceneLoader::AABBs";
+    m_AABBBuffer = device->createBuffer(bufferDesc);
+    commandList->writeBuffer(m_AABBBuffer, m_AABBs.data(), sizeof(AABB) * m_AABBs.size());
+
+    //Material IDs of the AABB faces
+    bufferDesc.isAccelStructBuildInput = false;
+    bufferDesc.byteSize = sizeof(AABBMaterials) * m_AABBMaterials.size();
+    bufferDesc.debugName = "AABBMatID";
+    bufferDesc.structStride = sizeof(AABBMaterials);
+    m_AABBMaterialIDBuffer = device->createBuffer(bufferDesc);
+    commandList->writeBuffer(m_AABBMaterialIDBuffer, m_AABBMaterials.data(), sizeof(AABBMaterials) * m_AABBMaterials.size());
+}
+
+void MinecraftSceneLoader::CreateOccupancyGridBuffers(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList)
+{
+    //The buffers are always bound, use a single empty element if the scene has no blocks
+    const std::vector<OccupancyRegion>& regions = m_OccupancyGrid.GetRegions();
+    const std::vector<uint64_t>& bricks = m_OccupancyGrid.GetBricks();
+    OccupancyRegion emptyRegion{};
+    uint64_t emptyBrick = 0;
+
+    nvrhi::BufferDesc bufferDesc;
+    bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+    bufferDesc.keepInitialState = true;
+
+    bufferDesc.byteSize = sizeof(OccupancyRegion) * std::max(regions.size(), size_t(1));
+    bufferDesc.structStride = sizeof(OccupancyRegion);
+    bufferDesc.debugName = "MinecraftSceneLoader::OccupancyRegions";
+    m_OccupancyRegionBuffer = device->createBuffer(bufferDesc);
+    commandList->writeBuffer(m_OccupancyRegionBuffer, regions.empty() ? &emptyRegion : regions.data(), bufferDesc.byteSize);
+
+    //Bricks are read as uint2 in the shader
+    bufferDesc.byteSize = sizeof(uint64_t) * std::max(bricks.size(), size_t(1));
+    bufferDesc.structStride = sizeof(uint2);
+    bufferDesc.debugName = "MinecraftSceneLoader::OccupancyBricks";
+    m_OccupancyBrickBuffer = device->createBuffer(bufferDesc);
+    commandList->writeBuffer(m_OccupancyBrickBuffer, bricks.empty() ? &emptyBrick : bricks.data(), bufferDesc.byteSize);
+}
+
+void MinecraftSceneLoader::BuildLightTree()
+{
+    m_LightTree.Build(m_AABBs, m_AABBMaterials, m_Vertices, m_Indices, m_TriPerFaceMatID, m_Materials);
+}
+
+void MinecraftSceneLoader::CreateEmissiveLightBuffers(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList)
+{
+    //The buffers are always bound, use a single dummy element if the scene has no emissive surfaces
+    const std::vector<LightTreeNode>& nodes = m_LightTree.GetNodes();
+    const std::vector<EmissiveLight>& lights = m_LightTree.GetLights();
+    LightTreeNode dummyNode{};
+    EmissiveLight dummyLight{};
+
+    nvrhi::BufferDesc bufferDesc;
+    bufferDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+    bufferDesc.keepInitialState = true;
+
+    bufferDesc.byteSize = sizeof(LightTreeNode) * std::max(nodes.size(), size_t(1));
+    bufferDesc.structStride = sizeof(LightTreeNode);
+    bufferDesc.debugName = "MinecraftSceneLoader::LightTree";
+    m_LightTreeBuffer = device->createBuffer(bufferDesc);
+    commandList->writeBuffer(m_LightTreeBuffer, nodes.empty() ? &dummyNode : nodes.data(), bufferDesc.byteSize);
+
+    bufferDesc.byteSize = sizeof(EmissiveLight) * std::max(lights.size(), size_t(1));
+    bufferDesc.structStride = sizeof(EmissiveLight);
+    bufferDesc.debugName = "MinecraftSceneLoader::EmissiveLights";
+    m_EmissiveLightBuffer = device->createBuffer(bufferDesc);
+    commandList->writeBuffer(m_EmissiveLightBuffer, lights.empty() ? &dummyLight : lights.data(), bufferDesc.byteSize);
 }
 
 void MinecraftSceneLoader::CreateAccelerationStructure(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList)
@@ -372,18 +1653,25 @@ void MinecraftSceneLoader::CreateAccelerationStructure(nvrhi::IDevice* device, n
     {
         nvrhi::rt::AccelStructDesc blasDesc;
         blasDesc.isTopLevel = false;
-        nvrhi::rt::GeometryDesc geometryDesc;
-        auto& triangles = geometryDesc.geometryData.triangles;
-        triangles.indexBuffer = m_IndexBuffer;
-        triangles.vertexBuffer = m_VertexBuffer;
-        triangles.indexFormat = nvrhi::Format::R32_UINT;
-        triangles.indexCount = m_Indices.size();
-        triangles.vertexFormat = nvrhi::Format::RGB32_FLOAT;
-        triangles.vertexStride = sizeof(VertexData);
-        triangles.vertexCount = m_Vertices.size();
-        geometryDesc.geometryType = nvrhi::rt::GeometryType::Triangles;
-        geometryDesc.flags = nvrhi::rt::GeometryFlags::NoDuplicateAnyHitInvocation;
-        blasDesc.bottomLevelGeometries.push_back(geometryDesc);
+        //One geometry per triangle region, the regions use 16 bit indices relative to their base vertex
+        for (size_t r = 0; r < m_TriangleRegions.size(); r++) {
+            const TriangleRegion& region = m_TriangleRegions[r];
+            uint vertexEnd = r + 1 < m_TriangleRegions.size() ? m_TriangleRegions[r + 1].baseVertex : uint(m_Vertices.size());
+            nvrhi::rt::GeometryDesc geometryDesc;
+            auto& triangles = geometryDesc.geometryData.triangles;
+            triangles.indexBuffer = m_IndexBuffer;
+            triangles.vertexBuffer = m_VertexBuffer;
+            triangles.indexFormat = nvrhi::Format::R16_UINT;
+            triangles.indexOffset = region.indexOffset;
+            triangles.indexCount = region.numTriangles * 3;
+            triangles.vertexFormat = nvrhi::Format::RGB32_FLOAT;
+            triangles.vertexOffset = uint64_t(region.baseVertex) * sizeof(VertexData);
+            triangles.vertexStride = sizeof(VertexData);
+            triangles.vertexCount = vertexEnd - region.baseVertex;
+            geometryDesc.geometryType = nvrhi::rt::GeometryType::Triangles;
+            geometryDesc.flags = nvrhi::rt::GeometryFlags::NoDuplicateAnyHitInvocation;
+            blasDesc.bottomLevelGeometries.push_back(geometryDesc);
+        }
 
         m_BlasTriangles = device->createAccelStruct(blasDesc);
         nvrhi::utils::BuildBottomLevelAccelStruct(commandList, m_BlasTriangles, blasDesc);
@@ -391,24 +1679,39 @@ void MinecraftSceneLoader::CreateAccelerationStructure(nvrhi::IDevice* device, n
 
     //Boxes
     if (m_AABBBuffer)
-    {
-        nvrhi::rt::AccelStructDesc blasDesc;
-        blasDesc.isTopLevel = false;
-        //Compaction and FastTrace flag is this BLAS contains static geometry
-        blasDesc.buildFlags = nvrhi::rt::AccelStructBuildFlags::AllowCompaction | nvrhi::rt::AccelStructBuildFlags::PreferFastTrace;
-        nvrhi::rt::GeometryDesc geometryDesc;
-        auto& aabbDesc = geometryDesc.geometryData.aabbs;
-        aabbDesc.buffer = m_AABBBuffer;
-        aabbDesc.count = m_AABBs.size();
-        aabbDesc.stride = sizeof(AABB);
-        aabbDesc.offset = 0;
-        geometryDesc.geometryType = nvrhi::rt::GeometryType::AABBs;
-        geometryDesc.flags = nvrhi::rt::GeometryFlags::NoDuplicateAnyHitInvocation;
-        blasDesc.bottomLevelGeometries.push_back(geometryDesc);
+        BuildBlockAccelStruct(device, commandList, false);
+
+    BuildTopLevelAccelStruct(device, commandList);
+}
+
+void MinecraftSceneLoader::BuildBlockAccelStruct(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList, bool allowUpdate)
+{
+    nvrhi::rt::AccelStructDesc blasDesc;
+    blasDesc.isTopLevel = false;
+    //Compaction and FastTrace flag is this BLAS contains static geometry. Edited blocks are refit, which compaction does not allow
+    blasDesc.buildFlags = allowUpdate ? nvrhi::rt::AccelStructBuildFlags::AllowUpdate | nvrhi::rt::AccelStructBuildFlags::PreferFastTrace
+        : nvrhi::rt::AccelStructBuildFlags::AllowCompaction | nvrhi::rt::AccelStructBuildFlags::PreferFastTrace;
+    nvrhi::rt::GeometryDesc geometryDesc;
+    auto& aabbDesc = geometryDesc.geometryData.aabbs;
+    aabbDesc.buffer = m_AABBBuffer;
+    aabbDesc.count = m_AABBs.size();
+    aabbDesc.stride = sizeof(AABB);
+    aabbDesc.offset = 0;
+    geometryDesc.geometryType = nvrhi::rt::GeometryType::AABBs;
+    geometryDesc.flags = nvrhi::rt::GeometryFlags::NoDuplicateAnyHitInvocation;
+    blasDesc.bottomLevelGeometries.push_back(geometryDesc);
+
+    //A compacted BLAS or one of another size can not be rebuilt in place
+    bool recreate = !m_BlasAABBs || !allowUpdate || m_BlasAABBsDesc.buildFlags != blasDesc.buildFlags
+        || m_BlasAABBsDesc.bottomLevelGeometries.empty() || m_BlasAABBsDesc.bottomLevelGeometries[0].geometryData.aabbs.count != aabbDesc.count;
+    if (recreate)
         m_BlasAABBs = device->createAccelStruct(blasDesc);
-        nvrhi::utils::BuildBottomLevelAccelStruct(commandList, m_BlasAABBs, blasDesc);
-    }
+    m_BlasAABBsDesc = blasDesc;
+    nvrhi::utils::BuildBottomLevelAccelStruct(commandList, m_BlasAABBs, blasDesc);
+}
 
+void MinecraftSceneLoader::BuildTopLevelAccelStruct(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList)
+{
     //Create Instances and TLAS
     std::vector<nvrhi::rt::InstanceDesc> instances;
 
@@ -417,7 +1720,7 @@ void MinecraftSceneLoader::CreateAccelerationStructure(nvrhi::IDevice* device, n
     {
         nvrhi::rt::InstanceDesc instanceDesc;
         instanceDesc.bottomLevelAS = m_BlasTriangles;
-        instanceDesc.instanceMask = 0xFF;
+        instanceDesc.instanceMask = INSTANCE_MASK_TRIANGLES;
         instanceDesc.flags = nvrhi::rt::InstanceFlags::TriangleFrontCounterclockwise;
         instanceDesc.instanceContributionToHitGroupIndex = 0;
         float3x4 transform = float3x4::identity();
@@ -430,7 +1733,7 @@ void MinecraftSceneLoader::CreateAccelerationStructure(nvrhi::IDevice* device, n
     {
         nvrhi::rt::InstanceDesc instanceDesc;
         instanceDesc.bottomLevelAS = m_BlasAABBs;
-        instanceDesc.instanceMask = 0xFF;
+        instanceDesc.instanceMask = INSTANCE_MASK_AABBS;
         instanceDesc.flags = nvrhi::rt::InstanceFlags::None;
         instanceDesc.instanceContributionToHitGroupIndex = 1;
         float3x4 transform = float3x4::identity();
@@ -443,7 +1746,8 @@ void MinecraftSceneLoader::CreateAccelerationStructure(nvrhi::IDevice* device, n
     nvrhi::rt::AccelStructDesc tlasDesc;
     tlasDesc.isTopLevel = true;
     tlasDesc.topLevelMaxInstances = instances.size();
-    m_TopLevelAS = device->createAccelStruct(tlasDesc);
+    if (!m_TopLevelAS || m_TopLevelAS->getDesc().topLevelMaxInstances < instances.size())
+        m_TopLevelAS = device->createAccelStruct(tlasDesc);
 
     commandList->buildTopLevelAccelStruct(m_TopLevelAS, instances.data(), instances.size());
 }
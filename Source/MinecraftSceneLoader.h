@@ -5,12 +5,37 @@
 #include <donut/engine/ShaderFactory.h>
 #include <donut/core/math/math.h>
 #include <tiny_obj_loader.h>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include "LightTree.h"
+#include "OccupancyGrid.h"
+#include "BlockEditor.h"
+#include "TextureResidency.h"
+#include "LoadArena.h"
+#include "SceneRegion.h"
+#include "PotentiallyVisibleSet.h"
+#include "TaskGraph.h"
 
 using namespace donut::math;
 #include "sharedShaderData.h" //Needs namespace donut::math;
 using namespace donut::engine;
 
-/* Class to load Minecraft Scene from Mineways .obj with individual block export enabled
+//How MinecraftSceneLoader::LoadScene handles the material textures
+struct TextureLoadSettings {
+	bool lazy = false;	//Load textures on first use instead of at load time, see MinecraftSceneLoader::UpdateTextureResidency
+	//Average linear color of the diffuse and emissive textures by their name in the .mtl, e.g. from the scene index. Missing ones are computed
+	const std::map<std::string, float4>* fallbackColors = nullptr;
+	//Eager textures are decoded on the task scheduler while the geometry is prepared and uploaded by the TextureCache, which needs the passes.
+	//Without them the textures are decoded and uploaded one after another on the loading thread
+	CommonRenderPasses* commonPasses = nullptr;
+};
+
+/* Class to load Minecraft Scene from Mineways .obj with individual block export enabled, directly from a Minecraft world folder,
+   or from a scene archive (see SceneArchive)
+   The stages of a load run as a TaskGraph: the CPU stages on the task scheduler, everything that records into the command list on the
+   loading thread, so that texture loading, geometry preparation and the uploads overlap. GetLoadReport has the timings of every stage
 */
 class MinecraftSceneLoader {
 public:
@@ -38,18 +63,124 @@ public:
 		}
 	};
 
+	//Texture names of a material as in the .mtl (relative to the scene folder), empty if the material has no such texture
+	struct MaterialTextureNames {
+		std::string diffuse;
+		std::string emissive;
+	};
+
+	struct SceneStats {
+		int numTriangles = 0;
+		int numAABBs = 0;
+		int numMaterials = 0;
+		int numUniqueVertices = 0;
+		int numIndices = 0;
+		float3 boundsMin = float3(std::numeric_limits<float>::max());
+		float3 boundsMax = float3(-std::numeric_limits<float>::max());
+	};
+
+	//Approximate memory used by a loaded scene. Textures from the TextureCache are listed separately, as they can be shared between scenes
+	struct MemoryFootprint {
+		size_t cpuBytes = 0;		//CPU copies of geometry, materials and lights
+		size_t gpuBytes = 0;		//Buffers, acceleration structures and textures owned by the scene
+	};
+
+	//CPU stages of LoadScene, in the order they run
+	enum class LoadStage {
+		Parse,		//Reading the .obj/.mtl, or importing the world
+		Geometry,	//AddGeometryToScene
+		Materials,	//Resolving and deduplicating the referenced materials
+		Buffers		//Spatial sort, mesh optimization and occupancy grid
+	};
+	//Called when a stage starts (finished = false) and when it ends, e.g. to measure the time and memory of each stage
+	using StageCallback = std::function<void(LoadStage stage, bool finished)>;
+	//Result of ApplyBlockEdits
+	struct BlockEditUpdate {
+		uint numSlots = 0;				//Block slots uploaded
+		uint numUploads = 0;			//writeBuffer calls
+		size_t uploadBytes = 0;
+		bool refit = false;				//The block BLAS was refit
+		bool rebuilt = false;			//The block BLAS was rebuilt
+		bool batchRebuild = false;		//The BLAS, occupancy grid and light tree were rebuilt after the edits stopped
+		bool buffersChanged = false;	//Buffers were recreated, binding sets that use them have to be recreated
+		double cpuMs = 0.0;
+	};
+
+	//Called at the end of LoadScene and PrepareScene with the allocations of the load temporaries, see LoadArena.
+	//Stages run on worker threads, but never two callbacks at the same time
+	using ArenaCallback = std::function<void(const LoadArena::Stats& stats)>;
+
 	MinecraftSceneLoader(std::shared_ptr<ShaderFactory> shaderFactory) : m_ShaderFactory(shaderFactory) {}
 
-	//Loads a Mineways obj scene
+	//Loads a Mineways obj scene, a scene archive or a Minecraft world folder (sceneName is the folder name)
 	bool LoadScene(std::filesystem::path scenePath , std::string sceneName, nvrhi::IDevice* device, 
-		nvrhi::CommandListHandle commandList, std::shared_ptr<TextureCache>& pTextureCache, std::shared_ptr<DescriptorTableManager>& descriptorTable);
+		nvrhi::CommandListHandle commandList, std::shared_ptr<TextureCache>& pTextureCache, std::shared_ptr<DescriptorTableManager>& descriptorTable,
+		const TextureLoadSettings& textureSettings = TextureLoadSettings());
+
+	//Runs the CPU stages of LoadScene without a device. materialSourceIndices receives the index into materials of each scene material.
+	//The scene can not be rendered afterwards, used by LoadScene and the loader benchmark
+	bool PrepareScene(const std::filesystem::path& scenePath, const std::string& sceneName, std::vector<tinyobj::material_t>& materials,
+		std::vector<uint>& materialSourceIndices);
+
+	//Loads the scene for CPU rendering: the CPU stages of LoadScene and the materials with the average colors of their textures.
+	//No GPU resources are created, the scene can not be rendered by the Renderer
+	bool LoadSceneWithoutDevice(const std::filesystem::path& scenePath, const std::string& sceneName);
+
+	//Loads only the blocks and triangles in the region, e.g. one slab of a sharded render. Archives decode only the chunks that overlap it.
+	//The bounds of the scene stats stay those of the whole scene
+	void SetLoadRegion(const SceneRegion& region) { m_LoadRegion = region; }
+	const SceneRegion& GetLoadRegion() const { return m_LoadRegion; }
+	//Loads only the cells of the potentially visible set that are flagged in visibleCells (see PotentiallyVisibleSet::GetVisibleCells),
+	//in addition to the load region. Archives do not decode the chunks of the other cells. A null set loads every cell
+	void SetLoadVisibility(std::shared_ptr<const PotentiallyVisibleSet> pvs, std::vector<uint8_t> visibleCells) {
+		m_LoadVisibility = std::move(pvs);
+		m_LoadVisibleCells = std::move(visibleCells);
+	}
 
-	// Removes all scene resources
-	bool UnloadScene(std::shared_ptr<TextureCache>& pTextureCache);
+	void SetStageCallback(StageCallback callback) { m_StageCallback = std::move(callback); }
+	void SetArenaCallback(ArenaCallback callback) { m_ArenaCallback = std::move(callback); }
+	static const char* GetStageName(LoadStage stage);
+	//Timings and critical path of the tasks of the last LoadScene, PrepareScene or LoadSceneWithoutDevice
+	const TaskGraph::Report& GetLoadReport() const { return m_LoadReport; }
+
+	// Removes all scene resources. If resetTextureCache is false, textures in the cache are kept (e.g. if shared with other scenes)
+	bool UnloadScene(std::shared_ptr<TextureCache>& pTextureCache, bool resetTextureCache = true);
 
 	//True if scene can be used
 	bool IsLoaded() { return m_sceneIsLoaded; }
 
+	//Lazy textures: requests the textures of materials that were shaded a few frames ago, switches materials whose textures are uploaded and
+	//evicts the least recently shaded materials above the budget. Call once per frame before the dispatch, does nothing if textures are loaded eagerly
+	void UpdateTextureResidency(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList, std::shared_ptr<TextureCache>& pTextureCache,
+		std::shared_ptr<DescriptorTableManager>& descriptorTable, uint64_t budgetBytes);
+	//Reads back which materials the dispatch shaded. Call after every dispatch
+	void RecordTextureFeedback(nvrhi::ICommandList* commandList);
+	//Incremented whenever material constants are rewritten after the load, e.g. by UpdateTextureResidency
+	uint64_t GetMaterialVersion() const { return m_MaterialVersion; }
+	bool HasLazyTextures() const { return m_TextureResidency != nullptr; }
+	//Residency of the lazy textures, nullptr if textures are loaded eagerly
+	const TextureResidency* GetTextureResidency() const { return m_TextureResidency.get(); }
+	//Average texture colors used as fallback by the lazy textures, by their name in the .mtl
+	const std::map<std::string, float4>& GetTextureFallbackColors() const { return m_TextureFallbackColors; }
+
+	//Runtime block edits in integer block coordinates, a cell is the block whose min corner is its position (see BlockEditor).
+	//The CPU copies change immediately, ApplyBlockEdits uploads them. Material IDs have to be scene materials. Return false if nothing changed
+	bool SetBlock(int3 cell, int materialID);
+	bool SetBlock(int3 cell, const AABBMaterials& materials);
+	bool RemoveBlock(int3 cell);
+	bool SetBlockFaceMaterial(int3 cell, BlockEditor::Face face, int materialID);
+	//True if a block box lies in the cell. Unlike the occupancy grid this does not report removed blocks
+	bool IsBlockOccupied(int3 cell) const;
+	//True while edits wait for ApplyBlockEdits, including the batch rebuild after the last edit
+	bool HasPendingBlockEdits() const;
+	//Uploads the changed block slots and refits the block BLAS, or rebuilds it if it grew or many slots were refit, and rebuilds the TLAS.
+	//k_IdleFramesBeforeRebuild calls after the last edit the BLAS, occupancy grid and light tree are rebuilt. Call once per frame before the dispatch
+	BlockEditUpdate ApplyBlockEdits(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList);
+	//Incremented whenever the geometry changes after the load
+	uint64_t GetGeometryVersion() const { return m_GeometryVersion; }
+	//Slots and edits of the block editor, nullptr before the first edit
+	const BlockEditor* GetBlockEditor() const { return m_BlockEditor.get(); }
+
 	nvrhi::rt::AccelStructHandle GetTLAS() { return m_TopLevelAS; }
 	nvrhi::BufferHandle GetAABBBuffer() { return m_AABBBuffer; }
 	nvrhi::BufferHandle GetVertexBuffer() { return m_VertexBuffer; }
@@ -57,28 +188,114 @@ public:
 	nvrhi::BufferHandle GetAABBMaterialIDBuffer() { return m_AABBMaterialIDBuffer; }
 	nvrhi::BufferHandle GetTriangleMaterialIDBuffer() { return m_TriangleMaterialIDBuffer; }
 	nvrhi::BufferHandle GetMaterialBuffer() { return m_MaterialBuffer; }
+	nvrhi::BufferHandle GetMaterialFeedbackBuffer() { return m_MaterialFeedbackBuffer; }
+	nvrhi::BufferHandle GetLightTreeBuffer() { return m_LightTreeBuffer; }
+	nvrhi::BufferHandle GetEmissiveLightBuffer() { return m_EmissiveLightBuffer; }
+	uint GetNumEmissiveLights() { return m_LightTree.GetNumLights(); }
+	nvrhi::BufferHandle GetTriangleRegionBuffer() { return m_TriangleRegionBuffer; }
+	nvrhi::BufferHandle GetOccupancyRegionBuffer() { return m_OccupancyRegionBuffer; }
+	nvrhi::BufferHandle GetOccupancyBrickBuffer() { return m_OccupancyBrickBuffer; }
+
+	//CPU copies of the scene geometry
+	const std::vector<AABB>& GetAABBs() const { return m_AABBs; }
+	const std::vector<AABBMaterials>& GetAABBMaterials() const { return m_AABBMaterials; }
+	const std::vector<VertexData>& GetVertices() const { return m_Vertices; }
+	const std::vector<uint>& GetIndices() const { return m_Indices; }
+	const std::vector<int>& GetTriangleMaterialIDs() const { return m_TriPerFaceMatID; }
+	//Original (file) order of the spatially sorted arrays, e.g. GetAABBOrder()[i] is the index the AABB i had in the file
+	const std::vector<uint>& GetAABBOrder() const { return m_AABBOrder; }
+	const std::vector<uint>& GetTriangleOrder() const { return m_TriangleOrder; }
+	const std::vector<uint>& GetVertexOrder() const { return m_VertexOrder; }
+	//Block occupancy for empty space skipping on the CPU, e.g. for picking and baking
+	const OccupancyGrid& GetOccupancyGrid() const { return m_OccupancyGrid; }
+
+	const SceneStats& GetSceneStats() const { return m_sceneStats; }
+	const std::vector<Material>& GetMaterials() const { return m_Materials; }
+	//Diffuse texture (relative to the scene folder) of every alpha tested material, empty for the other materials
+	const std::vector<std::string>& GetAlphaTestTextures() const { return m_AlphaTestTextures; }
+	const std::vector<MaterialTextureNames>& GetMaterialTextureNames() const { return m_MaterialTextureNames; }
+	MemoryFootprint GetMemoryFootprint() const;
+	//Textures that were loaded through the TextureCache for this scene
+	const std::vector<std::shared_ptr<LoadedTexture>>& GetCachedTextures() const { return m_CachedTextures; }
+	//Approximate GPU size of a texture including its mip chain
+	static size_t GetTextureByteSize(const nvrhi::ITexture* texture);
 
 private:
-	struct SceneStats {
-		int numTriangles = 0;
-		int numAABBs = 0;
-		int numMaterials = 0;
-		int numUniqueVertices = 0;
-		int numIndices = 0;
+	//Tasks of the CPU stages in a load graph
+	struct PrepareTasks {
+		TaskGraph::TaskID materials = 0;	//Materials resolved, the textures to load are known
+		TaskGraph::TaskID geometry = 0;		//Geometry sorted and optimized, the order of the primitives is final
+		TaskGraph::TaskID occupancy = 0;	//Occupancy grid built
 	};
+	//Adds the CPU stages shared by LoadScene and PrepareScene to the graph, the load temporaries are left in the arena. A failing stage cancels the graph
+	PrepareTasks AddPrepareTasks(TaskGraph& graph, const std::filesystem::path& scenePath, const std::string& sceneName,
+		std::vector<tinyobj::material_t>& materials, std::vector<uint>& materialSourceIndices);
+	//Runs the CPU stages on their own. Returns false if the scene could not be read
+	bool PrepareSceneData(const std::filesystem::path& scenePath, const std::string& sceneName, std::vector<tinyobj::material_t>& materials,
+		std::vector<uint>& materialSourceIndices);
+	//Frees the load temporaries and reports their allocations
+	void ReleaseLoadArena();
 
-	//Adds all "materials" to the scene structures (CPU) and loads textures to the GPU
-	void AddMaterialsToScene(const std::vector<tinyobj::material_t>& materials, nvrhi::IDevice* device, nvrhi::CommandListHandle commandList,
-		std::shared_ptr<TextureCache>& pTextureCache, std::shared_ptr<DescriptorTableManager>& descriptorTable);
-	//Creates the materials ID buffers
+	//Removes unreferenced materials and collapses identical ones. Remaps the geometry material IDs and
+	//returns the source index of each remaining material. Needs to be called after AddGeometryToScene
+	std::vector<uint> DeduplicateMaterials(const std::vector<tinyobj::material_t>& materials);
+	//Adds the "materials" selected by DeduplicateMaterials to the scene structures (CPU) and loads textures to the GPU.
+	//With lazy textures the materials get the average texture colors and a TextureResidency instead
+	void AddMaterialsToScene(const std::vector<tinyobj::material_t>& materials, const std::vector<uint>& uniqueSourceIndices, nvrhi::IDevice* device, nvrhi::CommandListHandle commandList,
+		std::shared_ptr<TextureCache>& pTextureCache, std::shared_ptr<DescriptorTableManager>& descriptorTable, const std::filesystem::path& scenePath,
+		const TextureLoadSettings& textureSettings);
+	//Lazy variant of AddMaterialsToScene: materials get the average colors of their textures, the textures are left to the TextureResidency.
+	//Without a device only the materials are created
+	void AddLazyMaterialsToScene(const std::vector<tinyobj::material_t>& materials, const std::vector<uint>& uniqueSourceIndices, nvrhi::IDevice* device,
+		const std::filesystem::path& scenePath, const TextureLoadSettings& textureSettings);
+	//Decodes the textures AddMaterialsToScene loads into the TextureCache in parallel, without uploading them
+	void DecodeMaterialTextures(const std::vector<tinyobj::material_t>& materials, const std::vector<uint>& uniqueSourceIndices, TextureCache& textureCache);
+	//Creates the material constant and feedback buffers
 	void CreateMaterialsBuffers(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList);
 
+	//Reads a Mineways .obj and its .mtl and adds the geometry to the scene
+	bool AddObjToScene(const std::filesystem::path& objFile, std::vector<tinyobj::material_t>& materials);
+	//Imports the blocks of a Minecraft world folder (see AnvilImporter) and adds them to the scene
+	bool AddAnvilWorldToScene(const std::filesystem::path& scenePath, const std::string& worldName, std::vector<tinyobj::material_t>& materials);
+	//Decodes a scene archive (see SceneArchive) into the scene structures
+	bool AddArchiveToScene(const std::filesystem::path& archiveFile, std::vector<tinyobj::material_t>& materials);
+	//Removes the blocks and triangles outside the load region or in culled cells of the load visibility and the vertices only they used
+	void ClipToLoadRegion();
+	bool IsLoaded(float3 position) const;
 	//Adds the geometry to the scene structures on the CPU
 	void AddGeometryToScene(const tinyobj::attrib_t& attribs, const std::vector<tinyobj::shape_t>& shapes);
+	//Merged face exports: turns the unit quads on the block grid of the triangle shapes back into blocks (see VoxelReconstruction).
+	//faceInBlock is indexed with faceOffsets[shape] + face and marks the triangles that became block faces. Returns their number
+	size_t ReconstructBlocks(const tinyobj::attrib_t& attribs, const std::vector<tinyobj::shape_t>& shapes, std::pmr::vector<size_t>& faceOffsets,
+		std::pmr::vector<uint8_t>& faceInBlock);
+	//Sorts blocks and triangles along a Morton curve and renumbers the vertices in order of first use, so that neighbouring
+	//rays read neighbouring memory. Needs to be called after AddGeometryToScene and before anything refers to primitive indices
+	void SortPrimitivesSpatially();
+	//Splits the triangles into regions with at most TRIANGLE_REGION_MAX_VERTICES vertices (shared vertices are duplicated),
+	//reorders the triangles of each region for the vertex cache and its vertices for fetch locality, and packs 16-bit indices.
+	//Needs to be called after SortPrimitivesSpatially
+	void OptimizeTriangleMesh();
 	//Creates and uploads the geometry buffers to the GPU
 	void CreateGeometryBuffers(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList);
+	//Creates and uploads the AABB and AABB material ID buffers, also when block edits grew the arrays
+	void CreateBlockBuffers(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList);
+	//Uploads the occupancy grid to the GPU
+	void CreateOccupancyGridBuffers(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList);
+	//Builds the light tree over all emissive surfaces. Needs the materials and the final primitive order
+	void BuildLightTree();
+	//Uploads the light tree to the GPU
+	void CreateEmissiveLightBuffers(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList);
 	//Creates the Acceleration Structure for Ray Tracing
 	void CreateAccelerationStructure(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList);
+	//Builds the block BLAS, it is recreated if the number of boxes or allowUpdate changed. Loaded scenes are compacted, edited ones can be refit
+	void BuildBlockAccelStruct(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList, bool allowUpdate);
+	//Builds the TLAS over the triangle and block BLAS, it is recreated if it has too few instances
+	void BuildTopLevelAccelStruct(nvrhi::IDevice* device, nvrhi::CommandListHandle commandList);
+	//Creates the block editor on the first edit
+	BlockEditor& GetOrCreateBlockEditor();
+	//Marks a placed block in the occupancy grid and records what has to be uploaded
+	void MarkOccupiedCell(int3 cell);
+	bool IsValidMaterialID(int materialID) const { return materialID >= 0 && materialID < int(m_Materials.size()); }
 
 	//Initializes the compute shader to generate a MetalRoughness texture from two separate textures
 	void InitMetalRoughTexGenCS(nvrhi::IDevice* device);
@@ -88,7 +305,19 @@ private:
 	//Removes compute shader resources
 	void RemoveMetalRoughTexGenCS();
 
+	void NotifyStage(LoadStage stage, bool finished) {
+		if (m_StageCallback)
+			m_StageCallback(stage, finished);
+	}
+
 	bool m_sceneIsLoaded = false;
+	StageCallback m_StageCallback;
+	ArenaCallback m_ArenaCallback;
+	LoadArena m_LoadArena;		//Temporaries of the running load, released at its end
+	TaskGraph::Report m_LoadReport;
+	SceneRegion m_LoadRegion;	//Part of the scene that is loaded, everything by default
+	std::shared_ptr<const PotentiallyVisibleSet> m_LoadVisibility;	//Cells of the scene that are loaded if set
+	std::vector<uint8_t> m_LoadVisibleCells;
 	SceneStats m_sceneStats = {};
 	std::vector<AABB> m_AABBs;
 	std::vector<AABBMaterials> m_AABBMaterials;
@@ -97,22 +326,67 @@ private:
 	std::vector<VertexData> m_Vertices;
 	std::vector<int> m_TriPerFaceMatID;
 
+	//Triangle regions (one BLAS geometry each) and their 16-bit indices for the GPU. m_Indices keeps the scene wide 32-bit indices
+	std::vector<TriangleRegion> m_TriangleRegions;
+	std::vector<uint16_t> m_RegionIndices;
+
+	//Original index of each primitive and vertex after the spatial sort and the mesh optimization
+	std::vector<uint> m_AABBOrder;
+	std::vector<uint> m_TriangleOrder;
+	std::vector<uint> m_VertexOrder;
+
 	std::vector<Material> m_Materials;
+	std::vector<std::string> m_AlphaTestTextures;	//By material ID, see GetAlphaTestTextures
+	std::vector<MaterialTextureNames> m_MaterialTextureNames;	//By material ID
+
+	LightTree m_LightTree;		//Light BVH over all emissive block faces and triangles
+	OccupancyGrid m_OccupancyGrid;	//Two level bitmask of the cells covered by blocks
+
+	std::vector<std::shared_ptr<LoadedTexture>> m_CachedTextures;	//Textures owned by the TextureCache that are used by the materials
+
+	//Runtime block edits
+	static const uint k_BlockEditReserveSlots = 4096;		//Free slots appended on the first edit
+	static const uint k_MaxRefitSlots = 4096;				//Slots refit since the last BLAS build above which an edit rebuilds it
+	static const uint k_IdleFramesBeforeRebuild = 60;		//ApplyBlockEdits calls without edits before the batch rebuild
+	std::unique_ptr<BlockEditor> m_BlockEditor;
+	uint m_RefitSlots = 0;					//Slots refit since the last build of the block BLAS
+	uint m_BlockEditIdleFrames = 0;
+	bool m_BlockRebuildPending = false;		//Edits since the last batch rebuild
+	std::vector<uint> m_DirtyOccupancyBricks;	//Bricks whose mask changed, uploaded by ApplyBlockEdits
+	bool m_OccupancyBuffersDirty = false;	//Bricks were inserted, both occupancy buffers are recreated
+	bool m_OccupancyGridOutdated = false;	//A block was placed outside of the grid, it is rebuilt
+	uint64_t m_GeometryVersion = 0;
+
+	//Lazy textures
+	std::unique_ptr<TextureResidency> m_TextureResidency;
+	uint64_t m_MaterialVersion = 0;
+	std::map<std::string, float4> m_TextureFallbackColors;
 
 	//Acceleration Structures
 	nvrhi::rt::AccelStructHandle m_BlasTriangles;	//Triangle Bottom Level Acceleration Structure for all non-block geometry
 	nvrhi::rt::AccelStructHandle m_BlasAABBs;		//AABB Bottom Level Acceleration Structure for all blocks
 	nvrhi::rt::AccelStructHandle m_TopLevelAS;		//Top Level Acceleration Structure for the scene
+	nvrhi::rt::AccelStructDesc m_BlasAABBsDesc;		//Description m_BlasAABBs was created with, used for refits
 
 	//GPU Geometry Buffers
 	nvrhi::BufferHandle m_AABBBuffer;
 	nvrhi::BufferHandle m_VertexBuffer;
 	nvrhi::BufferHandle m_IndexBuffer;
+	nvrhi::BufferHandle m_TriangleRegionBuffer;
 
 	//GPU Material Buffers/Textures
 	nvrhi::BufferHandle m_AABBMaterialIDBuffer;
 	nvrhi::BufferHandle m_TriangleMaterialIDBuffer;
 	nvrhi::BufferHandle m_MaterialBuffer;
+	nvrhi::BufferHandle m_MaterialFeedbackBuffer;	//Nonzero for every material the ray tracing shader shaded since the last RecordTextureFeedback
+
+	//GPU Emissive Light Buffers
+	nvrhi::BufferHandle m_LightTreeBuffer;
+	nvrhi::BufferHandle m_EmissiveLightBuffer;
+
+	//GPU Occupancy Grid Buffers
+	nvrhi::BufferHandle m_OccupancyRegionBuffer;
+	nvrhi::BufferHandle m_OccupancyBrickBuffer;
 
 	//Create and handle metal rough textures
 	std::shared_ptr<ShaderFactory> m_ShaderFactory;
@@ -0,0 +1,255 @@
+#include "OccupancyGrid.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+using namespace donut;
+
+static uint CountBits(uint64_t mask) {
+	mask = mask - ((mask >> 1) & 0x5555555555555555ull);
+	mask = (mask & 0x3333333333333333ull) + ((mask >> 2) & 0x3333333333333333ull);
+	mask = (mask + (mask >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+	return uint((mask * 0x0101010101010101ull) >> 56);
+}
+
+static uint64_t GetBrickMask(const OccupancyRegion& region) {
+	return uint64_t(region.brickMask.x) | (uint64_t(region.brickMask.y) << 32);
+}
+
+//Removed blocks are collapsed to a point (see BlockEditor), they occupy no cell
+static bool IsPoint(const AABB& aabb) {
+	return all(aabb.min == aabb.max);
+}
+
+//Bit of a non-negative position inside its 4x4x4 block
+static uint64_t GetBit(int3 position) {
+	return uint64_t(1) << ((position.x & 3) + 4 * (position.y & 3) + 16 * (position.z & 3));
+}
+
+void OccupancyGrid::Clear()
+{
+	m_Origin = int3(0);
+	m_NumRegions = uint3(0);
+	m_Regions.clear();
+	m_Bricks.clear();
+}
+
+void OccupancyGrid::Build(const std::vector<AABB>& aabbs)
+{
+	auto buildStart = std::chrono::high_resolution_clock::now();
+	Clear();
+	if (aabbs.empty())
+		return;
+
+	float3 boundsMin = float3(std::numeric_limits<float>::max());
+	float3 boundsMax = float3(-std::numeric_limits<float>::max());
+	for (const AABB& aabb : aabbs) {
+		if (IsPoint(aabb))
+			continue;
+		boundsMin = min(boundsMin, aabb.min);
+		boundsMax = max(boundsMax, aabb.max);
+	}
+	if (any(boundsMin > boundsMax))
+		return;
+	m_Origin = int3(int(std::floor(boundsMin.x)), int(std::floor(boundsMin.y)), int(std::floor(boundsMin.z)));
+	const int3 numCells = max(int3(int(std::ceil(boundsMax.x)), int(std::ceil(boundsMax.y)), int(std::ceil(boundsMax.z))) - m_Origin, int3(1));
+	m_NumRegions = uint3((numCells + k_RegionSize - 1) / k_RegionSize);
+	m_Regions.resize(size_t(m_NumRegions.x) * m_NumRegions.y * m_NumRegions.z, OccupancyRegion{});
+
+	//Grid local range of cells covered by an AABB. Flat AABBs still occupy one cell
+	auto getCellRange = [&](const AABB& aabb, int3& cellMin, int3& cellMax) {
+		cellMin = int3(int(std::floor(aabb.min.x)), int(std::floor(aabb.min.y)), int(std::floor(aabb.min.z))) - m_Origin;
+		cellMax = int3(int(std::ceil(aabb.max.x)), int(std::ceil(aabb.max.y)), int(std::ceil(aabb.max.z))) - m_Origin - 1;
+		cellMax = max(cellMax, cellMin);
+	};
+	auto getRegion = [&](int3 cell) -> OccupancyRegion& {
+		int3 region = cell / k_RegionSize;
+		return m_Regions[(size_t(region.z) * m_NumRegions.y + region.y) * m_NumRegions.x + region.x];
+	};
+
+	//Brick masks of the regions
+	for (const AABB& aabb : aabbs) {
+		if (IsPoint(aabb))
+			continue;
+		int3 cellMin, cellMax;
+		getCellRange(aabb, cellMin, cellMax);
+		for (int z = cellMin.z / k_BrickSize; z <= cellMax.z / k_BrickSize; z++) {
+			for (int y = cellMin.y / k_BrickSize; y <= cellMax.y / k_BrickSize; y++) {
+				for (int x = cellMin.x / k_BrickSize; x <= cellMax.x / k_BrickSize; x++) {
+					int3 brick = int3(x, y, z);
+					OccupancyRegion& region = getRegion(brick * k_BrickSize);
+					uint64_t mask = GetBrickMask(region) | GetBit(brick);
+					region.brickMask = uint2(uint(mask), uint(mask >> 32));
+				}
+			}
+		}
+	}
+
+	//Non-empty bricks are stored in region order
+	uint numBricks = 0;
+	for (OccupancyRegion& region : m_Regions) {
+		region.firstBrick = numBricks;
+		numBricks += CountBits(GetBrickMask(region));
+	}
+	m_Bricks.resize(numBricks, 0);
+
+	//Cell masks of the bricks
+	for (const AABB& aabb : aabbs) {
+		if (IsPoint(aabb))
+			continue;
+		int3 cellMin, cellMax;
+		getCellRange(aabb, cellMin, cellMax);
+		for (int z = cellMin.z; z <= cellMax.z; z++) {
+			for (int y = cellMin.y; y <= cellMax.y; y++) {
+				for (int x = cellMin.x; x <= cellMax.x; x++) {
+					int3 cell = int3(x, y, z);
+					const OccupancyRegion& region = getRegion(cell);
+					uint64_t brickBit = GetBit(cell / k_BrickSize);
+					m_Bricks[region.firstBrick + CountBits(GetBrickMask(region) & (brickBit - 1))] |= GetBit(cell);
+				}
+			}
+		}
+	}
+
+	double buildTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildStart).count();
+	log::info("OccupancyGrid: %ux%ux%u regions, %u non-empty bricks, %.1f KB, built in %.1f ms", m_NumRegions.x, m_NumRegions.y, m_NumRegions.z,
+		numBricks, double(GetByteSize()) / 1024.0, buildTimeMs);
+}
+
+OccupancyGrid::MarkResult OccupancyGrid::MarkCell(int3 cell, uint* brickIndex)
+{
+	int3 localCell = cell - m_Origin;
+	const int3 numCells = int3(m_NumRegions) * k_RegionSize;
+	if (IsEmpty() || any(localCell < int3(0)) || any(localCell >= numCells))
+		return MarkResult::OutsideGrid;
+
+	int3 region = localCell / k_RegionSize;
+	size_t regionIndex = (size_t(region.z) * m_NumRegions.y + region.y) * m_NumRegions.x + region.x;
+	OccupancyRegion& regionData = m_Regions[regionIndex];
+	uint64_t brickMask = GetBrickMask(regionData);
+	uint64_t brickBit = GetBit(localCell / k_BrickSize);
+	uint index = regionData.firstBrick + CountBits(brickMask & (brickBit - 1));
+
+	MarkResult result = MarkResult::BrickChanged;
+	if ((brickMask & brickBit) == 0) {
+		//Bricks are stored in region order, the bricks of the later regions move by one
+		m_Bricks.insert(m_Bricks.begin() + index, 0);
+		brickMask |= brickBit;
+		regionData.brickMask = uint2(uint(brickMask), uint(brickMask >> 32));
+		for (size_t r = regionIndex + 1; r < m_Regions.size(); r++)
+			m_Regions[r].firstBrick++;
+		result = MarkResult::BrickInserted;
+	}
+	else if (m_Bricks[index] & GetBit(localCell))
+		return MarkResult::Unchanged;
+
+	m_Bricks[index] |= GetBit(localCell);
+	if (brickIndex)
+		*brickIndex = index;
+	return result;
+}
+
+int OccupancyGrid::GetEmptySize(int3 localCell) const
+{
+	int3 region = localCell / k_RegionSize;
+	const OccupancyRegion& regionData = m_Regions[(size_t(region.z) * m_NumRegions.y + region.y) * m_NumRegions.x + region.x];
+	uint64_t brickMask = GetBrickMask(regionData);
+	uint64_t brickBit = GetBit(localCell / k_BrickSize);
+	if ((brickMask & brickBit) == 0)
+		return brickMask == 0 ? k_RegionSize : k_BrickSize;
+
+	uint64_t cellMask = m_Bricks[regionData.firstBrick + CountBits(brickMask & (brickBit - 1))];
+	return (cellMask & GetBit(localCell)) == 0 ? 1 : 0;
+}
+
+bool OccupancyGrid::IsOccupied(int3 cell) const
+{
+	int3 localCell = cell - m_Origin;
+	const int3 numCells = int3(m_NumRegions) * k_RegionSize;
+	if (IsEmpty() || any(localCell < int3(0)) || any(localCell >= numCells))
+		return false;
+	return GetEmptySize(localCell) == 0;
+}
+
+bool OccupancyGrid::Trace(float3 origin, float3 direction, float tMin, float tMax, TraceResult& result, uint maxSteps) const
+{
+	result = TraceResult();
+	if (IsEmpty())
+		return false;
+
+	//Clip the segment to the grid bounds, in grid local coordinates
+	const float3 localOrigin = origin - float3(m_Origin);
+	const int3 numCells = int3(m_NumRegions) * k_RegionSize;
+	float3 invDirection;
+	float tEnter = tMin;
+	float tExit = tMax;
+	for (int axis = 0; axis < 3; axis++) {
+		if (direction[axis] == 0.f) {
+			invDirection[axis] = 0.f;
+			if (localOrigin[axis] < 0.f || localOrigin[axis] > float(numCells[axis]))
+				return false;
+			continue;
+		}
+		invDirection[axis] = 1.f / direction[axis];
+		float t0 = -localOrigin[axis] * invDirection[axis];
+		float t1 = (float(numCells[axis]) - localOrigin[axis]) * invDirection[axis];
+		tEnter = std::max(tEnter, std::min(t0, t1));
+		tExit = std::min(tExit, std::max(t0, t1));
+	}
+
+	if (tEnter > tExit)
+		return false;
+
+	float t = tEnter;
+	float3 entry = localOrigin + direction * t;
+	int3 cell = clamp(int3(int(std::floor(entry.x)), int(std::floor(entry.y)), int(std::floor(entry.z))), int3(0), numCells - 1);
+	while (true) {
+		if (result.steps >= maxSteps) {
+			result.aborted = true;
+			return false;
+		}
+		result.steps++;
+
+		int emptySize = GetEmptySize(cell);
+		if (emptySize == 0) {
+			result.hit = true;
+			result.t = t;
+			result.cell = cell + m_Origin;
+			return true;
+		}
+
+		//Leave the empty cube through the nearest face
+		int3 cubeMin = (cell / emptySize) * emptySize;
+		float3 tFace = float3(std::numeric_limits<float>::max());
+		float tNext = std::numeric_limits<float>::max();
+		for (int axis = 0; axis < 3; axis++) {
+			if (direction[axis] != 0.f) {
+				float plane = float(direction[axis] > 0.f ? cubeMin[axis] + emptySize : cubeMin[axis]);
+				tFace[axis] = (plane - localOrigin[axis]) * invDirection[axis];
+				tNext = std::min(tNext, tFace[axis]);
+			}
+		}
+		if (tNext > tExit)
+			return false;
+		t = std::max(t, tNext);
+
+		//Step over the exit faces, the other axes stay inside the cube
+		float3 position = localOrigin + direction * t;
+		for (int axis = 0; axis < 3; axis++) {
+			if (tFace[axis] <= tNext)
+				cell[axis] = direction[axis] > 0.f ? cubeMin[axis] + emptySize : cubeMin[axis] - 1;
+			else
+				cell[axis] = clamp(int(std::floor(position[axis])), cubeMin[axis], cubeMin[axis] + emptySize - 1);
+		}
+		if (any(cell < int3(0)) || any(cell >= numCells))
+			return false;
+	}
+}
+
+bool OccupancyGrid::IsSegmentEmpty(float3 origin, float3 direction, float tMin, float tMax, uint maxSteps) const
+{
+	TraceResult result;
+	return !Trace(origin, direction, tMin, tMax, result, maxSteps) && !result.aborted;
+}
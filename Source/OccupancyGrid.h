@@ -0,0 +1,63 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <vector>
+
+using namespace donut::math;
+#include "sharedShaderData.h" //Needs namespace donut::math;
+
+/* Two level occupancy bitmask over the block grid, used to skip empty space.
+   Every 4x4x4 brick of unit cells has a 64-bit mask, every region of 4x4x4 bricks has a 64-bit mask of its non-empty bricks.
+   Only non-empty bricks are stored. The same layout is uploaded to the GPU (OccupancyRegion, uint2 bricks)
+*/
+class OccupancyGrid {
+public:
+	static const int k_BrickSize = OCCUPANCY_BRICK_SIZE;
+	static const int k_RegionSize = OCCUPANCY_REGION_SIZE;
+
+	struct TraceResult {
+		bool hit = false;			//An occupied cell was found
+		bool aborted = false;		//The step limit was reached before the ray left the segment
+		float t = 0.f;				//Ray distance at which the occupied cell is entered
+		int3 cell = int3(0);		//World position of the occupied cell
+		uint steps = 0;
+	};
+
+	enum class MarkResult {
+		Unchanged,			//The cell was occupied already
+		BrickChanged,		//The mask of an existing brick changed
+		BrickInserted,		//A brick was inserted, the bricks after it and the firstBrick of the later regions moved
+		OutsideGrid			//The cell is outside of the grid, it has to be rebuilt
+	};
+
+	//Marks every cell that overlaps an AABB
+	void Build(const std::vector<AABB>& aabbs);
+	void Clear();
+	//Marks a single cell as occupied, e.g. for a placed block. brickIndex receives the index of its brick.
+	//Cells are never cleared, the grid stays conservative when blocks are removed until it is rebuilt
+	MarkResult MarkCell(int3 cell, uint* brickIndex = nullptr);
+
+	bool IsEmpty() const { return m_Bricks.empty(); }
+	//True if the cell at the world position contains geometry
+	bool IsOccupied(int3 cell) const;
+
+	//Hierarchical DDA from tMin to tMax, skips empty regions and bricks at once. Returns true if an occupied cell was hit.
+	//If maxSteps is reached, result.aborted is set and the segment has to be treated as not empty
+	bool Trace(float3 origin, float3 direction, float tMin, float tMax, TraceResult& result, uint maxSteps = ~0u) const;
+	//True if the ray segment provably passes no occupied cell
+	bool IsSegmentEmpty(float3 origin, float3 direction, float tMin, float tMax, uint maxSteps = ~0u) const;
+
+	float3 GetOrigin() const { return float3(m_Origin); }
+	uint3 GetNumRegions() const { return m_NumRegions; }
+	const std::vector<OccupancyRegion>& GetRegions() const { return m_Regions; }
+	const std::vector<uint64_t>& GetBricks() const { return m_Bricks; }
+	size_t GetByteSize() const { return m_Regions.size() * sizeof(OccupancyRegion) + m_Bricks.size() * sizeof(uint64_t); }
+
+private:
+	//Size of the empty cube around the grid local cell: k_RegionSize, k_BrickSize or 1 if it is empty, 0 if the cell is occupied
+	int GetEmptySize(int3 localCell) const;
+
+	int3 m_Origin = int3(0);			//World position of the first cell
+	uint3 m_NumRegions = uint3(0);
+	std::vector<OccupancyRegion> m_Regions;
+	std::vector<uint64_t> m_Bricks;		//Cell masks of the non-empty bricks, bit x + 4 * y + 16 * z
+};
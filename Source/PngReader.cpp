@@ -0,0 +1,188 @@
+#include "PngReader.h"
+#include "Inflate.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+
+static uint32_t ReadBigEndian(const uint8_t* data) {
+	return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | uint32_t(data[3]);
+}
+
+static uint8_t PaethPredictor(int a, int b, int c) {
+	int p = a + b - c;
+	int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+	if (pa <= pb && pa <= pc)
+		return uint8_t(a);
+	return uint8_t(pb <= pc ? b : c);
+}
+
+//Reverses the per row filters in place. Every row starts with its filter type, which is kept
+static bool Unfilter(std::vector<uint8_t>& data, uint height, size_t stride, size_t filterBytes) {
+	if (data.size() < (stride + 1) * height)
+		return false;
+	for (uint y = 0; y < height; y++) {
+		uint8_t* row = &data[y * (stride + 1)];
+		const uint8_t* previous = y > 0 ? row - (stride + 1) : nullptr;
+		uint8_t filter = row[0];
+		row++;
+		if (previous)
+			previous++;
+		for (size_t i = 0; i < stride; i++) {
+			int a = i >= filterBytes ? row[i - filterBytes] : 0;
+			int b = previous ? previous[i] : 0;
+			int c = previous && i >= filterBytes ? previous[i - filterBytes] : 0;
+			switch (filter) {
+			case 0: break;
+			case 1: row[i] = uint8_t(row[i] + a); break;
+			case 2: row[i] = uint8_t(row[i] + b); break;
+			case 3: row[i] = uint8_t(row[i] + ((a + b) >> 1)); break;
+			case 4: row[i] = uint8_t(row[i] + PaethPredictor(a, b, c)); break;
+			default: return false;
+			}
+		}
+	}
+	return true;
+}
+
+namespace PngReader {
+	bool Read(const std::filesystem::path& file, Image& image)
+	{
+		std::ifstream stream(file, std::ios::binary);
+		if (!stream)
+			return false;
+		std::vector<uint8_t> png((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+		const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		if (png.size() < 8 || !std::equal(signature, signature + 8, png.begin()))
+			return false;
+
+		uint width = 0, height = 0;
+		uint8_t bitDepth = 0, colorType = 0, interlace = 0;
+		std::vector<uint8_t> palette, transparency, compressed;
+		for (size_t offset = 8; offset + 12 <= png.size();) {
+			uint32_t length = ReadBigEndian(&png[offset]);
+			const uint8_t* type = &png[offset + 4];
+			const uint8_t* chunk = &png[offset + 8];
+			if (length > png.size() - offset - 12)
+				return false;
+			if (std::equal(type, type + 4, "IHDR") && length >= 13) {
+				width = ReadBigEndian(chunk);
+				height = ReadBigEndian(chunk + 4);
+				bitDepth = chunk[8];
+				colorType = chunk[9];
+				interlace = chunk[12];
+			}
+			else if (std::equal(type, type + 4, "PLTE"))
+				palette.assign(chunk, chunk + length);
+			else if (std::equal(type, type + 4, "tRNS"))
+				transparency.assign(chunk, chunk + length);
+			else if (std::equal(type, type + 4, "IDAT"))
+				compressed.insert(compressed.end(), chunk, chunk + length);
+			else if (std::equal(type, type + 4, "IEND"))
+				break;
+			offset += 12 + size_t(length);
+		}
+
+		uint channels = 0;
+		switch (colorType) {
+		case 0: channels = 1; break;	//Gray
+		case 2: channels = 3; break;	//RGB
+		case 3: channels = 1; break;	//Palette
+		case 4: channels = 2; break;	//Gray and alpha
+		case 6: channels = 4; break;	//RGBA
+		default: return false;
+		}
+		if (width == 0 || height == 0 || interlace != 0 || (bitDepth != 1 && bitDepth != 2 && bitDepth != 4 && bitDepth != 8 && bitDepth != 16))
+			return false;
+		if (colorType == 3 && palette.size() < 3)
+			return false;
+
+		std::vector<uint8_t> data;
+		if (!Inflate::Zlib(compressed.data(), compressed.size(), data))
+			return false;
+		const size_t bitsPerPixel = size_t(channels) * bitDepth;
+		const size_t stride = (size_t(width) * bitsPerPixel + 7) / 8;
+		if (!Unfilter(data, height, stride, std::max<size_t>(bitsPerPixel / 8, 1)))
+			return false;
+
+		//Samples are reduced to 8 bit, low bit depths are scaled up except for palette indices
+		const uint maxValue = (1u << std::min<uint>(bitDepth, 8)) - 1;
+		auto getSample = [&](const uint8_t* row, uint x, uint channel) -> uint {
+			size_t sample = size_t(x) * channels + channel;
+			if (bitDepth == 16)
+				return row[sample * 2];
+			if (bitDepth == 8)
+				return row[sample];
+			size_t bit = sample * bitDepth;
+			return (row[bit / 8] >> (8 - bitDepth - bit % 8)) & maxValue;
+		};
+		auto scale = [&](uint value) { return uint8_t(value * 255 / maxValue); };
+
+		image.width = width;
+		image.height = height;
+		image.rgba.resize(size_t(width) * height * 4);
+		for (uint y = 0; y < height; y++) {
+			const uint8_t* row = &data[y * (stride + 1) + 1];
+			for (uint x = 0; x < width; x++) {
+				uint8_t* texel = &image.rgba[(size_t(y) * width + x) * 4];
+				texel[3] = 255;
+				if (colorType == 3) {
+					uint index = getSample(row, x, 0);
+					if (size_t(index) * 3 + 2 >= palette.size())
+						return false;
+					texel[0] = palette[index * 3];
+					texel[1] = palette[index * 3 + 1];
+					texel[2] = palette[index * 3 + 2];
+					if (index < transparency.size())
+						texel[3] = transparency[index];
+				}
+				else if (colorType == 0 || colorType == 4) {
+					uint gray = getSample(row, x, 0);
+					texel[0] = texel[1] = texel[2] = scale(gray);
+					if (colorType == 4)
+						texel[3] = scale(getSample(row, x, 1));
+					else if (transparency.size() >= 2 && gray == (bitDepth == 16 ? transparency[0] : transparency[1]))
+						texel[3] = 0;
+				}
+				else {
+					for (uint c = 0; c < 3; c++)
+						texel[c] = scale(getSample(row, x, c));
+					if (colorType == 6) {
+						texel[3] = scale(getSample(row, x, 3));
+					}
+					else if (transparency.size() >= 6) {
+						//Color key, compared with the high byte of 16-bit samples
+						uint keyOffset = bitDepth == 16 ? 0 : 1;
+						if (texel[0] == transparency[keyOffset] && texel[1] == transparency[2 + keyOffset] && texel[2] == transparency[4 + keyOffset])
+							texel[3] = 0;
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	float4 ComputeAverageColor(const Image& image)
+	{
+		float toLinear[256];
+		for (int i = 0; i < 256; i++) {
+			float c = float(i) / 255.f;
+			toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+
+		double sum[3] = { 0.0, 0.0, 0.0 };
+		double alphaSum = 0.0;
+		size_t numTexels = image.rgba.size() / 4;
+		for (size_t i = 0; i < numTexels; i++) {
+			const uint8_t* texel = &image.rgba[i * 4];
+			double alpha = double(texel[3]) / 255.0;
+			for (int c = 0; c < 3; c++)
+				sum[c] += toLinear[texel[c]] * alpha;
+			alphaSum += alpha;
+		}
+		if (alphaSum <= 0.0)
+			return float4(0.f);
+		return float4(float(sum[0] / alphaSum), float(sum[1] / alphaSum), float(sum[2] / alphaSum), float(alphaSum / double(numTexels)));
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+using namespace donut::math;
+
+/* Minimal PNG decoder for the scene index and the texture fallbacks, so that textures can be summarized on the CPU
+   without the TextureCache. Supports all color types and bit depths of non-interlaced images
+*/
+namespace PngReader {
+	struct Image {
+		uint width = 0;
+		uint height = 0;
+		std::vector<uint8_t> rgba;	//8-bit RGBA, rows from top to bottom
+	};
+
+	//Decodes the file to RGBA8. Returns false if it is not a PNG, corrupt or interlaced
+	bool Read(const std::filesystem::path& file, Image& image);
+
+	//Average linear color of the texels weighted by their alpha (the texels are treated as sRGB), and the average alpha in w
+	float4 ComputeAverageColor(const Image& image);
+}
@@ -0,0 +1,99 @@
+#include "PngWriter.h"
+#include "Deflate.h"
+#include <array>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+
+static uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+	static const std::array<uint32_t, 256> table = []() {
+		std::array<uint32_t, 256> entries;
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			entries[n] = c;
+		}
+		return entries;
+	}();
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++)
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void PutBigEndian(std::vector<uint8_t>& output, uint32_t value) {
+	for (int shift = 24; shift >= 0; shift -= 8)
+		output.push_back(uint8_t(value >> shift));
+}
+
+static void PutChunk(std::vector<uint8_t>& png, const char* type, const std::vector<uint8_t>& data) {
+	PutBigEndian(png, uint32_t(data.size()));
+	size_t typeStart = png.size();
+	png.insert(png.end(), type, type + 4);
+	png.insert(png.end(), data.begin(), data.end());
+	PutBigEndian(png, Crc32(&png[typeStart], png.size() - typeStart));
+}
+
+static uint8_t PaethPredictor(int a, int b, int c) {
+	int p = a + b - c;
+	int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+	if (pa <= pb && pa <= pc)
+		return uint8_t(a);
+	return uint8_t(pb <= pc ? b : c);
+}
+
+namespace PngWriter {
+	bool Write(const std::filesystem::path& file, uint32_t width, uint32_t height, const uint8_t* rgba)
+	{
+		//Every row uses the filter with the smallest sum of absolute differences, the usual heuristic of PNG encoders
+		const size_t stride = size_t(width) * 4;
+		std::vector<uint8_t> filtered((stride + 1) * height);
+		std::vector<uint8_t> candidate(stride);
+		for (uint32_t y = 0; y < height; y++) {
+			const uint8_t* row = rgba + y * stride;
+			const uint8_t* previous = y > 0 ? row - stride : nullptr;
+			uint8_t* target = &filtered[y * (stride + 1)];
+			uint64_t bestSum = ~uint64_t(0);
+			for (uint8_t filter = 0; filter <= 4; filter++) {
+				uint64_t sum = 0;
+				for (size_t i = 0; i < stride; i++) {
+					int a = i >= 4 ? row[i - 4] : 0;
+					int b = previous ? previous[i] : 0;
+					int c = previous && i >= 4 ? previous[i - 4] : 0;
+					uint8_t predicted = 0;
+					switch (filter) {
+					case 1: predicted = uint8_t(a); break;
+					case 2: predicted = uint8_t(b); break;
+					case 3: predicted = uint8_t((a + b) >> 1); break;
+					case 4: predicted = PaethPredictor(a, b, c); break;
+					}
+					candidate[i] = uint8_t(row[i] - predicted);
+					sum += std::abs(int(int8_t(candidate[i])));
+				}
+				if (sum < bestSum) {
+					bestSum = sum;
+					target[0] = filter;
+					std::copy(candidate.begin(), candidate.end(), target + 1);
+				}
+			}
+		}
+
+		std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		std::vector<uint8_t> header;
+		PutBigEndian(header, width);
+		PutBigEndian(header, height);
+		header.insert(header.end(), { 8, 6, 0, 0, 0 });	//8 bit RGBA, deflate, adaptive filters, not interlaced
+		PutChunk(png, "IHDR", header);
+		std::vector<uint8_t> compressed;
+		Deflate::Zlib(filtered.data(), filtered.size(), compressed);
+		PutChunk(png, "IDAT", compressed);
+		PutChunk(png, "IEND", {});
+
+		std::ofstream stream(file, std::ios::binary);
+		if (!stream)
+			return false;
+		stream.write(reinterpret_cast<const char*>(png.data()), png.size());
+		return bool(stream);
+	}
+}
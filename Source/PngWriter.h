@@ -0,0 +1,11 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+
+/* Minimal PNG encoder for images rendered on the CPU, e.g. by the batch renderer.
+   Writes 8-bit RGBA with per row filters and Deflate compression
+*/
+namespace PngWriter {
+	//Writes width x height RGBA8 texels, rows from top to bottom. Returns false if the file can not be written
+	bool Write(const std::filesystem::path& file, uint32_t width, uint32_t height, const uint8_t* rgba);
+}
@@ -0,0 +1,493 @@
+#include "PotentiallyVisibleSet.h"
+#include "OccupancyGrid.h"
+#include "TaskScheduler.h"
+#include "Deflate.h"
+#include "Inflate.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+using namespace donut;
+
+const char* const PotentiallyVisibleSet::k_Extension = ".pvs";
+
+static const char k_Magic[4] = { 'M', 'W', 'P', 'V' };
+static const uint32_t k_Version = 2;
+//Faces of a cell are 2 * axis + 1 for the positive side, face a is connected to face b if bit 6 * a + b is set.
+//Bit 7 * a is set if any air touches face a. Air that touches no face, e.g. a closed room, only sets k_HasAir
+static const uint64_t k_HasAir = uint64_t(1) << 36;
+static const uint64_t k_AllConnected = (uint64_t(1) << 37) - 1;
+
+struct FileHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t cellSize;
+	int32_t originCell[3];
+	uint32_t numCells[3];
+	float boundsMin[3];
+	float boundsMax[3];
+	uint32_t numViewpointCells;
+	uint32_t numOccupiedCells;
+	uint64_t numOpaqueBlocks;
+	double visibleCellFraction;
+	double culledPrimitiveFraction;
+	double buildMs;
+	uint64_t sceneBytes[PotentiallyVisibleSet::k_MaxScenes];		//Stamps of the scenes the set was built from, 0 if unused
+	int64_t sceneWriteTimes[PotentiallyVisibleSet::k_MaxScenes];
+	uint64_t dataBytes;				//zlib stream of the primitive counts and the rows
+};
+
+static bool IsConnected(uint64_t connectivity, int faceA, int faceB) {
+	return (connectivity >> (6 * faceA + faceB)) & 1;
+}
+
+static int3 FloorDivide(float3 position, int divisor) {
+	return int3(int(std::floor(position.x / float(divisor))), int(std::floor(position.y / float(divisor))), int(std::floor(position.z / float(divisor))));
+}
+
+//Air components of a cell by flood fill, the faces every component touches are connected
+static uint64_t ComputeConnectivity(const OccupancyGrid& opaque, int3 cellMin, std::vector<uint8_t>& state, std::vector<uint>& stack) {
+	const int n = PotentiallyVisibleSet::k_CellSize;
+	const uint8_t air = 0, solid = 1, visited = 2;
+	state.resize(size_t(n) * n * n);
+	for (int z = 0; z < n; z++) {
+		for (int y = 0; y < n; y++) {
+			for (int x = 0; x < n; x++)
+				state[(z * n + y) * n + x] = opaque.IsOccupied(cellMin + int3(x, y, z)) ? solid : air;
+		}
+	}
+
+	uint64_t connectivity = 0;
+	for (uint start = 0; start < state.size(); start++) {
+		if (state[start] != air)
+			continue;
+		connectivity |= k_HasAir;
+		uint faces = 0;
+		state[start] = visited;
+		stack.clear();
+		stack.push_back(start);
+		while (!stack.empty()) {
+			uint index = stack.back();
+			stack.pop_back();
+			int3 voxel = int3(int(index % n), int(index / n % n), int(index / (n * n)));
+			const uint strides[3] = { 1u, uint(n), uint(n * n) };
+			for (int axis = 0; axis < 3; axis++) {
+				if (voxel[axis] == 0)
+					faces |= 1u << (2 * axis);
+				else if (state[index - strides[axis]] == air) {
+					state[index - strides[axis]] = visited;
+					stack.push_back(index - strides[axis]);
+				}
+				if (voxel[axis] == n - 1)
+					faces |= 1u << (2 * axis + 1);
+				else if (state[index + strides[axis]] == air) {
+					state[index + strides[axis]] = visited;
+					stack.push_back(index + strides[axis]);
+				}
+			}
+		}
+		for (int a = 0; a < 6; a++) {
+			for (int b = 0; b < 6; b++) {
+				if ((faces >> a) & (faces >> b) & 1)
+					connectivity |= uint64_t(1) << (6 * a + b);
+			}
+		}
+		if (connectivity == k_AllConnected)
+			break;
+	}
+	return connectivity;
+}
+
+void PotentiallyVisibleSet::Clear()
+{
+	m_OriginCell = int3(0);
+	m_NumCells = uint3(0);
+	m_BoundsMin = float3(0.f);
+	m_BoundsMax = float3(0.f);
+	m_RowWords = 0;
+	m_Rows.clear();
+	m_CellPrimitives.clear();
+	m_Stats = Stats();
+}
+
+bool PotentiallyVisibleSet::Build(const SceneArchive::Contents& contents)
+{
+	auto buildStart = std::chrono::high_resolution_clock::now();
+	Clear();
+
+	//Same bounds as the archive, removed blocks are collapsed to a point and ignored
+	auto isPoint = [](const AABB& aabb) { return all(aabb.min == aabb.max); };
+	float3 boundsMin = float3(std::numeric_limits<float>::max()), boundsMax = float3(-std::numeric_limits<float>::max());
+	for (const AABB& aabb : contents.aabbs) {
+		if (isPoint(aabb))
+			continue;
+		boundsMin = min(boundsMin, aabb.min);
+		boundsMax = max(boundsMax, aabb.max);
+	}
+	for (const VertexData& vertex : contents.vertices) {
+		boundsMin = min(boundsMin, vertex.position);
+		boundsMax = max(boundsMax, vertex.position);
+	}
+	if (any(boundsMin > boundsMax))
+		return false;
+	const int3 originCell = FloorDivide(boundsMin, k_CellSize);
+	const uint3 gridSize = uint3(FloorDivide(boundsMax, k_CellSize) - originCell + int3(1));
+	if (uint64_t(gridSize.x) * gridSize.y * gridSize.z > k_MaxCells) {
+		log::warning("PotentiallyVisibleSet: %u x %u x %u cells are more than the %u cells of the visibility matrix", gridSize.x, gridSize.y, gridSize.z, k_MaxCells);
+		return false;
+	}
+	m_BoundsMin = boundsMin;
+	m_BoundsMax = boundsMax;
+	m_OriginCell = originCell;
+	m_NumCells = gridSize;
+	const uint numCells = GetNumCells();
+	m_RowWords = (numCells + 63) / 64;
+
+	//Primitives per cell, by the min corner of the blocks and the centroid of the triangles
+	m_CellPrimitives.assign(numCells, 0);
+	for (const AABB& aabb : contents.aabbs) {
+		if (!isPoint(aabb))
+			m_CellPrimitives[GetIndex(FloorDivide(aabb.min, k_CellSize) - m_OriginCell)]++;
+	}
+	for (size_t t = 0; t < contents.triangleMaterialIDs.size(); t++) {
+		const uint* triangle = &contents.indices[t * 3];
+		float3 centroid = (contents.vertices[triangle[0]].position + contents.vertices[triangle[1]].position + contents.vertices[triangle[2]].position) / 3.f;
+		m_CellPrimitives[GetIndex(FloorDivide(centroid, k_CellSize) - m_OriginCell)]++;
+	}
+
+	//Only full blocks with opaque materials on all faces block the view. Alpha tested materials are the ones the loader alpha tests
+	std::vector<bool> opaqueMaterials(contents.materials.size());
+	for (size_t m = 0; m < contents.materials.size(); m++)
+		opaqueMaterials[m] = contents.materials[m].alpha_texname.empty();
+	auto isOpaque = [&](int materialID) { return materialID >= 0 && size_t(materialID) < opaqueMaterials.size() && opaqueMaterials[materialID]; };
+	std::vector<AABB> opaqueBlocks;
+	std::vector<uint8_t> cellHasOpaque(numCells, 0);
+	for (size_t i = 0; i < contents.aabbs.size(); i++) {
+		const AABB& aabb = contents.aabbs[i];
+		const AABBMaterials& materials = contents.aabbMaterials[i];
+		if (!all(aabb.min == floor(aabb.min)) || !all(aabb.max == aabb.min + float3(1.f)))
+			continue;
+		if (!isOpaque(materials.negXMatID) || !isOpaque(materials.posXMatID) || !isOpaque(materials.negYMatID) || !isOpaque(materials.posYMatID)
+			|| !isOpaque(materials.negZMatID) || !isOpaque(materials.posZMatID))
+			continue;
+		opaqueBlocks.push_back(aabb);
+		cellHasOpaque[GetIndex(FloorDivide(aabb.min, k_CellSize) - m_OriginCell)] = 1;
+	}
+	m_Stats.numOpaqueBlocks = opaqueBlocks.size();
+	OccupancyGrid opaque;
+	opaque.Build(opaqueBlocks);
+	opaqueBlocks = std::vector<AABB>();
+
+	//Cells without opaque blocks are all air
+	std::vector<uint64_t> connectivity(numCells, k_AllConnected);
+	TaskScheduler::Get().ParallelFor(0, numCells, 1, [&](uint64_t begin, uint64_t end) {
+		std::vector<uint8_t> state;
+		std::vector<uint> stack;
+		for (uint64_t c = begin; c < end; c++) {
+			if (cellHasOpaque[c])
+				connectivity[c] = ComputeConnectivity(opaque, (m_OriginCell + GetCell(uint(c))) * k_CellSize, state, stack);
+		}
+	});
+	auto visibilityStart = std::chrono::high_resolution_clock::now();
+	m_Stats.connectivityMs = std::chrono::duration<double, std::milli>(visibilityStart - buildStart).count();
+
+	ComputeVisibility(connectivity);
+	m_Stats.visibilityMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - visibilityStart).count();
+
+	ComputeStats(connectivity);
+	m_Stats.buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildStart).count();
+	log::info("PotentiallyVisibleSet: %u cells (%u x %u x %u), %llu opaque blocks, %.1f%% of the occupied cells visible, %.1f%% of the primitives culled, "
+		"%.1f ms (connectivity %.1f ms, visibility %.1f ms)", numCells, m_NumCells.x, m_NumCells.y, m_NumCells.z, (unsigned long long)m_Stats.numOpaqueBlocks,
+		m_Stats.visibleCellFraction * 100.0, m_Stats.culledPrimitiveFraction * 100.0, m_Stats.buildMs, m_Stats.connectivityMs, m_Stats.visibilityMs);
+	return true;
+}
+
+void PotentiallyVisibleSet::ComputeVisibility(const std::vector<uint64_t>& connectivity)
+{
+	const uint numCells = GetNumCells();
+	m_Rows.assign(size_t(numCells) * m_RowWords, 0);
+	const int3 numCellsInt = int3(m_NumCells);
+
+	TaskScheduler::Get().ParallelFor(0, numCells, 1, [&](uint64_t begin, uint64_t end) {
+		//Axes through which a cell was entered, reset while sweeping
+		std::vector<uint8_t> entered(numCells, 0);
+		for (uint64_t source = begin; source < end; source++) {
+			uint64_t* row = &m_Rows[source * m_RowWords];
+			//A camera inside of solid blocks sees everything
+			if (!(connectivity[source] & k_HasAir)) {
+				for (uint c = 0; c < numCells; c++)
+					row[c >> 6] |= uint64_t(1) << (c & 63);
+				continue;
+			}
+			const int3 sourceCell = GetCell(uint(source));
+			for (int octant = 0; octant < 8; octant++) {
+				const int3 direction = int3((octant & 1) ? 1 : -1, (octant & 2) ? 1 : -1, (octant & 4) ? 1 : -1);
+				const int3 last = int3(direction.x > 0 ? numCellsInt.x - 1 : 0, direction.y > 0 ? numCellsInt.y - 1 : 0, direction.z > 0 ? numCellsInt.z - 1 : 0);
+				int exitFaces[3], entryFaces[3];
+				for (int axis = 0; axis < 3; axis++) {
+					exitFaces[axis] = 2 * axis + (direction[axis] > 0 ? 1 : 0);
+					entryFaces[axis] = 2 * axis + (direction[axis] > 0 ? 0 : 1);
+				}
+
+				//Every predecessor of a cell in the octant comes before it
+				for (int z = sourceCell.z; z != last.z + direction.z; z += direction.z) {
+					for (int y = sourceCell.y; y != last.y + direction.y; y += direction.y) {
+						for (int x = sourceCell.x; x != last.x + direction.x; x += direction.x) {
+							const int3 cell = int3(x, y, z);
+							const uint index = GetIndex(cell);
+							const uint64_t cellConnectivity = connectivity[index];
+							uint exits = 0;
+							if (index == source) {
+								for (int axis = 0; axis < 3; axis++) {
+									if (IsConnected(cellConnectivity, exitFaces[axis], exitFaces[axis]))
+										exits |= 1u << axis;
+								}
+							}
+							else {
+								const uint axesIn = entered[index];
+								if (axesIn == 0)
+									continue;
+								entered[index] = 0;
+								for (int axisOut = 0; axisOut < 3; axisOut++) {
+									for (int axisIn = 0; axisIn < 3; axisIn++) {
+										if (((axesIn >> axisIn) & 1) && IsConnected(cellConnectivity, entryFaces[axisIn], exitFaces[axisOut]))
+											exits |= 1u << axisOut;
+									}
+								}
+							}
+							row[index >> 6] |= uint64_t(1) << (index & 63);
+							for (int axis = 0; axis < 3; axis++) {
+								int3 next = cell;
+								next[axis] += direction[axis];
+								if (((exits >> axis) & 1) && next[axis] >= 0 && next[axis] < numCellsInt[axis])
+									entered[GetIndex(next)] |= uint8_t(1u << axis);
+							}
+						}
+					}
+				}
+			}
+		}
+	});
+}
+
+void PotentiallyVisibleSet::ComputeStats(const std::vector<uint64_t>& connectivity)
+{
+	const uint numCells = GetNumCells();
+	uint64_t totalPrimitives = 0;
+	m_Stats.numCells = numCells;
+	m_Stats.numOccupiedCells = 0;
+	for (uint c = 0; c < numCells; c++) {
+		totalPrimitives += m_CellPrimitives[c];
+		if (m_CellPrimitives[c] > 0)
+			m_Stats.numOccupiedCells++;
+	}
+
+	//Cameras are expected near geometry and not inside of solid blocks
+	double visibleSum = 0.0, culledSum = 0.0;
+	uint numViewpoints = 0;
+	for (uint source = 0; source < numCells; source++) {
+		if (m_CellPrimitives[source] == 0 || !(connectivity[source] & k_HasAir))
+			continue;
+		uint visibleOccupied = 0;
+		uint64_t visiblePrimitives = 0;
+		for (uint c = 0; c < numCells; c++) {
+			if (!IsVisible(source, c))
+				continue;
+			visibleOccupied += m_CellPrimitives[c] > 0 ? 1 : 0;
+			visiblePrimitives += m_CellPrimitives[c];
+		}
+		visibleSum += double(visibleOccupied) / double(m_Stats.numOccupiedCells);
+		culledSum += 1.0 - double(visiblePrimitives) / double(std::max<uint64_t>(totalPrimitives, 1));
+		numViewpoints++;
+	}
+	m_Stats.numViewpointCells = numViewpoints;
+	m_Stats.visibleCellFraction = numViewpoints > 0 ? visibleSum / numViewpoints : 1.0;
+	m_Stats.culledPrimitiveFraction = numViewpoints > 0 ? culledSum / numViewpoints : 0.0;
+}
+
+int3 PotentiallyVisibleSet::GetCell(uint index) const
+{
+	return int3(int(index % m_NumCells.x), int(index / m_NumCells.x % m_NumCells.y), int(index / (m_NumCells.x * m_NumCells.y)));
+}
+
+int PotentiallyVisibleSet::GetCellIndex(float3 position) const
+{
+	int3 cell = FloorDivide(position, k_CellSize) - m_OriginCell;
+	if (IsEmpty() || any(cell < int3(0)) || any(cell >= int3(m_NumCells)))
+		return -1;
+	return int(GetIndex(cell));
+}
+
+std::vector<uint8_t> PotentiallyVisibleSet::GetVisibleCells(const std::vector<float3>& positions, uint margin) const
+{
+	const uint numCells = GetNumCells();
+	std::vector<uint8_t> visible(numCells, 0);
+	for (float3 position : positions) {
+		int source = GetCellIndex(position);
+		if (source < 0)
+			return std::vector<uint8_t>(numCells, 1);
+		for (uint c = 0; c < numCells; c++)
+			visible[c] |= IsVisible(uint(source), c) ? 1 : 0;
+	}
+	if (margin == 0)
+		return visible;
+
+	std::vector<uint8_t> dilated(numCells, 0);
+	const int m = int(margin);
+	for (uint c = 0; c < numCells; c++) {
+		if (!visible[c])
+			continue;
+		int3 cell = GetCell(c);
+		int3 first = max(cell - int3(m), int3(0));
+		int3 last = min(cell + int3(m), int3(m_NumCells) - int3(1));
+		for (int z = first.z; z <= last.z; z++) {
+			for (int y = first.y; y <= last.y; y++) {
+				for (int x = first.x; x <= last.x; x++)
+					dilated[GetIndex(int3(x, y, z))] = 1;
+			}
+		}
+	}
+	return dilated;
+}
+
+double PotentiallyVisibleSet::GetCulledFraction(const std::vector<uint8_t>& visibleCells) const
+{
+	uint64_t total = 0, culled = 0;
+	for (size_t c = 0; c < m_CellPrimitives.size(); c++) {
+		total += m_CellPrimitives[c];
+		if (c >= visibleCells.size() || !visibleCells[c])
+			culled += m_CellPrimitives[c];
+	}
+	return total > 0 ? double(culled) / double(total) : 0.0;
+}
+
+std::filesystem::path PotentiallyVisibleSet::GetFile(const std::filesystem::path& sceneFolder, const std::string& sceneName)
+{
+	return sceneFolder / (std::filesystem::path(sceneName).stem().string() + k_Extension);
+}
+
+PotentiallyVisibleSet::SceneStamp PotentiallyVisibleSet::GetSceneStamp(const std::filesystem::path& scene)
+{
+	SceneStamp stamp;
+	std::error_code error;
+	auto addFile = [&](const std::filesystem::path& file) {
+		uint64_t bytes = std::filesystem::file_size(file, error);
+		int64_t writeTime = int64_t(std::filesystem::last_write_time(file, error).time_since_epoch().count());
+		if (error)
+			return;
+		stamp.bytes += bytes;
+		stamp.writeTime = std::max(stamp.writeTime, writeTime);
+	};
+	if (std::filesystem::is_directory(scene, error)) {
+		for (const auto& entry : std::filesystem::recursive_directory_iterator(scene, error)) {
+			if (entry.is_regular_file(error))
+				addFile(entry.path());
+		}
+	}
+	else if (std::filesystem::is_regular_file(scene, error))
+		addFile(scene);
+	return stamp;
+}
+
+bool PotentiallyVisibleSet::Write(const std::filesystem::path& file, const std::vector<std::filesystem::path>& scenes)
+{
+	std::vector<uint8_t> raw(m_CellPrimitives.size() * sizeof(uint32_t) + m_Rows.size() * sizeof(uint64_t));
+	memcpy(raw.data(), m_CellPrimitives.data(), m_CellPrimitives.size() * sizeof(uint32_t));
+	memcpy(raw.data() + m_CellPrimitives.size() * sizeof(uint32_t), m_Rows.data(), m_Rows.size() * sizeof(uint64_t));
+	std::vector<uint8_t> data;
+	Deflate::Zlib(raw.data(), raw.size(), data);
+
+	FileHeader header = {};
+	memcpy(header.magic, k_Magic, sizeof(k_Magic));
+	header.version = k_Version;
+	header.cellSize = k_CellSize;
+	memcpy(header.originCell, &m_OriginCell, sizeof(header.originCell));
+	memcpy(header.numCells, &m_NumCells, sizeof(header.numCells));
+	memcpy(header.boundsMin, &m_BoundsMin, sizeof(header.boundsMin));
+	memcpy(header.boundsMax, &m_BoundsMax, sizeof(header.boundsMax));
+	header.numViewpointCells = m_Stats.numViewpointCells;
+	header.numOccupiedCells = m_Stats.numOccupiedCells;
+	header.numOpaqueBlocks = m_Stats.numOpaqueBlocks;
+	header.visibleCellFraction = m_Stats.visibleCellFraction;
+	header.culledPrimitiveFraction = m_Stats.culledPrimitiveFraction;
+	header.buildMs = m_Stats.buildMs;
+	for (size_t i = 0; i < scenes.size() && i < k_MaxScenes; i++) {
+		SceneStamp stamp = GetSceneStamp(scenes[i]);
+		header.sceneBytes[i] = stamp.bytes;
+		header.sceneWriteTimes[i] = stamp.writeTime;
+	}
+	header.dataBytes = data.size();
+
+	std::ofstream stream(file, std::ios::binary);
+	if (!stream)
+		return false;
+	stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	stream.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+	stream.close();
+	if (!stream)
+		return false;
+	m_Stats.fileBytes = sizeof(header) + data.size();
+	return true;
+}
+
+bool PotentiallyVisibleSet::Read(const std::filesystem::path& file, const std::filesystem::path& scene)
+{
+	Clear();
+	std::ifstream stream(file, std::ios::binary | std::ios::ate);
+	if (!stream)
+		return false;
+	const uint64_t fileBytes = uint64_t(stream.tellg());
+	FileHeader header;
+	stream.seekg(0);
+	if (fileBytes < sizeof(header) || !stream.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return false;
+	if (memcmp(header.magic, k_Magic, sizeof(k_Magic)) != 0 || header.version != k_Version || header.cellSize != uint32_t(k_CellSize)
+		|| header.dataBytes != fileBytes - sizeof(header))
+		return false;
+	//Culling with the set of an older export would drop geometry that is visible now
+	const SceneStamp stamp = GetSceneStamp(scene);
+	bool sameScene = false;
+	for (uint i = 0; i < k_MaxScenes; i++)
+		sameScene |= (stamp.bytes != 0 || stamp.writeTime != 0) && header.sceneBytes[i] == stamp.bytes && header.sceneWriteTimes[i] == stamp.writeTime;
+	if (!sameScene) {
+		log::warning("PotentiallyVisibleSet: %s was not built from the current state of %s, it is ignored", file.string().c_str(), scene.string().c_str());
+		return false;
+	}
+	std::vector<uint8_t> data(header.dataBytes);
+	if (!stream.read(reinterpret_cast<char*>(data.data()), std::streamsize(data.size())))
+		return false;
+
+	uint3 numCells;
+	memcpy(&numCells, header.numCells, sizeof(numCells));
+	const uint64_t cellCount = uint64_t(numCells.x) * numCells.y * numCells.z;
+	const uint64_t rowWords = (cellCount + 63) / 64;
+	std::vector<uint8_t> raw;
+	if (cellCount == 0 || cellCount > k_MaxCells || !Inflate::Zlib(data.data(), data.size(), raw)
+		|| raw.size() != cellCount * sizeof(uint32_t) + cellCount * rowWords * sizeof(uint64_t))
+		return false;
+
+	memcpy(&m_OriginCell, header.originCell, sizeof(header.originCell));
+	m_NumCells = numCells;
+	memcpy(&m_BoundsMin, header.boundsMin, sizeof(header.boundsMin));
+	memcpy(&m_BoundsMax, header.boundsMax, sizeof(header.boundsMax));
+	m_RowWords = size_t(rowWords);
+	m_CellPrimitives.resize(size_t(cellCount));
+	m_Rows.resize(size_t(cellCount * rowWords));
+	memcpy(m_CellPrimitives.data(), raw.data(), m_CellPrimitives.size() * sizeof(uint32_t));
+	memcpy(m_Rows.data(), raw.data() + m_CellPrimitives.size() * sizeof(uint32_t), m_Rows.size() * sizeof(uint64_t));
+
+	m_Stats.numCells = uint(cellCount);
+	m_Stats.numOccupiedCells = header.numOccupiedCells;
+	m_Stats.numOpaqueBlocks = header.numOpaqueBlocks;
+	m_Stats.numViewpointCells = header.numViewpointCells;
+	m_Stats.visibleCellFraction = header.visibleCellFraction;
+	m_Stats.culledPrimitiveFraction = header.culledPrimitiveFraction;
+	m_Stats.buildMs = header.buildMs;
+	m_Stats.fileBytes = fileBytes;
+	return true;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "SceneArchive.h"
+
+using namespace donut::math;
+
+/* Potentially visible set between the cells of a scene, precomputed offline (see SceneConverter -pvs) and stored next to the scene (.pvs).
+   Cells are k_CellSize^3 blocks, aligned like the chunks of a scene archive, so a cell is a chunk and blocks and triangles belong to the
+   cell of their min corner and centroid as in SceneRegion.
+   Visibility is conservative voxel visibility on the occupancy of the opaque full blocks: every other block, every triangle and everything outside
+   of the grid counts as air. Per cell, the air is split into 6-connected components and the faces of the cell that a component touches are
+   connected. A line of sight only moves in one direction per axis, so a cell is visible from another if it can be reached from it through
+   connected faces with steps in the directions of one octant. Caves and closed rooms that no air leads into are never visible.
+   Secondary rays are not covered: shadows and reflections of geometry in culled cells are lost.
+   The set is a dense bit matrix of cells x cells and the build sweeps the grid once per cell, so both grow with the square of the cell count.
+   Scenes with more than k_MaxCells cells in their bounds are not supported (128 MB of rows at the limit)
+*/
+class PotentiallyVisibleSet {
+public:
+	static const int k_CellSize = int(SceneArchive::k_ChunkSize);
+	static const char* const k_Extension;
+	static const uint k_MaxScenes = 2;
+	static const uint k_MaxCells = 1u << 15;
+
+	//Identifies a state of a scene without reading it
+	struct SceneStamp {
+		uint64_t bytes = 0;
+		int64_t writeTime = 0;
+	};
+
+	struct Stats {
+		uint numCells = 0;
+		uint numOccupiedCells = 0;			//Cells with blocks or triangles
+		uint64_t numOpaqueBlocks = 0;		//Blocks that block the view
+		uint numViewpointCells = 0;			//Occupied cells with air, where cameras are expected
+		double visibleCellFraction = 0.0;	//Mean over the viewpoint cells of the fraction of occupied cells that are visible
+		double culledPrimitiveFraction = 0.0;	//Mean over the viewpoint cells of the fraction of blocks and triangles in cells that are not visible
+		double connectivityMs = 0.0;		//Occupancy of the opaque blocks and the face connectivity of the cells
+		double visibilityMs = 0.0;			//Visibility between all cells
+		double buildMs = 0.0;
+		uint64_t fileBytes = 0;				//Set by Write and Read
+	};
+
+	//Computes the visibility between all cells of the scene with the TaskScheduler. The materials decide which blocks are opaque, alpha tested
+	//materials are not. Returns false if the scene is empty or has more than k_MaxCells cells
+	bool Build(const SceneArchive::Contents& contents);
+	void Clear();
+
+	//scenes are the files the set was built from, e.g. the .obj and its archive (up to k_MaxScenes). Their stamps are stored with the set
+	bool Write(const std::filesystem::path& file, const std::vector<std::filesystem::path>& scenes);
+	//Returns false if the file does not exist or is invalid, or if the scene is not one the set was built from in the same state,
+	//e.g. after a new export. A set is stale as soon as the size or the write time of the scene changed
+	bool Read(const std::filesystem::path& file, const std::filesystem::path& scene);
+	//PVS file of a scene, next to the scene with its name and the .pvs extension. Shared by a .obj and its archive
+	static std::filesystem::path GetFile(const std::filesystem::path& sceneFolder, const std::string& sceneName);
+	//Size and newest write time of a scene file, or of all files of a world folder. Zero if the scene does not exist
+	static SceneStamp GetSceneStamp(const std::filesystem::path& scene);
+
+	bool IsEmpty() const { return m_Rows.empty(); }
+	uint GetNumCells() const { return m_NumCells.x * m_NumCells.y * m_NumCells.z; }
+	//Index of the cell that contains the position, -1 outside of the grid
+	int GetCellIndex(float3 position) const;
+	bool IsVisible(uint fromCell, uint toCell) const { return (m_Rows[size_t(fromCell) * m_RowWords + (toCell >> 6)] >> (toCell & 63)) & 1; }
+	//Visible cells of a cell, bit t of the GetRowWords() words is set if cell t is visible
+	const uint64_t* GetVisibleRow(uint fromCell) const { return &m_Rows[size_t(fromCell) * m_RowWords]; }
+	size_t GetRowWords() const { return m_RowWords; }
+	int3 GetOriginCell() const { return m_OriginCell; }
+	uint3 GetGridSize() const { return m_NumCells; }
+
+	//Cells potentially visible from any of the positions, one flag per cell. Positions outside of the grid see everything.
+	//margin adds the cells up to that many cells away from a visible one, e.g. to keep nearby shadow casters
+	std::vector<uint8_t> GetVisibleCells(const std::vector<float3>& positions, uint margin = 0) const;
+	//Fraction of the blocks and triangles in cells that are not visible
+	double GetCulledFraction(const std::vector<uint8_t>& visibleCells) const;
+
+	float3 GetBoundsMin() const { return m_BoundsMin; }
+	float3 GetBoundsMax() const { return m_BoundsMax; }
+	const Stats& GetStats() const { return m_Stats; }
+
+private:
+	int3 GetCell(uint index) const;
+	uint GetIndex(int3 cell) const { return (uint(cell.z) * m_NumCells.y + uint(cell.y)) * m_NumCells.x + uint(cell.x); }
+	//Visible cells of every cell as bit rows
+	void ComputeVisibility(const std::vector<uint64_t>& connectivity);
+	void ComputeStats(const std::vector<uint64_t>& connectivity);
+
+	int3 m_OriginCell = int3(0);		//First cell in units of cells
+	uint3 m_NumCells = uint3(0);
+	float3 m_BoundsMin = float3(0.f);
+	float3 m_BoundsMax = float3(0.f);
+	size_t m_RowWords = 0;
+	std::vector<uint64_t> m_Rows;		//Bit t of row s is set if cell t is visible from cell s
+	std::vector<uint32_t> m_CellPrimitives;	//Blocks and triangles per cell
+	Stats m_Stats;
+};
@@ -0,0 +1,162 @@
+#include "ProcessUtils.h"
+#ifdef WIN32
+#define NOMINMAX
+#include <Windows.h>
+#include <psapi.h>
+#else
+#include <cerrno>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+#ifdef WIN32
+//Quotes an argument for CommandLineToArgvW, backslashes are only special in front of quotes
+static std::wstring QuoteArgument(const std::wstring& argument)
+{
+	if (!argument.empty() && argument.find_first_of(L" \t\"") == std::wstring::npos)
+		return argument;
+	std::wstring quoted = L"\"";
+	size_t backslashes = 0;
+	for (wchar_t c : argument) {
+		if (c == L'\\') {
+			backslashes++;
+			continue;
+		}
+		if (c == L'"')
+			quoted.append(backslashes * 2 + 1, L'\\');
+		else
+			quoted.append(backslashes, L'\\');
+		backslashes = 0;
+		quoted.push_back(c);
+	}
+	quoted.append(backslashes * 2, L'\\');
+	quoted.push_back(L'"');
+	return quoted;
+}
+
+std::filesystem::path GetExecutablePath()
+{
+	std::wstring path(MAX_PATH, L'\0');
+	DWORD length;
+	while ((length = GetModuleFileNameW(nullptr, path.data(), DWORD(path.size()))) == path.size())
+		path.resize(path.size() * 2);
+	path.resize(length);
+	return path;
+}
+
+uint64_t GetPeakResidentBytes()
+{
+	PROCESS_MEMORY_COUNTERS counters = {};
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize;
+	return 0;
+}
+
+ChildProcess::~ChildProcess()
+{
+	Wait();
+}
+
+bool ChildProcess::Start(const std::filesystem::path& executable, const std::vector<std::string>& arguments)
+{
+	Wait();
+	std::wstring commandLine = QuoteArgument(executable.wstring());
+	for (const std::string& argument : arguments)
+		commandLine += L" " + QuoteArgument(std::filesystem::path(argument).wstring());
+
+	STARTUPINFOW startupInfo = {};
+	startupInfo.cb = sizeof(startupInfo);
+	PROCESS_INFORMATION processInfo = {};
+	if (!CreateProcessW(executable.wstring().c_str(), commandLine.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startupInfo, &processInfo))
+		return false;
+	CloseHandle(processInfo.hThread);
+	m_Process = processInfo.hProcess;
+	return true;
+}
+
+int ChildProcess::Wait()
+{
+	if (!m_Process)
+		return -1;
+	DWORD exitCode = DWORD(-1);
+	WaitForSingleObject(m_Process, INFINITE);
+	GetExitCodeProcess(m_Process, &exitCode);
+	CloseHandle(m_Process);
+	m_Process = nullptr;
+	return int(exitCode);
+}
+
+bool ChildProcess::IsStarted() const
+{
+	return m_Process != nullptr;
+}
+
+bool ChildProcess::IsRunning() const
+{
+	return m_Process && WaitForSingleObject(m_Process, 0) == WAIT_TIMEOUT;
+}
+#else
+std::filesystem::path GetExecutablePath()
+{
+	std::error_code error;
+	return std::filesystem::read_symlink("/proc/self/exe", error);
+}
+
+uint64_t GetPeakResidentBytes()
+{
+	//ru_maxrss is in kilobytes on Linux
+	rusage usage = {};
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+	return uint64_t(usage.ru_maxrss) * 1024;
+}
+
+ChildProcess::~ChildProcess()
+{
+	Wait();
+}
+
+bool ChildProcess::Start(const std::filesystem::path& executable, const std::vector<std::string>& arguments)
+{
+	Wait();
+	std::string executableString = executable.string();
+	std::vector<char*> argv;
+	argv.push_back(executableString.data());
+	for (const std::string& argument : arguments)
+		argv.push_back(const_cast<char*>(argument.c_str()));
+	argv.push_back(nullptr);
+
+	pid_t pid;
+	if (posix_spawn(&pid, executableString.c_str(), nullptr, nullptr, argv.data(), environ) != 0)
+		return false;
+	m_Pid = pid;
+	return true;
+}
+
+int ChildProcess::Wait()
+{
+	if (m_Pid < 0)
+		return -1;
+	int status = 0;
+	while (waitpid(m_Pid, &status, 0) < 0 && errno == EINTR) {}
+	m_Pid = -1;
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+bool ChildProcess::IsStarted() const
+{
+	return m_Pid >= 0;
+}
+
+bool ChildProcess::IsRunning() const
+{
+	if (m_Pid < 0)
+		return false;
+	//WNOWAIT leaves an exited process to Wait
+	siginfo_t info = {};
+	return waitid(P_PID, id_t(m_Pid), &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid == 0;
+}
+#endif
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+//Path of the running executable, used to start worker processes of the same build
+std::filesystem::path GetExecutablePath();
+
+//Peak resident memory (working set) of the running process in bytes, 0 if unknown
+uint64_t GetPeakResidentBytes();
+
+/* Child process started with an argument list, without a shell. The process is waited for on destruction
+*/
+class ChildProcess {
+public:
+	ChildProcess() = default;
+	~ChildProcess();
+
+	ChildProcess(const ChildProcess&) = delete;
+	ChildProcess& operator=(const ChildProcess&) = delete;
+
+	//Returns false if the process could not be started
+	bool Start(const std::filesystem::path& executable, const std::vector<std::string>& arguments);
+	//Blocks until the process exited and returns its exit code, -1 if it was not started or crashed
+	int Wait();
+	bool IsStarted() const;
+	//True if the process was started and has not exited yet, does not block
+	bool IsRunning() const;
+
+private:
+#ifdef WIN32
+	void* m_Process = nullptr;
+#else
+	int m_Pid = -1;
+#endif
+};
@@ -35,13 +35,20 @@ VK_BINDING(0, 1) Texture2D t_BindlessTextures[] : register(t0, space1);
 
 // ---[ Resources ]---
 RWTexture2D<unorm float4> RTOutput : register(u0);
+RWStructuredBuffer<uint> g_MaterialFeedback : register(u1);
 RaytracingAccelerationStructure SceneBVH : register(t0);
-StructuredBuffer<uint> g_IndexData : register(t1);
+ByteAddressBuffer g_IndexData : register(t1);
 StructuredBuffer<VertexData> g_VertexData : register(t2);
 StructuredBuffer<float2> g_AABBData : register(t3);
 StructuredBuffer<int> g_TriMaterialID : register(t4);
 StructuredBuffer<AABBMaterials> g_AABBMaterialID : register(t5);
 StructuredBuffer<MaterialConstants> g_Material : register(t6);
+StructuredBuffer<LightTreeNode> g_LightTree : register(t7);
+StructuredBuffer<EmissiveLight> g_EmissiveLights : register(t8);
+StructuredBuffer<OccupancyRegion> g_OccupancyRegions : register(t9);
+StructuredBuffer<uint2> g_OccupancyBricks : register(t10);
+StructuredBuffer<TriangleRegion> g_TriangleRegions : register(t11);
+StructuredBuffer<uint> g_VisibleCells : register(t12);
 
 SamplerState s_MaterialSampler : register(s0);
 
@@ -51,6 +58,8 @@ static const int kHitTypeTriangle = 1;
 static const int kHitTypeAABB = 2;
 static const float k_DielectricSpecular = 0.04;
 static const float3 kEnviromentColor = float3(0.68, 0.85, 0.9); //Light Blue
+static const uint kLightTreeMaxDepth = 64;
+static const float kFloatMax = 3.402823466e+38;
 
 // ---[ Functions ]---
 RayDesc SetupPrimaryRay(uint2 pixelPosition, PlanarViewConstants view)
@@ -141,10 +150,20 @@ AttributesAABB GetAABBAttributes(AABB aabb, float3 hitPos, float3 normal)
     return attribs;
 }
 
-void GetTriangleVertices(uint primitiveIndex,out Vertex vertices[3]){
-    uint indicesBufferIndex = primitiveIndex * 3;
-    uint3 indices = uint3(g_IndexData[indicesBufferIndex], g_IndexData[indicesBufferIndex + 1], g_IndexData[indicesBufferIndex + 2]);
-        
+//Scene wide triangle index, used for the per triangle buffers
+uint GetTriangleIndex(uint geometryIndex, uint primitiveIndex)
+{
+    return g_TriangleRegions[geometryIndex].firstTriangle + primitiveIndex;
+}
+
+void GetTriangleVertices(uint geometryIndex, uint primitiveIndex, out Vertex vertices[3]){
+    //Three 16-bit indices, read from the two aligned words that contain them
+    TriangleRegion region = g_TriangleRegions[geometryIndex];
+    uint address = region.indexOffset + primitiveIndex * 6;
+    uint2 words = g_IndexData.Load2(address & ~3u);
+    uint3 indices = (address & 2) == 0 ? uint3(words.x & 0xFFFF, words.x >> 16, words.y & 0xFFFF) : uint3(words.x >> 16, words.y & 0xFFFF, words.y >> 16);
+    indices += region.baseVertex;
+    
     [unroll]
     for (uint i = 0; i < 3; i++)
     {
@@ -152,6 +171,28 @@ void GetTriangleVertices(uint primitiveIndex,out Vertex vertices[3]){
     }
 }
 
+//Potentially visible set of the camera cell. Blocks belong to the cell of their min corner and triangles to the cell of their centroid,
+//positions outside of the grid are always visible
+bool IsCellVisible(float3 position)
+{
+    if (g_CB.pvsCulling == 0)
+        return true;
+    int3 cell = int3(floor(position / g_CB.pvsCellSize)) - g_CB.pvsOriginCell;
+    if (any(cell < 0) || any(cell >= int3(g_CB.pvsGridSize)))
+        return true;
+    uint index = (uint(cell.z) * g_CB.pvsGridSize.y + uint(cell.y)) * g_CB.pvsGridSize.x + uint(cell.x);
+    return ((g_VisibleCells[index >> 5] >> (index & 31)) & 1) != 0;
+}
+
+bool IsTriangleCellVisible(uint geometryIndex, uint primitiveIndex)
+{
+    if (g_CB.pvsCulling == 0)
+        return true;
+    Vertex verts[3];
+    GetTriangleVertices(geometryIndex, primitiveIndex, verts);
+    return IsCellVisible((verts[0].position + verts[1].position + verts[2].position) / 3.0);
+}
+
 int GetAABBMaterialID(AABBMaterials aabbMat, int side)
 {
     switch (side)
@@ -192,19 +233,19 @@ float3 GetAABBNormalFromHitSide(int hitSide)
 }
 
 //Alpha Test for Triangles. Returns true if an opaque surface was hit
-bool TriangleAlphaTest(uint primitiveIndex, float2 triBarycentrics)
+bool TriangleAlphaTest(uint geometryIndex, uint primitiveIndex, float2 triBarycentrics)
 {
-    uint triMaterialID = g_TriMaterialID[primitiveIndex];
+    uint triMaterialID = g_TriMaterialID[GetTriangleIndex(geometryIndex, primitiveIndex)];
     MaterialConstants material = g_Material[triMaterialID];
     
     bool opaqueHit = true;
     
-    //Perform alpha test
-    if (material.domain > 0)
+    //Perform alpha test. Lazy textures may not be loaded yet, the surface is opaque until then
+    if (material.domain > 0 && (material.flags & MaterialFlags_UseBaseOrDiffuseTexture) > 0)
     {
         float3 barycentrics = float3((1.0f - triBarycentrics.x - triBarycentrics.y), triBarycentrics.x, triBarycentrics.y);
         Vertex verts[3];
-        GetTriangleVertices(primitiveIndex,verts);
+        GetTriangleVertices(geometryIndex, primitiveIndex, verts);
         
         float2 uv = verts[0].uv * barycentrics.x + verts[1].uv * barycentrics.y + verts[2].uv * barycentrics.z;
     
@@ -226,7 +267,7 @@ bool AABBAlphaTest(uint primitiveIndex, AttributesAABB attribs)
     bool opaqueHit = true;
     
     //Perform alpha test
-    if (material.domain > 0)
+    if (material.domain > 0 && (material.flags & MaterialFlags_UseBaseOrDiffuseTexture) > 0)
     {
         Texture2D diffuseTexture = t_BindlessTextures[NonUniformResourceIndex(material.baseOrDiffuseTextureIndex)];
         float4 baseColor = diffuseTexture.SampleLevel(s_MaterialSampler, attribs.uv, 0);
@@ -277,17 +318,127 @@ void EvaluateMaterialTextures(inout MaterialConstants material, float2 uv , inou
     material.specularColor = lerp(k_DielectricSpecular,  diffuseColor, material.metalness); //F0Spectular for GGX
 }
 
+// ---[ Occupancy Grid ]---
+
+//Bit of a position inside its 4x4x4 block
+uint OccupancyBitIndex(int3 position)
+{
+    return (position.x & 3) + 4 * (position.y & 3) + 16 * (position.z & 3);
+}
+
+bool TestMaskBit(uint2 mask, uint bit)
+{
+    return ((bit < 32 ? mask.x >> bit : mask.y >> (bit - 32)) & 1) != 0;
+}
+
+uint CountMaskBitsBelow(uint2 mask, uint bit)
+{
+    return bit < 32 ? countbits(mask.x & ((1u << bit) - 1)) : countbits(mask.x) + countbits(mask.y & ((1u << (bit - 32)) - 1));
+}
+
+//Same as OccupancyGrid::GetEmptySize. Size of the empty cube around the grid local cell, 0 if the cell is occupied
+int OccupancyEmptySize(int3 cell)
+{
+    uint3 region = uint3(cell / OCCUPANCY_REGION_SIZE);
+    OccupancyRegion regionData = g_OccupancyRegions[(region.z * g_CB.occupancyGridRegions.y + region.y) * g_CB.occupancyGridRegions.x + region.x];
+    uint brickBit = OccupancyBitIndex(cell / OCCUPANCY_BRICK_SIZE);
+    if (!TestMaskBit(regionData.brickMask, brickBit))
+        return all(regionData.brickMask == 0) ? OCCUPANCY_REGION_SIZE : OCCUPANCY_BRICK_SIZE;
+    
+    uint2 cellMask = g_OccupancyBricks[regionData.firstBrick + CountMaskBitsBelow(regionData.brickMask, brickBit)];
+    return TestMaskBit(cellMask, OccupancyBitIndex(cell)) ? 0 : 1;
+}
+
+//Hierarchical DDA over the occupancy grid, same as OccupancyGrid::Trace. True if the ray segment passes no block.
+//Returns false if a block is found or occupancyMaxSteps is reached
+bool OccupancyGridSegmentEmpty(float3 origin, float3 direction, float tMin, float tMax)
+{
+    const float3 localOrigin = origin - g_CB.occupancyGridOrigin;
+    const int3 numCells = int3(g_CB.occupancyGridRegions) * OCCUPANCY_REGION_SIZE;
+    if (any(numCells == 0))
+        return true;
+    
+    //Clip the segment to the grid bounds
+    float3 invDirection = float3(0, 0, 0);
+    float tEnter = tMin;
+    float tExit = tMax;
+    [unroll]
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (direction[axis] == 0)
+        {
+            if (localOrigin[axis] < 0 || localOrigin[axis] > float(numCells[axis]))
+                return true;
+            continue;
+        }
+        invDirection[axis] = 1.0 / direction[axis];
+        float t0 = -localOrigin[axis] * invDirection[axis];
+        float t1 = (float(numCells[axis]) - localOrigin[axis]) * invDirection[axis];
+        tEnter = max(tEnter, min(t0, t1));
+        tExit = min(tExit, max(t0, t1));
+    }
+    if (tEnter > tExit)
+        return true;
+    
+    float t = tEnter;
+    int3 cell = clamp(int3(floor(localOrigin + direction * t)), int3(0, 0, 0), numCells - 1);
+    [loop]
+    for (uint stepIndex = 0; stepIndex < g_CB.occupancyMaxSteps; stepIndex++)
+    {
+        int emptySize = OccupancyEmptySize(cell);
+        if (emptySize == 0)
+            return false;
+        
+        //Leave the empty cube through the nearest face
+        int3 cubeMin = (cell / emptySize) * emptySize;
+        float3 tFace = float3(kFloatMax, kFloatMax, kFloatMax);
+        [unroll]
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (direction[axis] != 0)
+                tFace[axis] = (float(direction[axis] > 0 ? cubeMin[axis] + emptySize : cubeMin[axis]) - localOrigin[axis]) * invDirection[axis];
+        }
+        float tNext = min(min(tFace.x, tFace.y), tFace.z);
+        if (tNext > tExit)
+            return true;
+        t = max(t, tNext);
+        
+        //Step over the exit faces, the other axes stay inside the cube
+        float3 position = localOrigin + direction * t;
+        [unroll]
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (tFace[axis] <= tNext)
+                cell[axis] = direction[axis] > 0 ? cubeMin[axis] + emptySize : cubeMin[axis] - 1;
+            else
+                cell[axis] = clamp(int(floor(position[axis])), cubeMin[axis], cubeMin[axis] + emptySize - 1);
+        }
+        if (any(cell < 0) || any(cell >= numCells))
+            return true;
+    }
+    return false;
+}
+
 //Shadow test using ray queries. True if lit, false if shadowed
-bool RayShadowTest(float3 posW, float3 faceN, float3 toLight)
+bool RayShadowTest(float3 posW, float3 faceN, float3 toLight, float maxDistance)
 {
     RayDesc shadowRay;
     shadowRay.Origin = posW + faceN * g_CB.shadowRayOffset;
     shadowRay.Direction = toLight;
     shadowRay.TMin = g_CB.shadowRayOffset;
-    shadowRay.TMax = g_CB.cameraFar; //Approximate with camera far
+    shadowRay.TMax = maxDistance;
+    
+    //The block instance can be skipped if the occupancy grid shows no block along the ray
+    uint instanceMask = 0xFF;
+    if (g_CB.occupancyMaxSteps > 0 && OccupancyGridSegmentEmpty(shadowRay.Origin, shadowRay.Direction, shadowRay.TMin, shadowRay.TMax))
+    {
+        if (g_CB.sceneHasTriangles == 0)
+            return true;
+        instanceMask = INSTANCE_MASK_TRIANGLES;
+    }
     
     RayQuery<RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH> rayQuery;
-    rayQuery.TraceRayInline(SceneBVH, RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH, 0xFF, shadowRay);
+    rayQuery.TraceRayInline(SceneBVH, RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH, instanceMask, shadowRay);
     
     while(rayQuery.Proceed())
     {
@@ -330,7 +481,7 @@ bool RayShadowTest(float3 posW, float3 faceN, float3 toLight)
         {
             if(rayQuery.CommittedInstanceID()!=0)
                     continue;
-            if(TriangleAlphaTest(rayQuery.CandidatePrimitiveIndex(), rayQuery.CandidateTriangleBarycentrics()))
+            if(TriangleAlphaTest(rayQuery.CandidateGeometryIndex(), rayQuery.CandidatePrimitiveIndex(), rayQuery.CandidateTriangleBarycentrics()))
             {
                 rayQuery.CommitNonOpaqueTriangleHit();
                 rayQuery.Abort();
@@ -342,6 +493,125 @@ bool RayShadowTest(float3 posW, float3 faceN, float3 toLight)
     return rayQuery.CommittedStatus() == COMMITTED_NOTHING;
 }
 
+// ---[ Emissive Light Sampling ]---
+
+//PCG hash (Jarzynski and Olano, "Hash Functions for GPU Rendering", 2020)
+uint PcgHash(uint v)
+{
+    uint state = v * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+uint InitRandomSeed(uint2 pixel, uint frameIndex)
+{
+    return PcgHash(pixel.x + PcgHash(pixel.y + PcgHash(frameIndex)));
+}
+
+//Returns a random float in [0,1)
+float NextRandom(inout uint state)
+{
+    state = PcgHash(state);
+    return float(state >> 8) * (1.0 / 16777216.0);
+}
+
+//Same heuristic as NodeImportance in LightTree.cpp
+float LightTreeNodeImportance(LightTreeNode node, float3 posW)
+{
+    float3 center = (node.boundsMin + node.boundsMax) * 0.5;
+    float3 extent = node.boundsMax - node.boundsMin;
+    float3 toCenter = center - posW;
+    float distanceSquared = max(dot(toCenter, toCenter), 0.25 * dot(extent, extent));
+    return node.power / max(distanceSquared, 1e-4);
+}
+
+//Stochastic traversal of the light tree. Picks one child per level proportional to its importance, LightTree::SampleLight is the same on the CPU
+bool SampleLightTree(float3 posW, inout uint rngState, out uint lightIndex, out float pdf)
+{
+    pdf = 1.0;
+    lightIndex = 0;
+    uint nodeIndex = 0;
+    
+    [loop]
+    for (uint depth = 0; depth < kLightTreeMaxDepth; depth++)
+    {
+        uint childOrLight = g_LightTree[nodeIndex].childOrLight;
+        if ((childOrLight & LIGHT_TREE_LEAF_FLAG) != 0)
+        {
+            lightIndex = childOrLight & ~LIGHT_TREE_LEAF_FLAG;
+            return true;
+        }
+        
+        float importanceLeft = LightTreeNodeImportance(g_LightTree[childOrLight], posW);
+        float importanceRight = LightTreeNodeImportance(g_LightTree[childOrLight + 1], posW);
+        float total = importanceLeft + importanceRight;
+        if (total <= 0)
+            return false;
+        
+        float probLeft = importanceLeft / total;
+        if (NextRandom(rngState) < probLeft)
+        {
+            nodeIndex = childOrLight;
+            pdf *= probLeft;
+        }
+        else
+        {
+            nodeIndex = childOrLight + 1;
+            pdf *= 1.0 - probLeft;
+        }
+    }
+    return false;
+}
+
+//Direct light from one emissive surface picked with the light tree
+float3 SampleEmissiveLight(float3 posW, float3 faceN, float3 normal, MaterialConstants material, inout uint rngState)
+{
+    uint lightIndex;
+    float selectionPdf;
+    if (!SampleLightTree(posW, rngState, lightIndex, selectionPdf) || selectionPdf <= 0)
+        return float3(0, 0, 0);
+    
+    EmissiveLight light = g_EmissiveLights[lightIndex];
+    bool isTriangle = (light.flags & EMISSIVE_LIGHT_FLAG_TRIANGLE) != 0;
+    
+    //Uniform point on the light surface
+    float2 u = float2(NextRandom(rngState), NextRandom(rngState));
+    if (isTriangle && u.x + u.y > 1.0)
+        u = 1.0 - u;
+    float3 lightPos = light.origin + light.edge1 * u.x + light.edge2 * u.y;
+    float3 lightNormalArea = cross(light.edge1, light.edge2);
+    float area = length(lightNormalArea) * (isTriangle ? 0.5 : 1.0);
+    float3 lightNormal = normalize(lightNormalArea);
+    
+    float3 toLight = lightPos - posW;
+    float distanceSquared = dot(toLight, toLight);
+    float distance = sqrt(distanceSquared);
+    toLight /= distance;
+    
+    float cosLight = dot(lightNormal, -toLight);
+    if ((light.flags & EMISSIVE_LIGHT_FLAG_DOUBLE_SIDED) != 0)
+        cosLight = abs(cosLight);
+    if (cosLight <= 0 || dot(normal, toLight) <= 0)
+        return float3(0, 0, 0);
+    
+    //Emitted radiance, the emissive texture is sampled with the surface parameterization
+    MaterialConstants lightMaterial = g_Material[light.matID];
+    float3 emission = lightMaterial.emissiveColor;
+    if ((lightMaterial.flags & MaterialFlags_UseEmissiveTexture) > 0)
+    {
+        Texture2D emissiveTexture = t_BindlessTextures[NonUniformResourceIndex(lightMaterial.emissiveTextureIndex)];
+        emission = emissiveTexture.SampleLevel(s_MaterialSampler, u, 0).xyz;
+    }
+    emission *= g_CB.emissiveStrength;
+    
+    if (!RayShadowTest(posW, faceN, toLight, distance - 2.0 * g_CB.shadowRayOffset))
+        return float3(0, 0, 0);
+    
+    //Convert the area pdf to solid angle and divide by the selection probability
+    float geometryTerm = cosLight * area / distanceSquared;
+    return Lambert(normal, -toLight) * material.baseOrDiffuseColor * emission * geometryTerm / selectionPdf;
+}
+
 // ---[ Miss Shader ]---
 
 [shader("miss")]
@@ -355,7 +625,7 @@ void Miss(inout HitInfo payload : SV_RayPayload)
 void AnyHitTriangle(inout HitInfo payload : SV_RayPayload,
     Attributes attrib : SV_IntersectionAttributes)
 {
-    if(!TriangleAlphaTest(PrimitiveIndex(), attrib.uv))
+    if(!IsTriangleCellVisible(GeometryIndex(), PrimitiveIndex()) || !TriangleAlphaTest(GeometryIndex(), PrimitiveIndex(), attrib.uv))
         IgnoreHit();   
 }
 
@@ -375,8 +645,8 @@ void ClosestHitTriangle(inout HitInfo payload : SV_RayPayload,
 {
     float3 barycentrics = float3((1.0f - attrib.uv.x - attrib.uv.y), attrib.uv.x, attrib.uv.y);
     Vertex verts[3];
-    GetTriangleVertices(PrimitiveIndex(),verts);
-    uint triMaterialID = g_TriMaterialID[PrimitiveIndex()];
+    GetTriangleVertices(GeometryIndex(), PrimitiveIndex(), verts);
+    uint triMaterialID = g_TriMaterialID[GetTriangleIndex(GeometryIndex(), PrimitiveIndex())];
         
     //Fill payload hit data
     payload.hitType = kHitTypeTriangle;
@@ -405,6 +675,8 @@ void IntersectionAABB()
 {
     uint bufferIndex = PrimitiveIndex() * 3;
     AABB aabb = ReadAABBFromDataBuffer(bufferIndex);
+    if (!IsCellVisible(aabb.min))
+        return;
     
     float distance = -1;
     float3 normal = float3(0,0,0);
@@ -455,7 +727,7 @@ void RayGen()
     RAY_FLAG_NONE,  //Ray Flags
     0xFF,           //Instance Mask
     0,              //Offset for Hit Kind
-    2,              //Mulitplier for Hit Kind offset
+    0,              //Mulitplier for Hit Kind offset, all geometries (triangle regions) of an instance share its hit group
     0,              //Miss shader index
     ray,            //Ray Description
     payload);       //Payload
@@ -468,6 +740,10 @@ void RayGen()
         
         MaterialConstants material = g_Material[payload.matID];
         
+        //Request the textures of the material (lazy textures)
+        if (g_CB.textureFeedback != 0)
+            g_MaterialFeedback[payload.matID] = 1;
+        
         //Flip normal if material is double sided and normal is backfacing
         if ((material.flags & MaterialFlags_DoubleSided) > 0){
             if(dot(payload.normal, -ray.Direction) < 0){
@@ -491,14 +767,26 @@ void RayGen()
         
         float3 diffuseRadiance = float3(0,0,0);
         float3 specularRadiance = float3(0,0,0);
-        if(RayShadowTest(posW, faceN, -dirLight.direction))
+        if(RayShadowTest(posW, faceN, -dirLight.direction, g_CB.cameraFar)) //Approximate with camera far
         {
             diffuseRadiance = Lambert(payload.normal, dirLight.direction) * material.baseOrDiffuseColor * dirLight.intensity;
             specularRadiance = GGX_AnalyticalLights_times_NdotL(dirLight.direction, ray.Direction, payload.normal,
                 material.roughness, material.specularColor, dirLight.angularSizeOrInvRange * 0.5) * dirLight.intensity;
         }
                 
-        outColor = emission + ambient + reflectionAmbient + diffuseRadiance + specularRadiance;
+        //Emissive blocks
+        float3 emissiveLightRadiance = float3(0,0,0);
+        if (g_CB.numEmissiveLights > 0 && g_CB.emissiveLightSamples > 0)
+        {
+            uint rngState = InitRandomSeed(LaunchIndex, g_CB.frameIndex);
+            for (uint s = 0; s < g_CB.emissiveLightSamples; s++)
+            {
+                emissiveLightRadiance += SampleEmissiveLight(posW, faceN, payload.normal, material, rngState);
+            }
+            emissiveLightRadiance /= float(g_CB.emissiveLightSamples);
+        }
+                
+        outColor = emission + ambient + reflectionAmbient + diffuseRadiance + specularRadiance + emissiveLightRadiance;
     }
     else //Set to background color
     {
@@ -0,0 +1,554 @@
+#include "RecordingDevice.h"
+#include <nvrhi/common/aftermath.h>
+#include <donut/core/log.h>
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+using namespace donut;
+
+//Bytes of one mip of one array slice, or of all depth slices of a 3D texture
+static uint64_t GetMipBytes(const nvrhi::TextureDesc& desc, uint32_t mipLevel) {
+	const nvrhi::FormatInfo& info = nvrhi::getFormatInfo(desc.format);
+	uint64_t blockSize = std::max<uint64_t>(info.blockSize, 1);
+	uint64_t blocksX = (std::max(desc.width >> mipLevel, 1u) + blockSize - 1) / blockSize;
+	uint64_t blocksY = (std::max(desc.height >> mipLevel, 1u) + blockSize - 1) / blockSize;
+	uint64_t depth = desc.dimension == nvrhi::TextureDimension::Texture3D ? std::max(desc.depth >> mipLevel, 1u) : 1;
+	return blocksX * blocksY * depth * info.bytesPerBlock;
+}
+
+static uint64_t GetTextureBytes(const nvrhi::TextureDesc& desc) {
+	uint64_t bytes = 0;
+	for (uint32_t mip = 0; mip < desc.mipLevels; mip++)
+		bytes += GetMipBytes(desc, mip);
+	return bytes * (desc.dimension == nvrhi::TextureDimension::Texture3D ? 1 : desc.arraySize);
+}
+
+namespace {
+	class Buffer : public nvrhi::RefCounter<nvrhi::IBuffer> {
+	public:
+		Buffer(const nvrhi::BufferDesc& desc, nvrhi::GpuVirtualAddress address) : m_Desc(desc), m_Address(address) {}
+		const nvrhi::BufferDesc& getDesc() const override { return m_Desc; }
+		nvrhi::GpuVirtualAddress getGpuVirtualAddress() const override { return m_Address; }
+
+		//CPU memory for mapBuffer, allocated on the first map
+		void* Map() {
+			if (m_Memory.empty())
+				m_Memory.resize(size_t(m_Desc.byteSize), 0);
+			return m_Memory.data();
+		}
+
+	private:
+		nvrhi::BufferDesc m_Desc;
+		nvrhi::GpuVirtualAddress m_Address;
+		std::vector<uint8_t> m_Memory;
+	};
+
+	class Texture : public nvrhi::RefCounter<nvrhi::ITexture> {
+	public:
+		Texture(const nvrhi::TextureDesc& desc) : m_Desc(desc) {}
+		const nvrhi::TextureDesc& getDesc() const override { return m_Desc; }
+		nvrhi::Object getNativeView(nvrhi::ObjectType objectType, nvrhi::Format format, nvrhi::TextureSubresourceSet subresources,
+			nvrhi::TextureDimension dimension, bool isReadOnlyDSV) override { return nullptr; }
+
+	private:
+		nvrhi::TextureDesc m_Desc;
+	};
+
+	class Shader : public nvrhi::RefCounter<nvrhi::IShader> {
+	public:
+		Shader(const nvrhi::ShaderDesc& desc, const void* binary, size_t binarySize) : m_Desc(desc),
+			m_Bytecode((const uint8_t*)binary, (const uint8_t*)binary + (binary ? binarySize : 0)) {}
+		const nvrhi::ShaderDesc& getDesc() const override { return m_Desc; }
+		void getBytecode(const void** ppBytecode, size_t* pSize) const override {
+			if (ppBytecode)
+				*ppBytecode = m_Bytecode.data();
+			if (pSize)
+				*pSize = m_Bytecode.size();
+		}
+
+	private:
+		nvrhi::ShaderDesc m_Desc;
+		std::vector<uint8_t> m_Bytecode;
+	};
+
+	class Sampler : public nvrhi::RefCounter<nvrhi::ISampler> {
+	public:
+		Sampler(const nvrhi::SamplerDesc& desc) : m_Desc(desc) {}
+		const nvrhi::SamplerDesc& getDesc() const override { return m_Desc; }
+
+	private:
+		nvrhi::SamplerDesc m_Desc;
+	};
+
+	class ComputePipeline : public nvrhi::RefCounter<nvrhi::IComputePipeline> {
+	public:
+		ComputePipeline(const nvrhi::ComputePipelineDesc& desc) : m_Desc(desc) {}
+		const nvrhi::ComputePipelineDesc& getDesc() const override { return m_Desc; }
+
+	private:
+		nvrhi::ComputePipelineDesc m_Desc;
+	};
+
+	class BindingLayout : public nvrhi::RefCounter<nvrhi::IBindingLayout> {
+	public:
+		BindingLayout(const nvrhi::BindingLayoutDesc& desc) : m_Desc(desc) {}
+		BindingLayout(const nvrhi::BindlessLayoutDesc& desc) : m_BindlessDesc(desc), m_IsBindless(true) {}
+		const nvrhi::BindingLayoutDesc* getDesc() const override { return m_IsBindless ? nullptr : &m_Desc; }
+		const nvrhi::BindlessLayoutDesc* getBindlessDesc() const override { return m_IsBindless ? &m_BindlessDesc : nullptr; }
+
+	private:
+		nvrhi::BindingLayoutDesc m_Desc;
+		nvrhi::BindlessLayoutDesc m_BindlessDesc;
+		bool m_IsBindless = false;
+	};
+
+	class BindingSet : public nvrhi::RefCounter<nvrhi::IBindingSet> {
+	public:
+		BindingSet(const nvrhi::BindingSetDesc& desc, nvrhi::IBindingLayout* layout) : m_Desc(desc), m_Layout(layout) {}
+		const nvrhi::BindingSetDesc* getDesc() const override { return &m_Desc; }
+		nvrhi::IBindingLayout* getLayout() const override { return m_Layout; }
+
+	private:
+		nvrhi::BindingSetDesc m_Desc;
+		nvrhi::BindingLayoutHandle m_Layout;
+	};
+
+	class DescriptorTable : public nvrhi::RefCounter<nvrhi::IDescriptorTable> {
+	public:
+		DescriptorTable(nvrhi::IBindingLayout* layout) : m_Layout(layout) {}
+		const nvrhi::BindingSetDesc* getDesc() const override { return nullptr; }
+		nvrhi::IBindingLayout* getLayout() const override { return m_Layout; }
+		uint32_t getCapacity() const override { return m_Capacity; }
+		uint32_t getFirstDescriptorIndexInHeap() const override { return 0; }
+
+		uint32_t m_Capacity = 0;
+
+	private:
+		nvrhi::BindingLayoutHandle m_Layout;
+	};
+
+	class AccelStruct : public nvrhi::RefCounter<nvrhi::rt::IAccelStruct> {
+	public:
+		AccelStruct(const nvrhi::rt::AccelStructDesc& desc, uint64_t address) : m_Desc(desc), m_Address(address) {}
+		const nvrhi::rt::AccelStructDesc& getDesc() const override { return m_Desc; }
+		bool isCompacted() const override { return false; }
+		uint64_t getDeviceAddress() const override { return m_Address; }
+
+	private:
+		nvrhi::rt::AccelStructDesc m_Desc;
+		uint64_t m_Address;
+	};
+
+	class EventQuery : public nvrhi::RefCounter<nvrhi::IEventQuery> {};
+	class TimerQuery : public nvrhi::RefCounter<nvrhi::ITimerQuery> {};
+
+	class LogCallback : public nvrhi::IMessageCallback {
+	public:
+		void message(nvrhi::MessageSeverity severity, const char* messageText) override {
+			switch (severity) {
+			case nvrhi::MessageSeverity::Info: log::info("RecordingDevice: %s", messageText); break;
+			case nvrhi::MessageSeverity::Warning: log::warning("RecordingDevice: %s", messageText); break;
+			default: log::error("RecordingDevice: %s", messageText); break;
+			}
+		}
+	};
+
+	class Device : public nvrhi::RefCounter<nvrhi::IDevice> {
+	public:
+		Device(nvrhi::GraphicsAPI api) : m_GraphicsAPI(api) {}
+
+		//Runs function on the stats under the lock of the device
+		template<typename Function>
+		void Record(Function function) {
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			function(m_Stats);
+		}
+		RecordingDevice::Stats GetStats() {
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			return m_Stats;
+		}
+		void ResetStats() {
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Stats = RecordingDevice::Stats();
+		}
+
+		nvrhi::HeapHandle createHeap(const nvrhi::HeapDesc& d) override { return nullptr; }
+
+		nvrhi::TextureHandle createTexture(const nvrhi::TextureDesc& d) override {
+			Record([&](RecordingDevice::Stats& stats) {
+				stats.numTextures++;
+				stats.textureBytes += GetTextureBytes(d);
+			});
+			return nvrhi::TextureHandle::Create(new Texture(d));
+		}
+		nvrhi::MemoryRequirements getTextureMemoryRequirements(nvrhi::ITexture* texture) override {
+			nvrhi::MemoryRequirements requirements;
+			requirements.size = texture ? GetTextureBytes(texture->getDesc()) : 0;
+			requirements.alignment = 65536;
+			return requirements;
+		}
+		bool bindTextureMemory(nvrhi::ITexture* texture, nvrhi::IHeap* heap, uint64_t offset) override { return true; }
+		nvrhi::TextureHandle createHandleForNativeTexture(nvrhi::ObjectType objectType, nvrhi::Object texture, const nvrhi::TextureDesc& desc) override {
+			return nullptr;
+		}
+
+		nvrhi::StagingTextureHandle createStagingTexture(const nvrhi::TextureDesc& d, nvrhi::CpuAccessMode cpuAccess) override { return nullptr; }
+		void* mapStagingTexture(nvrhi::IStagingTexture* tex, const nvrhi::TextureSlice& slice, nvrhi::CpuAccessMode cpuAccess, size_t* outRowPitch) override {
+			return nullptr;
+		}
+		void unmapStagingTexture(nvrhi::IStagingTexture* tex) override {}
+
+		void getTextureTiling(nvrhi::ITexture* texture, uint32_t* numTiles, nvrhi::PackedMipDesc* desc, nvrhi::TileShape* tileShape,
+			uint32_t* subresourceTilingsNum, nvrhi::SubresourceTiling* subresourceTilings) override {
+			if (numTiles)
+				*numTiles = 0;
+			if (subresourceTilingsNum)
+				*subresourceTilingsNum = 0;
+		}
+		void updateTextureTileMappings(nvrhi::ITexture* texture, const nvrhi::TextureTilesMapping* tileMappings, uint32_t numTileMappings,
+			nvrhi::CommandQueue executionQueue) override {}
+
+		nvrhi::SamplerFeedbackTextureHandle createSamplerFeedbackTexture(nvrhi::ITexture* pairedTexture, const nvrhi::SamplerFeedbackTextureDesc& desc) override {
+			return nullptr;
+		}
+		nvrhi::SamplerFeedbackTextureHandle createSamplerFeedbackForNativeTexture(nvrhi::ObjectType objectType, nvrhi::Object texture,
+			nvrhi::ITexture* pairedTexture) override { return nullptr; }
+
+		nvrhi::BufferHandle createBuffer(const nvrhi::BufferDesc& d) override {
+			nvrhi::GpuVirtualAddress address = 0;
+			Record([&](RecordingDevice::Stats& stats) {
+				stats.numBuffers++;
+				stats.bufferBytes += d.byteSize;
+				address = AllocateAddress(d.byteSize);
+			});
+			return nvrhi::BufferHandle::Create(new Buffer(d, address));
+		}
+		void* mapBuffer(nvrhi::IBuffer* buffer, nvrhi::CpuAccessMode cpuAccess) override {
+			return buffer ? static_cast<Buffer*>(buffer)->Map() : nullptr;
+		}
+		void unmapBuffer(nvrhi::IBuffer* buffer) override {}
+		nvrhi::MemoryRequirements getBufferMemoryRequirements(nvrhi::IBuffer* buffer) override {
+			nvrhi::MemoryRequirements requirements;
+			requirements.size = buffer ? buffer->getDesc().byteSize : 0;
+			requirements.alignment = 256;
+			return requirements;
+		}
+		bool bindBufferMemory(nvrhi::IBuffer* buffer, nvrhi::IHeap* heap, uint64_t offset) override { return true; }
+		nvrhi::BufferHandle createHandleForNativeBuffer(nvrhi::ObjectType objectType, nvrhi::Object buffer, const nvrhi::BufferDesc& desc) override {
+			return nullptr;
+		}
+
+		nvrhi::ShaderHandle createShader(const nvrhi::ShaderDesc& d, const void* binary, size_t binarySize) override {
+			Record([&](RecordingDevice::Stats& stats) {
+				stats.numShaders++;
+				stats.shaderBytes += binarySize;
+			});
+			return nvrhi::ShaderHandle::Create(new Shader(d, binary, binarySize));
+		}
+		nvrhi::ShaderHandle createShaderSpecialization(nvrhi::IShader* baseShader, const nvrhi::ShaderSpecialization* constants, uint32_t numConstants) override {
+			if (!baseShader)
+				return nullptr;
+			const void* binary = nullptr;
+			size_t binarySize = 0;
+			baseShader->getBytecode(&binary, &binarySize);
+			return createShader(baseShader->getDesc(), binary, binarySize);
+		}
+		nvrhi::ShaderLibraryHandle createShaderLibrary(const void* binary, size_t binarySize) override { return nullptr; }
+
+		nvrhi::SamplerHandle createSampler(const nvrhi::SamplerDesc& d) override {
+			Record([](RecordingDevice::Stats& stats) { stats.numSamplers++; });
+			return nvrhi::SamplerHandle::Create(new Sampler(d));
+		}
+
+		nvrhi::InputLayoutHandle createInputLayout(const nvrhi::VertexAttributeDesc* d, uint32_t attributeCount, nvrhi::IShader* vertexShader) override {
+			return nullptr;
+		}
+
+		nvrhi::EventQueryHandle createEventQuery() override { return nvrhi::EventQueryHandle::Create(new EventQuery()); }
+		void setEventQuery(nvrhi::IEventQuery* query, nvrhi::CommandQueue queue) override {}
+		bool pollEventQuery(nvrhi::IEventQuery* query) override { return true; }
+		void waitEventQuery(nvrhi::IEventQuery* query) override {}
+		void resetEventQuery(nvrhi::IEventQuery* query) override {}
+
+		nvrhi::TimerQueryHandle createTimerQuery() override { return nvrhi::TimerQueryHandle::Create(new TimerQuery()); }
+		bool pollTimerQuery(nvrhi::ITimerQuery* query) override { return true; }
+		float getTimerQueryTime(nvrhi::ITimerQuery* query) override { return 0.f; }
+		void resetTimerQuery(nvrhi::ITimerQuery* query) override {}
+
+		nvrhi::GraphicsAPI getGraphicsAPI() override { return m_GraphicsAPI; }
+
+		nvrhi::FramebufferHandle createFramebuffer(const nvrhi::FramebufferDesc& desc) override { return nullptr; }
+		nvrhi::GraphicsPipelineHandle createGraphicsPipeline(const nvrhi::GraphicsPipelineDesc& desc, nvrhi::FramebufferInfo const& fbinfo) override {
+			return nullptr;
+		}
+		nvrhi::GraphicsPipelineHandle createGraphicsPipeline(const nvrhi::GraphicsPipelineDesc& desc, nvrhi::IFramebuffer* fb) override { return nullptr; }
+		nvrhi::ComputePipelineHandle createComputePipeline(const nvrhi::ComputePipelineDesc& desc) override {
+			Record([](RecordingDevice::Stats& stats) { stats.numPipelines++; });
+			return nvrhi::ComputePipelineHandle::Create(new ComputePipeline(desc));
+		}
+		nvrhi::MeshletPipelineHandle createMeshletPipeline(const nvrhi::MeshletPipelineDesc& desc, nvrhi::FramebufferInfo const& fbinfo) override {
+			return nullptr;
+		}
+		nvrhi::MeshletPipelineHandle createMeshletPipeline(const nvrhi::MeshletPipelineDesc& desc, nvrhi::IFramebuffer* fb) override { return nullptr; }
+		nvrhi::rt::PipelineHandle createRayTracingPipeline(const nvrhi::rt::PipelineDesc& desc) override { return nullptr; }
+
+		nvrhi::BindingLayoutHandle createBindingLayout(const nvrhi::BindingLayoutDesc& desc) override {
+			Record([](RecordingDevice::Stats& stats) { stats.numBindingLayouts++; });
+			return nvrhi::BindingLayoutHandle::Create(new BindingLayout(desc));
+		}
+		nvrhi::BindingLayoutHandle createBindlessLayout(const nvrhi::BindlessLayoutDesc& desc) override {
+			Record([](RecordingDevice::Stats& stats) { stats.numBindingLayouts++; });
+			return nvrhi::BindingLayoutHandle::Create(new BindingLayout(desc));
+		}
+		nvrhi::BindingSetHandle createBindingSet(const nvrhi::BindingSetDesc& desc, nvrhi::IBindingLayout* layout) override {
+			Record([](RecordingDevice::Stats& stats) { stats.numBindingSets++; });
+			return nvrhi::BindingSetHandle::Create(new BindingSet(desc, layout));
+		}
+		nvrhi::DescriptorTableHandle createDescriptorTable(nvrhi::IBindingLayout* layout) override {
+			Record([](RecordingDevice::Stats& stats) { stats.numDescriptorTables++; });
+			return nvrhi::DescriptorTableHandle::Create(new DescriptorTable(layout));
+		}
+		void resizeDescriptorTable(nvrhi::IDescriptorTable* descriptorTable, uint32_t newSize, bool keepContents) override {
+			if (descriptorTable)
+				static_cast<DescriptorTable*>(descriptorTable)->m_Capacity = newSize;
+		}
+		bool writeDescriptorTable(nvrhi::IDescriptorTable* descriptorTable, const nvrhi::BindingSetItem& item) override {
+			if (!descriptorTable || item.slot >= descriptorTable->getCapacity())
+				return false;
+			Record([](RecordingDevice::Stats& stats) { stats.numDescriptorWrites++; });
+			return true;
+		}
+
+		nvrhi::rt::OpacityMicromapHandle createOpacityMicromap(const nvrhi::rt::OpacityMicromapDesc& desc) override { return nullptr; }
+		nvrhi::rt::AccelStructHandle createAccelStruct(const nvrhi::rt::AccelStructDesc& desc) override {
+			uint64_t address = 0;
+			Record([&](RecordingDevice::Stats& stats) {
+				stats.numAccelStructs++;
+				address = AllocateAddress(1);
+			});
+			return nvrhi::rt::AccelStructHandle::Create(new AccelStruct(desc, address));
+		}
+		nvrhi::MemoryRequirements getAccelStructMemoryRequirements(nvrhi::rt::IAccelStruct* as) override { return nvrhi::MemoryRequirements(); }
+		nvrhi::rt::cluster::OperationSizeInfo getClusterOperationSizeInfo(const nvrhi::rt::cluster::OperationParams& params) override {
+			return nvrhi::rt::cluster::OperationSizeInfo();
+		}
+		bool bindAccelStructMemory(nvrhi::rt::IAccelStruct* as, nvrhi::IHeap* heap, uint64_t offset) override { return true; }
+
+		nvrhi::CommandListHandle createCommandList(const nvrhi::CommandListParameters& params) override;
+		uint64_t executeCommandLists(nvrhi::ICommandList* const* pCommandLists, size_t numCommandLists, nvrhi::CommandQueue executionQueue) override {
+			Record([&](RecordingDevice::Stats& stats) { stats.numExecutedCommandLists += numCommandLists; });
+			return ++m_LastInstance;
+		}
+		void queueWaitForCommandList(nvrhi::CommandQueue waitQueue, nvrhi::CommandQueue executionQueue, uint64_t instance) override {}
+		bool waitForIdle() override { return true; }
+		void runGarbageCollection() override {}
+
+		//Reports every feature as supported, so the loader takes its ray tracing paths. Feature info structs are zeroed
+		bool queryFeatureSupport(nvrhi::Feature feature, void* pInfo, size_t infoSize) override {
+			if (pInfo)
+				memset(pInfo, 0, infoSize);
+			return true;
+		}
+		nvrhi::FormatSupport queryFormatSupport(nvrhi::Format format) override { return nvrhi::FormatSupport(~0u); }
+		nvrhi::coopvec::DeviceFeatures queryCoopVecFeatures() override { return nvrhi::coopvec::DeviceFeatures(); }
+		size_t getCoopVecMatrixSize(nvrhi::coopvec::DataType type, nvrhi::coopvec::MatrixLayout layout, int rows, int columns) override { return 0; }
+
+		nvrhi::Object getNativeQueue(nvrhi::ObjectType objectType, nvrhi::CommandQueue queue) override { return nullptr; }
+		nvrhi::IMessageCallback* getMessageCallback() override { return &m_MessageCallback; }
+		bool isAftermathEnabled() override { return false; }
+		nvrhi::AftermathCrashDumpHelper& getAftermathCrashDumpHelper() override { return m_AftermathCrashDumpHelper; }
+
+	private:
+		//Unique fake GPU addresses, called under the lock
+		uint64_t AllocateAddress(uint64_t byteSize) {
+			uint64_t address = m_NextAddress;
+			m_NextAddress += (std::max<uint64_t>(byteSize, 1) + 255) & ~uint64_t(255);
+			return address;
+		}
+
+		nvrhi::GraphicsAPI m_GraphicsAPI;
+		std::mutex m_Mutex;
+		RecordingDevice::Stats m_Stats;
+		uint64_t m_NextAddress = 65536;
+		uint64_t m_LastInstance = 0;
+		LogCallback m_MessageCallback;
+		nvrhi::AftermathCrashDumpHelper m_AftermathCrashDumpHelper;
+	};
+
+	//Counts the commands into the stats of its device as they are recorded
+	class CommandList : public nvrhi::RefCounter<nvrhi::ICommandList> {
+	public:
+		CommandList(Device* device, const nvrhi::CommandListParameters& params) : m_Device(device), m_Params(params) {}
+
+		void open() override {}
+		void close() override {}
+		void clearState() override {}
+
+		void clearTextureFloat(nvrhi::ITexture* t, nvrhi::TextureSubresourceSet subresources, const nvrhi::Color& clearColor) override { CountTextureClear(); }
+		void clearDepthStencilTexture(nvrhi::ITexture* t, nvrhi::TextureSubresourceSet subresources, bool clearDepth, float depth, bool clearStencil,
+			uint8_t stencil) override { CountTextureClear(); }
+		void clearTextureUInt(nvrhi::ITexture* t, nvrhi::TextureSubresourceSet subresources, uint32_t clearColor) override { CountTextureClear(); }
+
+		void copyTexture(nvrhi::ITexture* dest, const nvrhi::TextureSlice& destSlice, nvrhi::ITexture* src, const nvrhi::TextureSlice& srcSlice) override {}
+		void copyTexture(nvrhi::IStagingTexture* dest, const nvrhi::TextureSlice& destSlice, nvrhi::ITexture* src, const nvrhi::TextureSlice& srcSlice) override {}
+		void copyTexture(nvrhi::ITexture* dest, const nvrhi::TextureSlice& destSlice, nvrhi::IStagingTexture* src, const nvrhi::TextureSlice& srcSlice) override {}
+		void writeTexture(nvrhi::ITexture* dest, uint32_t arraySlice, uint32_t mipLevel, const void* data, size_t rowPitch, size_t depthPitch) override {
+			uint64_t bytes = 0;
+			if (dest) {
+				const nvrhi::TextureDesc& desc = dest->getDesc();
+				uint64_t blockSize = std::max<uint64_t>(nvrhi::getFormatInfo(desc.format).blockSize, 1);
+				uint64_t rows = (std::max(desc.height >> mipLevel, 1u) + blockSize - 1) / blockSize;
+				uint64_t depth = desc.dimension == nvrhi::TextureDimension::Texture3D ? std::max(desc.depth >> mipLevel, 1u) : 1;
+				bytes = depth > 1 && depthPitch ? depthPitch * depth : rowPitch * rows * depth;
+			}
+			m_Device->Record([&](RecordingDevice::Stats& stats) {
+				stats.numTextureWrites++;
+				stats.textureWriteBytes += bytes;
+			});
+		}
+		void resolveTexture(nvrhi::ITexture* dest, const nvrhi::TextureSubresourceSet& dstSubresources, nvrhi::ITexture* src,
+			const nvrhi::TextureSubresourceSet& srcSubresources) override {}
+
+		void writeBuffer(nvrhi::IBuffer* b, const void* data, size_t dataSize, uint64_t destOffsetBytes) override {
+			m_Device->Record([&](RecordingDevice::Stats& stats) {
+				stats.numBufferWrites++;
+				stats.bufferWriteBytes += dataSize;
+			});
+		}
+		void clearBufferUInt(nvrhi::IBuffer* b, uint32_t clearValue) override {
+			m_Device->Record([](RecordingDevice::Stats& stats) { stats.numBufferClears++; });
+		}
+		void copyBuffer(nvrhi::IBuffer* dest, uint64_t destOffsetBytes, nvrhi::IBuffer* src, uint64_t srcOffsetBytes, uint64_t dataSizeBytes) override {
+			m_Device->Record([&](RecordingDevice::Stats& stats) {
+				stats.numBufferCopies++;
+				stats.bufferCopyBytes += dataSizeBytes;
+			});
+		}
+
+		void clearSamplerFeedbackTexture(nvrhi::ISamplerFeedbackTexture* texture) override {}
+		void decodeSamplerFeedbackTexture(nvrhi::IBuffer* buffer, nvrhi::ISamplerFeedbackTexture* texture, nvrhi::Format format) override {}
+		void setSamplerFeedbackTextureState(nvrhi::ISamplerFeedbackTexture* texture, nvrhi::ResourceStates stateBits) override {}
+
+		void setPushConstants(const void* data, size_t byteSize) override {}
+
+		void setGraphicsState(const nvrhi::GraphicsState& state) override {}
+		void draw(const nvrhi::DrawArguments& args) override { CountDraw(); }
+		void drawIndexed(const nvrhi::DrawArguments& args) override { CountDraw(); }
+		void drawIndirect(uint32_t offsetBytes, uint32_t drawCount) override { CountDraw(); }
+		void drawIndexedIndirect(uint32_t offsetBytes, uint32_t drawCount) override { CountDraw(); }
+
+		void setComputeState(const nvrhi::ComputeState& state) override {}
+		void dispatch(uint32_t groupsX, uint32_t groupsY, uint32_t groupsZ) override {
+			m_Device->Record([&](RecordingDevice::Stats& stats) {
+				stats.numDispatches++;
+				stats.dispatchedGroups += uint64_t(groupsX) * groupsY * groupsZ;
+			});
+		}
+		void dispatchIndirect(uint32_t offsetBytes) override {
+			m_Device->Record([](RecordingDevice::Stats& stats) { stats.numDispatches++; });
+		}
+
+		void setMeshletState(const nvrhi::MeshletState& state) override {}
+		void dispatchMesh(uint32_t groupsX, uint32_t groupsY, uint32_t groupsZ) override { CountDraw(); }
+
+		void setRayTracingState(const nvrhi::rt::State& state) override {}
+		void dispatchRays(const nvrhi::rt::DispatchRaysArguments& args) override {
+			m_Device->Record([&](RecordingDevice::Stats& stats) {
+				stats.numRayDispatches++;
+				stats.dispatchedRays += uint64_t(args.width) * args.height * args.depth;
+			});
+		}
+
+		void buildOpacityMicromap(nvrhi::rt::IOpacityMicromap* omm, const nvrhi::rt::OpacityMicromapDesc& desc) override {}
+		void buildBottomLevelAccelStruct(nvrhi::rt::IAccelStruct* as, const nvrhi::rt::GeometryDesc* pGeometries, size_t numGeometries,
+			nvrhi::rt::AccelStructBuildFlags buildFlags) override {
+			m_Device->Record([&](RecordingDevice::Stats& stats) {
+				stats.numBlasBuilds++;
+				stats.blasGeometries += numGeometries;
+				for (size_t i = 0; i < numGeometries; i++) {
+					const nvrhi::rt::GeometryDesc& geometry = pGeometries[i];
+					if (geometry.geometryType == nvrhi::rt::GeometryType::Triangles) {
+						const nvrhi::rt::GeometryTriangles& triangles = geometry.geometryData.triangles;
+						stats.blasTriangles += (triangles.indexBuffer ? triangles.indexCount : triangles.vertexCount) / 3;
+					}
+					else if (geometry.geometryType == nvrhi::rt::GeometryType::AABBs)
+						stats.blasAABBs += geometry.geometryData.aabbs.count;
+				}
+			});
+		}
+		void compactBottomLevelAccelStructs() override {
+			m_Device->Record([](RecordingDevice::Stats& stats) { stats.numBlasCompactions++; });
+		}
+		void buildTopLevelAccelStruct(nvrhi::rt::IAccelStruct* as, const nvrhi::rt::InstanceDesc* pInstances, size_t numInstances,
+			nvrhi::rt::AccelStructBuildFlags buildFlags) override { CountTlasBuild(numInstances); }
+		void buildTopLevelAccelStructFromBuffer(nvrhi::rt::IAccelStruct* as, nvrhi::IBuffer* instanceBuffer, uint64_t instanceBufferOffset,
+			size_t numInstances, nvrhi::rt::AccelStructBuildFlags buildFlags) override { CountTlasBuild(numInstances); }
+		void executeMultiIndirectClusterOperation(const nvrhi::rt::cluster::OperationDesc& desc) override {}
+
+		void convertCoopVecMatrices(nvrhi::coopvec::ConvertMatrixLayoutDesc const* convertDescs, size_t numDescs) override {}
+
+		void beginTimerQuery(nvrhi::ITimerQuery* query) override {}
+		void endTimerQuery(nvrhi::ITimerQuery* query) override {}
+		void beginMarker(const char* name) override {}
+		void endMarker() override {}
+
+		void setEnableAutomaticBarriers(bool enable) override {}
+		void setResourceStatesForBindingSet(nvrhi::IBindingSet* bindingSet) override {}
+		void setResourceStatesForFramebuffer(nvrhi::IFramebuffer* framebuffer) override {}
+		void setEnableUavBarriersForTexture(nvrhi::ITexture* texture, bool enableBarriers) override {}
+		void setEnableUavBarriersForBuffer(nvrhi::IBuffer* buffer, bool enableBarriers) override {}
+		void beginTrackingTextureState(nvrhi::ITexture* texture, nvrhi::TextureSubresourceSet subresources, nvrhi::ResourceStates stateBits) override {}
+		void beginTrackingBufferState(nvrhi::IBuffer* buffer, nvrhi::ResourceStates stateBits) override {}
+		void setTextureState(nvrhi::ITexture* texture, nvrhi::TextureSubresourceSet subresources, nvrhi::ResourceStates stateBits) override {}
+		void setBufferState(nvrhi::IBuffer* buffer, nvrhi::ResourceStates stateBits) override {}
+		void setAccelStructState(nvrhi::rt::IAccelStruct* as, nvrhi::ResourceStates stateBits) override {}
+		void setPermanentTextureState(nvrhi::ITexture* texture, nvrhi::ResourceStates stateBits) override {}
+		void setPermanentBufferState(nvrhi::IBuffer* buffer, nvrhi::ResourceStates stateBits) override {}
+		void commitBarriers() override {}
+		nvrhi::ResourceStates getTextureSubresourceState(nvrhi::ITexture* texture, nvrhi::ArraySlice arraySlice, nvrhi::MipLevel mipLevel) override {
+			return nvrhi::ResourceStates::Unknown;
+		}
+		nvrhi::ResourceStates getBufferState(nvrhi::IBuffer* buffer) override { return nvrhi::ResourceStates::Unknown; }
+
+		nvrhi::IDevice* getDevice() override { return m_Device; }
+		const nvrhi::CommandListParameters& getDesc() override { return m_Params; }
+
+	private:
+		void CountTextureClear() { m_Device->Record([](RecordingDevice::Stats& stats) { stats.numTextureClears++; }); }
+		void CountDraw() { m_Device->Record([](RecordingDevice::Stats& stats) { stats.numDraws++; }); }
+		void CountTlasBuild(size_t numInstances) {
+			m_Device->Record([&](RecordingDevice::Stats& stats) {
+				stats.numTlasBuilds++;
+				stats.tlasInstances += numInstances;
+			});
+		}
+
+		nvrhi::RefCountPtr<Device> m_Device;
+		nvrhi::CommandListParameters m_Params;
+	};
+
+	nvrhi::CommandListHandle Device::createCommandList(const nvrhi::CommandListParameters& params) {
+		Record([](RecordingDevice::Stats& stats) { stats.numCommandLists++; });
+		return nvrhi::CommandListHandle::Create(new CommandList(this, params));
+	}
+}
+
+nvrhi::DeviceHandle RecordingDevice::Create(nvrhi::GraphicsAPI api) {
+	return nvrhi::DeviceHandle::Create(new Device(api));
+}
+
+bool RecordingDevice::IsRecordingDevice(nvrhi::IDevice* device) {
+	return dynamic_cast<Device*>(device) != nullptr;
+}
+
+RecordingDevice::Stats RecordingDevice::GetStats(nvrhi::IDevice* device) {
+	Device* recordingDevice = dynamic_cast<Device*>(device);
+	return recordingDevice ? recordingDevice->GetStats() : Stats();
+}
+
+void RecordingDevice::ResetStats(nvrhi::IDevice* device) {
+	if (Device* recordingDevice = dynamic_cast<Device*>(device))
+		recordingDevice->ResetStats();
+}
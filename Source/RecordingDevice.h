@@ -0,0 +1,71 @@
+#pragma once
+#include <nvrhi/nvrhi.h>
+#include <cstdint>
+
+/* nvrhi device that records what is created, uploaded, built and dispatched without executing anything, so the scene loader runs on
+   machines without a GPU (tests and benchmarks of the load path, see LoaderBenchmark -device).
+   Objects keep their descriptions, buffers and textures keep no contents: mapBuffer returns zeroed memory of the size of the buffer, so
+   readbacks of e.g. the texture feedback see no requests. Commands are counted when they are recorded into a command list, the loader
+   executes every command list it records. Queries always report completion.
+   Only the objects the loader creates are supported: graphics, meshlet and ray tracing pipelines, framebuffers, heaps, input layouts,
+   shader libraries, staging and sampler feedback textures, opacity micromaps and native handles are created as null.
+   Thread safe, the stats of all command lists of a device are accumulated
+*/
+namespace RecordingDevice {
+	struct Stats {
+		//Created objects
+		uint64_t numBuffers = 0;
+		uint64_t bufferBytes = 0;
+		uint64_t numTextures = 0;
+		uint64_t textureBytes = 0;			//All mips and array slices
+		uint64_t numAccelStructs = 0;
+		uint64_t numShaders = 0;
+		uint64_t shaderBytes = 0;
+		uint64_t numPipelines = 0;
+		uint64_t numBindingLayouts = 0;
+		uint64_t numBindingSets = 0;
+		uint64_t numDescriptorTables = 0;
+		uint64_t numDescriptorWrites = 0;
+		uint64_t numSamplers = 0;
+		uint64_t numCommandLists = 0;
+
+		//Uploads and copies
+		uint64_t numBufferWrites = 0;
+		uint64_t bufferWriteBytes = 0;
+		uint64_t numTextureWrites = 0;
+		uint64_t textureWriteBytes = 0;
+		uint64_t numBufferCopies = 0;
+		uint64_t bufferCopyBytes = 0;
+		uint64_t numBufferClears = 0;
+		uint64_t numTextureClears = 0;
+
+		//Acceleration structure builds and their inputs
+		uint64_t numBlasBuilds = 0;
+		uint64_t blasGeometries = 0;
+		uint64_t blasTriangles = 0;
+		uint64_t blasAABBs = 0;
+		uint64_t numBlasCompactions = 0;
+		uint64_t numTlasBuilds = 0;
+		uint64_t tlasInstances = 0;
+
+		//Work
+		uint64_t numDispatches = 0;
+		uint64_t dispatchedGroups = 0;
+		uint64_t numRayDispatches = 0;
+		uint64_t dispatchedRays = 0;
+		uint64_t numDraws = 0;
+		uint64_t numExecutedCommandLists = 0;
+
+		uint64_t GetUploadBytes() const { return bufferWriteBytes + textureWriteBytes; }
+	};
+
+	//The API only decides which shader binaries the ShaderFactory loads
+	nvrhi::DeviceHandle Create(nvrhi::GraphicsAPI api = nvrhi::GraphicsAPI::D3D12);
+
+	//True if the device was created by Create
+	bool IsRecordingDevice(nvrhi::IDevice* device);
+
+	//Stats since the creation or the last ResetStats. Zero for other devices
+	Stats GetStats(nvrhi::IDevice* device);
+	void ResetStats(nvrhi::IDevice* device);
+}
@@ -1,5 +1,16 @@
 #include "Renderer.h"
 #include "sharedShaderData.h"
+#include "AnvilImporter.h"
+#include "SceneArchive.h"
+#include "CpuRenderer.h"
+#include <donut/core/log.h>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <set>
+#include <thread>
 
 template<typename ... Args> std::string StringFormat(const std::string& format, Args ... args)
 {
@@ -14,6 +25,7 @@ template<typename ... Args> std::string StringFormat(const std::string& format,
 void Renderer::BackBufferResizing()
 {
 	m_RenderTarget = nullptr;
+	m_FrameTracker.Invalidate();
 	m_BindingCache->Clear();
 }
 
@@ -37,24 +49,565 @@ bool Renderer::MouseButtonUpdate(int button, int action, int mods)
 
 void Renderer::Animate(float fElapsedTimeSeconds)
 {
-	m_Camera.Animate(fElapsedTimeSeconds);
+	//The replay ignores the camera input and the measured frame time
+	if (m_CameraPathMode == CameraPathMode::Replay)
+		AnimateReplay();
+	else
+		m_Camera.Animate(fElapsedTimeSeconds);
+
+	if (m_CameraPathMode == CameraPathMode::Recording)
+		RecordCameraPathFrame(fElapsedTimeSeconds);
 
 	double frameTime = GetDeviceManager()->GetAverageFrameTimeSeconds();
 	
 	m_fpsInfo = StringFormat("%.3f ms/frame (%.1f FPS)", frameTime * 1e3, 1.0 / frameTime);
 
 	GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle, false, m_fpsInfo.c_str());
+
+	//Merge the results of the background scene scan
+	if (m_SceneIndexScan.valid() && m_SceneIndexScan.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+		m_SceneIndex.Merge(m_SceneIndexScan.get());
+		m_SceneIndex.Save();
+	}
 }
 
 bool Renderer::LoadMinecraftScene(std::string sceneName) {
+	m_RayQuery.Clear();
+	m_SceneCache->SetBudget(size_t(max(m_ui->sceneCacheGpuBudgetMB, 0)) << 20, size_t(max(m_ui->sceneCacheCpuBudgetMB, 0)) << 20);
+
 	m_CommandList->open();
 
-	bool valid = m_MinecraftSceneLoader->LoadScene(m_ScenePath, sceneName, GetDevice(), m_CommandList, m_TextureCache, m_DescriptorTable);
+	//Lazy textures start with the average texture colors of the scene index, if it has them
+	TextureLoadSettings textureSettings;
+	textureSettings.lazy = m_LazyTextures;
+	textureSettings.commonPasses = m_CommonPasses.get();
+	const SceneIndexEntry* indexEntry = m_SceneIndex.Find(sceneName);
+	if (indexEntry && !indexEntry->textureColors.empty())
+		textureSettings.fallbackColors = &indexEntry->textureColors;
+
+	m_Scene = m_SceneCache->Acquire(m_ScenePath, sceneName, GetDevice(), m_CommandList, m_TextureCache, m_DescriptorTable, textureSettings);
 
 	m_CommandList->close();
 	GetDevice()->executeCommandList(m_CommandList);
 
-	return valid;
+	//Primary rays skip the cells the potentially visible set culls from the camera cell, a missing or stale set renders everything.
+	//So does a resident scene with block edits
+	m_Pvs.Clear();
+	m_VisibleCellsSource = -1;
+	m_VisibleCellBuffer = nullptr;
+	if (m_Scene && m_Scene->GetGeometryVersion() == 0 && m_Pvs.Read(PotentiallyVisibleSet::GetFile(m_ScenePath, sceneName), m_ScenePath / sceneName))
+		log::info("Culling %s with its potentially visible set of %u cells", sceneName.c_str(), m_Pvs.GetNumCells());
+	nvrhi::BufferDesc visibleCellDesc;
+	visibleCellDesc.byteSize = sizeof(uint64_t) * std::max<size_t>(m_Pvs.GetRowWords(), 1);
+	visibleCellDesc.structStride = sizeof(uint);
+	visibleCellDesc.debugName = "VisibleCells";
+	visibleCellDesc.initialState = nvrhi::ResourceStates::ShaderResource;
+	visibleCellDesc.keepInitialState = true;
+	m_VisibleCellBuffer = GetDevice()->createBuffer(visibleCellDesc);
+
+	if (m_Scene) {
+		const SceneIndexEntry* entry = m_SceneIndex.Find(sceneName);
+		bool missingColors = m_Scene->HasLazyTextures() && entry && entry->textureColors.size() < m_Scene->GetTextureFallbackColors().size();
+		if (!entry || !entry->fromFullLoad || missingColors || !m_SceneIndex.GetOutdatedScenes(m_ScenePath, { sceneName }).empty())
+			UpdateSceneIndex(sceneName);
+	}
+
+	return m_Scene != nullptr;
+}
+
+void Renderer::UpdateSceneIndex(const std::string& sceneName) {
+	const MinecraftSceneLoader::SceneStats& stats = m_Scene->GetSceneStats();
+	SceneIndexEntry entry;
+	entry.fileName = sceneName;
+	entry.numBlocks = uint(stats.numAABBs);
+	entry.numTriangles = uint(stats.numTriangles);
+	entry.numMaterials = uint(stats.numMaterials);
+	if (stats.boundsMin.x <= stats.boundsMax.x) {
+		entry.boundsMin = stats.boundsMin;
+		entry.boundsMax = stats.boundsMax;
+	}
+	entry.estimatedGpuBytes = m_Scene->GetMemoryFootprint().gpuBytes;
+
+	//Texture sets are the folders of the loaded textures relative to the scene folder
+	std::set<std::string> textureSets;
+	std::set<LoadedTexture*> countedTextures;
+	const std::string modelFolderName = "/MinecraftModels/";
+	for (const std::shared_ptr<LoadedTexture>& texture : m_Scene->GetCachedTextures()) {
+		if (!texture || !countedTextures.insert(texture.get()).second)
+			continue;
+		std::string path = texture->path;
+		if (path.rfind(modelFolderName, 0) == 0)
+			path = path.substr(modelFolderName.size());
+		textureSets.insert(std::filesystem::path(path).parent_path().generic_string());
+		entry.estimatedGpuBytes += MinecraftSceneLoader::GetTextureByteSize(texture->texture);
+	}
+	entry.textureSets.assign(textureSets.begin(), textureSets.end());
+
+	//Lazy textures are not loaded yet, keep the texture infos of the scan and add the computed average colors
+	const SceneIndexEntry* previous = m_SceneIndex.Find(sceneName);
+	if (previous) {
+		entry.textureColors = previous->textureColors;
+		if (m_Scene->HasLazyTextures()) {
+			entry.textureSets = previous->textureSets;
+			entry.estimatedGpuBytes = std::max(entry.estimatedGpuBytes, previous->estimatedGpuBytes);
+		}
+	}
+	for (const auto& [texture, color] : m_Scene->GetTextureFallbackColors())
+		entry.textureColors[texture] = color;
+
+	m_SceneIndex.UpdateFromFullLoad(m_ScenePath, entry);
+	m_SceneIndex.Save();
+}
+
+bool Renderer::StartRecording(const std::filesystem::path& pathFile) {
+	if (m_CameraPathMode != CameraPathMode::None)
+		return false;
+
+	m_CameraPath.Clear();
+	m_CameraPathFile = pathFile;
+	m_RecordedTime = 0.0;
+	m_CameraPathMode = CameraPathMode::Recording;
+	log::info("Recording camera path to %s", pathFile.string().c_str());
+	return true;
+}
+
+void Renderer::StopRecording() {
+	if (m_CameraPathMode != CameraPathMode::Recording)
+		return;
+
+	m_CameraPathMode = CameraPathMode::None;
+	if (m_CameraPath.GetNumFrames() == 0) {
+		log::warning("Camera path recording stopped without any recorded frame");
+		return;
+	}
+	m_CameraPath.SetTimestep(float(m_RecordedTime / double(m_CameraPath.GetNumFrames())));
+	if (m_CameraPath.Save(m_CameraPathFile))
+		log::info("Saved camera path with %zu frames to %s", m_CameraPath.GetNumFrames(), m_CameraPathFile.string().c_str());
+}
+
+void Renderer::RecordCameraPathFrame(float fElapsedTimeSeconds) {
+	//Only frames with a loaded scene are recorded
+	if (!m_Scene || m_selectedScene != m_ui->selectedScene)
+		return;
+
+	const std::string& sceneName = m_AvailableScenes[m_selectedScene];
+	if (m_CameraPath.GetNumFrames() == 0) {
+		m_CameraPath.SetSceneName(sceneName);
+	}
+	else if (m_CameraPath.GetSceneName() != sceneName) {
+		log::warning("The scene changed during the camera path recording, recording stopped");
+		StopRecording();
+		return;
+	}
+
+	CameraPathFrame frame;
+	frame.position = m_Camera.GetPosition();
+	frame.direction = m_Camera.GetDir();
+	frame.up = m_Camera.GetUp();
+	frame.ui = *m_ui;
+	m_CameraPath.AddFrame(frame);
+	m_RecordedTime += fElapsedTimeSeconds;
+}
+
+bool Renderer::StartReplay(const std::filesystem::path& pathFile, const std::filesystem::path& reportFile, bool exitWhenDone) {
+	if (m_CameraPathMode != CameraPathMode::None)
+		return false;
+
+	if (!m_CameraPath.Load(pathFile)) {
+		log::warning("Could not load camera path %s", pathFile.string().c_str());
+		return false;
+	}
+
+	auto sceneIt = std::find(m_AvailableScenes.begin(), m_AvailableScenes.end(), m_CameraPath.GetSceneName());
+	if (sceneIt == m_AvailableScenes.end()) {
+		log::warning("Scene %s of the camera path is not available", m_CameraPath.GetSceneName().c_str());
+		return false;
+	}
+	m_ReplayScene = int(sceneIt - m_AvailableScenes.begin());
+	m_ui->selectedScene = m_ReplayScene;
+
+	if (!m_TimerQueries[0]) {
+		for (uint i = 0; i < k_NumTimerQueries; i++)
+			m_TimerQueries[i] = GetDevice()->createTimerQuery();
+	}
+
+	m_BenchmarkReport.Clear();
+	m_BenchmarkReport.SetInfo("version", RENDERER_VERSION);
+	m_BenchmarkReport.SetInfo("device", GetDeviceManager()->GetRendererString());
+	m_BenchmarkReport.SetInfo("scene", m_CameraPath.GetSceneName());
+	m_BenchmarkReport.SetInfo("cameraPath", pathFile.filename().string());
+	m_BenchmarkReportFile = reportFile;
+	m_ExitAfterReplay = exitWhenDone;
+	m_ReplayFrame = 0;
+	m_ReplayRenderFrame = -1;
+	m_ReplayWarmupFrames = k_ReplayWarmupFrames;
+	m_CameraPathMode = CameraPathMode::Replay;
+	log::info("Replaying camera path %s with %zu frames", pathFile.string().c_str(), m_CameraPath.GetNumFrames());
+	return true;
+}
+
+void Renderer::AnimateReplay() {
+	//The wall clock time of a frame ends when the next one starts
+	auto now = std::chrono::high_resolution_clock::now();
+	if (m_ReplayRenderFrame >= 0 && size_t(m_ReplayRenderFrame) < m_BenchmarkReport.GetNumFrames())
+		m_BenchmarkReport.GetFrame(m_ReplayRenderFrame).frameMs = std::chrono::duration<double, std::milli>(now - m_ReplayFrameStart).count();
+	m_ReplayFrameStart = now;
+	m_ReplayRenderFrame = -1;
+
+	//Loading the scene failed
+	if (m_ui->selectedScene == -1) {
+		log::warning("Camera path replay aborted, the scene could not be loaded");
+		m_CameraPathMode = CameraPathMode::None;
+		return;
+	}
+	//The scene selection of the UI is ignored during the replay
+	m_ui->selectedScene = m_ReplayScene;
+
+	if (m_ReplayFrame >= m_CameraPath.GetNumFrames()) {
+		FinishReplay();
+		return;
+	}
+
+	//Warm up with the first frame until the scene is loaded and the timings settled
+	bool sceneReady = m_Scene && m_selectedScene == m_ui->selectedScene;
+	if (!sceneReady || m_ReplayWarmupFrames > 0) {
+		if (sceneReady)
+			m_ReplayWarmupFrames--;
+	}
+	else {
+		m_ReplayRenderFrame = int(m_ReplayFrame++);
+		//The timer query is reused after k_NumTimerQueries frames, read it before the CPU timing of this frame starts
+		if (m_ReplayRenderFrame >= int(k_NumTimerQueries))
+			ResolveTimerQuery(size_t(m_ReplayRenderFrame) - k_NumTimerQueries);
+	}
+
+	const CameraPathFrame& frame = m_CameraPath.GetFrames()[max(m_ReplayRenderFrame, 0)];
+	CameraPath::ApplyRenderSettings(frame.ui, *m_ui);
+	m_Camera.LookAt(frame.position, frame.position + frame.direction, frame.up);
+	//Same random numbers as in every other replay of this path
+	m_FrameIndex = uint(max(m_ReplayRenderFrame, 0));
+}
+
+void Renderer::ResolveTimerQuery(size_t replayFrame) {
+	//A frame that was not rendered (e.g. the scene was reloaded) has no timing and its query was not started
+	if (replayFrame >= m_BenchmarkReport.GetNumFrames())
+		return;
+	//Blocks until the GPU finished the frame
+	nvrhi::ITimerQuery* query = m_TimerQueries[replayFrame % k_NumTimerQueries];
+	m_BenchmarkReport.GetFrame(replayFrame).gpuMs = double(GetDevice()->getTimerQueryTime(query)) * 1e3;
+	GetDevice()->resetTimerQuery(query);
+}
+
+void Renderer::FinishReplay() {
+	size_t numFrames = m_BenchmarkReport.GetNumFrames();
+	for (size_t frame = numFrames > k_NumTimerQueries ? numFrames - k_NumTimerQueries : 0; frame < numFrames; frame++)
+		ResolveTimerQuery(frame);
+
+	m_BenchmarkReport.SetInfo("resolution", GetResolutionInfo());
+	m_BenchmarkReport.SetInfo("timestep", std::to_string(m_CameraPath.GetTimestep()));
+
+	//Frames that took longer than the average frame of the recording
+	const double recordedFrameMs = double(m_CameraPath.GetTimestep()) * 1e3;
+	size_t numSlowerFrames = 0;
+	std::vector<double> gpuMs;
+	for (size_t i = 0; i < numFrames; i++) {
+		gpuMs.push_back(m_BenchmarkReport.GetFrame(i).gpuMs);
+		if (m_BenchmarkReport.GetFrame(i).frameMs > recordedFrameMs)
+			numSlowerFrames++;
+	}
+	m_BenchmarkReport.SetInfo("framesSlowerThanRecording", std::to_string(numSlowerFrames));
+	BenchmarkReport::Summary gpuSummary = BenchmarkReport::Summarize(gpuMs);
+	log::info("Camera path replay finished: %zu frames, GPU p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, %zu frames slower than the recording (%.3f ms)",
+		numFrames, gpuSummary.p50, gpuSummary.p95, gpuSummary.p99, numSlowerFrames, recordedFrameMs);
+
+	if (m_BenchmarkReport.WriteJson(m_BenchmarkReportFile))
+		log::info("Benchmark report written to %s", m_BenchmarkReportFile.string().c_str());
+
+	m_CameraPathMode = CameraPathMode::None;
+	if (m_ExitAfterReplay)
+		glfwSetWindowShouldClose(GetDeviceManager()->GetWindow(), GLFW_TRUE);
+}
+
+CpuCamera Renderer::GetCpuCamera(uint2 resolution) {
+	return CpuRenderer::MakeCamera(m_Camera.GetWorldToViewMatrix(), *m_ui, resolution);
+}
+
+CpuRayTracer::BenchmarkResult Renderer::RunCpuRayBenchmark(uint2 resolution) {
+	CpuRayTracer tracer;
+	tracer.Build(m_Scene->GetAABBs(), m_Scene->GetAABBMaterials(), m_Scene->GetVertices(), m_Scene->GetIndices(), m_Scene->GetTriangleMaterialIDs());
+	tracer.SetOriginalOrder(&m_Scene->GetAABBOrder(), &m_Scene->GetTriangleOrder(), &m_Scene->GetVertexOrder());
+	TaskScheduler::Get().ResetStats();
+	CpuRayTracer::BenchmarkResult result = tracer.RunBenchmark(GetCpuCamera(resolution), resolution, -normalize(m_ui->lightDirection), m_ui->shadowRayBias);
+
+	//Worker utilization over the benchmark, a low minimum points to load imbalance
+	std::vector<TaskScheduler::WorkerStats> workerStats = TaskScheduler::Get().GetWorkerStats();
+	double minUtilization = 1.0, sumUtilization = 0.0;
+	uint64_t tasksStolen = 0;
+	for (const TaskScheduler::WorkerStats& worker : workerStats) {
+		minUtilization = std::min(minUtilization, worker.utilization);
+		sumUtilization += worker.utilization;
+		tasksStolen += worker.tasksStolen;
+	}
+
+	m_CpuRayBenchmarkInfo = StringFormat("Primary: %.2f Mrays/s (single %.2f), Shadow: %.2f Mrays/s (single %.2f), %u threads",
+		result.primaryPacketMrays, result.primarySingleMrays, result.shadowPacketMrays, result.shadowSingleMrays, result.numThreads);
+	log::info("CPU ray benchmark %s at %ux%u, BVH build %.1f ms: %s", m_AvailableScenes[m_selectedScene].c_str(), resolution.x, resolution.y,
+		result.bvhBuildMs, m_CpuRayBenchmarkInfo.c_str());
+	log::info("CPU ray benchmark: %llu frustum culled of %llu visited nodes, %llu fallback rays, %llu packet/single mismatches",
+		(unsigned long long)result.packetStats.nodesFrustumCulled, (unsigned long long)result.packetStats.nodesVisited,
+		(unsigned long long)result.packetStats.fallbackRays, (unsigned long long)result.mismatches);
+	log::info("CPU ray benchmark: simulated hit shader cache miss rate %.1f%% (%.1f%% in the original primitive order)",
+		result.hitCacheMissRate * 100.0, result.originalHitCacheMissRate * 100.0);
+	log::info("CPU ray benchmark: %u threads, worker utilization %.1f%% average, %.1f%% minimum, %llu stolen tasks", result.numThreads,
+		workerStats.empty() ? 0.0 : sumUtilization / double(workerStats.size()) * 100.0, minUtilization * 100.0, (unsigned long long)tasksStolen);
+	return result;
+}
+
+bool Renderer::RunCpuRayBenchmark() {
+	if (!m_Scene || m_selectedScene == -1)
+		return false;
+	RunCpuRayBenchmark(m_Resolution);
+	return true;
+}
+
+bool Renderer::RunCpuRayBenchmarks(const std::filesystem::path& reportFile) {
+	std::ofstream stream(reportFile);
+	if (!stream) {
+		log::warning("Could not write %s", reportFile.string().c_str());
+		return false;
+	}
+
+	int width = 0, height = 0;
+	GetDeviceManager()->GetWindowDimensions(width, height);
+	uint2 resolution = uint2(uint(max(width, 1)), uint(max(height, 1)));
+
+	stream << "{\n  \"version\": \"" << RENDERER_VERSION << "\",\n  \"resolution\": \"" << resolution.x << "," << resolution.y << "\",\n  \"scenes\": [";
+	bool first = true;
+	for (int sceneIndex = 0; sceneIndex < int(m_AvailableScenes.size()); sceneIndex++) {
+		m_ui->selectedScene = sceneIndex;
+		m_selectedScene = sceneIndex;
+		m_BindingSet = nullptr;
+		if (!LoadMinecraftScene(m_AvailableScenes[sceneIndex])) {
+			log::warning("Loading scene %s failed", m_AvailableScenes[sceneIndex].c_str());
+			continue;
+		}
+
+		//Look at the scene center from above one of the corners
+		const MinecraftSceneLoader::SceneStats& stats = m_Scene->GetSceneStats();
+		float3 center = (stats.boundsMin + stats.boundsMax) * 0.5f;
+		float3 extent = max(stats.boundsMax - stats.boundsMin, float3(1.f));
+		m_Camera.LookAt(center + float3(extent.x * 0.5f, extent.y * 0.5f + 2.f, extent.z * 0.5f), center);
+
+		CpuRayTracer::BenchmarkResult result = RunCpuRayBenchmark(resolution);
+		stream << (first ? "\n" : ",\n");
+		first = false;
+		stream << "    { \"scene\": \"" << BenchmarkReport::EscapeJson(m_AvailableScenes[sceneIndex]) << "\", \"bvhBuildMs\": " << result.bvhBuildMs << ", \"numThreads\": " << result.numThreads
+			<< ", \"primaryRays\": " << result.primaryRays << ", \"shadowRays\": " << result.shadowRays
+			<< ", \"primaryPacketMrays\": " << result.primaryPacketMrays << ", \"primarySingleMrays\": " << result.primarySingleMrays
+			<< ", \"shadowPacketMrays\": " << result.shadowPacketMrays << ", \"shadowSingleMrays\": " << result.shadowSingleMrays
+			<< ", \"frustumCulledNodes\": " << result.packetStats.nodesFrustumCulled << ", \"visitedNodes\": " << result.packetStats.nodesVisited
+			<< ", \"fallbackRays\": " << result.packetStats.fallbackRays << ", \"mismatches\": " << result.mismatches
+			<< ", \"hitCacheMissRate\": " << result.hitCacheMissRate << ", \"originalHitCacheMissRate\": " << result.originalHitCacheMissRate << " }";
+	}
+	stream << "\n  ]\n}\n";
+	log::info("CPU ray benchmark report written to %s", reportFile.string().c_str());
+	return true;
+}
+
+bool Renderer::PickBlock(OccupancyGrid::TraceResult& result) {
+	result = OccupancyGrid::TraceResult();
+	if (!m_Scene || !m_Scene->IsLoaded())
+		return false;
+	return m_Scene->GetOccupancyGrid().Trace(m_Camera.GetPosition(), m_Camera.GetDir(), m_ui->cameraNear, m_ui->cameraFar, result);
+}
+
+bool Renderer::EditViewCenterBlock(BlockEditAction action, int materialID) {
+	if (!m_Scene || !m_Scene->IsLoaded())
+		return false;
+
+	//Removed blocks stay in the occupancy grid until the batch rebuild, the trace continues behind their cells
+	const int maxSkippedCells = 64;
+	float3 origin = m_Camera.GetPosition();
+	float3 direction = normalize(m_Camera.GetDir());
+	float tMin = m_ui->cameraNear;
+	OccupancyGrid::TraceResult result;
+	bool found = false;
+	for (int i = 0; i < maxSkippedCells && m_Scene->GetOccupancyGrid().Trace(origin, direction, tMin, m_ui->cameraFar, result); i++) {
+		if (m_Scene->IsBlockOccupied(result.cell)) {
+			found = true;
+			break;
+		}
+		float tExit = m_ui->cameraFar;
+		for (int axis = 0; axis < 3; axis++) {
+			if (direction[axis] != 0.f)
+				tExit = std::min(tExit, (float(result.cell[axis] + (direction[axis] > 0.f ? 1 : 0)) - origin[axis]) / direction[axis]);
+		}
+		tMin = tExit + 1e-4f;
+	}
+	if (!found)
+		return false;
+
+	//The ray entered through the cell boundary closest to the entry point
+	float3 entry = origin + direction * result.t;
+	int faceAxis = 0;
+	int faceSide = 0;
+	float nearest = std::numeric_limits<float>::max();
+	for (int axis = 0; axis < 3; axis++) {
+		for (int side = 0; side < 2; side++) {
+			float distance = std::abs(entry[axis] - float(result.cell[axis] + side));
+			if (distance < nearest) {
+				nearest = distance;
+				faceAxis = axis;
+				faceSide = side;
+			}
+		}
+	}
+	int3 normal = int3(0);
+	normal[faceAxis] = faceSide ? 1 : -1;
+	const BlockEditor::Face faces[3][2] = { { BlockEditor::NegX, BlockEditor::PosX }, { BlockEditor::NegY, BlockEditor::PosY }, { BlockEditor::NegZ, BlockEditor::PosZ } };
+
+	bool changed = false;
+	switch (action) {
+	case BlockEditAction::Place:
+		changed = m_Scene->SetBlock(result.cell + normal, materialID);
+		break;
+	case BlockEditAction::Remove:
+		changed = m_Scene->RemoveBlock(result.cell);
+		break;
+	case BlockEditAction::PaintFace:
+		changed = m_Scene->SetBlockFaceMaterial(result.cell, faces[faceAxis][faceSide], materialID);
+		break;
+	}
+
+	//Later edits while one is measured are shown by the same or an earlier frame
+	if (changed && !m_BlockEditPending) {
+		m_BlockEditPending = true;
+		m_BlockEditSubmitted = false;
+		m_BlockEditTime = std::chrono::high_resolution_clock::now();
+		m_BlockEditFrame = m_PresentedFrames;
+	}
+	return changed;
+}
+
+void Renderer::ApplyBlockEdits() {
+	if (!m_Scene->HasPendingBlockEdits())
+		return;
+
+	uint64_t geometryVersion = m_Scene->GetGeometryVersion();
+	m_CommandList->open();
+	MinecraftSceneLoader::BlockEditUpdate update = m_Scene->ApplyBlockEdits(GetDevice(), m_CommandList);
+	m_CommandList->close();
+	GetDevice()->executeCommandList(m_CommandList);
+
+	if (update.buffersChanged)
+		m_BindingSet = nullptr;
+	if (m_Scene->GetGeometryVersion() != geometryVersion) {
+		m_RayQuery.Clear();
+		//A removed block can open a view the set does not contain
+		if (!m_Pvs.IsEmpty()) {
+			log::info("The blocks of the scene were edited, the potentially visible set is no longer used");
+			m_Pvs.Clear();
+		}
+	}
+}
+
+void Renderer::UpdateVisibleCells(ConstBuffer& constants) {
+	constants.pvsCulling = 0;
+	if (m_Pvs.IsEmpty())
+		return;
+	//A camera outside of the grid sees everything
+	int cell = m_Pvs.GetCellIndex(m_Camera.GetPosition());
+	if (cell < 0)
+		return;
+	if (cell != m_VisibleCellsSource) {
+		m_CommandList->writeBuffer(m_VisibleCellBuffer, m_Pvs.GetVisibleRow(uint(cell)), m_Pvs.GetRowWords() * sizeof(uint64_t));
+		m_VisibleCellsSource = cell;
+	}
+	constants.pvsCulling = 1;
+	constants.pvsOriginCell = m_Pvs.GetOriginCell();
+	constants.pvsGridSize = m_Pvs.GetGridSize();
+	constants.pvsCellSize = float(PotentiallyVisibleSet::k_CellSize);
+}
+
+void Renderer::PollBlockEditLatency() {
+	if (!m_BlockEditSubmitted || !GetDevice()->pollEventQuery(m_BlockEditQuery))
+		return;
+
+	//Polled once per frame, the time is at most one frame late
+	BlockEditLatency& latency = m_BlockEditLatency;
+	latency.lastMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_BlockEditTime).count();
+	latency.lastFrames = uint(m_BlockEditSubmitFrame - m_BlockEditFrame);
+	latency.maxMs = std::max(latency.maxMs, latency.lastMs);
+	latency.maxFrames = std::max(latency.maxFrames, latency.lastFrames);
+	latency.totalMs += latency.lastMs;
+	latency.numMeasured++;
+	m_BlockEditPending = false;
+	m_BlockEditSubmitted = false;
+}
+
+const SceneRayQuery* Renderer::GetRayQuery() {
+	if (!m_Scene || !m_Scene->IsLoaded())
+		return nullptr;
+	if (!m_RayQuery.IsBuilt())
+		m_RayQuery.Build(*m_Scene, m_ScenePath);
+	return &m_RayQuery;
+}
+
+bool Renderer::PickSurface(CpuHit& hit) const {
+	hit = CpuHit();
+	if (!m_Scene || !m_RayQuery.IsBuilt())
+		return false;
+	CpuRay ray;
+	ray.origin = m_Camera.GetPosition();
+	ray.direction = normalize(m_Camera.GetDir());
+	ray.tMin = m_ui->cameraNear;
+	ray.tMax = m_ui->cameraFar;
+	return m_RayQuery.TraceClosest(ray, hit);
+}
+
+bool Renderer::RunRayQueryBenchmark() {
+	const SceneRayQuery* rayQuery = GetRayQuery();
+	if (!rayQuery)
+		return false;
+
+	//Coherent rays: primary rays of the view in 8x8 tiles, so that the packets share a frustum
+	const uint2 resolution = uint2(256, 256);
+	CpuCamera camera = GetCpuCamera(resolution);
+	std::vector<CpuRay> viewRays;
+	viewRays.reserve(resolution.x * resolution.y);
+	for (uint tileY = 0; tileY < resolution.y; tileY += CpuRayTracer::k_PacketWidth)
+		for (uint tileX = 0; tileX < resolution.x; tileX += CpuRayTracer::k_PacketWidth)
+			for (uint y = tileY; y < tileY + CpuRayTracer::k_PacketWidth; y++)
+				for (uint x = tileX; x < tileX + CpuRayTracer::k_PacketWidth; x++)
+					viewRays.push_back(camera.GetPrimaryRay(uint2(x, y)));
+
+	//Incoherent rays: uniformly distributed directions from the camera
+	std::vector<CpuRay> randomRays(viewRays.size());
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+	for (CpuRay& ray : randomRays) {
+		float z = uniform(random) * 2.f - 1.f;
+		float phi = uniform(random) * 6.2831853f;
+		float r = std::sqrt(std::max(0.f, 1.f - z * z));
+		ray.origin = camera.origin;
+		ray.direction = float3(r * std::cos(phi), r * std::sin(phi), z);
+		ray.tMin = camera.tMin;
+		ray.tMax = camera.tMax;
+	}
+
+	std::vector<CpuHit> hits(viewRays.size());
+	std::vector<uint8_t> occluded(viewRays.size());
+	SceneRayQuery::Stats viewClosest = rayQuery->TraceClosest(viewRays.data(), hits.data(), viewRays.size());
+	SceneRayQuery::Stats viewAny = rayQuery->TraceAny(viewRays.data(), occluded.data(), viewRays.size());
+	SceneRayQuery::Stats randomClosest = rayQuery->TraceClosest(randomRays.data(), hits.data(), randomRays.size());
+	SceneRayQuery::Stats randomAny = rayQuery->TraceAny(randomRays.data(), occluded.data(), randomRays.size());
+
+	m_RayQueryBenchmarkInfo = StringFormat("Closest: %.2f Mrays/s (view), %.2f (random), Any: %.2f Mrays/s (view), %.2f (random)",
+		viewClosest.GetMraysPerSecond(), randomClosest.GetMraysPerSecond(), viewAny.GetMraysPerSecond(), randomAny.GetMraysPerSecond());
+	log::info("Ray query benchmark %s, %zu rays per batch: %s", m_AvailableScenes[m_selectedScene].c_str(), viewRays.size(), m_RayQueryBenchmarkInfo.c_str());
+	log::info("Ray query benchmark: view rays %.1f%% hit, random rays %.1f%% hit", double(viewClosest.numHits) * 100.0 / double(viewClosest.numRays),
+		double(randomClosest.numHits) * 100.0 / double(randomClosest.numRays));
+	return true;
 }
 
 void Renderer::ResetCameraPosition() {
@@ -66,6 +619,8 @@ const std::string Renderer::GetResolutionInfo() {
 	info += std::to_string(m_Resolution.x);
 	info += ",";
 	info += std::to_string(m_Resolution.y);
+	if (any(m_TraceResolution != m_Resolution))
+		info += " (traced " + std::to_string(m_TraceResolution.x) + "," + std::to_string(m_TraceResolution.y) + ")";
 	return info;
 }
 
@@ -87,12 +642,19 @@ void Renderer::InitBindingLayouts() {
 		nvrhi::BindingLayoutItem::VolatileConstantBuffer(0),
 		nvrhi::BindingLayoutItem::RayTracingAccelStruct(0),
 		nvrhi::BindingLayoutItem::Texture_UAV(0),
-		nvrhi::BindingLayoutItem::StructuredBuffer_SRV(1),
+		nvrhi::BindingLayoutItem::StructuredBuffer_UAV(1),
+		nvrhi::BindingLayoutItem::RawBuffer_SRV(1),
 		nvrhi::BindingLayoutItem::StructuredBuffer_SRV(2),
 		nvrhi::BindingLayoutItem::StructuredBuffer_SRV(3),
 		nvrhi::BindingLayoutItem::StructuredBuffer_SRV(4),
 		nvrhi::BindingLayoutItem::StructuredBuffer_SRV(5),
 		nvrhi::BindingLayoutItem::StructuredBuffer_SRV(6),
+		nvrhi::BindingLayoutItem::StructuredBuffer_SRV(7),
+		nvrhi::BindingLayoutItem::StructuredBuffer_SRV(8),
+		nvrhi::BindingLayoutItem::StructuredBuffer_SRV(9),
+		nvrhi::BindingLayoutItem::StructuredBuffer_SRV(10),
+		nvrhi::BindingLayoutItem::StructuredBuffer_SRV(11),
+		nvrhi::BindingLayoutItem::StructuredBuffer_SRV(12),
 		nvrhi::BindingLayoutItem::Sampler(0)
 	};
 
@@ -151,27 +713,38 @@ void Renderer::FindAvailableScenes() {
 	const std::string sceneNameExtension = ".obj";
 	for (const auto& file : std::filesystem::directory_iterator(m_ScenePath))
 	{
+		//Minecraft world folders are imported directly
+		if (file.is_directory() && AnvilImporter::IsWorldFolder(file.path())) {
+			m_AvailableScenes.push_back(file.path().filename().string());
+			continue;
+		}
 		if (!file.is_regular_file()) continue;
 		std::string fileName = file.path().filename().string();
 		std::string extension = file.path().extension().string();
-		if (sceneNameExtension == extension) {
+		if (sceneNameExtension == extension || extension == SceneArchive::k_Extension) {
 			m_AvailableScenes.push_back(fileName);
 		}
 	}
 
-	if (m_AvailableScenes.size() == 1) {
-		LoadMinecraftScene(m_AvailableScenes[0]);
-		m_selectedScene = 0;
-		m_ui->selectedScene = 0;
+	std::sort(m_AvailableScenes.begin(), m_AvailableScenes.end());
+
+	//Scenes are not loaded at startup. New or changed scenes are scanned in the background to fill the scene index
+	m_SceneIndex.Load(m_ScenePath / "SceneIndex.txt");
+	std::vector<std::string> outdatedScenes = m_SceneIndex.GetOutdatedScenes(m_ScenePath, m_AvailableScenes);
+	if (!outdatedScenes.empty()) {
+		std::filesystem::path scenePath = m_ScenePath;
+		m_SceneIndexScan = std::async(std::launch::async, [scenePath, outdatedScenes]() {
+			return SceneIndex::ScanScenes(scenePath, outdatedScenes);
+		});
 	}
 }
 
-bool Renderer::Init() {
+bool Renderer::Init(const std::filesystem::path& sceneFolder) {
 	//Get file system paths
 	auto nativeFS = std::make_shared<vfs::NativeFileSystem>();
 	std::filesystem::path frameworkShaderPath = app::GetDirectoryWithExecutable() / "shaders/framework" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
 	std::filesystem::path appShaderPath = app::GetDirectoryWithExecutable() / "shaders/MinewaysRenderer" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
-	m_ScenePath = app::GetDirectoryWithExecutable().parent_path() / "MinecraftModels";
+	m_ScenePath = sceneFolder.empty() ? app::GetDirectoryWithExecutable().parent_path() / "MinecraftModels" : sceneFolder;
 
 	m_RootFS = std::make_shared<vfs::RootFileSystem>();
 	m_RootFS->mount("/shaders/donut", frameworkShaderPath);
@@ -214,34 +787,168 @@ bool Renderer::Init() {
 	m_ConstantBuffer = GetDevice()->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(ConstBuffer), "ConstantBuffer", engine::c_MaxRenderPassConstantBufferVersions));
 
 	//Init Scene
-	m_MinecraftSceneLoader = std::make_unique<MinecraftSceneLoader>(m_ShaderFactory);
+	m_SceneCache = std::make_unique<SceneCache>(m_ShaderFactory);
 
 	FindAvailableScenes();
 
 	return true;
 }
 
+bool Renderer::LoadSceneOffscreen(const std::string& sceneName) {
+	auto sceneIt = std::find(m_AvailableScenes.begin(), m_AvailableScenes.end(), sceneName);
+	if (sceneIt == m_AvailableScenes.end()) {
+		log::warning("Scene %s is not available in %s", sceneName.c_str(), m_ScenePath.string().c_str());
+		return false;
+	}
+
+	//Same as a scene change in Render, without waiting for the next frame. Lazy textures would show their fallback colors
+	m_BindingSet = nullptr;
+	m_Scene = nullptr;
+	m_BlockEditPending = false;
+	m_BlockEditSubmitted = false;
+	m_ui->lazyTextures = false;
+	m_LazyTextures = false;
+	m_selectedScene = int(sceneIt - m_AvailableScenes.begin());
+	m_ui->selectedScene = m_selectedScene;
+	if (!LoadMinecraftScene(sceneName)) {
+		log::warning("Loading scene %s failed", sceneName.c_str());
+		m_selectedScene = -1;
+		m_ui->selectedScene = -1;
+		return false;
+	}
+	return true;
+}
+
+bool Renderer::RenderOffscreen(const float3& position, const float3& direction, const float3& up, const UIData& settings, uint2 resolution,
+	std::vector<uint8_t>& rgba) {
+	if (!m_Scene || !m_Scene->IsLoaded())
+		return false;
+
+	if (!m_OffscreenTarget || m_OffscreenTarget->getDesc().width != resolution.x || m_OffscreenTarget->getDesc().height != resolution.y) {
+		nvrhi::TextureDesc textureDesc;
+		textureDesc.width = resolution.x;
+		textureDesc.height = resolution.y;
+		textureDesc.format = nvrhi::Format::SRGBA8_UNORM;
+		textureDesc.isRenderTarget = true;
+		textureDesc.initialState = nvrhi::ResourceStates::RenderTarget;
+		textureDesc.keepInitialState = true;
+		textureDesc.debugName = "OffscreenTarget";
+		m_OffscreenTarget = GetDevice()->createTexture(textureDesc);
+		m_OffscreenFramebuffer = GetDevice()->createFramebuffer(nvrhi::FramebufferDesc().addColorAttachment(m_OffscreenTarget));
+		textureDesc.isRenderTarget = false;
+		textureDesc.initialState = nvrhi::ResourceStates::CopyDest;
+		textureDesc.debugName = "OffscreenReadback";
+		m_OffscreenReadback = GetDevice()->createStagingTexture(textureDesc, nvrhi::CpuAccessMode::Read);
+		//Like a window resize, the blit bindings refer to the old target
+		BackBufferResizing();
+	}
+
+	CameraPath::ApplyRenderSettings(settings, *m_ui);
+	m_Camera.LookAt(position, position + direction, up);
+	m_FrameTracker.Invalidate();
+	Render(m_OffscreenFramebuffer);
+
+	m_CommandList->open();
+	m_CommandList->copyTexture(m_OffscreenReadback, nvrhi::TextureSlice(), m_OffscreenTarget, nvrhi::TextureSlice());
+	m_CommandList->close();
+	GetDevice()->executeCommandList(m_CommandList);
+	GetDevice()->waitForIdle();
+
+	size_t rowPitch = 0;
+	const uint8_t* mapped = static_cast<const uint8_t*>(GetDevice()->mapStagingTexture(m_OffscreenReadback, nvrhi::TextureSlice(), nvrhi::CpuAccessMode::Read, &rowPitch));
+	if (!mapped)
+		return false;
+	rgba.resize(size_t(resolution.x) * resolution.y * 4);
+	for (uint y = 0; y < resolution.y; y++)
+		memcpy(rgba.data() + size_t(y) * resolution.x * 4, mapped + y * rowPitch, size_t(resolution.x) * 4);
+	GetDevice()->unmapStagingTexture(m_OffscreenReadback);
+	return true;
+}
+
+void Renderer::UpdateResolutionScale() {
+	ResolutionScaleSettings settings;
+	settings.targetFrameMs = m_ui->targetFrameMs;
+	settings.minScale = m_ui->minResolutionScale;
+	settings.maxScale = m_ui->maxResolutionScale;
+
+	//Replays are traced at the full resolution, so their timings stay comparable
+	bool enabled = m_ui->dynamicResolution && m_CameraPathMode != CameraPathMode::Replay;
+	if (enabled != m_DynamicResolution) {
+		m_DynamicResolution = enabled;
+		m_ResolutionScale.Reset(ResolutionScaleController::Quantize(settings.maxScale, settings));
+	}
+
+	//Timings of frames traced at an older scale are dropped
+	for (uint i = 0; i < k_NumScaleTimerQueries; i++) {
+		if (m_ScaleTimerQueryScale[i] == 0.f || !GetDevice()->pollTimerQuery(m_ScaleTimerQueries[i]))
+			continue;
+		double dispatchMs = double(GetDevice()->getTimerQueryTime(m_ScaleTimerQueries[i])) * 1e3;
+		GetDevice()->resetTimerQuery(m_ScaleTimerQueries[i]);
+		if (m_DynamicResolution && m_ScaleTimerQueryScale[i] == m_ResolutionScale.GetScale())
+			m_ResolutionScale.Update(dispatchMs, settings);
+		m_ScaleTimerQueryScale[i] = 0.f;
+	}
+}
+
+void Renderer::BlitRenderTarget(nvrhi::IFramebuffer* framebuffer) {
+	engine::BlitParameters blitParams;
+	blitParams.targetFramebuffer = framebuffer;
+	blitParams.targetViewport = nvrhi::Viewport(float(m_Resolution.x), float(m_Resolution.y));
+	blitParams.sourceTexture = m_RenderTarget;
+	blitParams.sampler = all(m_TraceResolution == m_Resolution) ? engine::BlitSampler::Point : engine::BlitSampler::Linear;
+	m_CommonPasses->BlitTexture(m_CommandList, blitParams, m_BindingCache.get());
+}
+
 void Renderer::Render(nvrhi::IFramebuffer* framebuffer) {
-	//Check if scene has changed
-	if (m_selectedScene != m_ui->selectedScene) {
-		if (m_MinecraftSceneLoader->IsLoaded()) {
-			m_BindingSet = nullptr;
-			m_MinecraftSceneLoader->UnloadScene(m_TextureCache);
-		}
+	//Frame rate cap, replays run uncapped
+	if (m_ui->frameRateCap > 0 && m_CameraPathMode != CameraPathMode::Replay) {
+		auto frameTime = std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(std::chrono::duration<double>(1.0 / m_ui->frameRateCap));
+		std::this_thread::sleep_until(m_LastFrameStart + frameTime);
+	}
+	auto renderStart = std::chrono::high_resolution_clock::now();
+	m_LastFrameStart = renderStart;
+	m_PresentedFrames++;
+	PollBlockEditLatency();
 
-		m_selectedScene = m_ui->selectedScene;
+	//Resident scenes were loaded with the other texture mode, reload the scene
+	if (m_LazyTextures != m_ui->lazyTextures) {
+		m_LazyTextures = m_ui->lazyTextures;
+		m_BindingSet = nullptr;
+		m_Scene = nullptr;
+		m_SceneCache->Clear(m_TextureCache);
+		m_RayQuery.Clear();
+		m_selectedScene = -1;
 	}
 
-	if (!m_MinecraftSceneLoader->IsLoaded() && m_selectedScene != -1)
-	{
-		LoadMinecraftScene(m_AvailableScenes[m_selectedScene]);
+	//Check if scene has changed. The previous scene stays resident in the scene cache
+	if (m_selectedScene != m_ui->selectedScene) {
+		m_BindingSet = nullptr;
+		m_Scene = nullptr;
+		m_BlockEditPending = false;
+		m_BlockEditSubmitted = false;
+		m_selectedScene = m_ui->selectedScene;
+
+		if (m_selectedScene != -1 && !LoadMinecraftScene(m_AvailableScenes[m_selectedScene])) {
+			log::warning("Loading scene %s failed", m_AvailableScenes[m_selectedScene].c_str());
+			m_selectedScene = -1;
+			m_ui->selectedScene = -1;
+		}
 	}
 
+	//The render target is recreated when the window size or the quantized resolution scale changes
+	nvrhi::TextureDesc textureDesc = framebuffer->getDesc().colorAttachments[0].texture->getDesc();
+	m_Resolution = uint2(textureDesc.width, textureDesc.height);
+	UpdateResolutionScale();
+	uint2 traceResolution = ResolutionScaleController::GetTraceResolution(m_Resolution, m_DynamicResolution ? m_ResolutionScale.GetScale() : 1.f);
+	if (any(traceResolution != m_TraceResolution))
+		m_RenderTarget = nullptr;
+
 	if (!m_RenderTarget) {
 		m_BindingSet = nullptr;
 
-		nvrhi::TextureDesc textureDesc = framebuffer->getDesc().colorAttachments[0].texture->getDesc();
-		m_Resolution = uint2(textureDesc.width, textureDesc.height);
+		m_TraceResolution = traceResolution;
+		textureDesc.width = traceResolution.x;
+		textureDesc.height = traceResolution.y;
 		textureDesc.isUAV = true;
 		textureDesc.isRenderTarget = false;
 		textureDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
@@ -251,46 +958,81 @@ void Renderer::Render(nvrhi::IFramebuffer* framebuffer) {
 	}
 
 	//Return early
-	if (!m_MinecraftSceneLoader->IsLoaded()) {
+	if (!m_Scene || !m_Scene->IsLoaded()) {
 		m_CommandList->open();
 		m_CommandList->clearTextureFloat(m_RenderTarget, nvrhi::AllSubresources, nvrhi::Color(0.1f, 0.6f, 0.1f, 1.f));
-		m_CommonPasses->BlitTexture(m_CommandList, framebuffer, m_RenderTarget, m_BindingCache.get());
+		BlitRenderTarget(framebuffer);
 		m_CommandList->close();
 		GetDevice()->executeCommandList(m_CommandList);
 		return;
 	}
 
+	//Block edits can recreate buffers, they are applied before the binding set is created
+	ApplyBlockEdits();
+
 	//Create Binding set
 	if (!m_BindingSet) {
 		nvrhi::BindingSetDesc bindingSetDesc;
 		bindingSetDesc.bindings = {
 			nvrhi::BindingSetItem::ConstantBuffer(0, m_ConstantBuffer),
-			nvrhi::BindingSetItem::RayTracingAccelStruct(0, m_MinecraftSceneLoader->GetTLAS()),
+			nvrhi::BindingSetItem::RayTracingAccelStruct(0, m_Scene->GetTLAS()),
 			nvrhi::BindingSetItem::Texture_UAV(0, m_RenderTarget),
-			nvrhi::BindingSetItem::StructuredBuffer_SRV(1, m_MinecraftSceneLoader->GetIndexBuffer()),
-			nvrhi::BindingSetItem::StructuredBuffer_SRV(2, m_MinecraftSceneLoader->GetVertexBuffer()),
-			nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_MinecraftSceneLoader->GetAABBBuffer()),
-			nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_MinecraftSceneLoader->GetTriangleMaterialIDBuffer()),
-			nvrhi::BindingSetItem::StructuredBuffer_SRV(5, m_MinecraftSceneLoader->GetAABBMaterialIDBuffer()),
-			nvrhi::BindingSetItem::StructuredBuffer_SRV(6, m_MinecraftSceneLoader->GetMaterialBuffer()),
+			nvrhi::BindingSetItem::StructuredBuffer_UAV(1, m_Scene->GetMaterialFeedbackBuffer()),
+			nvrhi::BindingSetItem::RawBuffer_SRV(1, m_Scene->GetIndexBuffer()),
+			nvrhi::BindingSetItem::StructuredBuffer_SRV(2, m_Scene->GetVertexBuffer()),
+			nvrhi::BindingSetItem::StructuredBuffer_SRV(3, m_Scene->GetAABBBuffer()),
+			nvrhi::BindingSetItem::StructuredBuffer_SRV(4, m_Scene->GetTriangleMaterialIDBuffer()),
+			nvrhi::BindingSetItem::StructuredBuffer_SRV(5, m_Scene->GetAABBMaterialIDBuffer()),
+			nvrhi::BindingSetItem::StructuredBuffer_SRV(6, m_Scene->GetMaterialBuffer()),
+			nvrhi::BindingSetItem::StructuredBuffer_SRV(7, m_Scene->GetLightTreeBuffer()),
+			nvrhi::BindingSetItem::StructuredBuffer_SRV(8, m_Scene->GetEmissiveLightBuffer()),
+			nvrhi::BindingSetItem::StructuredBuffer_SRV(9, m_Scene->GetOccupancyRegionBuffer()),
+			nvrhi::BindingSetItem::StructuredBuffer_SRV(10, m_Scene->GetOccupancyBrickBuffer()),
+			nvrhi::BindingSetItem::StructuredBuffer_SRV(11, m_Scene->GetTriangleRegionBuffer()),
+			nvrhi::BindingSetItem::StructuredBuffer_SRV(12, m_VisibleCellBuffer),
 			nvrhi::BindingSetItem::Sampler(0, m_CommonPasses->m_PointClampSampler)
 		};
 		m_BindingSet = GetDevice()->createBindingSet(bindingSetDesc, m_BindingLayout);
+		//New scene or render target
+		m_FrameTracker.Invalidate();
 	}
 
 	//Update viewport and camera
 	m_Camera.SetMoveSpeed(m_ui->cameraSpeed);
-	nvrhi::Viewport windowViewport(float(m_Resolution.x), float(m_Resolution.y));
-	m_View.SetViewport(windowViewport);
-	m_View.SetMatrices(m_Camera.GetWorldToViewMatrix(), perspProjD3DStyleReverse(m_ui->cameraFov, windowViewport.width() / windowViewport.height(), m_ui->cameraFar));
+	//Primary rays are generated over the trace resolution, the aspect ratio is the one of the window
+	nvrhi::Viewport traceViewport(float(m_TraceResolution.x), float(m_TraceResolution.y));
+	m_View.SetViewport(traceViewport);
+	m_View.SetMatrices(m_Camera.GetWorldToViewMatrix(), perspProjD3DStyleReverse(m_ui->cameraFov, float(m_Resolution.x) / float(m_Resolution.y), m_ui->cameraFar));
 	m_View.UpdateCache();
 
 	m_DirLight->SetDirection(double3(m_ui->lightDirection));
 	m_DirLight->irradiance = m_ui->lightIntensity;
 	m_LightGraph->Refresh(0);
 
+	//Upload the lazy textures that finished decoding, the upload time per frame is limited
+	if (m_Scene->HasLazyTextures())
+		m_TextureCache->ProcessRenderingThreadCommands(*m_CommonPasses, k_TextureUploadMsPerFrame);
+
 	m_CommandList->open();
 
+	m_Scene->UpdateTextureResidency(GetDevice(), m_CommandList, m_TextureCache, m_DescriptorTable, uint64_t(max(m_ui->textureBudgetMB, 0)) << 20);
+
+	//Show the last image again if nothing changed. Replayed frames are always traced, they are timed
+	FrameChangeTracker::Inputs frameInputs;
+	frameInputs.viewProjection = m_View.GetViewProjectionMatrix();
+	frameInputs.settings = *m_ui;
+	frameInputs.scene = m_Scene;
+	frameInputs.sceneVersion = m_Scene->GetMaterialVersion() + m_Scene->GetGeometryVersion();
+	frameInputs.resolution = m_TraceResolution;
+	if (!m_ui->reuseFrames || m_CameraPathMode == CameraPathMode::Replay)
+		m_FrameTracker.Invalidate();
+	if (!m_FrameTracker.Update(frameInputs)) {
+		BlitRenderTarget(framebuffer);
+		m_CommandList->close();
+		GetDevice()->executeCommandList(m_CommandList);
+		return;
+	}
+
 	//m_CommandList->clearTextureFloat(m_RenderTarget, nvrhi::AllSubresources, nvrhi::Color(0.f, 0.f, 0.f, 1.f));
 	//Fill Constant buffer
 	ConstBuffer constants = {};
@@ -302,6 +1044,15 @@ void Renderer::Render(nvrhi::IFramebuffer* framebuffer) {
 	constants.cameraFar = m_ui->cameraFar;
 	constants.ambientSpecular = m_ui->ambientSpecularStrength;
 	constants.shadowRayOffset = m_ui->shadowRayBias;
+	constants.numEmissiveLights = m_Scene->GetNumEmissiveLights();
+	constants.frameIndex = m_FrameIndex++;
+	constants.emissiveLightSamples = uint(max(m_ui->emissiveLightSamples, 0));
+	constants.occupancyMaxSteps = uint(max(m_ui->occupancyMaxSteps, 0));
+	constants.sceneHasTriangles = m_Scene->GetIndices().empty() ? 0 : 1;
+	constants.textureFeedback = m_Scene->HasLazyTextures() ? 1 : 0;
+	constants.occupancyGridOrigin = m_Scene->GetOccupancyGrid().GetOrigin();
+	constants.occupancyGridRegions = m_Scene->GetOccupancyGrid().GetNumRegions();
+	UpdateVisibleCells(constants);
 	m_CommandList->writeBuffer(m_ConstantBuffer, &constants, sizeof(constants));
 
 	nvrhi::rt::State state;
@@ -309,13 +1060,54 @@ void Renderer::Render(nvrhi::IFramebuffer* framebuffer) {
 	state.bindings = { m_BindingSet, m_DescriptorTable->GetDescriptorTable() };
 	m_CommandList->setRayTracingState(state);
 
+	//Replayed frames measure the GPU time of the dispatch
+	nvrhi::ITimerQuery* timerQuery = nullptr;
+	if (m_CameraPathMode == CameraPathMode::Replay && m_ReplayRenderFrame >= 0) {
+		timerQuery = m_TimerQueries[m_ReplayRenderFrame % k_NumTimerQueries];
+		m_CommandList->beginTimerQuery(timerQuery);
+	}
+
+	//The dynamic resolution measures the dispatch as well, if a query of an earlier frame is free
+	nvrhi::ITimerQuery* scaleTimerQuery = nullptr;
+	if (!timerQuery && m_DynamicResolution && m_ScaleTimerQueryScale[m_NextScaleTimerQuery] == 0.f) {
+		if (!m_ScaleTimerQueries[m_NextScaleTimerQuery])
+			m_ScaleTimerQueries[m_NextScaleTimerQuery] = GetDevice()->createTimerQuery();
+		scaleTimerQuery = m_ScaleTimerQueries[m_NextScaleTimerQuery];
+		m_ScaleTimerQueryScale[m_NextScaleTimerQuery] = m_ResolutionScale.GetScale();
+		m_NextScaleTimerQuery = (m_NextScaleTimerQuery + 1) % k_NumScaleTimerQueries;
+		m_CommandList->beginTimerQuery(scaleTimerQuery);
+	}
+
 	nvrhi::rt::DispatchRaysArguments args;
-	args.width = m_Resolution.x;
-	args.height = m_Resolution.y;
+	args.width = m_TraceResolution.x;
+	args.height = m_TraceResolution.y;
 	m_CommandList->dispatchRays(args);
 
-	m_CommonPasses->BlitTexture(m_CommandList, framebuffer, m_RenderTarget, m_BindingCache.get());
+	if (timerQuery)
+		m_CommandList->endTimerQuery(timerQuery);
+	if (scaleTimerQuery)
+		m_CommandList->endTimerQuery(scaleTimerQuery);
+
+	m_Scene->RecordTextureFeedback(m_CommandList);
+
+	BlitRenderTarget(framebuffer);
 
 	m_CommandList->close();
 	GetDevice()->executeCommandList(m_CommandList);
+
+	//A pending block edit was applied before the dispatch, it is visible once the GPU finished this frame
+	if (m_BlockEditPending && !m_BlockEditSubmitted) {
+		if (!m_BlockEditQuery)
+			m_BlockEditQuery = GetDevice()->createEventQuery();
+		GetDevice()->resetEventQuery(m_BlockEditQuery);
+		GetDevice()->setEventQuery(m_BlockEditQuery, nvrhi::CommandQueue::Graphics);
+		m_BlockEditSubmitted = true;
+		m_BlockEditSubmitFrame = m_PresentedFrames;
+	}
+
+	if (timerQuery) {
+		FrameTiming timing;
+		timing.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - renderStart).count();
+		m_BenchmarkReport.AddFrame(timing);
+	}
 }
\ No newline at end of file
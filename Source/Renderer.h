@@ -14,6 +14,19 @@
 #include <nvrhi/utils.h>
 
 #include "MinecraftSceneLoader.h"
+#include "SceneCache.h"
+#include "SceneIndex.h"
+#include "UIData.h"
+#include "CameraPath.h"
+#include "BenchmarkReport.h"
+#include "CpuRayTracer.h"
+#include "SceneRayQuery.h"
+#include "FrameChangeTracker.h"
+#include "PotentiallyVisibleSet.h"
+#include "ResolutionScaleController.h"
+#include "TaskScheduler.h"
+#include <chrono>
+#include <future>
 
 using namespace donut;
 using namespace donut::math;
@@ -22,30 +35,6 @@ using namespace donut::math;
 
 static const char* g_WindowTitle = "Mineways Renderer V" RENDERER_VERSION;
 
-//UI data
-struct UIData {
-	//Light
-	float3 lightDirection = float3(-0.340f , -0.841f , 0.421);
-	float lightIntensity = 5.f;
-
-	//Camera
-	float cameraSpeed = 3.f;
-	float cameraFov = 0.78f;
-	float cameraNear = 0.1f;
-	float cameraFar = 1000.f;
-
-	//Rendering settings
-	float ambient = 0.1f;
-	float emissiveStrength = 1.0f;
-	float ambientSpecularStrength = 1.f;
-	
-	//Shadow
-	float shadowRayBias = 0.03;
-	
-	//Scene selection
-	int selectedScene = -1;
-};
-
 class Renderer : public app::IRenderPass 
 {
 public:
@@ -68,8 +57,8 @@ public:
 	//Called once per frame for updating time depended classes
 	void Animate(float fElapsedTimeSeconds) override;
 
-	//Initialize resources for the renderer
-	bool Init();
+	//Initialize resources for the renderer. Scenes are found in the MinecraftModels folder of the build if no scene folder is given
+	bool Init(const std::filesystem::path& sceneFolder = {});
 
 	//Main render loop
 	void Render(nvrhi::IFramebuffer* framebuffer) override;
@@ -82,9 +71,80 @@ public:
 
 	//Return render time infos
 	const std::string GetFPSInfo() { return m_fpsInfo; }
+	//Frames traced and frames that reused the last image
+	const FrameChangeTracker::Stats& GetFrameReuseStats() const { return m_FrameTracker.GetStats(); }
+	//Dynamic resolution state, the trace resolution equals the window resolution while it is off
+	const ResolutionScaleController& GetResolutionScale() const { return m_ResolutionScale; }
+	uint2 GetTraceResolution() const { return m_TraceResolution; }
 
 	const std::vector<std::string>& GetAvailableScenes() { return m_AvailableScenes; }
+	//Index entry of an available scene, nullptr if it was not scanned yet
+	const SceneIndexEntry* GetSceneIndexEntry(int sceneIndex) const { return m_SceneIndex.Find(m_AvailableScenes[sceneIndex]); }
+	bool IsScanningScenes() const { return m_SceneIndexScan.valid(); }
 	std::shared_ptr<engine::ShaderFactory> GetShaderFactory() const { return m_ShaderFactory; }
+	const SceneCache::Stats& GetSceneCacheStats() const { return m_SceneCache->GetStats(); }
+	//Residency of the lazy textures of the active scene, nullptr if its textures are loaded eagerly
+	const TextureResidency* GetTextureResidency() const { return m_Scene ? m_Scene->GetTextureResidency() : nullptr; }
+
+	//Records the camera transform and UIData of every frame until StopRecording is called, which saves the path to the file
+	bool StartRecording(const std::filesystem::path& pathFile);
+	void StopRecording();
+	//Replays a recorded camera path with one path frame per rendered frame and writes the frame timings as JSON to reportFile
+	bool StartReplay(const std::filesystem::path& pathFile, const std::filesystem::path& reportFile, bool exitWhenDone);
+	bool IsRecording() const { return m_CameraPathMode == CameraPathMode::Recording; }
+	bool IsReplaying() const { return m_CameraPathMode == CameraPathMode::Replay; }
+	size_t GetCameraPathFrame() const { return IsReplaying() ? m_ReplayFrame : m_CameraPath.GetNumFrames(); }
+	size_t GetCameraPathLength() const { return m_CameraPath.GetNumFrames(); }
+	//Default file for camera paths recorded or replayed from the UI
+	std::filesystem::path GetDefaultCameraPathFile() const { return m_ScenePath.parent_path() / "CameraPath.txt"; }
+
+	//Traces the current view of the active scene on the CPU, with 8x8 ray packets and with single rays, and logs the ray throughput
+	bool RunCpuRayBenchmark();
+	//Runs the CPU ray benchmark for every available scene and writes the results as JSON. Used for headless runs
+	bool RunCpuRayBenchmarks(const std::filesystem::path& reportFile);
+	const std::string& GetCpuRayBenchmarkInfo() const { return m_CpuRayBenchmarkInfo; }
+
+	//CPU ray queries against the active scene, built on first use. nullptr if no scene is loaded
+	const SceneRayQuery* GetRayQuery();
+	//Closest hit of the view center ray with the ray query. Returns false if the query is not built or nothing was hit
+	bool PickSurface(CpuHit& hit) const;
+	//Traces batches of coherent (view) and random rays with closest and any hit queries and logs the throughput
+	bool RunRayQueryBenchmark();
+	const std::string& GetRayQueryBenchmarkInfo() const { return m_RayQueryBenchmarkInfo; }
+
+	//Finds the first block along the view direction with the occupancy grid of the active scene
+	bool PickBlock(OccupancyGrid::TraceResult& result);
+	size_t GetOccupancyGridByteSize() const { return m_Scene ? m_Scene->GetOccupancyGrid().GetByteSize() : 0; }
+
+	enum class BlockEditAction {
+		Place,		//Places a block in front of the face the view center enters
+		Remove,		//Removes the view center block
+		PaintFace	//Sets the material of the face the view center enters
+	};
+	//Time from a block edit until the GPU finished the first frame showing it
+	struct BlockEditLatency {
+		uint numMeasured = 0;
+		double lastMs = 0.0;
+		double maxMs = 0.0;
+		double totalMs = 0.0;
+		uint lastFrames = 0;	//Presented frames until the edit was visible, including the one showing it
+		uint maxFrames = 0;
+	};
+	//Edits the block at the view center of the active scene, see MinecraftSceneLoader::SetBlock. Returns false if nothing changed
+	bool EditViewCenterBlock(BlockEditAction action, int materialID);
+	const BlockEditLatency& GetBlockEditLatency() const { return m_BlockEditLatency; }
+	//Slots and edits of the active scene, nullptr if it was not edited
+	const BlockEditor* GetBlockEditor() const { return m_Scene ? m_Scene->GetBlockEditor() : nullptr; }
+	int GetNumMaterials() const { return m_Scene ? int(m_Scene->GetMaterials().size()) : 0; }
+
+	//Headless rendering without a window, used by the batch workers when a ray tracing device exists.
+	//Loads a scene of the scene folder with all textures. Returns false if it is not available or could not be loaded
+	bool LoadSceneOffscreen(const std::string& sceneName);
+	const MinecraftSceneLoader* GetActiveScene() const { return m_Scene; }
+	//Traces the view of the loaded scene with the render settings of the given UIData into an offscreen render target and reads it back
+	//as sRGB encoded RGBA8, rows from top to bottom like CpuRenderer::Render. Waits for the GPU
+	bool RenderOffscreen(const float3& position, const float3& direction, const float3& up, const UIData& settings, uint2 resolution,
+		std::vector<uint8_t>& rgba);
 private:
 	//Helper for loading the scene
 	bool LoadMinecraftScene(std::string sceneName);
@@ -97,10 +157,51 @@ private:
 
 	void FindAvailableScenes();
 
+	//Replaces the index entry of a scene with the exact values of the loaded scene
+	void UpdateSceneIndex(const std::string& sceneName);
+
+	//Camera for CPU primary rays matching the current view
+	CpuCamera GetCpuCamera(uint2 resolution);
+	//Builds the CPU BVH of the active scene and runs the benchmark at the given resolution
+	CpuRayTracer::BenchmarkResult RunCpuRayBenchmark(uint2 resolution);
+
+	//Adds the current camera and UIData to the recorded path
+	void RecordCameraPathFrame(float fElapsedTimeSeconds);
+	//Applies the next path frame to the camera and UIData
+	void AnimateReplay();
+	//Feeds the finished dispatch timings to the resolution scale controller
+	void UpdateResolutionScale();
+	//Blits the render target to the window, scaled render targets are upscaled with bilinear filtering
+	void BlitRenderTarget(nvrhi::IFramebuffer* framebuffer);
+	//Reads the GPU time of a replayed frame from its timer query
+	void ResolveTimerQuery(size_t replayFrame);
+	//Writes the benchmark report and ends the replay
+	void FinishReplay();
+	//Uploads the pending block edits of the active scene and starts the latency measurement of the frame that shows them
+	void ApplyBlockEdits();
+	//Uploads the visible cells of the camera cell if it changed and fills the culling constants. Without a set of the scene culling is off
+	void UpdateVisibleCells(ConstBuffer& constants);
+	//Finishes the latency measurement once the GPU completed the frame that shows the edit
+	void PollBlockEditLatency();
+
 	int m_selectedScene = -1;							//Active index in m_AvailableScenes (-1 = no scene loaded)
 	std::vector<std::string> m_AvailableScenes;			//List of available Scenes
-	uint2 m_Resolution = uint2(500, 500);				//Display and Render resolution
+	SceneIndex m_SceneIndex;							//Lightweight infos of the available scenes
+	std::future<std::vector<SceneIndexEntry>> m_SceneIndexScan;	//Background scan of new or changed scenes
+	uint2 m_Resolution = uint2(500, 500);				//Display resolution
+	uint2 m_TraceResolution = uint2(500, 500);			//Resolution of the render target and the ray dispatch
 	std::string m_fpsInfo = "";							//Render Time info in ms and FPS
+	uint m_FrameIndex = 0;								//Frame counter, used to seed random numbers in the shader
+	FrameChangeTracker m_FrameTracker;					//Skips tracing if nothing changed since the last traced frame
+	std::chrono::high_resolution_clock::time_point m_LastFrameStart;	//Start of the last frame, for the frame rate cap
+
+	//Dynamic resolution, driven by the GPU time of the ray dispatch
+	static const uint k_NumScaleTimerQueries = 3;		//Timer queries in flight, a frame is not measured if none is free
+	ResolutionScaleController m_ResolutionScale;
+	bool m_DynamicResolution = false;					//Controller active, off during replays
+	nvrhi::TimerQueryHandle m_ScaleTimerQueries[k_NumScaleTimerQueries];
+	float m_ScaleTimerQueryScale[k_NumScaleTimerQueries] = {};	//Scale of the frame a query measures, 0 = free
+	uint m_NextScaleTimerQuery = 0;
 
 	nvrhi::CommandListHandle m_CommandList;				//(Graphics) Command List
 	nvrhi::ShaderLibraryHandle m_ShaderLibrary;			//Shader Library
@@ -130,7 +231,52 @@ private:
 	std::shared_ptr<engine::SceneGraphNode> m_LightNode;	//Scene Node needed for the Directional light
 	std::shared_ptr<engine::DirectionalLight> m_DirLight;	//Directional Light helper
 
-	std::unique_ptr<MinecraftSceneLoader> m_MinecraftSceneLoader; //Scene loader
+	std::unique_ptr<SceneCache> m_SceneCache;			//Resident scenes, least recently used are evicted
+	MinecraftSceneLoader* m_Scene = nullptr;			//Active scene, owned by the scene cache
+	bool m_LazyTextures = false;						//Texture mode of the resident scenes
+	PotentiallyVisibleSet m_Pvs;						//Potentially visible set of the active scene, empty if there is none
+	nvrhi::BufferHandle m_VisibleCellBuffer;			//Visible cells of the camera cell as bits, read by the hit shaders
+	int m_VisibleCellsSource = -1;						//Camera cell of the uploaded bits, -1 if none were uploaded
+
+	static constexpr float k_TextureUploadMsPerFrame = 2.f;	//Time limit for uploading lazy textures in a frame
+
+	//Camera path recording and benchmark replay
+	enum class CameraPathMode { None, Recording, Replay };
+	static const uint k_ReplayWarmupFrames = 30;		//Frames rendered with the first path frame before timing starts
+	static const uint k_NumTimerQueries = 4;			//Timer queries in flight, the oldest one is read before it is reused
+	CameraPathMode m_CameraPathMode = CameraPathMode::None;
+	CameraPath m_CameraPath;							//Recorded or replayed path
+	std::filesystem::path m_CameraPathFile;				//Target file of the recording
+	std::filesystem::path m_BenchmarkReportFile;		//Target file of the replay timings
+	BenchmarkReport m_BenchmarkReport;					//Timings of the replayed frames
+	double m_RecordedTime = 0.0;						//Summed frame time of the recording, used for the path time step
+	int m_ReplayScene = -1;								//Index of the path scene in m_AvailableScenes
+	size_t m_ReplayFrame = 0;							//Next path frame of the replay
+	int m_ReplayRenderFrame = -1;						//Path frame rendered this frame (-1 = warm up, not timed)
+	uint m_ReplayWarmupFrames = 0;						//Remaining warm up frames
+	bool m_ExitAfterReplay = false;						//Closes the window after the report was written
+	std::chrono::high_resolution_clock::time_point m_ReplayFrameStart;
+	nvrhi::TimerQueryHandle m_TimerQueries[k_NumTimerQueries];
+
+	std::string m_CpuRayBenchmarkInfo = "";				//Result of the last CPU ray benchmark
+
+	SceneRayQuery m_RayQuery;							//CPU ray queries of the active scene, cleared when the scene changes
+
+	//Block edit latency, one edit is measured at a time
+	uint64_t m_PresentedFrames = 0;						//Calls of Render
+	bool m_BlockEditPending = false;					//An edit waits for its frame
+	bool m_BlockEditSubmitted = false;					//The frame with the edit was executed, m_BlockEditQuery is set
+	std::chrono::high_resolution_clock::time_point m_BlockEditTime;
+	uint64_t m_BlockEditFrame = 0;						//Value of m_PresentedFrames when the edit was made
+	uint64_t m_BlockEditSubmitFrame = 0;
+	nvrhi::EventQueryHandle m_BlockEditQuery;
+	BlockEditLatency m_BlockEditLatency;
+
+	//Offscreen target of RenderOffscreen, in the format of the window swap chain, and its readback copy
+	nvrhi::TextureHandle m_OffscreenTarget;
+	nvrhi::FramebufferHandle m_OffscreenFramebuffer;
+	nvrhi::StagingTextureHandle m_OffscreenReadback;
+	std::string m_RayQueryBenchmarkInfo = "";			//Result of the last ray query benchmark
 
 	UIData* m_ui;	//Pointer to UI data. Is shared with the UI
 };
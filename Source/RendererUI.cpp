@@ -42,6 +42,43 @@ inline float3 PolarToCartesian(float2 polar) {
 	return float3(sin(polar.x) * cos(polar.y), cos(polar.x), sin(polar.x) * sin(polar.y));
 }
 
+static std::string FormatBytes(uint64_t bytes) {
+	char buffer[32];
+	if (bytes >= (uint64_t(1) << 30))
+		snprintf(buffer, sizeof(buffer), "%.1f GB", double(bytes) / double(1 << 30));
+	else
+		snprintf(buffer, sizeof(buffer), "%.1f MB", double(bytes) / double(1 << 20));
+	return buffer;
+}
+
+std::string UserInterface::GetSceneLabel(int sceneIndex) {
+	std::string label = m_renderer->GetAvailableScenes()[sceneIndex];
+	const SceneIndexEntry* entry = m_renderer->GetSceneIndexEntry(sceneIndex);
+	if (entry) {
+		char info[96];
+		snprintf(info, sizeof(info), " (%s%u blocks, %s)", entry->fromFullLoad ? "" : "~", entry->numBlocks, FormatBytes(entry->estimatedGpuBytes).c_str());
+		label += info;
+	}
+	return label;
+}
+
+void UserInterface::ShowSceneTooltip(int sceneIndex) {
+	const SceneIndexEntry* entry = m_renderer->GetSceneIndexEntry(sceneIndex);
+	if (!entry)
+		return;
+
+	ImGui::BeginTooltip();
+	ImGui::Text("File size: %s", FormatBytes(entry->fileSize).c_str());
+	ImGui::Text("Blocks: %u, Triangles: %u, Materials: %u", entry->numBlocks, entry->numTriangles, entry->numMaterials);
+	ImGui::Text("Bounds: (%.0f, %.0f, %.0f) to (%.0f, %.0f, %.0f)", entry->boundsMin.x, entry->boundsMin.y, entry->boundsMin.z,
+		entry->boundsMax.x, entry->boundsMax.y, entry->boundsMax.z);
+	ImGui::Text("Estimated GPU memory: %s", FormatBytes(entry->estimatedGpuBytes).c_str());
+	for (const std::string& textureSet : entry->textureSets)
+		ImGui::Text("Textures: %s", textureSet.c_str());
+	ImGui::Text(entry->fromFullLoad ? "Values from the last load" : "Estimated values, exact after loading");
+	ImGui::EndTooltip();
+}
+
 void UserInterface::buildUI()
 {
 	ImGui::SetNextWindowPos(ImVec2(10.f, 10.f), 0);
@@ -62,18 +99,20 @@ void UserInterface::buildUI()
 			ImGui::Text("No Scene selected");
 		ImGui::Unindent();
 
-		if (availableScenes.size() > 1) {
-			if (ImGui::BeginCombo("Scene", availableScenes[selectedScene].c_str())) {
-				for (int i = 0; i < availableScenes.size(); i++) {
-					bool is_selected = i == selectedScene;
-					if (ImGui::Selectable(availableScenes[i].c_str(), is_selected))
-						selectedScene = i;
-					if (is_selected)
-						ImGui::SetItemDefaultFocus();
-				}
-				ImGui::EndCombo();
+		if (ImGui::BeginCombo("Scene", GetSceneLabel(selectedScene).c_str())) {
+			for (int i = 0; i < availableScenes.size(); i++) {
+				bool is_selected = i == selectedScene;
+				if (ImGui::Selectable(GetSceneLabel(i).c_str(), is_selected))
+					selectedScene = i;
+				if (ImGui::IsItemHovered())
+					ShowSceneTooltip(i);
+				if (is_selected)
+					ImGui::SetItemDefaultFocus();
 			}
+			ImGui::EndCombo();
 		}
+		if (m_renderer->IsScanningScenes())
+			ImGui::Text("Scanning scenes...");
 
 	}
 	else {
@@ -84,13 +123,124 @@ void UserInterface::buildUI()
 		return;
 	}
 
-	if (availableScenes.size() > 1) {
-		if (ImGui::Button("Load Scene"))
-			m_ui->selectedScene = selectedScene;
-	}
+	if (ImGui::Button("Load Scene"))
+		m_ui->selectedScene = selectedScene;
 
 	//Settings
+	if (ImGui::CollapsingHeader("Scene Cache"))
+	{
+		ImGui::Text("GPU Budget (MB):");
+		ImGui::Indent();
+		ImGui::DragInt("##SceneCacheGpuBudget", &m_ui->sceneCacheGpuBudgetMB, 16.f, 0, 1 << 20);
+		ImGui::Unindent();
+		ImGui::Text("CPU Budget (MB):");
+		ImGui::Indent();
+		ImGui::DragInt("##SceneCacheCpuBudget", &m_ui->sceneCacheCpuBudgetMB, 16.f, 0, 1 << 20);
+		ImGui::Unindent();
+
+		const SceneCache::Stats& stats = m_renderer->GetSceneCacheStats();
+		ImGui::Text("Resident Scenes: %u", stats.residentScenes);
+		ImGui::Text("GPU: %.1f MB (%.1f MB shared textures)", double(stats.gpuBytes) / (1024.0 * 1024.0), double(stats.sharedTextureBytes) / (1024.0 * 1024.0));
+		ImGui::Text("CPU: %.1f MB", double(stats.cpuBytes) / (1024.0 * 1024.0));
+		ImGui::Text("Hits: %u, Misses: %u, Evictions: %u", stats.hits, stats.misses, stats.evictions);
+	}
+
+	if (ImGui::CollapsingHeader("Textures"))
+	{
+		ImGui::Checkbox("Load on first use", &m_ui->lazyTextures);
+		ImGui::Text("Budget (MB):");
+		ImGui::Indent();
+		ImGui::DragInt("##TextureBudget", &m_ui->textureBudgetMB, 4.f, 0, 1 << 20);
+		ImGui::Unindent();
+
+		const TextureResidency* residency = m_renderer->GetTextureResidency();
+		if (residency) {
+			const TextureResidency::Stats& stats = residency->GetStats();
+			ImGui::Text("Resident Materials: %u / %u (%u loading)", stats.numResident, stats.numMaterials, stats.numLoading);
+			ImGui::Text("Textures: %u, %.1f MB", stats.numTextures, double(stats.residentBytes) / (1024.0 * 1024.0));
+			ImGui::Text("Requests: %llu, Evictions: %llu", (unsigned long long)stats.numRequests, (unsigned long long)stats.numEvictions);
+		}
+	}
+
+	if (ImGui::CollapsingHeader("Frame Reuse"))
+	{
+		ImGui::Checkbox("Reuse unchanged frames", &m_ui->reuseFrames);
+		ImGui::Text("Frame Rate Cap (0 = off):");
+		ImGui::Indent();
+		ImGui::DragInt("##FrameRateCap", &m_ui->frameRateCap, 1.f, 0, 1000);
+		ImGui::Unindent();
+
+		const FrameChangeTracker::Stats& stats = m_renderer->GetFrameReuseStats();
+		ImGui::Text("Traced: %llu, Reused: %llu", (unsigned long long)stats.tracedFrames, (unsigned long long)stats.reusedFrames);
+	}
+
+	if (ImGui::CollapsingHeader("Dynamic Resolution"))
+	{
+		ImGui::Checkbox("Scale to frame time budget", &m_ui->dynamicResolution);
+		IndentFloat("Target dispatch time (ms):", "##TargetFrameMs", &m_ui->targetFrameMs, 0.1f, 1.f, 100.f, "%.1f");
+		IndentFloat("Minimum scale:", "##MinResolutionScale", &m_ui->minResolutionScale, 0.01f, 0.125f, m_ui->maxResolutionScale);
+		IndentFloat("Maximum scale:", "##MaxResolutionScale", &m_ui->maxResolutionScale, 0.01f, m_ui->minResolutionScale, 1.f);
+
+		const ResolutionScaleController::Stats& stats = m_renderer->GetResolutionScale().GetStats();
+		uint2 traceResolution = m_renderer->GetTraceResolution();
+		ImGui::Text("Scale: %.3f (%ux%u)", m_ui->dynamicResolution ? m_renderer->GetResolutionScale().GetScale() : 1.f, traceResolution.x, traceResolution.y);
+		ImGui::Text("Dispatch: %.2f ms, in budget: %.0f%%", stats.filteredFrameMs, stats.budgetAdherence * 100.f);
+		ImGui::Text("Scale changes: %llu", (unsigned long long)stats.scaleChanges);
+	}
 	
+	if (ImGui::CollapsingHeader("Camera Path"))
+	{
+		std::filesystem::path pathFile = m_renderer->GetDefaultCameraPathFile();
+		ImGui::Text("File: %s", pathFile.filename().string().c_str());
+		if (m_renderer->IsReplaying()) {
+			ImGui::Text("Replaying frame %zu / %zu", m_renderer->GetCameraPathFrame(), m_renderer->GetCameraPathLength());
+		}
+		else if (m_renderer->IsRecording()) {
+			ImGui::Text("Recorded frames: %zu", m_renderer->GetCameraPathFrame());
+			if (ImGui::Button("Stop Recording"))
+				m_renderer->StopRecording();
+		}
+		else {
+			if (ImGui::Button("Start Recording"))
+				m_renderer->StartRecording(pathFile);
+			ImGui::SameLine();
+			if (ImGui::Button("Replay Benchmark"))
+				m_renderer->StartReplay(pathFile, std::filesystem::path(pathFile).replace_extension(".json"), false);
+		}
+	}
+
+	if (ImGui::CollapsingHeader("CPU Ray Tracing"))
+	{
+		if (ImGui::Button("Run CPU Ray Benchmark"))
+			m_renderer->RunCpuRayBenchmark();
+		if (!m_renderer->GetCpuRayBenchmarkInfo().empty())
+			ImGui::Text(m_renderer->GetCpuRayBenchmarkInfo().c_str());
+
+		//Batched ray queries for picking and tools, the BVH is built by the first benchmark
+		if (ImGui::Button("Run Ray Query Benchmark"))
+			m_renderer->RunRayQueryBenchmark();
+		if (!m_renderer->GetRayQueryBenchmarkInfo().empty())
+			ImGui::Text(m_renderer->GetRayQueryBenchmarkInfo().c_str());
+		CpuHit pick;
+		if (m_renderer->PickSurface(pick)) {
+			const char* faceNames[6] = { "-X", "+X", "-Z", "+Z", "-Y", "+Y" };
+			ImGui::Text("View Center: material %d, %s, %.2f", pick.matID, pick.face >= 0 ? faceNames[pick.face] : "triangle", pick.t);
+		}
+
+		//Utilization since the last reset, also covers scene loading
+		if (ImGui::TreeNode("Task Scheduler")) {
+			if (ImGui::Button("Reset Stats"))
+				TaskScheduler::Get().ResetStats();
+			std::vector<TaskScheduler::WorkerStats> workerStats = TaskScheduler::Get().GetWorkerStats();
+			for (size_t i = 0; i < workerStats.size(); i++) {
+				const TaskScheduler::WorkerStats& worker = workerStats[i];
+				ImGui::Text("%s %zu: %.1f%% busy, %llu tasks (%llu stolen)", i + 1 < workerStats.size() ? "Worker" : "External", i,
+					worker.utilization * 100.0, (unsigned long long)worker.tasksExecuted, (unsigned long long)worker.tasksStolen);
+			}
+			ImGui::TreePop();
+		}
+	}
+
 	if (ImGui::CollapsingHeader("Directional Light")) //, ImGuiTreeNodeFlags_DefaultOpen))
 	{
 		static bool asPolar = true;
@@ -131,11 +281,56 @@ void UserInterface::buildUI()
 		IndentFloat("Emissive Strength:", "##EmissiveStrength", &m_ui->emissiveStrength, 0.01f, 0.f, FLT_MAX, " % .2f");
 
 		IndentFloat("Specular Ambient", "##SpecularAmbient", &m_ui->ambientSpecularStrength, 0.0001f, 0.f, FLT_MAX, " % .4f");
+
+		ImGui::Text("Emissive Block Light Samples:");
+		ImGui::Indent();
+		ImGui::SliderInt("##EmissiveLightSamples", &m_ui->emissiveLightSamples, 0, 8);
+		ImGui::Unindent();
 	}
 
 	if (ImGui::CollapsingHeader("Shadow")) //, ImGuiTreeNodeFlags_DefaultOpen))
 	{
 		IndentFloat("Ray Shadow Offset", "##RayShadowOffset", &m_ui->shadowRayBias, 0.0000001f, 0.f, FLT_MAX, " % .8f");
+
+		//Shadow rays skip the blocks if the occupancy grid is empty along the ray
+		ImGui::Text("Occupancy Grid Steps:");
+		ImGui::Indent();
+		ImGui::SliderInt("##OccupancyMaxSteps", &m_ui->occupancyMaxSteps, 0, 256);
+		ImGui::Text("Grid Size: %.1f KB", double(m_renderer->GetOccupancyGridByteSize()) / 1024.0);
+		OccupancyGrid::TraceResult pick;
+		if (m_renderer->PickBlock(pick))
+			ImGui::Text("View Center Block: %d, %d, %d (%.1f, %u steps)", pick.cell.x, pick.cell.y, pick.cell.z, pick.t, pick.steps);
+		else
+			ImGui::Text("View Center Block: None");
+		ImGui::Unindent();
+	}
+
+	if (ImGui::CollapsingHeader("Block Editing"))
+	{
+		static int materialID = 0;
+		ImGui::Text("Material ID (0 - %d):", max(m_renderer->GetNumMaterials() - 1, 0));
+		ImGui::Indent();
+		ImGui::InputInt("##EditMaterialID", &materialID);
+		materialID = clamp(materialID, 0, max(m_renderer->GetNumMaterials() - 1, 0));
+		ImGui::Unindent();
+		if (ImGui::Button("Place"))
+			m_renderer->EditViewCenterBlock(Renderer::BlockEditAction::Place, materialID);
+		ImGui::SameLine();
+		if (ImGui::Button("Remove"))
+			m_renderer->EditViewCenterBlock(Renderer::BlockEditAction::Remove, materialID);
+		ImGui::SameLine();
+		if (ImGui::Button("Paint Face"))
+			m_renderer->EditViewCenterBlock(Renderer::BlockEditAction::PaintFace, materialID);
+
+		if (const BlockEditor* editor = m_renderer->GetBlockEditor()) {
+			const BlockEditor::Stats& stats = editor->GetStats();
+			ImGui::Text("Edits: %llu, Slots: %u used, %u free", (unsigned long long)stats.numEdits, stats.numUsedSlots, stats.numFreeSlots);
+		}
+		const Renderer::BlockEditLatency& latency = m_renderer->GetBlockEditLatency();
+		if (latency.numMeasured > 0) {
+			ImGui::Text("Latency: %.1f ms, %u frames (avg %.1f ms, max %.1f ms, %u frames)", latency.lastMs, latency.lastFrames,
+				latency.totalMs / latency.numMeasured, latency.maxMs, latency.maxFrames);
+		}
 	}
 
 	// End of window
@@ -15,6 +15,10 @@ public:
 	void buildUI() override;
 
 private:
+	//Scene name with infos from the scene index
+	std::string GetSceneLabel(int sceneIndex);
+	void ShowSceneTooltip(int sceneIndex);
+
 	UIData* m_ui;
 	Renderer* m_renderer;
 };
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "ResolutionScaleController.h"
+#include <algorithm>
+#include <cmath>
+
+void ResolutionScaleController::Reset(float scale)
+{
+	m_Scale = scale;
+	m_FilteredMs = 0.0;
+	m_NumSamples = 0;
+	m_InBudget = {};
+	m_NumInBudget = 0;
+	m_Stats = Stats();
+}
+
+float ResolutionScaleController::Quantize(float scale, const ResolutionScaleSettings& settings)
+{
+	float step = std::max(settings.scaleStep, 0.01f);
+	float minScale = std::max(std::ceil(settings.minScale / step - 1e-4f) * step, step);
+	float maxScale = std::max(std::floor(settings.maxScale / step + 1e-4f) * step, minScale);
+	return std::clamp(std::round(scale / step) * step, minScale, maxScale);
+}
+
+uint2 ResolutionScaleController::GetTraceResolution(uint2 displayResolution, float scale)
+{
+	return uint2(std::max(uint(float(displayResolution.x) * scale + 0.5f), 1u), std::max(uint(float(displayResolution.y) * scale + 0.5f), 1u));
+}
+
+bool ResolutionScaleController::Update(double frameMs, const ResolutionScaleSettings& settings)
+{
+	const double target = std::max(double(settings.targetFrameMs), 0.01);
+	const float step = std::max(settings.scaleStep, 0.01f);
+
+	bool inBudget = frameMs <= target;
+	size_t slot = m_Stats.measuredFrames % k_AdherenceWindow;
+	if (m_Stats.measuredFrames >= k_AdherenceWindow && m_InBudget[slot])
+		m_NumInBudget--;
+	m_InBudget[slot] = inBudget;
+	m_NumInBudget += inBudget ? 1 : 0;
+	m_Stats.measuredFrames++;
+	m_Stats.budgetAdherence = float(m_NumInBudget) / float(std::min<uint64_t>(m_Stats.measuredFrames, k_AdherenceWindow));
+
+	m_FilteredMs = m_NumSamples == 0 ? frameMs : m_FilteredMs + (frameMs - m_FilteredMs) * double(std::clamp(settings.smoothing, 0.f, 1.f));
+	m_NumSamples++;
+	m_Stats.filteredFrameMs = m_FilteredMs;
+
+	//Changed bounds apply right away
+	float newScale = Quantize(m_Scale, settings);
+	if (newScale == m_Scale && m_NumSamples >= std::max(settings.settleFrames, 1u)) {
+		if (m_FilteredMs > target * (1.0 + settings.hysteresis)) {
+			float fitScale = m_Scale * float(std::sqrt(target / m_FilteredMs));
+			newScale = Quantize(std::min(std::floor(fitScale / step) * step, m_Scale - step), settings);
+		}
+		else if (m_FilteredMs < target * (1.0 - settings.hysteresis)) {
+			float upScale = Quantize(m_Scale + step, settings);
+			double predictedMs = m_FilteredMs * double(upScale * upScale) / double(m_Scale * m_Scale);
+			if (predictedMs <= target)
+				newScale = upScale;
+		}
+	}
+
+	if (newScale == m_Scale)
+		return false;
+	m_Scale = newScale;
+	m_NumSamples = 0;
+	m_Stats.scaleChanges++;
+	return true;
+}
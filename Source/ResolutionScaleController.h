@@ -0,0 +1,55 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <array>
+
+using namespace donut::math;
+
+//Budget and bounds of the dynamic resolution
+struct ResolutionScaleSettings {
+	float targetFrameMs = 16.6f;		//Frame time budget of the measured work
+	float minScale = 0.5f;				//Bounds of the scale of the trace resolution per axis
+	float maxScale = 1.f;
+	float scaleStep = 0.125f;			//Scales are multiples of this, the render target is only recreated when the step changes
+	float hysteresis = 0.1f;			//Relative band around the target in which the scale is kept
+	float smoothing = 0.2f;				//Weight of a new measurement in the filtered frame time
+	uint settleFrames = 8;				//Measurements after a scale change before the next change
+};
+
+/* Feedback controller for the trace resolution, aiming for a frame time budget.
+   Measured frame times are filtered with an exponential moving average. The scale drops when the filtered time leaves the hysteresis band
+   above the target, directly to the step that is expected to fit the budget (the cost is assumed proportional to the pixel count).
+   It rises one step at a time, and only if the predicted time of the next step is within the budget, so the scale does not oscillate
+*/
+class ResolutionScaleController {
+public:
+	struct Stats {
+		double filteredFrameMs = 0.0;	//Filtered frame time at the current scale
+		float budgetAdherence = 1.f;	//Fraction of the last k_AdherenceWindow measured frames within the budget
+		uint64_t measuredFrames = 0;
+		uint64_t scaleChanges = 0;
+	};
+
+	static const uint k_AdherenceWindow = 120;
+
+	//Starts over at the given scale, usually the maximum
+	void Reset(float scale);
+
+	//Adds the frame time measured at the current scale. Returns true if the scale changed
+	bool Update(double frameMs, const ResolutionScaleSettings& settings);
+
+	float GetScale() const { return m_Scale; }
+	const Stats& GetStats() const { return m_Stats; }
+
+	//Resolution of the traced image for a display resolution, at least 1x1
+	static uint2 GetTraceResolution(uint2 displayResolution, float scale);
+	//Scale quantized to the step of the settings and clamped to their bounds
+	static float Quantize(float scale, const ResolutionScaleSettings& settings);
+
+private:
+	float m_Scale = 1.f;
+	double m_FilteredMs = 0.0;
+	uint m_NumSamples = 0;				//Measurements since the last scale change
+	std::array<bool, k_AdherenceWindow> m_InBudget = {};
+	uint m_NumInBudget = 0;
+	Stats m_Stats;
+};
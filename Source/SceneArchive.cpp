@@ -0,0 +1,769 @@
+#include "SceneArchive.h"
+#include "Deflate.h"
+#include "Inflate.h"
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+using namespace SceneArchive;
+
+static const char k_Magic[4] = { 'M', 'W', 'S', 'A' };
+static const uint32_t k_Version = 1;
+static const double k_BlockScale = 16.0;		//Block corners in 1/16 blocks
+static const double k_PositionScale = 256.0;	//Vertex positions in 1/256 blocks
+static const double k_UVScale = 4096.0;
+static const double k_MaxFixed = double(int64_t(1) << 40);
+
+//Chunk flags, set if the values are not exact in fixed point and stored as raw floats
+static const uint32_t k_RawBlocks = 1;			//BlockCells holds the AABBs, BlockSizes is empty
+static const uint32_t k_RawPositions = 2;
+static const uint32_t k_RawUVs = 4;
+
+namespace {
+	struct FileHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t numChunks;
+		uint32_t numMaterials;
+		uint64_t numBlocks;
+		uint64_t numVertices;
+		uint64_t numTriangles;
+		float boundsMin[3];
+		float boundsMax[3];
+		uint32_t chunkSize;
+		uint32_t materialsBytes;		//Compressed size of the material stream
+		uint32_t materialsRawBytes;
+		uint32_t materialsChecksum;		//Adler-32 of the compressed material stream
+		uint64_t materialsOffset;
+		uint64_t chunkTableOffset;
+	};
+
+	//Chunks follow each other in the file, the first block, vertex and triangle of a chunk are the sums over the previous chunks
+	struct ChunkEntry {
+		int32_t coord[3];				//In chunks
+		uint32_t flags;
+		uint32_t numBlocks;
+		uint32_t numVertices;
+		uint32_t numTriangles;
+		uint32_t checksum;				//Adler-32 of the compressed streams, DEFLATE has none
+		uint64_t offset;				//Of the first stream, the streams are stored in order
+		uint32_t streamBytes[NumStreams];
+		uint32_t streamRawBytes[NumStreams];
+	};
+
+	//Sequential reader of a decompressed stream. Reads past the end return zeros and mark the reader as failed
+	class StreamReader {
+	public:
+		StreamReader(const std::vector<uint8_t>& data) : m_Pos(data.data()), m_End(data.data() + data.size()) {}
+
+		uint64_t Varint() {
+			uint64_t value = 0;
+			for (unsigned shift = 0; shift < 64; shift += 7) {
+				if (m_Pos == m_End)
+					break;
+				uint8_t byte = *m_Pos++;
+				value |= uint64_t(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0)
+					return value;
+			}
+			m_Failed = true;
+			return 0;
+		}
+		int64_t SignedVarint() {
+			uint64_t value = Varint();
+			return int64_t(value >> 1) ^ -int64_t(value & 1);
+		}
+		//Returns the next n bytes, nullptr if the stream is too short
+		const uint8_t* Take(size_t n) {
+			if (size_t(m_End - m_Pos) < n) {
+				m_Failed = true;
+				return nullptr;
+			}
+			const uint8_t* data = m_Pos;
+			m_Pos += n;
+			return data;
+		}
+		bool IsValid() const { return !m_Failed; }
+		bool IsAtEnd() const { return m_Pos == m_End; }
+
+	private:
+		const uint8_t* m_Pos;
+		const uint8_t* m_End;
+		bool m_Failed = false;
+	};
+
+	//Serialization of the material fields, the same visit order for writing and reading
+	template<typename Visitor>
+	void VisitMaterial(tinyobj::material_t& material, Visitor& visitor) {
+		visitor.String(material.name);
+		visitor.Floats(material.ambient, 3);
+		visitor.Floats(material.diffuse, 3);
+		visitor.Floats(material.specular, 3);
+		visitor.Floats(material.transmittance, 3);
+		visitor.Floats(material.emission, 3);
+		visitor.Floats(&material.shininess, 1);
+		visitor.Floats(&material.ior, 1);
+		visitor.Floats(&material.dissolve, 1);
+		visitor.Int(material.illum);
+		visitor.Floats(&material.roughness, 1);
+		visitor.Floats(&material.metallic, 1);
+		for (std::string* texture : { &material.ambient_texname, &material.diffuse_texname, &material.specular_texname, &material.specular_highlight_texname,
+			&material.bump_texname, &material.displacement_texname, &material.alpha_texname, &material.reflection_texname, &material.roughness_texname,
+			&material.metallic_texname, &material.sheen_texname, &material.emissive_texname, &material.normal_texname })
+			visitor.String(*texture);
+	}
+}
+
+static_assert(sizeof(FileHeader) == 96, "The header layout is part of the file format");
+static_assert(sizeof(ChunkEntry) == 40 + 8 * NumStreams, "The chunk table layout is part of the file format");
+
+static void PutVarint(std::vector<uint8_t>& out, uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back(uint8_t(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back(uint8_t(value));
+}
+
+static void PutSignedVarint(std::vector<uint8_t>& out, int64_t value) {
+	PutVarint(out, (uint64_t(value) << 1) ^ uint64_t(value >> 63));
+}
+
+static void PutBytes(std::vector<uint8_t>& out, const void* data, size_t size) {
+	out.insert(out.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+}
+
+//Raw floats with byte k of every value stored together, the sign and exponent bytes of similar values compress well
+static void PutBytePlanes(std::vector<uint8_t>& out, const std::vector<float>& values) {
+	size_t start = out.size();
+	out.resize(start + values.size() * 4);
+	for (size_t i = 0; i < values.size(); i++) {
+		uint32_t bits;
+		memcpy(&bits, &values[i], 4);
+		for (size_t k = 0; k < 4; k++)
+			out[start + k * values.size() + i] = uint8_t(bits >> (8 * k));
+	}
+}
+
+static const uint8_t* TakeBytePlanes(StreamReader& reader, size_t count) {
+	return reader.Take(count * 4);
+}
+
+static float GetBytePlaneValue(const uint8_t* planes, size_t count, size_t i) {
+	uint32_t bits = uint32_t(planes[i]) | (uint32_t(planes[count + i]) << 8) | (uint32_t(planes[2 * count + i]) << 16) | (uint32_t(planes[3 * count + i]) << 24);
+	float value;
+	memcpy(&value, &bits, 4);
+	return value;
+}
+
+//Fixed point value if it is exact. Negative zero is not, so the raw fallback keeps it
+static bool ToFixed(float value, double scale, int64_t& fixed) {
+	double scaled = double(value) * scale;
+	if (!(std::abs(scaled) < k_MaxFixed) || scaled != std::floor(scaled) || (value == 0.f && std::signbit(value)))
+		return false;
+	fixed = int64_t(scaled);
+	return true;
+}
+
+static int32_t GetChunkCoord(float value) {
+	double chunk = std::floor(double(value) / double(k_ChunkSize));
+	return std::isnan(chunk) ? 0 : int32_t(std::clamp(chunk, -double(1 << 30), double(1 << 30)));
+}
+
+//Delta coded fixed point values relative to the origin, false if a value is not exact
+static bool PutFixedDeltas(std::vector<uint8_t>& out, const std::vector<float>& values, uint dimensions, double scale, const int64_t* origin) {
+	std::vector<uint8_t> encoded;
+	std::array<int64_t, 3> previous = { origin[0], origin[1], dimensions > 2 ? origin[2] : 0 };
+	for (size_t i = 0; i < values.size(); i++) {
+		int64_t fixed;
+		if (!ToFixed(values[i], scale, fixed))
+			return false;
+		uint d = uint(i % dimensions);
+		PutSignedVarint(encoded, fixed - previous[d]);
+		previous[d] = fixed;
+	}
+	out.insert(out.end(), encoded.begin(), encoded.end());
+	return true;
+}
+
+static void EncodeChunk(const Contents& contents, const int32_t coord[3], const std::vector<uint32_t>& blocks, const std::vector<uint32_t>& triangles,
+	ChunkEntry& entry, std::vector<uint8_t> (&streams)[NumStreams])
+{
+	entry = ChunkEntry();
+	memcpy(entry.coord, coord, sizeof(entry.coord));
+	entry.numBlocks = uint32_t(blocks.size());
+	entry.numTriangles = uint32_t(triangles.size());
+
+	//Blocks on the 1/16 grid are sorted by their cell, so the cell deltas are small
+	const int64_t cellsPerAxis = int64_t(k_ChunkSize) * int64_t(k_BlockScale);
+	struct Cell {
+		uint64_t key;
+		int64_t size[3];
+		uint32_t block;
+	};
+	std::vector<Cell> cells;
+	cells.reserve(blocks.size());
+	bool onGrid = true;
+	for (size_t b = 0; b < blocks.size() && onGrid; b++) {
+		const AABB& aabb = contents.aabbs[blocks[b]];
+		Cell cell = { 0, {}, blocks[b] };
+		int64_t local[3];
+		for (int axis = 0; axis < 3 && onGrid; axis++) {
+			int64_t minFixed, maxFixed;
+			onGrid = ToFixed(aabb.min[axis], k_BlockScale, minFixed) && ToFixed(aabb.max[axis], k_BlockScale, maxFixed);
+			local[axis] = minFixed - int64_t(coord[axis]) * cellsPerAxis;
+			onGrid = onGrid && local[axis] >= 0 && local[axis] < cellsPerAxis;
+			cell.size[axis] = maxFixed - minFixed;
+		}
+		if (onGrid) {
+			cell.key = (uint64_t(local[1]) * cellsPerAxis + uint64_t(local[2])) * cellsPerAxis + uint64_t(local[0]);
+			cells.push_back(cell);
+		}
+	}
+
+	std::vector<uint32_t> blockOrder;
+	blockOrder.reserve(blocks.size());
+	if (onGrid) {
+		std::stable_sort(cells.begin(), cells.end(), [](const Cell& a, const Cell& b) { return a.key < b.key; });
+		uint64_t previousKey = 0;
+		for (const Cell& cell : cells) {
+			PutVarint(streams[BlockCells], cell.key - previousKey);
+			previousKey = cell.key;
+			for (int axis = 0; axis < 3; axis++)
+				PutSignedVarint(streams[BlockSizes], cell.size[axis] - int64_t(k_BlockScale));
+			blockOrder.push_back(cell.block);
+		}
+	}
+	else {
+		entry.flags |= k_RawBlocks;
+		std::vector<float> values;
+		for (uint32_t block : blocks) {
+			const AABB& aabb = contents.aabbs[block];
+			values.insert(values.end(), { aabb.min.x, aabb.min.y, aabb.min.z, aabb.max.x, aabb.max.y, aabb.max.z });
+			blockOrder.push_back(block);
+		}
+		PutBytePlanes(streams[BlockCells], values);
+	}
+
+	//Faces mostly share the material of the first face, which in turn often matches the previous block
+	int64_t previousMaterial = 0;
+	for (uint32_t block : blockOrder) {
+		const AABBMaterials& m = contents.aabbMaterials[block];
+		const int faces[6] = { m.negXMatID, m.posXMatID, m.negZMatID, m.posZMatID, m.negYMatID, m.posYMatID };
+		PutSignedVarint(streams[BlockMaterials], faces[0] - previousMaterial);
+		for (int face = 1; face < 6; face++)
+			PutSignedVarint(streams[BlockMaterials], int64_t(faces[face]) - faces[0]);
+		previousMaterial = faces[0];
+	}
+
+	//Chunk local vertices in order of first use
+	std::unordered_map<uint32_t, uint32_t> localIndices;
+	std::vector<uint32_t> vertices;
+	int64_t previousIndex = 0, previousTriangleMaterial = 0;
+	for (uint32_t triangle : triangles) {
+		for (int k = 0; k < 3; k++) {
+			uint32_t vertex = contents.indices[size_t(triangle) * 3 + k];
+			auto [it, inserted] = localIndices.emplace(vertex, uint32_t(vertices.size()));
+			if (inserted)
+				vertices.push_back(vertex);
+			PutSignedVarint(streams[Indices], int64_t(it->second) - previousIndex);
+			previousIndex = it->second;
+		}
+		int material = contents.triangleMaterialIDs[triangle];
+		PutSignedVarint(streams[TriangleMaterials], material - previousTriangleMaterial);
+		previousTriangleMaterial = material;
+	}
+	entry.numVertices = uint32_t(vertices.size());
+
+	std::vector<float> positions, uvs;
+	positions.reserve(vertices.size() * 3);
+	uvs.reserve(vertices.size() * 2);
+	for (uint32_t vertex : vertices) {
+		const VertexData& data = contents.vertices[vertex];
+		positions.insert(positions.end(), { data.position.x, data.position.y, data.position.z });
+		uvs.insert(uvs.end(), { data.uvX, data.uvY });
+	}
+	const int64_t positionOrigin[3] = { int64_t(coord[0]) * int64_t(k_ChunkSize) * int64_t(k_PositionScale),
+		int64_t(coord[1]) * int64_t(k_ChunkSize) * int64_t(k_PositionScale), int64_t(coord[2]) * int64_t(k_ChunkSize) * int64_t(k_PositionScale) };
+	if (!PutFixedDeltas(streams[VertexPositions], positions, 3, k_PositionScale, positionOrigin)) {
+		entry.flags |= k_RawPositions;
+		PutBytePlanes(streams[VertexPositions], positions);
+	}
+	const int64_t uvOrigin[2] = { 0, 0 };
+	if (!PutFixedDeltas(streams[VertexUVs], uvs, 2, k_UVScale, uvOrigin)) {
+		entry.flags |= k_RawUVs;
+		PutBytePlanes(streams[VertexUVs], uvs);
+	}
+
+	//Palette of the distinct normals (by their bits), followed by the palette index of every vertex
+	std::map<std::array<uint32_t, 3>, uint32_t> palette;
+	std::vector<uint32_t> normalIndices;
+	std::vector<uint8_t> paletteBytes;
+	for (uint32_t vertex : vertices) {
+		std::array<uint32_t, 3> bits;
+		memcpy(bits.data(), &contents.vertices[vertex].normal, sizeof(bits));
+		auto [it, inserted] = palette.emplace(bits, uint32_t(palette.size()));
+		if (inserted)
+			PutBytes(paletteBytes, bits.data(), sizeof(bits));
+		normalIndices.push_back(it->second);
+	}
+	PutVarint(streams[VertexNormals], palette.size());
+	PutBytes(streams[VertexNormals], paletteBytes.data(), paletteBytes.size());
+	for (uint32_t index : normalIndices)
+		PutVarint(streams[VertexNormals], index);
+}
+
+//Decodes a chunk into the output arrays at the given offsets
+static bool DecodeChunk(const ChunkEntry& entry, const std::vector<uint8_t> (&streams)[NumStreams], uint64_t firstBlock, uint64_t firstVertex,
+	uint64_t firstTriangle, Contents& contents)
+{
+	StreamReader cells(streams[BlockCells]), sizes(streams[BlockSizes]), blockMaterials(streams[BlockMaterials]);
+	AABB* aabbs = contents.aabbs.data() + firstBlock;
+	if (entry.flags & k_RawBlocks) {
+		const uint8_t* planes = TakeBytePlanes(cells, size_t(entry.numBlocks) * 6);
+		if (!planes)
+			return false;
+		for (uint32_t b = 0; b < entry.numBlocks; b++) {
+			for (int axis = 0; axis < 3; axis++) {
+				aabbs[b].min[axis] = GetBytePlaneValue(planes, size_t(entry.numBlocks) * 6, size_t(b) * 6 + axis);
+				aabbs[b].max[axis] = GetBytePlaneValue(planes, size_t(entry.numBlocks) * 6, size_t(b) * 6 + 3 + axis);
+			}
+		}
+	}
+	else {
+		const uint64_t cellsPerAxis = uint64_t(k_ChunkSize) * uint64_t(k_BlockScale);
+		const int64_t origin[3] = { int64_t(entry.coord[0]) * int64_t(cellsPerAxis), int64_t(entry.coord[1]) * int64_t(cellsPerAxis),
+			int64_t(entry.coord[2]) * int64_t(cellsPerAxis) };
+		uint64_t key = 0;
+		for (uint32_t b = 0; b < entry.numBlocks; b++) {
+			key += cells.Varint();
+			const int64_t local[3] = { int64_t(key % cellsPerAxis), int64_t(key / (cellsPerAxis * cellsPerAxis)), int64_t((key / cellsPerAxis) % cellsPerAxis) };
+			for (int axis = 0; axis < 3; axis++) {
+				int64_t minFixed = origin[axis] + local[axis];
+				aabbs[b].min[axis] = float(double(minFixed) / k_BlockScale);
+				aabbs[b].max[axis] = float(double(minFixed + int64_t(k_BlockScale) + sizes.SignedVarint()) / k_BlockScale);
+			}
+		}
+	}
+	AABBMaterials* materials = contents.aabbMaterials.data() + firstBlock;
+	int64_t previousMaterial = 0;
+	for (uint32_t b = 0; b < entry.numBlocks; b++) {
+		int64_t first = previousMaterial + blockMaterials.SignedVarint();
+		int faces[6] = { int(first) };
+		for (int face = 1; face < 6; face++)
+			faces[face] = int(first + blockMaterials.SignedVarint());
+		materials[b] = { faces[0], faces[1], faces[2], faces[3], faces[4], faces[5], int2(0) };
+		previousMaterial = first;
+	}
+
+	StreamReader positions(streams[VertexPositions]), normals(streams[VertexNormals]), uvs(streams[VertexUVs]);
+	VertexData* vertices = contents.vertices.data() + firstVertex;
+	const size_t numVertices = entry.numVertices;
+	if (entry.flags & k_RawPositions) {
+		const uint8_t* planes = TakeBytePlanes(positions, numVertices * 3);
+		for (size_t v = 0; planes && v < numVertices; v++) {
+			for (int axis = 0; axis < 3; axis++)
+				vertices[v].position[axis] = GetBytePlaneValue(planes, numVertices * 3, v * 3 + axis);
+		}
+	}
+	else {
+		int64_t previous[3];
+		for (int axis = 0; axis < 3; axis++)
+			previous[axis] = int64_t(entry.coord[axis]) * int64_t(k_ChunkSize) * int64_t(k_PositionScale);
+		for (size_t v = 0; v < numVertices; v++) {
+			for (int axis = 0; axis < 3; axis++) {
+				previous[axis] += positions.SignedVarint();
+				vertices[v].position[axis] = float(double(previous[axis]) / k_PositionScale);
+			}
+		}
+	}
+	if (entry.flags & k_RawUVs) {
+		const uint8_t* planes = TakeBytePlanes(uvs, numVertices * 2);
+		for (size_t v = 0; planes && v < numVertices; v++) {
+			vertices[v].uvX = GetBytePlaneValue(planes, numVertices * 2, v * 2);
+			vertices[v].uvY = GetBytePlaneValue(planes, numVertices * 2, v * 2 + 1);
+		}
+	}
+	else {
+		int64_t previous[2] = { 0, 0 };
+		for (size_t v = 0; v < numVertices; v++) {
+			previous[0] += uvs.SignedVarint();
+			previous[1] += uvs.SignedVarint();
+			vertices[v].uvX = float(double(previous[0]) / k_UVScale);
+			vertices[v].uvY = float(double(previous[1]) / k_UVScale);
+		}
+	}
+	uint64_t paletteSize = normals.Varint();
+	if (paletteSize > numVertices)
+		return false;
+	const uint8_t* palette = normals.Take(size_t(paletteSize) * 12);
+	for (size_t v = 0; palette && v < numVertices; v++) {
+		uint64_t index = normals.Varint();
+		if (index >= paletteSize)
+			return false;
+		memcpy(&vertices[v].normal, palette + index * 12, 12);
+	}
+
+	StreamReader indices(streams[Indices]), triangleMaterials(streams[TriangleMaterials]);
+	uint* outIndices = contents.indices.data() + firstTriangle * 3;
+	int* outMaterials = contents.triangleMaterialIDs.data() + firstTriangle;
+	int64_t previousIndex = 0, previousTriangleMaterial = 0;
+	for (uint32_t t = 0; t < entry.numTriangles; t++) {
+		for (int k = 0; k < 3; k++) {
+			previousIndex += indices.SignedVarint();
+			if (previousIndex < 0 || uint64_t(previousIndex) >= numVertices)
+				return false;
+			outIndices[t * 3 + k] = uint(firstVertex + uint64_t(previousIndex));
+		}
+		previousTriangleMaterial += triangleMaterials.SignedVarint();
+		outMaterials[t] = int(previousTriangleMaterial);
+	}
+
+	//Every stream has to be consumed exactly
+	for (const StreamReader* reader : { &cells, &sizes, &blockMaterials, &positions, &normals, &uvs, &indices, &triangleMaterials }) {
+		if (!reader->IsValid() || !reader->IsAtEnd())
+			return false;
+	}
+	return true;
+}
+
+static bool ReadHeader(const uint8_t* data, size_t size, FileHeader& header) {
+	if (size < sizeof(FileHeader))
+		return false;
+	memcpy(&header, data, sizeof(FileHeader));
+	return memcmp(header.magic, k_Magic, sizeof(k_Magic)) == 0 && header.version == k_Version && header.chunkSize == k_ChunkSize;
+}
+
+static Info GetInfo(const FileHeader& header) {
+	Info info;
+	info.numChunks = header.numChunks;
+	info.numMaterials = header.numMaterials;
+	info.numBlocks = header.numBlocks;
+	info.numVertices = header.numVertices;
+	info.numTriangles = header.numTriangles;
+	memcpy(&info.boundsMin, header.boundsMin, sizeof(header.boundsMin));
+	memcpy(&info.boundsMax, header.boundsMax, sizeof(header.boundsMax));
+	return info;
+}
+
+//DEFLATE expands by at most 1032:1
+static uint64_t MaxInflatedBytes(uint64_t compressedBytes) {
+	return compressedBytes * 1032 + 16;
+}
+
+//Counts that fit the stream sizes, so corrupt counts can not make the output arrays arbitrarily large.
+//Every block has 6 material varints, every vertex a normal index and every triangle 3 index varints
+static bool IsPlausible(const ChunkEntry& entry) {
+	for (int s = 0; s < NumStreams; s++) {
+		if (entry.streamRawBytes[s] > MaxInflatedBytes(entry.streamBytes[s]))
+			return false;
+	}
+	return uint64_t(entry.numBlocks) * 6 <= entry.streamRawBytes[BlockMaterials] && entry.numVertices <= entry.streamRawBytes[VertexNormals]
+		&& uint64_t(entry.numTriangles) * 3 <= entry.streamRawBytes[Indices];
+}
+
+namespace SceneArchive {
+	bool Write(const std::filesystem::path& file, const Contents& contents, Stats* stats)
+	{
+		Stats localStats;
+		Stats& result = stats ? *stats : localStats;
+		result = Stats();
+		const size_t numTriangles = contents.triangleMaterialIDs.size();
+		if (contents.aabbMaterials.size() != contents.aabbs.size() || contents.indices.size() != numTriangles * 3)
+			return false;
+
+		//Chunks in the order of their coordinates, primitives keep their order within the chunk
+		std::map<std::tuple<int32_t, int32_t, int32_t>, std::pair<std::vector<uint32_t>, std::vector<uint32_t>>> chunkPrimitives;
+		for (size_t b = 0; b < contents.aabbs.size(); b++) {
+			const float3& corner = contents.aabbs[b].min;
+			chunkPrimitives[{ GetChunkCoord(corner.x), GetChunkCoord(corner.y), GetChunkCoord(corner.z) }].first.push_back(uint32_t(b));
+		}
+		for (size_t t = 0; t < numTriangles; t++) {
+			float3 centroid = float3(0.f);
+			for (int k = 0; k < 3; k++) {
+				uint vertex = contents.indices[t * 3 + k];
+				if (vertex >= contents.vertices.size())
+					return false;
+				centroid += contents.vertices[vertex].position / 3.f;
+			}
+			chunkPrimitives[{ GetChunkCoord(centroid.x), GetChunkCoord(centroid.y), GetChunkCoord(centroid.z) }].second.push_back(uint32_t(t));
+		}
+
+		std::vector<int32_t> coords;
+		std::vector<const std::pair<std::vector<uint32_t>, std::vector<uint32_t>>*> primitives;
+		for (const auto& [coord, chunk] : chunkPrimitives) {
+			coords.insert(coords.end(), { std::get<0>(coord), std::get<1>(coord), std::get<2>(coord) });
+			primitives.push_back(&chunk);
+		}
+
+		//Chunks are encoded and compressed in parallel, the payloads are kept in memory until the file is written
+		const size_t numChunks = primitives.size();
+		std::vector<ChunkEntry> entries(numChunks);
+		std::vector<std::vector<uint8_t>> payloads(numChunks);
+		TaskScheduler::Get().ParallelFor(0, numChunks, 1, [&](uint64_t begin, uint64_t end) {
+			for (uint64_t c = begin; c < end; c++) {
+				std::vector<uint8_t> streams[NumStreams];
+				EncodeChunk(contents, &coords[c * 3], primitives[c]->first, primitives[c]->second, entries[c], streams);
+				for (int s = 0; s < NumStreams; s++) {
+					size_t start = payloads[c].size();
+					Deflate::Raw(streams[s].data(), streams[s].size(), payloads[c]);
+					entries[c].streamBytes[s] = uint32_t(payloads[c].size() - start);
+					entries[c].streamRawBytes[s] = uint32_t(streams[s].size());
+				}
+			}
+		});
+
+		std::vector<uint8_t> materialData;
+		for (const tinyobj::material_t& source : contents.materials) {
+			struct Writer {
+				std::vector<uint8_t>& out;
+				void String(std::string& str) {
+					PutVarint(out, str.size());
+					PutBytes(out, str.data(), str.size());
+				}
+				void Floats(float* values, size_t count) { PutBytes(out, values, count * sizeof(float)); }
+				void Int(int& value) { PutSignedVarint(out, value); }
+			} writer = { materialData };
+			tinyobj::material_t material = source;
+			VisitMaterial(material, writer);
+		}
+		std::vector<uint8_t> materialBytes;
+		Deflate::Raw(materialData.data(), materialData.size(), materialBytes);
+
+		FileHeader header = {};
+		memcpy(header.magic, k_Magic, sizeof(k_Magic));
+		header.version = k_Version;
+		header.numChunks = uint32_t(numChunks);
+		header.numMaterials = uint32_t(contents.materials.size());
+		header.numBlocks = contents.aabbs.size();
+		header.numTriangles = numTriangles;
+		header.chunkSize = k_ChunkSize;
+		header.materialsBytes = uint32_t(materialBytes.size());
+		header.materialsRawBytes = uint32_t(materialData.size());
+		header.materialsChecksum = Deflate::Adler32(materialBytes.data(), materialBytes.size());
+		header.materialsOffset = sizeof(FileHeader);
+		header.chunkTableOffset = header.materialsOffset + materialBytes.size();
+		float3 boundsMin = float3(std::numeric_limits<float>::max()), boundsMax = float3(-std::numeric_limits<float>::max());
+		for (const AABB& aabb : contents.aabbs) {
+			boundsMin = min(boundsMin, aabb.min);
+			boundsMax = max(boundsMax, aabb.max);
+		}
+		for (const VertexData& vertex : contents.vertices) {
+			boundsMin = min(boundsMin, vertex.position);
+			boundsMax = max(boundsMax, vertex.position);
+		}
+		memcpy(header.boundsMin, &boundsMin, sizeof(header.boundsMin));
+		memcpy(header.boundsMax, &boundsMax, sizeof(header.boundsMax));
+
+		uint64_t offset = header.chunkTableOffset + numChunks * sizeof(ChunkEntry);
+		for (size_t c = 0; c < numChunks; c++) {
+			entries[c].offset = offset;
+			entries[c].checksum = Deflate::Adler32(payloads[c].data(), payloads[c].size());
+			offset += payloads[c].size();
+			header.numVertices += entries[c].numVertices;
+			for (int s = 0; s < NumStreams; s++) {
+				result.streamBytes[s] += entries[c].streamBytes[s];
+				result.streamRawBytes[s] += entries[c].streamRawBytes[s];
+			}
+		}
+
+		std::ofstream stream(file, std::ios::binary);
+		if (!stream)
+			return false;
+		stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		stream.write(reinterpret_cast<const char*>(materialBytes.data()), std::streamsize(materialBytes.size()));
+		stream.write(reinterpret_cast<const char*>(entries.data()), std::streamsize(entries.size() * sizeof(ChunkEntry)));
+		for (const std::vector<uint8_t>& payload : payloads)
+			stream.write(reinterpret_cast<const char*>(payload.data()), std::streamsize(payload.size()));
+		stream.close();
+		if (!stream)
+			return false;
+
+		//Vertices referenced from several chunks are stored once per chunk
+		std::vector<bool> referenced(contents.vertices.size(), false);
+		for (uint vertex : contents.indices)
+			referenced[vertex] = true;
+		result.numDuplicatedVertices = header.numVertices - uint64_t(std::count(referenced.begin(), referenced.end(), true));
+		result.info = { header.numChunks, header.numMaterials, header.numBlocks, header.numVertices, header.numTriangles, boundsMin, boundsMax };
+		result.fileBytes = offset;
+		result.decodedBytes = header.numBlocks * (sizeof(AABB) + sizeof(AABBMaterials)) + header.numVertices * sizeof(VertexData)
+			+ header.numTriangles * (3 * sizeof(uint) + sizeof(int));
+		return true;
+	}
+
+	bool Read(const std::filesystem::path& file, Contents& contents, Stats* stats, std::pmr::memory_resource* resource, const SceneRegion& region,
+		const ChunkFilter& chunkFilter)
+	{
+		Stats localStats;
+		Stats& result = stats ? *stats : localStats;
+		result = Stats();
+		contents = Contents();
+
+		auto readStart = std::chrono::high_resolution_clock::now();
+		std::ifstream stream(file, std::ios::binary | std::ios::ate);
+		if (!stream)
+			return false;
+		std::pmr::vector<uint8_t> data(size_t(stream.tellg()), resource);
+		stream.seekg(0);
+		stream.read(reinterpret_cast<char*>(data.data()), std::streamsize(data.size()));
+		if (!stream)
+			return false;
+		result.fileBytes = data.size();
+		auto decodeStart = std::chrono::high_resolution_clock::now();
+		result.readMs = std::chrono::duration<double, std::milli>(decodeStart - readStart).count();
+
+		FileHeader header;
+		if (!ReadHeader(data.data(), data.size(), header))
+			return false;
+		result.info = GetInfo(header);
+		if (header.materialsOffset + header.materialsBytes > data.size() || header.chunkTableOffset > data.size()
+			|| header.materialsRawBytes > MaxInflatedBytes(header.materialsBytes) || header.numMaterials > header.materialsRawBytes
+			|| uint64_t(header.numChunks) * sizeof(ChunkEntry) > data.size() - header.chunkTableOffset)
+			return false;
+		std::vector<ChunkEntry> entries(header.numChunks);
+		memcpy(entries.data(), data.data() + header.chunkTableOffset, entries.size() * sizeof(ChunkEntry));
+
+		//Output ranges of the chunks that overlap the region, the arrays are sized once and every chunk writes to its own range
+		std::vector<uint32_t> selected;
+		std::vector<std::array<uint64_t, 4>> firsts;	//First block, vertex and triangle, and the compressed size
+		uint64_t numBlocks = 0, numVertices = 0, numTriangles = 0;
+		uint64_t totalBlocks = 0, totalVertices = 0, totalTriangles = 0;
+		const bool everything = region.IsEverything();
+		selected.reserve(entries.size());
+		firsts.reserve(entries.size());
+		for (size_t c = 0; c < entries.size(); c++) {
+			const ChunkEntry& entry = entries[c];
+			uint64_t chunkBytes = 0;
+			for (int s = 0; s < NumStreams; s++)
+				chunkBytes += entry.streamBytes[s];
+			if (entry.offset > data.size() || chunkBytes > data.size() - entry.offset || !IsPlausible(entry))
+				return false;
+			totalBlocks += entry.numBlocks;
+			totalVertices += entry.numVertices;
+			totalTriangles += entry.numTriangles;
+
+			float3 chunkMin = float3(float(entry.coord[0]), float(entry.coord[1]), float(entry.coord[2])) * float(k_ChunkSize);
+			if (!everything && !region.Overlaps(chunkMin, chunkMin + float3(float(k_ChunkSize))))
+				continue;
+			if (chunkFilter && !chunkFilter(chunkMin))
+				continue;
+			selected.push_back(uint32_t(c));
+			firsts.push_back({ numBlocks, numVertices, numTriangles, chunkBytes });
+			numBlocks += entry.numBlocks;
+			numVertices += entry.numVertices;
+			numTriangles += entry.numTriangles;
+		}
+		if (totalBlocks != header.numBlocks || totalVertices != header.numVertices || totalTriangles != header.numTriangles || totalVertices > UINT32_MAX)
+			return false;
+		result.numDecodedChunks = uint(selected.size());
+		contents.aabbs.resize(numBlocks);
+		contents.aabbMaterials.resize(numBlocks);
+		contents.vertices.resize(numVertices);
+		contents.indices.resize(numTriangles * 3);
+		contents.triangleMaterialIDs.resize(numTriangles);
+
+		std::atomic<bool> failed = false;
+		TaskScheduler::Get().ParallelFor(0, selected.size(), 1, [&](uint64_t begin, uint64_t end) {
+			std::vector<uint8_t> streams[NumStreams];
+			for (uint64_t c = begin; c < end && !failed; c++) {
+				const ChunkEntry& entry = entries[selected[c]];
+				uint64_t offset = entry.offset;
+				if (Deflate::Adler32(data.data() + offset, firsts[c][3]) != entry.checksum) {
+					failed = true;
+					return;
+				}
+				for (int s = 0; s < NumStreams; s++) {
+					streams[s].clear();
+					streams[s].reserve(entry.streamRawBytes[s]);
+					if (!Inflate::Raw(data.data() + offset, entry.streamBytes[s], streams[s]) || streams[s].size() != entry.streamRawBytes[s]) {
+						failed = true;
+						return;
+					}
+					offset += entry.streamBytes[s];
+				}
+				if (!DecodeChunk(entry, streams, firsts[c][0], firsts[c][1], firsts[c][2], contents))
+					failed = true;
+			}
+		});
+		if (failed)
+			return false;
+
+		std::vector<uint8_t> materialData;
+		if (Deflate::Adler32(data.data() + header.materialsOffset, header.materialsBytes) != header.materialsChecksum)
+			return false;
+		if (!Inflate::Raw(data.data() + header.materialsOffset, header.materialsBytes, materialData) || materialData.size() != header.materialsRawBytes)
+			return false;
+		StreamReader materialReader(materialData);
+		struct Reader {
+			StreamReader& in;
+			void String(std::string& str) {
+				uint64_t length = in.Varint();
+				const uint8_t* chars = length < (uint64_t(1) << 20) ? in.Take(size_t(length)) : nullptr;
+				if (chars)
+					str.assign(reinterpret_cast<const char*>(chars), size_t(length));
+			}
+			void Floats(float* values, size_t count) {
+				if (const uint8_t* bytes = in.Take(count * sizeof(float)))
+					memcpy(values, bytes, count * sizeof(float));
+			}
+			void Int(int& value) { value = int(in.SignedVarint()); }
+		} reader = { materialReader };
+		contents.materials.resize(header.numMaterials);
+		for (tinyobj::material_t& material : contents.materials)
+			VisitMaterial(material, reader);
+		if (!materialReader.IsValid() || !materialReader.IsAtEnd())
+			return false;
+
+		for (int s = 0; s < NumStreams; s++) {
+			for (uint32_t c : selected) {
+				result.streamBytes[s] += entries[c].streamBytes[s];
+				result.streamRawBytes[s] += entries[c].streamRawBytes[s];
+			}
+		}
+		result.decodedBytes = numBlocks * (sizeof(AABB) + sizeof(AABBMaterials)) + numVertices * sizeof(VertexData) + numTriangles * (3 * sizeof(uint) + sizeof(int));
+		result.decodeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - decodeStart).count();
+		return true;
+	}
+
+	bool ReadInfo(const std::filesystem::path& file, Info& info)
+	{
+		std::ifstream stream(file, std::ios::binary);
+		uint8_t data[sizeof(FileHeader)];
+		if (!stream || !stream.read(reinterpret_cast<char*>(data), sizeof(data)))
+			return false;
+		FileHeader header;
+		if (!ReadHeader(data, sizeof(data), header))
+			return false;
+		info = GetInfo(header);
+		return true;
+	}
+
+	bool IsArchive(const std::filesystem::path& file)
+	{
+		return file.extension() == k_Extension;
+	}
+
+	const char* GetStreamName(Stream stream)
+	{
+		switch (stream) {
+		case BlockCells: return "blockCells";
+		case BlockSizes: return "blockSizes";
+		case BlockMaterials: return "blockMaterials";
+		case VertexPositions: return "vertexPositions";
+		case VertexNormals: return "vertexNormals";
+		case VertexUVs: return "vertexUVs";
+		case Indices: return "indices";
+		case TriangleMaterials: return "triangleMaterials";
+		default: return "";
+		}
+	}
+}
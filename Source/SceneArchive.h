@@ -0,0 +1,95 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <tiny_obj_loader.h>
+#include <filesystem>
+#include <functional>
+#include <memory_resource>
+#include <vector>
+#include "SceneRegion.h"
+
+using namespace donut::math;
+#include "sharedShaderData.h" //Needs namespace donut::math;
+
+/* Compressed binary scene archive (.mwa), a much smaller and faster to load replacement for the .obj and .mtl of a scene.
+   The geometry is split into independent spatial chunks of k_ChunkSize^3 blocks (blocks by their min corner, triangles by their centroid),
+   so the chunks decompress in parallel straight into their ranges of the output arrays. Every chunk stores its data in separate streams
+   (block cells, block sizes, block materials, vertex positions, normals and texture coordinates, indices and triangle materials):
+   - Block corners are integers in 1/16 blocks relative to the chunk. Blocks are sorted by cell and their cells are delta coded,
+     sizes and materials are stored as differences to a full block and to the neighboring face or block.
+   - Vertex positions and texture coordinates are delta coded fixed point values if they are exact, otherwise raw floats split into byte planes.
+     Normals are indices into a palette of the distinct normals of the chunk. Indices are chunk local and delta coded.
+   - Integers are zigzag varints, and each stream is entropy coded with DEFLATE (Deflate/Inflate).
+   The archive is lossless, except that the order of the blocks and triangles changes and vertices shared by triangles of different chunks
+   are duplicated. Materials are stored with the fields the loader uses, texture names stay relative to the scene folder.
+   Chunks and materials carry an Adler-32 of their compressed bytes. All values are little endian
+*/
+namespace SceneArchive {
+	static const char* const k_Extension = ".mwa";
+	static const uint k_ChunkSize = 32;		//Chunk edge length in blocks
+
+	enum Stream {
+		BlockCells,
+		BlockSizes,
+		BlockMaterials,
+		VertexPositions,
+		VertexNormals,
+		VertexUVs,
+		Indices,
+		TriangleMaterials,
+		NumStreams
+	};
+
+	//Geometry and materials of a scene, the same arrays as MinecraftSceneLoader keeps
+	struct Contents {
+		std::vector<AABB> aabbs;
+		std::vector<AABBMaterials> aabbMaterials;
+		std::vector<VertexData> vertices;
+		std::vector<uint> indices;
+		std::vector<int> triangleMaterialIDs;
+		std::vector<tinyobj::material_t> materials;
+	};
+
+	//Counts and bounds from the header, readable without decoding the archive
+	struct Info {
+		uint numChunks = 0;
+		uint numMaterials = 0;
+		uint64_t numBlocks = 0;
+		uint64_t numVertices = 0;
+		uint64_t numTriangles = 0;
+		float3 boundsMin = float3(0.f);
+		float3 boundsMax = float3(0.f);
+	};
+
+	struct Stats {
+		Info info;
+		uint64_t fileBytes = 0;
+		uint numDecodedChunks = 0;		//Chunks that overlap the region of Read
+		uint64_t decodedBytes = 0;		//Size of the decoded arrays in memory
+		uint64_t numDuplicatedVertices = 0;	//Vertices stored in more than one chunk, only known when writing
+		uint64_t streamBytes[NumStreams] = {};		//Compressed bytes per stream over all chunks
+		uint64_t streamRawBytes[NumStreams] = {};	//Bytes per stream before the entropy coding
+		double readMs = 0.0;			//Reading the file
+		double decodeMs = 0.0;			//Decompressing and decoding the chunks and materials
+	};
+
+	//Decides by the min corner of a chunk whether it is decoded
+	using ChunkFilter = std::function<bool(float3 chunkMin)>;
+
+	//Writes the contents as an archive. Returns false if the file could not be written
+	bool Write(const std::filesystem::path& file, const Contents& contents, Stats* stats = nullptr);
+
+	//Reads and decodes an archive with the TaskScheduler. The file data is allocated from the resource.
+	//Only the chunks that overlap the region and pass the filter are decoded, primitives of these chunks outside the region are not removed.
+	//The stream sizes and decodedBytes of the stats count the decoded chunks. Returns false if the file could not be read or is corrupt
+	bool Read(const std::filesystem::path& file, Contents& contents, Stats* stats = nullptr,
+		std::pmr::memory_resource* resource = std::pmr::get_default_resource(), const SceneRegion& region = SceneRegion(),
+		const ChunkFilter& chunkFilter = nullptr);
+
+	//Reads only the header
+	bool ReadInfo(const std::filesystem::path& file, Info& info);
+
+	//True if the file has the archive extension
+	bool IsArchive(const std::filesystem::path& file);
+
+	const char* GetStreamName(Stream stream);
+}
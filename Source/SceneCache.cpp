@@ -0,0 +1,119 @@
+#include "SceneCache.h"
+#include <donut/core/log.h>
+#include <unordered_set>
+
+using namespace donut;
+
+MinecraftSceneLoader* SceneCache::Acquire(const std::filesystem::path& scenePath, const std::string& sceneName, nvrhi::IDevice* device,
+	nvrhi::CommandListHandle commandList, std::shared_ptr<TextureCache>& pTextureCache, std::shared_ptr<DescriptorTableManager>& descriptorTable,
+	const TextureLoadSettings& textureSettings)
+{
+	//Hit, move to the front
+	for (auto it = m_Entries.begin(); it != m_Entries.end(); ++it) {
+		if (it->name == sceneName) {
+			m_Entries.splice(m_Entries.begin(), m_Entries, it);
+			m_Stats.hits++;
+			log::info("SceneCache: hit for %s (%u hits, %u misses, %u evictions)", sceneName.c_str(), m_Stats.hits, m_Stats.misses, m_Stats.evictions);
+			return m_Entries.front().scene.get();
+		}
+	}
+
+	//Miss, load the scene
+	m_Stats.misses++;
+	Entry entry;
+	entry.name = sceneName;
+	entry.scene = std::make_unique<MinecraftSceneLoader>(m_ShaderFactory);
+	if (!entry.scene->LoadScene(scenePath, sceneName, device, commandList, pTextureCache, descriptorTable, textureSettings)) {
+		//Do not reset the cache, other resident scenes might use the textures
+		entry.scene->UnloadScene(pTextureCache, false);
+		return nullptr;
+	}
+
+	//Reference the textures once per scene
+	std::unordered_set<LoadedTexture*> uniqueTextures;
+	for (const std::shared_ptr<LoadedTexture>& texture : entry.scene->GetCachedTextures()) {
+		if (texture && uniqueTextures.insert(texture.get()).second) {
+			entry.textures.push_back(texture);
+			m_TextureRefCounts[texture.get()]++;
+		}
+	}
+	entry.footprint = entry.scene->GetMemoryFootprint();
+
+	m_Entries.push_front(std::move(entry));
+	EnforceBudget(pTextureCache);
+	UpdateStats();
+
+	log::info("SceneCache: loaded %s (%u resident scenes, %.1f MB GPU, %.1f MB CPU)", sceneName.c_str(), m_Stats.residentScenes,
+		double(m_Stats.gpuBytes) / (1024.0 * 1024.0), double(m_Stats.cpuBytes) / (1024.0 * 1024.0));
+
+	return m_Entries.front().scene.get();
+}
+
+void SceneCache::SetBudget(size_t gpuBudgetBytes, size_t cpuBudgetBytes)
+{
+	m_GpuBudget = gpuBudgetBytes;
+	m_CpuBudget = cpuBudgetBytes;
+}
+
+bool SceneCache::Contains(const std::string& sceneName) const
+{
+	for (const Entry& entry : m_Entries) {
+		if (entry.name == sceneName)
+			return true;
+	}
+	return false;
+}
+
+void SceneCache::Clear(std::shared_ptr<TextureCache>& pTextureCache)
+{
+	for (Entry& entry : m_Entries)
+		UnloadEntry(entry, pTextureCache);
+	m_Entries.clear();
+	m_TextureRefCounts.clear();
+	UpdateStats();
+}
+
+void SceneCache::EnforceBudget(std::shared_ptr<TextureCache>& pTextureCache)
+{
+	UpdateStats();
+	//The most recently used scene always stays resident, even if it exceeds the budget on its own
+	while (m_Entries.size() > 1 && (m_Stats.gpuBytes > m_GpuBudget || m_Stats.cpuBytes > m_CpuBudget)) {
+		Entry& lru = m_Entries.back();
+		log::info("SceneCache: evicting %s", lru.name.c_str());
+		UnloadEntry(lru, pTextureCache);
+		m_Entries.pop_back();
+		m_Stats.evictions++;
+		UpdateStats();
+	}
+}
+
+void SceneCache::UnloadEntry(Entry& entry, std::shared_ptr<TextureCache>& pTextureCache)
+{
+	for (const std::shared_ptr<LoadedTexture>& texture : entry.textures) {
+		auto it = m_TextureRefCounts.find(texture.get());
+		if (it == m_TextureRefCounts.end())
+			continue;
+		if (--it->second == 0) {
+			m_TextureRefCounts.erase(it);
+			pTextureCache->UnloadTexture(texture);
+		}
+	}
+	entry.textures.clear();
+	entry.scene->UnloadScene(pTextureCache, false);
+}
+
+void SceneCache::UpdateStats()
+{
+	m_Stats.residentScenes = uint(m_Entries.size());
+	m_Stats.cpuBytes = 0;
+	m_Stats.gpuBytes = 0;
+	m_Stats.sharedTextureBytes = 0;
+	for (const Entry& entry : m_Entries) {
+		m_Stats.cpuBytes += entry.footprint.cpuBytes;
+		m_Stats.gpuBytes += entry.footprint.gpuBytes;
+	}
+	//Shared textures are counted once
+	for (const auto& texture : m_TextureRefCounts)
+		m_Stats.sharedTextureBytes += MinecraftSceneLoader::GetTextureByteSize(texture.first->texture);
+	m_Stats.gpuBytes += m_Stats.sharedTextureBytes;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "MinecraftSceneLoader.h"
+
+/* LRU cache of loaded scenes. Keeps several scenes resident (geometry, acceleration structures and textures) so that
+   switching back to a previous scene is instant. Scenes are evicted least recently used first once the GPU or CPU budget is exceeded.
+   Textures from the TextureCache are reference counted per scene and only unloaded once no resident scene uses them,
+   which shares them between scenes exported with the same resource pack.
+*/
+class SceneCache {
+public:
+	struct Stats {
+		uint hits = 0;				//Acquire calls served from the cache
+		uint misses = 0;			//Acquire calls that needed a full load
+		uint evictions = 0;			//Scenes removed due to the budget
+		uint residentScenes = 0;
+		size_t cpuBytes = 0;		//Resident CPU memory of all scenes
+		size_t gpuBytes = 0;		//Resident GPU memory of all scenes including shared textures
+		size_t sharedTextureBytes = 0;	//Part of gpuBytes used by textures from the TextureCache
+	};
+
+	SceneCache(std::shared_ptr<ShaderFactory> shaderFactory) : m_ShaderFactory(shaderFactory) {}
+
+	//Returns the scene and marks it as most recently used. Loads the scene if it is not resident. Returns nullptr if loading failed.
+	//textureSettings only apply to new loads, clear the cache when they change
+	MinecraftSceneLoader* Acquire(const std::filesystem::path& scenePath, const std::string& sceneName, nvrhi::IDevice* device,
+		nvrhi::CommandListHandle commandList, std::shared_ptr<TextureCache>& pTextureCache, std::shared_ptr<DescriptorTableManager>& descriptorTable,
+		const TextureLoadSettings& textureSettings = TextureLoadSettings());
+
+	//Sets the memory budgets in bytes. Evicts scenes on the next Acquire if they are exceeded
+	void SetBudget(size_t gpuBudgetBytes, size_t cpuBudgetBytes);
+
+	//True if the scene is resident
+	bool Contains(const std::string& sceneName) const;
+
+	//Unloads all scenes
+	void Clear(std::shared_ptr<TextureCache>& pTextureCache);
+
+	const Stats& GetStats() const { return m_Stats; }
+
+private:
+	struct Entry {
+		std::string name;
+		std::unique_ptr<MinecraftSceneLoader> scene;
+		MinecraftSceneLoader::MemoryFootprint footprint;
+		std::vector<std::shared_ptr<LoadedTexture>> textures;	//Unique cache textures used by the scene
+	};
+
+	//Evicts least recently used scenes (except the most recent one) until the budget is met
+	void EnforceBudget(std::shared_ptr<TextureCache>& pTextureCache);
+	//Unloads the scene and releases its textures if no other scene uses them
+	void UnloadEntry(Entry& entry, std::shared_ptr<TextureCache>& pTextureCache);
+	void UpdateStats();
+
+	std::shared_ptr<ShaderFactory> m_ShaderFactory;
+	std::list<Entry> m_Entries;		//Most recently used first
+
+	std::unordered_map<LoadedTexture*, uint> m_TextureRefCounts;	//Number of resident scenes per shared texture
+
+	size_t m_GpuBudget = size_t(4) << 30;
+	size_t m_CpuBudget = size_t(4) << 30;
+	Stats m_Stats;
+};
@@ -0,0 +1,413 @@
+#include "SceneIndex.h"
+#include "AnvilImporter.h"
+#include "PngReader.h"
+#include "SceneArchive.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <cfloat>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+using namespace donut;
+
+static const char* k_IndexFileHeader = "# Mineways Renderer scene index v1";
+//Size of the .obj sample that is used to extrapolate the block and triangle counts
+static const size_t k_ScanSampleBytes = 4 << 20;
+
+//GPU bytes per primitive, same values as MinecraftSceneLoader::GetMemoryFootprint uses (buffers + BLAS estimate)
+static const uint64_t k_GpuBytesPerBlock = 24 + 32 + 64;
+static const uint64_t k_GpuBytesPerTriangle = 3 * 4 + 4 + 32 + 64;
+//Imported blocks per chunk of a world folder, estimated for a typical overworld surface
+static const uint k_BlocksPerWorldChunk = 600;
+
+static bool GetFileInfo(const std::filesystem::path& file, uint64_t& size, int64_t& modifiedTime) {
+	std::error_code ec;
+	//World folders use the total size and the newest time of their region files
+	if (std::filesystem::is_directory(file, ec)) {
+		std::vector<AnvilImporter::RegionFile> regionFiles = AnvilImporter::FindRegionFiles(file);
+		size = 0;
+		modifiedTime = 0;
+		for (const AnvilImporter::RegionFile& regionFile : regionFiles) {
+			uint64_t regionSize = 0;
+			int64_t regionTime = 0;
+			if (!GetFileInfo(regionFile.path, regionSize, regionTime))
+				return false;
+			size += regionSize;
+			modifiedTime = std::max(modifiedTime, regionTime);
+		}
+		return !regionFiles.empty();
+	}
+	size = std::filesystem::file_size(file, ec);
+	if (ec)
+		return false;
+	auto time = std::filesystem::last_write_time(file, ec);
+	if (ec)
+		return false;
+	modifiedTime = int64_t(time.time_since_epoch().count());
+	return true;
+}
+
+//Reads width and height from the PNG IHDR chunk. Returns the RGBA8 size including mips or 0 if the file is not a PNG
+static uint64_t EstimatePngTextureBytes(const std::filesystem::path& file) {
+	std::ifstream stream(file, std::ios::binary);
+	unsigned char header[24];
+	if (!stream.read(reinterpret_cast<char*>(header), sizeof(header)))
+		return 0;
+	const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	if (!std::equal(signature, signature + 8, header))
+		return 0;
+	uint64_t width = (uint64_t(header[16]) << 24) | (header[17] << 16) | (header[18] << 8) | header[19];
+	uint64_t height = (uint64_t(header[20]) << 24) | (header[21] << 16) | (header[22] << 8) | header[23];
+	return width * height * 4 * 4 / 3;
+}
+
+static std::string Trim(const std::string& str) {
+	size_t begin = str.find_first_not_of(" \t\r\n");
+	if (begin == std::string::npos)
+		return "";
+	size_t end = str.find_last_not_of(" \t\r\n");
+	return str.substr(begin, end - begin + 1);
+}
+
+//Parses the .mtl for the material count and the referenced textures
+static void ScanMaterialFile(const std::filesystem::path& mtlFile, SceneIndexEntry& entry) {
+	std::ifstream stream(mtlFile);
+	if (!stream)
+		return;
+
+	std::set<std::string> textureFiles;
+	std::set<std::string> colorTextures;	//Diffuse and emissive textures, their average is the fallback of lazy texture loading
+	std::string line;
+	while (std::getline(stream, line)) {
+		line = Trim(line);
+		if (line.rfind("newmtl", 0) == 0) {
+			entry.numMaterials++;
+		}
+		else if (line.rfind("map_", 0) == 0 || line.rfind("norm ", 0) == 0 || line.rfind("bump ", 0) == 0) {
+			size_t split = line.find_first_of(" \t");
+			if (split != std::string::npos) {
+				std::string texture = Trim(line.substr(split));
+				textureFiles.insert(texture);
+				if (line.rfind("map_Kd", 0) == 0 || line.rfind("map_Ke", 0) == 0)
+					colorTextures.insert(texture);
+			}
+		}
+	}
+
+	std::set<std::string> textureSets;
+	for (const std::string& texture : textureFiles) {
+		std::filesystem::path texturePath = mtlFile.parent_path() / texture;
+		textureSets.insert(std::filesystem::path(texture).parent_path().generic_string());
+		entry.estimatedGpuBytes += EstimatePngTextureBytes(texturePath);
+		PngReader::Image image;
+		if (colorTextures.count(texture) > 0 && PngReader::Read(texturePath, image))
+			entry.textureColors[texture] = PngReader::ComputeAverageColor(image);
+	}
+	entry.textureSets.assign(textureSets.begin(), textureSets.end());
+}
+
+//Estimates a world folder from the chunk positions in the region headers
+static void ScanWorldFolder(const std::filesystem::path& sceneFolder, const std::string& worldName, SceneIndexEntry& entry) {
+	int2 spawn = int2(0);
+	AnvilImporter::Settings settings;
+	AnvilImporter::ReadSpawn(sceneFolder / worldName, spawn);
+	int2 minChunk = int2((spawn.x - settings.spawnRadius) >> 4, (spawn.y - settings.spawnRadius) >> 4);
+	int2 maxChunk = int2((spawn.x + settings.spawnRadius - 1) >> 4, (spawn.y + settings.spawnRadius - 1) >> 4);
+
+	//Bounds of the imported chunks relative to the volume center, like AnvilImporter::Import
+	float3 origin = float3(float(spawn.x), 0.f, float(spawn.y));
+	uint numChunks = 0;
+	entry.boundsMin = float3(FLT_MAX);
+	entry.boundsMax = float3(-FLT_MAX);
+	for (const AnvilImporter::RegionFile& regionFile : AnvilImporter::FindRegionFiles(sceneFolder / worldName)) {
+		for (int2 chunk : AnvilImporter::GetChunkPositions(regionFile)) {
+			if (chunk.x < minChunk.x || chunk.x > maxChunk.x || chunk.y < minChunk.y || chunk.y > maxChunk.y)
+				continue;
+			numChunks++;
+			entry.boundsMin = min(entry.boundsMin, float3(float(chunk.x * 16), float(settings.minBlock.y), float(chunk.y * 16)) - origin);
+			entry.boundsMax = max(entry.boundsMax, float3(float(chunk.x * 16 + 16), float(settings.maxBlock.y + 1), float(chunk.y * 16 + 16)) - origin);
+		}
+	}
+	if (numChunks == 0) {
+		entry.boundsMin = float3(0.f);
+		entry.boundsMax = float3(0.f);
+	}
+
+	//Roughly the exposed surface of a chunk, the hidden blocks below are not imported
+	entry.numBlocks = numChunks * k_BlocksPerWorldChunk;
+	std::string textureFolder = AnvilImporter::FindTextureFolder(sceneFolder, worldName);
+	if (!textureFolder.empty())
+		entry.textureSets.push_back(textureFolder);
+	entry.estimatedGpuBytes += entry.numBlocks * k_GpuBytesPerBlock;
+}
+
+//Counts and bounds of an archive are exact and in its header. Textures are not scanned, the loader averages them when needed
+static bool ScanArchive(const std::filesystem::path& archiveFile, SceneIndexEntry& entry) {
+	SceneArchive::Info info;
+	if (!SceneArchive::ReadInfo(archiveFile, info))
+		return false;
+	entry.numBlocks = uint(info.numBlocks);
+	entry.numTriangles = uint(info.numTriangles);
+	entry.numMaterials = info.numMaterials;
+	entry.boundsMin = info.boundsMin;
+	entry.boundsMax = info.boundsMax;
+	entry.estimatedGpuBytes += entry.numBlocks * k_GpuBytesPerBlock + entry.numTriangles * k_GpuBytesPerTriangle;
+	return true;
+}
+
+bool SceneIndex::ScanScene(const std::filesystem::path& sceneFolder, const std::string& sceneName, SceneIndexEntry& entry)
+{
+	entry = SceneIndexEntry();
+	entry.fileName = sceneName;
+	std::filesystem::path objFile = sceneFolder / sceneName;
+	if (!GetFileInfo(objFile, entry.fileSize, entry.modifiedTime))
+		return false;
+
+	std::error_code ec;
+	if (std::filesystem::is_directory(objFile, ec)) {
+		ScanWorldFolder(sceneFolder, sceneName, entry);
+		return true;
+	}
+	if (SceneArchive::IsArchive(objFile))
+		return ScanArchive(objFile, entry);
+
+	std::ifstream stream(objFile, std::ios::binary);
+	if (!stream)
+		return false;
+
+	//Only a sample at the start of the file is parsed, the counts are extrapolated by the file size
+	std::string sample(std::min<uint64_t>(entry.fileSize, k_ScanSampleBytes), '\0');
+	stream.read(&sample[0], sample.size());
+	sample.resize(size_t(stream.gcount()));
+
+	std::istringstream lines(sample);
+	std::string line;
+	std::string mtlLib;
+	bool headerBounds = false;
+	float3 sampleMin = float3(FLT_MAX);
+	float3 sampleMax = float3(-FLT_MAX);
+	uint sampleBlocks = 0;
+	uint sampleTriangles = 0;
+	uint groupTriangles = 0;
+	size_t parsedBytes = 0;
+	auto endGroup = [&]() {
+		//Same rule as MinecraftSceneLoader::AddGeometryToScene: blocks are groups of 12 triangles
+		if (groupTriangles == 12)
+			sampleBlocks++;
+		else
+			sampleTriangles += groupTriangles;
+		groupTriangles = 0;
+	};
+
+	while (std::getline(lines, line)) {
+		//The last line of the sample is most likely cut off
+		if (lines.eof() && sample.size() < entry.fileSize)
+			break;
+		parsedBytes += line.size() + 1;
+
+		if (line.size() < 2)
+			continue;
+		if (line[0] == '#') {
+			//Mineways header, e.g. "# Selection location min to max: -44, 62, -32 to 56, 255, 38"
+			size_t pos = line.find("location min to max:");
+			if (pos != std::string::npos && !headerBounds) {
+				int3 minPos, maxPos;
+				if (sscanf(line.c_str() + pos + 20, " %d, %d, %d to %d, %d, %d", &minPos.x, &minPos.y, &minPos.z, &maxPos.x, &maxPos.y, &maxPos.z) == 6) {
+					entry.boundsMin = float3(float(minPos.x), float(minPos.y), float(minPos.z));
+					entry.boundsMax = float3(float(maxPos.x + 1), float(maxPos.y + 1), float(maxPos.z + 1));
+					headerBounds = true;
+				}
+			}
+		}
+		else if (line[0] == 'v' && line[1] == ' ') {
+			float3 v;
+			if (sscanf(line.c_str() + 2, "%f %f %f", &v.x, &v.y, &v.z) == 3) {
+				sampleMin = min(sampleMin, v);
+				sampleMax = max(sampleMax, v);
+			}
+		}
+		else if (line[0] == 'f' && line[1] == ' ') {
+			//Triangulated face count of a polygon
+			uint numVertices = 0;
+			std::istringstream face(line.substr(2));
+			std::string vertex;
+			while (face >> vertex)
+				numVertices++;
+			if (numVertices >= 3)
+				groupTriangles += numVertices - 2;
+		}
+		else if ((line[0] == 'o' || line[0] == 'g') && line[1] == ' ') {
+			endGroup();
+		}
+		else if (line.rfind("mtllib ", 0) == 0) {
+			mtlLib = Trim(line.substr(7));
+		}
+	}
+	endGroup();
+
+	//Extrapolate the counts to the full file
+	double scale = parsedBytes > 0 ? double(entry.fileSize) / double(parsedBytes) : 1.0;
+	entry.numBlocks = uint(double(sampleBlocks) * scale);
+	entry.numTriangles = uint(double(sampleTriangles) * scale);
+	if (!headerBounds && sampleMin.x <= sampleMax.x) {
+		entry.boundsMin = sampleMin;
+		entry.boundsMax = sampleMax;
+	}
+
+	if (!mtlLib.empty())
+		ScanMaterialFile(sceneFolder / mtlLib, entry);
+	entry.estimatedGpuBytes += entry.numBlocks * k_GpuBytesPerBlock + entry.numTriangles * k_GpuBytesPerTriangle;
+
+	return true;
+}
+
+std::vector<SceneIndexEntry> SceneIndex::ScanScenes(const std::filesystem::path& sceneFolder, const std::vector<std::string>& sceneNames)
+{
+	std::vector<SceneIndexEntry> entries;
+	for (const std::string& sceneName : sceneNames) {
+		SceneIndexEntry entry;
+		if (ScanScene(sceneFolder, sceneName, entry))
+			entries.push_back(entry);
+	}
+	return entries;
+}
+
+std::vector<std::string> SceneIndex::GetOutdatedScenes(const std::filesystem::path& sceneFolder, const std::vector<std::string>& sceneNames) const
+{
+	std::vector<std::string> outdated;
+	for (const std::string& sceneName : sceneNames) {
+		uint64_t size = 0;
+		int64_t modifiedTime = 0;
+		GetFileInfo(sceneFolder / sceneName, size, modifiedTime);
+		const SceneIndexEntry* entry = Find(sceneName);
+		if (!entry || entry->fileSize != size || entry->modifiedTime != modifiedTime)
+			outdated.push_back(sceneName);
+	}
+	return outdated;
+}
+
+void SceneIndex::Merge(const std::vector<SceneIndexEntry>& entries)
+{
+	for (const SceneIndexEntry& entry : entries) {
+		auto it = std::find_if(m_Entries.begin(), m_Entries.end(), [&](const SceneIndexEntry& e) { return e.fileName == entry.fileName; });
+		//Never replace exact values with an estimate of the same file
+		bool keepExisting = it != m_Entries.end() && it->fromFullLoad && !entry.fromFullLoad &&
+			it->fileSize == entry.fileSize && it->modifiedTime == entry.modifiedTime;
+		if (keepExisting)
+			continue;
+		if (it != m_Entries.end())
+			*it = entry;
+		else
+			m_Entries.push_back(entry);
+	}
+}
+
+void SceneIndex::UpdateFromFullLoad(const std::filesystem::path& sceneFolder, SceneIndexEntry entry)
+{
+	GetFileInfo(sceneFolder / entry.fileName, entry.fileSize, entry.modifiedTime);
+	entry.fromFullLoad = true;
+	Merge({ entry });
+}
+
+const SceneIndexEntry* SceneIndex::Find(const std::string& sceneName) const
+{
+	for (const SceneIndexEntry& entry : m_Entries) {
+		if (entry.fileName == sceneName)
+			return &entry;
+	}
+	return nullptr;
+}
+
+bool SceneIndex::Load(const std::filesystem::path& indexFile)
+{
+	m_IndexFile = indexFile;
+	m_Entries.clear();
+
+	std::ifstream stream(indexFile);
+	std::string line;
+	if (!stream || !std::getline(stream, line) || Trim(line) != k_IndexFileHeader)
+		return false;
+
+	SceneIndexEntry entry;
+	bool inEntry = false;
+	try {
+		while (std::getline(stream, line)) {
+			line = Trim(line);
+			size_t split = line.find('=');
+			std::string key = line.substr(0, split);
+			std::string value = split != std::string::npos ? line.substr(split + 1) : "";
+
+			if (key == "scene") {
+				entry = SceneIndexEntry();
+				entry.fileName = value;
+				inEntry = true;
+			}
+			else if (!inEntry) {
+				continue;
+			}
+			else if (key == "end") {
+				m_Entries.push_back(entry);
+				inEntry = false;
+			}
+			else if (key == "size") entry.fileSize = std::stoull(value);
+			else if (key == "mtime") entry.modifiedTime = std::stoll(value);
+			else if (key == "fullLoad") entry.fromFullLoad = value == "1";
+			else if (key == "blocks") entry.numBlocks = uint(std::stoul(value));
+			else if (key == "triangles") entry.numTriangles = uint(std::stoul(value));
+			else if (key == "materials") entry.numMaterials = uint(std::stoul(value));
+			else if (key == "gpuBytes") entry.estimatedGpuBytes = std::stoull(value);
+			else if (key == "bounds") {
+				sscanf(value.c_str(), "%f %f %f %f %f %f", &entry.boundsMin.x, &entry.boundsMin.y, &entry.boundsMin.z,
+					&entry.boundsMax.x, &entry.boundsMax.y, &entry.boundsMax.z);
+			}
+			else if (key == "textureSet") entry.textureSets.push_back(value);
+			else if (key == "textureColor") {
+				//"r g b a name", the name can contain spaces
+				float4 color;
+				int nameOffset = 0;
+				if (sscanf(value.c_str(), "%f %f %f %f %n", &color.x, &color.y, &color.z, &color.w, &nameOffset) == 4 && nameOffset > 0)
+					entry.textureColors[value.substr(nameOffset)] = color;
+			}
+		}
+	}
+	catch (const std::exception&) {
+		log::warning("SceneIndex: %s is corrupt and will be rebuilt", indexFile.string().c_str());
+		m_Entries.clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool SceneIndex::Save() const
+{
+	if (m_IndexFile.empty())
+		return false;
+
+	std::ofstream stream(m_IndexFile);
+	if (!stream) {
+		log::warning("SceneIndex: could not write %s", m_IndexFile.string().c_str());
+		return false;
+	}
+
+	stream << k_IndexFileHeader << "\n";
+	for (const SceneIndexEntry& entry : m_Entries) {
+		stream << "scene=" << entry.fileName << "\n";
+		stream << "size=" << entry.fileSize << "\n";
+		stream << "mtime=" << entry.modifiedTime << "\n";
+		stream << "fullLoad=" << (entry.fromFullLoad ? 1 : 0) << "\n";
+		stream << "blocks=" << entry.numBlocks << "\n";
+		stream << "triangles=" << entry.numTriangles << "\n";
+		stream << "materials=" << entry.numMaterials << "\n";
+		stream << "gpuBytes=" << entry.estimatedGpuBytes << "\n";
+		stream << "bounds=" << entry.boundsMin.x << " " << entry.boundsMin.y << " " << entry.boundsMin.z << " "
+			<< entry.boundsMax.x << " " << entry.boundsMax.y << " " << entry.boundsMax.z << "\n";
+		for (const std::string& textureSet : entry.textureSets)
+			stream << "textureSet=" << textureSet << "\n";
+		for (const auto& [texture, color] : entry.textureColors)
+			stream << "textureColor=" << color.x << " " << color.y << " " << color.z << " " << color.w << " " << texture << "\n";
+		stream << "end\n";
+	}
+	return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace donut::math;
+
+//Lightweight description of a scene that can be shown without loading it
+struct SceneIndexEntry {
+	std::string fileName;					//.obj file or world folder name inside the scene folder
+	uint64_t fileSize = 0;
+	int64_t modifiedTime = 0;				//Raw file time, used to detect outdated entries
+	bool fromFullLoad = false;				//True if the values come from a full load, otherwise they are estimated by a scan
+
+	uint numBlocks = 0;
+	uint numTriangles = 0;
+	uint numMaterials = 0;
+	float3 boundsMin = float3(0.f);
+	float3 boundsMax = float3(0.f);
+	std::vector<std::string> textureSets;	//Texture folders referenced by the .mtl
+	std::map<std::string, float4> textureColors;	//Average linear color and coverage of the diffuse and emissive textures, by their name in the .mtl
+	uint64_t estimatedGpuBytes = 0;
+};
+
+/* On-disk index of the available scenes (SceneIndex.txt in the scene folder).
+   Entries are filled by a fast scan that only reads the Mineways header, a small sample of the .obj, the .mtl and the textures
+   (only the PNG headers, except for the diffuse and emissive textures which are averaged for lazy texture loading), and are replaced with exact values after a scene was fully loaded
+*/
+class SceneIndex {
+public:
+	//Reads the index file. Returns false if it does not exist or is invalid
+	bool Load(const std::filesystem::path& indexFile);
+	bool Save() const;
+
+	//Returns all scenes of the list whose entry is missing or outdated (size or modification time changed)
+	std::vector<std::string> GetOutdatedScenes(const std::filesystem::path& sceneFolder, const std::vector<std::string>& sceneNames) const;
+
+	//Scans the given scenes. Does not touch the index and can therefore run on another thread
+	static std::vector<SceneIndexEntry> ScanScenes(const std::filesystem::path& sceneFolder, const std::vector<std::string>& sceneNames);
+	//Estimates the entry from the Mineways header, a sample of the .obj and the .mtl. Archives and world folders are read from their headers
+	static bool ScanScene(const std::filesystem::path& sceneFolder, const std::string& sceneName, SceneIndexEntry& entry);
+
+	//Adds or replaces entries
+	void Merge(const std::vector<SceneIndexEntry>& entries);
+	//Adds or replaces the entry with exact values from a full load. File size and time are filled in
+	void UpdateFromFullLoad(const std::filesystem::path& sceneFolder, SceneIndexEntry entry);
+
+	const SceneIndexEntry* Find(const std::string& sceneName) const;
+
+private:
+	std::filesystem::path m_IndexFile;
+	std::vector<SceneIndexEntry> m_Entries;
+};
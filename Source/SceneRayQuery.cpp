@@ -0,0 +1,171 @@
+#include "SceneRayQuery.h"
+#include "MinecraftSceneLoader.h"
+#include "PngReader.h"
+#include "TaskScheduler.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+using namespace donut;
+
+void SceneRayQuery::Build(const MinecraftSceneLoader& scene, const std::filesystem::path& sceneFolder)
+{
+	Clear();
+	m_Tracer.Build(scene.GetAABBs(), scene.GetAABBMaterials(), scene.GetVertices(), scene.GetIndices(), scene.GetTriangleMaterialIDs());
+
+	//Alpha masks, decoded once per texture
+	const std::vector<Material>& materials = scene.GetMaterials();
+	const std::vector<std::string>& alphaTextures = scene.GetAlphaTestTextures();
+	std::unordered_map<std::string, int> maskIndices;
+	std::vector<std::string> maskTextures;
+	m_MaterialAlphaMasks.assign(materials.size(), -1);
+	m_AlphaCutoffs.assign(materials.size(), 0.f);
+	for (size_t i = 0; i < materials.size() && i < alphaTextures.size(); i++) {
+		if (alphaTextures[i].empty())
+			continue;
+		auto [it, inserted] = maskIndices.emplace(alphaTextures[i], int(maskTextures.size()));
+		if (inserted)
+			maskTextures.push_back(alphaTextures[i]);
+		m_MaterialAlphaMasks[i] = it->second;
+		m_AlphaCutoffs[i] = materials[i].alphaCutoff;
+	}
+
+	m_AlphaMasks.resize(maskTextures.size());
+	std::atomic<uint> numFailed = 0;
+	TaskScheduler::Get().ParallelFor(0, maskTextures.size(), 1, [&](uint64_t begin, uint64_t end) {
+		for (uint64_t i = begin; i < end; i++) {
+			PngReader::Image image;
+			if (!PngReader::Read(sceneFolder / maskTextures[i], image)) {
+				numFailed++;
+				continue;
+			}
+			AlphaMask& mask = m_AlphaMasks[i];
+			mask.width = image.width;
+			mask.height = image.height;
+			mask.alpha.resize(size_t(image.width) * image.height);
+			for (size_t texel = 0; texel < mask.alpha.size(); texel++)
+				mask.alpha[texel] = image.rgba[texel * 4 + 3];
+		}
+	});
+	//Materials whose texture could not be read are opaque, like materials without a texture in the shader
+	if (numFailed > 0)
+		log::warning("SceneRayQuery: %u alpha textures could not be read and are treated as opaque", numFailed.load());
+
+	std::vector<bool> alphaTested(materials.size());
+	for (size_t i = 0; i < materials.size(); i++)
+		alphaTested[i] = m_MaterialAlphaMasks[i] >= 0 && !m_AlphaMasks[m_MaterialAlphaMasks[i]].alpha.empty();
+	m_Tracer.SetAlphaTest(std::move(alphaTested), [this](int materialID, float2 uv) { return IsOpaque(materialID, uv); });
+
+	m_Built = true;
+	log::info("SceneRayQuery: BVH built in %.1f ms, %zu alpha masks", m_Tracer.GetBvh().GetBuildTimeMs(), m_AlphaMasks.size());
+}
+
+void SceneRayQuery::Clear()
+{
+	m_Tracer = CpuRayTracer();
+	m_AlphaMasks.clear();
+	m_MaterialAlphaMasks.clear();
+	m_AlphaCutoffs.clear();
+	m_Built = false;
+	ResetStats();
+}
+
+bool SceneRayQuery::IsOpaque(int materialID, float2 uv) const
+{
+	const AlphaMask& mask = m_AlphaMasks[m_MaterialAlphaMasks[materialID]];
+	//Point sampling with clamping, as the material sampler of the shader
+	int x = clamp(int(std::floor(uv.x * float(mask.width))), 0, int(mask.width) - 1);
+	int y = clamp(int(std::floor(uv.y * float(mask.height))), 0, int(mask.height) - 1);
+	return float(mask.alpha[size_t(y) * mask.width + x]) / 255.f >= m_AlphaCutoffs[materialID];
+}
+
+SceneRayQuery::Stats SceneRayQuery::TraceClosest(const CpuRay* rays, CpuHit* hits, size_t numRays) const
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	std::atomic<uint64_t> numHits = 0;
+	TaskScheduler::Get().ParallelFor(0, numRays, k_BatchGrainSize, [&](uint64_t begin, uint64_t end) {
+		uint64_t rangeHits = 0;
+		//Coherent packets (e.g. rays of a view) are traced together, the tracer falls back to single rays otherwise
+		for (uint64_t first = begin; first < end; first += CpuRayTracer::k_PacketSize) {
+			uint count = uint(std::min<uint64_t>(end - first, CpuRayTracer::k_PacketSize));
+			m_Tracer.TracePacket(rays + first, hits + first, count);
+			for (uint i = 0; i < count; i++)
+				rangeHits += hits[first + i].hitType != k_CpuHitTypeMiss ? 1 : 0;
+		}
+		numHits += rangeHits;
+	});
+
+	Stats stats;
+	stats.numBatches = 1;
+	stats.numRays = numRays;
+	stats.numHits = numHits;
+	stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	AddStats(stats);
+	return stats;
+}
+
+SceneRayQuery::Stats SceneRayQuery::TraceAny(const CpuRay* rays, uint8_t* occluded, size_t numRays) const
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	std::atomic<uint64_t> numHits = 0;
+	TaskScheduler::Get().ParallelFor(0, numRays, k_BatchGrainSize, [&](uint64_t begin, uint64_t end) {
+		uint64_t rangeHits = 0;
+		bool active[CpuRayTracer::k_PacketSize];
+		bool packetOccluded[CpuRayTracer::k_PacketSize];
+		std::fill(active, active + CpuRayTracer::k_PacketSize, true);
+		for (uint64_t first = begin; first < end; first += CpuRayTracer::k_PacketSize) {
+			uint count = uint(std::min<uint64_t>(end - first, CpuRayTracer::k_PacketSize));
+			m_Tracer.TraceShadowPacket(rays + first, active, packetOccluded, count);
+			for (uint i = 0; i < count; i++) {
+				occluded[first + i] = packetOccluded[i] ? 1 : 0;
+				rangeHits += packetOccluded[i] ? 1 : 0;
+			}
+		}
+		numHits += rangeHits;
+	});
+
+	Stats stats;
+	stats.numBatches = 1;
+	stats.numRays = numRays;
+	stats.numHits = numHits;
+	stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	AddStats(stats);
+	return stats;
+}
+
+bool SceneRayQuery::TraceClosest(const CpuRay& ray, CpuHit& hit) const
+{
+	return m_Tracer.TraceRay(ray, hit);
+}
+
+bool SceneRayQuery::TraceAny(const CpuRay& ray) const
+{
+	return m_Tracer.TraceShadowRay(ray);
+}
+
+SceneRayQuery::Stats SceneRayQuery::GetStats() const
+{
+	Stats stats;
+	stats.numBatches = m_TotalBatches.load(std::memory_order_relaxed);
+	stats.numRays = m_TotalRays.load(std::memory_order_relaxed);
+	stats.numHits = m_TotalHits.load(std::memory_order_relaxed);
+	stats.milliseconds = double(m_TotalNanoseconds.load(std::memory_order_relaxed)) * 1e-6;
+	return stats;
+}
+
+void SceneRayQuery::ResetStats()
+{
+	m_TotalBatches = 0;
+	m_TotalRays = 0;
+	m_TotalHits = 0;
+	m_TotalNanoseconds = 0;
+}
+
+void SceneRayQuery::AddStats(const Stats& stats) const
+{
+	m_TotalBatches.fetch_add(stats.numBatches, std::memory_order_relaxed);
+	m_TotalRays.fetch_add(stats.numRays, std::memory_order_relaxed);
+	m_TotalHits.fetch_add(stats.numHits, std::memory_order_relaxed);
+	m_TotalNanoseconds.fetch_add(uint64_t(stats.milliseconds * 1e6), std::memory_order_relaxed);
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "CpuRayTracer.h"
+
+using namespace donut::math;
+
+class MinecraftSceneLoader;
+
+/* Batched ray queries against a loaded scene on the CPU, for picking, line of sight checks and tools.
+   Wraps a CpuRayTracer over the CPU copies of the scene geometry and applies the alpha test of the shader (AABBAlphaTest/TriangleAlphaTest):
+   alpha tested materials are opaque where the alpha of their diffuse texture, point sampled with clamping, is at least the alpha cutoff.
+   The alpha channels are decoded from the PNGs, so the result does not depend on lazy textures being resident.
+   Build is not thread-safe; once built, all queries are const and can be called from any number of threads.
+   The scene needs to stay loaded while the query is used
+*/
+class SceneRayQuery {
+public:
+	//Rays per task of a batch, batches are split into packets for the CpuRayTracer
+	static const uint64_t k_BatchGrainSize = 1024;
+
+	//Timing of a batch, or the totals of all batches
+	struct Stats {
+		uint64_t numBatches = 0;
+		uint64_t numRays = 0;
+		uint64_t numHits = 0;
+		double milliseconds = 0.0;
+
+		double GetMraysPerSecond() const { return milliseconds > 0.0 ? double(numRays) / (milliseconds * 1e3) : 0.0; }
+	};
+
+	//Builds the BVH over the scene geometry and decodes the alpha masks of the alpha tested materials from sceneFolder
+	void Build(const MinecraftSceneLoader& scene, const std::filesystem::path& sceneFolder);
+	void Clear();
+	bool IsBuilt() const { return m_Built; }
+
+	//Closest hits, hits[i] has the material (matID), the face of blocks and the distance of rays[i]. Rays are traced in parallel
+	Stats TraceClosest(const CpuRay* rays, CpuHit* hits, size_t numRays) const;
+	//Any opaque hit, occluded[i] is 1 if rays[i] hits an opaque surface within [tMin, tMax]
+	Stats TraceAny(const CpuRay* rays, uint8_t* occluded, size_t numRays) const;
+
+	//Single ray variants, traced on the calling thread
+	bool TraceClosest(const CpuRay& ray, CpuHit& hit) const;
+	bool TraceAny(const CpuRay& ray) const;
+
+	//Totals over all batches since Build
+	Stats GetStats() const;
+	void ResetStats();
+
+	const CpuRayTracer& GetTracer() const { return m_Tracer; }
+
+private:
+	//Alpha channel of a diffuse texture
+	struct AlphaMask {
+		uint width = 0;
+		uint height = 0;
+		std::vector<uint8_t> alpha;
+	};
+
+	bool IsOpaque(int materialID, float2 uv) const;
+	void AddStats(const Stats& stats) const;
+
+	CpuRayTracer m_Tracer;
+	std::vector<AlphaMask> m_AlphaMasks;
+	std::vector<int> m_MaterialAlphaMasks;	//Index into m_AlphaMasks per material, -1 if opaque
+	std::vector<float> m_AlphaCutoffs;		//Per material
+	bool m_Built = false;
+
+	mutable std::atomic<uint64_t> m_TotalBatches = 0;
+	mutable std::atomic<uint64_t> m_TotalRays = 0;
+	mutable std::atomic<uint64_t> m_TotalHits = 0;
+	mutable std::atomic<uint64_t> m_TotalNanoseconds = 0;
+};
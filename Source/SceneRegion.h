@@ -0,0 +1,21 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <limits>
+
+using namespace donut::math;
+
+/* Part of a scene to load, e.g. the slab of one process of a sharded render (see ShardedRenderer).
+   Blocks belong to the region of their min corner and triangles to the region of their centroid, the same assignment as the
+   chunks of a scene archive, so regions that share a boundary plane divide a scene without overlap. The bounds are [min, max)
+*/
+struct SceneRegion {
+	float3 min = float3(-std::numeric_limits<float>::infinity());
+	float3 max = float3(std::numeric_limits<float>::infinity());
+
+	bool IsEverything() const {
+		return all(min == float3(-std::numeric_limits<float>::infinity())) && all(max == float3(std::numeric_limits<float>::infinity()));
+	}
+	bool Contains(float3 point) const { return all(point >= min) && all(point < max); }
+	//True if the box [boxMin, boxMax) overlaps the region
+	bool Overlaps(float3 boxMin, float3 boxMax) const { return all(boxMin < max) && all(boxMax > min); }
+};
@@ -0,0 +1,553 @@
+#include "ShardedRenderer.h"
+#include "AnvilImporter.h"
+#include "BatchJobs.h"
+#include "BenchmarkReport.h"
+#include "CpuRenderer.h"
+#include "MinecraftSceneLoader.h"
+#include "PngWriter.h"
+#include "ProcessUtils.h"
+#include "Renderer.h"
+#include "SceneArchive.h"
+#include "SceneIndex.h"
+#include "TaskScheduler.h"
+#include <donut/app/Camera.h>
+#include <donut/core/log.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <initializer_list>
+#include <sstream>
+#include <thread>
+
+using namespace donut;
+
+namespace {
+	//What a worker reports after loading its region and again after its last frame
+	struct ShardStats {
+		bool loaded = false;
+		uint64_t numBlocks = 0;
+		uint64_t numTriangles = 0;
+		uint64_t sceneBytes = 0;		//Geometry, materials and BVH of the region
+		uint64_t peakBytes = 0;			//Peak resident memory of the worker process
+		double loadMs = 0.0;			//Scene load and CPU renderer build
+		double primaryMs = 0.0;			//Primary rays and shading of all frames
+		double shadowMs = 0.0;			//Shadow rays of all frames
+		uint numFrames = 0;
+	};
+
+	struct ShardResult {
+		SceneRegion region;
+		ShardStats stats;
+	};
+
+	struct JobResult {
+		int axis = 0;					//Axis the slabs are cut along
+		std::vector<ShardResult> shards;
+		std::vector<double> frameMs;	//Between finished frames, the first one from the end of the loads. Failed frames are missing
+		std::vector<double> compositeMs;
+		double renderSeconds = 0.0;		//From the end of the loads to the last frame
+	};
+
+	struct RunResult {
+		uint numShards = 0;
+		uint threadsPerShard = 0;
+		double wallSeconds = 0.0;
+		std::vector<JobResult> jobs;
+	};
+}
+
+//Files are written to .part first and renamed when complete. The coordinator creates the abort file to stop the workers
+static const char* k_PartExtension = ".part";
+static const char* k_AbortFile = "abort";
+//Workers give up waiting for the coordinator after this time, e.g. if it was killed
+static const double k_ExchangeTimeoutSeconds = 3600.0;
+
+static std::string GetStatsName(uint shard, bool finished)
+{
+	return "shard" + std::to_string(shard) + (finished ? ".done" : ".loaded");
+}
+
+static std::string GetLayersName(uint shard, uint frame)
+{
+	return "shard" + std::to_string(shard) + "_frame" + std::to_string(frame) + ".layers";
+}
+
+static std::string GetOcclusionName(uint shard, uint frame)
+{
+	return "shard" + std::to_string(shard) + "_frame" + std::to_string(frame) + ".occlusion";
+}
+
+static std::string GetShadowName(uint frame)
+{
+	return "frame" + std::to_string(frame) + ".shadow";
+}
+
+static double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+//Writes the parts one after another into a file that appears under its name once it is complete
+static bool PublishFile(const std::filesystem::path& folder, const std::string& name, std::initializer_list<std::pair<const void*, size_t>> parts)
+{
+	std::filesystem::path partFile = folder / (name + k_PartExtension);
+	{
+		std::ofstream stream(partFile, std::ios::binary);
+		if (!stream)
+			return false;
+		for (const auto& [data, size] : parts)
+			stream.write(reinterpret_cast<const char*>(data), std::streamsize(size));
+		if (!stream)
+			return false;
+	}
+	std::error_code error;
+	std::filesystem::rename(partFile, folder / name, error);
+	return !error;
+}
+
+//Reads a file into the parts. Returns false if its size is not the size of the parts
+static bool ReadFile(const std::filesystem::path& file, std::initializer_list<std::pair<void*, size_t>> parts)
+{
+	size_t size = 0;
+	for (const auto& part : parts)
+		size += part.second;
+	std::ifstream stream(file, std::ios::binary | std::ios::ate);
+	if (!stream || size_t(stream.tellg()) != size)
+		return false;
+	stream.seekg(0);
+	for (const auto& [data, partSize] : parts)
+		stream.read(reinterpret_cast<char*>(data), std::streamsize(partSize));
+	return bool(stream);
+}
+
+static bool WriteStats(const std::filesystem::path& folder, const std::string& name, const ShardStats& stats)
+{
+	std::ostringstream text;
+	text << "loaded=" << (stats.loaded ? 1 : 0) << "\nblocks=" << stats.numBlocks << "\ntriangles=" << stats.numTriangles
+		<< "\nsceneBytes=" << stats.sceneBytes << "\npeakBytes=" << stats.peakBytes << "\nloadMs=" << stats.loadMs
+		<< "\nprimaryMs=" << stats.primaryMs << "\nshadowMs=" << stats.shadowMs << "\nframes=" << stats.numFrames << "\n";
+	std::string str = text.str();
+	return PublishFile(folder, name, { { str.data(), str.size() } });
+}
+
+static bool ReadStats(const std::filesystem::path& file, ShardStats& stats)
+{
+	std::ifstream stream(file);
+	if (!stream)
+		return false;
+	std::string line;
+	while (std::getline(stream, line)) {
+		size_t separator = line.find('=');
+		if (separator == std::string::npos)
+			continue;
+		std::string key = line.substr(0, separator);
+		const char* value = line.c_str() + separator + 1;
+		if (key == "loaded")
+			stats.loaded = std::atoi(value) != 0;
+		else if (key == "blocks")
+			stats.numBlocks = std::strtoull(value, nullptr, 10);
+		else if (key == "triangles")
+			stats.numTriangles = std::strtoull(value, nullptr, 10);
+		else if (key == "sceneBytes")
+			stats.sceneBytes = std::strtoull(value, nullptr, 10);
+		else if (key == "peakBytes")
+			stats.peakBytes = std::strtoull(value, nullptr, 10);
+		else if (key == "loadMs")
+			stats.loadMs = std::atof(value);
+		else if (key == "primaryMs")
+			stats.primaryMs = std::atof(value);
+		else if (key == "shadowMs")
+			stats.shadowMs = std::atof(value);
+		else if (key == "frames")
+			stats.numFrames = uint(std::atoi(value));
+	}
+	return true;
+}
+
+//Polls until the file exists. Returns false if stop() returns true first
+template<typename StopFunction>
+static bool WaitForFile(const std::filesystem::path& file, StopFunction stop)
+{
+	std::error_code error;
+	while (!std::filesystem::exists(file, error)) {
+		//The file can have been published right before stop became true
+		if (stop())
+			return std::filesystem::exists(file, error);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return true;
+}
+
+//Round trips floats and infinities through the command line of the workers
+static std::string FormatFloat(float value)
+{
+	char text[32];
+	snprintf(text, sizeof(text), "%.9g", value);
+	return text;
+}
+
+static std::string JsonFloat(float value)
+{
+	return std::isfinite(value) ? FormatFloat(value) : "null";
+}
+
+int ShardedRenderer::RunWorker(const std::filesystem::path& jobFile, const std::filesystem::path& exchangeFolder, uint jobIndex, uint shardIndex,
+	const SceneRegion& region, uint numThreads)
+{
+	//The calling thread helps the scheduler workers while waiting
+	if (numThreads > 0)
+		TaskScheduler::SetSharedNumWorkers(std::max(numThreads, 2u) - 1);
+
+	BatchJobFile jobs;
+	if (!jobs.Load(jobFile) || jobIndex >= jobs.GetJobs().size())
+		return 1;
+	const BatchJob& job = jobs.GetJobs()[jobIndex];
+	const std::filesystem::path sceneFolder = jobs.GetSceneFolder();
+
+	ShardStats stats;
+	auto loadStart = std::chrono::high_resolution_clock::now();
+	MinecraftSceneLoader scene(nullptr);
+	scene.SetLoadRegion(region);
+	CpuRenderer renderer;
+	stats.loaded = scene.LoadSceneWithoutDevice(sceneFolder, job.scene);
+	if (stats.loaded)
+		renderer.Build(scene, sceneFolder);
+	stats.loadMs = MillisecondsSince(loadStart);
+	stats.numBlocks = scene.GetAABBs().size();
+	stats.numTriangles = scene.GetTriangleMaterialIDs().size();
+	const CpuBvh& bvh = renderer.GetRayQuery().GetTracer().GetBvh();
+	stats.sceneBytes = scene.GetMemoryFootprint().cpuBytes + bvh.GetNodes().capacity() * sizeof(CpuBvhNode) + bvh.GetPrimitives().capacity() * sizeof(uint);
+	stats.peakBytes = GetPeakResidentBytes();
+	if (!WriteStats(exchangeFolder, GetStatsName(shardIndex, false), stats) || !stats.loaded) {
+		log::warning("ShardedRenderer: shard %u could not load %s", shardIndex, job.scene.c_str());
+		return 1;
+	}
+
+	const std::filesystem::path abortFile = exchangeFolder / k_AbortFile;
+	const size_t numPixels = size_t(job.resolution.x) * job.resolution.y;
+	std::vector<CpuRenderer::LayerTexel> layers;
+	std::vector<uint8_t> active(numPixels);
+	std::vector<float3> origins(numPixels);
+	std::vector<uint8_t> occluded(numPixels);
+	for (uint frameIndex = 0; frameIndex < job.frames.size(); frameIndex++) {
+		auto primaryStart = std::chrono::high_resolution_clock::now();
+		const BatchFrame& frame = job.frames[frameIndex];
+		//The scene stats keep the bounds of the whole scene, so orbit cameras are the same in every shard
+		const MinecraftSceneLoader::SceneStats& sceneStats = scene.GetSceneStats();
+		float3 position, direction, up;
+		BatchJobFile::GetFrameCamera(frame, sceneStats.boundsMin, sceneStats.boundsMax, position, direction, up);
+		app::FirstPersonCamera camera;
+		camera.LookAt(position, position + direction, up);
+		renderer.RenderLayers(CpuRenderer::MakeCamera(camera.GetWorldToViewMatrix(), frame.ui, job.resolution), job.resolution, frame.ui, layers);
+		stats.primaryMs += MillisecondsSince(primaryStart);
+		if (!PublishFile(exchangeFolder, GetLayersName(shardIndex, frameIndex), { { layers.data(), layers.size() * sizeof(CpuRenderer::LayerTexel) } })) {
+			log::warning("ShardedRenderer: shard %u could not write the layers of frame %u", shardIndex, frameIndex);
+			return 1;
+		}
+
+		//Shadow rays of the composited hits, an occluder of any pixel can be in this shard
+		auto waitStart = std::chrono::high_resolution_clock::now();
+		std::error_code error;
+		bool received = WaitForFile(exchangeFolder / GetShadowName(frameIndex), [&]() {
+			return std::filesystem::exists(abortFile, error) || MillisecondsSince(waitStart) > k_ExchangeTimeoutSeconds * 1000.0;
+		});
+		if (!received || !ReadFile(exchangeFolder / GetShadowName(frameIndex), { { active.data(), numPixels }, { origins.data(), numPixels * sizeof(float3) } }))
+			return 1;
+		auto shadowStart = std::chrono::high_resolution_clock::now();
+		renderer.TraceShadows(origins.data(), active.data(), numPixels, frame.ui, occluded.data());
+		stats.shadowMs += MillisecondsSince(shadowStart);
+		if (!PublishFile(exchangeFolder, GetOcclusionName(shardIndex, frameIndex), { { occluded.data(), numPixels } })) {
+			log::warning("ShardedRenderer: shard %u could not write the occlusion of frame %u", shardIndex, frameIndex);
+			return 1;
+		}
+		stats.numFrames++;
+	}
+
+	stats.peakBytes = GetPeakResidentBytes();
+	WriteStats(exchangeFolder, GetStatsName(shardIndex, true), stats);
+	log::info("ShardedRenderer: shard %u rendered %u frames of %s with %llu blocks and %llu triangles", shardIndex, stats.numFrames, job.name.c_str(),
+		(unsigned long long)stats.numBlocks, (unsigned long long)stats.numTriangles);
+	return 0;
+}
+
+//Runs the workers of one job with the given number of shards and composites its frames
+static JobResult RenderJob(const BatchJobFile& jobs, uint jobIndex, const SceneIndexEntry& entry, uint numShards, uint threadsPerShard,
+	const std::filesystem::path& jobFile, const std::filesystem::path& exchangeFolder)
+{
+	const BatchJob& job = jobs.GetJobs()[jobIndex];
+	JobResult result;
+
+	//Slabs of equal width along the longer horizontal axis, the outer slabs are open so that nothing outside the scanned bounds is lost
+	float3 extent = entry.boundsMax - entry.boundsMin;
+	result.axis = extent.z > extent.x ? 2 : 0;
+	result.shards.resize(numShards);
+	for (uint s = 0; s < numShards; s++) {
+		SceneRegion& region = result.shards[s].region;
+		if (s > 0)
+			region.min[result.axis] = entry.boundsMin[result.axis] + extent[result.axis] * float(s) / float(numShards);
+		if (s + 1 < numShards)
+			region.max[result.axis] = entry.boundsMin[result.axis] + extent[result.axis] * float(s + 1) / float(numShards);
+	}
+
+	//Start with an empty exchange folder, files of an aborted run would be taken for results
+	std::error_code error;
+	std::filesystem::remove_all(exchangeFolder, error);
+	std::filesystem::create_directories(exchangeFolder, error);
+	if (error) {
+		log::warning("ShardedRenderer: could not create the exchange folder %s", exchangeFolder.string().c_str());
+		return result;
+	}
+
+	std::vector<ChildProcess> workers(numShards);
+	const std::filesystem::path executable = GetExecutablePath();
+	auto abort = [&]() {
+		PublishFile(exchangeFolder, k_AbortFile, {});
+		for (ChildProcess& worker : workers)
+			worker.Wait();
+		return result;
+	};
+	for (uint s = 0; s < numShards; s++) {
+		const SceneRegion& region = result.shards[s].region;
+		std::vector<std::string> arguments = { "-shardworker", jobFile.string(), std::filesystem::absolute(exchangeFolder).string(), std::to_string(jobIndex),
+			std::to_string(s), std::to_string(result.axis), FormatFloat(region.min[result.axis]), FormatFloat(region.max[result.axis]),
+			"-threads", std::to_string(threadsPerShard) };
+		if (executable.empty() || !workers[s].Start(executable, arguments)) {
+			log::warning("ShardedRenderer: could not start shard %u", s);
+			return abort();
+		}
+	}
+
+	//Waits for a file of every shard, fails if a worker exits without writing it
+	auto waitForShards = [&](auto getName) {
+		for (uint s = 0; s < numShards; s++) {
+			if (!WaitForFile(exchangeFolder / getName(s), [&]() { return !workers[s].IsRunning(); })) {
+				log::warning("ShardedRenderer: shard %u of %s exited early", s, job.name.c_str());
+				return false;
+			}
+		}
+		return true;
+	};
+	if (!waitForShards([](uint s) { return GetStatsName(s, false); }))
+		return abort();
+	for (uint s = 0; s < numShards; s++) {
+		ReadStats(exchangeFolder / GetStatsName(s, false), result.shards[s].stats);
+		if (!result.shards[s].stats.loaded)
+			return abort();
+	}
+
+	const size_t numPixels = size_t(job.resolution.x) * job.resolution.y;
+	std::vector<CpuRenderer::LayerTexel> composite(numPixels);
+	std::vector<CpuRenderer::LayerTexel> layers(numPixels);
+	std::vector<uint8_t> active(numPixels);
+	std::vector<float3> origins(numPixels);
+	std::vector<uint8_t> occluded(numPixels);
+	std::vector<uint8_t> shardOccluded(numPixels);
+	std::vector<uint8_t> image(numPixels * 4);
+	auto renderStart = std::chrono::high_resolution_clock::now();
+	auto frameStart = renderStart;
+	for (uint frameIndex = 0; frameIndex < job.frames.size(); frameIndex++) {
+		if (!waitForShards([&](uint s) { return GetLayersName(s, frameIndex); }))
+			return abort();
+
+		//Nearest hit of every pixel, ties go to the lower shard
+		auto compositeStart = std::chrono::high_resolution_clock::now();
+		for (uint s = 0; s < numShards; s++) {
+			std::vector<CpuRenderer::LayerTexel>& target = s == 0 ? composite : layers;
+			if (!ReadFile(exchangeFolder / GetLayersName(s, frameIndex), { { target.data(), numPixels * sizeof(CpuRenderer::LayerTexel) } })) {
+				log::warning("ShardedRenderer: invalid layers of shard %u in frame %u of %s", s, frameIndex, job.name.c_str());
+				return abort();
+			}
+			if (s == 0)
+				continue;
+			for (size_t i = 0; i < numPixels; i++) {
+				if (layers[i].hitT < composite[i].hitT)
+					composite[i] = layers[i];
+			}
+		}
+		//Pixels the light can not reach need no shadow ray
+		for (size_t i = 0; i < numPixels; i++) {
+			active[i] = std::isfinite(composite[i].hitT) && any(composite[i].light > float3(0.f)) ? 1 : 0;
+			origins[i] = composite[i].shadowOrigin;
+		}
+		double compositeMs = MillisecondsSince(compositeStart);
+		if (!PublishFile(exchangeFolder, GetShadowName(frameIndex), { { active.data(), numPixels }, { origins.data(), numPixels * sizeof(float3) } })) {
+			log::warning("ShardedRenderer: could not write the shadow rays of frame %u of %s", frameIndex, job.name.c_str());
+			return abort();
+		}
+
+		if (!waitForShards([&](uint s) { return GetOcclusionName(s, frameIndex); }))
+			return abort();
+		auto shadeStart = std::chrono::high_resolution_clock::now();
+		std::fill(occluded.begin(), occluded.end(), uint8_t(0));
+		for (uint s = 0; s < numShards; s++) {
+			if (!ReadFile(exchangeFolder / GetOcclusionName(s, frameIndex), { { shardOccluded.data(), numPixels } })) {
+				log::warning("ShardedRenderer: invalid occlusion of shard %u in frame %u of %s", s, frameIndex, job.name.c_str());
+				return abort();
+			}
+			for (size_t i = 0; i < numPixels; i++)
+				occluded[i] |= shardOccluded[i];
+		}
+		for (size_t i = 0; i < numPixels; i++) {
+			float3 color = composite[i].color;
+			if (active[i] && !occluded[i])
+				color += composite[i].light;
+			CpuRenderer::EncodeColor(color, &image[i * 4]);
+		}
+		compositeMs += MillisecondsSince(shadeStart);
+
+		//Every worker has read the shadow rays once all occlusions are there
+		std::filesystem::remove(exchangeFolder / GetShadowName(frameIndex), error);
+		for (uint s = 0; s < numShards; s++) {
+			std::filesystem::remove(exchangeFolder / GetLayersName(s, frameIndex), error);
+			std::filesystem::remove(exchangeFolder / GetOcclusionName(s, frameIndex), error);
+		}
+		if (PngWriter::Write(jobs.GetImageFile(job, frameIndex), job.resolution.x, job.resolution.y, image.data())) {
+			result.compositeMs.push_back(compositeMs);
+			result.frameMs.push_back(MillisecondsSince(frameStart));
+		}
+		else {
+			log::warning("ShardedRenderer: could not write frame %u of %s", frameIndex, job.name.c_str());
+		}
+		frameStart = std::chrono::high_resolution_clock::now();
+	}
+	result.renderSeconds = MillisecondsSince(renderStart) / 1000.0;
+
+	for (uint s = 0; s < numShards; s++) {
+		if (workers[s].Wait() != 0)
+			log::warning("ShardedRenderer: shard %u of %s exited with an error", s, job.name.c_str());
+		ReadStats(exchangeFolder / GetStatsName(s, true), result.shards[s].stats);
+	}
+	std::filesystem::remove_all(exchangeFolder, error);
+	return result;
+}
+
+int ShardedRenderer::Run(const std::filesystem::path& jobFile, const ShardSettings& settings)
+{
+	BatchJobFile jobs;
+	if (!jobs.Load(jobFile)) {
+		log::warning("ShardedRenderer: no frames to render in %s", jobFile.string().c_str());
+		return 1;
+	}
+	const std::filesystem::path absoluteJobFile = std::filesystem::absolute(jobFile);
+	const std::filesystem::path outputFolder = jobs.GetOutputFolder();
+	const std::filesystem::path exchangeFolder = outputFolder / "ShardExchange";
+	const uint maxShards = std::max(settings.numShards, 1u);
+	const uint hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	std::error_code error;
+	std::filesystem::create_directories(outputFolder, error);
+
+	std::vector<uint> shardCounts;
+	if (settings.scaling) {
+		for (uint numShards = 1; numShards < maxShards; numShards *= 2)
+			shardCounts.push_back(numShards);
+	}
+	shardCounts.push_back(maxShards);
+
+	//The slabs are cut from the bounds of the scan, the coordinator never loads a scene
+	std::vector<SceneIndexEntry> entries(jobs.GetJobs().size());
+	for (size_t j = 0; j < entries.size(); j++) {
+		const std::string& scene = jobs.GetJobs()[j].scene;
+		if (!SceneIndex::ScanScene(jobs.GetSceneFolder(), scene, entries[j]))
+			log::warning("ShardedRenderer: could not scan %s, its geometry goes to the outer shards", scene.c_str());
+		//Only archives and world folders are read per slab. Every shard of an .obj parses the whole file and keeps its slab afterwards
+		if (!SceneArchive::IsArchive(scene) && !AnvilImporter::IsWorldFolder(jobs.GetSceneFolder() / scene))
+			log::warning("ShardedRenderer: every shard parses all of %s, convert it to an archive with SceneConverter to read only the slabs", scene.c_str());
+	}
+
+	std::vector<RunResult> runs;
+	for (uint numShards : shardCounts) {
+		RunResult run;
+		run.numShards = numShards;
+		run.threadsPerShard = std::max(hardwareThreads / numShards, 1u);
+		log::info("ShardedRenderer: %zu frames of %zu jobs, %u shards with %u threads each", jobs.GetNumFrames(), jobs.GetJobs().size(), numShards,
+			run.threadsPerShard);
+		auto runStart = std::chrono::high_resolution_clock::now();
+		for (uint j = 0; j < uint(jobs.GetJobs().size()); j++)
+			run.jobs.push_back(RenderJob(jobs, j, entries[j], numShards, run.threadsPerShard, absoluteJobFile, exchangeFolder));
+		run.wallSeconds = MillisecondsSince(runStart) / 1000.0;
+		runs.push_back(std::move(run));
+	}
+
+	//Throughput per core and the memory of the largest shard, relative to the run with one shard
+	auto getFramesPerSecond = [](const RunResult& run) {
+		size_t numFrames = 0;
+		double renderSeconds = 0.0;
+		for (const JobResult& job : run.jobs) {
+			numFrames += job.frameMs.size();
+			renderSeconds += job.renderSeconds;
+		}
+		return renderSeconds > 0.0 ? double(numFrames) / renderSeconds : 0.0;
+	};
+	auto getMaxShardBytes = [](const JobResult& job) {
+		uint64_t bytes = 0;
+		for (const ShardResult& shard : job.shards)
+			bytes = std::max(bytes, shard.stats.sceneBytes);
+		return bytes;
+	};
+	const RunResult* baseline = runs.front().numShards == 1 ? &runs.front() : nullptr;
+
+	size_t numFailed = 0;
+	std::filesystem::path reportFile = settings.reportFile.empty() ? outputFolder / "ShardReport.json" : settings.reportFile;
+	std::ofstream stream(reportFile);
+	if (!stream)
+		log::warning("ShardedRenderer: could not write %s", reportFile.string().c_str());
+	stream << "{\n  \"version\": \"" << RENDERER_VERSION << "\",\n  \"hardwareThreads\": " << hardwareThreads << ",\n  \"runs\": [";
+	for (size_t r = 0; r < runs.size(); r++) {
+		const RunResult& run = runs[r];
+		double framesPerSecond = getFramesPerSecond(run);
+		double efficiency = 0.0;
+		if (baseline && getFramesPerSecond(*baseline) > 0.0) {
+			double coresPerBaseline = double(baseline->threadsPerShard) / double(run.numShards * run.threadsPerShard);
+			efficiency = framesPerSecond / getFramesPerSecond(*baseline) * coresPerBaseline;
+		}
+		stream << (r == 0 ? "\n" : ",\n");
+		stream << "    { \"shards\": " << run.numShards << ", \"threadsPerShard\": " << run.threadsPerShard << ", \"wallSeconds\": " << run.wallSeconds
+			<< ", \"framesPerSecond\": " << framesPerSecond;
+		if (baseline)
+			stream << ", \"scalingEfficiency\": " << efficiency;
+		stream << ", \"jobs\": [";
+		for (size_t j = 0; j < run.jobs.size(); j++) {
+			const BatchJob& job = jobs.GetJobs()[j];
+			const JobResult& result = run.jobs[j];
+			size_t failedFrames = job.frames.size() - result.frameMs.size();
+			numFailed += failedFrames;
+			uint64_t maxShardBytes = getMaxShardBytes(result);
+			BenchmarkReport::Summary frameSummary = BenchmarkReport::Summarize(result.frameMs);
+			BenchmarkReport::Summary compositeSummary = BenchmarkReport::Summarize(result.compositeMs);
+
+			stream << (j == 0 ? "\n" : ",\n");
+			stream << "      { \"name\": \"" << BenchmarkReport::EscapeJson(job.name) << "\", \"scene\": \"" << BenchmarkReport::EscapeJson(job.scene)
+				<< "\", \"resolution\": \"" << job.resolution.x << "," << job.resolution.y << "\", \"axis\": \"" << (result.axis == 2 ? "z" : "x")
+				<< "\", \"frames\": " << result.frameMs.size() << ", \"failedFrames\": " << failedFrames << ", \"renderSeconds\": " << result.renderSeconds
+				<< ", \"maxShardSceneBytes\": " << maxShardBytes;
+			//1 if every shard holds an equal part of the scene of the single shard run
+			if (baseline && j < baseline->jobs.size() && !baseline->jobs[j].shards.empty() && maxShardBytes > 0) {
+				double memoryScaling = double(baseline->jobs[j].shards[0].stats.sceneBytes) / (double(maxShardBytes) * run.numShards);
+				stream << ", \"memoryScaling\": " << memoryScaling;
+			}
+			stream << ", \"frameMs\": { \"mean\": " << frameSummary.mean << ", \"p50\": " << frameSummary.p50 << ", \"p95\": " << frameSummary.p95
+				<< ", \"max\": " << frameSummary.max << " }, \"compositeMs\": { \"mean\": " << compositeSummary.mean << ", \"max\": " << compositeSummary.max
+				<< " },\n        \"shards\": [";
+			for (size_t s = 0; s < result.shards.size(); s++) {
+				const ShardResult& shard = result.shards[s];
+				stream << (s == 0 ? "\n" : ",\n");
+				stream << "          { \"regionMin\": " << JsonFloat(shard.region.min[result.axis]) << ", \"regionMax\": "
+					<< JsonFloat(shard.region.max[result.axis]) << ", \"blocks\": " << shard.stats.numBlocks << ", \"triangles\": "
+					<< shard.stats.numTriangles << ", \"sceneBytes\": " << shard.stats.sceneBytes << ", \"peakBytes\": " << shard.stats.peakBytes
+					<< ", \"loadMs\": " << shard.stats.loadMs << ", \"primaryMs\": " << shard.stats.primaryMs << ", \"shadowMs\": " << shard.stats.shadowMs << " }";
+			}
+			stream << "\n        ] }";
+			log::info("ShardedRenderer: %u shards, %s %zu frames, p50 %.1f ms, largest shard %.1f MB, composite %.1f ms per frame", run.numShards,
+				job.name.c_str(), result.frameMs.size(), frameSummary.p50, double(maxShardBytes) / (1 << 20), compositeSummary.mean);
+		}
+		stream << "\n    ] }";
+		if (baseline)
+			log::info("ShardedRenderer: %u shards, %.2f frames per second, scaling efficiency %.2f", run.numShards, framesPerSecond, efficiency);
+	}
+	stream << "\n  ]\n}\n";
+	log::info("ShardedRenderer: %zu failed frames, report %s", numFailed, reportFile.string().c_str());
+	return numFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <filesystem>
+#include "SceneRegion.h"
+
+using namespace donut::math;
+
+//Options of a sharded run
+struct ShardSettings {
+	uint numShards = 2;						//Worker processes, each loads one slab of the scene. The cores are split between them
+	bool scaling = false;					//Also renders with 1, 2, 4, ... shards up to numShards and reports the scaling against one shard
+	std::filesystem::path reportFile;		//JSON report, ShardReport.json in the output folder if empty
+};
+
+/* Headless rendering of a batch job file (see BatchJobFile) with the scene split between processes, for worlds that do not fit into one.
+   The scene is cut into slabs along its longer horizontal axis (equal widths of the scanned bounds, see SceneIndex) and every worker process
+   keeps only the blocks and triangles of its slab (see SceneRegion). Archives only decode the chunks of the slab and world folders only read
+   its chunks, a Mineways .obj is parsed completely by every worker.
+   For every frame the workers trace the primary rays against their slab and write the shading without the directional light, the light and
+   the hit distance per pixel (CpuRenderer::RenderLayers). The coordinator keeps the nearest hit of every pixel and sends the shadow rays of
+   the composited hits back to all workers, as an occluder can be in any slab; a pixel is lit if no worker reports it occluded.
+   The result is the image the CpuRenderer renders from the whole scene, except where surfaces of two slabs are hit at exactly the same distance
+   and for orbit frames of world folders, which are placed around the bounds of the stored chunks.
+   The exchange goes through files in <output>/ShardExchange that are published by renaming them, as the queue of the BatchRenderer.
+   The report lists the memory of every shard and, with the scaling option, the throughput per core and the memory per shard relative to one shard
+*/
+namespace ShardedRenderer {
+	//Coordinator: runs the workers of every job, composites the frames and writes the report. Returns the exit code of the process
+	int Run(const std::filesystem::path& jobFile, const ShardSettings& settings);
+
+	//Worker process: loads the region of the scene of a job and renders the layers of its frames. numThreads = 0 uses all hardware threads
+	int RunWorker(const std::filesystem::path& jobFile, const std::filesystem::path& exchangeFolder, uint jobIndex, uint shardIndex,
+		const SceneRegion& region, uint numThreads);
+}
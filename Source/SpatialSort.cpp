@@ -0,0 +1,109 @@
+#include "SpatialSort.h"
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <array>
+#include <numeric>
+
+//Spreads the lower 21 bits so that there are two zero bits between each bit
+static uint64_t SpreadBits(uint64_t v) {
+	v &= 0x1FFFFF;
+	v = (v | (v << 32)) & 0x1F00000000FFFFull;
+	v = (v | (v << 16)) & 0x1F0000FF0000FFull;
+	v = (v | (v << 8)) & 0x100F00F00F00F00Full;
+	v = (v | (v << 4)) & 0x10C30C30C30C30C3ull;
+	v = (v | (v << 2)) & 0x1249249249249249ull;
+	return v;
+}
+
+uint64_t SpatialSort::MortonEncode(uint x, uint y, uint z)
+{
+	return SpreadBits(x) | (SpreadBits(y) << 1) | (SpreadBits(z) << 2);
+}
+
+std::vector<uint64_t> SpatialSort::ComputeMortonKeys(const std::vector<float3>& points, float3 boundsMin, float3 boundsMax)
+{
+	const float k_MaxCoordinate = float((1u << 21) - 1);
+	const float3 extent = max(boundsMax - boundsMin, float3(1e-6f));
+	const float3 scale = float3(k_MaxCoordinate) / extent;
+
+	std::vector<uint64_t> keys(points.size());
+	TaskScheduler::Get().ParallelFor(0, points.size(), 16384, [&](uint64_t begin, uint64_t end) {
+		for (uint64_t i = begin; i < end; i++) {
+			float3 p = (points[i] - boundsMin) * scale;
+			uint x = uint(std::min(std::max(p.x, 0.f), k_MaxCoordinate));
+			uint y = uint(std::min(std::max(p.y, 0.f), k_MaxCoordinate));
+			uint z = uint(std::min(std::max(p.z, 0.f), k_MaxCoordinate));
+			keys[i] = MortonEncode(x, y, z);
+		}
+	});
+	return keys;
+}
+
+std::vector<uint> SpatialSort::RadixSortPermutation(const std::vector<uint64_t>& keys)
+{
+	const size_t k_BlockSize = 65536;
+	const size_t numKeys = keys.size();
+	const size_t numBlocks = (numKeys + k_BlockSize - 1) / k_BlockSize;
+
+	std::vector<uint64_t> keysIn = keys;
+	std::vector<uint64_t> keysOut(numKeys);
+	std::vector<uint> orderIn(numKeys);
+	std::vector<uint> orderOut(numKeys);
+	std::iota(orderIn.begin(), orderIn.end(), 0u);
+	if (numKeys < 2)
+		return orderIn;
+
+	//Digits that are the same for all keys do not need a pass
+	uint64_t differentBits = 0;
+	for (uint64_t key : keys)
+		differentBits |= key ^ keys[0];
+
+	TaskScheduler& scheduler = TaskScheduler::Get();
+	std::vector<std::array<size_t, 256>> offsets(numBlocks);
+	for (uint shift = 0; shift < 64; shift += 8) {
+		if (((differentBits >> shift) & 0xFF) == 0)
+			continue;
+
+		//Digit histogram per block
+		scheduler.ParallelFor(0, numBlocks, 1, [&](uint64_t blockBegin, uint64_t blockEnd) {
+			for (uint64_t block = blockBegin; block < blockEnd; block++) {
+				std::array<size_t, 256>& histogram = offsets[block];
+				histogram.fill(0);
+				for (size_t i = block * k_BlockSize; i < std::min(numKeys, (block + 1) * k_BlockSize); i++)
+					histogram[(keysIn[i] >> shift) & 0xFF]++;
+			}
+		});
+
+		//Start of each digit per block, blocks keep their order so the sort stays stable
+		size_t offset = 0;
+		for (uint digit = 0; digit < 256; digit++) {
+			for (size_t block = 0; block < numBlocks; block++) {
+				size_t count = offsets[block][digit];
+				offsets[block][digit] = offset;
+				offset += count;
+			}
+		}
+
+		scheduler.ParallelFor(0, numBlocks, 1, [&](uint64_t blockBegin, uint64_t blockEnd) {
+			for (uint64_t block = blockBegin; block < blockEnd; block++) {
+				std::array<size_t, 256>& blockOffsets = offsets[block];
+				for (size_t i = block * k_BlockSize; i < std::min(numKeys, (block + 1) * k_BlockSize); i++) {
+					size_t target = blockOffsets[(keysIn[i] >> shift) & 0xFF]++;
+					keysOut[target] = keysIn[i];
+					orderOut[target] = orderIn[i];
+				}
+			}
+		});
+		keysIn.swap(keysOut);
+		orderIn.swap(orderOut);
+	}
+	return orderIn;
+}
+
+std::vector<uint> SpatialSort::InvertPermutation(const std::vector<uint>& order)
+{
+	std::vector<uint> inverse(order.size());
+	for (size_t i = 0; i < order.size(); i++)
+		inverse[order[i]] = uint(i);
+	return inverse;
+}
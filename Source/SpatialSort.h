@@ -0,0 +1,32 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <vector>
+
+using namespace donut::math;
+
+/* Helpers to sort primitives along a 3D Morton curve, so that primitives that are close in space are close in memory
+*/
+namespace SpatialSort {
+	//Interleaves the lower 21 bits of x, y and z (x in the lowest bit)
+	uint64_t MortonEncode(uint x, uint y, uint z);
+
+	//Morton keys of points, quantized to 21 bits per axis inside the bounds
+	std::vector<uint64_t> ComputeMortonKeys(const std::vector<float3>& points, float3 boundsMin, float3 boundsMax);
+
+	//Stable parallel LSD radix sort (8 bit digits, constant digits are skipped).
+	//Returns the permutation, order[i] is the index of the key that ends up at position i
+	std::vector<uint> RadixSortPermutation(const std::vector<uint64_t>& keys);
+
+	//Returns the inverse of a permutation, inverse[order[i]] = i
+	std::vector<uint> InvertPermutation(const std::vector<uint>& order);
+
+	//Applies a permutation to an array, result[i] = values[order[i] * stride + k] for all k < stride
+	template<typename T> void ApplyPermutation(std::vector<T>& values, const std::vector<uint>& order, size_t stride = 1) {
+		std::vector<T> sorted(values.size());
+		for (size_t i = 0; i < order.size(); i++) {
+			for (size_t k = 0; k < stride; k++)
+				sorted[i * stride + k] = values[size_t(order[i]) * stride + k];
+		}
+		values.swap(sorted);
+	}
+}
@@ -0,0 +1,157 @@
+#include "TaskGraph.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <chrono>
+
+using namespace donut;
+
+static int64_t NowNanoseconds() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TaskGraph::TaskID TaskGraph::Add(const std::string& name, Task task, std::initializer_list<TaskID> dependencies, Affinity affinity)
+{
+	return Add(name, std::move(task), std::vector<TaskID>(dependencies), affinity);
+}
+
+TaskGraph::TaskID TaskGraph::Add(const std::string& name, Task task, const std::vector<TaskID>& dependencies, Affinity affinity)
+{
+	TaskID id = TaskID(m_Nodes.size());
+	auto node = std::make_unique<Node>();
+	node->name = name;
+	node->task = std::move(task);
+	node->affinity = affinity;
+	node->timing.name = name;
+	node->timing.mainThread = affinity == Affinity::MainThread;
+	for (TaskID dependency : dependencies) {
+		if (dependency >= id || std::find(node->dependencies.begin(), node->dependencies.end(), dependency) != node->dependencies.end())
+			continue;
+		node->dependencies.push_back(dependency);
+		m_Nodes[dependency]->dependants.push_back(id);
+	}
+	m_Nodes.push_back(std::move(node));
+	return id;
+}
+
+void TaskGraph::Run(TaskScheduler& scheduler)
+{
+	m_Scheduler = &scheduler;
+	m_StartNanoseconds = NowNanoseconds();
+	bool hasMainThreadTasks = false;
+	for (auto& node : m_Nodes) {
+		node->remainingDependencies.store(uint(node->dependencies.size()), std::memory_order_relaxed);
+		hasMainThreadTasks |= node->affinity == Affinity::MainThread;
+	}
+	for (TaskID id = 0; id < m_Nodes.size(); id++) {
+		if (m_Nodes[id]->dependencies.empty())
+			Submit(id);
+	}
+
+	if (hasMainThreadTasks) {
+		//This thread only runs its own tasks, so that they start as soon as they are ready
+		std::unique_lock<std::mutex> lock(m_MainMutex);
+		while (true) {
+			m_MainCondition.wait(lock, [this]() { return !m_MainTasks.empty() || m_NumFinished.load(std::memory_order_acquire) == m_Nodes.size(); });
+			if (m_MainTasks.empty())
+				break;
+			TaskID id = m_MainTasks.front();
+			m_MainTasks.pop_front();
+			lock.unlock();
+			Execute(id);
+			lock.lock();
+		}
+	}
+	//Without main thread tasks this thread helps the workers. Otherwise it waits until the scheduler released the last task
+	scheduler.Wait(m_Group);
+
+	BuildReport(GetElapsedMs());
+}
+
+void TaskGraph::Submit(TaskID id)
+{
+	if (m_Nodes[id]->affinity == Affinity::Any) {
+		m_Scheduler->Run(m_Group, [this, id]() { Execute(id); });
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_MainMutex);
+		m_MainTasks.push_back(id);
+	}
+	m_MainCondition.notify_one();
+}
+
+void TaskGraph::Execute(TaskID id)
+{
+	Node& node = *m_Nodes[id];
+	node.timing.threadIndex = m_Scheduler->GetCurrentThreadIndex();
+	node.timing.startMs = GetElapsedMs();
+	if (IsCancelled())
+		node.timing.skipped = true;
+	else
+		node.task();
+	node.task = nullptr;
+	node.timing.endMs = GetElapsedMs();
+
+	//Skipped tasks release their dependants as well, which are skipped in turn
+	for (TaskID dependantID : node.dependants) {
+		Node& dependant = *m_Nodes[dependantID];
+		if (dependant.remainingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			dependant.timing.readyMs = node.timing.endMs;
+			Submit(dependantID);
+		}
+	}
+
+	//Taking the mutex orders the notification after the waiting thread checked the counter
+	if (m_NumFinished.fetch_add(1, std::memory_order_acq_rel) + 1 == m_Nodes.size()) {
+		{
+			std::lock_guard<std::mutex> lock(m_MainMutex);
+		}
+		m_MainCondition.notify_all();
+	}
+}
+
+void TaskGraph::BuildReport(double totalMs)
+{
+	m_Report = Report();
+	m_Report.totalMs = totalMs;
+	for (auto& node : m_Nodes) {
+		m_Report.tasks.push_back(node->timing);
+		if (!node->timing.skipped)
+			m_Report.busyMs += node->timing.GetMs();
+	}
+
+	//Walk back from the task that finished last through the dependency that finished last
+	auto findLast = [&](const std::vector<TaskID>& candidates) {
+		int last = -1;
+		for (TaskID id : candidates) {
+			const TaskTiming& timing = m_Report.tasks[id];
+			if (!timing.skipped && (last < 0 || timing.endMs > m_Report.tasks[last].endMs))
+				last = int(id);
+		}
+		return last;
+	};
+	std::vector<TaskID> allTasks(m_Nodes.size());
+	for (TaskID id = 0; id < m_Nodes.size(); id++)
+		allTasks[id] = id;
+	for (int id = findLast(allTasks); id >= 0; id = findLast(m_Nodes[id]->dependencies)) {
+		m_Report.criticalPath.push_back(TaskID(id));
+		m_Report.tasks[id].critical = true;
+		m_Report.criticalPathMs += m_Report.tasks[id].GetMs();
+	}
+	std::reverse(m_Report.criticalPath.begin(), m_Report.criticalPath.end());
+}
+
+double TaskGraph::GetElapsedMs() const
+{
+	return double(NowNanoseconds() - m_StartNanoseconds) * 1e-6;
+}
+
+void TaskGraph::LogReport(const char* title, const Report& report)
+{
+	log::info("%s: %.1f ms, critical path %.1f ms, %.1f ms of tasks (%.1fx overlap)", title, report.totalMs, report.criticalPathMs, report.busyMs,
+		report.totalMs > 0.0 ? report.busyMs / report.totalMs : 0.0);
+	for (TaskID id : report.criticalPath) {
+		const TaskTiming& timing = report.tasks[id];
+		log::info("  %-24s %8.1f ms, started at %.1f ms%s", timing.name.c_str(), timing.GetMs(), timing.startMs, timing.mainThread ? " (main thread)" : "");
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "TaskScheduler.h"
+
+/* Tasks with explicit dependencies, executed on the TaskScheduler. A task starts as soon as all of its dependencies finished.
+   Tasks with the MainThread affinity run on the thread that calls Run, e.g. because they record into a command list; the other tasks run on
+   the workers. Cancel skips all tasks that did not start yet, e.g. when a stage fails.
+   Run records the start and end of every task and the critical path: starting at the task that finished last, the chain of dependencies that
+   finished last before their dependant could start. Only the tasks on this path determine the duration of the graph
+*/
+class TaskGraph {
+public:
+	using TaskID = uint;
+	using Task = std::function<void()>;
+
+	enum class Affinity {
+		Any,			//Runs on a worker of the scheduler
+		MainThread		//Runs on the thread that calls Run
+	};
+
+	struct TaskTiming {
+		std::string name;
+		double startMs = 0.0;		//Relative to the start of Run
+		double endMs = 0.0;
+		double readyMs = 0.0;		//All dependencies finished, the task waited for a thread until startMs
+		uint threadIndex = 0;		//TaskScheduler::GetCurrentThreadIndex of the executing thread
+		bool mainThread = false;
+		bool skipped = false;		//Not executed as the graph was cancelled
+		bool critical = false;		//On the critical path
+
+		double GetMs() const { return endMs - startMs; }
+	};
+
+	struct Report {
+		std::vector<TaskTiming> tasks;			//In the order they were added
+		std::vector<TaskID> criticalPath;		//From the first to the last task
+		double totalMs = 0.0;					//Duration of Run
+		double criticalPathMs = 0.0;			//Execution time of the tasks on the critical path, the rest of totalMs was spent waiting for threads
+		double busyMs = 0.0;					//Execution time of all tasks
+	};
+
+	TaskGraph() = default;
+	TaskGraph(const TaskGraph&) = delete;
+	TaskGraph& operator=(const TaskGraph&) = delete;
+
+	//Adds a task that starts after its dependencies, which have to be added before. Tasks can not be added while the graph runs
+	TaskID Add(const std::string& name, Task task, std::initializer_list<TaskID> dependencies = {}, Affinity affinity = Affinity::Any);
+	TaskID Add(const std::string& name, Task task, const std::vector<TaskID>& dependencies, Affinity affinity = Affinity::Any);
+
+	//Runs all tasks and returns when they finished or were skipped. Can only be called once
+	void Run(TaskScheduler& scheduler = TaskScheduler::Get());
+
+	//Skips the tasks that did not start yet. Can be called by a task
+	void Cancel() { m_Cancelled.store(true, std::memory_order_relaxed); }
+	bool IsCancelled() const { return m_Cancelled.load(std::memory_order_relaxed); }
+
+	//Timings of the last Run
+	const Report& GetReport() const { return m_Report; }
+	//Logs the tasks of the critical path and the total times
+	static void LogReport(const char* title, const Report& report);
+
+private:
+	struct Node {
+		std::string name;
+		Task task;
+		Affinity affinity = Affinity::Any;
+		std::vector<TaskID> dependencies;
+		std::vector<TaskID> dependants;
+		std::atomic<uint> remainingDependencies = 0;
+		TaskTiming timing;
+	};
+
+	//Queues a task whose dependencies finished
+	void Submit(TaskID id);
+	void Execute(TaskID id);
+	void BuildReport(double totalMs);
+	double GetElapsedMs() const;
+
+	std::vector<std::unique_ptr<Node>> m_Nodes;
+	TaskScheduler* m_Scheduler = nullptr;
+	TaskGroup m_Group;
+	std::atomic<bool> m_Cancelled = false;
+	std::atomic<uint> m_NumFinished = 0;
+	int64_t m_StartNanoseconds = 0;
+
+	//Ready main thread tasks, the waiting thread is woken when one is queued or the last task finished
+	std::mutex m_MainMutex;
+	std::condition_variable m_MainCondition;
+	std::deque<TaskID> m_MainTasks;
+
+	Report m_Report;
+};
@@ -0,0 +1,248 @@
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <chrono>
+
+//Index of the worker owned by the current thread, -1 for threads that are not workers of any scheduler
+static thread_local int t_WorkerIndex = -1;
+static thread_local const TaskScheduler* t_Scheduler = nullptr;
+//Nesting of Execute on the current thread, tasks that wait execute other tasks. Only the outermost task counts as busy time
+static thread_local uint t_ExecuteDepth = 0;
+
+static int64_t NowNanoseconds() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TaskScheduler::TaskScheduler(uint numWorkers)
+	: m_StatsStart(NowNanoseconds())
+{
+	if (numWorkers == 0) {
+		uint hardwareThreads = std::thread::hardware_concurrency();
+		numWorkers = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	for (uint i = 0; i < numWorkers + 1; i++)
+		m_Workers.push_back(std::make_unique<Worker>());
+	for (uint i = 0; i < numWorkers; i++)
+		m_Workers[i]->thread = std::thread([this, i]() { WorkerLoop(i); });
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_WakeMutex);
+		m_Stop = true;
+	}
+	m_WakeCondition.notify_all();
+	for (auto& worker : m_Workers) {
+		if (worker->thread.joinable())
+			worker->thread.join();
+	}
+}
+
+static std::atomic<uint> s_SharedNumWorkers = 0;
+
+TaskScheduler& TaskScheduler::Get()
+{
+	static TaskScheduler scheduler(s_SharedNumWorkers.load());
+	return scheduler;
+}
+
+void TaskScheduler::SetSharedNumWorkers(uint numWorkers)
+{
+	s_SharedNumWorkers.store(numWorkers);
+}
+
+uint TaskScheduler::GetCurrentThreadIndex() const
+{
+	if (t_Scheduler == this && t_WorkerIndex >= 0)
+		return uint(t_WorkerIndex);
+	return uint(m_Workers.size() - 1);
+}
+
+void TaskScheduler::Run(TaskGroup& group, Task task)
+{
+	group.m_Pending.fetch_add(1, std::memory_order_relaxed);
+
+	Worker& worker = *m_Workers[GetCurrentThreadIndex()];
+	{
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.tasks.push_back({ std::move(task), &group });
+	}
+	m_QueuedTasks.fetch_add(1, std::memory_order_release);
+
+	//Taking the wake mutex orders the notification after a worker checked the queue counter, so no wake up is lost
+	{
+		std::lock_guard<std::mutex> lock(m_WakeMutex);
+	}
+	m_WakeCondition.notify_one();
+}
+
+void TaskScheduler::Wait(TaskGroup& group)
+{
+	const uint workerIndex = GetCurrentThreadIndex();
+	while (!group.IsDone()) {
+		QueuedTask task;
+		bool stolen = false;
+		if (TryGetTask(workerIndex, task, stolen))
+			Execute(workerIndex, task, stolen);
+		else
+			std::this_thread::yield();
+	}
+}
+
+bool TaskScheduler::TryGetTask(uint workerIndex, QueuedTask& task, bool& stolen)
+{
+	if (m_QueuedTasks.load(std::memory_order_acquire) == 0)
+		return false;
+
+	//Newest task of the own deque
+	{
+		Worker& own = *m_Workers[workerIndex];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			m_QueuedTasks.fetch_sub(1, std::memory_order_relaxed);
+			stolen = false;
+			return true;
+		}
+	}
+
+	//Oldest task of another deque, starting at a different victim for every worker
+	const uint numWorkers = uint(m_Workers.size());
+	for (uint i = 1; i < numWorkers; i++) {
+		Worker& victim = *m_Workers[(workerIndex + i) % numWorkers];
+		std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+		if (!lock.owns_lock() || victim.tasks.empty())
+			continue;
+		task = std::move(victim.tasks.front());
+		victim.tasks.pop_front();
+		m_QueuedTasks.fetch_sub(1, std::memory_order_relaxed);
+		stolen = true;
+		return true;
+	}
+	return false;
+}
+
+void TaskScheduler::Execute(uint workerIndex, QueuedTask& task, bool stolen)
+{
+	Worker& worker = *m_Workers[workerIndex];
+	int64_t start = NowNanoseconds();
+	t_ExecuteDepth++;
+	if (!task.group->IsCancelled())
+		task.task();
+	t_ExecuteDepth--;
+	if (t_ExecuteDepth == 0)
+		worker.busyNanoseconds.fetch_add(uint64_t(NowNanoseconds() - start), std::memory_order_relaxed);
+	worker.tasksExecuted.fetch_add(1, std::memory_order_relaxed);
+	if (stolen)
+		worker.tasksStolen.fetch_add(1, std::memory_order_relaxed);
+
+	//Release the task before the group is marked as done, it might reference data owned by the waiting thread
+	task.task = nullptr;
+	task.group->m_Pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void TaskScheduler::WorkerLoop(uint workerIndex)
+{
+	t_WorkerIndex = int(workerIndex);
+	t_Scheduler = this;
+
+	while (!m_Stop) {
+		QueuedTask task;
+		bool stolen = false;
+		if (TryGetTask(workerIndex, task, stolen)) {
+			Execute(workerIndex, task, stolen);
+			continue;
+		}
+
+		//Sleep until new tasks are queued. The timeout covers tasks that could not be stolen due to a busy deque
+		std::unique_lock<std::mutex> lock(m_WakeMutex);
+		m_WakeCondition.wait_for(lock, std::chrono::milliseconds(1), [this]() {
+			return m_Stop || m_QueuedTasks.load(std::memory_order_acquire) > 0;
+		});
+	}
+}
+
+void TaskScheduler::ParallelFor(uint64_t begin, uint64_t end, uint64_t grainSize, const std::function<void(uint64_t, uint64_t)>& func, TaskGroup* group)
+{
+	if (begin >= end)
+		return;
+	TaskGroup localGroup;
+	TaskGroup& loopGroup = group ? *group : localGroup;
+	SplitRange(loopGroup, begin, end, std::max<uint64_t>(grainSize, 1), func);
+	Wait(loopGroup);
+}
+
+void TaskScheduler::SplitRange(TaskGroup& group, uint64_t begin, uint64_t end, uint64_t grainSize, const std::function<void(uint64_t, uint64_t)>& func)
+{
+	//Hand the upper halves to other workers and continue with the lower half
+	while (end - begin > grainSize) {
+		if (group.IsCancelled())
+			return;
+		uint64_t mid = begin + (end - begin) / 2;
+		Run(group, [this, &group, mid, end, grainSize, &func]() { SplitRange(group, mid, end, grainSize, func); });
+		end = mid;
+	}
+	if (!group.IsCancelled())
+		func(begin, end);
+}
+
+void TaskScheduler::ParallelForTiles(uint2 size, uint2 tileSize, const std::function<void(uint2, uint2)>& func, TaskGroup* group)
+{
+	if (size.x == 0 || size.y == 0)
+		return;
+	TaskGroup localGroup;
+	TaskGroup& loopGroup = group ? *group : localGroup;
+	SplitTiles(loopGroup, uint2(0, 0), size, uint2(max(tileSize.x, 1u), max(tileSize.y, 1u)), func);
+	Wait(loopGroup);
+}
+
+void TaskScheduler::SplitTiles(TaskGroup& group, uint2 regionMin, uint2 regionMax, uint2 tileSize, const std::function<void(uint2, uint2)>& func)
+{
+	//Split along the side with more tiles, at a tile border
+	while (true) {
+		if (group.IsCancelled())
+			return;
+		uint tilesX = (regionMax.x - regionMin.x + tileSize.x - 1) / tileSize.x;
+		uint tilesY = (regionMax.y - regionMin.y + tileSize.y - 1) / tileSize.y;
+		if (tilesX <= 1 && tilesY <= 1)
+			break;
+
+		uint2 upperMin = regionMin;
+		uint2 upperMax = regionMax;
+		if (tilesX >= tilesY) {
+			upperMin.x = regionMin.x + (tilesX / 2) * tileSize.x;
+			regionMax.x = upperMin.x;
+		}
+		else {
+			upperMin.y = regionMin.y + (tilesY / 2) * tileSize.y;
+			regionMax.y = upperMin.y;
+		}
+		Run(group, [this, &group, upperMin, upperMax, tileSize, &func]() { SplitTiles(group, upperMin, upperMax, tileSize, func); });
+	}
+	func(regionMin, regionMax);
+}
+
+std::vector<TaskScheduler::WorkerStats> TaskScheduler::GetWorkerStats() const
+{
+	double elapsedSeconds = double(NowNanoseconds() - m_StatsStart.load()) * 1e-9;
+	std::vector<WorkerStats> stats(m_Workers.size());
+	for (size_t i = 0; i < m_Workers.size(); i++) {
+		stats[i].tasksExecuted = m_Workers[i]->tasksExecuted.load(std::memory_order_relaxed);
+		stats[i].tasksStolen = m_Workers[i]->tasksStolen.load(std::memory_order_relaxed);
+		stats[i].busySeconds = double(m_Workers[i]->busyNanoseconds.load(std::memory_order_relaxed)) * 1e-9;
+		stats[i].utilization = elapsedSeconds > 0.0 ? stats[i].busySeconds / elapsedSeconds : 0.0;
+	}
+	return stats;
+}
+
+void TaskScheduler::ResetStats()
+{
+	for (auto& worker : m_Workers) {
+		worker->tasksExecuted = 0;
+		worker->tasksStolen = 0;
+		worker->busyNanoseconds = 0;
+	}
+	m_StatsStart = NowNanoseconds();
+}
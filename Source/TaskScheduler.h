@@ -0,0 +1,110 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace donut::math;
+
+/* Set of tasks that can be waited on and cancelled together.
+   Cancelling skips all tasks of the group that did not start yet; running tasks can poll IsCancelled to stop early
+*/
+class TaskGroup {
+public:
+	void Cancel() { m_Cancelled.store(true, std::memory_order_relaxed); }
+	bool IsCancelled() const { return m_Cancelled.load(std::memory_order_relaxed); }
+	//True if all tasks of the group finished (or were skipped)
+	bool IsDone() const { return m_Pending.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class TaskScheduler;
+	std::atomic<uint32_t> m_Pending = 0;
+	std::atomic<bool> m_Cancelled = false;
+};
+
+/* Work-stealing task scheduler for uneven CPU work (tiles, per-block or per-face work, builds).
+   Every worker owns a deque: new tasks are pushed to the back of the deque of the current worker and popped from there (LIFO, cache friendly),
+   idle workers steal the oldest tasks from the front of other deques, which are the largest ranges when work is split recursively.
+   Threads that wait for a group execute tasks as well, so tasks may spawn and wait for nested tasks
+*/
+class TaskScheduler {
+public:
+	using Task = std::function<void()>;
+
+	//Per-worker counters since the last ResetStats
+	struct WorkerStats {
+		uint64_t tasksExecuted = 0;
+		uint64_t tasksStolen = 0;		//Executed tasks taken from the deque of another worker
+		double busySeconds = 0.0;		//Time spent executing tasks
+		double utilization = 0.0;		//busySeconds divided by the time since the last ResetStats
+	};
+
+	//numWorkers = 0 uses one worker per hardware thread, minus the calling thread that helps while waiting
+	explicit TaskScheduler(uint numWorkers = 0);
+	~TaskScheduler();
+
+	TaskScheduler(const TaskScheduler&) = delete;
+	TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+	//Scheduler shared by the renderer, the scene loading and the CPU tracing
+	static TaskScheduler& Get();
+	//Worker count of the shared scheduler, e.g. to split the cores between batch worker processes. Has no effect after the first Get
+	static void SetSharedNumWorkers(uint numWorkers);
+
+	//Adds a task to the group
+	void Run(TaskGroup& group, Task task);
+	//Executes tasks until all tasks of the group are done
+	void Wait(TaskGroup& group);
+
+	//Calls func(begin, end) for sub ranges of [begin, end) with at most grainSize elements. Ranges are split in halves on demand,
+	//so idle workers steal large ranges. Blocks until done; pass a group to be able to cancel the loop from another thread or task
+	void ParallelFor(uint64_t begin, uint64_t end, uint64_t grainSize, const std::function<void(uint64_t, uint64_t)>& func, TaskGroup* group = nullptr);
+
+	//Calls func(tileMin, tileMax) for all tiles of the 2D range [0, size). Regions are split along the larger side down to tileSize
+	void ParallelForTiles(uint2 size, uint2 tileSize, const std::function<void(uint2, uint2)>& func, TaskGroup* group = nullptr);
+
+	//Worker threads plus the threads that help while waiting
+	uint GetNumThreads() const { return uint(m_Workers.size()); }
+	//Index of the calling thread in the stats, the last slot is shared by all non-worker threads
+	uint GetCurrentThreadIndex() const;
+
+	std::vector<WorkerStats> GetWorkerStats() const;
+	void ResetStats();
+
+private:
+	struct QueuedTask {
+		Task task;
+		TaskGroup* group = nullptr;
+	};
+
+	struct Worker {
+		std::mutex mutex;
+		std::deque<QueuedTask> tasks;
+		std::thread thread;
+		std::atomic<uint64_t> tasksExecuted = 0;
+		std::atomic<uint64_t> tasksStolen = 0;
+		std::atomic<uint64_t> busyNanoseconds = 0;
+	};
+
+	void WorkerLoop(uint workerIndex);
+	//Pops a task of the own deque or steals one. Returns false if all deques are empty
+	bool TryGetTask(uint workerIndex, QueuedTask& task, bool& stolen);
+	void Execute(uint workerIndex, QueuedTask& task, bool stolen);
+
+	void SplitRange(TaskGroup& group, uint64_t begin, uint64_t end, uint64_t grainSize, const std::function<void(uint64_t, uint64_t)>& func);
+	void SplitTiles(TaskGroup& group, uint2 regionMin, uint2 regionMax, uint2 tileSize, const std::function<void(uint2, uint2)>& func);
+
+	//The last worker has no thread, it is used by external threads that push or help
+	std::vector<std::unique_ptr<Worker>> m_Workers;
+	std::atomic<uint64_t> m_QueuedTasks = 0;
+	std::atomic<bool> m_Stop = false;
+	std::mutex m_WakeMutex;
+	std::condition_variable m_WakeCondition;
+	std::atomic<int64_t> m_StatsStart;
+};
@@ -0,0 +1,292 @@
+#include "TextureResidency.h"
+#include "MinecraftSceneLoader.h"
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+
+//Materials whose textures are requested per update at most, spreads the decoding of a new view over a few frames
+static const uint k_MaxRequestsPerUpdate = 64;
+//Updates a material has to be unused before it can be evicted, so that textures are not evicted while they are in view
+static const uint64_t k_MinUnusedUpdates = 60;
+//Updates until unused textures are released, frames in flight may still sample them through the old material constants
+static const uint64_t k_ReleaseDelayUpdates = 4;
+
+TextureResidency::TextureResidency(nvrhi::IDevice* device, const std::vector<MaterialTextures>& materialTextures)
+{
+	//Materials share texture entries by path, so that every file is loaded by a single task
+	std::unordered_map<std::string, int> textureIndices;
+	auto addTexture = [&](const std::filesystem::path& path, bool sRGB) -> int {
+		if (path.empty())
+			return -1;
+		auto [it, inserted] = textureIndices.emplace(path.generic_string(), int(m_Textures.size()));
+		if (inserted) {
+			m_Textures.push_back(std::make_unique<TextureEntry>());
+			m_Textures.back()->path = path;
+			m_Textures.back()->sRGB = sRGB;
+		}
+		return it->second;
+	};
+
+	m_Materials.resize(materialTextures.size());
+	for (size_t i = 0; i < materialTextures.size(); i++) {
+		const MaterialTextures& paths = materialTextures[i];
+		MaterialEntry& material = m_Materials[i];
+		material.textures[Diffuse] = addTexture(paths.diffuse, true);
+		material.textures[Normal] = addTexture(paths.normal, false);
+		material.textures[Emissive] = addTexture(paths.emissive, false);
+		material.textures[Roughness] = addTexture(paths.roughness, false);
+		material.textures[Metallic] = paths.roughness.empty() ? -1 : addTexture(paths.metallic, false);
+		material.convertShininessToRoughness = paths.convertShininessToRoughness;
+		//Materials without textures have nothing to load
+		if (std::all_of(material.textures, material.textures + NumTextureSlots, [](int index) { return index < 0; }))
+			material.state = MaterialState::Resident;
+	}
+
+	nvrhi::BufferDesc bufferDesc;
+	bufferDesc.byteSize = sizeof(uint) * std::max<size_t>(m_Materials.size(), 1);
+	bufferDesc.cpuAccess = nvrhi::CpuAccessMode::Read;
+	bufferDesc.initialState = nvrhi::ResourceStates::CopyDest;
+	bufferDesc.keepInitialState = true;
+	for (uint i = 0; i < k_FeedbackLatency; i++) {
+		bufferDesc.debugName = "TextureResidency::Readback" + std::to_string(i);
+		m_ReadbackBuffers[i] = device->createBuffer(bufferDesc);
+	}
+	m_Stats.numMaterials = uint(m_Materials.size());
+}
+
+TextureResidency::~TextureResidency()
+{
+	//Load tasks write into the texture entries
+	TaskScheduler::Get().Wait(m_LoadGroup);
+}
+
+void TextureResidency::RecordFeedback(nvrhi::ICommandList* commandList, nvrhi::IBuffer* feedbackBuffer)
+{
+	nvrhi::IBuffer* readback = m_ReadbackBuffers[m_NumRecordedFeedbacks % k_FeedbackLatency];
+	commandList->copyBuffer(readback, 0, feedbackBuffer, 0, readback->getDesc().byteSize);
+	commandList->clearBufferUInt(feedbackBuffer, 0);
+	m_NumRecordedFeedbacks++;
+}
+
+std::vector<uint> TextureResidency::Update(nvrhi::IDevice* device, std::vector<Material>& materials, std::shared_ptr<TextureCache>& pTextureCache,
+	const MetalRoughFunc& createMetalRough, uint64_t budgetBytes)
+{
+	m_UpdateIndex++;
+	std::vector<uint> changedMaterials;
+
+	//Feedback is read k_FeedbackLatency frames after it was recorded, when its frame is done unless the GPU is further behind.
+	//If no frame was traced since the last update, the last image is shown again: the remaining feedback is read right away and
+	//the materials of the image stay in use, materials that were over the request limit are requested now
+	bool traced = m_NumRecordedFeedbacks != m_NumRecordedAtLastUpdate;
+	m_NumRecordedAtLastUpdate = m_NumRecordedFeedbacks;
+	while (m_NumReadFeedbacks < m_NumRecordedFeedbacks && (!traced || m_NumRecordedFeedbacks - m_NumReadFeedbacks >= k_FeedbackLatency)) {
+		nvrhi::IBuffer* readback = m_ReadbackBuffers[m_NumReadFeedbacks % k_FeedbackLatency];
+		const uint* shaded = static_cast<const uint*>(device->mapBuffer(readback, nvrhi::CpuAccessMode::Read));
+		if (shaded) {
+			m_LastShaded.clear();
+			for (uint i = 0; i < m_Materials.size(); i++) {
+				if (shaded[i] != 0)
+					m_LastShaded.push_back(i);
+			}
+			device->unmapBuffer(readback);
+		}
+		m_NumReadFeedbacks++;
+		if (traced)
+			MarkShaded(pTextureCache);
+	}
+	if (!traced)
+		MarkShaded(pTextureCache);
+
+	//Switch materials whose textures are all uploaded
+	for (uint i = 0; i < m_Materials.size(); i++) {
+		MaterialEntry& material = m_Materials[i];
+		if (material.state != MaterialState::Loading)
+			continue;
+		bool ready = std::all_of(material.textures, material.textures + NumTextureSlots,
+			[&](int index) { return index < 0 || IsTextureReady(*m_Textures[index], *pTextureCache); });
+		if (ready) {
+			FinishMaterial(i, materials[i], createMetalRough);
+			changedMaterials.push_back(i);
+		}
+	}
+
+	//Texture memory of the loading and resident materials
+	auto getTextureBytes = [](const std::shared_ptr<LoadedTexture>& texture) {
+		return texture ? uint64_t(MinecraftSceneLoader::GetTextureByteSize(texture->texture)) : 0;
+	};
+	uint64_t residentBytes = 0;
+	for (const std::unique_ptr<TextureEntry>& texture : m_Textures) {
+		if (texture->numUsers > 0 && texture->decoded.load(std::memory_order_acquire))
+			residentBytes += getTextureBytes(texture->texture);
+	}
+	for (const MaterialEntry& material : m_Materials)
+		residentBytes += getTextureBytes(material.metalRough);
+
+	//Evict the least recently shaded materials above the budget
+	if (residentBytes > budgetBytes) {
+		std::vector<uint> candidates;
+		for (uint i = 0; i < m_Materials.size(); i++) {
+			const MaterialEntry& material = m_Materials[i];
+			bool hasTextures = std::any_of(material.textures, material.textures + NumTextureSlots, [](int index) { return index >= 0; });
+			if (material.state == MaterialState::Resident && hasTextures && material.lastUsedUpdate + k_MinUnusedUpdates < m_UpdateIndex)
+				candidates.push_back(i);
+		}
+		std::sort(candidates.begin(), candidates.end(), [&](uint a, uint b) { return m_Materials[a].lastUsedUpdate < m_Materials[b].lastUsedUpdate; });
+		for (uint i = 0; i < candidates.size() && residentBytes > budgetBytes; i++) {
+			const MaterialEntry& material = m_Materials[candidates[i]];
+			//Shared textures are only freed by their last user
+			uint64_t freedBytes = getTextureBytes(material.metalRough);
+			for (int slot : { Diffuse, Normal, Emissive }) {
+				int index = material.textures[slot];
+				if (index >= 0 && m_Textures[index]->numUsers == 1)
+					freedBytes += getTextureBytes(m_Textures[index]->texture);
+			}
+			EvictMaterial(candidates[i], materials[candidates[i]]);
+			changedMaterials.push_back(candidates[i]);
+			residentBytes -= std::min(freedBytes, residentBytes);
+		}
+	}
+
+	//Release textures that are no longer used
+	for (std::unique_ptr<TextureEntry>& texture : m_Textures) {
+		if (texture->numUsers > 0 || !texture->requested || !texture->decoded.load(std::memory_order_acquire) ||
+			m_UpdateIndex < texture->unusedSinceUpdate + k_ReleaseDelayUpdates)
+			continue;
+		//The entry and the cache hold a reference, other scenes sharing the cache may hold more
+		if (texture->texture && texture->texture.use_count() <= 2)
+			pTextureCache->UnloadTexture(texture->texture);
+		texture->texture = nullptr;
+		texture->requested = false;
+	}
+	m_DelayedReleases.erase(std::remove_if(m_DelayedReleases.begin(), m_DelayedReleases.end(),
+		[&](const DelayedRelease& release) { return m_UpdateIndex >= release.update + k_ReleaseDelayUpdates; }), m_DelayedReleases.end());
+
+	m_Stats.numResident = 0;
+	m_Stats.numLoading = 0;
+	for (const MaterialEntry& material : m_Materials) {
+		m_Stats.numResident += material.state == MaterialState::Resident ? 1 : 0;
+		m_Stats.numLoading += material.state == MaterialState::Loading ? 1 : 0;
+	}
+	m_Stats.numTextures = uint(std::count_if(m_Textures.begin(), m_Textures.end(), [](const std::unique_ptr<TextureEntry>& texture) { return texture->requested; }));
+	m_Stats.residentBytes = residentBytes;
+	return changedMaterials;
+}
+
+void TextureResidency::Release(TextureCache& textureCache)
+{
+	TaskScheduler::Get().Wait(m_LoadGroup);
+	for (std::unique_ptr<TextureEntry>& texture : m_Textures) {
+		if (texture->texture && texture->texture.use_count() <= 2)
+			textureCache.UnloadTexture(texture->texture);
+		texture->texture = nullptr;
+		texture->requested = false;
+		texture->numUsers = 0;
+	}
+	for (MaterialEntry& material : m_Materials)
+		material.metalRough = nullptr;
+	m_DelayedReleases.clear();
+}
+
+bool TextureResidency::IsTextureReady(TextureEntry& entry, TextureCache& textureCache) const
+{
+	if (!entry.decoded.load(std::memory_order_acquire))
+		return false;
+	if (!entry.texture || textureCache.IsTextureFinalized(entry.texture))
+		return true;
+	//Neither uploaded nor waiting for the upload: the file is missing or could not be decoded
+	return !textureCache.IsTextureLoaded(entry.texture);
+}
+
+void TextureResidency::MarkShaded(std::shared_ptr<TextureCache>& pTextureCache)
+{
+	uint numRequests = 0;
+	for (uint materialID : m_LastShaded) {
+		m_Materials[materialID].lastUsedUpdate = m_UpdateIndex;
+		if (m_Materials[materialID].state == MaterialState::Fallback && numRequests < k_MaxRequestsPerUpdate) {
+			RequestMaterial(materialID, pTextureCache);
+			numRequests++;
+		}
+	}
+}
+
+void TextureResidency::RequestMaterial(uint materialID, std::shared_ptr<TextureCache>& pTextureCache)
+{
+	MaterialEntry& material = m_Materials[materialID];
+	for (int index : material.textures) {
+		if (index < 0)
+			continue;
+		AddTextureUser(index);
+		TextureEntry* texture = m_Textures[index].get();
+		if (texture->requested)
+			continue;
+		//The file is decoded on the scheduler, the TextureCache uploads it in ProcessRenderingThreadCommands
+		texture->requested = true;
+		texture->decoded.store(false, std::memory_order_relaxed);
+		TaskScheduler::Get().Run(m_LoadGroup, [texture, pTextureCache]() {
+			texture->texture = pTextureCache->LoadTextureFromFileDeferred(texture->path, texture->sRGB);
+			texture->decoded.store(true, std::memory_order_release);
+		});
+	}
+	material.state = MaterialState::Loading;
+	m_Stats.numRequests++;
+}
+
+void TextureResidency::FinishMaterial(uint materialID, Material& material, const MetalRoughFunc& createMetalRough)
+{
+	MaterialEntry& entry = m_Materials[materialID];
+	auto getTexture = [&](TextureSlot slot) -> std::shared_ptr<LoadedTexture> {
+		int index = entry.textures[slot];
+		if (index < 0 || !m_Textures[index]->texture || !m_Textures[index]->texture->texture)
+			return nullptr;
+		return m_Textures[index]->texture;
+	};
+	material.baseOrDiffuseTexture = getTexture(Diffuse);
+	material.normalTexture = getTexture(Normal);
+	material.emissiveTexture = getTexture(Emissive);
+
+	std::shared_ptr<LoadedTexture> roughness = getTexture(Roughness);
+	if (roughness) {
+		std::shared_ptr<LoadedTexture> metallic = getTexture(Metallic);
+		entry.metalRough = createMetalRough(roughness->texture, metallic ? metallic->texture : nullptr, entry.convertShininessToRoughness);
+		material.metalRoughOrSpecularTexture = entry.metalRough;
+		material.metalnessInRedChannel = true;
+	}
+	//The single channel textures are only needed to create the metal rough texture
+	RemoveTextureUser(entry.textures[Roughness]);
+	RemoveTextureUser(entry.textures[Metallic]);
+
+	entry.state = MaterialState::Resident;
+	entry.lastUsedUpdate = m_UpdateIndex;
+}
+
+void TextureResidency::EvictMaterial(uint materialID, Material& material)
+{
+	MaterialEntry& entry = m_Materials[materialID];
+	material.baseOrDiffuseTexture = nullptr;
+	material.normalTexture = nullptr;
+	material.emissiveTexture = nullptr;
+	material.metalRoughOrSpecularTexture = nullptr;
+	if (entry.metalRough)
+		m_DelayedReleases.push_back({ std::move(entry.metalRough), m_UpdateIndex });
+	entry.metalRough = nullptr;
+	RemoveTextureUser(entry.textures[Diffuse]);
+	RemoveTextureUser(entry.textures[Normal]);
+	RemoveTextureUser(entry.textures[Emissive]);
+	entry.state = MaterialState::Fallback;
+	m_Stats.numEvictions++;
+}
+
+void TextureResidency::AddTextureUser(int textureIndex)
+{
+	if (textureIndex >= 0)
+		m_Textures[textureIndex]->numUsers++;
+}
+
+void TextureResidency::RemoveTextureUser(int textureIndex)
+{
+	if (textureIndex < 0)
+		return;
+	TextureEntry& texture = *m_Textures[textureIndex];
+	if (--texture.numUsers == 0)
+		texture.unusedSinceUpdate = m_UpdateIndex;
+}
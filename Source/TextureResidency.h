@@ -0,0 +1,122 @@
+#pragma once
+#include <donut/engine/SceneTypes.h>
+#include <donut/engine/TextureCache.h>
+#include <donut/core/math/math.h>
+#include <nvrhi/nvrhi.h>
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "TaskScheduler.h"
+
+using namespace donut::math;
+using namespace donut::engine;
+
+/* Loads material textures on first use instead of at scene load.
+   Materials start without textures, shaded with the average color of their textures. The ray tracing shader marks every material it
+   shades in a feedback buffer, which is read back a few frames later; the textures of newly marked materials are then decoded on the
+   TaskScheduler and uploaded by the TextureCache on the rendering thread. Once all textures of a material are uploaded, its constants
+   are rewritten to use them. If the textures of the resident materials exceed the budget, the least recently shaded materials fall back
+   to their average color again
+*/
+class TextureResidency {
+public:
+	//Textures of a material, as paths for the TextureCache. Empty paths are not loaded
+	struct MaterialTextures {
+		std::filesystem::path diffuse;
+		std::filesystem::path normal;
+		std::filesystem::path emissive;
+		std::filesystem::path roughness;	//Roughness or shininess, combined with metallic into a metal rough texture
+		std::filesystem::path metallic;
+		bool convertShininessToRoughness = false;
+	};
+
+	struct Stats {
+		uint numMaterials = 0;
+		uint numResident = 0;
+		uint numLoading = 0;
+		uint numTextures = 0;		//Textures in the TextureCache that were loaded for this scene
+		uint64_t residentBytes = 0;	//Textures used by resident materials, compared against the budget
+		uint64_t numRequests = 0;	//Material loads since the scene was loaded
+		uint64_t numEvictions = 0;
+	};
+
+	//Creates the metal rough texture of a material from its roughness (or shininess) and optional metallic texture
+	using MetalRoughFunc = std::function<std::shared_ptr<LoadedTexture>(nvrhi::TextureHandle roughness, nvrhi::TextureHandle metallic, bool convertShininessToRoughness)>;
+
+	TextureResidency(nvrhi::IDevice* device, const std::vector<MaterialTextures>& materialTextures);
+	~TextureResidency();
+
+	//Copies the feedback written by the last dispatch to a readback buffer and clears it. Call after the dispatch
+	void RecordFeedback(nvrhi::ICommandList* commandList, nvrhi::IBuffer* feedbackBuffer);
+
+	//Reads the oldest recorded feedback (all of it if no frame was traced since the last update), requests the textures of newly shaded materials, switches materials whose textures are uploaded
+	//and evicts above the budget. Returns the IDs of the materials that changed, their constants need to be uploaded again
+	std::vector<uint> Update(nvrhi::IDevice* device, std::vector<Material>& materials, std::shared_ptr<TextureCache>& pTextureCache,
+		const MetalRoughFunc& createMetalRough, uint64_t budgetBytes);
+
+	//Waits for running loads and removes all textures of the scene from the cache
+	void Release(TextureCache& textureCache);
+
+	const Stats& GetStats() const { return m_Stats; }
+
+private:
+	enum class MaterialState {
+		Fallback,	//Average colors only
+		Loading,	//Textures requested
+		Resident	//Textures in use
+	};
+	enum TextureSlot { Diffuse, Normal, Emissive, Roughness, Metallic, NumTextureSlots };
+
+	//A texture file, shared by all materials that use it. Loaded by one task at a time
+	struct TextureEntry {
+		std::filesystem::path path;
+		bool sRGB = false;
+		bool requested = false;					//A load task was started and the texture was not released since
+		std::atomic<bool> decoded = false;		//The load task finished, texture is set (it is not loaded if the file is missing)
+		std::shared_ptr<LoadedTexture> texture;
+		uint numUsers = 0;						//Loading or resident materials that need the texture
+		uint64_t unusedSinceUpdate = 0;
+	};
+
+	struct MaterialEntry {
+		MaterialState state = MaterialState::Fallback;
+		int textures[NumTextureSlots];			//Index into m_Textures, -1 if the slot is not used
+		bool convertShininessToRoughness = false;
+		uint64_t lastUsedUpdate = 0;
+		std::shared_ptr<LoadedTexture> metalRough;	//Generated, not part of the TextureCache
+	};
+
+	//True if the load of the texture finished and the TextureCache uploaded it (or gave up on it)
+	bool IsTextureReady(TextureEntry& entry, TextureCache& textureCache) const;
+	//Marks the materials of the last read feedback as used and requests their textures
+	void MarkShaded(std::shared_ptr<TextureCache>& pTextureCache);
+	void RequestMaterial(uint materialID, std::shared_ptr<TextureCache>& pTextureCache);
+	void FinishMaterial(uint materialID, Material& material, const MetalRoughFunc& createMetalRough);
+	void EvictMaterial(uint materialID, Material& material);
+	void AddTextureUser(int textureIndex);
+	void RemoveTextureUser(int textureIndex);
+
+	std::vector<MaterialEntry> m_Materials;
+	std::vector<std::unique_ptr<TextureEntry>> m_Textures;	//Pointers stay valid for the load tasks
+
+	//Feedback of a few frames is in flight, so that reading it back does not stall the GPU
+	static const uint k_FeedbackLatency = 3;
+	nvrhi::BufferHandle m_ReadbackBuffers[k_FeedbackLatency];
+	uint64_t m_NumRecordedFeedbacks = 0;
+	uint64_t m_NumReadFeedbacks = 0;
+	uint64_t m_NumRecordedAtLastUpdate = 0;
+	std::vector<uint> m_LastShaded;			//Materials shaded in the last read feedback
+
+	//Replaced metal rough textures are kept until the frames that may still use them are done
+	struct DelayedRelease {
+		std::shared_ptr<LoadedTexture> texture;
+		uint64_t update = 0;
+	};
+	std::vector<DelayedRelease> m_DelayedReleases;
+
+	TaskGroup m_LoadGroup;
+	uint64_t m_UpdateIndex = 0;
+	Stats m_Stats;
+};
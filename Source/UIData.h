@@ -0,0 +1,64 @@
+#pragma once
+#include <donut/core/math/math.h>
+
+using namespace donut::math;
+
+//UI data
+struct UIData {
+	//Light
+	float3 lightDirection = float3(-0.340f , -0.841f , 0.421);
+	float lightIntensity = 5.f;
+
+	//Camera
+	float cameraSpeed = 3.f;
+	float cameraFov = 0.78f;
+	float cameraNear = 0.1f;
+	float cameraFar = 1000.f;
+
+	//Rendering settings
+	float ambient = 0.1f;
+	float emissiveStrength = 1.0f;
+	float ambientSpecularStrength = 1.f;
+	int emissiveLightSamples = 1;		//Light tree samples per pixel for emissive blocks (0 = off)
+	
+	//Shadow
+	float shadowRayBias = 0.03;
+	int occupancyMaxSteps = 64;		//Occupancy grid steps before a shadow ray falls back to a full trace (0 = off)
+	
+	//Scene selection
+	int selectedScene = -1;
+
+	//Scene cache budgets in MB
+	int sceneCacheGpuBudgetMB = 4096;
+	int sceneCacheCpuBudgetMB = 4096;
+
+	//Textures
+	bool lazyTextures = false;		//Load textures on first use, materials use their average texture color until then
+	int textureBudgetMB = 512;		//Texture memory of the lazy textures before unused materials are evicted
+
+	//Frame reuse
+	bool reuseFrames = true;		//Show the last image again instead of tracing if the view, the settings and the scene did not change
+	int frameRateCap = 0;			//Maximum frames per second (0 = off)
+
+	//Dynamic resolution
+	bool dynamicResolution = false;	//Scale the trace resolution to keep the ray dispatch within the target time, the image is upscaled on the blit
+	float targetFrameMs = 16.6f;		//GPU time budget of the ray dispatch
+	float minResolutionScale = 0.5f;	//Bounds of the trace resolution relative to the window, per axis
+	float maxResolutionScale = 1.f;
+};
+
+//Calls the visitor with the name and the matching field of every given UIData, for all fields that affect the rendered image.
+//The scene selection is stored by name. The camera speed, scene cache budgets, texture and frame reuse settings do not change the image, and the dynamic resolution only through the trace resolution
+template<typename Visitor, typename... UI> void VisitRenderSettings(Visitor&& visit, UI&... ui) {
+	visit("lightDirection", ui.lightDirection...);
+	visit("lightIntensity", ui.lightIntensity...);
+	visit("cameraFov", ui.cameraFov...);
+	visit("cameraNear", ui.cameraNear...);
+	visit("cameraFar", ui.cameraFar...);
+	visit("ambient", ui.ambient...);
+	visit("emissiveStrength", ui.emissiveStrength...);
+	visit("ambientSpecularStrength", ui.ambientSpecularStrength...);
+	visit("emissiveLightSamples", ui.emissiveLightSamples...);
+	visit("shadowRayBias", ui.shadowRayBias...);
+	visit("occupancyMaxSteps", ui.occupancyMaxSteps...);
+}
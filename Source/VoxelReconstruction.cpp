@@ -0,0 +1,261 @@
+#include "VoxelReconstruction.h"
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace VoxelReconstruction;
+
+static const float k_Epsilon = 1e-3f;		//Position tolerance in blocks
+static const float k_UVEpsilon = 1e-2f;		//Mineways insets the texture coordinates slightly
+static const int k_OriginSteps = 64;		//Grid offsets are voted in 1/64 block steps
+static const size_t k_MaxVotes = 4096;		//Quads that vote for the grid offset
+static const int k_CellBits = 21;			//Bits per axis of the cell keys, cells within +-2^20 blocks
+static const uint64_t k_GrainSize = 4096;
+
+namespace {
+	//Block and side a grid quad belongs to, face -1 if the quad is not on the grid
+	struct QuadCell {
+		int3 cell = int3(0);
+		int face = -1;	//0:-x, 1:+x, 2:-z, 3:+z, 4:-y, 5:+y as in AABBMaterials
+	};
+
+	struct Block {
+		int materials[6] = { -1, -1, -1, -1, -1, -1 };
+		bool rejected = false;
+	};
+}
+
+//Axis of the quad plane if the quad is an axis aligned unit square, -1 otherwise
+static int GetUnitSquarePlane(const Quad& quad, float3& quadMin)
+{
+	float3 quadMax = quad.positions[0];
+	quadMin = quad.positions[0];
+	for (int i = 1; i < 4; i++) {
+		quadMin = min(quadMin, quad.positions[i]);
+		quadMax = max(quadMax, quad.positions[i]);
+	}
+	float3 extent = quadMax - quadMin;
+	int planeAxis = -1;
+	for (int axis = 0; axis < 3; axis++) {
+		if (extent[axis] < k_Epsilon) {
+			if (planeAxis >= 0)
+				return -1;
+			planeAxis = axis;
+		}
+		else if (std::abs(extent[axis] - 1.f) > k_Epsilon) {
+			return -1;
+		}
+	}
+	return planeAxis;
+}
+
+//The texture has to cover the face once, the AABB shader derives the texture coordinates from the hit position
+static bool CoversTexture(const Quad& quad)
+{
+	if (!quad.hasUVs)
+		return true;
+	float2 uvMin = quad.uvs[0];
+	float2 uvMax = quad.uvs[0];
+	for (int i = 0; i < 4; i++) {
+		for (float c : { quad.uvs[i].x, quad.uvs[i].y }) {
+			if (std::abs(c) > k_UVEpsilon && std::abs(c - 1.f) > k_UVEpsilon)
+				return false;
+		}
+		uvMin = min(uvMin, quad.uvs[i]);
+		uvMax = max(uvMax, quad.uvs[i]);
+	}
+	return uvMax.x - uvMin.x > 1.f - 2.f * k_UVEpsilon && uvMax.y - uvMin.y > 1.f - 2.f * k_UVEpsilon;
+}
+
+static bool IsInteger(float x)
+{
+	return std::abs(x - std::round(x)) < k_Epsilon;
+}
+
+static uint64_t GetCellKey(int3 cell)
+{
+	const int offset = 1 << (k_CellBits - 1);
+	return (uint64_t(uint32_t(cell.x + offset)) << (2 * k_CellBits)) | (uint64_t(uint32_t(cell.y + offset)) << k_CellBits) | uint64_t(uint32_t(cell.z + offset));
+}
+
+static bool IsCellInRange(int3 cell)
+{
+	const int limit = 1 << (k_CellBits - 1);
+	return all(cell >= int3(-limit)) && all(cell < int3(limit));
+}
+
+//Most common offset of the unit squares from the integer grid
+static float3 VoteGridOrigin(const Quad* quads, size_t numQuads)
+{
+	std::map<std::tuple<int, int, int>, uint> votes;
+	for (size_t i = 0; i < numQuads && votes.size() < k_MaxVotes; i++) {
+		float3 quadMin;
+		if (GetUnitSquarePlane(quads[i], quadMin) < 0)
+			continue;
+		int3 offset;
+		for (int axis = 0; axis < 3; axis++) {
+			float fraction = quadMin[axis] - std::floor(quadMin[axis]);
+			offset[axis] = int(std::round(fraction * k_OriginSteps)) % k_OriginSteps;
+		}
+		votes[{ offset.x, offset.y, offset.z }]++;
+	}
+
+	std::tuple<int, int, int> best = { 0, 0, 0 };
+	uint bestVotes = 0;
+	for (const auto& [offset, count] : votes) {
+		if (count > bestVotes) {
+			best = offset;
+			bestVotes = count;
+		}
+	}
+	return float3(float(std::get<0>(best)), float(std::get<1>(best)), float(std::get<2>(best))) / float(k_OriginSteps);
+}
+
+void VoxelReconstruction::Reconstruct(const Quad* quads, size_t numQuads, const float3* otherCentroids, size_t numOtherCentroids, const float3* blockMins, size_t numBlockMins,
+	Result& result, std::pmr::memory_resource* resource)
+{
+	result = Result();
+	result.quadUsed.assign(numQuads, 0);
+	result.stats.numQuads = numQuads;
+	if (numQuads == 0)
+		return;
+	const float3 origin = VoteGridOrigin(quads, numQuads);
+	result.stats.gridOrigin = origin;
+
+	//Cells of the existing blocks, only those on the grid can share a face with a grid quad
+	std::pmr::unordered_set<uint64_t> existingBlocks(resource);
+	existingBlocks.reserve(numBlockMins);
+	for (size_t i = 0; i < numBlockMins; i++) {
+		float3 gridMin = blockMins[i] - origin;
+		int3 cell = int3(int(std::round(gridMin.x)), int(std::round(gridMin.y)), int(std::round(gridMin.z)));
+		if (IsInteger(gridMin.x) && IsInteger(gridMin.y) && IsInteger(gridMin.z) && IsCellInRange(cell))
+			existingBlocks.insert(GetCellKey(cell));
+	}
+
+	//Grid cell and side of every quad, independent per quad
+	std::pmr::vector<QuadCell> quadCells(numQuads, resource);
+	std::pmr::vector<uint8_t> onExistingBlock(numQuads, 0, resource);
+	TaskScheduler::Get().ParallelFor(0, numQuads, k_GrainSize, [&](uint64_t begin, uint64_t end) {
+		for (uint64_t i = begin; i < end; i++) {
+			const Quad& quad = quads[i];
+			float3 quadMin;
+			int planeAxis = GetUnitSquarePlane(quad, quadMin);
+			if (planeAxis < 0 || !CoversTexture(quad))
+				continue;
+			float3 gridMin = quadMin - origin;
+			if (!IsInteger(gridMin.x) || !IsInteger(gridMin.y) || !IsInteger(gridMin.z))
+				continue;
+			//The normal has to point along the plane axis
+			float normalLength = length(quad.normal);
+			if (normalLength == 0.f || std::abs(quad.normal[planeAxis]) < 0.5f * normalLength)
+				continue;
+
+			bool positive = quad.normal[planeAxis] > 0.f;
+			int3 cell = int3(int(std::round(gridMin.x)), int(std::round(gridMin.y)), int(std::round(gridMin.z)));
+			//A face on the positive side lies on the far plane of its block
+			if (positive)
+				cell[planeAxis] -= 1;
+			if (!IsCellInRange(cell))
+				continue;
+			//The quad lies on an existing block if the cell behind or in front of it is one
+			int3 frontCell = cell;
+			frontCell[planeAxis] += positive ? 1 : -1;
+			if (!existingBlocks.empty() && (existingBlocks.count(GetCellKey(cell)) > 0 || (IsCellInRange(frontCell) && existingBlocks.count(GetCellKey(frontCell)) > 0))) {
+				onExistingBlock[i] = 1;
+				continue;
+			}
+
+			static const int k_AxisFaces[3] = { 0, 4, 2 };
+			quadCells[i].cell = cell;
+			quadCells[i].face = k_AxisFaces[planeAxis] + (positive ? 1 : 0);
+		}
+	});
+
+	//Blocks in the order of their first face
+	std::pmr::unordered_map<uint64_t, uint32_t> blockIndices(resource);
+	std::pmr::vector<Block> blocks(resource);
+	std::pmr::vector<int3> blockCells(resource);
+	std::pmr::vector<uint32_t> quadBlocks(numQuads, UINT32_MAX, resource);
+	for (size_t i = 0; i < numQuads; i++) {
+		result.stats.numQuadsOnBlocks += onExistingBlock[i];
+		if (quadCells[i].face < 0)
+			continue;
+		result.stats.numGridQuads++;
+		auto [it, inserted] = blockIndices.emplace(GetCellKey(quadCells[i].cell), uint32_t(blocks.size()));
+		if (inserted) {
+			blocks.emplace_back();
+			blockCells.push_back(quadCells[i].cell);
+		}
+		Block& block = blocks[it->second];
+		int& material = block.materials[quadCells[i].face];
+		if (material >= 0)
+			block.rejected = true;
+		material = quads[i].materialID;
+		quadBlocks[i] = it->second;
+	}
+
+	//Geometry strictly inside a block means it is not a full block. Grid quads that did not become a face are checked as well
+	auto rejectContaining = [&](float3 position) {
+		float3 gridPosition = position - origin;
+		float3 cellMin = floor(gridPosition);
+		float3 fraction = gridPosition - cellMin;
+		if (any(fraction < float3(k_Epsilon)) || any(fraction > float3(1.f - k_Epsilon)))
+			return;
+		int3 cell = int3(int(cellMin.x), int(cellMin.y), int(cellMin.z));
+		if (!IsCellInRange(cell))
+			return;
+		auto it = blockIndices.find(GetCellKey(cell));
+		if (it != blockIndices.end())
+			blocks[it->second].rejected = true;
+	};
+	for (size_t i = 0; i < numOtherCentroids; i++)
+		rejectContaining(otherCentroids[i]);
+	for (size_t i = 0; i < numQuads; i++) {
+		if (quadCells[i].face < 0)
+			rejectContaining((quads[i].positions[0] + quads[i].positions[1] + quads[i].positions[2] + quads[i].positions[3]) * 0.25f);
+	}
+
+	result.aabbs.reserve(blocks.size());
+	result.materials.reserve(blocks.size());
+	for (size_t b = 0; b < blocks.size(); b++) {
+		Block& block = blocks[b];
+		if (block.rejected) {
+			result.stats.numRejectedBlocks++;
+			continue;
+		}
+		//Covered faces use the opposite face, or any exported face
+		int anyMaterial = *std::max_element(block.materials, block.materials + 6);
+		int faceMaterials[6];
+		for (int face = 0; face < 6; face++) {
+			faceMaterials[face] = block.materials[face];
+			if (faceMaterials[face] < 0)
+				faceMaterials[face] = block.materials[face ^ 1] >= 0 ? block.materials[face ^ 1] : anyMaterial;
+		}
+
+		AABB aabb;
+		aabb.min = float3(float(blockCells[b].x), float(blockCells[b].y), float(blockCells[b].z)) + origin;
+		aabb.max = aabb.min + float3(1.f);
+		AABBMaterials materials;
+		materials.negXMatID = faceMaterials[0];
+		materials.posXMatID = faceMaterials[1];
+		materials.negZMatID = faceMaterials[2];
+		materials.posZMatID = faceMaterials[3];
+		materials.negYMatID = faceMaterials[4];
+		materials.posYMatID = faceMaterials[5];
+		materials.padding = int2(0);
+		result.aabbs.push_back(aabb);
+		result.materials.push_back(materials);
+	}
+	result.stats.numBlocks = result.aabbs.size();
+
+	for (size_t i = 0; i < numQuads; i++) {
+		if (quadBlocks[i] != UINT32_MAX && !blocks[quadBlocks[i]].rejected) {
+			result.quadUsed[i] = 1;
+			result.stats.numUsedQuads++;
+		}
+	}
+}
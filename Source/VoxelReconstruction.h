@@ -0,0 +1,48 @@
+#pragma once
+#include <donut/core/math/math.h>
+#include <memory_resource>
+#include <vector>
+
+using namespace donut::math;
+#include "sharedShaderData.h" //Needs namespace donut::math;
+
+/* Rebuilds blocks from merged face exports, where Mineways writes only the visible faces of the blocks instead of 12 triangles per block.
+   Quads that are axis aligned unit squares on the block grid and show the whole texture are assigned to the block behind them (the side their
+   normal points away from). Every block with at least one such face becomes an AABB; faces that were not exported because a neighbor covers them
+   get the material of the opposite or another exported face, they cannot be seen. A block is rejected, and its quads stay triangles, if other
+   geometry lies inside it (slabs, stairs, water), or if two quads claim the same face.
+   Quads on a face of a block that is already in the scene (a 12 triangle shape of an export with individual blocks) are not rebuilt, they are
+   rails, lily pads or carpets lying on that block.
+   The grid offset is found by a vote over the quads, the block size is one unit as everywhere else in the renderer
+*/
+namespace VoxelReconstruction {
+	struct Quad {
+		float3 positions[4];
+		float2 uvs[4];
+		bool hasUVs = false;
+		float3 normal = float3(0.f);	//Outward facing normal, not necessarily normalized
+		int materialID = -1;
+	};
+
+	struct Stats {
+		uint64_t numQuads = 0;
+		uint64_t numGridQuads = 0;		//Quads that are unit squares on the grid
+		uint64_t numUsedQuads = 0;		//Quads that became a face of a block
+		uint64_t numQuadsOnBlocks = 0;	//Grid quads on a face of an existing block, they stay triangles
+		uint64_t numBlocks = 0;
+		uint64_t numRejectedBlocks = 0;
+		float3 gridOrigin = float3(0.f);
+	};
+
+	struct Result {
+		std::vector<AABB> aabbs;
+		std::vector<AABBMaterials> materials;
+		std::vector<uint8_t> quadUsed;	//Per quad, 1 if it is a face of a block and has to be removed from the triangles
+		Stats stats;
+	};
+
+	//otherCentroids are the centroids of all remaining triangles, blockMins the minimum corners of the blocks already in the scene.
+	//Temporaries are allocated from the resource
+	void Reconstruct(const Quad* quads, size_t numQuads, const float3* otherCentroids, size_t numOtherCentroids, const float3* blockMins, size_t numBlockMins,
+		Result& result, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+}
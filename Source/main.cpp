@@ -3,6 +3,8 @@
 #include <donut/core/log.h>
 #include "Renderer.h"
 #include "RendererUI.h"
+#include "BatchRenderer.h"
+#include "ShardedRenderer.h"
 
 #ifdef WIN32
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
@@ -11,6 +13,90 @@ int main(int __argc, const char** __argv)
 #endif //WIN32
 {
 	nvrhi::GraphicsAPI api = app::GetGraphicsAPIFromCommandLine(__argc, __argv);
+
+	//Camera path options: -record <path file> or -replay <path file> [-report <json file>]
+	//Headless CPU ray benchmark of all scenes: -cpubenchmark [json file]
+	//Headless batch rendering on the GPU or the CPU: -batch <job file> [-workers N] [-framesperitem N] [-pvs [margin cells]] [-cpu] [-report <json file>]
+	//Sharded batch rendering, every process loads a slab of the scene: -batch <job file> -shards N [-shardscaling] [-report <json file>]
+	std::filesystem::path recordFile, replayFile, reportFile, cpuBenchmarkFile, batchFile, batchQueue;
+	bool cpuBenchmark = false;
+	BatchSettings batchSettings;
+	ShardSettings shardSettings;
+	bool sharded = false;
+	int batchWorker = -1;
+	int shardWorker = -1;
+	int shardJob = 0;
+	SceneRegion shardRegion;
+	uint batchThreads = 0;
+	for (int i = 1; i < __argc; i++) {
+		std::string arg = __argv[i];
+		bool hasValue = i + 1 < __argc && __argv[i + 1][0] != '-';
+		if (arg == "-record" && hasValue)
+			recordFile = __argv[++i];
+		else if (arg == "-replay" && hasValue)
+			replayFile = __argv[++i];
+		else if (arg == "-report" && hasValue)
+			reportFile = __argv[++i];
+		else if (arg == "-cpubenchmark") {
+			cpuBenchmark = true;
+			cpuBenchmarkFile = hasValue ? std::filesystem::path(__argv[++i]) : app::GetDirectoryWithExecutable().parent_path() / "CpuRayBenchmark.json";
+		}
+		else if (arg == "-batch" && hasValue)
+			batchFile = __argv[++i];
+		else if (arg == "-workers" && hasValue)
+			batchSettings.numWorkers = uint(std::max(std::atoi(__argv[++i]), 1));
+		else if (arg == "-framesperitem" && hasValue)
+			batchSettings.framesPerItem = uint(std::max(std::atoi(__argv[++i]), 1));
+		else if (arg == "-pvs") {
+			batchSettings.pvsCulling = true;
+			if (hasValue)
+				batchSettings.pvsMargin = uint(std::max(std::atoi(__argv[++i]), 0));
+		}
+		else if (arg == "-cpu")
+			batchSettings.cpuRendering = true;
+		else if (arg == "-threads" && hasValue)
+			batchThreads = uint(std::max(std::atoi(__argv[++i]), 0));
+		//Started by the batch coordinator: -batchworker <job file> <queue folder> <worker index>
+		else if (arg == "-batchworker" && i + 3 < __argc) {
+			batchFile = __argv[++i];
+			batchQueue = __argv[++i];
+			batchWorker = std::atoi(__argv[++i]);
+		}
+		else if (arg == "-shards" && hasValue) {
+			sharded = true;
+			shardSettings.numShards = uint(std::max(std::atoi(__argv[++i]), 1));
+		}
+		else if (arg == "-shardscaling")
+			shardSettings.scaling = true;
+		//Started by the sharded coordinator: -shardworker <job file> <exchange folder> <job index> <shard index> <axis> <region min> <region max>
+		else if (arg == "-shardworker" && i + 7 < __argc) {
+			batchFile = __argv[++i];
+			batchQueue = __argv[++i];
+			shardJob = std::atoi(__argv[++i]);
+			shardWorker = std::atoi(__argv[++i]);
+			int axis = std::clamp(std::atoi(__argv[++i]), 0, 2);
+			shardRegion.min[axis] = std::strtof(__argv[++i], nullptr);
+			shardRegion.max[axis] = std::strtof(__argv[++i], nullptr);
+		}
+	}
+	if (!replayFile.empty() && reportFile.empty())
+		reportFile = std::filesystem::path(replayFile).replace_extension(".json");
+
+	//The batch mode needs no window, its workers create a headless device if they can
+	batchSettings.graphicsAPI = api;
+	if (batchWorker >= 0)
+		return BatchRenderer::RunWorker(batchFile, batchQueue, uint(batchWorker), batchThreads, batchSettings);
+	if (shardWorker >= 0)
+		return ShardedRenderer::RunWorker(batchFile, batchQueue, uint(shardJob), uint(shardWorker), shardRegion, batchThreads);
+	if (!batchFile.empty() && sharded) {
+		shardSettings.reportFile = reportFile;
+		return ShardedRenderer::Run(batchFile, shardSettings);
+	}
+	if (!batchFile.empty()) {
+		batchSettings.reportFile = reportFile;
+		return BatchRenderer::Run(batchFile, batchSettings);
+	}
+
 	app::DeviceManager* deviceManager = app::DeviceManager::Create(api);
 
 	app::DeviceCreationParameters deviceParams;
@@ -39,11 +125,23 @@ int main(int __argc, const char** __argv)
 		Renderer voxelTest(deviceManager, &uiData);
 		UserInterface gui(deviceManager, &uiData, &voxelTest);
 
-		if (voxelTest.Init() && gui.Init(voxelTest.GetShaderFactory()))
+		if (cpuBenchmark)
 		{
+			if (voxelTest.Init())
+				voxelTest.RunCpuRayBenchmarks(cpuBenchmarkFile);
+		}
+		else if (voxelTest.Init() && gui.Init(voxelTest.GetShaderFactory()))
+		{
+			//The benchmark replay closes the window once the report is written
+			if (!replayFile.empty())
+				voxelTest.StartReplay(replayFile, reportFile, true);
+			else if (!recordFile.empty())
+				voxelTest.StartRecording(recordFile);
+
 			deviceManager->AddRenderPassToBack(&voxelTest);
 			deviceManager->AddRenderPassToBack(&gui);
 			deviceManager->RunMessageLoop();
+			voxelTest.StopRecording();
 			deviceManager->RemoveRenderPass(&gui);
 			deviceManager->RemoveRenderPass(&voxelTest);
 		}
@@ -16,7 +16,23 @@ struct ConstBuffer {
 
 	float ambientSpecular;
 	float shadowRayOffset;
-	float2 padding;
+	uint numEmissiveLights;
+	uint frameIndex;
+
+	uint emissiveLightSamples;
+	uint occupancyMaxSteps;		//Step limit of the occupancy grid early-out for shadow rays, 0 disables it
+	uint sceneHasTriangles;
+	uint textureFeedback;		//Marks shaded materials in the material feedback buffer (lazy textures)
+
+	float3 occupancyGridOrigin;	//World position of the first cell of the occupancy grid
+	float padding2;
+	uint3 occupancyGridRegions;	//Number of regions per axis
+	float padding3;
+
+	int3 pvsOriginCell;			//First cell of the potentially visible set in units of cells
+	uint pvsCulling;			//Primary rays skip primitives in cells that are not visible from the camera cell (g_VisibleCells), 0 disables it
+	uint3 pvsGridSize;			//Number of cells per axis
+	float pvsCellSize;
 };
 
 struct CBMetalRoughTexGen {
@@ -76,5 +92,58 @@ struct AABBMaterials {
 	int2 padding;
 };
 
+//Emissive block face (quad) or triangle used for light sampling
+struct EmissiveLight {
+	float3 origin;
+	int matID;
+
+	float3 edge1;
+	float power;
+
+	float3 edge2;
+	uint flags;		//See EMISSIVE_LIGHT_FLAG_*
+};
+
+#define EMISSIVE_LIGHT_FLAG_TRIANGLE 0x1u
+#define EMISSIVE_LIGHT_FLAG_DOUBLE_SIDED 0x2u
+
+//Node of the light BVH. Children of an inner node are stored next to each other (childOrLight, childOrLight + 1).
+//Leafs reference exactly one light
+struct LightTreeNode {
+	float3 boundsMin;
+	float power;
+
+	float3 boundsMax;
+	uint childOrLight;	//Light index if LIGHT_TREE_LEAF_FLAG is set, otherwise index of the first child
+};
+
+#define LIGHT_TREE_LEAF_FLAG 0x80000000u
+
+//Region of the occupancy grid (4x4x4 bricks of 4x4x4 block cells). Bit b = x + 4 * y + 16 * z of brickMask is set if the brick
+//contains geometry. The 64-bit cell masks of the non-empty bricks are stored consecutively, starting at firstBrick
+struct OccupancyRegion {
+	uint2 brickMask;	//Low and high 32 bits
+	uint firstBrick;
+	uint padding;
+};
+
+#define OCCUPANCY_BRICK_SIZE 4
+#define OCCUPANCY_REGION_SIZE 16
+
+//Consecutive triangles that share a vertex range and use 16-bit indices relative to baseVertex.
+//Each region is one geometry of the triangle BLAS, so GeometryIndex() selects the region
+struct TriangleRegion {
+	uint firstTriangle;
+	uint numTriangles;
+	uint baseVertex;
+	uint indexOffset;	//Byte offset of the first index in the index buffer
+};
+
+#define TRIANGLE_REGION_MAX_VERTICES 65536
+
+//Instance masks of the TLAS
+#define INSTANCE_MASK_TRIANGLES 0x1u
+#define INSTANCE_MASK_AABBS 0x2u
+
 #endif // !USE_SHARED_SHADER_DATA
 
@@ -0,0 +1,97 @@
+#include "FrameChangeTracker.h"
+#include "TestUtils.h"
+#include <string>
+
+//Drives FrameChangeTracker::Update with made up frames and checks which of them are traced
+
+static void Perturb(float& value) { value += 0.5f; }
+static void Perturb(int& value) { value += 1; }
+static void Perturb(float3& value) { value.y += 0.5f; }
+
+//The matrix is a plain array of floats
+static float* GetMatrixElements(float4x4& matrix) { return reinterpret_cast<float*>(&matrix); }
+
+static FrameChangeTracker::Inputs MakeInputs(const void* scene) {
+	FrameChangeTracker::Inputs inputs;
+	inputs.viewProjection = float4x4::identity();
+	GetMatrixElements(inputs.viewProjection)[12] = 2.f;
+	inputs.scene = scene;
+	inputs.sceneVersion = 1;
+	inputs.resolution = uint2(1280, 720);
+	return inputs;
+}
+
+//After a frame with the base inputs, traces the changed frame once and reuses it afterwards
+static void CheckChange(FrameChangeTracker& tracker, const FrameChangeTracker::Inputs& base, const FrameChangeTracker::Inputs& changed, const std::string& what) {
+	tracker.Update(base);
+	FrameChangeTracker::Stats before = tracker.GetStats();
+	Check(tracker.Update(changed), "a change of " + what + " does not trace a new frame");
+	Check(!tracker.Update(changed), "the frame after a change of " + what + " is traced again");
+	Check(tracker.GetStats().tracedFrames == before.tracedFrames + 1 && tracker.GetStats().reusedFrames == before.reusedFrames + 1,
+		"the counters after a change of " + what + " are wrong");
+}
+
+int main()
+{
+	const int sceneA = 0, sceneB = 0;
+	FrameChangeTracker tracker;
+	FrameChangeTracker::Inputs inputs = MakeInputs(&sceneA);
+
+	//The first frame is always traced, identical frames reuse it
+	Check(tracker.Update(inputs), "the first frame is not traced");
+	for (int frame = 0; frame < 10; frame++)
+		Check(!tracker.Update(MakeInputs(&sceneA)), "identical inputs trace a new frame");
+	Check(tracker.GetStats().tracedFrames == 1 && tracker.GetStats().reusedFrames == 10, "counters of identical frames are wrong");
+
+	//Every input on its own
+	FrameChangeTracker::Inputs changed = inputs;
+	for (int element = 0; element < 16; element++) {
+		changed = inputs;
+		GetMatrixElements(changed.viewProjection)[element] += 1e-3f;
+		CheckChange(tracker, inputs, changed, "matrix element " + std::to_string(element));
+	}
+	uint numFields = 0;
+	VisitRenderSettings([&](const char* name, auto&) {
+		uint field = numFields++;
+		FrameChangeTracker::Inputs changedSetting = inputs;
+		uint index = 0;
+		VisitRenderSettings([&](const char*, auto& value) {
+			if (index++ == field)
+				Perturb(value);
+		}, changedSetting.settings);
+		CheckChange(tracker, inputs, changedSetting, std::string("the setting ") + name);
+	}, inputs.settings);
+	Check(numFields > 0, "no render settings visited");
+
+	changed = inputs;
+	changed.scene = &sceneB;
+	CheckChange(tracker, inputs, changed, "the scene");
+	changed = inputs;
+	changed.sceneVersion++;
+	CheckChange(tracker, inputs, changed, "the scene version");
+	changed = inputs;
+	changed.resolution.x = 1920;
+	CheckChange(tracker, inputs, changed, "the resolution width");
+	changed = inputs;
+	changed.resolution.y = 1080;
+	CheckChange(tracker, inputs, changed, "the resolution height");
+
+	//Settings that do not change the image are not compared
+	changed = inputs;
+	changed.settings.cameraSpeed *= 2.f;
+	changed.settings.reuseFrames = !changed.settings.reuseFrames;
+	changed.settings.sceneCacheGpuBudgetMB *= 2;
+	changed.settings.textureBudgetMB *= 2;
+	tracker.Update(inputs);
+	Check(!tracker.Update(changed), "a setting that does not change the image traces a new frame");
+
+	//Invalidate forces one trace of unchanged inputs
+	tracker.ResetStats();
+	tracker.Update(inputs);
+	tracker.Invalidate();
+	Check(tracker.Update(inputs), "Invalidate does not trace the next frame");
+	Check(!tracker.Update(inputs), "the frame after Invalidate is traced again");
+	Check(tracker.GetStats().tracedFrames == 1 && tracker.GetStats().reusedFrames == 2, "counters after ResetStats and Invalidate are wrong");
+
+	return FinishTest("FrameChangeTrackerTest");
+}
@@ -0,0 +1,134 @@
+#include "LightTree.h"
+#include "TaskScheduler.h"
+#include "TestUtils.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+//Builds light trees from synthetic lights and checks their structure, the power sums, the sampling pdfs and the parallel build
+
+static void Check(bool condition, const char* test, const char* message, size_t numLights) {
+	Check(condition, std::string(test) + " (" + std::to_string(numLights) + " lights): " + message);
+}
+
+//Quads and triangles of random size, orientation and power in a cube of the given size
+static std::vector<EmissiveLight> MakeLights(size_t numLights, float sceneSize, uint seed) {
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> position(0.f, sceneSize);
+	std::uniform_real_distribution<float> edge(-1.f, 1.f);
+	std::uniform_real_distribution<float> power(0.01f, 10.f);
+	std::vector<EmissiveLight> lights(numLights);
+	for (size_t i = 0; i < numLights; i++) {
+		EmissiveLight& light = lights[i];
+		light.origin = float3(position(random), position(random), position(random));
+		light.edge1 = float3(edge(random), edge(random), edge(random));
+		light.edge2 = float3(edge(random), edge(random), edge(random));
+		light.power = power(random);
+		light.matID = int(i);
+		light.flags = (i % 3 == 0) ? EMISSIVE_LIGHT_FLAG_TRIANGLE : 0u;
+	}
+	return lights;
+}
+
+//Leaf count per light, walking down from the root
+static void CountLeaves(const LightTree& tree, uint nodeIndex, std::vector<uint>& leafCount, uint& numVisited) {
+	const std::vector<LightTreeNode>& nodes = tree.GetNodes();
+	if (nodeIndex >= nodes.size() || ++numVisited > nodes.size())
+		return;
+	const LightTreeNode& node = nodes[nodeIndex];
+	if (node.childOrLight & LIGHT_TREE_LEAF_FLAG) {
+		uint light = node.childOrLight & ~LIGHT_TREE_LEAF_FLAG;
+		if (light < leafCount.size())
+			leafCount[light]++;
+		return;
+	}
+	CountLeaves(tree, node.childOrLight, leafCount, numVisited);
+	CountLeaves(tree, node.childOrLight + 1, leafCount, numVisited);
+}
+
+static void TestTree(size_t numLights, TaskScheduler& scheduler) {
+	const float sceneSize = 16.f + std::sqrt(float(numLights));
+	const std::vector<EmissiveLight> lights = MakeLights(numLights, sceneSize, uint(numLights));
+	LightTree tree;
+	tree.BuildFromLights(lights, &scheduler);
+
+	Check(tree.GetNumLights() == numLights, "build", "light count differs", numLights);
+	Check(tree.GetNodes().size() == 2 * numLights - 1, "build", "not 2n - 1 nodes", numLights);
+
+	double sumPower = 0.0;
+	for (const EmissiveLight& light : lights)
+		sumPower += light.power;
+	Check(std::abs(double(tree.GetTotalPower()) - sumPower) <= 1e-4 * sumPower, "power", "root power is not the sum of the light powers", numLights);
+
+	//The leaf indices refer to the reordered lights, which have to be the input lights
+	std::vector<uint> leafCount(numLights, 0);
+	uint numVisited = 0;
+	CountLeaves(tree, 0, leafCount, numVisited);
+	bool everyLightOnce = numVisited == tree.GetNodes().size();
+	for (uint count : leafCount)
+		everyLightOnce &= count == 1;
+	Check(everyLightOnce, "leaves", "a light is not reachable as exactly one leaf", numLights);
+	std::vector<int> materials;
+	for (const EmissiveLight& light : tree.GetLights())
+		materials.push_back(light.matID);
+	std::sort(materials.begin(), materials.end());
+	bool permutation = true;
+	for (size_t i = 0; i < materials.size(); i++)
+		permutation &= materials[i] == int(i);
+	Check(permutation, "leaves", "the lights of the tree are not a permutation of the input", numLights);
+
+	//Inside, at the corner and far outside of the lights
+	const float3 shadingPoints[] = { float3(0.5f * sceneSize), float3(0.f), float3(-4.f * sceneSize, sceneSize, 2.f * sceneSize) };
+	uint frameIndex = 0;
+	for (float3 position : shadingPoints) {
+		double sumPdf = 0.0;
+		for (uint light = 0; light < numLights; light++)
+			sumPdf += tree.GetLightPdf(position, light);
+		Check(std::abs(sumPdf - 1.0) <= 1e-4, "pdf", "the pdfs of all leaves do not sum to 1", numLights);
+
+		bool samplesMatch = true;
+		for (uint sample = 0; sample < 256; sample++) {
+			uint rngState = LightTree::InitRandomSeed(uint2(sample, 0), frameIndex);
+			uint lightIndex = 0;
+			float pdf = 0.f;
+			if (!tree.SampleLight(position, rngState, lightIndex, pdf) || lightIndex >= numLights) {
+				samplesMatch = false;
+				continue;
+			}
+			float expected = tree.GetLightPdf(position, lightIndex);
+			samplesMatch &= pdf > 0.f && std::abs(pdf - expected) <= 1e-4f * expected;
+		}
+		Check(samplesMatch, "pdf", "SampleLight returns a pdf that differs from the pdf of its leaf", numLights);
+		frameIndex++;
+	}
+
+	//Subtrees are built as tasks, the result has to match the build on one thread
+	LightTree serialTree;
+	serialTree.BuildFromLights(lights, nullptr);
+	bool sameNodes = serialTree.GetNodes().size() == tree.GetNodes().size()
+		&& memcmp(serialTree.GetNodes().data(), tree.GetNodes().data(), tree.GetNodes().size() * sizeof(LightTreeNode)) == 0;
+	bool sameLights = serialTree.GetLights().size() == tree.GetLights().size()
+		&& memcmp(serialTree.GetLights().data(), tree.GetLights().data(), tree.GetLights().size() * sizeof(EmissiveLight)) == 0;
+	Check(sameNodes && sameLights, "parallel", "the parallel build differs from the single threaded build", numLights);
+}
+
+int main()
+{
+	TaskScheduler scheduler(4);
+
+	LightTree empty;
+	empty.BuildFromLights({}, &scheduler);
+	uint rngState = LightTree::InitRandomSeed(uint2(0, 0), 0);
+	uint lightIndex = 0;
+	float pdf = 0.f;
+	Check(empty.GetNodes().empty() && !empty.SampleLight(float3(0.f), rngState, lightIndex, pdf), "empty", "an empty tree has nodes or samples a light", 0);
+
+	//Above 4096 lights the subtrees are built in parallel
+	for (size_t numLights : { 1, 2, 3, 7, 64, 1000, 5000, 50000 })
+		TestTree(numLights, scheduler);
+
+	return FinishTest("LightTreeTest");
+}
@@ -0,0 +1,371 @@
+#include "SyntheticScene.h"
+#include "MinecraftSceneLoader.h"
+#include "AnvilImporter.h"
+#include "BenchmarkReport.h"
+#include "TaskScheduler.h"
+#include "RecordingDevice.h"
+#include <donut/core/log.h>
+#include <donut/core/vfs/VFS.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace donut;
+
+static const int k_NumStages = 4;
+static const MinecraftSceneLoader::LoadStage k_Stages[k_NumStages] = { MinecraftSceneLoader::LoadStage::Parse, MinecraftSceneLoader::LoadStage::Geometry,
+	MinecraftSceneLoader::LoadStage::Materials, MinecraftSceneLoader::LoadStage::Buffers };
+
+//Resident memory (working set) of the process in bytes
+static uint64_t GetResidentBytes() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters = {};
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.WorkingSetSize;
+	return 0;
+#else
+	FILE* statm = fopen("/proc/self/statm", "r");
+	if (!statm)
+		return 0;
+	unsigned long long totalPages = 0, residentPages = 0;
+	int count = fscanf(statm, "%llu %llu", &totalPages, &residentPages);
+	fclose(statm);
+	return count == 2 ? residentPages * uint64_t(sysconf(_SC_PAGESIZE)) : 0;
+#endif
+}
+
+/* Tracks the peak resident memory between Reset calls by polling it on a background thread.
+   The process peak of the OS can not be reset on all platforms, so it can not be used per stage
+*/
+class MemorySampler {
+public:
+	MemorySampler() : m_Thread([this]() { Run(); }) {}
+	~MemorySampler() {
+		m_Stop = true;
+		m_Thread.join();
+	}
+
+	//Starts a new measurement and returns the current resident memory
+	uint64_t Reset() {
+		uint64_t bytes = GetResidentBytes();
+		m_Peak = bytes;
+		return bytes;
+	}
+	uint64_t GetPeak() {
+		Sample();
+		return m_Peak;
+	}
+
+private:
+	void Sample() {
+		uint64_t bytes = GetResidentBytes();
+		uint64_t peak = m_Peak.load();
+		while (bytes > peak && !m_Peak.compare_exchange_weak(peak, bytes)) {}
+	}
+	void Run() {
+		while (!m_Stop) {
+			Sample();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	std::atomic<uint64_t> m_Peak = 0;
+	std::atomic<bool> m_Stop = false;
+	std::thread m_Thread;
+};
+
+struct StageResult {
+	std::vector<double> ms;
+	uint64_t peakBytes = 0;			//Highest resident memory during the stage over all runs
+	int64_t retainedBytes = 0;		//Change of the resident memory by the stage in the last run
+};
+
+struct SceneResult {
+	std::string scene;
+	uint64_t fileBytes = 0;
+	uint numBlocks = 0;
+	uint numTriangles = 0;
+	uint numVertices = 0;
+	uint numMaterials = 0;
+	LoadArena::Stats arena;			//Load temporaries of the last run
+	std::array<StageResult, k_NumStages> stages;
+	bool recorded = false;			//device and deviceLoadMs are set, see RecordScene
+	RecordingDevice::Stats device;
+	double deviceLoadMs = 0.0;
+	TaskGraph::Report loadTasks;	//Tasks of the recorded LoadScene
+};
+
+//Bytes of the .obj and .mtl, or of the region files of a world folder
+static uint64_t GetSceneBytes(const std::filesystem::path& scene) {
+	std::error_code error;
+	uint64_t bytes = 0;
+	if (AnvilImporter::IsWorldFolder(scene)) {
+		for (const AnvilImporter::RegionFile& region : AnvilImporter::FindRegionFiles(scene))
+			bytes += std::filesystem::file_size(region.path, error);
+		return bytes;
+	}
+	bytes += std::filesystem::file_size(scene, error);
+	uint64_t mtlBytes = std::filesystem::file_size(std::filesystem::path(scene).replace_extension(".mtl"), error);
+	return bytes + (error ? 0 : mtlBytes);
+}
+
+//Runs the CPU stages of the loader on the scene. Every run uses a new loader, so the memory of the previous run is freed
+static bool BenchmarkScene(const std::filesystem::path& scene, uint numRuns, MemorySampler& sampler, SceneResult& result) {
+	result.scene = scene.filename().string();
+	result.fileBytes = GetSceneBytes(scene);
+	for (uint run = 0; run < numRuns; run++) {
+		std::chrono::high_resolution_clock::time_point stageStart;
+		uint64_t stageStartBytes = 0;
+		MinecraftSceneLoader loader(nullptr);
+		loader.SetStageCallback([&](MinecraftSceneLoader::LoadStage stage, bool finished) {
+			if (!finished) {
+				stageStartBytes = sampler.Reset();
+				stageStart = std::chrono::high_resolution_clock::now();
+				return;
+			}
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - stageStart).count();
+			StageResult& stageResult = result.stages[int(stage)];
+			stageResult.ms.push_back(ms);
+			stageResult.peakBytes = std::max(stageResult.peakBytes, sampler.GetPeak());
+			stageResult.retainedBytes = int64_t(GetResidentBytes()) - int64_t(stageStartBytes);
+		});
+		loader.SetArenaCallback([&](const LoadArena::Stats& stats) { result.arena = stats; });
+
+		std::vector<tinyobj::material_t> materials;
+		std::vector<uint> materialSourceIndices;
+		if (!loader.PrepareScene(scene.parent_path(), scene.filename().string(), materials, materialSourceIndices))
+			return false;
+
+		const MinecraftSceneLoader::SceneStats& stats = loader.GetSceneStats();
+		result.numBlocks = uint(stats.numAABBs);
+		result.numTriangles = uint(stats.numTriangles);
+		result.numVertices = uint(loader.GetVertices().size());
+		result.numMaterials = uint(materialSourceIndices.size());
+	}
+	return true;
+}
+
+//Runs all of LoadScene against a RecordingDevice, with the textures, shader and resources the renderer would get, and records what it creates,
+//uploads and builds. The uploads do not change between runs, so it runs once after the CPU stages
+static bool RecordScene(const std::filesystem::path& scene, const std::filesystem::path& shaderFolder, SceneResult& result) {
+	nvrhi::DeviceHandle device = RecordingDevice::Create();
+	auto rootFS = std::make_shared<vfs::RootFileSystem>();
+	rootFS->mount("/shaders/app", shaderFolder);
+	rootFS->mount("/MinecraftModels", std::filesystem::absolute(scene.parent_path()));
+	auto shaderFactory = std::make_shared<engine::ShaderFactory>(device, rootFS, "/shaders");
+
+	//Same bindless layout as Renderer::InitBindingLayouts
+	nvrhi::BindlessLayoutDesc bindlessLayoutDesc;
+	bindlessLayoutDesc.visibility = nvrhi::ShaderType::All;
+	bindlessLayoutDesc.firstSlot = 0;
+	bindlessLayoutDesc.maxCapacity = 4096;
+	bindlessLayoutDesc.registerSpaces = { nvrhi::BindingLayoutItem::Texture_SRV(1) };
+	auto descriptorTable = std::make_shared<engine::DescriptorTableManager>(device, device->createBindlessLayout(bindlessLayoutDesc));
+	auto textureCache = std::make_shared<engine::TextureCache>(device, rootFS, descriptorTable);
+	nvrhi::CommandListHandle commandList = device->createCommandList();
+	RecordingDevice::ResetStats(device);
+
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	MinecraftSceneLoader loader(shaderFactory);
+	commandList->open();
+	bool loaded = loader.LoadScene(scene.parent_path(), scene.filename().string(), device, commandList, textureCache, descriptorTable);
+	commandList->close();
+	device->executeCommandList(commandList);
+	result.deviceLoadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	result.device = RecordingDevice::GetStats(device);
+	result.recorded = loaded;
+	result.loadTasks = loader.GetLoadReport();
+
+	loader.UnloadScene(textureCache);
+	return loaded;
+}
+
+static bool WriteReport(const std::filesystem::path& reportFile, const std::vector<SceneResult>& results, uint numRuns) {
+	std::ofstream stream(reportFile);
+	if (!stream) {
+		log::warning("LoaderBenchmark: could not write %s", reportFile.string().c_str());
+		return false;
+	}
+
+	stream.precision(6);
+	stream << std::fixed;
+	stream << "{\n  \"numThreads\": " << TaskScheduler::Get().GetNumThreads() << ",\n  \"numRuns\": " << numRuns << ",\n  \"scenes\": [";
+	for (size_t i = 0; i < results.size(); i++) {
+		const SceneResult& result = results[i];
+		double totalMs = 0.0;
+		uint64_t peakBytes = 0;
+		for (const StageResult& stage : result.stages) {
+			totalMs += BenchmarkReport::Summarize(stage.ms).p50;
+			peakBytes = std::max(peakBytes, stage.peakBytes);
+		}
+		double parseMs = BenchmarkReport::Summarize(result.stages[int(MinecraftSceneLoader::LoadStage::Parse)].ms).p50;
+
+		stream << (i == 0 ? "\n" : ",\n");
+		stream << "    { \"scene\": \"" << BenchmarkReport::EscapeJson(result.scene) << "\", \"fileBytes\": " << result.fileBytes
+			<< ", \"blocks\": " << result.numBlocks << ", \"triangles\": " << result.numTriangles << ", \"vertices\": " << result.numVertices
+			<< ", \"materials\": " << result.numMaterials << ", \"totalMs\": " << totalMs << ", \"peakBytes\": " << peakBytes
+			<< ", \"parseMBPerSecond\": " << (parseMs > 0.0 ? double(result.fileBytes) / (1 << 20) / (parseMs / 1000.0) : 0.0)
+			<< ",\n      \"arena\": { \"allocations\": " << result.arena.numAllocations << ", \"bytes\": " << result.arena.allocatedBytes
+			<< ", \"chunks\": " << result.arena.numChunks << ", \"chunkBytes\": " << result.arena.chunkBytes << ", \"allocatorMs\": " << result.arena.allocatorMs
+			<< " },\n";
+		if (result.recorded) {
+			const RecordingDevice::Stats& device = result.device;
+			stream << "      \"device\": { \"loadMs\": " << result.deviceLoadMs << ", \"uploadBytes\": " << device.GetUploadBytes()
+				<< ", \"buffers\": " << device.numBuffers << ", \"bufferBytes\": " << device.bufferBytes << ", \"bufferWrites\": " << device.numBufferWrites
+				<< ", \"bufferWriteBytes\": " << device.bufferWriteBytes << ", \"textures\": " << device.numTextures << ", \"textureBytes\": " << device.textureBytes
+				<< ", \"textureWrites\": " << device.numTextureWrites << ", \"textureWriteBytes\": " << device.textureWriteBytes
+				<< ",\n        \"accelStructs\": " << device.numAccelStructs << ", \"blasBuilds\": " << device.numBlasBuilds << ", \"blasGeometries\": " << device.blasGeometries
+				<< ", \"blasTriangles\": " << device.blasTriangles << ", \"blasAABBs\": " << device.blasAABBs << ", \"tlasBuilds\": " << device.numTlasBuilds
+				<< ", \"tlasInstances\": " << device.tlasInstances << ", \"dispatches\": " << device.numDispatches << ", \"shaders\": " << device.numShaders
+				<< ", \"pipelines\": " << device.numPipelines << ", \"bindingSets\": " << device.numBindingSets << ", \"descriptorWrites\": " << device.numDescriptorWrites
+				<< ",\n        \"graphMs\": " << result.loadTasks.totalMs << ", \"criticalPathMs\": " << result.loadTasks.criticalPathMs
+				<< ", \"busyMs\": " << result.loadTasks.busyMs << ", \"loadTasks\": [";
+			for (size_t t = 0; t < result.loadTasks.tasks.size(); t++) {
+				const TaskGraph::TaskTiming& task = result.loadTasks.tasks[t];
+				stream << (t == 0 ? "\n" : ",\n") << "          { \"task\": \"" << BenchmarkReport::EscapeJson(task.name) << "\", \"readyMs\": " << task.readyMs
+					<< ", \"startMs\": " << task.startMs << ", \"endMs\": " << task.endMs << ", \"thread\": " << task.threadIndex
+					<< ", \"mainThread\": " << (task.mainThread ? "true" : "false") << ", \"critical\": " << (task.critical ? "true" : "false")
+					<< ", \"skipped\": " << (task.skipped ? "true" : "false") << " }";
+			}
+			stream << "\n        ] },\n";
+		}
+		stream << "      \"stages\": [\n";
+		for (int s = 0; s < k_NumStages; s++) {
+			const StageResult& stage = result.stages[s];
+			BenchmarkReport::Summary summary = BenchmarkReport::Summarize(stage.ms);
+			double primitivesPerSecond = summary.p50 > 0.0 ? double(result.numBlocks + result.numTriangles) / (summary.p50 / 1000.0) : 0.0;
+			stream << "        { \"stage\": \"" << MinecraftSceneLoader::GetStageName(k_Stages[s]) << "\", \"ms\": " << summary.p50 << ", \"minMs\": " << summary.min
+				<< ", \"maxMs\": " << summary.max << ", \"primitivesPerSecond\": " << primitivesPerSecond << ", \"peakBytes\": " << stage.peakBytes
+				<< ", \"retainedBytes\": " << stage.retainedBytes << " }" << (s + 1 < k_NumStages ? ",\n" : "\n");
+		}
+		stream << "      ] }";
+	}
+	stream << "\n  ]\n}\n";
+	log::info("LoaderBenchmark: report written to %s", reportFile.string().c_str());
+	return true;
+}
+
+static void PrintUsage() {
+	printf("Usage: LoaderBenchmark [options] [scene .obj files or world folders]\n"
+		"  -generate <min> <max>  generates synthetic scenes with 10^min to 10^max blocks (default 4 6 if no scenes are given)\n"
+		"  -scenes <folder>       folder for the generated scenes (default LoaderBenchmarkScenes)\n"
+		"  -keep                  keeps the generated scenes, otherwise they are deleted after their benchmark\n"
+		"  -types, -alpha, -props, -height, -seed <value>  generator settings, see SceneGenerator\n"
+		"  -merged                generates merged face scenes, see SceneGenerator\n"
+		"  -repeat <n>            runs per scene, the report contains the median (default 3)\n"
+		"  -device                also runs the full load against a recording device without a GPU and reports the created objects,\n"
+		"                         uploads and acceleration structure inputs (generated scenes get textures)\n"
+		"  -shaders <folder>      compiled shaders for -device (default shaders/MinewaysRenderer/dxil next to the executable)\n"
+		"  -report <file.json>    report file (default LoaderBenchmark.json)\n");
+}
+
+int main(int argc, const char** argv)
+{
+	std::vector<std::filesystem::path> scenes;
+	std::filesystem::path sceneFolder = "LoaderBenchmarkScenes";
+	std::filesystem::path reportFile = "LoaderBenchmark.json";
+	SyntheticScene::Settings settings;
+	int minExponent = 4, maxExponent = 6;
+	bool generate = false, keepScenes = false, recordDevice = false;
+	std::filesystem::path shaderFolder = std::filesystem::path(argv[0]).parent_path() / "shaders/MinewaysRenderer/dxil";
+	uint numRuns = 3;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "-generate" && i + 2 < argc) {
+			generate = true;
+			minExponent = std::atoi(argv[++i]);
+			maxExponent = std::atoi(argv[++i]);
+		}
+		else if (arg == "-scenes" && hasValue)
+			sceneFolder = argv[++i];
+		else if (arg == "-keep")
+			keepScenes = true;
+		else if (arg == "-merged")
+			settings.mergedFaces = true;
+		else if (arg == "-types" && hasValue)
+			settings.numBlockTypes = uint32_t(std::atoi(argv[++i]));
+		else if (arg == "-alpha" && hasValue)
+			settings.alphaFraction = float(std::atof(argv[++i]));
+		else if (arg == "-props" && hasValue)
+			settings.propDensity = float(std::atof(argv[++i]));
+		else if (arg == "-height" && hasValue)
+			settings.averageHeight = uint32_t(std::max(std::atoi(argv[++i]), 1));
+		else if (arg == "-seed" && hasValue)
+			settings.seed = std::strtoull(argv[++i], nullptr, 10);
+		else if (arg == "-repeat" && hasValue)
+			numRuns = uint(std::max(std::atoi(argv[++i]), 1));
+		else if (arg == "-report" && hasValue)
+			reportFile = argv[++i];
+		else if (arg == "-device")
+			recordDevice = true;
+		else if (arg == "-shaders" && hasValue)
+			shaderFolder = argv[++i];
+		else if (arg[0] != '-')
+			scenes.push_back(arg);
+		else {
+			PrintUsage();
+			return 1;
+		}
+	}
+	if (scenes.empty())
+		generate = true;
+	settings.writeTextures = recordDevice;	//Textures are only loaded by the full load on the recording device
+
+	MemorySampler sampler;
+	std::vector<SceneResult> results;
+	for (const std::filesystem::path& scene : scenes) {
+		SceneResult result;
+		if (BenchmarkScene(scene, numRuns, sampler, result) && (!recordDevice || RecordScene(scene, shaderFolder, result)))
+			results.push_back(result);
+		else
+			log::warning("LoaderBenchmark: loading %s failed", scene.string().c_str());
+	}
+
+	//Generated scenes are benchmarked one after the other, so only one of them is on disk at a time
+	for (int exponent = minExponent; generate && exponent <= maxExponent; exponent++) {
+		settings.numBlocks = 1;
+		for (int i = 0; i < exponent; i++)
+			settings.numBlocks *= 10;
+		std::string name = SyntheticScene::GetDefaultName(settings);
+		std::filesystem::path objFile = sceneFolder / (name + ".obj");
+
+		bool existed = std::filesystem::exists(objFile);
+		if (!existed) {
+			SyntheticScene::Stats stats;
+			log::info("LoaderBenchmark: generating %s", name.c_str());
+			if (!SyntheticScene::Write(sceneFolder, name, settings, stats)) {
+				log::warning("LoaderBenchmark: could not write %s", objFile.string().c_str());
+				continue;
+			}
+		}
+
+		SceneResult result;
+		if (BenchmarkScene(objFile, numRuns, sampler, result) && (!recordDevice || RecordScene(objFile, shaderFolder, result)))
+			results.push_back(result);
+		else
+			log::warning("LoaderBenchmark: loading %s failed", objFile.string().c_str());
+
+		if (!existed && !keepScenes) {
+			std::error_code error;
+			std::filesystem::remove(objFile, error);
+			std::filesystem::remove(std::filesystem::path(objFile).replace_extension(".mtl"), error);
+			std::filesystem::remove_all(sceneFolder / (name + "_textures"), error);
+		}
+	}
+
+	return WriteReport(reportFile, results, numRuns) ? 0 : 1;
+}
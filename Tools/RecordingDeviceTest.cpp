@@ -0,0 +1,67 @@
+#include "MinecraftSceneLoader.h"
+#include "RecordingDevice.h"
+#include "SyntheticScene.h"
+#include "TestUtils.h"
+#include <donut/core/vfs/VFS.h>
+#include <string>
+
+using namespace donut;
+
+//Loads a synthetic export with LoadScene against a RecordingDevice and checks the recorded acceleration structure builds and uploads
+
+int main(int argc, const char** argv)
+{
+	const std::filesystem::path folder = std::filesystem::temp_directory_path() / "RecordingDeviceTest";
+	std::error_code error;
+	std::filesystem::remove_all(folder, error);
+
+	SyntheticScene::Settings settings;
+	settings.numBlocks = 2000;
+	settings.propDensity = 0.1f;
+	SyntheticScene::Stats sceneStats;
+	Check(SyntheticScene::Write(folder, "scene", settings, sceneStats), "could not write the synthetic scene");
+	Check(sceneStats.numProps > 0, "the synthetic scene has no props");
+
+	//Same setup as LoaderBenchmark -device, the compiled shaders of the renderer are next to the executable
+	const std::filesystem::path shaderFolder = argc > 1 ? std::filesystem::path(argv[1]) : std::filesystem::path(argv[0]).parent_path() / "shaders/MinewaysRenderer/dxil";
+	nvrhi::DeviceHandle device = RecordingDevice::Create();
+	Check(RecordingDevice::IsRecordingDevice(device), "the created device is not a recording device");
+	auto rootFS = std::make_shared<vfs::RootFileSystem>();
+	rootFS->mount("/shaders/app", shaderFolder);
+	rootFS->mount("/MinecraftModels", std::filesystem::absolute(folder));
+	auto shaderFactory = std::make_shared<engine::ShaderFactory>(device, rootFS, "/shaders");
+	nvrhi::BindlessLayoutDesc bindlessLayoutDesc;
+	bindlessLayoutDesc.visibility = nvrhi::ShaderType::All;
+	bindlessLayoutDesc.firstSlot = 0;
+	bindlessLayoutDesc.maxCapacity = 4096;
+	bindlessLayoutDesc.registerSpaces = { nvrhi::BindingLayoutItem::Texture_SRV(1) };
+	auto descriptorTable = std::make_shared<engine::DescriptorTableManager>(device, device->createBindlessLayout(bindlessLayoutDesc));
+	auto textureCache = std::make_shared<engine::TextureCache>(device, rootFS, descriptorTable);
+	nvrhi::CommandListHandle commandList = device->createCommandList();
+	RecordingDevice::ResetStats(device);
+
+	{
+		MinecraftSceneLoader loader(shaderFactory);
+		commandList->open();
+		bool loaded = loader.LoadScene(folder, "scene.obj", device, commandList, textureCache, descriptorTable);
+		commandList->close();
+		device->executeCommandList(commandList);
+		Check(loaded, "LoadScene failed on the recording device");
+
+		//One BLAS of the blocks and one of the prop triangles, every block is a box of an individual block export
+		RecordingDevice::Stats stats = RecordingDevice::GetStats(device);
+		Check(stats.numBlasBuilds == 2, "LoadScene built " + std::to_string(stats.numBlasBuilds) + " BLAS instead of 2");
+		Check(stats.blasAABBs == sceneStats.numBlocks, "the block BLAS has " + std::to_string(stats.blasAABBs) + " boxes instead of " +
+			std::to_string(sceneStats.numBlocks));
+		Check(stats.blasTriangles == 4 * sceneStats.numProps, "the triangle BLAS has " + std::to_string(stats.blasTriangles) + " triangles instead of " +
+			std::to_string(4 * sceneStats.numProps));
+		Check(stats.numTlasBuilds == 1 && stats.tlasInstances == 2, "the TLAS is not built once with both BLAS");
+		Check(stats.bufferWriteBytes > 0, "LoadScene uploaded no buffer data");
+		Check(stats.numExecutedCommandLists > 0, "no command list was executed");
+
+		loader.UnloadScene(textureCache);
+	}
+
+	std::filesystem::remove_all(folder, error);
+	return FinishTest("RecordingDeviceTest");
+}
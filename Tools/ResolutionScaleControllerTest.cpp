@@ -0,0 +1,160 @@
+#include "ResolutionScaleController.h"
+#include "TestUtils.h"
+#include <cmath>
+#include <random>
+#include <string>
+
+//Feeds synthetic frame times into ResolutionScaleController::Update and checks the scale decisions, the quantization and the budget adherence
+
+static bool NearlyEqual(double a, double b) { return std::abs(a - b) <= 1e-5; }
+
+//Frame time of a workload that costs fullScaleMs at scale 1 and is proportional to the pixel count
+static double GetFrameMs(double fullScaleMs, float scale) { return fullScaleMs * double(scale) * double(scale); }
+
+static void TestDrop() {
+	ResolutionScaleSettings settings;
+	ResolutionScaleController controller;
+	controller.Reset(settings.maxScale);
+
+	//sqrt(16.6 / 40) = 0.644, the largest step that fits is 0.625
+	uint framesToChange = 0;
+	while (!controller.Update(GetFrameMs(40.0, controller.GetScale()), settings) && framesToChange < 100)
+		framesToChange++;
+	Check(controller.GetScale() == 0.625f, "an over budget frame time drops to " + std::to_string(controller.GetScale()) + " instead of 0.625");
+	Check(framesToChange + 1 == settings.settleFrames, "the scale drops after " + std::to_string(framesToChange + 1) + " frames instead of the settle frames");
+	Check(controller.GetStats().scaleChanges == 1, "the drop takes more than one change");
+	for (int frame = 0; frame < 500; frame++)
+		controller.Update(GetFrameMs(40.0, controller.GetScale()), settings);
+	Check(controller.GetScale() == 0.625f && controller.GetStats().scaleChanges == 1, "the scale does not stay at the step that fits the budget");
+
+	//Far over the budget the scale stops at the lower bound
+	for (int frame = 0; frame < 500; frame++)
+		controller.Update(GetFrameMs(1000.0, controller.GetScale()), settings);
+	Check(controller.GetScale() == settings.minScale, "an overloaded frame time leaves the lower bound");
+}
+
+static void TestRise() {
+	ResolutionScaleSettings settings;
+	ResolutionScaleController controller;
+	controller.Reset(settings.minScale);
+
+	//A light workload fits at every scale, the scale rises step by step to the upper bound
+	float lastScale = controller.GetScale();
+	bool singleSteps = true;
+	uint numChanges = 0;
+	for (int frame = 0; frame < 1000; frame++) {
+		if (!controller.Update(GetFrameMs(8.0, controller.GetScale()), settings))
+			continue;
+		singleSteps &= NearlyEqual(controller.GetScale() - lastScale, settings.scaleStep);
+		lastScale = controller.GetScale();
+		numChanges++;
+	}
+	Check(singleSteps, "the scale rises by more than one step at a time");
+	Check(controller.GetScale() == settings.maxScale, "the scale does not rise to the upper bound");
+	Check(numChanges == 4, "the rise from 0.5 to 1 takes " + std::to_string(numChanges) + " changes instead of 4");
+
+	//The next step would exceed the budget: 18 ms at 1, 13.8 ms at 0.875 which is below the hysteresis band
+	controller.Reset(0.875f);
+	for (int frame = 0; frame < 1000; frame++)
+		controller.Update(GetFrameMs(18.0, controller.GetScale()), settings);
+	Check(controller.GetStats().scaleChanges == 0, "the scale rises to a step that does not fit the budget");
+}
+
+static void TestHysteresis() {
+	ResolutionScaleSettings settings;
+	ResolutionScaleController controller;
+	std::mt19937 random(3);
+	std::uniform_real_distribution<double> noise(-0.03, 0.03);
+
+	//Frame times within the band around the target keep the scale
+	const double bandFrameMs[] = { settings.targetFrameMs * 0.94, settings.targetFrameMs, settings.targetFrameMs * 1.06 };
+	for (double frameMs : bandFrameMs) {
+		controller.Reset(0.75f);
+		for (int frame = 0; frame < 2000; frame++)
+			controller.Update(frameMs * (1.0 + noise(random)), settings);
+		Check(controller.GetStats().scaleChanges == 0, "a frame time of " + std::to_string(frameMs) + " ms within the hysteresis band changes the scale");
+	}
+
+	//20 ms at 1 drops once to 0.875, where 15.3 ms is within the band
+	controller.Reset(1.f);
+	for (int frame = 0; frame < 2000; frame++)
+		controller.Update(GetFrameMs(20.0, controller.GetScale()) * (1.0 + noise(random)), settings);
+	Check(controller.GetScale() == 0.875f && controller.GetStats().scaleChanges == 1, "the scale oscillates after a drop into the hysteresis band");
+}
+
+static void TestQuantize() {
+	ResolutionScaleSettings settings;
+	settings.minScale = 0.3f;
+	settings.maxScale = 0.9f;
+	settings.scaleStep = 0.125f;
+	bool inBounds = true;
+	bool onSteps = true;
+	for (float scale = 0.f; scale <= 2.f; scale += 0.01f) {
+		float quantized = ResolutionScaleController::Quantize(scale, settings);
+		inBounds &= quantized >= settings.minScale && quantized <= settings.maxScale;
+		onSteps &= NearlyEqual(std::round(quantized / settings.scaleStep) * settings.scaleStep, quantized);
+	}
+	Check(inBounds, "Quantize leaves the bounds");
+	Check(onSteps, "Quantize returns a scale that is not a multiple of the step");
+	Check(ResolutionScaleController::Quantize(0.f, settings) == 0.375f && ResolutionScaleController::Quantize(2.f, settings) == 0.875f,
+		"Quantize does not clamp to the steps inside the bounds");
+	Check(ResolutionScaleController::Quantize(0.55f, settings) == 0.5f && ResolutionScaleController::Quantize(0.7f, settings) == 0.75f,
+		"Quantize does not round to the nearest step");
+
+	//Bounds that do not contain a step collapse to a single scale
+	settings.minScale = 0.6f;
+	settings.maxScale = 0.55f;
+	Check(ResolutionScaleController::Quantize(0.f, settings) == ResolutionScaleController::Quantize(1.f, settings), "Quantize of empty bounds is not a single scale");
+
+	//Changed bounds apply with the next update
+	ResolutionScaleSettings defaults;
+	ResolutionScaleController controller;
+	controller.Reset(1.f);
+	defaults.maxScale = 0.75f;
+	Check(controller.Update(defaults.targetFrameMs, defaults) && controller.GetScale() == 0.75f, "a lower upper bound does not apply right away");
+
+	Check(ResolutionScaleController::GetTraceResolution(uint2(1920, 1080), 0.5f).x == 960 && ResolutionScaleController::GetTraceResolution(uint2(1920, 1080), 0.5f).y == 540,
+		"the trace resolution is not the scaled display resolution");
+	Check(ResolutionScaleController::GetTraceResolution(uint2(1, 1), 0.1f).x == 1, "the trace resolution is below 1x1");
+}
+
+static void TestAdherence() {
+	//A huge band keeps the scale, the adherence only depends on the measured times
+	ResolutionScaleSettings settings;
+	settings.hysteresis = 100.f;
+	ResolutionScaleController controller;
+	controller.Reset(1.f);
+	const double inBudgetMs = settings.targetFrameMs * 0.5;
+	const double overBudgetMs = settings.targetFrameMs * 2.0;
+	const uint window = ResolutionScaleController::k_AdherenceWindow;
+
+	//Before the window is full the adherence is over the measured frames
+	for (uint frame = 0; frame < 10; frame++)
+		controller.Update(frame % 2 ? overBudgetMs : inBudgetMs, settings);
+	Check(NearlyEqual(controller.GetStats().budgetAdherence, 0.5), "the adherence of a partial window is wrong");
+
+	controller.Reset(1.f);
+	for (uint frame = 0; frame < window; frame++)
+		controller.Update(inBudgetMs, settings);
+	Check(controller.GetStats().budgetAdherence == 1.f, "a full window in budget has an adherence below 1");
+	for (uint frame = 0; frame < window / 4; frame++)
+		controller.Update(overBudgetMs, settings);
+	Check(NearlyEqual(controller.GetStats().budgetAdherence, 0.75), "over budget frames do not replace the oldest frames of the window");
+	for (uint frame = 0; frame < window; frame++)
+		controller.Update(overBudgetMs, settings);
+	Check(controller.GetStats().budgetAdherence == 0.f, "frames older than the window count for the adherence");
+	controller.Update(settings.targetFrameMs, settings);
+	Check(NearlyEqual(controller.GetStats().budgetAdherence, 1.0 / window), "a frame time equal to the budget is not within it");
+	Check(controller.GetStats().measuredFrames == 2 * window + window / 4 + 1 && controller.GetStats().scaleChanges == 0, "the measured frames are not counted");
+}
+
+int main()
+{
+	TestDrop();
+	TestRise();
+	TestHysteresis();
+	TestQuantize();
+	TestAdherence();
+
+	return FinishTest("ResolutionScaleControllerTest");
+}
@@ -0,0 +1,283 @@
+#include "MinecraftSceneLoader.h"
+#include "AnvilImporter.h"
+#include "SceneArchive.h"
+#include "PotentiallyVisibleSet.h"
+#include "BenchmarkReport.h"
+#include "TaskScheduler.h"
+#include <donut/core/log.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+using namespace donut;
+
+struct ConversionResult {
+	std::string scene;
+	std::string archive;
+	uint64_t sourceBytes = 0;
+	double sourceLoadMs = 0.0;		//Parse and geometry stages of the loader for the source
+	double writeMs = 0.0;
+	double decodeMs = 0.0;			//Median over the runs
+	double readMs = 0.0;
+	bool verified = false;
+	SceneArchive::Stats stats;
+	bool hasPvs = false;
+	PotentiallyVisibleSet::Stats pvsStats;
+};
+
+//Bytes of the .obj and .mtl, or of the region files of a world folder
+static uint64_t GetSourceBytes(const std::filesystem::path& scene) {
+	std::error_code error;
+	uint64_t bytes = 0;
+	if (AnvilImporter::IsWorldFolder(scene)) {
+		for (const AnvilImporter::RegionFile& region : AnvilImporter::FindRegionFiles(scene))
+			bytes += std::filesystem::file_size(region.path, error);
+		return bytes;
+	}
+	bytes += std::filesystem::file_size(scene, error);
+	uint64_t mtlBytes = std::filesystem::file_size(std::filesystem::path(scene).replace_extension(".mtl"), error);
+	return bytes + (error ? 0 : mtlBytes);
+}
+
+//Blocks and triangles of both scenes have to match, in any order
+static bool ContentsMatch(const SceneArchive::Contents& a, const SceneArchive::Contents& b) {
+	struct BlockRecord {
+		AABB aabb;
+		AABBMaterials materials;
+	};
+	struct TriangleRecord {
+		VertexData vertices[3];
+		int material;
+	};
+	//The records have no padding, so they can be compared bytewise (which also tells -0 from 0)
+	auto less = [](const auto& x, const auto& y) { return memcmp(&x, &y, sizeof(x)) < 0; };
+	auto equal = [](const auto& x, const auto& y) { return memcmp(&x, &y, sizeof(x)) == 0; };
+	auto getBlocks = [&](const SceneArchive::Contents& contents) {
+		std::vector<BlockRecord> records(contents.aabbs.size());
+		for (size_t i = 0; i < records.size(); i++) {
+			records[i].aabb = contents.aabbs[i];
+			records[i].materials = contents.aabbMaterials[i];
+		}
+		std::sort(records.begin(), records.end(), less);
+		return records;
+	};
+	auto getTriangles = [&](const SceneArchive::Contents& contents) {
+		std::vector<TriangleRecord> records(contents.triangleMaterialIDs.size());
+		for (size_t i = 0; i < records.size(); i++) {
+			for (int k = 0; k < 3; k++)
+				records[i].vertices[k] = contents.vertices[contents.indices[i * 3 + k]];
+			records[i].material = contents.triangleMaterialIDs[i];
+		}
+		std::sort(records.begin(), records.end(), less);
+		return records;
+	};
+
+	std::vector<BlockRecord> blocksA = getBlocks(a), blocksB = getBlocks(b);
+	std::vector<TriangleRecord> trianglesA = getTriangles(a), trianglesB = getTriangles(b);
+	if (blocksA.size() != blocksB.size() || trianglesA.size() != trianglesB.size() || a.materials.size() != b.materials.size())
+		return false;
+	for (size_t i = 0; i < blocksA.size(); i++) {
+		if (!equal(blocksA[i], blocksB[i]))
+			return false;
+	}
+	for (size_t i = 0; i < trianglesA.size(); i++) {
+		if (!equal(trianglesA[i], trianglesB[i]))
+			return false;
+	}
+	for (size_t i = 0; i < a.materials.size(); i++) {
+		if (a.materials[i].name != b.materials[i].name || a.materials[i].diffuse_texname != b.materials[i].diffuse_texname)
+			return false;
+	}
+	return true;
+}
+
+//Loads the scene with the CPU stages of the loader and writes what it would keep as an archive
+static bool ConvertScene(const std::filesystem::path& scene, const std::filesystem::path& archive, uint numRuns, bool verify, bool buildPvs,
+	ConversionResult& result) {
+	result.scene = scene.filename().string();
+	result.archive = archive.string();
+	result.sourceBytes = GetSourceBytes(scene);
+
+	std::chrono::high_resolution_clock::time_point stageStart;
+	MinecraftSceneLoader loader(nullptr);
+	loader.SetStageCallback([&](MinecraftSceneLoader::LoadStage stage, bool finished) {
+		if (!finished)
+			stageStart = std::chrono::high_resolution_clock::now();
+		else if (stage == MinecraftSceneLoader::LoadStage::Parse || stage == MinecraftSceneLoader::LoadStage::Geometry)
+			result.sourceLoadMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - stageStart).count();
+	});
+	std::vector<tinyobj::material_t> materials;
+	std::vector<uint> materialSourceIndices;
+	if (!loader.PrepareScene(scene.parent_path(), scene.filename().string(), materials, materialSourceIndices)) {
+		log::warning("SceneConverter: loading %s failed", scene.string().c_str());
+		return false;
+	}
+
+	//The geometry refers to the deduplicated materials
+	SceneArchive::Contents contents;
+	contents.aabbs = loader.GetAABBs();
+	contents.aabbMaterials = loader.GetAABBMaterials();
+	contents.vertices = loader.GetVertices();
+	contents.indices = loader.GetIndices();
+	contents.triangleMaterialIDs = loader.GetTriangleMaterialIDs();
+	for (uint source : materialSourceIndices)
+		contents.materials.push_back(materials[source]);
+
+	auto writeStart = std::chrono::high_resolution_clock::now();
+	if (!SceneArchive::Write(archive, contents, &result.stats)) {
+		log::warning("SceneConverter: could not write %s", archive.string().c_str());
+		return false;
+	}
+	result.writeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - writeStart).count();
+
+	std::vector<double> decodeMs, readMs;
+	SceneArchive::Contents decoded;
+	for (uint run = 0; run < numRuns; run++) {
+		SceneArchive::Stats stats;
+		if (!SceneArchive::Read(archive, decoded, &stats)) {
+			log::warning("SceneConverter: could not read back %s", archive.string().c_str());
+			return false;
+		}
+		decodeMs.push_back(stats.decodeMs);
+		readMs.push_back(stats.readMs);
+	}
+	result.decodeMs = BenchmarkReport::Summarize(decodeMs).p50;
+	result.readMs = BenchmarkReport::Summarize(readMs).p50;
+	if (verify) {
+		result.verified = ContentsMatch(contents, decoded);
+		if (!result.verified) {
+			log::warning("SceneConverter: %s does not decode to the source scene", archive.string().c_str());
+			return false;
+		}
+	}
+
+	const SceneArchive::Stats& stats = result.stats;
+	log::info("SceneConverter: %s -> %s, %llu blocks, %llu triangles, %llu vertices (%llu duplicated), %u chunks", result.scene.c_str(),
+		archive.filename().string().c_str(), (unsigned long long)stats.info.numBlocks, (unsigned long long)stats.info.numTriangles,
+		(unsigned long long)stats.info.numVertices, (unsigned long long)stats.numDuplicatedVertices, stats.info.numChunks);
+	log::info("SceneConverter: %.2f MB source, %.2f MB decoded arrays, %.2f MB archive: %.1fx smaller than the source, %.1fx smaller than the arrays",
+		double(result.sourceBytes) / (1 << 20), double(stats.decodedBytes) / (1 << 20), double(stats.fileBytes) / (1 << 20),
+		double(result.sourceBytes) / double(std::max<uint64_t>(stats.fileBytes, 1)), double(stats.decodedBytes) / double(std::max<uint64_t>(stats.fileBytes, 1)));
+	log::info("SceneConverter: source load %.1f ms, archive read %.1f ms + decode %.1f ms (%.2f GB/s), write %.1f ms", result.sourceLoadMs, result.readMs,
+		result.decodeMs, result.decodeMs > 0.0 ? double(stats.decodedBytes) / 1e9 / (result.decodeMs / 1000.0) : 0.0, result.writeMs);
+	for (int s = 0; s < SceneArchive::NumStreams; s++) {
+		log::info("SceneConverter:   %-18s %10llu bytes, %10llu before entropy coding", SceneArchive::GetStreamName(SceneArchive::Stream(s)),
+			(unsigned long long)stats.streamBytes[s], (unsigned long long)stats.streamRawBytes[s]);
+	}
+
+	//Next to the archive, where the loader finds it for the archive and its source
+	if (buildPvs) {
+		PotentiallyVisibleSet pvs;
+		std::filesystem::path pvsFile = PotentiallyVisibleSet::GetFile(archive.parent_path(), archive.filename().string());
+		if (!pvs.Build(contents) || !pvs.Write(pvsFile, { scene, archive })) {
+			log::warning("SceneConverter: could not write the potentially visible set %s", pvsFile.string().c_str());
+			return false;
+		}
+		result.hasPvs = true;
+		result.pvsStats = pvs.GetStats();
+		log::info("SceneConverter: %s, %.2f MB", pvsFile.filename().string().c_str(), double(result.pvsStats.fileBytes) / (1 << 20));
+	}
+	return true;
+}
+
+static bool WriteReport(const std::filesystem::path& reportFile, const std::vector<ConversionResult>& results, uint numRuns) {
+	std::ofstream stream(reportFile);
+	if (!stream) {
+		log::warning("SceneConverter: could not write %s", reportFile.string().c_str());
+		return false;
+	}
+
+	stream.precision(6);
+	stream << std::fixed;
+	stream << "{\n  \"numThreads\": " << TaskScheduler::Get().GetNumThreads() << ",\n  \"numRuns\": " << numRuns << ",\n  \"scenes\": [";
+	for (size_t i = 0; i < results.size(); i++) {
+		const ConversionResult& result = results[i];
+		const SceneArchive::Stats& stats = result.stats;
+		double archiveBytes = double(std::max<uint64_t>(stats.fileBytes, 1));
+		stream << (i == 0 ? "\n" : ",\n");
+		stream << "    { \"scene\": \"" << BenchmarkReport::EscapeJson(result.scene) << "\", \"archive\": \"" << BenchmarkReport::EscapeJson(result.archive)
+			<< "\", \"blocks\": " << stats.info.numBlocks << ", \"triangles\": " << stats.info.numTriangles << ", \"vertices\": " << stats.info.numVertices
+			<< ", \"duplicatedVertices\": " << stats.numDuplicatedVertices << ", \"chunks\": " << stats.info.numChunks
+			<< ",\n      \"sourceBytes\": " << result.sourceBytes << ", \"decodedBytes\": " << stats.decodedBytes << ", \"archiveBytes\": " << stats.fileBytes
+			<< ", \"sourceRatio\": " << double(result.sourceBytes) / archiveBytes << ", \"decodedRatio\": " << double(stats.decodedBytes) / archiveBytes
+			<< ",\n      \"sourceLoadMs\": " << result.sourceLoadMs << ", \"readMs\": " << result.readMs << ", \"decodeMs\": " << result.decodeMs
+			<< ", \"decodeGBPerSecond\": " << (result.decodeMs > 0.0 ? double(stats.decodedBytes) / 1e9 / (result.decodeMs / 1000.0) : 0.0)
+			<< ", \"writeMs\": " << result.writeMs << ", \"verified\": " << (result.verified ? "true" : "false") << ",\n      \"streams\": [";
+		for (int s = 0; s < SceneArchive::NumStreams; s++) {
+			stream << (s == 0 ? " " : ", ") << "{ \"stream\": \"" << SceneArchive::GetStreamName(SceneArchive::Stream(s)) << "\", \"bytes\": " << stats.streamBytes[s]
+				<< ", \"rawBytes\": " << stats.streamRawBytes[s] << " }";
+		}
+		stream << " ]";
+		if (result.hasPvs) {
+			const PotentiallyVisibleSet::Stats& pvs = result.pvsStats;
+			stream << ",\n      \"pvs\": { \"cells\": " << pvs.numCells << ", \"occupiedCells\": " << pvs.numOccupiedCells << ", \"opaqueBlocks\": " << pvs.numOpaqueBlocks
+				<< ", \"viewpointCells\": " << pvs.numViewpointCells << ", \"visibleCellFraction\": " << pvs.visibleCellFraction
+				<< ", \"culledPrimitiveFraction\": " << pvs.culledPrimitiveFraction << ", \"buildMs\": " << pvs.buildMs
+				<< ", \"connectivityMs\": " << pvs.connectivityMs << ", \"visibilityMs\": " << pvs.visibilityMs << ", \"fileBytes\": " << pvs.fileBytes << " }";
+		}
+		stream << " }";
+	}
+	stream << "\n  ]\n}\n";
+	log::info("SceneConverter: report written to %s", reportFile.string().c_str());
+	return true;
+}
+
+static void PrintUsage() {
+	printf("Usage: SceneConverter [options] <scene .obj files or world folders>\n"
+		"  -out <file.mwa>        archive file, only for a single scene (default: next to the scene with the .mwa extension)\n"
+		"  -repeat <n>            decode runs, the report contains the median (default 3)\n"
+		"  -report <file.json>    report file (default SceneConverter.json)\n"
+		"  -noverify              does not compare the decoded archive with the source scene\n"
+		"  -pvs                   also writes the potentially visible set of the scene next to the archive (.pvs)\n");
+}
+
+int main(int argc, const char** argv)
+{
+	std::vector<std::filesystem::path> scenes;
+	std::filesystem::path archiveFile;
+	std::filesystem::path reportFile = "SceneConverter.json";
+	uint numRuns = 3;
+	bool verify = true;
+	bool buildPvs = false;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "-out" && hasValue)
+			archiveFile = argv[++i];
+		else if (arg == "-repeat" && hasValue)
+			numRuns = uint(std::max(std::atoi(argv[++i]), 1));
+		else if (arg == "-report" && hasValue)
+			reportFile = argv[++i];
+		else if (arg == "-noverify")
+			verify = false;
+		else if (arg == "-pvs")
+			buildPvs = true;
+		else if (arg[0] != '-')
+			scenes.push_back(arg);
+		else {
+			PrintUsage();
+			return 1;
+		}
+	}
+	if (scenes.empty() || (!archiveFile.empty() && scenes.size() > 1)) {
+		PrintUsage();
+		return 1;
+	}
+
+	//Archives are written next to their source by default, so the texture names stay relative to the scene folder
+	std::vector<ConversionResult> results;
+	bool succeeded = true;
+	for (const std::filesystem::path& scene : scenes) {
+		std::filesystem::path archive = !archiveFile.empty() ? archiveFile : scene.parent_path() / (scene.stem().string() + SceneArchive::k_Extension);
+		ConversionResult result;
+		if (ConvertScene(scene, archive, numRuns, verify, buildPvs, result))
+			results.push_back(result);
+		else
+			succeeded = false;
+	}
+
+	return WriteReport(reportFile, results, numRuns) && succeeded ? 0 : 1;
+}
@@ -0,0 +1,78 @@
+#include "SyntheticScene.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+static void PrintUsage() {
+	printf("Usage: SceneGenerator [options]\n"
+		"  -blocks <n>       number of blocks (default 100000)\n"
+		"  -types <n>        opaque block types (default 32)\n"
+		"  -alphatypes <n>   alpha tested block types (default 8)\n"
+		"  -skew <f>         Zipf exponent of the block type frequencies, 0 = uniform (default 1)\n"
+		"  -alpha <f>        fraction of alpha tested blocks (default 0.1)\n"
+		"  -props <f>        crossed quad props per terrain column (default 0.05)\n"
+		"  -flatprops <f>    flat quad props on the block grid per terrain column, like rails (default 0)\n"
+		"  -height <n>       average column height (default 24)\n"
+		"  -seed <n>         random seed (default 1)\n"
+		"  -notextures       do not write the texture PNGs\n"
+		"  -merged           only visible faces in one object, like an export without \"Export individual blocks\"\n"
+		"  -out <folder>     output folder (default: current folder)\n"
+		"  -name <name>      scene name without extension (default: encodes the settings)\n");
+}
+
+int main(int argc, const char** argv)
+{
+	SyntheticScene::Settings settings;
+	std::string outFolder = ".";
+	std::string name;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "-blocks" && hasValue)
+			settings.numBlocks = std::strtoull(argv[++i], nullptr, 10);
+		else if (arg == "-types" && hasValue)
+			settings.numBlockTypes = uint32_t(std::atoi(argv[++i]));
+		else if (arg == "-alphatypes" && hasValue)
+			settings.numAlphaTypes = uint32_t(std::atoi(argv[++i]));
+		else if (arg == "-skew" && hasValue)
+			settings.blockTypeSkew = float(std::atof(argv[++i]));
+		else if (arg == "-alpha" && hasValue)
+			settings.alphaFraction = float(std::atof(argv[++i]));
+		else if (arg == "-props" && hasValue)
+			settings.propDensity = float(std::atof(argv[++i]));
+		else if (arg == "-flatprops" && hasValue)
+			settings.flatPropDensity = float(std::atof(argv[++i]));
+		else if (arg == "-height" && hasValue)
+			settings.averageHeight = uint32_t(std::max(std::atoi(argv[++i]), 1));
+		else if (arg == "-seed" && hasValue)
+			settings.seed = std::strtoull(argv[++i], nullptr, 10);
+		else if (arg == "-notextures")
+			settings.writeTextures = false;
+		else if (arg == "-merged")
+			settings.mergedFaces = true;
+		else if (arg == "-out" && hasValue)
+			outFolder = argv[++i];
+		else if (arg == "-name" && hasValue)
+			name = argv[++i];
+		else {
+			PrintUsage();
+			return 1;
+		}
+	}
+	if (name.empty())
+		name = SyntheticScene::GetDefaultName(settings);
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	SyntheticScene::Stats stats;
+	if (!SyntheticScene::Write(outFolder, name, settings, stats)) {
+		fprintf(stderr, "SceneGenerator: could not write %s to %s\n", name.c_str(), outFolder.c_str());
+		return 1;
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+	printf("SceneGenerator: wrote %s.obj with %llu blocks, %llu props, %llu flat props, %llu triangles, %u materials, %.1f MB in %.1f s\n", name.c_str(),
+		(unsigned long long)stats.numBlocks, (unsigned long long)stats.numProps, (unsigned long long)stats.numFlatProps, (unsigned long long)stats.numTriangles, stats.numMaterials,
+		double(stats.objBytes) / (1 << 20), seconds);
+	return 0;
+}
@@ -0,0 +1,460 @@
+#include "SyntheticScene.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace {
+	//Corners of the quads of a block, vertex i is at (i & 1, (i >> 1) & 1, (i >> 2) & 1). Same face order as Mineways (-x, -y, -z, +x, +y, +z)
+	const int k_FaceCorners[6][4] = {
+		{ 0, 4, 6, 2 }, { 0, 1, 5, 4 }, { 0, 2, 3, 1 }, { 1, 3, 7, 5 }, { 2, 6, 7, 3 }, { 4, 5, 7, 6 }
+	};
+	const size_t k_WriteBufferSize = 1 << 20;
+	const uint32_t k_TextureSize = 16;
+	const uint32_t k_NoiseCellSize = 48;
+	const uint32_t k_DetailNoiseCellSize = 12;
+
+	//Deterministic hash of the seed and up to three coordinates (SplitMix64 finalizer per value)
+	uint64_t Hash(uint64_t seed, int64_t a, int64_t b = 0, int64_t c = 0) {
+		uint64_t h = seed ^ 0x9E3779B97F4A7C15ull;
+		for (uint64_t value : { uint64_t(a), uint64_t(b), uint64_t(c) }) {
+			h += value * 0xBF58476D1CE4E5B9ull + 0x9E3779B97F4A7C15ull;
+			h ^= h >> 30;
+			h *= 0xBF58476D1CE4E5B9ull;
+			h ^= h >> 27;
+			h *= 0x94D049BB133111EBull;
+			h ^= h >> 31;
+		}
+		return h;
+	}
+
+	//Uniform float in [0, 1)
+	float HashToFloat(uint64_t h) {
+		return float(h >> 40) / float(1 << 24);
+	}
+
+	//Smooth value noise in [-1, 1] on a grid with the given cell size
+	float ValueNoise(uint64_t seed, uint32_t x, uint32_t z, uint32_t cellSize) {
+		uint32_t cellX = x / cellSize, cellZ = z / cellSize;
+		float fx = float(x % cellSize) / float(cellSize);
+		float fz = float(z % cellSize) / float(cellSize);
+		fx = fx * fx * (3.f - 2.f * fx);
+		fz = fz * fz * (3.f - 2.f * fz);
+		float v00 = HashToFloat(Hash(seed, cellX, cellZ));
+		float v10 = HashToFloat(Hash(seed, cellX + 1, cellZ));
+		float v01 = HashToFloat(Hash(seed, cellX, cellZ + 1));
+		float v11 = HashToFloat(Hash(seed, cellX + 1, cellZ + 1));
+		float v = (v00 * (1.f - fx) + v10 * fx) * (1.f - fz) + (v01 * (1.f - fx) + v11 * fx) * fz;
+		return v * 2.f - 1.f;
+	}
+
+	uint32_t GetColumnHeight(const SyntheticScene::Settings& settings, uint32_t x, uint32_t z) {
+		float noise = 0.7f * ValueNoise(settings.seed, x, z, k_NoiseCellSize) + 0.3f * ValueNoise(settings.seed + 1, x, z, k_DetailNoiseCellSize);
+		long height = std::lround(float(settings.averageHeight) * (1.f + 0.5f * noise));
+		return uint32_t(std::max(height, 1l));
+	}
+
+	//Column layout of the terrain: columns are filled row by row until the block count is reached
+	struct TerrainLayout {
+		uint32_t width = 1;		//Columns per row (x)
+		uint32_t numRows = 0;	//Rows (z), the last one may be incomplete
+		uint32_t maxY = 0;		//Highest block or prop
+	};
+
+	TerrainLayout ComputeLayout(const SyntheticScene::Settings& settings) {
+		TerrainLayout layout;
+		uint64_t numColumns = (settings.numBlocks + settings.averageHeight - 1) / settings.averageHeight;
+		layout.width = uint32_t(std::max(std::ceil(std::sqrt(double(numColumns))), 1.0));
+		uint64_t numBlocks = 0;
+		for (uint32_t z = 0; numBlocks < settings.numBlocks; z++) {
+			for (uint32_t x = 0; x < layout.width && numBlocks < settings.numBlocks; x++) {
+				uint32_t height = uint32_t(std::min<uint64_t>(GetColumnHeight(settings, x, z), settings.numBlocks - numBlocks));
+				numBlocks += height;
+				layout.maxY = std::max(layout.maxY, height);	//A prop on top is at y = height
+			}
+			layout.numRows = z + 1;
+		}
+		return layout;
+	}
+
+	//Clipped column heights of one row, the columns are filled in the same order as by ComputeLayout
+	struct TerrainRow {
+		std::vector<uint32_t> heights;
+		uint64_t firstBlock = 0;	//Blocks in the rows before
+		uint64_t numBlocks = 0;
+	};
+
+	void ComputeRow(const SyntheticScene::Settings& settings, uint32_t width, uint32_t z, uint64_t firstBlock, TerrainRow& row) {
+		row.heights.assign(width, 0);
+		row.firstBlock = firstBlock;
+		row.numBlocks = 0;
+		for (uint32_t x = 0; x < width && firstBlock + row.numBlocks < settings.numBlocks; x++) {
+			row.heights[x] = uint32_t(std::min<uint64_t>(GetColumnHeight(settings, x, z), settings.numBlocks - firstBlock - row.numBlocks));
+			row.numBlocks += row.heights[x];
+		}
+	}
+
+	//Buffered text output with fast integer formatting, the .obj of large scenes has billions of numbers
+	class TextWriter {
+	public:
+		explicit TextWriter(FILE* file) : m_File(file) { m_Buffer.reserve(k_WriteBufferSize + 256); }
+
+		void Append(const char* str) { m_Buffer += str; }
+		void Append(const std::string& str) { m_Buffer += str; }
+		void Append(char c) { m_Buffer += c; }
+		void AppendInt(int64_t value) {
+			char digits[24];
+			int count = 0;
+			uint64_t magnitude = value < 0 ? uint64_t(0) - uint64_t(value) : uint64_t(value);
+			do {
+				digits[count++] = char('0' + magnitude % 10);
+				magnitude /= 10;
+			} while (magnitude > 0);
+			if (value < 0)
+				m_Buffer += '-';
+			while (count > 0)
+				m_Buffer += digits[--count];
+		}
+		//Writes the buffer to the file once it is full
+		void EndLine() {
+			m_Buffer += '\n';
+			if (m_Buffer.size() >= k_WriteBufferSize)
+				Flush();
+		}
+		bool Flush() {
+			if (!m_Buffer.empty() && fwrite(m_Buffer.data(), 1, m_Buffer.size(), m_File) != m_Buffer.size())
+				m_Failed = true;
+			m_BytesWritten += m_Buffer.size();
+			m_Buffer.clear();
+			return !m_Failed;
+		}
+		uint64_t GetBytesWritten() const { return m_BytesWritten + m_Buffer.size(); }
+
+	private:
+		FILE* m_File;
+		std::string m_Buffer;
+		uint64_t m_BytesWritten = 0;
+		bool m_Failed = false;
+	};
+
+	uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc) {
+		static uint32_t table[256] = {};
+		if (table[1] == 0) {
+			for (uint32_t i = 0; i < 256; i++) {
+				uint32_t c = i;
+				for (int k = 0; k < 8; k++)
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				table[i] = c;
+			}
+		}
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++)
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	void AppendBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+		out.push_back(uint8_t(value >> 24));
+		out.push_back(uint8_t(value >> 16));
+		out.push_back(uint8_t(value >> 8));
+		out.push_back(uint8_t(value));
+	}
+
+	void AppendChunk(std::vector<uint8_t>& png, const char* type, const std::vector<uint8_t>& data) {
+		AppendBigEndian(png, uint32_t(data.size()));
+		size_t typeOffset = png.size();
+		png.insert(png.end(), type, type + 4);
+		png.insert(png.end(), data.begin(), data.end());
+		AppendBigEndian(png, Crc32(&png[typeOffset], png.size() - typeOffset, 0));
+	}
+
+	//Writes an 8-bit RGBA PNG. The image data is stored without compression, the textures are tiny
+	bool WritePng(const std::filesystem::path& file, uint32_t width, uint32_t height, const std::vector<uint8_t>& rgba) {
+		std::vector<uint8_t> rows;
+		for (uint32_t y = 0; y < height; y++) {
+			rows.push_back(0);	//Filter type none
+			rows.insert(rows.end(), rgba.begin() + size_t(y) * width * 4, rgba.begin() + size_t(y + 1) * width * 4);
+		}
+
+		//zlib stream with stored DEFLATE blocks
+		std::vector<uint8_t> zlib = { 0x78, 0x01 };
+		size_t offset = 0;
+		do {
+			size_t blockSize = std::min<size_t>(rows.size() - offset, 0xFFFF);
+			zlib.push_back(offset + blockSize == rows.size() ? 1 : 0);
+			zlib.push_back(uint8_t(blockSize));
+			zlib.push_back(uint8_t(blockSize >> 8));
+			zlib.push_back(uint8_t(~blockSize));
+			zlib.push_back(uint8_t(~blockSize >> 8));
+			zlib.insert(zlib.end(), rows.begin() + offset, rows.begin() + offset + blockSize);
+			offset += blockSize;
+		} while (offset < rows.size());
+		uint32_t a = 1, b = 0;
+		for (uint8_t value : rows) {
+			a = (a + value) % 65521;
+			b = (b + a) % 65521;
+		}
+		AppendBigEndian(zlib, (b << 16) | a);
+
+		std::vector<uint8_t> header;
+		AppendBigEndian(header, width);
+		AppendBigEndian(header, height);
+		header.insert(header.end(), { 8, 6, 0, 0, 0 });	//8 bit, RGBA, deflate, no filter, no interlace
+
+		std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		AppendChunk(png, "IHDR", header);
+		AppendChunk(png, "IDAT", zlib);
+		AppendChunk(png, "IEND", {});
+
+		FILE* stream = fopen(file.string().c_str(), "wb");
+		if (!stream)
+			return false;
+		bool written = fwrite(png.data(), 1, png.size(), stream) == png.size();
+		return fclose(stream) == 0 && written;
+	}
+
+	//Noisy single color texture. Alpha tested textures have transparent holes
+	std::vector<uint8_t> CreateTexture(uint64_t seed, uint32_t materialIndex, bool alphaTested) {
+		uint64_t colorHash = Hash(seed, materialIndex, -1);
+		float baseColor[3] = { HashToFloat(colorHash), HashToFloat(colorHash << 8), HashToFloat(colorHash << 16) };
+		std::vector<uint8_t> rgba(k_TextureSize * k_TextureSize * 4);
+		for (uint32_t pixel = 0; pixel < k_TextureSize * k_TextureSize; pixel++) {
+			uint64_t pixelHash = Hash(seed, materialIndex, pixel);
+			float brightness = 0.75f + 0.25f * HashToFloat(pixelHash);
+			for (int c = 0; c < 3; c++)
+				rgba[pixel * 4 + c] = uint8_t(std::min(baseColor[c] * brightness, 1.f) * 255.f);
+			rgba[pixel * 4 + 3] = alphaTested && HashToFloat(pixelHash << 24) < 0.4f ? 0 : 255;
+		}
+		return rgba;
+	}
+}
+
+namespace SyntheticScene {
+	std::string GetDefaultName(const Settings& settings)
+	{
+		std::string blocks = std::to_string(settings.numBlocks);
+		//Powers of ten are written as 1eN
+		if (blocks.size() > 1 && blocks[0] == '1' && blocks.find_first_not_of('0', 1) == std::string::npos)
+			blocks = "1e" + std::to_string(blocks.size() - 1);
+		char suffix[64];
+		snprintf(suffix, sizeof(suffix), "_b%u_a%.2f_p%.2f", settings.numBlockTypes, settings.alphaFraction, settings.propDensity);
+		std::string flatProps;
+		if (settings.flatPropDensity > 0.f) {
+			char flatSuffix[32];
+			snprintf(flatSuffix, sizeof(flatSuffix), "_f%.2f", settings.flatPropDensity);
+			flatProps = flatSuffix;
+		}
+		return "synthetic_" + blocks + suffix + flatProps + (settings.mergedFaces ? "_m" : "");
+	}
+
+	bool Write(const std::filesystem::path& folder, const std::string& name, const Settings& settings, Stats& stats)
+	{
+		stats = Stats();
+		std::error_code error;
+		std::filesystem::create_directories(folder, error);
+
+		//Materials: top, side and bottom of each opaque block type, followed by one per alpha tested type
+		const uint32_t numBlockTypes = std::max(settings.numBlockTypes, 1u);
+		const uint32_t numAlphaTypes = std::max(settings.numAlphaTypes, 1u);
+		const uint32_t firstAlphaMaterial = numBlockTypes * 3;
+		std::vector<std::string> materialNames;
+		for (uint32_t type = 0; type < numBlockTypes; type++) {
+			materialNames.push_back("block_" + std::to_string(type) + "_top");
+			materialNames.push_back("block_" + std::to_string(type) + "_side");
+			materialNames.push_back("block_" + std::to_string(type) + "_bottom");
+		}
+		for (uint32_t type = 0; type < numAlphaTypes; type++)
+			materialNames.push_back("alpha_" + std::to_string(type));
+		stats.numMaterials = uint32_t(materialNames.size());
+
+		const std::string textureFolder = name + "_textures";
+		if (settings.writeTextures) {
+			std::filesystem::create_directories(folder / textureFolder, error);
+			for (uint32_t i = 0; i < materialNames.size(); i++) {
+				if (!WritePng(folder / textureFolder / (materialNames[i] + ".png"), k_TextureSize, k_TextureSize, CreateTexture(settings.seed, i, i >= firstAlphaMaterial)))
+					return false;
+			}
+		}
+
+		FILE* mtlFile = fopen((folder / (name + ".mtl")).string().c_str(), "wb");
+		if (!mtlFile)
+			return false;
+		{
+			TextWriter mtl(mtlFile);
+			for (uint32_t i = 0; i < materialNames.size(); i++) {
+				std::string texture = textureFolder + "/" + materialNames[i] + ".png";
+				mtl.Append("newmtl " + materialNames[i]); mtl.EndLine();
+				mtl.Append("Ns 0"); mtl.EndLine();
+				mtl.Append("Ka 0 0 0"); mtl.EndLine();
+				mtl.Append("Kd 1 1 1"); mtl.EndLine();
+				mtl.Append("Ks 0 0 0"); mtl.EndLine();
+				mtl.Append("map_Kd " + texture); mtl.EndLine();
+				if (i >= firstAlphaMaterial) {
+					mtl.Append("map_d " + texture); mtl.EndLine();
+				}
+				mtl.Append("illum 2"); mtl.EndLine();
+				mtl.EndLine();
+			}
+			mtl.Flush();
+		}
+		if (fclose(mtlFile) != 0)
+			return false;
+
+		//Cumulative Zipf distribution of the opaque block types
+		std::vector<float> typeCdf(numBlockTypes);
+		float weightSum = 0.f;
+		for (uint32_t type = 0; type < numBlockTypes; type++) {
+			weightSum += std::pow(float(type + 1), -settings.blockTypeSkew);
+			typeCdf[type] = weightSum;
+		}
+		for (float& value : typeCdf)
+			value /= weightSum;
+
+		FILE* objFile = fopen((folder / (name + ".obj")).string().c_str(), "wb");
+		if (!objFile)
+			return false;
+		TextWriter obj(objFile);
+		const TerrainLayout layout = ComputeLayout(settings);
+		obj.Append("# Wavefront OBJ file made by the Mineways Renderer SceneGenerator (synthetic Mineways export)"); obj.EndLine();
+		obj.Append("# Selection location min to max: 0, 0, 0 to "); obj.AppendInt(layout.width - 1); obj.Append(", ");
+		obj.AppendInt(layout.maxY); obj.Append(", "); obj.AppendInt(int64_t(layout.numRows) - 1); obj.EndLine();
+		obj.EndLine();
+		obj.Append("mtllib " + name + ".mtl"); obj.EndLine();
+		obj.EndLine();
+		//Face normals in face order, followed by the normals of the two prop quads
+		obj.Append("vn -1 0 0\nvn 0 -1 0\nvn 0 0 -1\nvn 1 0 0\nvn 0 1 0\nvn 0 0 1\nvn 0.7071 0 -0.7071\nvn 0.7071 0 0.7071"); obj.EndLine();
+		obj.Append("vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1"); obj.EndLine();
+
+		uint32_t currentMaterial = ~0u;
+		auto useMaterial = [&](uint32_t material) {
+			if (material == currentMaterial)
+				return;
+			currentMaterial = material;
+			obj.Append("usemtl "); obj.Append(materialNames[material]); obj.EndLine();
+		};
+		auto appendFaceVertex = [&](uint64_t vertex, int texcoord, int normal) {
+			obj.Append(' '); obj.AppendInt(int64_t(vertex)); obj.Append('/'); obj.AppendInt(texcoord); obj.Append('/'); obj.AppendInt(normal);
+		};
+
+		auto isAlphaBlock = [&](uint32_t x, uint32_t y, uint32_t z) {
+			return HashToFloat(Hash(settings.seed, x, y, z)) < settings.alphaFraction;
+		};
+		//Rows z - 1, z and z + 1 for the neighbors of the merged faces
+		TerrainRow rows[3];
+		ComputeRow(settings, layout.width, 0, 0, rows[1]);
+		ComputeRow(settings, layout.width, 1, rows[1].numBlocks, rows[2]);
+		auto isCovered = [&](uint32_t x, uint32_t y, uint32_t z, int face) {
+			static const int k_FaceOffsets[6][3] = { { -1, 0, 0 }, { 0, -1, 0 }, { 0, 0, -1 }, { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+			int64_t nx = int64_t(x) + k_FaceOffsets[face][0], ny = int64_t(y) + k_FaceOffsets[face][1], nz = int64_t(z) + k_FaceOffsets[face][2];
+			if (nx < 0 || ny < 0 || nz < 0 || nx >= int64_t(layout.width))
+				return false;
+			const TerrainRow& row = rows[1 + k_FaceOffsets[face][2]];
+			return ny < int64_t(row.heights[nx]) && !isAlphaBlock(uint32_t(nx), uint32_t(ny), uint32_t(nz));
+		};
+		if (settings.mergedFaces) {
+			obj.Append("o terrain"); obj.EndLine();
+		}
+
+		uint64_t numVertices = 0;
+		for (uint32_t z = 0; stats.numBlocks < settings.numBlocks; z++) {
+			if (z > 0) {
+				std::swap(rows[0], rows[1]);
+				std::swap(rows[1], rows[2]);
+				ComputeRow(settings, layout.width, z + 1, rows[1].firstBlock + rows[1].numBlocks, rows[2]);
+			}
+			for (uint32_t x = 0; x < layout.width && stats.numBlocks < settings.numBlocks; x++) {
+				uint32_t height = rows[1].heights[x];
+				for (uint32_t y = 0; y < height; y++) {
+					uint64_t blockHash = Hash(settings.seed, x, y, z);
+					uint32_t faceMaterials[6];
+					if (isAlphaBlock(x, y, z)) {
+						uint32_t material = firstAlphaMaterial + uint32_t((blockHash >> 8) % numAlphaTypes);
+						std::fill(faceMaterials, faceMaterials + 6, material);
+					}
+					else {
+						float u = HashToFloat(blockHash << 24);
+						uint32_t type = uint32_t(std::min<size_t>(std::upper_bound(typeCdf.begin(), typeCdf.end(), u) - typeCdf.begin(), numBlockTypes - 1));
+						std::fill(faceMaterials, faceMaterials + 6, type * 3 + 1);
+						faceMaterials[1] = type * 3 + 2;
+						faceMaterials[4] = type * 3;
+					}
+
+					//Faces between two alpha tested blocks are kept, Mineways only removes faces behind opaque blocks
+					bool visibleFaces[6];
+					int numVisibleFaces = 0;
+					for (int face = 0; face < 6; face++) {
+						visibleFaces[face] = !settings.mergedFaces || !isCovered(x, y, z, face);
+						numVisibleFaces += visibleFaces[face] ? 1 : 0;
+					}
+					stats.numBlocks++;
+					if (numVisibleFaces == 0)
+						continue;
+
+					if (!settings.mergedFaces) {
+						obj.Append("o block_"); obj.AppendInt(int64_t(stats.numBlocks - 1)); obj.EndLine();
+					}
+					for (int corner = 0; corner < 8; corner++) {
+						obj.Append("v "); obj.AppendInt(x + (corner & 1)); obj.Append(' ');
+						obj.AppendInt(y + ((corner >> 1) & 1)); obj.Append(' '); obj.AppendInt(z + ((corner >> 2) & 1)); obj.EndLine();
+					}
+					for (int face = 0; face < 6; face++) {
+						if (!visibleFaces[face])
+							continue;
+						useMaterial(faceMaterials[face]);
+						obj.Append('f');
+						for (int k = 0; k < 4; k++)
+							appendFaceVertex(numVertices + 1 + k_FaceCorners[face][k], k + 1, face + 1);
+						obj.EndLine();
+					}
+					numVertices += 8;
+					stats.numTriangles += 2 * numVisibleFaces;
+				}
+
+				//Crossed quads on top of the column
+				if (HashToFloat(Hash(settings.seed + 2, x, z)) < settings.propDensity) {
+					if (!settings.mergedFaces) {
+						obj.Append("o prop_"); obj.AppendInt(int64_t(stats.numProps)); obj.EndLine();
+					}
+					const int corners[8][3] = { { 0, 0, 0 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 0 }, { 1, 0, 0 }, { 0, 0, 1 }, { 0, 1, 1 }, { 1, 1, 0 } };
+					for (const auto& corner : corners) {
+						obj.Append("v "); obj.AppendInt(x + corner[0]); obj.Append(' ');
+						obj.AppendInt(height + corner[1]); obj.Append(' '); obj.AppendInt(z + corner[2]); obj.EndLine();
+					}
+					useMaterial(firstAlphaMaterial + uint32_t(Hash(settings.seed + 3, x, z) % numAlphaTypes));
+					for (int quad = 0; quad < 2; quad++) {
+						obj.Append('f');
+						for (int k = 0; k < 4; k++)
+							appendFaceVertex(numVertices + 1 + quad * 4 + k, k + 1, 7 + quad);
+						obj.EndLine();
+					}
+					numVertices += 8;
+					stats.numProps++;
+					stats.numTriangles += 4;
+				}
+
+				//Flat quad on the top face of the column, with the corners of the +y face
+				if (HashToFloat(Hash(settings.seed + 4, x, z)) < settings.flatPropDensity) {
+					if (!settings.mergedFaces) {
+						obj.Append("o flat_prop_"); obj.AppendInt(int64_t(stats.numFlatProps)); obj.EndLine();
+					}
+					for (int k = 0; k < 4; k++) {
+						int corner = k_FaceCorners[4][k];
+						obj.Append("v "); obj.AppendInt(x + (corner & 1)); obj.Append(' ');
+						obj.AppendInt(height); obj.Append(' '); obj.AppendInt(z + ((corner >> 2) & 1)); obj.EndLine();
+					}
+					useMaterial(firstAlphaMaterial + uint32_t(Hash(settings.seed + 5, x, z) % numAlphaTypes));
+					obj.Append('f');
+					for (int k = 0; k < 4; k++)
+						appendFaceVertex(numVertices + 1 + k, k + 1, 5);
+					obj.EndLine();
+					numVertices += 4;
+					stats.numFlatProps++;
+					stats.numTriangles += 2;
+				}
+			}
+		}
+		bool written = obj.Flush();
+		stats.objBytes = obj.GetBytesWritten();
+		return fclose(objFile) == 0 && written;
+	}
+}
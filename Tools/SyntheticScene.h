@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+/* Writes synthetic scenes in the format of a Mineways .obj export with "Export individual blocks" enabled:
+   every block is an "o" group with 8 vertices and 6 quads (-x, -y, -z, +x, +y, +z), props are crossed quads or flat quads,
+   and the .mtl references one 16x16 PNG per material in a texture folder next to it.
+   The blocks form a height field terrain, so the scenes behave like real exports for the spatial sort and the occupancy grid.
+   With mergedFaces the export looks like one without "Export individual blocks": a single object with only the faces that are not covered
+   by an opaque neighbor, which is what the loader rebuilds blocks from.
+   The output is streamed, the memory use does not depend on the scene size
+*/
+namespace SyntheticScene {
+	struct Settings {
+		uint64_t numBlocks = 100000;
+		uint32_t numBlockTypes = 32;	//Opaque block types, each with a top, side and bottom material
+		uint32_t numAlphaTypes = 8;		//Alpha tested block types (leaves, glass), also used for the props
+		float blockTypeSkew = 1.f;		//Zipf exponent of the block type frequencies, 0 = uniform
+		float alphaFraction = 0.1f;		//Fraction of the blocks with an alpha tested type
+		float propDensity = 0.05f;		//Probability of a prop (crossed quads, 4 triangles) on top of a column
+		float flatPropDensity = 0.f;	//Probability of a flat prop (rails, carpets) on top of a column, a quad on the block grid with the whole texture
+		uint32_t averageHeight = 24;	//Average column height in blocks
+		uint64_t seed = 1;
+		bool writeTextures = true;
+		bool mergedFaces = false;		//Only visible faces in one object instead of an object per block
+	};
+
+	struct Stats {
+		uint64_t numBlocks = 0;
+		uint64_t numProps = 0;
+		uint64_t numFlatProps = 0;
+		uint64_t numTriangles = 0;
+		uint32_t numMaterials = 0;
+		uint64_t objBytes = 0;
+	};
+
+	//Writes folder/name.obj, folder/name.mtl and folder/name_textures/*.png. Returns false if a file could not be written
+	bool Write(const std::filesystem::path& folder, const std::string& name, const Settings& settings, Stats& stats);
+
+	//Scene name that encodes the settings, e.g. "synthetic_1e6_b32_a0.10_p0.05", merged face scenes end with "_m"
+	std::string GetDefaultName(const Settings& settings);
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdio>
+#include <string>
+
+//Checks of the tests in this folder. Every test is an executable that returns FinishTest(...) from main, ctest treats a nonzero exit code as failure
+
+inline unsigned g_NumFailedChecks = 0;
+
+//Prints the message of a failed check, the test continues to report all failures at once
+inline void Check(bool condition, const std::string& message) {
+	if (condition)
+		return;
+	printf("FAILED %s\n", message.c_str());
+	g_NumFailedChecks++;
+}
+
+//Prints the summary line of the test and returns the exit code of main
+inline int FinishTest(const char* testName) {
+	if (g_NumFailedChecks > 0) {
+		printf("%s: %u checks failed\n", testName, g_NumFailedChecks);
+		return 1;
+	}
+	printf("%s: all checks passed\n", testName);
+	return 0;
+}
@@ -0,0 +1,106 @@
+#include "MinecraftSceneLoader.h"
+#include "SyntheticScene.h"
+#include "TestUtils.h"
+#include <cmath>
+#include <fstream>
+#include <set>
+#include <string>
+#include <tuple>
+
+//Loads synthetic exports with flat props on the block grid and checks that the block reconstruction only rebuilds the merged faces of blocks
+
+static bool LoadScene(const std::filesystem::path& folder, const std::string& name, MinecraftSceneLoader& loader) {
+	std::vector<tinyobj::material_t> materials;
+	std::vector<uint> materialSourceIndices;
+	return loader.PrepareScene(folder, name + ".obj", materials, materialSourceIndices);
+}
+
+//Every box has to be a unit block in its own cell
+static bool HasUniqueCells(const std::vector<AABB>& aabbs) {
+	std::set<std::tuple<int, int, int>> cells;
+	for (const AABB& aabb : aabbs) {
+		if (!cells.emplace(int(std::floor(aabb.min.x + 0.5f)), int(std::floor(aabb.min.y + 0.5f)), int(std::floor(aabb.min.z + 0.5f))).second)
+			return false;
+	}
+	return true;
+}
+
+//Appends an individual block with the corners and face order of SyntheticScene, the face indices are relative to the end of the vertex list
+static bool AppendLoneBlock(const std::filesystem::path& objFile, int3 position) {
+	std::ofstream stream(objFile, std::ios::app);
+	stream << "o lone_block\n";
+	for (int corner = 0; corner < 8; corner++)
+		stream << "v " << position.x + (corner & 1) << " " << position.y + ((corner >> 1) & 1) << " " << position.z + ((corner >> 2) & 1) << "\n";
+	stream << "usemtl block_0_side\n";
+	const int faceCorners[6][4] = { { 0, 4, 6, 2 }, { 0, 1, 5, 4 }, { 0, 2, 3, 1 }, { 1, 3, 7, 5 }, { 2, 6, 7, 3 }, { 4, 5, 7, 6 } };
+	for (int face = 0; face < 6; face++) {
+		stream << "f";
+		for (int k = 0; k < 4; k++)
+			stream << " " << faceCorners[face][k] - 8 << "/" << k + 1 << "/" << face + 1;
+		stream << "\n";
+	}
+	return bool(stream);
+}
+
+int main()
+{
+	const std::filesystem::path folder = std::filesystem::temp_directory_path() / "VoxelReconstructionTest";
+	std::error_code error;
+	std::filesystem::remove_all(folder, error);
+
+	SyntheticScene::Settings settings;
+	settings.numBlocks = 5000;
+	settings.propDensity = 0.05f;
+	settings.flatPropDensity = 0.2f;
+	settings.writeTextures = false;
+
+	//Export individual blocks: every block is a 12 triangle shape and becomes one box, as without the reconstruction.
+	//The flat props lie on the top faces of the columns and stay triangles, they must not become a second box
+	SyntheticScene::Stats stats;
+	Check(SyntheticScene::Write(folder, "individual", settings, stats), "could not write the individual block export");
+	Check(stats.numFlatProps > 0, "the individual block export has no flat props");
+	{
+		MinecraftSceneLoader loader(nullptr);
+		Check(LoadScene(folder, "individual", loader), "could not load the individual block export");
+		Check(loader.GetAABBs().size() == stats.numBlocks, "the individual block export has " + std::to_string(loader.GetAABBs().size()) +
+			" boxes instead of one per block (" + std::to_string(stats.numBlocks) + ")");
+		Check(loader.GetTriangleMaterialIDs().size() == 4 * stats.numProps + 2 * stats.numFlatProps, "props of the individual block export did not stay triangles");
+	}
+
+	//The merged face export of the same terrain is still rebuilt into blocks
+	settings.mergedFaces = true;
+	settings.flatPropDensity = 0.f;
+	Check(SyntheticScene::Write(folder, "merged", settings, stats), "could not write the merged face export");
+	size_t numMergedBlocks = 0;
+	{
+		MinecraftSceneLoader loader(nullptr);
+		Check(LoadScene(folder, "merged", loader), "could not load the merged face export");
+		numMergedBlocks = loader.GetAABBs().size();
+		Check(numMergedBlocks > 0 && numMergedBlocks <= stats.numBlocks, "the merged face export is not rebuilt into blocks");
+		Check(HasUniqueCells(loader.GetAABBs()), "the merged face export has two boxes in the same cell");
+	}
+
+	//Flat props of a merged face export claim the top face of their column, that block stays triangles instead of getting a second box
+	settings.flatPropDensity = 0.2f;
+	Check(SyntheticScene::Write(folder, "merged_flat", settings, stats), "could not write the merged face export with flat props");
+	Check(stats.numFlatProps > 0, "the merged face export has no flat props");
+	{
+		MinecraftSceneLoader loader(nullptr);
+		Check(LoadScene(folder, "merged_flat", loader), "could not load the merged face export with flat props");
+		Check(loader.GetAABBs().size() + stats.numFlatProps == numMergedBlocks, "the merged face export with flat props has " + std::to_string(loader.GetAABBs().size()) +
+			" boxes instead of " + std::to_string(numMergedBlocks - stats.numFlatProps));
+		Check(HasUniqueCells(loader.GetAABBs()), "a flat prop of the merged face export became a second box");
+	}
+
+	//Exports split by block type can contain a lone block with all faces visible as a 12 triangle shape, the rest is still rebuilt
+	Check(AppendLoneBlock(folder / "merged_flat.obj", int3(-10, 0, -10)), "could not append the lone block");
+	{
+		MinecraftSceneLoader loader(nullptr);
+		Check(LoadScene(folder, "merged_flat", loader), "could not load the merged face export with a lone block");
+		Check(loader.GetAABBs().size() + stats.numFlatProps == numMergedBlocks + 1, "a lone block in a merged face export changes the rebuilt blocks to " +
+			std::to_string(loader.GetAABBs().size()) + " boxes");
+	}
+
+	std::filesystem::remove_all(folder, error);
+	return FinishTest("VoxelReconstructionTest");
+}